@@ -0,0 +1,679 @@
+#include "devices/ahci.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "devices/pci.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/mmio.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* The code in this file is a driver for SATA disks attached to
+   an AHCI host bus adapter, as described in [AHCI 1.3.1], such
+   as QEMU's "-device ahci" or the SATA controller of most PCs
+   made since 2005.
+
+   An AHCI port has a list of 32 command slots in memory.  To
+   issue a command, the driver fills in a slot's command table
+   with the command's FIS, the frame that the disk receives, and
+   a list of the memory it transfers, then sets the slot's bit in
+   the port's command issue register.  The adapter clears the bit
+   once the command is done.  With native command queuing (NCQ),
+   the disk takes up to 32 reads and writes at once, each tagged
+   with its slot, and finishes them in whatever order suits it,
+   so the driver implements the block layer's asynchronous START
+   operation and the block layer keeps the queue full.  Without
+   NCQ, only one command is outstanding at a time.
+
+   Disks are named "sda", "sdb" and so on, in PCI order and then
+   port order, and are registered as raw devices whose partitions
+   give them their roles, as for IDE. */
+
+/* PCI programming interface of an AHCI mass storage controller
+   of subclass SATA. */
+#define PROG_IF_AHCI 0x01
+
+/* Adapter registers, as byte offsets from ABAR, the memory base
+   address in BAR5. */
+#define HBA_CAP 0x00            /* Capabilities. */
+#define HBA_GHC 0x04            /* Global host control. */
+#define HBA_IS 0x08             /* Interrupt status, one bit per port. */
+#define HBA_PI 0x0c             /* Ports implemented. */
+
+/* Capability bits and fields. */
+#define CAP_NP(CAP) (((CAP) & 0x1f) + 1)          /* Ports. */
+#define CAP_NCS(CAP) ((((CAP) >> 8) & 0x1f) + 1)  /* Command slots. */
+#define CAP_SNCQ (1u << 30)     /* Supports native command queuing. */
+
+/* Global host control bits. */
+#define GHC_IE (1u << 1)        /* Interrupts enabled. */
+#define GHC_AE (1u << 31)       /* AHCI enabled. */
+
+/* Port registers, as byte offsets from the port's base at
+   PORT_BASE. */
+#define PORT_BASE(PORT) (0x100 + (PORT) * 0x80)
+#define PX_CLB 0x00             /* Command list base, low 32 bits. */
+#define PX_CLBU 0x04            /* Command list base, high 32 bits. */
+#define PX_FB 0x08              /* Received FIS base, low 32 bits. */
+#define PX_FBU 0x0c             /* Received FIS base, high 32 bits. */
+#define PX_IS 0x10              /* Interrupt status. */
+#define PX_IE 0x14              /* Interrupt enable. */
+#define PX_CMD 0x18             /* Command and status. */
+#define PX_TFD 0x20             /* Task file data: status, error. */
+#define PX_SIG 0x24             /* Signature of the attached device. */
+#define PX_SSTS 0x28            /* SATA status. */
+#define PX_SERR 0x30            /* SATA error. */
+#define PX_SACT 0x34            /* Queued commands still active. */
+#define PX_CI 0x38              /* Commands issued, not yet done. */
+
+/* Port command and status bits. */
+#define CMD_ST (1u << 0)        /* Start processing the command list. */
+#define CMD_FRE (1u << 4)       /* Accept received FISes. */
+#define CMD_FR (1u << 14)       /* Received FIS engine running. */
+#define CMD_CR (1u << 15)       /* Command list engine running. */
+
+/* Port interrupt bits. */
+#define IS_DHRS (1u << 0)       /* Register FIS from the device. */
+#define IS_PSS (1u << 1)        /* PIO setup FIS from the device. */
+#define IS_SDBS (1u << 3)       /* Set device bits FIS: NCQ done. */
+#define IS_IFS (1u << 27)       /* Interface fatal error. */
+#define IS_HBDS (1u << 28)      /* Host bus data error. */
+#define IS_HBFS (1u << 29)      /* Host bus fatal error. */
+#define IS_TFES (1u << 30)      /* Device reported an error. */
+#define IS_ERRORS (IS_IFS | IS_HBDS | IS_HBFS | IS_TFES)
+
+/* Task file status bits. */
+#define TFD_ERR 0x01            /* Error. */
+#define TFD_DRQ 0x08            /* Data request. */
+#define TFD_BSY 0x80            /* Busy. */
+
+/* Device detection in SSTS bits 3:0: present, link up. */
+#define SSTS_DET(SSTS) ((SSTS) & 0xf)
+#define SSTS_DET_PRESENT 3
+
+/* Signature of an ATA disk, as opposed to an ATAPI drive or a
+   port multiplier. */
+#define SIG_ATA 0x00000101
+
+/* ATA commands. */
+#define CMD_READ_DMA 0xc8               /* 28-bit LBA. */
+#define CMD_WRITE_DMA 0xca
+#define CMD_READ_DMA_EXT 0x25           /* 48-bit LBA. */
+#define CMD_WRITE_DMA_EXT 0x35
+#define CMD_READ_FPDMA_QUEUED 0x60      /* NCQ. */
+#define CMD_WRITE_FPDMA_QUEUED 0x61
+#define CMD_FLUSH_CACHE 0xe7
+#define CMD_FLUSH_CACHE_EXT 0xea
+#define CMD_IDENTIFY_DEVICE 0xec
+
+/* Register host to device FIS, which carries a command. */
+#define FIS_TYPE_H2D 0x27
+#define FIS_H2D_COMMAND 0x80    /* Byte 1: command, not control. */
+#define FIS_DEV_LBA 0x40        /* Device byte: address is an LBA. */
+#define FIS_H2D_LEN 20          /* Length in bytes. */
+
+/* Command header: one per slot in the command list. */
+struct cmd_header
+  {
+    uint16_t flags;             /* FIS length in dwords, HDR_*. */
+    uint16_t prdtl;             /* Entries in the PRD table. */
+    volatile uint32_t prdbc;    /* Bytes transferred. */
+    uint32_t ctba;              /* Command table address, low. */
+    uint32_t ctbau;             /* Command table address, high. */
+    uint32_t reserved[4];
+  };
+#define HDR_WRITE 0x40          /* Data goes to the device. */
+
+/* Physical region descriptor: one contiguous piece of a
+   transfer's memory. */
+struct prd
+  {
+    uint32_t dba;               /* Data base address, low. */
+    uint32_t dbau;              /* Data base address, high. */
+    uint32_t reserved;
+    uint32_t dbc;               /* Bytes - 1, PRD_INTR. */
+  };
+#define PRD_INTR (1u << 31)     /* Interrupt when done. */
+#define PRD_BYTES_MAX (4 * 1024 * 1024)
+
+/* Entries in each command table's PRD table.  Kernel buffers are
+   physically contiguous, so each transfer needs one entry per
+   PRD_BYTES_MAX bytes. */
+#define PRDT_CNT 8
+
+/* Command table: one per slot. */
+struct cmd_table
+  {
+    uint8_t cfis[64];           /* Command FIS. */
+    uint8_t acmd[16];           /* ATAPI command, unused. */
+    uint8_t reserved[48];
+    struct prd prdt[PRDT_CNT];  /* Memory to transfer. */
+  };
+
+/* Most command slots on a port. */
+#define SLOT_MAX 32
+
+/* Sizes of a port's structures, which share PORT_PAGES pages:
+   the command list, then the received FIS area, then the
+   command tables. */
+#define CMD_LIST_SIZE (SLOT_MAX * sizeof (struct cmd_header))
+#define RX_FIS_SIZE 256
+#define PORT_PAGES (1 + (SLOT_MAX * sizeof (struct cmd_table) \
+                         + PGSIZE - 1) / PGSIZE)
+
+/* A command slot. */
+struct slot
+  {
+    void *tag;                  /* Tag for block_start_done(), or... */
+    struct semaphore *done;     /* ...if nonnull, up'd once done. */
+  };
+
+/* A SATA disk on an AHCI port. */
+struct ahci_port
+  {
+    char name[8];               /* Name, e.g. "sda". */
+    volatile uint32_t *hba;     /* Adapter's registers. */
+    volatile uint32_t *regs;    /* Port's registers. */
+    int port_no;                /* Port number on the adapter. */
+    uint8_t irq;                /* Interrupt vector. */
+    bool ncq;                   /* Using native command queuing? */
+    bool lba48;                 /* Supports 48-bit addresses? */
+    bool flush;                 /* Supports FLUSH CACHE? */
+    int slot_cnt;               /* Number of slots in use. */
+
+    struct cmd_header *cmds;    /* Command list. */
+    struct cmd_table *tables;   /* Command tables, one per slot. */
+    struct slot slots[SLOT_MAX];
+
+    /* ACTIVE and FREE_MASK are touched by the interrupt handler,
+       so threads touch them with interrupts off. */
+    uint32_t active;            /* Slots issued and not done. */
+    uint32_t free_mask;         /* Slots not in use. */
+    struct semaphore free_cnt;  /* Number of bits in FREE_MASK. */
+
+    /* Held while issuing a command.  A flush holds it while it
+       waits for every slot to drain, since a non-queued command
+       may not be issued alongside queued ones. */
+    struct lock issue_lock;
+  };
+
+/* Most AHCI disks. */
+#define PORT_MAX 8
+static struct ahci_port ports[PORT_MAX];
+static size_t port_cnt;
+
+static struct block_operations ahci_operations;
+
+static bool probe (struct pci_dev *, const struct pci_id *);
+static bool setup_port (struct ahci_port *);
+static bool stop_port (struct ahci_port *);
+static void identify (struct ahci_port *, uint32_t hba_cap);
+static void issue (struct ahci_port *, uint8_t command,
+                   block_sector_t, size_t cnt, void *buffer, size_t size,
+                   bool write, void *tag, struct semaphore *done);
+static void issue_sync (struct ahci_port *, uint8_t command,
+                        void *buffer, size_t size);
+static void interrupt_handler (struct intr_frame *);
+
+static const struct pci_id ahci_ids[] =
+  {
+    {PCI_ANY, PCI_ANY, PCI_CLASS (0x01, 0x06)},
+    {0, 0, 0},
+  };
+
+static const struct pci_driver ahci_driver =
+  {
+    "ahci", ahci_ids, probe,
+  };
+
+/* Registers the AHCI driver, so that it finds AHCI adapters on
+   the PCI bus and registers the disks attached to them as block
+   devices. */
+void
+ahci_init (void)
+{
+  pci_register_driver (&ahci_driver);
+}
+
+/* Sets up AHCI adapter DEV and registers each disk attached to
+   it.  Returns true if successful. */
+static bool
+probe (struct pci_dev *dev, const struct pci_id *id UNUSED)
+{
+  const struct pci_bar *bar = &dev->bars[5];
+  volatile uint32_t *hba;
+  uint32_t cap, implemented;
+  size_t first, i;
+  int port_no;
+
+  if (dev->prog_if != PROG_IF_AHCI)
+    return false;
+  if (bar->io || bar->base == 0)
+    {
+      printf ("ahci: no memory base address, ignoring\n");
+      return false;
+    }
+  if (dev->irq == PCI_IRQ_NONE)
+    {
+      printf ("ahci: no interrupt line, ignoring\n");
+      return false;
+    }
+  pci_enable (dev, PCI_CMD_MEMORY | PCI_CMD_MASTER);
+  hba = mmio_map (bar->base, bar->size);
+  hba[HBA_GHC / 4] |= GHC_AE;
+  cap = hba[HBA_CAP / 4];
+  implemented = hba[HBA_PI / 4];
+
+  first = port_cnt;
+  for (port_no = 0; port_no < 32 && port_cnt < PORT_MAX; port_no++)
+    {
+      struct ahci_port *p = &ports[port_cnt];
+
+      if (!(implemented & (1u << port_no)))
+        continue;
+      snprintf (p->name, sizeof p->name, "sd%c", (int) ('a' + port_cnt));
+      p->hba = hba;
+      p->regs = (volatile uint32_t *) ((uint8_t *) hba + PORT_BASE (port_no));
+      p->port_no = port_no;
+      p->irq = dev->irq + 0x20;
+      p->slot_cnt = CAP_NCS (cap);
+      if (!setup_port (p))
+        continue;
+
+      /* The interrupt handler looks only at the first PORT_CNT
+         ports. */
+      port_cnt++;
+    }
+  if (port_cnt == first)
+    return false;
+
+  /* Adapters on the same line share its handler. */
+  for (i = 0; i < first; i++)
+    if (ports[i].irq == ports[first].irq)
+      break;
+  if (i == first)
+    intr_register_ext (ports[first].irq, interrupt_handler, "AHCI");
+
+  /* Identify each disk now that the handler will see its
+     interrupts. */
+  hba[HBA_IS / 4] = hba[HBA_IS / 4];
+  hba[HBA_GHC / 4] |= GHC_IE;
+  for (i = first; i < port_cnt; i++)
+    identify (&ports[i], cap);
+  return true;
+}
+
+/* Sets up port P, if a disk is attached to it: gives it memory
+   for its command list, received FISes and command tables and
+   starts it.  Returns true if successful, false if the port has
+   no usable disk. */
+static bool
+setup_port (struct ahci_port *p)
+{
+  uint8_t *pages;
+  int i;
+
+  if (SSTS_DET (p->regs[PX_SSTS / 4]) != SSTS_DET_PRESENT
+      || p->regs[PX_SIG / 4] != SIG_ATA)
+    return false;
+  if (!stop_port (p))
+    {
+      printf ("%s: port %d will not stop, ignoring\n", p->name, p->port_no);
+      return false;
+    }
+
+  pages = palloc_get_multiple (PAL_ZERO, PORT_PAGES);
+  if (pages == NULL)
+    {
+      printf ("%s: out of memory, ignoring\n", p->name);
+      return false;
+    }
+  p->cmds = (struct cmd_header *) pages;
+  p->tables = (struct cmd_table *) (pages + PGSIZE);
+  for (i = 0; i < SLOT_MAX; i++)
+    p->cmds[i].ctba = vtop (&p->tables[i]);
+  p->regs[PX_CLB / 4] = vtop (p->cmds);
+  p->regs[PX_CLBU / 4] = 0;
+  p->regs[PX_FB / 4] = vtop (pages + CMD_LIST_SIZE);
+  p->regs[PX_FBU / 4] = 0;
+
+  /* Until IDENTIFY DEVICE says whether the disk queues commands,
+     use a single slot. */
+  p->ncq = false;
+  p->lba48 = false;
+  p->active = 0;
+  p->free_mask = 1;
+  sema_init (&p->free_cnt, 1);
+  lock_init (&p->issue_lock);
+
+  /* Clear stale errors and interrupts, then start. */
+  p->regs[PX_CMD / 4] |= CMD_FRE;
+  p->regs[PX_SERR / 4] = 0xffffffff;
+  p->regs[PX_IS / 4] = 0xffffffff;
+  p->regs[PX_IE / 4] = IS_DHRS | IS_PSS | IS_SDBS | IS_ERRORS;
+  for (i = 0; i < 1000 && p->regs[PX_TFD / 4] & (TFD_BSY | TFD_DRQ); i++)
+    timer_msleep (1);
+  p->regs[PX_CMD / 4] |= CMD_ST;
+  return true;
+}
+
+/* Stops port P's command list and received FIS engines, as must
+   be done before moving its memory.  Returns true if
+   successful, false if they are still running after half a
+   second. */
+static bool
+stop_port (struct ahci_port *p)
+{
+  int i;
+
+  p->regs[PX_CMD / 4] &= ~CMD_ST;
+  for (i = 0; i < 500 && p->regs[PX_CMD / 4] & CMD_CR; i++)
+    timer_msleep (1);
+  p->regs[PX_CMD / 4] &= ~CMD_FRE;
+  for (; i < 500 && p->regs[PX_CMD / 4] & CMD_FR; i++)
+    timer_msleep (1);
+  return !(p->regs[PX_CMD / 4] & (CMD_CR | CMD_FR));
+}
+
+/* Copies the SIZE-byte string in identify data at ID into
+   STRING, swapping each pair of bytes into order and dropping
+   trailing spaces. */
+static void
+copy_ata_string (char *string, const uint8_t *id, int size)
+{
+  int i;
+
+  for (i = 0; i < size; i += 2)
+    {
+      string[i] = id[i + 1];
+      string[i + 1] = id[i];
+    }
+  while (size > 0 && (string[size - 1] == ' ' || string[size - 1] == '\0'))
+    size--;
+  string[size] = '\0';
+}
+
+/* Sends an IDENTIFY DEVICE command to the disk on port P and
+   sets up P to match.  Registers the disk with the block device
+   layer.  HBA_CAP is the adapter's capabilities. */
+static void
+identify (struct ahci_port *p, uint32_t hba_cap)
+{
+  uint8_t *id = palloc_get_page (PAL_ASSERT);
+  const uint16_t *word = (const uint16_t *) id;
+  block_sector_t capacity;
+  char extra_info[128];
+  char model[41];
+  struct block *block;
+  int depth, i;
+
+  issue_sync (p, CMD_IDENTIFY_DEVICE, id, BLOCK_SECTOR_SIZE);
+
+  /* Word 83 bit 10 says the disk takes 48-bit addresses, in
+     which case words 100...103 are its capacity; otherwise it is
+     in words 60...61.  Block sector numbers are 32 bits. */
+  p->lba48 = (word[83] & 0xc400) == 0x4400;
+  if (p->lba48 && (word[102] != 0 || word[103] != 0))
+    capacity = (block_sector_t) -1;
+  else if (p->lba48)
+    capacity = word[100] | (uint32_t) word[101] << 16;
+  else
+    capacity = word[60] | (uint32_t) word[61] << 16;
+  copy_ata_string (model, &id[27 * 2], 40);
+
+  /* Word 83, if bit 14 alone of its top two is set, says in bit
+     12 that the disk supports FLUSH CACHE. */
+  p->flush = (word[83] & 0xd000) == 0x5000;
+
+  /* Word 76 bit 8 says the disk supports NCQ, and word 75 bits
+     4:0 give its queue depth, less 1.  Without NCQ, only one
+     command may be outstanding. */
+  p->ncq = (hba_cap & CAP_SNCQ) && word[76] != 0xffff
+           && (word[76] & 0x100) && p->lba48;
+  if (p->ncq)
+    {
+      depth = (word[75] & 0x1f) + 1;
+      if (depth < p->slot_cnt)
+        p->slot_cnt = depth;
+    }
+  else
+    p->slot_cnt = 1;
+  p->free_mask = p->slot_cnt == 32 ? 0xffffffff : (1u << p->slot_cnt) - 1;
+  for (i = 1; i < p->slot_cnt; i++)
+    sema_up (&p->free_cnt);
+  palloc_free_page (id);
+
+  if (p->ncq)
+    snprintf (extra_info, sizeof extra_info, "model \"%s\", NCQ depth %d%s",
+              model, p->slot_cnt, p->flush ? ", flush" : "");
+  else
+    snprintf (extra_info, sizeof extra_info, "model \"%s\"%s",
+              model, p->flush ? ", flush" : "");
+
+  /* Disable access to disks over 1 GB, which are likely physical
+     disks rather than virtual ones, as for IDE. */
+  if (capacity >= 1024 * 1024 * 1024 / BLOCK_SECTOR_SIZE)
+    {
+      printf ("%s: ignoring ", p->name);
+      print_human_readable_size ((uint64_t) capacity * 512);
+      printf ("disk for safety\n");
+      return;
+    }
+
+  block = block_register (p->name, BLOCK_RAW, extra_info, capacity,
+                          &ahci_operations, p);
+  partition_scan (block);
+}
+
+/* Issues COMMAND to port P in a free slot, waiting for one if
+   need be, to transfer CNT sectors starting at SEC_NO between
+   the disk and the SIZE bytes at BUFFER, from BUFFER if WRITE.
+   Once the command is done, the interrupt handler ups DONE if it
+   is nonnull and otherwise passes TAG to block_start_done().
+   P's issue_lock must be held. */
+static void
+issue (struct ahci_port *p, uint8_t command, block_sector_t sec_no,
+       size_t cnt, void *buffer, size_t size, bool write, void *tag,
+       struct semaphore *done)
+{
+  bool queued = (command == CMD_READ_FPDMA_QUEUED
+                 || command == CMD_WRITE_FPDMA_QUEUED);
+  enum intr_level old_level;
+  struct cmd_header *h;
+  struct cmd_table *t;
+  uint8_t *fis;
+  int slot, prd_cnt;
+
+  ASSERT (lock_held_by_current_thread (&p->issue_lock));
+  ASSERT (size <= PRDT_CNT * PRD_BYTES_MAX);
+
+  sema_down (&p->free_cnt);
+  old_level = intr_disable ();
+  slot = __builtin_ctz (p->free_mask);
+  p->free_mask &= ~(1u << slot);
+  intr_set_level (old_level);
+
+  /* The command.  A queued command carries its sector count as
+     its features and its slot as its tag. */
+  t = &p->tables[slot];
+  fis = t->cfis;
+  memset (fis, 0, FIS_H2D_LEN);
+  fis[0] = FIS_TYPE_H2D;
+  fis[1] = FIS_H2D_COMMAND;
+  fis[2] = command;
+  fis[4] = sec_no;
+  fis[5] = sec_no >> 8;
+  fis[6] = sec_no >> 16;
+  fis[7] = FIS_DEV_LBA;
+  if (p->lba48)
+    fis[8] = sec_no >> 24;
+  else
+    fis[7] |= (sec_no >> 24) & 0x0f;
+  if (queued)
+    {
+      fis[3] = cnt;
+      fis[11] = cnt >> 8;
+      fis[12] = slot << 3;
+    }
+  else
+    {
+      fis[12] = cnt;
+      fis[13] = cnt >> 8;
+    }
+
+  /* The memory, which is physically contiguous. */
+  for (prd_cnt = 0; size > 0; prd_cnt++)
+    {
+      size_t n = size < PRD_BYTES_MAX ? size : PRD_BYTES_MAX;
+
+      t->prdt[prd_cnt].dba = vtop (buffer);
+      t->prdt[prd_cnt].dbau = 0;
+      t->prdt[prd_cnt].dbc = n - 1;
+      buffer = (uint8_t *) buffer + n;
+      size -= n;
+    }
+
+  h = &p->cmds[slot];
+  h->flags = FIS_H2D_LEN / 4 | (write ? HDR_WRITE : 0);
+  h->prdtl = prd_cnt;
+  h->prdbc = 0;
+  p->slots[slot].tag = tag;
+  p->slots[slot].done = done;
+
+  /* The adapter may fetch the command as soon as its bit is
+     set. */
+  barrier ();
+  old_level = intr_disable ();
+  p->active |= 1u << slot;
+  if (queued)
+    p->regs[PX_SACT / 4] = 1u << slot;
+  p->regs[PX_CI / 4] = 1u << slot;
+  intr_set_level (old_level);
+}
+
+/* Issues non-queued COMMAND to port P, transferring SIZE bytes
+   from the disk into BUFFER, and waits for it to finish. */
+static void
+issue_sync (struct ahci_port *p, uint8_t command, void *buffer,
+            size_t size)
+{
+  struct semaphore done;
+
+  sema_init (&done, 0);
+  lock_acquire (&p->issue_lock);
+  issue (p, command, 0, 0, buffer, size, false, NULL, &done);
+  lock_release (&p->issue_lock);
+  sema_down (&done);
+}
+
+/* Starts transferring CNT sectors starting at SEC_NO between
+   disk P and BUFFER, from BUFFER if WRITE, and returns once the
+   command is issued.  Passes TAG to block_start_done() once the
+   transfer is done. */
+static void
+ahci_start (void *p_, bool write, block_sector_t sec_no, size_t cnt,
+            void *buffer, void *tag)
+{
+  struct ahci_port *p = p_;
+  uint8_t command;
+
+  ASSERT (is_kernel_vaddr (buffer));
+  ASSERT (cnt > 0 && cnt <= (p->lba48 ? 65536 : 256));
+
+  if (p->ncq)
+    command = write ? CMD_WRITE_FPDMA_QUEUED : CMD_READ_FPDMA_QUEUED;
+  else if (p->lba48)
+    command = write ? CMD_WRITE_DMA_EXT : CMD_READ_DMA_EXT;
+  else
+    command = write ? CMD_WRITE_DMA : CMD_READ_DMA;
+
+  lock_acquire (&p->issue_lock);
+  issue (p, command, sec_no, cnt, buffer, cnt * BLOCK_SECTOR_SIZE, write,
+         tag, NULL);
+  lock_release (&p->issue_lock);
+}
+
+/* Has disk P write its write cache to the medium.  FLUSH CACHE
+   is not queued, so waits for every queued command to finish
+   first.  Does nothing if P does not support it. */
+static void
+ahci_flush (void *p_)
+{
+  struct ahci_port *p = p_;
+  struct semaphore done;
+  int i;
+
+  if (!p->flush)
+    return;
+
+  sema_init (&done, 0);
+  lock_acquire (&p->issue_lock);
+  for (i = 0; i < p->slot_cnt; i++)
+    sema_down (&p->free_cnt);
+  for (i = 0; i < p->slot_cnt; i++)
+    sema_up (&p->free_cnt);
+  issue (p, p->lba48 ? CMD_FLUSH_CACHE_EXT : CMD_FLUSH_CACHE, 0, 0,
+         NULL, 0, false, NULL, &done);
+  lock_release (&p->issue_lock);
+  sema_down (&done);
+}
+
+static struct block_operations ahci_operations =
+  {
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    ahci_flush,
+    ahci_start
+  };
+
+/* AHCI interrupt handler.  Completes the commands that every
+   port on the interrupt's line has finished and frees their
+   slots. */
+static void
+interrupt_handler (struct intr_frame *f)
+{
+  size_t i;
+
+  for (i = 0; i < port_cnt; i++)
+    {
+      struct ahci_port *p = &ports[i];
+      uint32_t status, done;
+
+      if (p->irq != f->vec_no
+          || !(p->hba[HBA_IS / 4] & (1u << p->port_no)))
+        continue;
+
+      /* Acknowledge the port, then the adapter. */
+      status = p->regs[PX_IS / 4];
+      p->regs[PX_IS / 4] = status;
+      p->hba[HBA_IS / 4] = 1u << p->port_no;
+      if (status & IS_ERRORS)
+        PANIC ("%s: disk error, interrupt status=%#x, task file=%#x",
+               p->name, (unsigned) status, (unsigned) p->regs[PX_TFD / 4]);
+
+      /* A command is done once neither SACT nor CI has its
+         slot. */
+      done = p->active & ~(p->regs[PX_SACT / 4] | p->regs[PX_CI / 4]);
+      p->active &= ~done;
+      while (done != 0)
+        {
+          int slot = __builtin_ctz (done);
+          struct slot *s = &p->slots[slot];
+
+          done &= ~(1u << slot);
+          if (s->done != NULL)
+            sema_up (s->done);
+          else
+            block_start_done (s->tag);
+          p->free_mask |= 1u << slot;
+          sema_up (&p->free_cnt);
+        }
+    }
+}
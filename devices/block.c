@@ -1,9 +1,54 @@
 #include "devices/block.h"
+#include <hist.h>
 #include <list.h>
+#include <round.h>
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "threads/cycle.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/trace.h"
+
+/* Requests to a block device, synchronous ones included, wait in
+   a queue per I/O class kept in ascending sector order, from
+   which an I/O thread of the device's own takes them C-LOOK
+   fashion: it serves the first request at or past the sector
+   where the last transfer ended, wrapping around to the lowest
+   sector when none is left ahead.  Requests that continue where
+   the one served ends, in the same direction, are merged into
+   one driver call of up to MERGE_MAX sectors through a bounce
+   buffer.
+
+   The I/O thread takes from the highest class with requests
+   pending, so that a high-priority thread's synchronous read
+   does not wait behind read-ahead, write-behind and the I/O of
+   lower-priority threads.  Each time it does, every lower class
+   with requests pending is aged, and a class aged AGE_MAX times
+   is served next instead.  Requests are only merged within a
+   class.
+
+   A driver with a START operation takes transfers without
+   waiting for them, so the I/O thread keeps up to ASYNC_DEPTH of
+   them outstanding at once, for the device to serve in the order
+   it likes, and finishes each when the driver reports it done.
+   Merging then waits while the one bounce buffer is in use.
+
+   Pending requests for overlapping sectors complete in no
+   particular order, so callers must not issue them together. */
+
+/* Most sectors in one merged transfer. */
+#define MERGE_MAX 64
+
+/* Most transfers outstanding at once through a driver's START
+   operation, and most sectors in one call to it. */
+#define ASYNC_DEPTH 32
+#define START_MAX 128
+
+/* Transfers taken from higher classes in a row after which a
+   class with requests pending is served. */
+#define AGE_MAX 8
 
 /* A block device. */
 struct block
@@ -12,6 +57,7 @@ struct block
 
     char name[16];                      /* Block device name. */
     enum block_type type;                /* Type of block device. */
+    struct block *role_next;            /* Next device in the same role. */
     block_sector_t size;                 /* Size in sectors. */
 
     const struct block_operations *ops;  /* Driver operations. */
@@ -19,6 +65,53 @@ struct block
 
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+    unsigned long long flush_cnt;       /* Number of cache flushes. */
+
+    /* Request queue. */
+    struct lock queue_lock;             /* Protects the members below. */
+    struct semaphore work;              /* Up'd per request queued and per
+                                           transfer the driver finished. */
+    struct list queues[BLOCK_CLASS_CNT]; /* Pending requests, by class,
+                                           each by sector. */
+    unsigned age[BLOCK_CLASS_CNT];      /* Transfers taken past each. */
+    block_sector_t head;                /* Sector past the last transfer. */
+    bool has_worker;                    /* I/O thread started? */
+    unsigned long long merge_cnt;       /* Requests merged into others. */
+
+    /* Owned by the I/O thread. */
+    uint8_t *bounce;                    /* Buffer for merged transfers. */
+    bool bounce_busy;                   /* BOUNCE in an outstanding one? */
+    struct list free_batches;           /* Batches for START, not in use. */
+    struct list done;                   /* Batches the driver finished,
+                                           touched with interrupts off. */
+
+    /* Statistics of submitted requests, protected by queue_lock. */
+    size_t queue_len;                   /* Requests in QUEUES. */
+    size_t active;                      /* Requests not yet completed. */
+    unsigned long long class_cnt[BLOCK_CLASS_CNT]; /* Requests per class. */
+    unsigned long long aged_cnt;        /* Transfers served for age. */
+    block_sector_t last_end;            /* Sector past the last one. */
+    unsigned long long seq_cnt;         /* Requests starting there. */
+    unsigned long long random_cnt;      /* Other requests. */
+    histogram size_hist;                /* Sectors per request. */
+    histogram depth_hist;               /* QUEUE_LEN, counting new one. */
+    histogram latency_hist;             /* Cycles, submit to completion. */
+  };
+
+/* A transfer the I/O thread passes to the driver: one request,
+   or several that continue one another, merged through the
+   bounce buffer. */
+struct batch
+  {
+    struct block *block;                /* Device. */
+    struct list reqs;                   /* Requests, by sector. */
+    bool write;                         /* Write, rather than read? */
+    int class;                          /* Requests' class. */
+    block_sector_t sector;              /* First sector. */
+    size_t cnt;                         /* Number of sectors. */
+    uint8_t *buffer;                    /* Only request's buffer, or bounce. */
+    int pending;                        /* Calls to START not finished. */
+    struct list_elem elem;              /* In free_batches or done. */
   };
 
 /* List of all block devices. */
@@ -28,6 +121,14 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static thread_func io_thread NO_RETURN;
+static int current_class (void);
+static bool take_batch (struct block *, struct batch *);
+static void finish_batch (struct batch *);
+static void start_batch (struct batch *);
+static void transfer (struct batch *);
+static bool request_less (const struct list_elem *,
+                          const struct list_elem *, void *aux);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -40,6 +141,7 @@ block_type_name (enum block_type type)
       "filesys",
       "scratch",
       "swap",
+      "snapshot",
       "raw",
       "foreign",
     };
@@ -57,12 +159,21 @@ block_get_role (enum block_type role)
   return block_by_role[role];
 }
 
-/* Assigns BLOCK the given ROLE. */
+/* Assigns BLOCK the given ROLE.  BLOCK_SWAP may be assigned to
+   several block devices, of which block_get_role() returns the
+   first; they are then all swap areas (see vm/swap.c).  Any other
+   role is BLOCK's alone. */
 void
 block_set_role (enum block_type role, struct block *block)
 {
+  struct block **last = &block_by_role[role];
+
   ASSERT (role < BLOCK_ROLE_CNT);
-  block_by_role[role] = block;
+  ASSERT (block->role_next == NULL);
+  if (role == BLOCK_SWAP)
+    while (*last != NULL)
+      last = &(*last)->role_next;
+  *last = block;
 }
 
 /* Returns the first block device in kernel probe order, or a
@@ -113,6 +224,31 @@ check_sector (struct block *block, block_sector_t sector)
     }
 }
 
+/* Verifies that the CNT sectors starting at SECTOR are within
+   BLOCK.  Panics if not. */
+static void
+check_sectors (struct block *block, block_sector_t sector, size_t cnt)
+{
+  check_sector (block, sector);
+  if (cnt > block->size - sector)
+    PANIC ("Access past end of device %s (sector=%"PRDSNu", cnt=%zu, "
+           "size=%"PRDSNu")\n", block_name (block), sector, cnt,
+           block->size);
+}
+
+/* Submits a request for the CNT sectors starting at SECTOR of
+   BLOCK and waits for it to complete. */
+static void
+transfer_sync (struct block *block, bool write, block_sector_t sector,
+               size_t cnt, void *buffer)
+{
+  struct block_request req;
+
+  block_request_init (&req, write, sector, cnt, buffer, NULL, NULL);
+  block_submit (block, &req);
+  block_wait (&req);
+}
+
 /* Reads sector SECTOR from BLOCK into BUFFER, which must
    have room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to block devices, so external
@@ -120,9 +256,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  transfer_sync (block, false, sector, 1, buffer);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +267,181 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
-  check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  transfer_sync (block, true, sector, 1, (void *) buffer);
+}
+
+/* Reads the CNT sectors starting at SECTOR from BLOCK into
+   BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE bytes,
+   in as few driver requests as the driver allows.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block *block, block_sector_t sector,
+                     size_t cnt, void *buffer)
+{
+  if (cnt > 0)
+    transfer_sync (block, false, sector, cnt, buffer);
+}
+
+/* Writes the CNT sectors starting at SECTOR to BLOCK from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes, in as few
+   driver requests as the driver allows.  Returns after the block
+   device has acknowledged receiving the data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block *block, block_sector_t sector,
+                      size_t cnt, const void *buffer)
+{
+  if (cnt > 0)
+    transfer_sync (block, true, sector, cnt, (void *) buffer);
+}
+
+/* Initializes REQ to transfer the CNT sectors starting at SECTOR
+   between a block device and BUFFER, which must have room for
+   CNT * BLOCK_SECTOR_SIZE bytes: from BUFFER to the device if
+   WRITE is true, into BUFFER otherwise.  If DONE is nonnull, the
+   block layer calls it once the request completes, and REQ must
+   not be passed to block_wait(); AUX is stored in REQ for DONE's
+   use. */
+void
+block_request_init (struct block_request *req, bool write,
+                    block_sector_t sector, size_t cnt, void *buffer,
+                    void (*done) (struct block_request *), void *aux)
+{
+  ASSERT (cnt > 0);
+
+  req->sector = sector;
+  req->cnt = cnt;
+  req->buffer = buffer;
+  req->write = write;
+  req->class = BLOCK_CLASS_INHERIT;
+  req->done = done;
+  req->aux = aux;
+  sema_init (&req->finished, 0);
+}
+
+/* Queues REQ, initialized by block_request_init(), on BLOCK and
+   returns without waiting for the transfer.  REQ and its buffer
+   must stay allocated until it completes. */
+void
+block_submit (struct block *block, struct block_request *req)
+{
+#ifdef USERPROG
+  struct rusage *rusage = thread_rusage ();
+#endif
+
+  check_sectors (block, req->sector, req->cnt);
+  ASSERT (!req->write || block->type != BLOCK_FOREIGN);
+  ASSERT (req->class >= BLOCK_CLASS_INHERIT && req->class < BLOCK_CLASS_CNT);
+
+  if (req->class == BLOCK_CLASS_INHERIT)
+    req->class = current_class ();
+
+  lock_acquire (&block->queue_lock);
+  if (!block->has_worker)
+    {
+      if (thread_create (block->name, PRI_MAX, io_thread, block)
+          == TID_ERROR)
+        PANIC ("%s: I/O thread creation failed", block->name);
+      block->has_worker = true;
+    }
+  if (req->write)
+    block->write_cnt += req->cnt;
+  else
+    block->read_cnt += req->cnt;
+#ifdef USERPROG
+  /* Charged to the process, if any, that the I/O is done for. */
+  if (rusage != NULL && req->write)
+    rusage->block_writes += req->cnt;
+  else if (rusage != NULL)
+    rusage->block_reads += req->cnt;
+#endif
+  if (req->sector == block->last_end)
+    block->seq_cnt++;
+  else
+    block->random_cnt++;
+  block->last_end = req->sector + req->cnt;
+  hist_add (block->size_hist, req->cnt);
+  hist_add (block->depth_hist, ++block->queue_len);
+  block->active++;
+  block->class_cnt[req->class]++;
+  req->submitted = rdtsc ();
+  TRACE (TRACE_BLOCK_SUBMIT, req, req->sector,
+         req->cnt | (req->write ? TRACE_WRITE : 0));
+  list_insert_ordered_back (&block->queues[req->class], &req->elem,
+                            request_less, NULL);
+  sema_up (&block->work);
+  lock_release (&block->queue_lock);
+}
+
+/* Returns the class of requests the running thread submits
+   with BLOCK_CLASS_INHERIT: the one it set, if any, else the one
+   of its priority.  A thread that has priority donated to it
+   gets at least the class of that, so that a background thread
+   holding a lock that a more important one waits for does not
+   hold it at the back of the queue. */
+static int
+current_class (void)
+{
+  struct thread *t = thread_current ();
+  bool donated = !thread_mlfqs && t->priority > t->base_priority;
+  int class;
+
+  if (t->priority < PRI_DEFAULT)
+    class = BLOCK_CLASS_LOW;
+  else if (t->priority == PRI_DEFAULT)
+    class = BLOCK_CLASS_NORMAL;
+  else
+    class = BLOCK_CLASS_HIGH;
+
+  if (t->io_class != BLOCK_CLASS_INHERIT
+      && (!donated || t->io_class > class))
+    class = t->io_class;
+  return class;
+}
+
+/* Sets the class of the requests that the running thread submits
+   with BLOCK_CLASS_INHERIT, including those of block_read() and
+   the like, to CLASS, or back to the one its priority gives if
+   CLASS is BLOCK_CLASS_INHERIT.  Returns the class set before, so
+   that a caller can restore it.  Background threads set
+   BLOCK_CLASS_IDLE. */
+int
+block_set_class (int class)
+{
+  struct thread *t = thread_current ();
+  int old = t->io_class;
+
+  ASSERT (class >= BLOCK_CLASS_INHERIT && class < BLOCK_CLASS_CNT);
+
+  t->io_class = class;
+  return old;
+}
+
+/* Waits for REQ, which was submitted without a completion
+   function, to complete. */
+void
+block_wait (struct block_request *req)
+{
+  ASSERT (req->done == NULL);
+  sema_down (&req->finished);
+}
+
+/* Makes the data of every write to BLOCK that has completed
+   durable, by having the device write its write cache to the
+   medium, so that the caller can order later writes after them
+   across a power failure too.  Writes still pending are not
+   covered: the caller waits for them first. */
+void
+block_flush (struct block *block)
+{
+  if (block->ops->flush == NULL)
+    return;
+  block->ops->flush (block->aux);
+  lock_acquire (&block->queue_lock);
+  block->flush_cnt++;
+  lock_release (&block->queue_lock);
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -160,7 +465,26 @@ block_type (struct block *block)
   return block->type;
 }
 
-/* Prints statistics for each block device used for a Pintos role. */
+/* Returns true if no block device has a request submitted and
+   not yet completed, so that no transfer is under way.  With
+   interrupts off, the answer stays true until they are turned
+   back on. */
+bool
+block_quiescent (void)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&all_blocks); e != list_end (&all_blocks);
+       e = list_next (e))
+    if (list_entry (e, struct block, list_elem)->active > 0)
+      return false;
+  return true;
+}
+
+/* Prints statistics for each block device used for a Pintos role:
+   transfer counts, then how many requests began where the one
+   before ended, then histograms of request sizes, of queue depths
+   and of latencies. */
 void
 block_print_stats (void)
 {
@@ -168,12 +492,30 @@ block_print_stats (void)
 
   for (i = 0; i < BLOCK_ROLE_CNT; i++)
     {
-      struct block *block = block_by_role[i];
-      if (block != NULL)
+      struct block *block;
+
+      for (block = block_by_role[i]; block != NULL;
+           block = block->role_next)
         {
-          printf ("%s (%s): %llu reads, %llu writes\n",
+          printf ("%s (%s): %llu reads, %llu writes, %llu merged, "
+                  "%llu flushes\n",
                   block->name, block_type_name (block->type),
-                  block->read_cnt, block->write_cnt);
+                  block->read_cnt, block->write_cnt, block->merge_cnt,
+                  block->flush_cnt);
+          printf ("%s: %llu sequential, %llu random requests\n",
+                  block->name, block->seq_cnt, block->random_cnt);
+          printf ("%s: %llu idle, %llu low, %llu normal, %llu high "
+                  "class requests, %llu transfers aged\n",
+                  block->name, block->class_cnt[BLOCK_CLASS_IDLE],
+                  block->class_cnt[BLOCK_CLASS_LOW],
+                  block->class_cnt[BLOCK_CLASS_NORMAL],
+                  block->class_cnt[BLOCK_CLASS_HIGH], block->aged_cnt);
+          printf ("%s:", block->name);
+          hist_print ("sectors", block->size_hist);
+          printf ("%s:", block->name);
+          hist_print ("queue depth", block->depth_hist);
+          printf ("%s:", block->name);
+          hist_print ("latency cycles", block->latency_hist);
         }
     }
 }
@@ -189,17 +531,44 @@ block_register (const char *name, enum block_type type,
                 const struct block_operations *ops, void *aux)
 {
   struct block *block = malloc (sizeof *block);
+  int i;
+
   if (block == NULL)
     PANIC ("Failed to allocate memory for block device descriptor");
 
   list_push_back (&all_blocks, &block->list_elem);
   strlcpy (block->name, name, sizeof block->name);
   block->type = type;
+  block->role_next = NULL;
   block->size = size;
   block->ops = ops;
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  block->flush_cnt = 0;
+  lock_init_named (&block->queue_lock, block->name);
+  sema_init (&block->work, 0);
+  for (i = 0; i < BLOCK_CLASS_CNT; i++)
+    {
+      list_init (&block->queues[i]);
+      block->age[i] = 0;
+      block->class_cnt[i] = 0;
+    }
+  block->head = 0;
+  block->has_worker = false;
+  block->merge_cnt = 0;
+  block->bounce = NULL;
+  block->bounce_busy = false;
+  list_init (&block->free_batches);
+  list_init (&block->done);
+  block->queue_len = 0;
+  block->active = 0;
+  block->aged_cnt = 0;
+  block->last_end = 0;
+  block->seq_cnt = block->random_cnt = 0;
+  memset (block->size_hist, 0, sizeof block->size_hist);
+  memset (block->depth_hist, 0, sizeof block->depth_hist);
+  memset (block->latency_hist, 0, sizeof block->latency_hist);
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -221,3 +590,300 @@ list_elem_to_block (struct list_elem *list_elem)
           : NULL);
 }
 
+/* Returns the class of BLOCK's queue to serve next: the highest
+   with requests pending, unless a lower one has aged AGE_MAX
+   times, in which case the highest such one.  Ages the classes
+   passed over.  Returns -1 if no request is pending.  BLOCK's
+   queues must be locked. */
+static int
+next_class (struct block *block)
+{
+  int class, next = -1;
+  bool aged = false;
+
+  for (class = BLOCK_CLASS_CNT - 1; class >= 0; class--)
+    if (!list_empty (&block->queues[class]))
+      {
+        if (next < 0)
+          next = class;
+        else if (block->age[class] >= AGE_MAX)
+          {
+            next = class;
+            aged = true;
+            break;
+          }
+      }
+  if (next < 0)
+    return -1;
+
+  for (class = next - 1; class >= 0; class--)
+    if (!list_empty (&block->queues[class]))
+      block->age[class]++;
+  block->age[next] = 0;
+  if (aged)
+    block->aged_cnt++;
+  return next;
+}
+
+/* Returns the request in QUEUE to serve next: the first at or
+   past BLOCK's head, or the first of all if there is none past
+   it.  QUEUE must be non-empty and BLOCK's queues locked. */
+static struct block_request *
+next_request (struct block *block, struct list *queue)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (queue); e != list_end (queue); e = list_next (e))
+    {
+      struct block_request *req = list_entry (e, struct block_request, elem);
+      if (req->sector >= block->head)
+        return req;
+    }
+  return list_entry (list_front (queue), struct block_request, elem);
+}
+
+/* Serves the requests queued on BLOCK, which is passed as AUX,
+   forever. */
+static void
+io_thread (void *block_)
+{
+  struct block *block = block_;
+  struct batch *batches;
+  int i;
+
+  block->bounce = malloc (MERGE_MAX * BLOCK_SECTOR_SIZE);
+  if (block->ops->start != NULL)
+    {
+      batches = malloc (ASYNC_DEPTH * sizeof *batches);
+      if (batches == NULL)
+        PANIC ("%s: out of memory for I/O batches", block->name);
+      for (i = 0; i < ASYNC_DEPTH; i++)
+        list_push_back (&block->free_batches, &batches[i].elem);
+    }
+
+  for (;;)
+    {
+      struct batch sync, *b;
+
+      sema_down (&block->work);
+      if (block->ops->start == NULL)
+        {
+          /* One transfer at a time, waiting for each. */
+          if (take_batch (block, &sync))
+            {
+              transfer (&sync);
+              finish_batch (&sync);
+            }
+          continue;
+        }
+
+      /* Finish the transfers the driver is done with, then start
+         as many queued ones as there is room for. */
+      for (;;)
+        {
+          enum intr_level old_level = intr_disable ();
+          b = (!list_empty (&block->done)
+               ? list_entry (list_pop_front (&block->done),
+                             struct batch, elem)
+               : NULL);
+          intr_set_level (old_level);
+          if (b == NULL)
+            break;
+          finish_batch (b);
+          list_push_back (&block->free_batches, &b->elem);
+        }
+      while (!list_empty (&block->free_batches))
+        {
+          b = list_entry (list_front (&block->free_batches),
+                          struct batch, elem);
+          if (!take_batch (block, b))
+            break;
+          list_pop_front (&block->free_batches);
+          start_batch (b);
+        }
+    }
+}
+
+/* Takes the request to serve next off BLOCK's queues into B,
+   along with those of its class that continue it, if the bounce
+   buffer is free.  Returns false if the queues are empty. */
+static bool
+take_batch (struct block *block, struct batch *b)
+{
+  struct block_request *first, *req;
+  struct list *queue;
+  struct list_elem *e;
+  bool merge = block->bounce != NULL && !block->bounce_busy;
+  int class;
+
+  lock_acquire (&block->queue_lock);
+  class = next_class (block);
+  if (class < 0)
+    {
+      lock_release (&block->queue_lock);
+      return false;
+    }
+  queue = &block->queues[class];
+  first = next_request (block, queue);
+  b->block = block;
+  b->write = first->write;
+  b->class = class;
+  b->sector = first->sector;
+  b->cnt = first->cnt;
+  list_init (&b->reqs);
+  e = list_remove (&first->elem);
+  list_push_back (&b->reqs, &first->elem);
+  while (merge && e != list_end (queue))
+    {
+      req = list_entry (e, struct block_request, elem);
+      if (req->write != first->write
+          || req->sector != first->sector + b->cnt
+          || b->cnt + req->cnt > MERGE_MAX)
+        break;
+      b->cnt += req->cnt;
+      e = list_remove (e);
+      list_push_back (&b->reqs, &req->elem);
+      block->merge_cnt++;
+    }
+  block->head = first->sector + b->cnt;
+  block->queue_len -= list_size (&b->reqs);
+  lock_release (&block->queue_lock);
+
+  if (b->cnt == first->cnt)
+    b->buffer = first->buffer;
+  else
+    {
+      /* Gather writes into the bounce buffer. */
+      b->buffer = block->bounce;
+      block->bounce_busy = true;
+      if (b->write)
+        for (e = list_begin (&b->reqs); e != list_end (&b->reqs);
+             e = list_next (e))
+          {
+            req = list_entry (e, struct block_request, elem);
+            memcpy (b->buffer + (req->sector - b->sector) * BLOCK_SECTOR_SIZE,
+                    req->buffer, req->cnt * BLOCK_SECTOR_SIZE);
+          }
+    }
+  return true;
+}
+
+/* Completes the requests in B, whose transfer is done. */
+static void
+finish_batch (struct batch *b)
+{
+  struct block *block = b->block;
+  struct block_request *req;
+  struct list_elem *e;
+
+  if (b->buffer == block->bounce)
+    {
+      /* Scatter reads from the bounce buffer. */
+      if (!b->write)
+        for (e = list_begin (&b->reqs); e != list_end (&b->reqs);
+             e = list_next (e))
+          {
+            req = list_entry (e, struct block_request, elem);
+            memcpy (req->buffer,
+                    b->buffer + (req->sector - b->sector) * BLOCK_SECTOR_SIZE,
+                    req->cnt * BLOCK_SECTOR_SIZE);
+          }
+      block->bounce_busy = false;
+    }
+
+  /* DONE may free its request, so move on before calling it. */
+  while (!list_empty (&b->reqs))
+    {
+      req = list_entry (list_pop_front (&b->reqs),
+                        struct block_request, elem);
+      lock_acquire (&block->queue_lock);
+      hist_add (block->latency_hist, rdtsc () - req->submitted);
+      block->active--;
+      lock_release (&block->queue_lock);
+      TRACE (TRACE_BLOCK_COMPLETE, req, req->sector,
+             req->cnt | (req->write ? TRACE_WRITE : 0));
+      if (req->done != NULL)
+        req->done (req);
+      else
+        sema_up (&req->finished);
+    }
+}
+
+/* Starts B's transfer through the driver's START operation, in
+   pieces of up to START_MAX sectors, without waiting for it. */
+static void
+start_batch (struct batch *b)
+{
+  struct block *block = b->block;
+  size_t ofs, n;
+
+  /* Any piece may finish before the next starts. */
+  b->pending = DIV_ROUND_UP (b->cnt, START_MAX);
+  for (ofs = 0; ofs < b->cnt; ofs += n)
+    {
+      n = b->cnt - ofs < START_MAX ? b->cnt - ofs : START_MAX;
+      block->ops->start (block->aux, b->write, b->sector + ofs, n,
+                         b->buffer + ofs * BLOCK_SECTOR_SIZE, b);
+    }
+}
+
+/* Reports that the transfer a driver's START operation began
+   with TAG is done.  May be called from an interrupt handler. */
+void
+block_start_done (void *tag)
+{
+  struct batch *b = tag;
+  enum intr_level old_level = intr_disable ();
+
+  ASSERT (b->pending > 0);
+  if (--b->pending == 0)
+    {
+      list_push_back (&b->block->done, &b->elem);
+      sema_up (&b->block->work);
+    }
+  intr_set_level (old_level);
+}
+
+/* Returns the class of the requests in the transfer that a
+   driver's START operation began with TAG, for a driver that
+   passes the transfer on to another device. */
+int
+block_start_class (void *tag)
+{
+  struct batch *b = tag;
+
+  return b->class;
+}
+
+/* Transfers B through its device's driver, waiting for it, in
+   as few calls as the driver allows. */
+static void
+transfer (struct batch *b)
+{
+  struct block *block = b->block;
+  const struct block_operations *ops = block->ops;
+  uint8_t *p = b->buffer;
+  size_t i;
+
+  if (b->write && ops->write_multiple != NULL)
+    ops->write_multiple (block->aux, b->sector, b->cnt, b->buffer);
+  else if (!b->write && ops->read_multiple != NULL)
+    ops->read_multiple (block->aux, b->sector, b->cnt, b->buffer);
+  else
+    for (i = 0; i < b->cnt; i++, p += BLOCK_SECTOR_SIZE)
+      if (b->write)
+        ops->write (block->aux, b->sector + i, p);
+      else
+        ops->read (block->aux, b->sector + i, p);
+}
+
+/* Orders block requests by first sector. */
+static bool
+request_less (const struct list_elem *a_, const struct list_elem *b_,
+              void *aux UNUSED)
+{
+  const struct block_request *a = list_entry (a_, struct block_request, elem);
+  const struct block_request *b = list_entry (b_, struct block_request, elem);
+
+  return a->sector < b->sector;
+}
@@ -1,8 +1,11 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
+#include "threads/synch.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -30,6 +33,7 @@ enum block_type
     BLOCK_FILESYS,               /* File system. */
     BLOCK_SCRATCH,               /* Scratch. */
     BLOCK_SWAP,                  /* Swap. */
+    BLOCK_SNAPSHOT,              /* Memory snapshot. */
     BLOCK_ROLE_CNT,
 
     /* Other kinds of block devices that Pintos may see but does
@@ -53,8 +57,63 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, size_t cnt,
+                          void *);
+void block_write_multiple (struct block *, block_sector_t, size_t cnt,
+                           const void *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
+bool block_quiescent (void);
+
+/* I/O priority classes.  A device's I/O thread serves pending
+   requests of a higher class first, except that a class passed
+   over too many times in a row is served next, so that none
+   starves. */
+enum block_class
+  {
+    BLOCK_CLASS_IDLE,           /* Background: read-ahead, write-behind. */
+    BLOCK_CLASS_LOW,            /* Threads below PRI_DEFAULT. */
+    BLOCK_CLASS_NORMAL,         /* Threads at PRI_DEFAULT. */
+    BLOCK_CLASS_HIGH,           /* Threads above PRI_DEFAULT. */
+    BLOCK_CLASS_CNT
+  };
+
+/* Class taken from the submitting thread: the class it set with
+   block_set_class(), if any, else the one its effective priority,
+   donations included, falls in. */
+#define BLOCK_CLASS_INHERIT (-1)
+
+int block_set_class (int class);
+
+/* An asynchronous request to transfer CNT sectors starting at
+   SECTOR between a block device and BUFFER. */
+struct block_request
+  {
+    block_sector_t sector;      /* First sector. */
+    size_t cnt;                 /* Number of sectors. */
+    void *buffer;               /* CNT * BLOCK_SECTOR_SIZE bytes. */
+    bool write;                 /* Write BUFFER, rather than read? */
+    int class;                  /* enum block_class, or
+                                   BLOCK_CLASS_INHERIT, the default. */
+
+    /* Called in the device's I/O thread once the transfer is
+       done, if nonnull.  Must not wait for block requests. */
+    void (*done) (struct block_request *);
+    void *aux;                  /* For use by DONE. */
+
+    /* Owned by the block layer. */
+    struct list_elem elem;      /* Element in a device queue. */
+    struct semaphore finished;  /* Up'd when done, if DONE is null. */
+    uint64_t submitted;         /* Time stamp counter at submission. */
+  };
+
+void block_request_init (struct block_request *, bool write,
+                         block_sector_t, size_t cnt, void *buffer,
+                         void (*done) (struct block_request *),
+                         void *aux);
+void block_submit (struct block *, struct block_request *);
+void block_wait (struct block_request *);
+void block_flush (struct block *);
 
 /* Statistics. */
 void block_print_stats (void);
@@ -63,12 +122,36 @@ void block_print_stats (void);
 
 struct block_operations
   {
+    /* Transfer one sector.  May be null if START is not. */
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Optional.  Transfer CNT consecutive sectors at once.  If
+       null, the block layer calls READ or WRITE once per
+       sector. */
+    void (*read_multiple) (void *aux, block_sector_t, size_t cnt,
+                           void *buffer);
+    void (*write_multiple) (void *aux, block_sector_t, size_t cnt,
+                            const void *buffer);
+
+    /* Optional.  Makes every write that has completed durable,
+       if the device has a write cache. */
+    void (*flush) (void *aux);
+
+    /* Optional.  Starts transferring CNT consecutive sectors, from
+       BUFFER if WRITE is true and into it otherwise, and returns
+       without waiting for the transfer, except for room to start
+       it.  Once it is done, the driver calls block_start_done()
+       with TAG.  If nonnull, the block layer uses it in place of
+       the operations above, with several transfers outstanding. */
+    void (*start) (void *aux, bool write, block_sector_t, size_t cnt,
+                   void *buffer, void *tag);
   };
 
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
                               const struct block_operations *, void *aux);
+void block_start_done (void *tag);
+int block_start_class (void *tag);
 
 #endif /* devices/block.h */
@@ -0,0 +1,527 @@
+#include "devices/e1000.h"
+#include <debug.h>
+#include <net.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "devices/pci.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/mmio.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* The code in this file is a driver for the Intel 82540EM
+   gigabit Ethernet controller, the "e1000" that QEMU emulates by
+   default, as described in [8254x].
+
+   The card receives into, and sends from, rings of descriptors
+   in memory, each of which names a packet buffer.  Rather than
+   copying packets through system calls, the driver gives each
+   descriptor a buffer of its own, once and for all, and lets one
+   process at a time map the buffers together with a control page
+   of ring indexes (see lib/net.h).  The card then writes received
+   packets straight into the process's memory and sends straight
+   from it, and the system calls only move indexes.
+
+   Interrupts are throttled to one per ITR_INTERVAL, so that a
+   burst of packets costs one interrupt rather than one each. */
+
+/* PCI vendor and device ID of the 82540EM. */
+#define E1000_VENDOR 0x8086
+#define E1000_DEVICE 0x100e
+
+/* Registers, as byte offsets from the memory base in BAR0. */
+#define REG_CTRL 0x0000         /* Device control. */
+#define REG_EERD 0x0014         /* EEPROM read. */
+#define REG_ICR 0x00c0          /* Interrupt cause, clear on read. */
+#define REG_ITR 0x00c4          /* Interrupt throttling. */
+#define REG_IMS 0x00d0          /* Interrupt mask set. */
+#define REG_IMC 0x00d8          /* Interrupt mask clear. */
+#define REG_RCTL 0x0100         /* Receive control. */
+#define REG_TCTL 0x0400         /* Transmit control. */
+#define REG_TIPG 0x0410         /* Transmit inter-packet gap. */
+#define REG_RDBAL 0x2800        /* Receive ring address, low. */
+#define REG_RDBAH 0x2804        /* Receive ring address, high. */
+#define REG_RDLEN 0x2808        /* Receive ring length in bytes. */
+#define REG_RDH 0x2810          /* Receive ring head. */
+#define REG_RDT 0x2818          /* Receive ring tail. */
+#define REG_TDBAL 0x3800        /* Transmit ring address, low. */
+#define REG_TDBAH 0x3804        /* Transmit ring address, high. */
+#define REG_TDLEN 0x3808        /* Transmit ring length in bytes. */
+#define REG_TDH 0x3810          /* Transmit ring head. */
+#define REG_TDT 0x3818          /* Transmit ring tail. */
+#define REG_MTA 0x5200          /* Multicast table, 128 entries. */
+#define REG_RAL 0x5400          /* Receive address 0, low. */
+#define REG_RAH 0x5404          /* Receive address 0, high. */
+
+/* Device control bits. */
+#define CTRL_ASDE (1u << 5)     /* Detect link speed. */
+#define CTRL_SLU (1u << 6)      /* Set link up. */
+#define CTRL_RST (1u << 26)     /* Reset. */
+
+/* EEPROM read bits. */
+#define EERD_START (1u << 0)
+#define EERD_DONE (1u << 4)
+
+/* Receive address high bits. */
+#define RAH_AV (1u << 31)       /* Address valid. */
+
+/* Interrupt causes. */
+#define ICR_TXDW (1u << 0)      /* Transmit descriptor written back. */
+#define ICR_LSC (1u << 2)       /* Link status change. */
+#define ICR_RXDMT0 (1u << 4)    /* Receive ring running low. */
+#define ICR_RXO (1u << 6)       /* Receive overrun. */
+#define ICR_RXT0 (1u << 7)      /* Receive timer: packets received. */
+
+/* Receive control bits.  A BSIZE of 0 means 2048-byte buffers. */
+#define RCTL_EN (1u << 1)       /* Enable. */
+#define RCTL_BAM (1u << 15)     /* Accept broadcasts. */
+#define RCTL_SECRC (1u << 26)   /* Strip the frame check sequence. */
+
+/* Transmit control bits and fields. */
+#define TCTL_EN (1u << 1)       /* Enable. */
+#define TCTL_PSP (1u << 3)      /* Pad short packets. */
+#define TCTL_CT(N) ((N) << 4)   /* Collision threshold. */
+#define TCTL_COLD(N) ((N) << 12)  /* Collision distance. */
+
+/* Inter-packet gap for copper, as [8254x] 13.4.34 recommends. */
+#define TIPG_VALUE (10 | 8 << 10 | 6 << 20)
+
+/* Interrupt throttling interval, in units of 256 ns: at most one
+   interrupt per 128 us, or about 7800 per second. */
+#define ITR_INTERVAL 500
+
+/* Receive descriptor. */
+struct rx_desc
+  {
+    uint64_t addr;              /* Buffer's physical address. */
+    uint16_t length;            /* Bytes received. */
+    uint16_t checksum;
+    volatile uint8_t status;    /* RXD_*. */
+    uint8_t errors;             /* Nonzero if the packet is bad. */
+    uint16_t special;
+  };
+#define RXD_DD 0x01             /* Descriptor done. */
+#define RXD_EOP 0x02            /* End of packet. */
+
+/* Transmit descriptor. */
+struct tx_desc
+  {
+    uint64_t addr;              /* Buffer's physical address. */
+    uint16_t length;            /* Bytes to send. */
+    uint8_t cso;
+    uint8_t cmd;                /* TXD_CMD_*. */
+    volatile uint8_t status;    /* TXD_DD. */
+    uint8_t css;
+    uint16_t special;
+  };
+#define TXD_CMD_EOP 0x01        /* End of packet. */
+#define TXD_CMD_IFCS 0x02       /* Insert frame check sequence. */
+#define TXD_CMD_RS 0x08         /* Report status. */
+#define TXD_DD 0x01             /* Descriptor done. */
+
+/* Pages that a process maps: see NET_MAP_SIZE. */
+#define MAP_PAGES (NET_MAP_SIZE / PGSIZE)
+
+/* The network card. */
+struct e1000
+  {
+    volatile uint32_t *regs;    /* Registers, or null if none. */
+    uint8_t irq;                /* Interrupt vector. */
+    struct rx_desc *rx;         /* Receive ring. */
+    struct tx_desc *tx;         /* Transmit ring. */
+    uint8_t *pages;             /* MAP_PAGES pages, the first of which
+                                   is the control page. */
+    struct net_ring *ring;      /* Control page. */
+
+    /* Trusted copies of the ring indexes, since a process may
+       write anything to the control page.  RX_TAIL and TX_HEAD
+       are advanced by the interrupt handler, so threads touch
+       them with interrupts off. */
+    uint32_t rx_head;           /* First packet the process holds. */
+    uint32_t rx_tail;           /* Next packet the card receives. */
+    uint32_t tx_head;           /* Next packet for the card to finish. */
+    uint32_t tx_posted;         /* Next packet to give the card. */
+
+    struct lock lock;           /* Serializes system calls. */
+    bool claimed;               /* Mapped by a process? */
+    struct semaphore rx_ready;  /* Up'd when packets arrive. */
+    struct semaphore tx_done;   /* Up'd when packets are sent. */
+  };
+
+static struct e1000 nic;
+
+static bool probe (struct pci_dev *, const struct pci_id *);
+static bool setup_rings (struct e1000 *);
+static void read_mac (struct e1000 *);
+static void set_rdt (struct e1000 *);
+static void receive (struct e1000 *);
+static void reap_tx (struct e1000 *);
+static void interrupt_handler (struct intr_frame *);
+
+static const struct pci_id e1000_ids[] =
+  {
+    {E1000_VENDOR, E1000_DEVICE, PCI_ANY},
+    {0, 0, 0},
+  };
+
+static const struct pci_driver e1000_driver =
+  {
+    "e1000", e1000_ids, probe,
+  };
+
+/* Registers the e1000 driver, so that it sets up the first
+   e1000 network card on the PCI bus. */
+void
+e1000_init (void)
+{
+  lock_init (&nic.lock);
+  sema_init (&nic.rx_ready, 0);
+  sema_init (&nic.tx_done, 0);
+  pci_register_driver (&e1000_driver);
+}
+
+/* Resets network card DEV and starts it receiving and sending.
+   Returns true if successful. */
+static bool
+probe (struct pci_dev *dev, const struct pci_id *id UNUSED)
+{
+  struct e1000 *n = &nic;
+  const struct pci_bar *bar = &dev->bars[0];
+  int i;
+
+  if (n->regs != NULL)
+    return false;
+  if (bar->io || bar->base == 0)
+    {
+      printf ("e1000: no memory base address, ignoring\n");
+      return false;
+    }
+  if (dev->irq == PCI_IRQ_NONE)
+    {
+      printf ("e1000: no interrupt line, ignoring\n");
+      return false;
+    }
+  if (!setup_rings (n))
+    {
+      printf ("e1000: out of memory, ignoring\n");
+      return false;
+    }
+  pci_enable (dev, PCI_CMD_MEMORY | PCI_CMD_MASTER);
+  n->regs = mmio_map (bar->base, bar->size);
+  n->irq = dev->irq + 0x20;
+
+  /* Reset, with interrupts masked, and bring the link up. */
+  n->regs[REG_IMC / 4] = 0xffffffff;
+  n->regs[REG_CTRL / 4] |= CTRL_RST;
+  timer_msleep (1);
+  for (i = 0; i < 100 && n->regs[REG_CTRL / 4] & CTRL_RST; i++)
+    timer_msleep (1);
+  n->regs[REG_IMC / 4] = 0xffffffff;
+  (void) n->regs[REG_ICR / 4];
+  n->regs[REG_CTRL / 4] |= CTRL_SLU | CTRL_ASDE;
+  read_mac (n);
+  for (i = 0; i < 128; i++)
+    n->regs[REG_MTA / 4 + i] = 0;
+
+  /* Every receive descriptor but one belongs to the card. */
+  n->regs[REG_RDBAL / 4] = vtop (n->rx);
+  n->regs[REG_RDBAH / 4] = 0;
+  n->regs[REG_RDLEN / 4] = NET_RING_ENTRIES * sizeof *n->rx;
+  n->regs[REG_RDH / 4] = 0;
+  set_rdt (n);
+  n->regs[REG_RCTL / 4] = RCTL_EN | RCTL_BAM | RCTL_SECRC;
+
+  n->regs[REG_TDBAL / 4] = vtop (n->tx);
+  n->regs[REG_TDBAH / 4] = 0;
+  n->regs[REG_TDLEN / 4] = NET_RING_ENTRIES * sizeof *n->tx;
+  n->regs[REG_TDH / 4] = 0;
+  n->regs[REG_TDT / 4] = 0;
+  n->regs[REG_TIPG / 4] = TIPG_VALUE;
+  n->regs[REG_TCTL / 4] = (TCTL_EN | TCTL_PSP | TCTL_CT (0x10)
+                           | TCTL_COLD (0x40));
+
+  intr_register_ext (n->irq, interrupt_handler, "e1000");
+  n->regs[REG_ITR / 4] = ITR_INTERVAL;
+  n->regs[REG_IMS / 4] = ICR_TXDW | ICR_LSC | ICR_RXDMT0 | ICR_RXO | ICR_RXT0;
+
+  printf ("e1000: MAC %02x:%02x:%02x:%02x:%02x:%02x, "
+          "%d-entry rings\n",
+          n->ring->mac[0], n->ring->mac[1], n->ring->mac[2],
+          n->ring->mac[3], n->ring->mac[4], n->ring->mac[5],
+          NET_RING_ENTRIES);
+  return true;
+}
+
+/* Allocates card N's descriptor rings, its control page and its
+   packet buffers, and points each descriptor at its buffer.
+   Returns true if successful, false if out of memory. */
+static bool
+setup_rings (struct e1000 *n)
+{
+  uint8_t *descs = palloc_get_page (PAL_ZERO);
+  size_t i;
+
+  n->pages = palloc_get_multiple (PAL_ZERO, MAP_PAGES);
+  if (descs == NULL || n->pages == NULL)
+    {
+      palloc_free_page (descs);
+      palloc_free_multiple (n->pages, MAP_PAGES);
+      return false;
+    }
+  n->rx = (struct rx_desc *) descs;
+  n->tx = (struct tx_desc *) (descs + NET_RING_ENTRIES * sizeof *n->rx);
+  n->ring = (struct net_ring *) n->pages;
+  for (i = 0; i < NET_RING_ENTRIES; i++)
+    {
+      n->rx[i].addr = vtop (NET_RX_BUF (n->ring, i));
+      n->tx[i].addr = vtop (NET_TX_BUF (n->ring, i));
+    }
+  return true;
+}
+
+/* Reads card N's Ethernet address into its control page, from
+   receive address 0 if the card loaded it there at reset, or
+   else from the EEPROM. */
+static void
+read_mac (struct e1000 *n)
+{
+  uint8_t *mac = n->ring->mac;
+  int i;
+
+  if (n->regs[REG_RAH / 4] & RAH_AV)
+    {
+      uint32_t lo = n->regs[REG_RAL / 4];
+      uint32_t hi = n->regs[REG_RAH / 4];
+
+      for (i = 0; i < 4; i++)
+        mac[i] = lo >> (8 * i);
+      mac[4] = hi;
+      mac[5] = hi >> 8;
+      return;
+    }
+
+  for (i = 0; i < 3; i++)
+    {
+      uint32_t eerd;
+      int j;
+
+      n->regs[REG_EERD / 4] = EERD_START | i << 8;
+      for (j = 0; j < 1000; j++)
+        if ((eerd = n->regs[REG_EERD / 4]) & EERD_DONE)
+          break;
+      mac[2 * i] = eerd >> 16;
+      mac[2 * i + 1] = eerd >> 24;
+    }
+  n->regs[REG_RAL / 4] = (mac[0] | mac[1] << 8 | mac[2] << 16
+                          | (uint32_t) mac[3] << 24);
+  n->regs[REG_RAH / 4] = mac[4] | mac[5] << 8 | RAH_AV;
+}
+
+/* Gives card N every receive descriptor that the process does
+   not hold, less one, since a tail equal to the head would mean
+   that the card has none. */
+static void
+set_rdt (struct e1000 *n)
+{
+  n->regs[REG_RDT / 4] = (n->rx_head + NET_RING_ENTRIES - 1)
+                         % NET_RING_ENTRIES;
+}
+
+/* Claims the network card for the current process, which then
+   maps its pages.  Packets received before now are dropped.
+   Returns false if there is no card or another process has
+   claimed it. */
+bool
+e1000_claim (void)
+{
+  struct e1000 *n = &nic;
+  enum intr_level old_level;
+  bool success;
+
+  lock_acquire (&n->lock);
+  success = n->regs != NULL && !n->claimed;
+  if (success)
+    {
+      n->claimed = true;
+      old_level = intr_disable ();
+      reap_tx (n);
+      n->rx_head = n->ring->rx_head = n->ring->rx_tail = n->rx_tail;
+      n->ring->tx_tail = n->tx_posted;
+      set_rdt (n);
+      intr_set_level (old_level);
+    }
+  lock_release (&n->lock);
+  return success;
+}
+
+/* Returns the kernel address of page PAGE_NO of the NET_MAP_SIZE
+   bytes that the claiming process maps. */
+void *
+e1000_map_page (size_t page_no)
+{
+  ASSERT (nic.claimed);
+  ASSERT (page_no < MAP_PAGES);
+  return nic.pages + page_no * PGSIZE;
+}
+
+/* Gives up the current process's claim on the network card,
+   once it has unmapped the card's pages. */
+void
+e1000_release (void)
+{
+  lock_acquire (&nic.lock);
+  ASSERT (nic.claimed);
+  nic.claimed = false;
+  lock_release (&nic.lock);
+}
+
+/* Gives the card the packets that the process has queued in the
+   send ring, then, if the ring is full, waits until the card
+   finishes one.  Returns the number of packets given to the
+   card, or -1 if the process queued more than the ring holds,
+   NET_RING_ENTRIES - 1 packets, since a tail equal to the head
+   would mean that the card has none. */
+int
+e1000_send (void)
+{
+  struct e1000 *n = &nic;
+  enum intr_level old_level;
+  uint32_t tail;
+  int cnt = 0;
+
+  lock_acquire (&n->lock);
+  ASSERT (n->claimed);
+  tail = n->ring->tx_tail;
+  old_level = intr_disable ();
+  reap_tx (n);
+  intr_set_level (old_level);
+  if (tail - n->tx_posted > n->tx_head + NET_RING_ENTRIES - 1 - n->tx_posted)
+    {
+      lock_release (&n->lock);
+      return -1;
+    }
+
+  while (n->tx_posted != tail)
+    {
+      size_t i = n->tx_posted++ % NET_RING_ENTRIES;
+      size_t len = n->ring->tx_len[i];
+
+      if (len > NET_PACKET_MAX)
+        len = NET_PACKET_MAX;
+      else if (len < NET_PACKET_MIN)
+        len = NET_PACKET_MIN;
+      n->tx[i].length = len;
+      n->tx[i].cmd = TXD_CMD_EOP | TXD_CMD_IFCS | TXD_CMD_RS;
+      n->tx[i].status = 0;
+      cnt++;
+    }
+
+  /* The card may fetch the descriptors as soon as the tail
+     moves past them. */
+  barrier ();
+  n->regs[REG_TDT / 4] = n->tx_posted % NET_RING_ENTRIES;
+
+  old_level = intr_disable ();
+  while (n->tx_posted - n->tx_head == NET_RING_ENTRIES - 1)
+    {
+      sema_down (&n->tx_done);
+      reap_tx (n);
+    }
+  intr_set_level (old_level);
+  lock_release (&n->lock);
+  return cnt;
+}
+
+/* Gives the card back the receive buffers that the process has
+   consumed, then, if WAIT is true and no packets are waiting,
+   waits for one.  Returns the number of packets waiting for the
+   process, or -1 if its receive head is out of range. */
+int
+e1000_recv (bool wait)
+{
+  struct e1000 *n = &nic;
+  enum intr_level old_level;
+  uint32_t head;
+  int cnt;
+
+  lock_acquire (&n->lock);
+  ASSERT (n->claimed);
+  head = n->ring->rx_head;
+  old_level = intr_disable ();
+  if (head - n->rx_head > n->rx_tail - n->rx_head)
+    {
+      intr_set_level (old_level);
+      lock_release (&n->lock);
+      return -1;
+    }
+  n->rx_head = head;
+  set_rdt (n);
+  intr_set_level (old_level);
+  lock_release (&n->lock);
+
+  old_level = intr_disable ();
+  while (wait && n->rx_tail == n->rx_head)
+    sema_down (&n->rx_ready);
+  cnt = n->rx_tail - n->rx_head;
+  intr_set_level (old_level);
+  return cnt;
+}
+
+/* Hands the packets that card N has received to the process, by
+   advancing the control page's receive tail past them.  A
+   packet with errors is passed on with length 0. */
+static void
+receive (struct e1000 *n)
+{
+  uint32_t first = n->rx_tail;
+
+  for (;;)
+    {
+      size_t i = n->rx_tail % NET_RING_ENTRIES;
+      struct rx_desc *d = &n->rx[i];
+
+      if (!(d->status & RXD_DD))
+        break;
+      n->ring->rx_len[i] = ((d->status & RXD_EOP) && d->errors == 0
+                            ? d->length : 0);
+      d->status = 0;
+      n->rx_tail++;
+    }
+  n->ring->rx_tail = n->rx_tail;
+  if (n->rx_tail != first)
+    sema_up (&n->rx_ready);
+}
+
+/* Advances card N's send head past the packets it has finished
+   sending. */
+static void
+reap_tx (struct e1000 *n)
+{
+  while (n->tx_head != n->tx_posted
+         && n->tx[n->tx_head % NET_RING_ENTRIES].status & TXD_DD)
+    n->tx_head++;
+  n->ring->tx_head = n->tx_head;
+}
+
+/* e1000 interrupt handler.  Reading the cause also acknowledges
+   it, and reads 0 if the card did not interrupt, as when another
+   device on the line did. */
+static void
+interrupt_handler (struct intr_frame *f UNUSED)
+{
+  struct e1000 *n = &nic;
+  uint32_t cause = n->regs[REG_ICR / 4];
+
+  if (cause & (ICR_RXT0 | ICR_RXDMT0 | ICR_RXO))
+    receive (n);
+  if (cause & ICR_TXDW)
+    {
+      uint32_t head = n->tx_head;
+
+      reap_tx (n);
+      if (n->tx_head != head)
+        sema_up (&n->tx_done);
+    }
+}
@@ -0,0 +1,15 @@
+#ifndef DEVICES_E1000_H
+#define DEVICES_E1000_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+void e1000_init (void);
+
+bool e1000_claim (void);
+void *e1000_map_page (size_t page_no);
+void e1000_release (void);
+int e1000_send (void);
+int e1000_recv (bool wait);
+
+#endif /* devices/e1000.h */
@@ -5,10 +5,14 @@
 #include <stdio.h>
 #include "devices/block.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
    controller.  It attempts to comply to [ATA-3]. */
@@ -24,16 +28,15 @@
 #define reg_status(CHANNEL) ((CHANNEL)->reg_base + 7)   /* Status (r/o). */
 #define reg_command(CHANNEL) reg_status (CHANNEL)       /* Command (w/o). */
 
-/* ATA control block port addresses.
-   (If we supported non-legacy ATA controllers this would not be
-   flexible enough, but it's fine for what we do.) */
-#define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
+/* ATA control block port addresses. */
+#define reg_ctl(CHANNEL) ((CHANNEL)->ctl_base + 2)      /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +52,34 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+#define CMD_FLUSH_CACHE 0xe7            /* FLUSH CACHE. */
+
+/* Bus master IDE port addresses, per [SFF-8038i].  A PCI IDE
+   controller's BAR4 gives the base of 16 ports, 8 per channel. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
+/* Bus Master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* Transfer from disk to memory. */
+
+/* Bus Master Status Register bits (write 1 to clear). */
+#define BM_STA_ERROR 0x02       /* Transfer failed. */
+#define BM_STA_INTR 0x04        /* Disk raised its interrupt. */
+
+/* Physical Region Descriptor: one physically contiguous piece
+   of a DMA transfer, which may not cross a 64 kB boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address. */
+    uint16_t size;              /* Bytes, 0 meaning 64 kB. */
+    uint16_t flags;             /* PRD_EOT on the last entry. */
+  };
+#define PRD_EOT 0x8000          /* End of table. */
+#define PRD_CNT (PGSIZE / sizeof (struct prd))
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +88,8 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    bool dma;                   /* Transfer by bus master DMA? */
+    bool flush;                 /* Supports FLUSH CACHE? */
   };
 
 /* An ATA channel (aka controller).
@@ -65,17 +98,23 @@ struct channel
   {
     char name[8];               /* Name, e.g. "ide0". */
     uint16_t reg_base;          /* Base I/O port. */
+    uint16_t ctl_base;          /* Base of control block ports. */
     uint8_t irq;                /* Interrupt in use. */
+    uint16_t bm_base;           /* Bus master base port, 0 if none. */
+    struct prd *prdt;           /* PRD table, one page, if bm_base. */
 
     struct lock lock;           /* Must acquire to access the controller. */
     bool expecting_interrupt;   /* True if an interrupt is expected, false if
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
+    struct semaphore probed;    /* Up'd once probed during ide_init(). */
 
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
-/* We support the two "legacy" ATA channels found in a standard PC. */
+/* We support the two ATA channels of a standard PC, at their
+   legacy ports or wherever a PCI controller in native mode puts
+   them. */
 #define CHANNEL_CNT 2
 static struct channel channels[CHANNEL_CNT];
 
@@ -84,8 +123,9 @@ static struct block_operations ide_operations;
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
+static thread_func probe_thread;
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sectors (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -95,12 +135,21 @@ static bool wait_while_busy (const struct ata_disk *);
 static void select_device (const struct ata_disk *);
 static void select_device_wait (const struct ata_disk *);
 
+static bool find_native_ports (struct pci_dev *, size_t chan_no,
+                               struct channel *);
+static uint16_t find_bus_master (struct pci_dev *);
+static void dma_transfer (struct ata_disk *, block_sector_t, size_t cnt,
+                          void *buffer, bool write);
+
 static void interrupt_handler (struct intr_frame *);
 
 /* Initialize the disk subsystem and detect disks. */
 void
 ide_init (void) 
 {
+  /* Class 1 is mass storage, subclass 1 IDE. */
+  struct pci_dev *pci = pci_find_class (0x01, 0x01);
+  uint16_t bm_base = find_bus_master (pci);
   size_t chan_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
@@ -110,22 +159,29 @@ ide_init (void)
 
       /* Initialize channel. */
       snprintf (c->name, sizeof c->name, "ide%zu", chan_no);
-      switch (chan_no) 
-        {
-        case 0:
-          c->reg_base = 0x1f0;
-          c->irq = 14 + 0x20;
-          break;
-        case 1:
-          c->reg_base = 0x170;
-          c->irq = 15 + 0x20;
-          break;
-        default:
-          NOT_REACHED ();
-        }
-      lock_init (&c->lock);
+      if (!find_native_ports (pci, chan_no, c))
+        switch (chan_no) 
+          {
+          case 0:
+            c->reg_base = 0x1f0;
+            c->ctl_base = 0x3f4;
+            c->irq = 14 + 0x20;
+            break;
+          case 1:
+            c->reg_base = 0x170;
+            c->ctl_base = 0x374;
+            c->irq = 15 + 0x20;
+            break;
+          default:
+            NOT_REACHED ();
+          }
+      c->bm_base = bm_base != 0 ? bm_base + chan_no * 8 : 0;
+      c->prdt = (c->bm_base != 0
+                 ? palloc_get_page (PAL_ASSERT | PAL_ZERO) : NULL);
+      lock_init_named (&c->lock, c->name);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      sema_init (&c->probed, 0);
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,17 +192,37 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->dma = false;
         }
 
-      /* Register interrupt handler. */
-      intr_register_ext (c->irq, interrupt_handler, c->name);
+      /* Register interrupt handler, once if the channels share
+         the controller's PCI interrupt. */
+      if (chan_no == 0 || c->irq != channels[0].irq)
+        intr_register_ext (c->irq, interrupt_handler, c->name);
+    }
 
-      /* Reset hardware. */
-      reset_channel (c);
+  /* Resetting a channel mostly sleeps, so probe the other channels
+     in threads of their own while this thread probes the first. */
+  for (chan_no = 1; chan_no < CHANNEL_CNT; chan_no++)
+    {
+      struct channel *c = &channels[chan_no];
+      char name[16];
 
-      /* Distinguish ATA hard disks from other devices. */
-      if (check_device_type (&c->devices[0]))
-        check_device_type (&c->devices[1]);
+      snprintf (name, sizeof name, "%s-probe", c->name);
+      if (thread_create (name, PRI_DEFAULT, probe_thread, c) == TID_ERROR)
+        probe_thread (c);
+    }
+  probe_thread (&channels[0]);
+
+  /* Register the disks in order, so that their names and the order
+     in which their partitions are found do not depend on which
+     channel finished first. */
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+    {
+      struct channel *c = &channels[chan_no];
+      int dev_no;
+
+      sema_down (&c->probed);
 
       /* Read hard disk identity information. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -154,6 +230,23 @@ ide_init (void)
           identify_ata_device (&c->devices[dev_no]);
     }
 }
+
+/* Resets channel C_ and finds out which of its devices are ATA
+   disks, then ups its probed semaphore. */
+static void
+probe_thread (void *c_)
+{
+  struct channel *c = c_;
+
+  /* Reset hardware. */
+  reset_channel (c);
+
+  /* Distinguish ATA hard disks from other devices. */
+  if (check_device_type (&c->devices[0]))
+    check_device_type (&c->devices[1]);
+
+  sema_up (&c->probed);
+}
 
 /* Disk detection and identification. */
 
@@ -286,8 +379,14 @@ identify_ata_device (struct ata_disk *d)
   capacity = *(uint32_t *) &id[60 * 2];
   model = descramble_ata_string (&id[10 * 2], 20);
   serial = descramble_ata_string (&id[27 * 2], 40);
+  /* Word 49 bit 8 says the disk supports DMA. */
+  d->dma = c->bm_base != 0 && (*(uint16_t *) &id[49 * 2] & 0x100) != 0;
+  /* Word 83, if bit 14 alone of its top two is set, says in bit
+     12 that the disk supports FLUSH CACHE. */
+  d->flush = (*(uint16_t *) &id[83 * 2] & 0xd000) == 0x5000;
   snprintf (extra_info, sizeof extra_info,
-            "model \"%s\", serial \"%s\"", model, serial);
+            "model \"%s\", serial \"%s\"%s%s", model, serial,
+            d->dma ? ", DMA" : "", d->flush ? ", flush" : "");
 
   /* Disable access to IDE disks over 1 GB, which are likely
      physical IDE disks rather than virtual ones.  If we don't
@@ -337,63 +436,169 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
+/* Most sectors one command transfers: a sector count of 0 in
+   the Sector Count register means 256. */
+#define MAX_NSECT 256
+
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFER,
+   which must have room for CNT * BLOCK_SECTOR_SIZE bytes.  Issues
+   one command per MAX_NSECT sectors.  By DMA the disk interrupts
+   once per command; otherwise it interrupts once per sector as
+   each becomes ready, and the CPU copies the data.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_read_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                   void *buffer)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  uint8_t *p = buffer;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
+  while (cnt > 0)
+    {
+      size_t n = cnt < MAX_NSECT ? cnt : MAX_NSECT;
+      size_t i;
+
+      if (d->dma && ((uintptr_t) p & 1) == 0)
+        {
+          dma_transfer (d, sec_no, n, p, false);
+          p += n * BLOCK_SECTOR_SIZE;
+        }
+      else
+        {
+          select_sectors (d, sec_no, n);
+          issue_pio_command (c, CMD_READ_SECTOR_RETRY);
+          for (i = 0; i < n; i++)
+            {
+              sema_down (&c->completion_wait);
+              if (!wait_while_busy (d))
+                PANIC ("%s: disk read failed, sector=%"PRDSNu,
+                       d->name, sec_no + i);
+              input_sector (c, p);
+              p += BLOCK_SECTOR_SIZE;
+            }
+        }
+      sec_no += n;
+      cnt -= n;
+    }
   lock_release (&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
+/* Writes CNT sectors starting at SEC_NO to disk D from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes.  Returns
+   after the disk has acknowledged receiving the data.  Issues one
+   command per MAX_NSECT sectors, like ide_read_multiple(), by DMA
+   if the disk supports it.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+ide_write_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                    const void *buffer)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  const uint8_t *p = buffer;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
+  while (cnt > 0)
+    {
+      size_t n = cnt < MAX_NSECT ? cnt : MAX_NSECT;
+      size_t i;
+
+      if (d->dma && ((uintptr_t) p & 1) == 0)
+        {
+          dma_transfer (d, sec_no, n, (void *) p, true);
+          p += n * BLOCK_SECTOR_SIZE;
+        }
+      else
+        {
+          select_sectors (d, sec_no, n);
+          issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
+          for (i = 0; i < n; i++)
+            {
+              if (!wait_while_busy (d))
+                PANIC ("%s: disk write failed, sector=%"PRDSNu,
+                       d->name, sec_no + i);
+              output_sector (c, p);
+              p += BLOCK_SECTOR_SIZE;
+              sema_down (&c->completion_wait);
+            }
+        }
+      sec_no += n;
+      cnt -= n;
+    }
+  lock_release (&c->lock);
+}
+
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes. */
+static void
+ide_read (void *d, block_sector_t sec_no, void *buffer)
+{
+  ide_read_multiple (d, sec_no, 1, buffer);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
+   acknowledged receiving the data. */
+static void
+ide_write (void *d, block_sector_t sec_no, const void *buffer)
+{
+  ide_write_multiple (d, sec_no, 1, buffer);
+}
+
+/* Has disk D write the data in its write cache to the medium,
+   so that every write it has acknowledged is durable.  Does
+   nothing if D does not support FLUSH CACHE, and stops using it
+   if D rejects it. */
+static void
+ide_flush (void *d_)
+{
+  struct ata_disk *d = d_;
+  struct channel *c = d->channel;
+
+  if (!d->flush)
+    return;
+
+  lock_acquire (&c->lock);
+  select_device_wait (d);
+  issue_pio_command (c, CMD_FLUSH_CACHE);
   sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if (inb (reg_alt_status (c)) & STA_ERR)
+    {
+      printf ("%s: FLUSH CACHE failed, not using it\n", d->name);
+      d->flush = false;
+    }
   lock_release (&c->lock);
 }
 
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple,
+    ide_flush,
+    NULL
   };
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the number of sectors CNT, at most
+   MAX_NSECT, to the disk's sector selection registers.  (We use
+   LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sectors (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= MAX_NSECT);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt % MAX_NSECT);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -502,26 +707,153 @@ select_device_wait (const struct ata_disk *d)
   wait_until_idle (d);
 }
 
+/* Bus master DMA. */
+
+/* If PCI IDE controller PCI, which may be null, runs channel
+   CHAN_NO in native mode, as bit 0 or 2 of its programming
+   interface says, sets C's ports from its BARs and C's interrupt
+   from its interrupt line and returns true.  Otherwise, returns
+   false, leaving C at its legacy ports. */
+static bool
+find_native_ports (struct pci_dev *pci, size_t chan_no, struct channel *c)
+{
+  const struct pci_bar *cmd, *ctl;
+
+  if (pci == NULL || !(pci->prog_if & (1 << (chan_no * 2))))
+    return false;
+
+  /* BAR0 and BAR1 are channel 0's command and control blocks,
+     BAR2 and BAR3 channel 1's. */
+  cmd = &pci->bars[chan_no * 2];
+  ctl = &pci->bars[chan_no * 2 + 1];
+  if (!cmd->io || cmd->base == 0 || !ctl->io || ctl->base == 0
+      || pci->irq == PCI_IRQ_NONE)
+    return false;
+
+  pci_enable (pci, PCI_CMD_IO);
+  c->reg_base = cmd->base;
+  c->ctl_base = ctl->base;
+  c->irq = pci->irq + 0x20;
+  printf ("%s: native mode at ports 0x%04x, 0x%04x, IRQ %d\n",
+          c->name, c->reg_base, c->ctl_base, pci->irq);
+  return true;
+}
+
+/* If PCI IDE controller PCI, which may be null, can act as a bus
+   master, as [SFF-8038i] describes, enables its bus mastering.
+   Returns the base of its bus master ports, or 0 if it cannot,
+   in which case all transfers use PIO. */
+static uint16_t
+find_bus_master (struct pci_dev *pci)
+{
+  const struct pci_bar *bar;
+
+  /* Bit 7 of the programming interface says the controller is
+     bus master capable. */
+  if (pci == NULL || !(pci->prog_if & 0x80))
+    return 0;
+
+  /* BAR4 must be an I/O space base address. */
+  bar = &pci->bars[4];
+  if (!bar->io || bar->base == 0)
+    return 0;
+
+  pci_enable (pci, PCI_CMD_IO | PCI_CMD_MASTER);
+  printf ("ide: bus master DMA at port 0x%04x\n", (unsigned) bar->base);
+  return bar->base;
+}
+
+/* Fills in C's PRD table to describe the CNT sectors at BUFFER,
+   which must be a kernel virtual address. */
+static void
+build_prdt (struct channel *c, void *buffer, size_t cnt)
+{
+  uintptr_t phys = vtop (buffer);
+  size_t size = cnt * BLOCK_SECTOR_SIZE;
+  size_t i;
+
+  /* Kernel virtual memory maps physical memory linearly, so the
+     buffer is physically contiguous; only 64 kB boundaries
+     split it. */
+  for (i = 0; size > 0; i++)
+    {
+      size_t chunk = 0x10000 - (phys & 0xffff);
+      if (chunk > size)
+        chunk = size;
+
+      ASSERT (i < PRD_CNT);
+      c->prdt[i].addr = phys;
+      c->prdt[i].size = chunk & 0xffff;
+      c->prdt[i].flags = 0;
+      phys += chunk;
+      size -= chunk;
+    }
+  c->prdt[i - 1].flags = PRD_EOT;
+}
+
+/* Transfers CNT sectors, at most MAX_NSECT, starting at SEC_NO
+   between disk D and BUFFER by bus master DMA: into BUFFER if
+   WRITE is false, from it if WRITE is true.  The controller moves
+   the data itself and the disk interrupts once, at the end.
+   BUFFER must be 2-byte aligned.  D's channel must be locked. */
+static void
+dma_transfer (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+              void *buffer, bool write)
+{
+  struct channel *c = d->channel;
+  uint8_t direction = write ? 0 : BM_CMD_READ;
+  uint8_t bm_status;
+
+  ASSERT (d->dma);
+  ASSERT (is_kernel_vaddr (buffer));
+  ASSERT (((uintptr_t) buffer & 1) == 0);
+
+  build_prdt (c, buffer, cnt);
+  outb (reg_bm_command (c), direction);
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_status (c), BM_STA_ERROR | BM_STA_INTR);
+
+  select_sectors (d, sec_no, cnt);
+  issue_pio_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (reg_bm_command (c), direction | BM_CMD_START);
+  sema_down (&c->completion_wait);
+  outb (reg_bm_command (c), direction);
+
+  bm_status = inb (reg_bm_status (c));
+  outb (reg_bm_status (c), BM_STA_ERROR | BM_STA_INTR);
+  if ((bm_status & BM_STA_ERROR) || (inb (reg_alt_status (c)) & STA_ERR))
+    PANIC ("%s: disk %s failed, sector=%"PRDSNu,
+           d->name, write ? "write" : "read", sec_no);
+}
+
 /* ATA interrupt handler. */
 static void
 interrupt_handler (struct intr_frame *f) 
 {
   struct channel *c;
+  struct channel *first = NULL;
+  bool shared = channels[0].irq == channels[1].irq;
+  bool expected = false;
 
+  /* In native mode both channels share the interrupt, so a
+     channel still busy did not raise it. */
   for (c = channels; c < channels + CHANNEL_CNT; c++)
     if (f->vec_no == c->irq)
       {
-        if (c->expecting_interrupt) 
+        if (first == NULL)
+          first = c;
+        if (c->expecting_interrupt
+            && (!shared || !(inb (reg_alt_status (c)) & STA_BSY)))
           {
             inb (reg_status (c));               /* Acknowledge interrupt. */
             sema_up (&c->completion_wait);      /* Wake up waiter. */
+            expected = true;
           }
-        else
-          printf ("%s: unexpected interrupt\n", c->name);
-        return;
       }
 
-  NOT_REACHED ();
+  ASSERT (first != NULL);
+  if (!expected)
+    printf ("%s: unexpected interrupt\n", first->name);
 }
 
 
@@ -29,18 +29,37 @@ input_putc (uint8_t key)
    If the buffer is empty, waits for a key to be pressed. */
 uint8_t
 input_getc (void) 
+{
+  return input_getc_unless (NULL);
+}
+
+/* Like input_getc(), but if STOP is non-null, returns -1 instead
+   of waiting, or of waiting any longer once woken by
+   input_kick(), as soon as STOP returns true. */
+int
+input_getc_unless (bool (*stop) (void))
 {
   enum intr_level old_level;
-  uint8_t key;
+  int key;
 
   old_level = intr_disable ();
-  key = intq_getc (&buffer);
+  key = intq_getc_unless (&buffer, stop);
   serial_notify ();
   intr_set_level (old_level);
   
   return key;
 }
 
+/* Wakes the thread waiting for a key, if any, to check whether it
+   should stop waiting. */
+void
+input_kick (void)
+{
+  enum intr_level old_level = intr_disable ();
+  intq_kick (&buffer);
+  intr_set_level (old_level);
+}
+
 /* Returns true if the input buffer is full,
    false otherwise.
    Interrupts must be off. */
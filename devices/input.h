@@ -7,6 +7,8 @@
 void input_init (void);
 void input_putc (uint8_t);
 uint8_t input_getc (void);
+int input_getc_unless (bool (*stop) (void));
+void input_kick (void);
 bool input_full (void);
 
 #endif /* devices/input.h */
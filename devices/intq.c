@@ -1,5 +1,6 @@
 #include "devices/intq.h"
 #include <debug.h>
+#include <string.h>
 #include "threads/thread.h"
 
 static int next (int pos);
@@ -36,6 +37,15 @@ intq_full (const struct intq *q)
    When called from an interrupt handler, Q must not be empty. */
 uint8_t
 intq_getc (struct intq *q) 
+{
+  return intq_getc_unless (q, NULL);
+}
+
+/* Like intq_getc(), but if STOP is non-null, returns -1 instead
+   of sleeping, or of sleeping any longer once woken by
+   intq_kick(), as soon as STOP returns true. */
+int
+intq_getc_unless (struct intq *q, bool (*stop) (void))
 {
   uint8_t byte;
   
@@ -43,8 +53,11 @@ intq_getc (struct intq *q)
   while (intq_empty (q)) 
     {
       ASSERT (!intr_context ());
+      if (stop != NULL && stop ())
+        return -1;
       lock_acquire (&q->lock);
-      wait (q, &q->not_empty);
+      if (intq_empty (q) && (stop == NULL || !stop ()))
+        wait (q, &q->not_empty);
       lock_release (&q->lock);
     }
   
@@ -74,6 +87,21 @@ intq_putc (struct intq *q, uint8_t byte)
   signal (q, &q->not_empty);
 }
 
+/* Wakes the thread waiting for Q to become non-empty, if any,
+   so that it checks the STOP function it passed to
+   intq_getc_unless() again.  Interrupts must be off. */
+void
+intq_kick (struct intq *q)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (q->not_empty != NULL)
+    {
+      thread_unblock (q->not_empty);
+      q->not_empty = NULL;
+    }
+}
+
 /* Returns the position after POS within an intq. */
 static int
 next (int pos) 
@@ -112,3 +140,100 @@ signal (struct intq *q UNUSED, struct thread **waiter)
       *waiter = NULL;
     }
 }
+
+/* Initializes Q as an empty ring over the SIZE bytes in BUF.
+   SIZE must be a power of 2. */
+void
+spscq_init (struct spscq *q, void *buf, size_t size)
+{
+  ASSERT (size > 0 && (size & (size - 1)) == 0);
+
+  q->buf = buf;
+  q->mask = size - 1;
+  q->head = q->tail = 0;
+}
+
+/* Returns the number of bytes in Q.  Only a lower bound when
+   called by the producer, only an upper bound when called by the
+   consumer, since the other side may be running. */
+size_t
+spscq_count (const struct spscq *q)
+{
+  size_t count;
+
+  barrier ();
+  count = q->head - q->tail;
+  barrier ();
+  return count;
+}
+
+/* Returns the number of bytes that may be added to Q. */
+size_t
+spscq_space (const struct spscq *q)
+{
+  return q->mask + 1 - spscq_count (q);
+}
+
+/* Returns true if Q is empty, false otherwise. */
+bool
+spscq_empty (const struct spscq *q)
+{
+  return spscq_count (q) == 0;
+}
+
+/* Returns true if Q is full, false otherwise. */
+bool
+spscq_full (const struct spscq *q)
+{
+  return spscq_space (q) == 0;
+}
+
+/* Adds up to SIZE bytes from SRC to the end of Q, as many as
+   there is room for, and returns the number added.  Never
+   sleeps.  Must only be called by Q's producer. */
+size_t
+spscq_put (struct spscq *q, const void *src, size_t size)
+{
+  size_t head = q->head;
+  size_t ofs = head & q->mask;
+  size_t first;
+  size_t space = spscq_space (q);
+
+  if (size > space)
+    size = space;
+  first = q->mask + 1 - ofs;
+  if (first > size)
+    first = size;
+  memcpy (q->buf + ofs, src, first);
+  memcpy (q->buf, (const uint8_t *) src + first, size - first);
+
+  /* Publish the new bytes only once they are in the buffer. */
+  barrier ();
+  q->head = head + size;
+  return size;
+}
+
+/* Removes up to SIZE bytes from the front of Q into DST, as many
+   as Q holds, and returns the number removed.  Never sleeps.
+   Must only be called by Q's consumer. */
+size_t
+spscq_get (struct spscq *q, void *dst, size_t size)
+{
+  size_t tail = q->tail;
+  size_t ofs = tail & q->mask;
+  size_t first;
+  size_t count = spscq_count (q);
+
+  if (size > count)
+    size = count;
+  first = q->mask + 1 - ofs;
+  if (first > size)
+    first = size;
+  memcpy (dst, q->buf + ofs, first);
+  memcpy ((uint8_t *) dst + first, q->buf, size - first);
+
+  /* Release the space only once the bytes have been copied out. */
+  barrier ();
+  q->tail = tail + size;
+  return size;
+}
@@ -1,6 +1,7 @@
 #ifndef DEVICES_INTQ_H
 #define DEVICES_INTQ_H
 
+#include <stddef.h>
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 
@@ -38,6 +39,38 @@ void intq_init (struct intq *);
 bool intq_empty (const struct intq *);
 bool intq_full (const struct intq *);
 uint8_t intq_getc (struct intq *);
+int intq_getc_unless (struct intq *, bool (*stop) (void));
+void intq_kick (struct intq *);
 void intq_putc (struct intq *, uint8_t);
 
+/* A single-producer, single-consumer ring of bytes.
+
+   Unlike an intq, an spscq needs no locking and no interrupt
+   masking as long as at most one context adds bytes and at most
+   one context removes them at any time: the producer alone
+   advances HEAD and the consumer alone advances TAIL, each only
+   after the bytes it covers have been written or read.  A kernel
+   thread may thus fill the ring with interrupts on while an
+   interrupt handler drains it.  Keeping to one producer and one
+   consumer is up to the caller.
+
+   The capacity is a power of 2 chosen by the caller, who also
+   supplies the buffer.  HEAD and TAIL count bytes ever added and
+   removed, and wrap around freely. */
+struct spscq
+  {
+    uint8_t *buf;               /* Buffer. */
+    size_t mask;                /* Capacity minus 1. */
+    size_t head;                /* Bytes added so far. */
+    size_t tail;                /* Bytes removed so far. */
+  };
+
+void spscq_init (struct spscq *, void *buf, size_t size);
+size_t spscq_count (const struct spscq *);
+size_t spscq_space (const struct spscq *);
+bool spscq_empty (const struct spscq *);
+bool spscq_full (const struct spscq *);
+size_t spscq_put (struct spscq *, const void *, size_t);
+size_t spscq_get (struct spscq *, void *, size_t);
+
 #endif /* devices/intq.h */
@@ -167,6 +167,7 @@ found_partition (struct block *block, uint8_t part_type,
                               : part_type == 0x21 ? BLOCK_FILESYS
                               : part_type == 0x22 ? BLOCK_SCRATCH
                               : part_type == 0x23 ? BLOCK_SWAP
+                              : part_type == 0x25 ? BLOCK_SNAPSHOT
                               : BLOCK_FOREIGN);
       struct partition *p;
       char extra_info[128];
@@ -225,6 +226,7 @@ partition_type_name (uint8_t type)
       [0x22] = "Pintos scratch",
       [0x23] = "Pintos swap",
       [0x24] = "NEC DOS",
+      [0x25] = "Pintos snapshot",
       [0x39] = "Plan 9",
       [0x3c] = "PartitionMagic recovery",
       [0x40] = "Venix 80286",
@@ -317,8 +319,80 @@ partition_write (void *p_, block_sector_t sector, const void *buffer)
   block_write (p->block, p->start + sector, buffer);
 }
 
+/* Reads CNT sectors starting at SECTOR from partition P into
+   BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes. */
+static void
+partition_read_multiple (void *p_, block_sector_t sector, size_t cnt,
+                         void *buffer)
+{
+  struct partition *p = p_;
+  block_read_multiple (p->block, p->start + sector, cnt, buffer);
+}
+
+/* Writes CNT sectors starting at SECTOR to partition P from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes. */
+static void
+partition_write_multiple (void *p_, block_sector_t sector, size_t cnt,
+                          const void *buffer)
+{
+  struct partition *p = p_;
+  block_write_multiple (p->block, p->start + sector, cnt, buffer);
+}
+
+/* Flushes the write cache of the device that partition P is
+   on. */
+static void
+partition_flush (void *p_)
+{
+  struct partition *p = p_;
+  block_flush (p->block);
+}
+
+/* Completes the transfer that REQ, which partition_start()
+   forwarded, was part of. */
+static void
+forward_done (struct block_request *req)
+{
+  void *tag = req->aux;
+
+  free (req);
+  block_start_done (tag);
+}
+
+/* Starts transferring CNT sectors starting at SECTOR between
+   partition P and BUFFER by queuing them on the device that P is
+   on, so that the transfers of all its partitions wait there
+   together, to be ordered and merged with one another. */
+static void
+partition_start (void *p_, bool write, block_sector_t sector, size_t cnt,
+                 void *buffer, void *tag)
+{
+  struct partition *p = p_;
+  struct block_request *req = malloc (sizeof *req);
+
+  if (req == NULL)
+    {
+      /* Fall back to waiting for the transfer. */
+      if (write)
+        block_write_multiple (p->block, p->start + sector, cnt, buffer);
+      else
+        block_read_multiple (p->block, p->start + sector, cnt, buffer);
+      block_start_done (tag);
+      return;
+    }
+  block_request_init (req, write, p->start + sector, cnt, buffer,
+                      forward_done, tag);
+  req->class = block_start_class (tag);
+  block_submit (p->block, req);
+}
+
 static struct block_operations partition_operations =
   {
     partition_read,
-    partition_write
+    partition_write,
+    partition_read_multiple,
+    partition_write_multiple,
+    partition_flush,
+    partition_start
   };
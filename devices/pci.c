@@ -0,0 +1,252 @@
+#include "devices/pci.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/io.h"
+
+/* The code in this file accesses PCI configuration space through
+   configuration mechanism #1, which every PC chipset since the
+   early 1990s supports: write the address of a register to
+   CONFIG_ADDRESS, then transfer its contents through
+   CONFIG_DATA.
+
+   pci_init() enumerates every function once, at boot, decoding
+   its base address registers and interrupt line.  Drivers then
+   register with pci_register_driver(), which hands each of them
+   the functions that match its table of IDs and that no driver
+   registered earlier has claimed. */
+
+/* Configuration mechanism #1 ports. */
+#define CONFIG_ADDRESS 0xcf8
+#define CONFIG_DATA 0xcfc
+
+/* CONFIG_ADDRESS bits. */
+#define ADDRESS_ENABLE 0x80000000
+
+/* Base address register bits. */
+#define BAR_IO 0x1              /* In I/O space. */
+#define BAR_TYPE_64 0x4         /* 64-bit memory address, in 2 BARs. */
+
+/* Functions found by pci_init(), in bus, device and function
+   order. */
+#define DEV_MAX 64
+static struct pci_dev devs[DEV_MAX];
+static size_t dev_cnt;
+
+static void add_dev (struct pci_addr);
+static bool decode_bar (struct pci_addr, int bar, struct pci_bar *);
+static bool id_matches (const struct pci_dev *, const struct pci_id *);
+
+/* Returns the CONFIG_ADDRESS value that selects register REG of
+   function A. */
+static uint32_t
+config_address (struct pci_addr a, uint8_t reg)
+{
+  ASSERT (a.dev < 32 && a.func < 8);
+  ASSERT (reg % 4 == 0);
+
+  return (ADDRESS_ENABLE | ((uint32_t) a.bus << 16) | (a.dev << 11)
+          | (a.func << 8) | reg);
+}
+
+/* Returns the 32-bit configuration register at byte offset REG,
+   which must be a multiple of 4, of function A.  Reading a
+   function that does not exist yields 0xffffffff. */
+uint32_t
+pci_read_config (struct pci_addr a, uint8_t reg)
+{
+  outl (CONFIG_ADDRESS, config_address (a, reg));
+  return inl (CONFIG_DATA);
+}
+
+/* Writes VALUE to the 32-bit configuration register at byte
+   offset REG, which must be a multiple of 4, of function A. */
+void
+pci_write_config (struct pci_addr a, uint8_t reg, uint32_t value)
+{
+  outl (CONFIG_ADDRESS, config_address (a, reg));
+  outl (CONFIG_DATA, value);
+}
+
+/* Enumerates the functions on every bus. */
+void
+pci_init (void)
+{
+  unsigned bus, dev, func;
+
+  for (bus = 0; bus < 256; bus++)
+    for (dev = 0; dev < 32; dev++)
+      for (func = 0; func < 8; func++)
+        {
+          struct pci_addr a = {bus, dev, func};
+
+          if ((pci_read_config (a, PCI_REG_ID) & 0xffff) == 0xffff)
+            {
+              /* No function 0 means no device at all. */
+              if (func == 0)
+                break;
+              continue;
+            }
+
+          add_dev (a);
+
+          /* Only multi-function devices implement functions
+             other than 0. */
+          if (func == 0
+              && !(pci_read_config (a, PCI_REG_HEADER) & 0x800000))
+            break;
+        }
+  printf ("pci: %zu functions found\n", dev_cnt);
+}
+
+/* Registers DRIVER and offers it each function that matches an
+   entry in its ID table and that is not claimed yet, in bus,
+   device and function order. */
+void
+pci_register_driver (const struct pci_driver *driver)
+{
+  size_t i;
+
+  for (i = 0; i < dev_cnt; i++)
+    {
+      struct pci_dev *d = &devs[i];
+      const struct pci_id *id;
+
+      if (d->driver != NULL)
+        continue;
+      for (id = driver->ids; id->vendor != 0; id++)
+        if (id_matches (d, id))
+          {
+            if (driver->probe (d, id))
+              d->driver = driver;
+            break;
+          }
+    }
+}
+
+/* Returns the first function whose class code is CLASS and whose
+   subclass is SUBCLASS, or a null pointer if there is none. */
+struct pci_dev *
+pci_find_class (uint8_t class, uint8_t subclass)
+{
+  size_t i;
+
+  for (i = 0; i < dev_cnt; i++)
+    if (devs[i].class == class && devs[i].subclass == subclass)
+      return &devs[i];
+  return NULL;
+}
+
+/* Returns the first function that a driver has claimed and
+   enabled as a bus master, which may write memory behind the
+   CPU's back at any time, or a null pointer if there is none. */
+struct pci_dev *
+pci_bus_master (void)
+{
+  size_t i;
+
+  for (i = 0; i < dev_cnt; i++)
+    if (devs[i].driver != NULL
+        && pci_read_config (devs[i].addr, PCI_REG_COMMAND) & PCI_CMD_MASTER)
+      return &devs[i];
+  return NULL;
+}
+
+/* Sets the bits in COMMAND, a combination of PCI_CMD_*, in D's
+   command register, so that it responds to accesses or may act as
+   a bus master. */
+void
+pci_enable (struct pci_dev *d, uint16_t command)
+{
+  uint32_t reg = pci_read_config (d->addr, PCI_REG_COMMAND);
+
+  /* Writing 1s to status bits would clear them. */
+  pci_write_config (d->addr, PCI_REG_COMMAND, (reg & 0xffff) | command);
+}
+
+/* Returns true if function D matches ID. */
+static bool
+id_matches (const struct pci_dev *d, const struct pci_id *id)
+{
+  return ((id->vendor == PCI_ANY || id->vendor == d->vendor)
+          && (id->device == PCI_ANY || id->device == d->device)
+          && (id->class == PCI_ANY
+              || id->class == PCI_CLASS (d->class, d->subclass)));
+}
+
+/* Sizes base address register BAR of function A and stores it
+   into *B.  Returns true if it is the low half of a 64-bit
+   memory address, whose high half is the next BAR. */
+static bool
+decode_bar (struct pci_addr a, int bar, struct pci_bar *b)
+{
+  uint8_t reg = PCI_REG_BAR0 + 4 * bar;
+  uint32_t value = pci_read_config (a, reg);
+  uint32_t mask;
+
+  /* Writing all 1s reads back the bits that the function decodes,
+     which give the size. */
+  pci_write_config (a, reg, 0xffffffff);
+  mask = pci_read_config (a, reg);
+  pci_write_config (a, reg, value);
+
+  b->io = (value & BAR_IO) != 0;
+  if (b->io)
+    {
+      b->base = value & 0xfffc;
+      mask |= 0xffff0000;
+      mask &= ~3u;
+    }
+  else
+    {
+      b->base = value & ~0xfu;
+      mask &= ~0xfu;
+    }
+  b->size = mask != 0 ? -mask : 0;
+  if (b->size == 0)
+    b->base = 0;
+  return !b->io && (value & 0x6) == BAR_TYPE_64;
+}
+
+/* Records function A, which exists, in devs[]. */
+static void
+add_dev (struct pci_addr a)
+{
+  struct pci_dev *d;
+  uint32_t id, class, intr, command;
+  int bar;
+
+  if (dev_cnt >= DEV_MAX)
+    return;
+  d = &devs[dev_cnt++];
+
+  id = pci_read_config (a, PCI_REG_ID);
+  class = pci_read_config (a, PCI_REG_CLASS);
+  intr = pci_read_config (a, PCI_REG_INTR);
+  d->addr = a;
+  d->vendor = id & 0xffff;
+  d->device = id >> 16;
+  d->class = class >> 24;
+  d->subclass = (class >> 16) & 0xff;
+  d->prog_if = (class >> 8) & 0xff;
+  d->irq = ((intr & 0xff) != 0 && (intr & 0xff) < 16
+            ? intr & 0xff : PCI_IRQ_NONE);
+  d->driver = NULL;
+
+  /* Only ordinary functions, not bridges, have 6 BARs.  Turn off
+     decoding while sizing them, so that the function does not
+     claim accesses meant for others. */
+  if ((pci_read_config (a, PCI_REG_HEADER) >> 16 & 0x7f) != 0)
+    return;
+  command = pci_read_config (a, PCI_REG_COMMAND) & 0xffff;
+  pci_write_config (a, PCI_REG_COMMAND,
+                    command & ~(PCI_CMD_IO | PCI_CMD_MEMORY));
+  for (bar = 0; bar < PCI_BAR_CNT; bar++)
+    if (decode_bar (a, bar, &d->bars[bar]))
+      {
+        /* Addresses above 4 GB are out of reach. */
+        if (pci_read_config (a, PCI_REG_BAR0 + 4 * (bar + 1)) != 0)
+          d->bars[bar].base = d->bars[bar].size = 0;
+        bar++;
+      }
+  pci_write_config (a, PCI_REG_COMMAND, command);
+}
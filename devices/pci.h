@@ -0,0 +1,95 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* A PCI function, identified by bus, device and function
+   number. */
+struct pci_addr
+  {
+    uint8_t bus;                /* Bus number, 0...255. */
+    uint8_t dev;                /* Device number, 0...31. */
+    uint8_t func;               /* Function number, 0...7. */
+  };
+
+/* Configuration space registers, as byte offsets.  Only the few
+   that we use are defined. */
+#define PCI_REG_ID 0x00         /* Vendor ID 15:0, device ID 31:16. */
+#define PCI_REG_COMMAND 0x04    /* Command 15:0, status 31:16. */
+#define PCI_REG_CLASS 0x08      /* Revision, prog-if, subclass, class. */
+#define PCI_REG_HEADER 0x0c     /* Header type at bits 23:16. */
+#define PCI_REG_BAR0 0x10       /* Base address registers 0...5. */
+#define PCI_REG_INTR 0x3c       /* Interrupt line at bits 7:0. */
+
+/* Command register bits. */
+#define PCI_CMD_IO 0x0001       /* Respond to I/O port accesses. */
+#define PCI_CMD_MEMORY 0x0002   /* Respond to memory accesses. */
+#define PCI_CMD_MASTER 0x0004   /* May act as a bus master. */
+
+/* Number of base address registers in a function's header. */
+#define PCI_BAR_CNT 6
+
+/* A decoded base address register. */
+struct pci_bar
+  {
+    uint32_t base;              /* Port or physical address, 0 if none. */
+    uint32_t size;              /* Number of ports or bytes decoded. */
+    bool io;                    /* In I/O space, not memory space? */
+  };
+
+/* A PCI function, as found by pci_init(). */
+struct pci_dev
+  {
+    struct pci_addr addr;       /* Where it is. */
+    uint16_t vendor;            /* Vendor ID. */
+    uint16_t device;            /* Device ID. */
+    uint8_t class;              /* Class code. */
+    uint8_t subclass;           /* Subclass. */
+    uint8_t prog_if;            /* Programming interface. */
+    uint8_t irq;                /* ISA interrupt line 0...15, or
+                                   PCI_IRQ_NONE. */
+    struct pci_bar bars[PCI_BAR_CNT];   /* Base address registers. */
+    const struct pci_driver *driver;    /* Driver that claimed it. */
+  };
+
+/* Value of a pci_dev's irq if it has no usable interrupt line. */
+#define PCI_IRQ_NONE 0xff
+
+/* Matches any vendor, device or class in a pci_id. */
+#define PCI_ANY 0xffff
+
+/* A class and subclass as a pci_id's class member. */
+#define PCI_CLASS(CLASS, SUBCLASS) (((CLASS) << 8) | (SUBCLASS))
+
+/* Functions a driver handles: those whose vendor ID, device ID,
+   and class and subclass each match or are PCI_ANY. */
+struct pci_id
+  {
+    uint16_t vendor;
+    uint16_t device;
+    uint16_t class;             /* PCI_CLASS(class, subclass). */
+  };
+
+/* A driver for PCI functions. */
+struct pci_driver
+  {
+    const char *name;           /* Name, for messages. */
+    const struct pci_id *ids;   /* Ends with an all-zero entry. */
+
+    /* Sets up function DEV, which matched ID.  Returns true if
+       it is now in use, false to leave it to other drivers. */
+    bool (*probe) (struct pci_dev *dev, const struct pci_id *id);
+  };
+
+void pci_init (void);
+void pci_register_driver (const struct pci_driver *);
+struct pci_dev *pci_find_class (uint8_t class, uint8_t subclass);
+struct pci_dev *pci_bus_master (void);
+void pci_enable (struct pci_dev *, uint16_t command);
+
+uint32_t pci_read_config (struct pci_addr, uint8_t reg);
+void pci_write_config (struct pci_addr, uint8_t reg, uint32_t value);
+
+#endif /* devices/pci.h */
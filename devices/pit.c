@@ -11,9 +11,6 @@
 #define PIT_PORT_CONTROL          0x43                /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL))  /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
-
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
    three output channels are hooked up like this:
 
@@ -46,7 +43,6 @@ void
 pit_configure_channel (int channel, int mode, int frequency)
 {
   uint16_t count;
-  enum intr_level old_level;
 
   ASSERT (channel == 0 || channel == 2);
   ASSERT (mode == 2 || mode == 3);
@@ -74,10 +70,57 @@ pit_configure_channel (int channel, int mode, int frequency)
   else
     count = (PIT_HZ + frequency / 2) / frequency;
 
-  /* Configure the PIT mode and load its counters. */
-  old_level = intr_disable ();
-  outb (PIT_PORT_CONTROL, (channel << 6) | 0x30 | (mode << 1));
-  outb (PIT_PORT_COUNTER (channel), count);
-  outb (PIT_PORT_COUNTER (channel), count >> 8);
-  intr_set_level (old_level);
+  pit_configure_count (channel, mode, count);
+}
+
+/**
+ * pit_configure_count - configure a PIT channel with a raw count
+ *
+ * @channel: the channel, 0 or 2
+ * @mode: the mode, 2 or 3, as for pit_configure_channel()
+ * @count: the period in PIT cycles, 0 meaning 65536
+ *
+ * Configure the given channel to a period of COUNT PIT cycles.  The
+ * counter restarts immediately, so this can also program the next
+ * interrupt of channel 0 to arrive COUNT cycles from now.
+*/
+void pit_configure_count(int channel, int mode, uint16_t count)
+{
+	enum intr_level old_level;
+
+	ASSERT(channel == 0 || channel == 2);
+	ASSERT(mode == 2 || mode == 3);
+	ASSERT(count != 1);
+
+	/* Configure the PIT mode and load its counters. */
+	old_level = intr_disable();
+	outb(PIT_PORT_CONTROL, (channel << 6) | 0x30 | (mode << 1));
+	outb(PIT_PORT_COUNTER(channel), count);
+	outb(PIT_PORT_COUNTER(channel), count >> 8);
+	intr_set_level(old_level);
+}
+
+/**
+ * pit_read_count - read the current count of a PIT channel
+ *
+ * @channel: the channel, 0 or 2
+ *
+ * Latch and return the number of PIT cycles left in the current
+ * period of the given channel.
+*/
+uint16_t pit_read_count(int channel)
+{
+	enum intr_level old_level;
+	uint16_t count;
+
+	ASSERT(channel == 0 || channel == 2);
+
+	old_level = intr_disable();
+	/* Counter latch command, then low and high bytes. */
+	outb(PIT_PORT_CONTROL, channel << 6);
+	count = inb(PIT_PORT_COUNTER(channel));
+	count |= inb(PIT_PORT_COUNTER(channel)) << 8;
+	intr_set_level(old_level);
+
+	return count;
 }
@@ -0,0 +1,159 @@
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* RAM disks.
+
+   A RAM disk is a block device whose sectors are kept in pages
+   of the kernel pool, for scratch space, swap or a file system
+   that need not outlive the machine.  Transfers are copies, so
+   they run at memory speed, which also takes the cost of
+   programmed I/O out of benchmarks of the file system's own
+   work.
+
+   The disks are named "rd0", "rd1" and so on, and are registered
+   as raw devices, so that none takes a role unless asked to by
+   -filesys, -scratch or -swap.  A page is allocated when a sector
+   in it is first written, so that a disk costs memory only for
+   what is stored on it; sectors never written read as zeros.
+
+   The block layer serves each device from a single I/O thread,
+   which calls the driver for one transfer at a time, so a disk
+   needs no lock of its own. */
+
+/* Most RAM disks. */
+#define RAMDISK_MAX 4
+
+/* Sectors in a page. */
+#define PAGE_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* A RAM disk. */
+struct ramdisk
+  {
+    char name[16];              /* "rd0" through "rd3". */
+    size_t page_cnt;            /* Number of pages. */
+    uint8_t **pages;            /* Pages, each NULL until written. */
+  };
+
+static struct block_operations ramdisk_operations;
+
+/* Creates a RAM disk of each size, in kB, in the comma-separated
+   list SIZES, which is modified.  Panics if a size is not a
+   positive number or memory is not available. */
+void
+ramdisk_init (char *sizes)
+{
+  char *token, *save_ptr;
+  int cnt = 0;
+
+  for (token = strtok_r (sizes, ",", &save_ptr); token != NULL;
+       token = strtok_r (NULL, ",", &save_ptr))
+    {
+      int kb = atoi (token);
+      block_sector_t sector_cnt = kb * (1024 / BLOCK_SECTOR_SIZE);
+      struct ramdisk *d;
+
+      if (kb <= 0)
+        PANIC ("bad RAM disk size `%s'", token);
+      if (cnt >= RAMDISK_MAX)
+        PANIC ("too many RAM disks (at most %d)", RAMDISK_MAX);
+
+      d = malloc (sizeof *d);
+      if (d == NULL)
+        PANIC ("out of memory for RAM disk");
+      snprintf (d->name, sizeof d->name, "rd%d", cnt++);
+      d->page_cnt = DIV_ROUND_UP (sector_cnt, PAGE_SECTORS);
+      d->pages = calloc (d->page_cnt, sizeof *d->pages);
+      if (d->pages == NULL)
+        PANIC ("%s: out of memory", d->name);
+      block_register (d->name, BLOCK_RAW, "RAM disk", sector_cnt,
+                      &ramdisk_operations, d);
+    }
+}
+
+/* Reads the CNT sectors starting at SECTOR of RAM disk D_ into
+   BUFFER. */
+static void
+ramdisk_read_multiple (void *d_, block_sector_t sector, size_t cnt,
+                       void *buffer_)
+{
+  struct ramdisk *d = d_;
+  uint8_t *buffer = buffer_;
+
+  while (cnt > 0)
+    {
+      uint8_t *page = d->pages[sector / PAGE_SECTORS];
+      size_t ofs = sector % PAGE_SECTORS;
+      size_t n = cnt < PAGE_SECTORS - ofs ? cnt : PAGE_SECTORS - ofs;
+
+      if (page != NULL)
+        memcpy (buffer, page + ofs * BLOCK_SECTOR_SIZE,
+                n * BLOCK_SECTOR_SIZE);
+      else
+        memset (buffer, 0, n * BLOCK_SECTOR_SIZE);
+      sector += n;
+      cnt -= n;
+      buffer += n * BLOCK_SECTOR_SIZE;
+    }
+}
+
+/* Writes the CNT sectors starting at SECTOR of RAM disk D_ from
+   BUFFER, allocating the pages that hold them if need be.
+   Panics if the kernel pool is exhausted. */
+static void
+ramdisk_write_multiple (void *d_, block_sector_t sector, size_t cnt,
+                        const void *buffer_)
+{
+  struct ramdisk *d = d_;
+  const uint8_t *buffer = buffer_;
+
+  while (cnt > 0)
+    {
+      uint8_t **page = &d->pages[sector / PAGE_SECTORS];
+      size_t ofs = sector % PAGE_SECTORS;
+      size_t n = cnt < PAGE_SECTORS - ofs ? cnt : PAGE_SECTORS - ofs;
+
+      if (*page == NULL)
+        {
+          *page = palloc_get_page (PAL_ZERO);
+          if (*page == NULL)
+            PANIC ("%s: out of memory", d->name);
+        }
+      memcpy (*page + ofs * BLOCK_SECTOR_SIZE, buffer,
+              n * BLOCK_SECTOR_SIZE);
+      sector += n;
+      cnt -= n;
+      buffer += n * BLOCK_SECTOR_SIZE;
+    }
+}
+
+/* Reads sector SECTOR of RAM disk D into BUFFER. */
+static void
+ramdisk_read (void *d, block_sector_t sector, void *buffer)
+{
+  ramdisk_read_multiple (d, sector, 1, buffer);
+}
+
+/* Writes sector SECTOR of RAM disk D from BUFFER. */
+static void
+ramdisk_write (void *d, block_sector_t sector, const void *buffer)
+{
+  ramdisk_write_multiple (d, sector, 1, buffer);
+}
+
+static struct block_operations ramdisk_operations =
+  {
+    ramdisk_read,
+    ramdisk_write,
+    ramdisk_read_multiple,
+    ramdisk_write_multiple,
+    NULL,                       /* Nothing to flush. */
+    NULL
+  };
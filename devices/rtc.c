@@ -28,14 +28,21 @@
 
 /* Register A. */
 #define RTCSA_UIP	0x80	/* Set while time update in progress. */
+#define RTCSA_RATE	0x0f	/* Periodic interrupt rate selector. */
 
 /* Register B. */
 #define	RTCSB_SET	0x80	/* Disables update to let time be set. */
+#define RTCSB_PIE	0x40	/* Enables the periodic interrupt. */
 #define RTCSB_DM	0x04	/* 0 = BCD time format, 1 = binary format. */
 #define RTCSB_24HR	0x02    /* 0 = 12-hour format, 1 = 24-hour format. */
 
 static int bcd_to_bin (uint8_t);
 static uint8_t cmos_read (uint8_t index);
+static void cmos_write (uint8_t index, uint8_t data);
+
+/* Handler for the periodic interrupt. */
+static intr_handler_func *periodic_handler;
+static intr_handler_func rtc_interrupt;
 
 /* Returns number of seconds since Unix epoch of January 1,
    1970. */
@@ -95,6 +102,45 @@ rtc_get_time (void)
   return time;
 }
 
+/* Makes the RTC interrupt HZ times per second, calling HANDLER
+   each time in an external interrupt context.  HZ must be a
+   power of 2 from 2 to 8192.  Returns true if successful, false
+   if HZ is not a rate the RTC supports. */
+bool
+rtc_start_periodic (unsigned hz, intr_handler_func *handler)
+{
+  enum intr_level old_level;
+  int rate;
+
+  /* The RTC divides its 32768 Hz clock by 2**(RATE - 1). */
+  for (rate = 3; rate <= 15; rate++)
+    if (32768u >> (rate - 1) == hz)
+      break;
+  if (rate > 15)
+    return false;
+
+  periodic_handler = handler;
+  intr_register_ext (0x28, rtc_interrupt, "RTC");
+
+  old_level = intr_disable ();
+  cmos_write (RTC_REG_A, (cmos_read (RTC_REG_A) & ~RTCSA_RATE) | rate);
+  cmos_write (RTC_REG_B, cmos_read (RTC_REG_B) | RTCSB_PIE);
+  cmos_read (RTC_REG_C);
+  intr_set_level (old_level);
+
+  return true;
+}
+
+/* RTC interrupt handler. */
+static void
+rtc_interrupt (struct intr_frame *f)
+{
+  /* Reading register C acknowledges the interrupt; until then,
+     the RTC raises no other. */
+  cmos_read (RTC_REG_C);
+  periodic_handler (f);
+}
+
 /* Returns the integer value of the given BCD byte. */
 static int
 bcd_to_bin (uint8_t x)
@@ -110,3 +156,11 @@ cmos_read (uint8_t index)
   outb (CMOS_REG_SET, index);
   return inb (CMOS_REG_IO);
 }
+
+/* Writes byte DATA to the CMOS register with the given INDEX. */
+static void
+cmos_write (uint8_t index, uint8_t data)
+{
+  outb (CMOS_REG_SET, index);
+  outb (CMOS_REG_IO, data);
+}
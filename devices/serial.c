@@ -33,6 +33,15 @@
 #define MCR_REG (IO_BASE + 4)   /* MODEM Control Register. */
 #define LSR_REG (IO_BASE + 5)   /* Line Status Register (read-only). */
 
+/* FIFO Control Register bits. */
+#define FCR_ENABLE 0x01         /* Enable FIFOs. */
+#define FCR_CLEAR_RECV 0x02     /* Clear receive FIFO. */
+#define FCR_CLEAR_XMIT 0x04     /* Clear transmit FIFO. */
+#define FCR_TRIGGER_8 0x80      /* Receive interrupt at 8 bytes. */
+
+/* Interrupt Identification Register bits. */
+#define IIR_FIFO 0xc0           /* Both set if FIFOs are enabled. */
+
 /* Interrupt Enable Register bits. */
 #define IER_RECV 0x01           /* Interrupt when data received. */
 #define IER_XMIT 0x02           /* Interrupt when transmit finishes. */
@@ -46,16 +55,50 @@
 
 /* Line Status Register. */
 #define LSR_DR 0x01             /* Data Ready: received data byte is in RBR. */
-#define LSR_THRE 0x20           /* THR Empty. */
+#define LSR_THRE 0x20           /* THR Empty; with FIFOs, FIFO empty. */
+#define LSR_TEMT 0x40           /* Transmitter Empty: all bytes sent. */
+
+/* Bytes in each FIFO of a 16550A. */
+#define FIFO_SIZE 16
 
 /* Transmission mode. */
 static enum { UNINIT, POLL, QUEUE } mode;
 
-/* Data to be transmitted. */
-static struct intq txq;
+/* Data rate, in bits per second. */
+static int serial_bps = 9600;
+
+/* Bytes that may be written to THR at once when LSR_THRE is set:
+   FIFO_SIZE if the UART's FIFOs work, 1 for an older UART that
+   has none. */
+static size_t xmit_burst = 1;
+
+/* Transmit queue capacity, in bytes.  Must be a power of 2. */
+#define TXQ_SIZE 4096
+
+/* Data to be transmitted.  serial_putbuf() is the producer, with
+   the console layer serializing its callers, and the interrupt handler
+   is the consumer, so queuing bytes needs no interrupt
+   masking. */
+static struct spscq txq;
+static uint8_t txq_buf[TXQ_SIZE];
+
+/* True while a caller is adding to txq.  A second producer that
+   arrives meanwhile, from an interrupt handler or a recursive
+   printf(), sends its bytes by polling instead. */
+static bool txq_busy;
+
+/* Thread waiting for room in txq, or NULL. */
+static struct thread *txq_waiter;
+
+/* Whether the transmit interrupt is enabled, as of the last
+   write_ier(). */
+static bool xmit_enabled;
 
 static void set_serial (int bps);
 static void putc_poll (uint8_t);
+static void send_burst (void);
+static void queue_bytes (const uint8_t *, size_t);
+static void drain_poll (void);
 static void write_ier (void);
 static intr_handler_func serial_interrupt;
 
@@ -68,10 +111,15 @@ init_poll (void)
 {
   ASSERT (mode == UNINIT);
   outb (IER_REG, 0);                    /* Turn off all interrupts. */
-  outb (FCR_REG, 0);                    /* Disable FIFO. */
-  set_serial (9600);                    /* 9.6 kbps, N-8-1. */
+  outb (FCR_REG, FCR_ENABLE | FCR_CLEAR_RECV | FCR_CLEAR_XMIT
+        | FCR_TRIGGER_8);               /* Enable and clear FIFOs. */
+  if ((inb (IIR_REG) & IIR_FIFO) == IIR_FIFO)
+    xmit_burst = FIFO_SIZE;
+  else
+    outb (FCR_REG, 0);                  /* No working FIFOs. */
+  set_serial (serial_bps);              /* 9.6 kbps by default, N-8-1. */
   outb (MCR_REG, MCR_OUT2);             /* Required to enable interrupts. */
-  intq_init (&txq);
+  spscq_init (&txq, txq_buf, sizeof txq_buf);
   mode = POLL;
 } 
 
@@ -94,38 +142,74 @@ serial_init_queue (void)
   intr_set_level (old_level);
 }
 
+/* Changes the serial port's data rate to BPS bits per second,
+   after sending anything already queued at the old rate.
+   Returns false, changing nothing, if the 16550A cannot run at
+   BPS. */
+bool
+serial_set_bps (int bps)
+{
+  enum intr_level old_level;
+
+  if (bps < 300 || bps > 115200 || 115200 % bps != 0)
+    return false;
+
+  old_level = intr_disable ();
+  serial_bps = bps;
+  if (mode != UNINIT)
+    {
+      drain_poll ();
+      while ((inb (LSR_REG) & LSR_TEMT) == 0)
+        continue;
+      set_serial (bps);
+    }
+  intr_set_level (old_level);
+  return true;
+}
+
 /* Sends BYTE to the serial port. */
 void
 serial_putc (uint8_t byte) 
 {
-  enum intr_level old_level = intr_disable ();
+  serial_putbuf (&byte, 1);
+}
+
+/* Sends the N bytes in BUFFER to the serial port.  Queues them
+   all at once, so that interrupts are disabled at most once for
+   the whole buffer unless the queue fills up. */
+void
+serial_putbuf (const void *buffer, size_t n)
+{
+  const uint8_t *p = buffer;
+  enum intr_level old_level;
 
+  if (mode == QUEUE && !txq_busy)
+    {
+      /* Queue the bytes for the interrupt handler. */
+      txq_busy = true;
+      queue_bytes (p, n);
+      txq_busy = false;
+      return;
+    }
+
+  old_level = intr_disable ();
   if (mode != QUEUE)
     {
       /* If we're not set up for interrupt-driven I/O yet,
-         use dumb polling to transmit a byte. */
+         use dumb polling to transmit the bytes. */
       if (mode == UNINIT)
         init_poll ();
-      putc_poll (byte); 
     }
   else 
     {
-      /* Otherwise, queue a byte and update the interrupt enable
-         register. */
-      if (old_level == INTR_OFF && intq_full (&txq)) 
-        {
-          /* Interrupts are off and the transmit queue is full.
-             If we wanted to wait for the queue to empty,
-             we'd have to reenable interrupts.
-             That's impolite, so we'll send a character via
-             polling instead. */
-          putc_poll (intq_getc (&txq)); 
-        }
-
-      intq_putc (&txq, byte); 
-      write_ier ();
+      /* We interrupted another producer partway through adding
+         to the queue, so we must not touch its head.  Send
+         whatever it has already queued, then these bytes, by
+         polling. */
+      drain_poll ();
     }
-  
+  while (n-- > 0)
+    putc_poll (*p++);
   intr_set_level (old_level);
 }
 
@@ -135,8 +219,7 @@ void
 serial_flush (void) 
 {
   enum intr_level old_level = intr_disable ();
-  while (!intq_empty (&txq))
-    putc_poll (intq_getc (&txq));
+  drain_poll ();
   intr_set_level (old_level);
 }
 
@@ -182,8 +265,9 @@ write_ier (void)
 
   /* Enable transmit interrupt if we have any characters to
      transmit. */
-  if (!intq_empty (&txq))
+  if (!spscq_empty (&txq))
     ier |= IER_XMIT;
+  xmit_enabled = (ier & IER_XMIT) != 0;
 
   /* Enable receive interrupt if we have room to store any
      characters we receive. */
@@ -205,6 +289,90 @@ putc_poll (uint8_t byte)
   outb (THR_REG, byte);
 }
 
+/* Adds the N bytes in BUF to txq as its sole producer, and makes
+   sure the transmit interrupt will pick them up.  Only masks
+   interrupts when the queue fills up or the transmit interrupt is
+   off. */
+static void
+queue_bytes (const uint8_t *buf, size_t n)
+{
+  enum intr_level old_level;
+  size_t cnt = spscq_put (&txq, buf, n);
+
+  if (cnt == n)
+    {
+      /* The interrupt handler turns off the transmit interrupt
+         only after finding the queue empty.  If it ran after the
+         bytes went in, it saw them and left XMIT_ENABLED true;
+         otherwise it has already cleared it. */
+      barrier ();
+      if (xmit_enabled)
+        return;
+      old_level = intr_disable ();
+      write_ier ();
+      intr_set_level (old_level);
+      return;
+    }
+
+  old_level = intr_disable ();
+  for (;;)
+    {
+      buf += cnt;
+      n -= cnt;
+      if (n == 0)
+        break;
+
+      if (old_level == INTR_OFF || intr_context ())
+        {
+          /* Interrupts are off and the transmit queue is full.
+             If we wanted to wait for the queue to empty,
+             we'd have to reenable interrupts.
+             That's impolite, so we'll send a character via
+             polling instead. */
+          uint8_t c;
+          spscq_get (&txq, &c, 1);
+          putc_poll (c);
+        }
+      else
+        {
+          /* Wait for the interrupt handler to make room. */
+          txq_waiter = thread_current ();
+          write_ier ();
+          thread_block ();
+        }
+      cnt = spscq_put (&txq, buf, n);
+    }
+  write_ier ();
+  intr_set_level (old_level);
+}
+
+/* Moves up to a transmit FIFO's worth of bytes from txq to the
+   port, which must be ready to accept them, as LSR_THRE says. */
+static void
+send_burst (void)
+{
+  uint8_t buf[FIFO_SIZE];
+  size_t cnt = spscq_get (&txq, buf, xmit_burst);
+
+  outsb (THR_REG, buf, cnt);
+}
+
+/* Sends everything in txq out the port by polling.  With
+   interrupts off, the caller stands in for the interrupt
+   handler as txq's consumer. */
+static void
+drain_poll (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (!spscq_empty (&txq))
+    {
+      while ((inb (LSR_REG) & LSR_THRE) == 0)
+        continue;
+      send_burst ();
+    }
+}
+
 /* Serial interrupt handler. */
 static void
 serial_interrupt (struct intr_frame *f UNUSED) 
@@ -214,14 +382,24 @@ serial_interrupt (struct intr_frame *f UNUSED)
   inb (IIR_REG);
 
   /* As long as we have room to receive a byte, and the hardware
-     has a byte for us, receive a byte.  */
+     has a byte for us, receive a byte, emptying the receive FIFO
+     if there is room for all of it.  */
   while (!input_full () && (inb (LSR_REG) & LSR_DR) != 0)
     input_putc (inb (RBR_REG));
 
-  /* As long as we have a byte to transmit, and the hardware is
-     ready to accept a byte for transmission, transmit a byte. */
-  while (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0) 
-    outb (THR_REG, intq_getc (&txq));
+  /* If we have bytes to transmit and the transmit FIFO is empty,
+     refill it, so that the next transmit interrupt comes only
+     after up to FIFO_SIZE bytes have gone out. */
+  if (!spscq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0)
+    send_burst ();
+
+  /* Wake up a thread waiting for room in the queue, once there
+     is enough room for it to add a good-sized batch. */
+  if (txq_waiter != NULL && spscq_space (&txq) >= TXQ_SIZE / 2)
+    {
+      thread_unblock (txq_waiter);
+      txq_waiter = NULL;
+    }
 
   /* Update interrupt enable register based on queue status. */
   write_ier ();
@@ -1,11 +1,15 @@
 #ifndef DEVICES_SERIAL_H
 #define DEVICES_SERIAL_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 void serial_init_queue (void);
 void serial_putc (uint8_t);
+void serial_putbuf (const void *, size_t);
 void serial_flush (void);
 void serial_notify (void);
+bool serial_set_bps (int bps);
 
 #endif /* devices/serial.h */
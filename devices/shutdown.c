@@ -4,14 +4,33 @@
 #include "devices/kbd.h"
 #include "devices/serial.h"
 #include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/memtag.h"
+#include "threads/profile.h"
+#include "threads/shrinker.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/vmstat.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "userprog/syscall.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
+#include "filesys/cache.h"
+#include "filesys/directory.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "filesys/journal.h"
+#endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
 #endif
 
 /* Keyboard control register port. */
@@ -52,11 +71,20 @@ shutdown_configure (enum shutdown_type type)
   how = type;
 }
 
+/* Returns the way the machine will shut down, as set by
+   shutdown_configure(). */
+enum shutdown_type
+shutdown_get_type (void)
+{
+  return how;
+}
+
 /* Reboots the machine via the keyboard controller. */
 void
 shutdown_reboot (void)
 {
   printf ("Rebooting...\n");
+  console_flush ();
 
     /* See [kbd] for details on how to program the keyboard
      * controller. */
@@ -97,6 +125,7 @@ shutdown_power_off (void)
   print_stats ();
 
   printf ("Powering off...\n");
+  console_flush ();
   serial_flush ();
 
   /* ACPI power-off */
@@ -128,14 +157,33 @@ shutdown_power_off (void)
 static void
 print_stats (void)
 {
+  profile_print_stats ();
+  trace_print_stats ();
   timer_print_stats ();
   thread_print_stats ();
+  workqueue_print_stats ();
+  lock_print_stats ();
+  intr_print_stats ();
+  vmstat_print_stats ();
+  memtag_print_stats ();
+  shrinker_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
+  cache_print_stats ();
+  journal_print_stats ();
+  inode_print_stats ();
+  dir_print_stats ();
 #endif
   console_print_stats ();
   kbd_print_stats ();
 #ifdef USERPROG
   exception_print_stats ();
+  syscall_print_stats ();
+  pagedir_print_stats ();
+  process_print_stats ();
+#endif
+#ifdef VM
+  frame_print_stats ();
+  page_print_stats ();
 #endif
 }
@@ -1,12 +1,18 @@
 #include "devices/timer.h"
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stdio.h>
+#include <vdso.h>
 #include "devices/pit.h"
+#include "threads/apic.h"
+#include "threads/cycle.h"
 #include "threads/interrupt.h"
+#include "threads/profile.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
   
 /* See [8254] for hardware details of the 8254 timer chip. */
 
@@ -17,26 +23,121 @@
 #error TIMER_FREQ <= 1000 recommended
 #endif
 
-/* Number of timer ticks since OS booted. */
-static int64_t ticks;
+/* Page shared read-only with user programs, which holds the
+   number of timer ticks since OS booted and the TSC calibration.
+   It is a whole page of its own, so that mapping it exposes
+   nothing else.  Only the timer interrupt and timer_idle_exit(),
+   with interrupts off, update the ticks, and the latter only
+   while the idle thread runs; timer_calibrate() sets the TSC
+   members once. */
+static union
+  {
+    struct vdso_data data;
+    uint8_t page[PGSIZE];
+  }
+vdso_page __attribute__ ((aligned (PGSIZE)));
+static struct vdso_data *const vdso = &vdso_page.data;
+
+/* PIT cycles per timer tick. */
+#define TIMER_COUNT ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Most ticks a single PIT period can span, limited by its 16-bit
+   counter. */
+#define TIMER_IDLE_MAX (UINT16_MAX / TIMER_COUNT)
+
+/* If false (default), interrupt every tick.
+   If true, stretch the PIT period over ticks in which the CPU would
+   only idle, up to the next sleep deadline.
+   Controlled by kernel command-line option "-tickless". */
+bool timer_tickless;
+
+/* If nonzero, the TSC frequency in kHz, used instead of measuring
+   it against the PIT, which is imprecise under virtualization.
+   Controlled by kernel command-line option "-tsc-khz". */
+unsigned timer_tsc_khz;
+
+/* Local APIC timer counts per PIT cycle, times 2**16, if the local
+   APIC timer is the tick source, otherwise 0 for the PIT.  Either
+   way, the rest of this file counts in PIT cycles. */
+static uint32_t apic_per_pit;
+
+/* Number of ticks the current PIT period spans. */
+static unsigned tick_period = 1;
+
+/* True if the PIT is not in its periodic TIMER_COUNT mode, so the
+   next timer interrupt must reprogram it. */
+static bool tick_reprogram;
+
+/* Number of timer interrupts skipped in dynamic-tick mode. */
+static int64_t ticks_skipped;
 
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* TSC cycles per second, and the TSC when calibration ended.
+   Initialized by timer_calibrate(); until then, timer_ns() only
+   has tick resolution. */
+#define TSC_CALIBRATE_TICKS 5
+static uint64_t tsc_hz;
+static uint64_t tsc_base;
+static int64_t tsc_base_ticks;
+
+/* A thread sleeping for less than a tick, until timer_ns() reaches
+   DEADLINE.  Such sleepers wait in hr_list, soonest first.  While
+   the earliest deadline falls before the next tick boundary, the
+   PIT is split into a one-shot period ending at the deadline
+   followed by one of HR_REST cycles ending on the boundary, so
+   that tick boundaries stay where they were. */
+struct hr_sleeper
+  {
+    struct list_elem elem;      /* Element in hr_list. */
+    struct thread *thread;      /* Sleeping thread. */
+    uint64_t deadline;          /* timer_ns() to wake up at. */
+  };
+static struct list hr_list;
+static bool hr_armed;           /* Next interrupt is a one-shot? */
+static unsigned hr_rest;        /* PIT cycles from it to the boundary. */
+static int64_t hr_sleep_cnt;    /* Number of sub-tick sleeps. */
+static int64_t hr_intr_cnt;     /* Number of one-shot interrupts. */
+
+/* Sleeps with slack, and the ticks by which their deadlines were
+   moved to line up with others'. */
+static int64_t slack_sleep_cnt;
+static int64_t slack_ticks;
+
+/* Shortest sleep worth a one-shot interrupt and two thread switches,
+   in nanoseconds.  Shorter ones busy-wait. */
+#define HR_SLEEP_MIN (20 * 1000)
+
 static intr_handler_func timer_interrupt;
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
+static unsigned ticks_passed (void);
+static void hr_sleep (int64_t ns);
+static void hr_wake (void);
+static void hr_arm (void);
+static bool hr_arm_within (unsigned cycles);
+static void apic_timer_calibrate (void);
+static void tick_set (unsigned count);
+static unsigned tick_read (void);
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
-   and registers the corresponding interrupt. */
+   and registers the corresponding interrupt.  If interrupts go
+   through the APICs, the local APIC timer interrupts instead of
+   the PIT, at the same vector. */
 void
 timer_init (void) 
 {
+  vdso->timer_freq = TIMER_FREQ;
+  list_init (&hr_list);
   pit_configure_channel (0, 2, TIMER_FREQ);
-  intr_register_ext (0x20, timer_interrupt, "8254 Timer");
+  if (apic_active ())
+    apic_timer_calibrate ();
+  intr_register_ext (0x20, timer_interrupt,
+                     apic_per_pit != 0 ? "APIC Timer" : "8254 Timer");
 }
 
 /* Calibrates loops_per_tick, used to implement brief delays. */
@@ -64,14 +165,69 @@ timer_calibrate (void)
       loops_per_tick |= test_bit;
 
   printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+
+  /* Count TSC cycles across a few whole ticks, unless we were
+     told the frequency, in which case just line up tsc_base with
+     a tick boundary. */
+  {
+    int64_t start = vdso->ticks;
+    uint64_t tsc_start;
+
+    while (vdso->ticks == start)
+      barrier ();
+    start = vdso->ticks;
+    tsc_start = rdtsc ();
+    if (timer_tsc_khz == 0)
+      while (vdso->ticks < start + TSC_CALIBRATE_TICKS)
+        barrier ();
+    tsc_base = rdtsc ();
+    tsc_base_ticks = vdso->ticks;
+    if (timer_tsc_khz != 0)
+      tsc_hz = (uint64_t) timer_tsc_khz * 1000;
+    else
+      tsc_hz = (tsc_base - tsc_start) * TIMER_FREQ / TSC_CALIBRATE_TICKS;
+  }
+  {
+    enum intr_level old_level = intr_disable ();
+    seq_write_begin (&vdso->seq);
+    vdso->tsc_hz = tsc_hz;
+    vdso->tsc_base = tsc_base;
+    vdso->tsc_base_ticks = tsc_base_ticks;
+    seq_write_end (&vdso->seq);
+    intr_set_level (old_level);
+  }
+  printf ("TSC runs at %'"PRIu64" Hz%s.\n", tsc_hz,
+          timer_tsc_khz != 0 ? " (from command line)" : "");
 }
 
 /* Returns the number of timer ticks since the OS booted. */
 int64_t
 timer_ticks (void) 
 {
-  enum intr_level old_level = intr_disable ();
-  int64_t t = ticks;
+  enum intr_level old_level;
+  unsigned seq;
+  int64_t t;
+
+  /* The PIT period is only stretched while the idle thread runs,
+     so any other thread reads the ticks without turning
+     interrupts off, retrying if a timer interrupt updated them
+     in the middle. */
+  if (tick_period == 1)
+    {
+      do
+        {
+          seq = seq_read_begin (&vdso->seq);
+          t = vdso->ticks;
+        }
+      while (seq_read_retry (&vdso->seq, seq));
+      return t;
+    }
+
+  /* Add the ticks the stretched period has spanned so far. */
+  old_level = intr_disable ();
+  t = vdso->ticks;
+  if (tick_period > 1)
+    t += ticks_passed ();
   intr_set_level (old_level);
   return t;
 }
@@ -84,8 +240,48 @@ timer_elapsed (int64_t then)
   return timer_ticks () - then;
 }
 
-/* Sleeps for approximately TICKS timer ticks.  Interrupts must
-   be turned on. */
+/**
+ * timer_ns - read the high-resolution monotonic clock
+ *
+ * Return the number of nanoseconds since the OS booted, counted by
+ * the TSC since timer_calibrate() and by timer ticks before that.
+*/
+uint64_t timer_ns(void)
+{
+	uint64_t delta;
+
+	if (tsc_hz == 0)
+		return timer_ticks() * (1000 * 1000 * 1000 / TIMER_FREQ);
+
+	/* Split the division so that delta * 10^9 cannot overflow. */
+	delta = rdtsc() - tsc_base;
+	return (tsc_base_ticks * (1000 * 1000 * 1000 / TIMER_FREQ)
+		+ delta / tsc_hz * 1000 * 1000 * 1000
+		+ delta % tsc_hz * 1000 * 1000 * 1000 / tsc_hz);
+}
+
+/**
+ * timer_vdso_page - get the page shared with user programs
+ *
+ * Return the kernel address of the page holding the timer's
+ * struct vdso_data, for mapping read-only at VDSO_ADDR.
+*/
+void *timer_vdso_page(void)
+{
+	return vdso_page.page;
+}
+
+/**
+ * timer_tsc_hz - get the TSC frequency
+ *
+ * Return the number of TSC cycles per second measured by
+ * timer_calibrate(), or 0 before it has run.
+*/
+uint64_t timer_tsc_hz(void)
+{
+	return tsc_hz;
+}
+
 /**
  * timer_sleep - sleep for the given ticks
  *
@@ -95,17 +291,46 @@ timer_elapsed (int64_t then)
  * Interrupts must be turned on.
 */
 void timer_sleep(int64_t ticks)
+{
+	timer_sleep_slack(ticks, 0);
+}
+
+/**
+ * timer_sleep_slack - sleep for the given ticks, or a little longer
+ *
+ * @ticks: ticks to sleep at least
+ * @slack: ticks the sleep may last beyond that
+ *
+ * Sleeps until a deadline between the given ticks from now and the
+ * slack after that, chosen as a multiple of the largest power of two
+ * that is at most the slack plus one.  Sleepers whose deadlines are
+ * near and who allow similar slack then wake on the same tick, in
+ * one pass of the timer interrupt, rather than each on its own, and
+ * in dynamic-tick mode the PIT is stretched over longer idle spans.
+ * Suits periodic background work that only needs to happen roughly
+ * on time.  Interrupts must be turned on.
+*/
+void timer_sleep_slack(int64_t ticks, int64_t slack)
 {
 	enum intr_level old_level;
-	int64_t now;
+	int64_t deadline;
+	int64_t align;
 
 	ASSERT(intr_get_level() == INTR_ON);
+	ASSERT(slack >= 0);
 
-	now = timer_ticks();
+	deadline = timer_ticks() + ticks;
+	for (align = 1; align * 2 <= slack + 1; align *= 2)
+		continue;
 
 	old_level = intr_disable();
-	/* Sleep until OS ticks reaching timer_ticks() + ticks. */
-	thread_sleep(now + ticks);
+	if (align > 1) {
+		slack_sleep_cnt++;
+		slack_ticks += ROUND_UP(deadline, align) - deadline;
+		deadline = ROUND_UP(deadline, align);
+	}
+	/* Sleep until OS ticks reaching the deadline. */
+	thread_sleep(deadline);
 	intr_set_level(old_level);
 }
 
@@ -172,11 +397,90 @@ timer_ndelay (int64_t ns)
   real_time_delay (ns, 1000 * 1000 * 1000);
 }
 
+/**
+ * timer_idle_enter - stretch the PIT period before idling
+ *
+ * Called by the idle thread just before halting.  In dynamic-tick
+ * mode, reprogram the PIT so that the next timer interrupt arrives
+ * on the tick boundary of the next sleep deadline, or as far as the
+ * PIT allows.  No tick boundary is moved, so timer_ticks() stays exact.
+ * Must be called with interrupts turned off.
+*/
+void timer_idle_enter(void)
+{
+	int64_t delta;
+	unsigned count;
+
+	ASSERT(intr_get_level() == INTR_OFF);
+
+	if (!timer_tickless || tick_reprogram || !list_empty(&hr_list))
+		return;
+
+	/* Nothing is due for at least two ticks? */
+	delta = thread_next_wakeup() - vdso->ticks;
+	if (delta <= 1)
+		return;
+
+	/* Keep the rest of the current tick and add whole ones. */
+	tick_period = MIN(delta, TIMER_IDLE_MAX);
+	count = tick_read() + (tick_period - 1) * TIMER_COUNT;
+	if (count > UINT16_MAX) {
+		tick_period--;
+		count -= TIMER_COUNT;
+	}
+	if (tick_period <= 1) {
+		tick_period = 1;
+		return;
+	}
+	tick_reprogram = true;
+	tick_set(MAX(count, 2));
+}
+
+/**
+ * timer_idle_exit - restore periodic ticks after idling
+ *
+ * Called by the scheduler when switching away from the idle thread.
+ * If the PIT period is still stretched, account the ticks that have
+ * passed so far as idle and program the PIT to interrupt on the next
+ * tick boundary, after which it goes back to periodic mode.
+ * Must be called with interrupts turned off.
+*/
+void timer_idle_exit(void)
+{
+	unsigned passed;
+	unsigned left;
+
+	ASSERT(intr_get_level() == INTR_OFF);
+
+	/* Not stretched, or the timer interrupt is about to run anyway. */
+	if (tick_period == 1 || intr_ext_pending(0x20))
+		return;
+
+	passed = ticks_passed();
+	left = tick_read() % TIMER_COUNT;
+	seq_write_begin(&vdso->seq);
+	vdso->ticks += passed;
+	seq_write_end(&vdso->seq);
+	ticks_skipped += passed;
+	thread_tick_idle(passed);
+
+	tick_period = 1;
+	tick_set(MAX(left, 2));
+}
+
 /* Prints timer statistics. */
 void
 timer_print_stats (void) 
 {
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+  if (timer_tickless)
+    printf ("Timer: %"PRId64" interrupts skipped\n", ticks_skipped);
+  if (hr_sleep_cnt > 0)
+    printf ("Timer: %"PRId64" sub-tick sleeps, %"PRId64" one-shot "
+            "interrupts\n", hr_sleep_cnt, hr_intr_cnt);
+  if (slack_sleep_cnt > 0)
+    printf ("Timer: %"PRId64" sleeps with slack, %"PRId64" ticks "
+            "of it taken\n", slack_sleep_cnt, slack_ticks);
 }
 
 /* Timer interrupt handler. */
@@ -187,18 +491,51 @@ timer_print_stats (void)
  *
  * Timer interrupt handler.
 */
-static void timer_interrupt (struct intr_frame *args UNUSED)
+static void timer_interrupt (struct intr_frame *args)
 {
 	enum intr_level old_level;
-
-	ticks++;
+	unsigned skipped;
+	unsigned rest;
+
+	/* A one-shot period for a sub-tick sleeper, not a tick. */
+	if (hr_armed) {
+		hr_armed = false;
+		hr_intr_cnt++;
+		rest = hr_rest;
+		hr_wake();
+		/* Tick_reprogram is still set, so the boundary reprograms. */
+		if (!hr_arm_within(rest))
+			tick_set(MAX(rest, 2));
+		return;
+	}
+
+	/* Account every tick the current PIT period spanned. */
+	skipped = tick_period - 1;
+	seq_write_begin(&vdso->seq);
+	vdso->ticks += tick_period;
+	seq_write_end(&vdso->seq);
+	ticks_skipped += skipped;
+	/* Go back to periodic ticks after a stretched or partial period. */
+	if (tick_reprogram) {
+		tick_period = 1;
+		tick_reprogram = false;
+		tick_set(TIMER_COUNT);
+	}
 
 	old_level = intr_disable();
 	/* Wake up threads if any. */
-	thread_foreach_wake(ticks);
+	thread_foreach_wake(vdso->ticks);
 	intr_set_level(old_level);
 
-	thread_tick();
+	profile_sample(args);
+
+	/* Skipped ticks were spent idle. */
+	thread_tick_idle(skipped);
+	thread_tick(is_user_vaddr(args->eip));
+
+	/* Sub-tick sleepers due by now, or before the next tick. */
+	hr_wake();
+	hr_arm();
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -207,17 +544,17 @@ static bool
 too_many_loops (unsigned loops) 
 {
   /* Wait for a timer tick. */
-  int64_t start = ticks;
-  while (ticks == start)
+  int64_t start = vdso->ticks;
+  while (vdso->ticks == start)
     barrier ();
 
   /* Run LOOPS loops. */
-  start = ticks;
+  start = vdso->ticks;
   busy_wait (loops);
 
   /* If the tick count changed, we iterated too long. */
   barrier ();
-  return start != ticks;
+  return start != vdso->ticks;
 }
 
 /* Iterates through a simple loop LOOPS times, for implementing
@@ -254,14 +591,220 @@ real_time_sleep (int64_t num, int32_t denom)
          processes. */                
       timer_sleep (ticks); 
     }
+  else if (tsc_hz != 0
+           && num * (1000 * 1000 * 1000 / denom) >= HR_SLEEP_MIN)
+    {
+      /* Otherwise, sleep until a one-shot timer interrupt for
+         accurate sub-tick timing. */
+      hr_sleep (num * (1000 * 1000 * 1000 / denom));
+    }
   else 
     {
-      /* Otherwise, use a busy-wait loop for more accurate
-         sub-tick timing. */
+      /* Otherwise, use a busy-wait loop for very short sleeps or
+         before the TSC is calibrated. */
       real_time_delay (num, denom); 
     }
 }
 
+/**
+ * hr_sleep - sleep for less than a tick
+ *
+ * @ns: nanoseconds to sleep
+ *
+ * Block the current thread until timer_ns() has advanced by the
+ * given nanoseconds.  Interrupts must be turned on.
+*/
+static void hr_sleep(int64_t ns)
+{
+	struct hr_sleeper s;
+	struct list_elem *e;
+	enum intr_level old_level;
+
+	ASSERT(intr_get_level() == INTR_ON);
+
+	if (ns <= 0)
+		return;
+	s.thread = thread_current();
+	s.deadline = timer_ns() + ns;
+
+	old_level = intr_disable();
+	hr_sleep_cnt++;
+	for (e = list_begin(&hr_list); e != list_end(&hr_list);
+	     e = list_next(e))
+		if (list_entry(e, struct hr_sleeper, elem)->deadline
+		    > s.deadline)
+			break;
+	list_insert(e, &s.elem);
+	if (list_front(&hr_list) == &s.elem)
+		hr_arm();
+	thread_block();
+	intr_set_level(old_level);
+}
+
+/**
+ * hr_wake - wake sub-tick sleepers whose deadline has passed
+ *
+ * Must be called with interrupts turned off.
+*/
+static void hr_wake(void)
+{
+	struct hr_sleeper *s;
+	uint64_t now;
+
+	ASSERT(intr_get_level() == INTR_OFF);
+
+	if (list_empty(&hr_list))
+		return;
+	now = timer_ns();
+	while (!list_empty(&hr_list)) {
+		s = list_entry(list_front(&hr_list), struct hr_sleeper, elem);
+		if (s->deadline > now)
+			break;
+		list_pop_front(&hr_list);
+		thread_unblock(s->thread);
+	}
+}
+
+/**
+ * hr_arm - arm a one-shot interrupt for the earliest sub-tick sleeper
+ *
+ * Split the current tick if the earliest sub-tick deadline falls before
+ * its end.  Only done while the PIT runs periodic ticks, since the tick
+ * boundary must be known.  Must be called with interrupts turned off.
+*/
+static void hr_arm(void)
+{
+	ASSERT(intr_get_level() == INTR_OFF);
+
+	/* The boundary interrupt is pending, the count is of a new tick. */
+	if (hr_armed || tick_reprogram || tick_period != 1
+	    || intr_ext_pending(0x20))
+		return;
+	hr_arm_within(tick_read());
+}
+
+/**
+ * hr_arm_within - arm a one-shot interrupt before a tick boundary
+ *
+ * @cycles: PIT cycles until the tick boundary
+ *
+ * If the earliest sub-tick deadline comes before the tick boundary,
+ * program the PIT to interrupt at the deadline instead and remember
+ * how far the boundary is from there.  Return true if armed.
+ * Must be called with interrupts turned off.
+*/
+static bool hr_arm_within(unsigned cycles)
+{
+	struct hr_sleeper *s;
+	uint64_t now;
+	uint64_t count;
+
+	ASSERT(intr_get_level() == INTR_OFF);
+
+	if (list_empty(&hr_list))
+		return false;
+	s = list_entry(list_front(&hr_list), struct hr_sleeper, elem);
+	now = timer_ns();
+	count = s->deadline > now
+		? DIV_ROUND_UP((s->deadline - now) * PIT_HZ,
+			       1000 * 1000 * 1000)
+		: 0;
+	count = MAX(count, 2);
+	/* Too close to the boundary to be worth a separate interrupt. */
+	if (count + 2 >= cycles)
+		return false;
+
+	hr_armed = true;
+	hr_rest = cycles - count;
+	tick_reprogram = true;
+	tick_set(count);
+	return true;
+}
+
+/**
+ * ticks_passed - count tick boundaries passed in a stretched period
+ *
+ * Return the number of tick boundaries passed since the last timer
+ * interrupt, derived from the PIT count left in the stretched period.
+ * Must be called with interrupts turned off.
+*/
+static unsigned ticks_passed(void)
+{
+	unsigned left;
+
+	ASSERT(intr_get_level() == INTR_OFF);
+
+	/* The whole period has passed, the interrupt is pending. */
+	if (intr_ext_pending(0x20))
+		return tick_period - 1;
+	/* The period ends on a tick boundary, so count the ticks left. */
+	left = DIV_ROUND_UP(tick_read(), TIMER_COUNT);
+	return left < tick_period ? tick_period - left : 0;
+}
+
+/**
+ * apic_timer_calibrate - make the local APIC timer the tick source
+ *
+ * Measure the local APIC timer against the PIT over one tick, then
+ * mask the PIT's interrupt and start the local APIC timer ticking in
+ * its place.  The PIT keeps running, unheard.  Must be called with
+ * interrupts turned off, with the PIT in periodic TIMER_COUNT mode.
+*/
+static void apic_timer_calibrate(void)
+{
+	unsigned elapsed = 0;
+	unsigned prev, cur;
+
+	ASSERT(intr_get_level() == INTR_OFF);
+
+	apic_timer_start(0, UINT32_MAX, false);
+	prev = pit_read_count(0);
+	while (elapsed < TIMER_COUNT) {
+		/* The count runs down to 1, then reloads TIMER_COUNT. */
+		cur = pit_read_count(0);
+		elapsed += cur <= prev ? prev - cur : prev + TIMER_COUNT - cur;
+		prev = cur;
+	}
+	apic_per_pit = ((uint64_t) (UINT32_MAX - apic_timer_count()) << 16)
+		       / elapsed;
+	if (apic_per_pit == 0)
+		return;
+
+	apic_mask_irq(0, true);
+	tick_set(TIMER_COUNT);
+}
+
+/**
+ * tick_set - start a period of the tick source
+ *
+ * @count: the period in PIT cycles, at least 2
+ *
+ * Program the tick source to interrupt COUNT PIT cycles from now, and
+ * every COUNT cycles after that until programmed again.
+*/
+static void tick_set(unsigned count)
+{
+	if (apic_per_pit != 0)
+		apic_timer_start(0x20, ((uint64_t) count * apic_per_pit) >> 16,
+				 true);
+	else
+		pit_configure_count(0, 2, count);
+}
+
+/**
+ * tick_read - read the tick source
+ *
+ * Return the number of PIT cycles left in the current period of the
+ * tick source.
+*/
+static unsigned tick_read(void)
+{
+	if (apic_per_pit != 0)
+		return DIV_ROUND_UP((uint64_t) apic_timer_count() << 16,
+				    apic_per_pit);
+	return pit_read_count(0);
+}
+
 /* Busy-wait for approximately NUM/DENOM seconds. */
 static void
 real_time_delay (int64_t num, int32_t denom)
@@ -0,0 +1,520 @@
+#include "devices/virtio.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "devices/pci.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* The code in this file is a driver for virtio block devices,
+   the paravirtual disks that QEMU provides with "if=virtio",
+   through the legacy PCI interface of [VIRTIO 0.9.5].
+
+   Rather than emulating a disk controller register by register,
+   as IDE does, a virtio disk shares a "virtqueue" with the host:
+   a table of buffer descriptors, a ring through which the driver
+   makes chains of descriptors available, and a ring through
+   which the device returns them once used.  A request is a chain
+   of a header naming the operation and sector, the data, and a
+   status byte for the device to fill in.  One write to a port
+   tells the device to look at the ring, and any number of
+   requests may be outstanding at once, each of any length, so a
+   long transfer goes out as several requests that the host
+   serves in parallel, and a flush need not wait behind them.
+
+   Disks are named "vda", "vdb" and so on, in PCI order, which is
+   the order of their -drive options, and are registered as raw
+   devices whose partitions give them their roles, as for IDE. */
+
+/* PCI vendor and device ID of a transitional virtio block
+   device, which offers the legacy interface. */
+#define VIRTIO_VENDOR 0x1af4
+#define VIRTIO_DEVICE_BLOCK 0x1001
+
+/* Legacy interface registers, as offsets from the I/O port base
+   in BAR0. */
+#define REG_HOST_FEATURES 0x00  /* Features the device offers (r/o). */
+#define REG_GUEST_FEATURES 0x04 /* Features the driver accepts. */
+#define REG_QUEUE_PFN 0x08      /* Physical page of selected queue. */
+#define REG_QUEUE_SIZE 0x0c     /* Entries in selected queue (r/o). */
+#define REG_QUEUE_SELECT 0x0e   /* Queue selector. */
+#define REG_QUEUE_NOTIFY 0x10   /* Write queue number to kick it. */
+#define REG_STATUS 0x12         /* Device status. */
+#define REG_ISR 0x13            /* Interrupt status, clear on read. */
+#define REG_CAPACITY 0x14       /* Block config: 64-bit size in sectors. */
+
+/* Device status bits. */
+#define STATUS_ACK 0x01         /* Driver has noticed the device. */
+#define STATUS_DRIVER 0x02      /* Driver knows how to drive it. */
+#define STATUS_DRIVER_OK 0x04   /* Driver is ready. */
+#define STATUS_FAILED 0x80      /* Driver gave up on the device. */
+
+/* Interrupt status bits. */
+#define ISR_QUEUE 0x01          /* A queue has used buffers. */
+
+/* Block device feature bits. */
+#define FEATURE_FLUSH (1u << 9) /* Has a write cache to flush. */
+
+/* Virtqueue descriptor: one physically contiguous buffer. */
+struct vring_desc
+  {
+    uint64_t addr;              /* Physical address. */
+    uint32_t len;               /* Length in bytes. */
+    uint16_t flags;             /* DESC_* flags. */
+    uint16_t next;              /* Next descriptor, if DESC_NEXT. */
+  };
+#define DESC_NEXT 0x1           /* Chain continues in NEXT. */
+#define DESC_WRITE 0x2          /* Device writes, rather than reads. */
+
+/* Ring of descriptor chains made available to the device. */
+struct vring_avail
+  {
+    uint16_t flags;
+    uint16_t idx;               /* Where the next entry goes, mod size. */
+    uint16_t ring[];            /* Heads of chains. */
+  };
+
+/* Ring of descriptor chains the device has used. */
+struct vring_used_elem
+  {
+    uint32_t id;                /* Head of the chain. */
+    uint32_t len;               /* Bytes the device wrote. */
+  };
+struct vring_used
+  {
+    uint16_t flags;
+    uint16_t idx;               /* Where the next entry goes, mod size. */
+    struct vring_used_elem ring[];
+  };
+
+/* Header of a block request. */
+struct request_header
+  {
+    uint32_t type;              /* REQ_*. */
+    uint32_t reserved;
+    uint64_t sector;            /* First sector. */
+  };
+#define REQ_IN 0                /* Read. */
+#define REQ_OUT 1               /* Write. */
+#define REQ_FLUSH 4             /* Flush the write cache. */
+
+/* Value of a request's status byte on success. */
+#define REQ_STATUS_OK 0
+
+/* Most sectors in one request.  Longer transfers are split into
+   several requests, which are outstanding together. */
+#define REQUEST_SECTORS 128
+
+/* Descriptors per request: header, data, status. */
+#define SLOT_DESCS 3
+
+/* A caller's transfer, which may span several requests. */
+struct transfer
+  {
+    struct semaphore done;      /* Up'd once per finished request. */
+    bool failed;                /* Did any request fail? */
+  };
+
+/* The state of one request, which owns descriptors
+   SLOT_DESCS * I through SLOT_DESCS * I + 2 for its index I. */
+struct slot
+  {
+    struct request_header header;  /* Read by the device. */
+    uint8_t status;             /* Written by the device. */
+    struct transfer *transfer;  /* Transfer it belongs to. */
+    struct list_elem elem;      /* Element in free_slots, if free. */
+  };
+
+/* Most slots: as many as fit in a page. */
+#define SLOT_MAX (PGSIZE / sizeof (struct slot))
+
+/* A virtio disk. */
+struct virtio_disk
+  {
+    char name[8];               /* Name, e.g. "vda". */
+    uint16_t base;              /* I/O port base. */
+    uint8_t irq;                /* Interrupt vector. */
+    bool flush;                 /* Negotiated FEATURE_FLUSH? */
+
+    /* Virtqueue, in physically contiguous pages. */
+    uint16_t size;              /* Number of descriptors. */
+    struct vring_desc *desc;    /* Descriptor table. */
+    struct vring_avail *avail;  /* Available ring. */
+    volatile struct vring_used *used;  /* Used ring. */
+    uint16_t last_used;         /* Used ring entries consumed. */
+
+    /* Requests.  FREE_SLOTS and the rings are touched by the
+       interrupt handler, so threads touch them with interrupts
+       off. */
+    struct slot *slots;         /* One page of slots. */
+    struct list free_slots;     /* Slots not in use. */
+    struct semaphore slot_cnt;  /* Number of slots in FREE_SLOTS. */
+  };
+
+/* Most virtio disks.  QEMU puts each on a PCI slot of its own. */
+#define DISK_MAX 8
+static struct virtio_disk disks[DISK_MAX];
+static size_t disk_cnt;
+
+static struct block_operations virtio_operations;
+
+static bool probe (struct pci_dev *, const struct pci_id *);
+static bool setup_disk (struct virtio_disk *, struct pci_dev *,
+                        block_sector_t *capacity);
+static bool setup_queue (struct virtio_disk *);
+static void transfer (struct virtio_disk *, uint32_t type,
+                      block_sector_t, size_t cnt, void *buffer);
+static void submit (struct virtio_disk *, struct transfer *,
+                    uint32_t type, block_sector_t, size_t cnt,
+                    void *buffer);
+static void interrupt_handler (struct intr_frame *);
+
+static const struct pci_id virtio_ids[] =
+  {
+    {VIRTIO_VENDOR, VIRTIO_DEVICE_BLOCK, PCI_ANY},
+    {0, 0, 0},
+  };
+
+static const struct pci_driver virtio_driver =
+  {
+    "virtio-blk", virtio_ids, probe,
+  };
+
+/* Registers the virtio block driver, so that it finds virtio
+   block devices on the PCI bus and registers them as block
+   devices. */
+void
+virtio_init (void)
+{
+  pci_register_driver (&virtio_driver);
+}
+
+/* Sets up virtio block device DEV and registers it as a block
+   device.  Returns true if successful. */
+static bool
+probe (struct pci_dev *dev, const struct pci_id *id UNUSED)
+{
+  struct virtio_disk *d = &disks[disk_cnt];
+  block_sector_t capacity;
+  char extra_info[64];
+  struct block *block;
+
+  if (disk_cnt >= DISK_MAX)
+    return false;
+  snprintf (d->name, sizeof d->name, "vd%c", (int) ('a' + disk_cnt));
+  if (!setup_disk (d, dev, &capacity))
+    return false;
+
+  /* The interrupt handler looks only at the first DISK_CNT
+     disks. */
+  disk_cnt++;
+  snprintf (extra_info, sizeof extra_info, "virtio, %u-entry queue%s",
+            (unsigned) d->size, d->flush ? ", flush" : "");
+  block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
+                          &virtio_operations, d);
+  partition_scan (block);
+  return true;
+}
+
+/* Initializes disk D, which is PCI function DEV, following the
+   legacy initialization sequence, and stores its size in sectors
+   in *CAPACITY.  Returns true if successful, false if D is
+   unusable. */
+static bool
+setup_disk (struct virtio_disk *d, struct pci_dev *dev,
+            block_sector_t *capacity)
+{
+  const struct pci_bar *bar = &dev->bars[0];
+  uint32_t features;
+  uint64_t size;
+  size_t i;
+
+  /* The legacy interface lives in I/O space. */
+  if (!bar->io || bar->base == 0)
+    {
+      printf ("%s: no I/O space base address, ignoring\n", d->name);
+      return false;
+    }
+  d->base = bar->base;
+  if (dev->irq == PCI_IRQ_NONE)
+    {
+      printf ("%s: no interrupt line, ignoring\n", d->name);
+      return false;
+    }
+  d->irq = dev->irq + 0x20;
+  pci_enable (dev, PCI_CMD_IO | PCI_CMD_MASTER);
+
+  /* Reset, acknowledge, and take only the features we use. */
+  outb (d->base + REG_STATUS, 0);
+  outb (d->base + REG_STATUS, STATUS_ACK);
+  outb (d->base + REG_STATUS, STATUS_ACK | STATUS_DRIVER);
+  features = inl (d->base + REG_HOST_FEATURES) & FEATURE_FLUSH;
+  outl (d->base + REG_GUEST_FEATURES, features);
+  d->flush = (features & FEATURE_FLUSH) != 0;
+
+  size = (inl (d->base + REG_CAPACITY)
+          | (uint64_t) inl (d->base + REG_CAPACITY + 4) << 32);
+  if (size > (block_sector_t) -1)
+    {
+      printf ("%s: too large, ignoring\n", d->name);
+      outb (d->base + REG_STATUS, STATUS_FAILED);
+      return false;
+    }
+
+  if (!setup_queue (d))
+    {
+      printf ("%s: queue setup failed, ignoring\n", d->name);
+      outb (d->base + REG_STATUS, STATUS_FAILED);
+      return false;
+    }
+
+  /* Disks on the same line share its handler. */
+  for (i = 0; i < disk_cnt; i++)
+    if (disks[i].irq == d->irq)
+      break;
+  if (i == disk_cnt)
+    intr_register_ext (d->irq, interrupt_handler, "virtio");
+
+  outb (d->base + REG_STATUS,
+        STATUS_ACK | STATUS_DRIVER | STATUS_DRIVER_OK);
+  *capacity = size;
+  return true;
+}
+
+/* Allocates disk D's request queue and its slots and tells the
+   device where the queue is.  Returns true if successful, false
+   on failure. */
+static bool
+setup_queue (struct virtio_disk *d)
+{
+  size_t used_ofs, page_cnt, slot_cnt, i;
+  uint8_t *pages;
+
+  outw (d->base + REG_QUEUE_SELECT, 0);
+  d->size = inw (d->base + REG_QUEUE_SIZE);
+  if (d->size < SLOT_DESCS)
+    return false;
+
+  /* The legacy layout puts the used ring on the first page
+     boundary after the descriptors and the available ring. */
+  used_ofs = ROUND_UP (d->size * sizeof *d->desc
+                       + sizeof *d->avail + (d->size + 1) * sizeof (uint16_t),
+                       PGSIZE);
+  page_cnt = DIV_ROUND_UP (used_ofs + sizeof *d->used
+                           + d->size * sizeof *d->used->ring
+                           + sizeof (uint16_t), PGSIZE);
+  pages = palloc_get_multiple (PAL_ZERO, page_cnt);
+  d->slots = palloc_get_page (PAL_ZERO);
+  if (pages == NULL || d->slots == NULL)
+    {
+      palloc_free_multiple (pages, page_cnt);
+      palloc_free_page (d->slots);
+      return false;
+    }
+  d->desc = (struct vring_desc *) pages;
+  d->avail = (struct vring_avail *) (pages + d->size * sizeof *d->desc);
+  d->used = (struct vring_used *) (pages + used_ofs);
+  d->last_used = 0;
+
+  /* Each slot's header, data and status descriptors. */
+  slot_cnt = d->size / SLOT_DESCS;
+  if (slot_cnt > SLOT_MAX)
+    slot_cnt = SLOT_MAX;
+  list_init (&d->free_slots);
+  for (i = 0; i < slot_cnt; i++)
+    {
+      struct slot *s = &d->slots[i];
+      struct vring_desc *desc = &d->desc[i * SLOT_DESCS];
+
+      desc[0].addr = vtop (&s->header);
+      desc[0].len = sizeof s->header;
+      desc[0].flags = DESC_NEXT;
+      desc[0].next = i * SLOT_DESCS + 1;
+      desc[1].flags = DESC_NEXT;
+      desc[1].next = i * SLOT_DESCS + 2;
+      desc[2].addr = vtop (&s->status);
+      desc[2].len = sizeof s->status;
+      desc[2].flags = DESC_WRITE;
+      list_push_back (&d->free_slots, &s->elem);
+    }
+  sema_init (&d->slot_cnt, slot_cnt);
+
+  outl (d->base + REG_QUEUE_PFN, vtop (pages) / PGSIZE);
+  return true;
+}
+
+/* Transfers CNT sectors starting at SEC_NO between disk D and
+   BUFFER, a kernel virtual address, by requests of type TYPE, or
+   flushes D's write cache if TYPE is REQ_FLUSH.  Issues one
+   request per REQUEST_SECTORS sectors, all of them before
+   waiting for any, and returns once they are all done. */
+static void
+transfer (struct virtio_disk *d, uint32_t type, block_sector_t sec_no,
+          size_t cnt, void *buffer)
+{
+  struct transfer t;
+  block_sector_t first = sec_no;
+  uint8_t *p = buffer;
+  size_t req_cnt = 0;
+
+  ASSERT (type == REQ_FLUSH || is_kernel_vaddr (buffer));
+
+  sema_init (&t.done, 0);
+  t.failed = false;
+  do
+    {
+      size_t n = cnt < REQUEST_SECTORS ? cnt : REQUEST_SECTORS;
+
+      submit (d, &t, type, sec_no, n, p);
+      req_cnt++;
+      p += n * BLOCK_SECTOR_SIZE;
+      sec_no += n;
+      cnt -= n;
+    }
+  while (cnt > 0);
+
+  while (req_cnt-- > 0)
+    sema_down (&t.done);
+  if (t.failed)
+    PANIC ("%s: disk %s failed, sector=%"PRDSNu, d->name,
+           type == REQ_IN ? "read" : type == REQ_OUT ? "write" : "flush",
+           first);
+}
+
+/* Makes a request of type TYPE for the CNT sectors starting at
+   SEC_NO, to or from BUFFER, available to disk D as part of
+   transfer T, waiting for a free slot if need be.  CNT is 0 for
+   a flush. */
+static void
+submit (struct virtio_disk *d, struct transfer *t, uint32_t type,
+        block_sector_t sec_no, size_t cnt, void *buffer)
+{
+  struct vring_desc *desc;
+  enum intr_level old_level;
+  struct slot *s;
+  uint16_t head;
+
+  sema_down (&d->slot_cnt);
+  old_level = intr_disable ();
+  s = list_entry (list_pop_front (&d->free_slots), struct slot, elem);
+  head = (s - d->slots) * SLOT_DESCS;
+  desc = &d->desc[head];
+
+  s->header.type = type;
+  s->header.reserved = 0;
+  s->header.sector = sec_no;
+  s->status = 0xff;
+  s->transfer = t;
+  if (cnt > 0)
+    {
+      desc[0].next = head + 1;
+      desc[1].addr = vtop (buffer);
+      desc[1].len = cnt * BLOCK_SECTOR_SIZE;
+      desc[1].flags = DESC_NEXT | (type == REQ_IN ? DESC_WRITE : 0);
+    }
+  else
+    desc[0].next = head + 2;
+
+  /* The device may read the entry as soon as the index moves
+     past it. */
+  d->avail->ring[d->avail->idx % d->size] = head;
+  barrier ();
+  d->avail->idx++;
+  barrier ();
+  outw (d->base + REG_QUEUE_NOTIFY, 0);
+  intr_set_level (old_level);
+}
+
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFER,
+   which must have room for CNT * BLOCK_SECTOR_SIZE bytes. */
+static void
+virtio_read_multiple (void *d, block_sector_t sec_no, size_t cnt,
+                      void *buffer)
+{
+  transfer (d, REQ_IN, sec_no, cnt, buffer);
+}
+
+/* Writes CNT sectors starting at SEC_NO to disk D from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes.  Returns
+   after the disk has acknowledged receiving the data. */
+static void
+virtio_write_multiple (void *d, block_sector_t sec_no, size_t cnt,
+                       const void *buffer)
+{
+  transfer (d, REQ_OUT, sec_no, cnt, (void *) buffer);
+}
+
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes. */
+static void
+virtio_read (void *d, block_sector_t sec_no, void *buffer)
+{
+  virtio_read_multiple (d, sec_no, 1, buffer);
+}
+
+/* Writes sector SEC_NO to disk D from BUFFER, which must contain
+   BLOCK_SECTOR_SIZE bytes. */
+static void
+virtio_write (void *d, block_sector_t sec_no, const void *buffer)
+{
+  virtio_write_multiple (d, sec_no, 1, buffer);
+}
+
+/* Has disk D write its write cache to the medium.  Does nothing
+   if D did not offer to flush, which means that it has no write
+   cache. */
+static void
+virtio_flush (void *d_)
+{
+  struct virtio_disk *d = d_;
+
+  if (d->flush)
+    transfer (d, REQ_FLUSH, 0, 0, NULL);
+}
+
+static struct block_operations virtio_operations =
+  {
+    virtio_read,
+    virtio_write,
+    virtio_read_multiple,
+    virtio_write_multiple,
+    virtio_flush,
+    NULL
+  };
+
+/* Virtio interrupt handler.  Completes the requests that every
+   disk on the interrupt's line has used and frees their
+   slots. */
+static void
+interrupt_handler (struct intr_frame *f)
+{
+  size_t i;
+
+  for (i = 0; i < disk_cnt; i++)
+    {
+      struct virtio_disk *d = &disks[i];
+
+      /* Reading the status also deasserts the line. */
+      if (d->irq != f->vec_no || !(inb (d->base + REG_ISR) & ISR_QUEUE))
+        continue;
+      while (d->last_used != d->used->idx)
+        {
+          uint32_t head = d->used->ring[d->last_used % d->size].id;
+          struct slot *s = &d->slots[head / SLOT_DESCS];
+
+          if (s->status != REQ_STATUS_OK)
+            s->transfer->failed = true;
+          sema_up (&s->transfer->done);
+          list_push_back (&d->free_slots, &s->elem);
+          sema_up (&d->slot_cnt);
+          d->last_used++;
+        }
+    }
+}
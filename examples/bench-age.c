@@ -0,0 +1,216 @@
+/* bench-age.c
+
+   Ages the file system with many rounds of creating, appending
+   to, and removing files at random, so that free space is
+   scattered the way long use leaves it, and then measures how it
+   performs in that state: sequential read bandwidth and random
+   4 kB reads on a file written after aging, and file creation and
+   removal in a large directory.  The aged files are removed
+   afterward.  Running it again on the same disk ages it further.
+
+   usage: bench-age [ROUNDS [DIR_FILES [SEED]]]
+
+   ROUNDS is the number of aging operations, 1000 by default.
+   DIR_FILES is the number of files in the large directory, 200
+   by default.  SEED seeds the random choices, so that runs on
+   different kernels age the disk the same way. */
+
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "bench.h"
+
+#define AGE_FILES 48            /* Files kept while aging. */
+#define MAX_APPEND 16384        /* Largest append while aging. */
+#define BLOCK 4096              /* Bytes per read in the read tests. */
+#define DATA_SIZE 262144        /* Size of the file read. */
+#define DATA_NAME "age.dat"
+#define DIR_NAME "age.d"
+
+static char buf[MAX_APPEND];
+
+/* Sizes of the aged files "ageN", or -1 for files that do not
+   exist. */
+static int sizes[AGE_FILES];
+
+/* Appends SIZE bytes to file NAME.  Returns false on error. */
+static bool
+append (const char *name, int size)
+{
+  int fd = open (name);
+  bool ok;
+
+  if (fd < 0)
+    return false;
+  seek (fd, filesize (fd));
+  ok = write (fd, buf, size) == size;
+  close (fd);
+  return ok;
+}
+
+/* Carries out ROUNDS random creates, appends, and removes among
+   the AGE_FILES aged files.  Returns false on error. */
+static bool
+age (int rounds)
+{
+  uint64_t start = rdtsc ();
+  int i;
+
+  for (i = 0; i < AGE_FILES; i++)
+    sizes[i] = -1;
+  for (i = 0; i < rounds; i++)
+    {
+      int f = random_ulong () % AGE_FILES;
+      int size = random_ulong () % MAX_APPEND + 1;
+      char name[16];
+
+      snprintf (name, sizeof name, "age%d", f);
+      if (sizes[f] < 0)
+        {
+          if (!create (name, 0) || !append (name, size))
+            {
+              printf ("bench-age: %s: create failed\n", name);
+              return false;
+            }
+          sizes[f] = size;
+        }
+      else if (random_ulong () % 4 == 0 || sizes[f] > 8 * MAX_APPEND)
+        {
+          if (!remove (name))
+            {
+              printf ("bench-age: %s: remove failed\n", name);
+              return false;
+            }
+          sizes[f] = -1;
+        }
+      else
+        {
+          if (!append (name, size))
+            {
+              printf ("bench-age: %s: append failed\n", name);
+              return false;
+            }
+          sizes[f] += size;
+        }
+    }
+  bench_ops ("age", "age", rounds, rdtsc () - start);
+  return true;
+}
+
+/* Writes DATA_NAME, in the aged free space, and times reading it
+   in order and at random.  Returns false on error. */
+static bool
+read_data (void)
+{
+  const int cnt = DATA_SIZE / BLOCK;
+  uint64_t start;
+  int fd, i;
+
+  if (!create (DATA_NAME, 0) || (fd = open (DATA_NAME)) < 0)
+    {
+      printf ("bench-age: %s: create failed\n", DATA_NAME);
+      return false;
+    }
+  for (i = 0; i < cnt; i++)
+    if (write (fd, buf, BLOCK) != BLOCK)
+      {
+        printf ("bench-age: %s: write failed\n", DATA_NAME);
+        close (fd);
+        return false;
+      }
+  fsync (fd);
+
+  seek (fd, 0);
+  start = rdtsc ();
+  for (i = 0; i < cnt; i++)
+    if (read (fd, buf, BLOCK) != BLOCK)
+      break;
+  bench_bytes ("age", "seq-read", (uint64_t) i * BLOCK, rdtsc () - start);
+
+  start = rdtsc ();
+  for (i = 0; i < cnt; i++)
+    {
+      seek (fd, random_ulong () % cnt * BLOCK);
+      if (read (fd, buf, BLOCK) != BLOCK)
+        break;
+    }
+  bench_ops ("age", "rand-read-4k", i, rdtsc () - start);
+
+  close (fd);
+  remove (DATA_NAME);
+  return i == cnt;
+}
+
+/* Times creating and then removing CNT files in a directory of
+   their own.  Returns false on error. */
+static bool
+big_dir (int cnt)
+{
+  char name[16];
+  uint64_t start;
+  int i;
+
+  if (!mkdir (DIR_NAME) || !chdir (DIR_NAME))
+    {
+      printf ("bench-age: %s: mkdir failed\n", DIR_NAME);
+      return false;
+    }
+
+  start = rdtsc ();
+  for (i = 0; i < cnt; i++)
+    {
+      snprintf (name, sizeof name, "f%d", i);
+      if (!create (name, 512))
+        {
+          printf ("bench-age: %s: create failed\n", name);
+          return false;
+        }
+    }
+  bench_ops ("age", "dir-create", cnt, rdtsc () - start);
+
+  start = rdtsc ();
+  for (i = 0; i < cnt; i++)
+    {
+      snprintf (name, sizeof name, "f%d", i);
+      if (!remove (name))
+        {
+          printf ("bench-age: %s: remove failed\n", name);
+          return false;
+        }
+    }
+  bench_ops ("age", "dir-remove", cnt, rdtsc () - start);
+
+  chdir ("..");
+  return remove (DIR_NAME);
+}
+
+int
+main (int argc, char *argv[])
+{
+  int rounds = argc > 1 ? atoi (argv[1]) : 1000;
+  int dir_files = argc > 2 ? atoi (argv[2]) : 200;
+  unsigned seed = argc > 3 ? atoi (argv[3]) : 0;
+  bool ok;
+  int i;
+
+  if (rounds < 0 || dir_files <= 0)
+    {
+      printf ("usage: bench-age [ROUNDS [DIR_FILES [SEED]]]\n");
+      return EXIT_FAILURE;
+    }
+  random_init (seed);
+  random_bytes (buf, sizeof buf);
+
+  ok = age (rounds) && read_data () && big_dir (dir_files);
+
+  for (i = 0; i < AGE_FILES; i++)
+    if (sizes[i] >= 0)
+      {
+        char name[16];
+
+        snprintf (name, sizeof name, "age%d", i);
+        remove (name);
+      }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,50 @@
+/* bench-exec.c
+
+   Measures the latency of starting a process and waiting for it
+   to exit, with exec() and with fork().  The child is a copy of
+   this program that exits at once.
+
+   usage: bench-exec [COUNT] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "bench.h"
+
+int
+main (int argc, char *argv[])
+{
+  int cnt;
+  uint64_t start;
+  int i;
+
+  if (argc > 1 && !strcmp (argv[1], "child"))
+    return EXIT_SUCCESS;
+  cnt = argc > 1 ? atoi (argv[1]) : 50;
+
+  start = rdtsc ();
+  for (i = 0; i < cnt; i++)
+    if (wait (exec ("bench-exec child")) != EXIT_SUCCESS)
+      {
+        printf ("bench-exec: exec failed\n");
+        return EXIT_FAILURE;
+      }
+  bench_ops ("exec", "exec+wait", cnt, rdtsc () - start);
+
+  start = rdtsc ();
+  for (i = 0; i < cnt; i++)
+    {
+      pid_t pid = fork ();
+      if (pid == 0)
+        exit (EXIT_SUCCESS);
+      if (pid == PID_ERROR || wait (pid) != EXIT_SUCCESS)
+        {
+          printf ("bench-exec: fork failed\n");
+          return EXIT_FAILURE;
+        }
+    }
+  bench_ops ("exec", "fork+wait", cnt, rdtsc () - start);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,64 @@
+/* bench-files.c
+
+   Measures metadata operations by creating, opening, and
+   removing many small files in the current directory.
+
+   usage: bench-files [COUNT] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "bench.h"
+
+#define FILE_SIZE 512
+
+int
+main (int argc, char *argv[])
+{
+  int cnt = argc > 1 ? atoi (argv[1]) : 64;
+  char name[16];
+  uint64_t start;
+  int i;
+
+  start = rdtsc ();
+  for (i = 0; i < cnt; i++)
+    {
+      snprintf (name, sizeof name, "bf%d", i);
+      if (!create (name, FILE_SIZE))
+        {
+          printf ("bench-files: %s: create failed\n", name);
+          return EXIT_FAILURE;
+        }
+    }
+  bench_ops ("files", "create", cnt, rdtsc () - start);
+
+  start = rdtsc ();
+  for (i = 0; i < cnt; i++)
+    {
+      int fd;
+
+      snprintf (name, sizeof name, "bf%d", i);
+      fd = open (name);
+      if (fd < 0)
+        {
+          printf ("bench-files: %s: open failed\n", name);
+          return EXIT_FAILURE;
+        }
+      close (fd);
+    }
+  bench_ops ("files", "open+close", cnt, rdtsc () - start);
+
+  start = rdtsc ();
+  for (i = 0; i < cnt; i++)
+    {
+      snprintf (name, sizeof name, "bf%d", i);
+      if (!remove (name))
+        {
+          printf ("bench-files: %s: remove failed\n", name);
+          return EXIT_FAILURE;
+        }
+    }
+  bench_ops ("files", "remove", cnt, rdtsc () - start);
+
+  return EXIT_SUCCESS;
+}
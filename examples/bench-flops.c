@@ -0,0 +1,69 @@
+/* bench-flops.c
+
+   Measures floating-point throughput with a double-precision
+   matrix multiplication, like matmult's on integers, reported as
+   cycles per floating-point operation.  Each multiply-add counts
+   as two.  A second run, with another process doing the same
+   meanwhile, shows the cost of switching FPU state between them.
+
+   usage: bench-flops */
+
+#include <syscall.h>
+#include "bench.h"
+
+#define DIM 64
+
+static double a[DIM][DIM];
+static double b[DIM][DIM];
+static double c[DIM][DIM];
+
+/* Multiplies A by B into C and returns the cycles taken. */
+static uint64_t
+multiply (void)
+{
+  uint64_t start = rdtsc ();
+  int i, j, k;
+
+  for (i = 0; i < DIM; i++)
+    for (j = 0; j < DIM; j++)
+      {
+        double sum = 0.0;
+
+        for (k = 0; k < DIM; k++)
+          sum += a[i][k] * b[k][j];
+        c[i][j] = sum;
+      }
+  return rdtsc () - start;
+}
+
+int
+main (void)
+{
+  uint64_t flops = 2ULL * DIM * DIM * DIM;
+  pid_t pid;
+  int i, j;
+
+  for (i = 0; i < DIM; i++)
+    for (j = 0; j < DIM; j++)
+      {
+        a[i][j] = i + 0.5;
+        b[i][j] = j - 0.25;
+      }
+
+  bench_ops ("flops", "matmult", flops, multiply ());
+
+  /* The child inherits the matrices and its FPU state. */
+  pid = fork ();
+  if (pid == 0)
+    {
+      multiply ();
+      exit (EXIT_SUCCESS);
+    }
+  bench_ops ("flops", "matmult-shared", flops, multiply ());
+  if (pid != PID_ERROR)
+    wait (pid);
+
+  /* Check one element, so that the work is not optimized away. */
+  return c[DIM - 1][DIM - 1] == (DIM - 0.5) * (DIM - 1.25) * DIM
+         ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,82 @@
+/* bench-io.c
+
+   Measures file read and write throughput, sequentially and at
+   random block-aligned offsets, on a scratch file that is
+   removed afterward.
+
+   usage: bench-io [BLOCK [SIZE]]
+
+   BLOCK is the bytes per read() or write() call, 4096 by default
+   and at most 65536.  SIZE is the file size, 262144 by default. */
+
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "bench.h"
+
+#define FILE_NAME "bench-io.dat"
+#define MAX_BLOCK 65536
+
+static char buf[MAX_BLOCK];
+
+/* Reads or writes, according to WRITING, the CNT blocks of BLOCK
+   bytes in FD, in order if SEQUENTIAL, otherwise at random, and
+   reports the throughput as METRIC.  Returns false on error. */
+static bool
+transfer (int fd, bool writing, bool sequential, unsigned block, int cnt,
+          const char *metric)
+{
+  uint64_t start;
+  int i;
+
+  seek (fd, 0);
+  start = rdtsc ();
+  for (i = 0; i < cnt; i++)
+    {
+      int n;
+
+      if (!sequential)
+        seek (fd, random_ulong () % cnt * block);
+      n = writing ? write (fd, buf, block) : read (fd, buf, block);
+      if (n != (int) block)
+        {
+          printf ("bench-io: %s failed\n", metric);
+          return false;
+        }
+    }
+  bench_bytes ("io", metric, (uint64_t) cnt * block, rdtsc () - start);
+  return true;
+}
+
+int
+main (int argc, char *argv[])
+{
+  unsigned block = argc > 1 ? atoi (argv[1]) : 4096;
+  unsigned size = argc > 2 ? atoi (argv[2]) : 262144;
+  bool ok;
+  int fd;
+
+  if (block == 0 || block > MAX_BLOCK || size < block)
+    {
+      printf ("usage: bench-io [BLOCK [SIZE]]\n");
+      return EXIT_FAILURE;
+    }
+
+  /* Create the file at full size, so that it works without
+     extensible files too. */
+  if (!create (FILE_NAME, size) || (fd = open (FILE_NAME)) < 0)
+    {
+      printf ("bench-io: %s: create failed\n", FILE_NAME);
+      return EXIT_FAILURE;
+    }
+
+  ok = (transfer (fd, true, true, block, size / block, "seq-write")
+        && transfer (fd, false, true, block, size / block, "seq-read")
+        && transfer (fd, false, false, block, size / block, "rand-read")
+        && transfer (fd, true, false, block, size / block, "rand-write"));
+
+  close (fd);
+  remove (FILE_NAME);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,85 @@
+/* bench-malloc.c
+
+   Measures the user malloc(): pairs of malloc() and free() of one
+   small block, which stay within a thread's cache; building up and
+   tearing down a set of mixed sizes, which carves new pages; pairs
+   on large blocks, which reuse a run of pages; and small pairs in
+   several threads at once, each with a cache of its own.
+
+   usage: bench-malloc [ITERATIONS] */
+
+#include <malloc.h>
+#include <pthread.h>
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "bench.h"
+
+#define SET_SIZE 1000
+#define LARGE_SIZE (64 * 1024)
+#define THREAD_CNT 4
+
+static void *set[SET_SIZE];
+
+/* Does ITERATIONS small malloc() and free() pairs. */
+static void *
+small_pairs (void *iterations)
+{
+  unsigned i;
+
+  for (i = 0; i < (unsigned) iterations; i++)
+    free (malloc (32));
+  return NULL;
+}
+
+int
+main (int argc, char *argv[])
+{
+  unsigned iterations = argc > 1 ? atoi (argv[1]) : 10000;
+  pthread_t threads[THREAD_CNT];
+  uint64_t start;
+  unsigned i, j;
+
+  if (iterations == 0)
+    {
+      printf ("usage: bench-malloc [ITERATIONS]\n");
+      return EXIT_FAILURE;
+    }
+
+  start = rdtsc ();
+  small_pairs ((void *) iterations);
+  bench_ops ("malloc", "small", iterations, rdtsc () - start);
+
+  start = rdtsc ();
+  for (i = 0; i < iterations / SET_SIZE + 1; i++)
+    {
+      for (j = 0; j < SET_SIZE; j++)
+        if ((set[j] = malloc (16 + random_ulong () % 1000)) == NULL)
+          {
+            printf ("bench-malloc: out of memory\n");
+            return EXIT_FAILURE;
+          }
+      for (j = 0; j < SET_SIZE; j++)
+        free (set[j]);
+    }
+  bench_ops ("malloc", "mixed-set", i * SET_SIZE, rdtsc () - start);
+
+  start = rdtsc ();
+  for (i = 0; i < iterations; i++)
+    free (malloc (LARGE_SIZE));
+  bench_ops ("malloc", "large", iterations, rdtsc () - start);
+
+  start = rdtsc ();
+  for (i = 0; i < THREAD_CNT; i++)
+    if (pthread_create (&threads[i], small_pairs, (void *) iterations) != 0)
+      {
+        printf ("bench-malloc: pthread_create failed\n");
+        return EXIT_FAILURE;
+      }
+  for (i = 0; i < THREAD_CNT; i++)
+    pthread_join (threads[i], NULL);
+  bench_ops ("malloc", "threads", THREAD_CNT * iterations,
+             rdtsc () - start);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,79 @@
+/* bench-mmap.c
+
+   Compares reading a file with read() against mapping it with
+   mmap() and reading the memory, by summing the file's bytes
+   both ways.
+
+   usage: bench-mmap [SIZE] */
+
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "bench.h"
+
+#define FILE_NAME "bench-mmap.dat"
+#define BLOCK 4096
+#define MAP_ADDR ((unsigned char *) 0x10000000)
+
+static unsigned char buf[BLOCK];
+
+int
+main (int argc, char *argv[])
+{
+  unsigned size = argc > 1 ? atoi (argv[1]) : 131072;
+  unsigned read_sum = 0, map_sum = 0;
+  uint64_t start;
+  unsigned i, j;
+  mapid_t map;
+  int fd;
+
+  size -= size % BLOCK;
+  if (size == 0)
+    {
+      printf ("usage: bench-mmap [SIZE]\n");
+      return EXIT_FAILURE;
+    }
+  if (!create (FILE_NAME, size) || (fd = open (FILE_NAME)) < 0)
+    {
+      printf ("bench-mmap: %s: create failed\n", FILE_NAME);
+      return EXIT_FAILURE;
+    }
+  for (i = 0; i < size; i += BLOCK)
+    {
+      for (j = 0; j < BLOCK; j++)
+        buf[j] = random_ulong ();
+      write (fd, buf, BLOCK);
+    }
+
+  seek (fd, 0);
+  start = rdtsc ();
+  for (i = 0; i < size; i += BLOCK)
+    {
+      read (fd, buf, BLOCK);
+      for (j = 0; j < BLOCK; j++)
+        read_sum += buf[j];
+    }
+  bench_bytes ("mmap", "read", size, rdtsc () - start);
+
+  start = rdtsc ();
+  map = mmap (fd, MAP_ADDR);
+  if (map == MAP_FAILED)
+    {
+      printf ("bench-mmap: mmap failed\n");
+      return EXIT_FAILURE;
+    }
+  for (i = 0; i < size; i++)
+    map_sum += MAP_ADDR[i];
+  munmap (map);
+  bench_bytes ("mmap", "mmap", size, rdtsc () - start);
+
+  close (fd);
+  remove (FILE_NAME);
+  if (read_sum != map_sum)
+    {
+      printf ("bench-mmap: read and mmap disagree\n");
+      return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,35 @@
+/* bench-pf.c
+
+   Measures the cost of page faults by touching each page of a
+   large zero-filled array twice: the first touch faults the page
+   in, the second does not.
+
+   usage: bench-pf */
+
+#include <syscall.h>
+#include "bench.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 256            /* 1 MB. */
+
+static char pages[PAGE_CNT][PAGE_SIZE];
+
+/* Writes to each page in PAGES and returns the cycles taken. */
+static uint64_t
+touch_pages (void)
+{
+  uint64_t start = rdtsc ();
+  int i;
+
+  for (i = 0; i < PAGE_CNT; i++)
+    pages[i][0]++;
+  return rdtsc () - start;
+}
+
+int
+main (void)
+{
+  bench_ops ("pf", "first-touch", PAGE_CNT, touch_pages ());
+  bench_ops ("pf", "retouch", PAGE_CNT, touch_pages ());
+  return EXIT_SUCCESS;
+}
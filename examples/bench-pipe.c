@@ -0,0 +1,77 @@
+/* bench-pipe.c
+
+   Measures pipe throughput between two processes: a forked
+   writer sends SIZE bytes in BLOCK-byte writes, and the parent
+   reads them back in BLOCK-byte reads.  With whole, page-aligned
+   blocks the reads trade pages with the pipe instead of copying,
+   which a run with a BLOCK that is not a multiple of 4096 can be
+   compared against.
+
+   usage: bench-pipe [BLOCK [SIZE]]
+
+   BLOCK is 4096 by default and at most 65536.  SIZE is 4194304
+   by default. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "bench.h"
+
+#define MAX_BLOCK 65536
+
+static char buf[MAX_BLOCK] __attribute__ ((aligned (4096)));
+
+int
+main (int argc, char *argv[])
+{
+  unsigned block = argc > 1 ? atoi (argv[1]) : 4096;
+  unsigned size = argc > 2 ? atoi (argv[2]) : 4194304;
+  unsigned done = 0;
+  uint64_t start;
+  int fds[2];
+  pid_t pid;
+
+  if (block == 0 || block > MAX_BLOCK || size < block)
+    {
+      printf ("usage: bench-pipe [BLOCK [SIZE]]\n");
+      return EXIT_FAILURE;
+    }
+  if (pipe (fds) < 0)
+    {
+      printf ("bench-pipe: pipe failed\n");
+      return EXIT_FAILURE;
+    }
+
+  fflush (stdout);
+  pid = fork ();
+  if (pid == PID_ERROR)
+    {
+      printf ("bench-pipe: fork failed\n");
+      return EXIT_FAILURE;
+    }
+  if (pid == 0)
+    {
+      unsigned sent;
+
+      close (fds[0]);
+      for (sent = 0; sent + block <= size; sent += block)
+        if (write (fds[1], buf, block) != (int) block)
+          return EXIT_FAILURE;
+      return EXIT_SUCCESS;
+    }
+
+  close (fds[1]);
+  start = rdtsc ();
+  for (;;)
+    {
+      int n = read (fds[0], buf, block);
+
+      if (n <= 0)
+        break;
+      done += n;
+    }
+  bench_bytes ("pipe", block % 4096 == 0 ? "paged" : "copied", done,
+               rdtsc () - start);
+  close (fds[0]);
+  return wait (pid) == EXIT_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,205 @@
+/* bench-sort.c
+
+   Sorts random 32-bit keys three ways, for each of a set of
+   working-set sizes: a bottom-up merge sort, whose every pass
+   streams through the whole array; the same merge sort blocked,
+   which sorts each BLOCK-key block while it sits in the L1 cache
+   before merging the blocks, saving log2(BLOCK) passes over the
+   whole array; and an LSD radix sort, which makes four passes of
+   scattered writes.  Unlike bubsort and the sorts in tests/vm,
+   which exist to stress virtual memory, this tells whether a
+   change to paging or to the TLB helps code written with the
+   cache in mind, as well as code that is not.  Reports the cycles
+   per key and the page faults each sort took, not counting those
+   of filling in the keys beforehand.
+
+   usage: bench-sort [KB...]
+
+   Each KB is a working set, the keys and the buffer that each
+   sort needs as large as them, in kB.  The default is 16, 256,
+   and 4096: within L1, within L2, and past most L2 caches.  Sizes
+   larger than physical memory work too. */
+
+#include <malloc.h>
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "bench.h"
+
+#define BLOCK 1024              /* Keys per block: 4 kB. */
+#define RADIX_BITS 8            /* Bits sorted on per radix pass. */
+#define RADIX (1 << RADIX_BITS)
+
+static const unsigned default_sizes[] = {16, 256, 4096};
+
+/* Returns the smaller of A and B. */
+static size_t
+min (size_t a, size_t b)
+{
+  return a < b ? a : b;
+}
+
+/* Merges the sorted runs SRC[LO, MID) and SRC[MID, HI) into
+   DST[LO, HI). */
+static void
+merge (const unsigned *src, unsigned *dst, size_t lo, size_t mid,
+       size_t hi)
+{
+  size_t i = lo, j = mid, k = lo;
+
+  while (i < mid && j < hi)
+    dst[k++] = src[j] < src[i] ? src[j++] : src[i++];
+  while (i < mid)
+    dst[k++] = src[i++];
+  while (j < hi)
+    dst[k++] = src[j++];
+}
+
+/* Sorts A[LO, HI), made up of sorted runs of WIDTH keys, by
+   merging pairs of runs back and forth between A and TMP.
+   Returns whichever of them ends up holding the sorted keys. */
+static unsigned *
+merge_passes (unsigned *a, unsigned *tmp, size_t lo, size_t hi,
+              size_t width)
+{
+  for (; width < hi - lo; width *= 2)
+    {
+      unsigned *t;
+      size_t i;
+
+      for (i = lo; i < hi; i += 2 * width)
+        merge (a, tmp, i, min (i + width, hi), min (i + 2 * width, hi));
+      t = a;
+      a = tmp;
+      tmp = t;
+    }
+  return a;
+}
+
+/* Sorts the N keys in A with a bottom-up merge sort, using TMP.
+   Returns where the sorted keys are. */
+static unsigned *
+sort_merge (unsigned *a, unsigned *tmp, size_t n)
+{
+  return merge_passes (a, tmp, 0, n, 1);
+}
+
+/* Sorts the N keys in A with a merge sort that first sorts each
+   block of BLOCK keys on its own, using TMP.  Returns where the
+   sorted keys are. */
+static unsigned *
+sort_merge_blocked (unsigned *a, unsigned *tmp, size_t n)
+{
+  size_t lo;
+
+  for (lo = 0; lo < n; lo += BLOCK)
+    {
+      size_t hi = min (lo + BLOCK, n);
+
+      if (merge_passes (a, tmp, lo, hi, 1) != a)
+        memcpy (a + lo, tmp + lo, (hi - lo) * sizeof *a);
+    }
+  return merge_passes (a, tmp, 0, n, BLOCK);
+}
+
+/* Sorts the N keys in A with an LSD radix sort, using TMP.
+   Returns where the sorted keys are. */
+static unsigned *
+sort_radix (unsigned *a, unsigned *tmp, size_t n)
+{
+  unsigned shift;
+
+  for (shift = 0; shift < 32; shift += RADIX_BITS)
+    {
+      size_t count[RADIX];
+      size_t i, sum;
+      unsigned *t;
+
+      memset (count, 0, sizeof count);
+      for (i = 0; i < n; i++)
+        count[(a[i] >> shift) % RADIX]++;
+      for (i = sum = 0; i < RADIX; i++)
+        {
+          size_t c = count[i];
+
+          count[i] = sum;
+          sum += c;
+        }
+      for (i = 0; i < n; i++)
+        tmp[count[(a[i] >> shift) % RADIX]++] = a[i];
+      t = a;
+      a = tmp;
+      tmp = t;
+    }
+  return a;
+}
+
+/* Times sorting keys in a working set of KB kB with SORT,
+   reporting it as metric NAME-KBk.  Returns false if memory is
+   not available or the keys do not come out sorted. */
+static bool
+run (const char *name, unsigned *(*sort) (unsigned *, unsigned *, size_t),
+     unsigned kb)
+{
+  size_t n = kb * 1024 / (2 * sizeof (unsigned));
+  struct rusage usage;
+  unsigned *a, *sorted;
+  char metric[32];
+  uint64_t start;
+  size_t i;
+
+  a = malloc (2 * n * sizeof *a);
+  if (a == NULL)
+    {
+      printf ("bench-sort: %u kB: out of memory\n", kb);
+      return false;
+    }
+  random_init (kb);
+  for (i = 0; i < n; i++)
+    a[i] = random_ulong ();
+
+  snprintf (metric, sizeof metric, "%s-%uk", name, kb);
+  getrusage (RUSAGE_SELF, &usage);
+  start = rdtsc ();
+  sorted = sort (a, a + n, n);
+  bench_ops ("sort", metric, n, rdtsc () - start);
+  bench_faults ("sort", metric, &usage);
+
+  for (i = 1; i < n; i++)
+    if (sorted[i - 1] > sorted[i])
+      break;
+  free (a);
+  if (i < n)
+    {
+      printf ("bench-sort: %s: keys out of order\n", metric);
+      return false;
+    }
+  return true;
+}
+
+int
+main (int argc, char *argv[])
+{
+  bool ok = true;
+  int i;
+
+  for (i = 1; i < argc; i++)
+    if (atoi (argv[i]) <= 0)
+      {
+        printf ("usage: bench-sort [KB...]\n");
+        return EXIT_FAILURE;
+      }
+
+  for (i = 0; i < (argc > 1 ? argc - 1 : 3); i++)
+    {
+      unsigned kb = argc > 1 ? (unsigned) atoi (argv[i + 1])
+                             : default_sizes[i];
+
+      ok &= run ("merge", sort_merge, kb);
+      ok &= run ("merge-blocked", sort_merge_blocked, kb);
+      ok &= run ("radix", sort_radix, kb);
+    }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
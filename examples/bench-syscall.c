@@ -0,0 +1,25 @@
+/* bench-syscall.c
+
+   Measures the round trip into the kernel and back with a system
+   call that does almost nothing.
+
+   usage: bench-syscall [COUNT] */
+
+#include <stdlib.h>
+#include <syscall.h>
+#include "bench.h"
+
+int
+main (int argc, char *argv[])
+{
+  int cnt = argc > 1 ? atoi (argv[1]) : 10000;
+  uint64_t start;
+  int i;
+
+  start = rdtsc ();
+  for (i = 0; i < cnt; i++)
+    getpid ();
+  bench_ops ("syscall", "getpid", cnt, rdtsc () - start);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,51 @@
+/* bench.c
+
+   Reporting for the user-space benchmarks, in the same format as
+   the kernel's `bench' action, one line per metric:
+
+      BENCH name=NAME metric=METRIC ops=N cycles=C cycles/op=X
+      BENCH name=NAME metric=METRIC bytes=N cycles=C cycles/KB=X
+      BENCH name=NAME metric=METRIC minor-faults=N major-faults=M
+
+   The TSC can be read from user mode, so times are in TSC
+   cycles.  The kernel prints the TSC frequency at boot, which
+   converts them to seconds, and cycles/KB to MB/s. */
+
+#include "bench.h"
+#include <stdio.h>
+#include <syscall.h>
+
+/* Reports that OPS operations measured as METRIC took CYCLES. */
+void
+bench_ops (const char *name, const char *metric,
+           uint64_t ops, uint64_t cycles)
+{
+  printf ("BENCH name=%s metric=%s ops=%llu cycles=%llu cycles/op=%llu\n",
+          name, metric, ops, cycles, ops > 0 ? cycles / ops : 0);
+}
+
+/* Reports that transferring BYTES measured as METRIC took
+   CYCLES. */
+void
+bench_bytes (const char *name, const char *metric,
+             uint64_t bytes, uint64_t cycles)
+{
+  printf ("BENCH name=%s metric=%s bytes=%llu cycles=%llu cycles/KB=%llu\n",
+          name, metric, bytes, cycles,
+          bytes > 0 ? cycles * 1024 / bytes : 0);
+}
+
+/* Reports the page faults the process took since START was
+   filled in by getrusage(), as METRIC. */
+void
+bench_faults (const char *name, const char *metric,
+              const struct rusage *start)
+{
+  struct rusage now;
+
+  if (getrusage (RUSAGE_SELF, &now) < 0)
+    return;
+  printf ("BENCH name=%s metric=%s minor-faults=%llu major-faults=%llu\n",
+          name, metric, now.minor_faults - start->minor_faults,
+          now.major_faults - start->major_faults);
+}
@@ -0,0 +1,15 @@
+#ifndef EXAMPLES_BENCH_H
+#define EXAMPLES_BENCH_H
+
+#include <rusage.h>
+#include <stdint.h>
+#include "threads/cycle.h"
+
+void bench_ops (const char *name, const char *metric,
+                uint64_t ops, uint64_t cycles);
+void bench_bytes (const char *name, const char *metric,
+                  uint64_t bytes, uint64_t cycles);
+void bench_faults (const char *name, const char *metric,
+                   const struct rusage *start);
+
+#endif /* examples/bench.h */
@@ -5,6 +5,8 @@
 
 static void read_line (char line[], size_t);
 static bool backspace (char **pos, char line[]);
+static pid_t run_pipeline (char *command);
+static void print_usage (const struct rusage *before);
 
 int
 main (void)
@@ -26,17 +28,42 @@ main (void)
           if (!chdir (command + 3))
             printf ("\"%s\": chdir failed\n", command + 3);
         }
+      else if (!strcmp (command, "wait"))
+        {
+          /* Reap every background command, in the order they
+             finish. */
+          pid_t pid;
+          int status;
+
+          while ((pid = waitany (&status)) != PID_ERROR)
+            printf ("[%d]: exit code %d\n", pid, status);
+        }
       else if (command[0] == '\0') 
         {
           /* Empty command. */
         }
       else
         {
-          pid_t pid = exec (command);
-          if (pid != PID_ERROR)
-            printf ("\"%s\": exit code %d\n", command, wait (pid));
-          else
+          size_t len = strlen (command);
+          bool background = command[len - 1] == '&';
+          struct rusage before;
+          pid_t pid;
+
+          /* A trailing "&" runs the command in the background. */
+          if (background)
+            command[len - 1] = '\0';
+          getrusage (RUSAGE_CHILDREN, &before);
+          pid = strchr (command, '|') != NULL
+                ? run_pipeline (command) : exec (command);
+          if (pid == PID_ERROR)
             printf ("exec failed\n");
+          else if (background)
+            printf ("[%d]\n", pid);
+          else
+            {
+              printf ("\"%s\": exit code %d\n", command, wait (pid));
+              print_usage (&before);
+            }
         }
     }
 
@@ -44,6 +71,107 @@ main (void)
   return EXIT_SUCCESS;
 }
 
+/* Runs each of the commands in COMMAND, which are separated by
+   "|", with its standard output piped to the next one's standard
+   input.  Each command is started with spawn(), which sets up its
+   standard input and output itself, without waiting for it to
+   load, and then each load is checked.  Waits for all but the
+   last command.  Returns the pid of the last command, or
+   PID_ERROR if a pipe fails or a command cannot be started. */
+static pid_t
+run_pipeline (char *command)
+{
+  pid_t pids[16];
+  int pid_cnt = 0;
+  int in_fd = -1;
+  bool ok = false;
+  char *cmd, *save_ptr;
+  int i;
+
+  for (cmd = strtok_r (command, "|", &save_ptr); cmd != NULL;
+       cmd = strtok_r (NULL, "|", &save_ptr))
+    {
+      bool last = *save_ptr == '\0';
+      int fds[2] = {-1, -1};
+      struct spawn_action actions[3];
+      int action_cnt = 0;
+      char *argv[16];
+      int argc = 0;
+      char *arg, *arg_ptr;
+      pid_t pid;
+
+      for (arg = strtok_r (cmd, " ", &arg_ptr);
+           arg != NULL && argc < (int) (sizeof argv / sizeof *argv) - 1;
+           arg = strtok_r (NULL, " ", &arg_ptr))
+        argv[argc++] = arg;
+      argv[argc] = NULL;
+      if (pid_cnt == sizeof pids / sizeof *pids || argc == 0
+          || (!last && pipe (fds) < 0))
+        break;
+
+      if (in_fd >= 0)
+        actions[action_cnt++] = (struct spawn_action) {SPAWN_DUP2, in_fd,
+                                                       STDIN_FILENO};
+      if (!last)
+        actions[action_cnt++] = (struct spawn_action) {SPAWN_DUP2, fds[1],
+                                                       STDOUT_FILENO};
+      actions[action_cnt] = (struct spawn_action) {SPAWN_END, 0, 0};
+      pid = spawn (argv[0], argv, actions, SPAWN_NOWAIT);
+
+      /* The next command reads what this one writes. */
+      if (in_fd >= 0)
+        close (in_fd);
+      if (!last)
+        close (fds[1]);
+      in_fd = fds[0];
+      if (pid == PID_ERROR)
+        break;
+      pids[pid_cnt++] = pid;
+      ok = last;
+    }
+  if (in_fd >= 0)
+    close (in_fd);
+
+  /* The commands loaded meanwhile. */
+  for (i = 0; i < pid_cnt; i++)
+    if (spawn_status (pids[i]) != 1)
+      ok = false;
+
+  /* A failed pipeline has no last command to report on. */
+  if (!ok)
+    {
+      for (i = 0; i < pid_cnt; i++)
+        wait (pids[i]);
+      return PID_ERROR;
+    }
+  for (i = 0; i < pid_cnt - 1; i++)
+    wait (pids[i]);
+  return pids[pid_cnt - 1];
+}
+
+/* Prints the resources used by the children waited for since
+   their usage was BEFORE, that is, by the command just run.  The
+   peak of resident pages is the largest of any child so far. */
+static void
+print_usage (const struct rusage *before)
+{
+  struct rusage after;
+
+  if (getrusage (RUSAGE_CHILDREN, &after) < 0)
+    return;
+  printf ("  %llu user, %llu kernel ticks; %llu minor, %llu major faults; "
+          "%llu sectors read, %llu written; %llu switches; "
+          "%u pages peak\n",
+          after.user_ticks - before->user_ticks,
+          after.kernel_ticks - before->kernel_ticks,
+          after.minor_faults - before->minor_faults,
+          after.major_faults - before->major_faults,
+          after.block_reads - before->block_reads,
+          after.block_writes - before->block_writes,
+          after.switches - before->switches,
+          (unsigned) after.max_resident);
+}
+
 /* Reads a line of input from the user into LINE, which has room
    for SIZE bytes.  Handles backspace and Ctrl+U in the ways
    expected by Unix users.  On return, LINE will always be
@@ -55,6 +183,9 @@ read_line (char line[], size_t size)
   for (;;)
     {
       char c;
+
+      /* Show the prompt, or echo, before waiting for a key. */
+      fflush (stdout);
       read (STDIN_FILENO, &c, 1);
 
       switch (c) 
@@ -0,0 +1,75 @@
+/* sysctl.c
+
+   Lists the kernel's tunables with their values and ranges, or
+   prints or sets the ones named.  Tunables marked "boot" are read
+   only at boot: set them with -set=NAME=VALUE on the kernel
+   command line instead.
+
+   usage: sysctl [NAME[=VALUE]]... */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Prints tunable SC. */
+static void
+print (const struct sysctl *sc)
+{
+  printf ("%-28s %10u  (%u to %u%s)\n", sc->name, sc->value,
+          sc->min, sc->max, sc->boot_only ? ", boot" : "");
+}
+
+/* Finds the tunable called NAME and stores it in *SC.  Returns
+   false if there is none. */
+static bool
+find (const char *name, struct sysctl *sc)
+{
+  unsigned i;
+
+  for (i = 0; sysctl_get (i, sc); i++)
+    if (!strcmp (sc->name, name))
+      return true;
+  return false;
+}
+
+int
+main (int argc, char *argv[])
+{
+  struct sysctl sc;
+  bool ok = true;
+  int i;
+
+  if (argc < 2)
+    {
+      unsigned j;
+
+      for (j = 0; sysctl_get (j, &sc); j++)
+        print (&sc);
+      return EXIT_SUCCESS;
+    }
+
+  for (i = 1; i < argc; i++)
+    {
+      char *value = strchr (argv[i], '=');
+
+      if (value != NULL)
+        *value++ = '\0';
+      if (!find (argv[i], &sc))
+        {
+          printf ("sysctl: %s: no such tunable\n", argv[i]);
+          ok = false;
+          continue;
+        }
+      if (value != NULL
+          && (!sysctl_set (argv[i], atoi (value))
+              || !find (argv[i], &sc)))
+        {
+          printf ("sysctl: %s: cannot set to %s\n", argv[i], value);
+          ok = false;
+          continue;
+        }
+      print (&sc);
+    }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,60 @@
+/* vmstat.c
+
+   Prints the kernel's memory statistics: counts of page faults
+   by kind, evictions, and swap traffic, followed by the free
+   pages of each pool and the usage of each malloc() size class.
+
+   Given a command, runs it and prints the events it caused
+   instead of the counts since boot, then the memory in use
+   after it exited.
+
+   usage: vmstat [COMMAND [ARG]...] */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+
+static const char *names[VMSTAT_EVENT_CNT] = VMSTAT_EVENT_NAMES;
+
+int
+main (int argc, char *argv[])
+{
+  struct vmstat before, after;
+  size_t i;
+
+  memset (&before, 0, sizeof before);
+  if (argc > 1)
+    {
+      char cmd[128];
+      int status;
+
+      cmd[0] = '\0';
+      for (i = 1; i < (size_t) argc; i++)
+        {
+          if (i > 1)
+            strlcat (cmd, " ", sizeof cmd);
+          strlcat (cmd, argv[i], sizeof cmd);
+        }
+
+      vmstat (&before);
+      status = wait (exec (cmd));
+      printf ("vmstat: \"%s\" exited with status %d\n", cmd, status);
+    }
+  vmstat (&after);
+
+  for (i = 0; i < VMSTAT_EVENT_CNT; i++)
+    printf ("%12s %8llu\n", names[i],
+            after.events[i] - before.events[i]);
+  printf ("%12s %8u free of %u\n", "kernel pool",
+          after.kernel_free, after.kernel_pages);
+  printf ("%12s %8u free of %u\n", "user pool",
+          after.user_free, after.user_pages);
+  for (i = 0; i < after.class_cnt; i++)
+    {
+      struct vmstat_class *c = &after.classes[i];
+
+      printf ("%7s %4u %8u used, %u free in %u arenas\n", "malloc",
+              c->block_size, c->used, c->free, c->arenas);
+    }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,1116 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <hash.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/shrinker.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tunable.h"
+
+/* Buffer cache.
+
+   Every sector of the file system device that is read or written,
+   for inodes, directories and the free map alike, goes through a
+   cache of cache_size sectors.  A sector in the cache is found by
+   a hash table keyed by sector number.  Writes only update the
+   cached copy and mark it dirty; a dirty sector is written back
+   when it is evicted to make room for another one, and all of
+   them by cache_flush(), which a flusher thread calls every
+   cache_flush_ticks timer ticks and filesys_done() at shutdown.
+   Repeated writes to a hot sector thus cost one disk write per
+   flush.  The victim is picked by the clock
+   algorithm, which gives each recently used sector a second
+   chance.
+
+   So that a large scan cannot push out the sectors that every
+   open needs, each cached sector is in one of three classes.
+   Metadata, read with cache_read_meta() or written with
+   cache_write_meta(), is only evicted once no data sector can
+   be, unless it holds more than META_SHARE of the cache.
+   Streaming data, read in by read-ahead or dropped with
+   cache_drop(), goes before any other data once it has been read
+   once, and only moves up to the random data class when it is
+   read again, as in 2Q.  Random data, everything else, is what
+   the clock mostly works on.
+
+   cache_lock protects the hash table, the assignment of sectors
+   to entries, the reference counts and the clock hand.  Each
+   entry's own lock protects its data, so that accesses to
+   different sectors, including the disk I/O to fill or write
+   back an entry, go on in parallel.  An entry is only evicted
+   while no thread holds a reference to it, so its lock is then
+   free and may be taken while holding cache_lock without
+   waiting.
+
+   Sectors that a sequential reader is about to need are queued by
+   cache_read_ahead() and read in by a kernel thread of their own,
+   so that the reader finds them cached instead of waiting for the
+   disk sector by sector.  Both it and cache_flush() submit a batch
+   of requests at once, for the block layer to sort and merge into
+   multi-sector transfers.
+
+   Metadata sectors, written with cache_write_meta(), are not
+   written back in place but through the journal: cache_flush()
+   commits them after writing back the other dirty sectors, and an
+   evicted one is stashed in the journal instead.  A sector is
+   read from the journal rather than the disk while the journal
+   holds a newer copy of it, and then stays metadata for as long
+   as it is cached.
+
+   A block of file data may be written before it has a sector,
+   under a number from CACHE_DELAYED up that the inode layer makes
+   up for it.  Its entry is never evicted, since it has nowhere to
+   go, until cache_move() moves it to the sector that the inode
+   layer allocates for it at the next cache_flush().
+
+   cache_size is the most sectors the cache holds.  Under memory
+   pressure, its shrinker frees the buffers of clean entries that
+   the clock hand finds idle, down to CACHE_MIN_BUFFERS, and a miss
+   gives a buffer back to such a bare entry, when one can be
+   allocated, before it evicts a sector. */
+
+/* Classes of cached sectors, in the order they are kept. */
+enum cache_class
+  {
+    CLASS_META,                 /* Inodes, indexes, directories... */
+    CLASS_DATA,                 /* File data read or written at random. */
+    CLASS_STREAM                /* File data read sequentially. */
+  };
+
+/* A cached sector. */
+struct cache_entry
+  {
+    struct hash_elem elem;      /* Element in the hash table. */
+    block_sector_t sector;      /* Sector held, if in the table. */
+    bool in_table;              /* Holding a sector? */
+    int ref_cnt;                /* Threads using the entry. */
+    bool accessed;              /* Used since the hand passed? */
+    uint8_t class;              /* A cache_class. */
+
+    /* Protected by LOCK. */
+    struct lock lock;           /* Protects the members below. */
+    bool valid;                 /* DATA holds the sector's contents? */
+    bool dirty;                 /* DATA newer than the disk? */
+    bool meta;                  /* Written back through the journal? */
+    uint8_t *data;              /* Contents, BLOCK_SECTOR_SIZE bytes. */
+  };
+
+/* -cache: Number of sectors in the buffer cache. */
+size_t cache_size = 64;
+
+/* -flush: Timer ticks between write-behind flushes. */
+unsigned cache_flush_ticks = TIMER_FREQ;
+
+/* The same as tunables.  The size is read only by cache_init(),
+   and flushing, if turned off at boot, cannot be turned on. */
+static struct tunable size_tunable =
+  {
+    .name = "cache.size",
+    .value = &cache_size,
+    .min = 1,
+    .max = 65536,
+    .boot_only = true,
+  };
+static struct tunable flush_tunable =
+  {
+    .name = "cache.flush_ticks",
+    .value = &cache_flush_ticks,
+    .min = 1,
+    .max = 60 * TIMER_FREQ,
+  };
+
+/* Fewest entries left with buffers by the shrinker. */
+#define CACHE_MIN_BUFFERS 16
+
+/* Most of the cache that metadata keeps from eviction, as a
+   fraction of cache_size. */
+#define META_SHARE(SIZE) ((SIZE) * 3 / 4)
+
+static struct cache_entry *entries;
+static size_t bare_cnt;         /* Entries without buffers. */
+static size_t meta_cnt;         /* Entries of CLASS_META. */
+static struct hash table;
+static size_t hand;
+static struct lock cache_lock;
+static struct condition entry_released;  /* An entry's ref_cnt fell to 0. */
+
+/* Entries being flushed, in ascending sector order, and their
+   write requests, protected by flush_lock. */
+static struct cache_entry **flushing;
+static struct block_request *flush_reqs;
+static struct lock flush_lock;
+
+/* Sectors queued for read-ahead, protected by cache_lock.  A
+   request that finds the queue full is dropped. */
+#define READ_AHEAD_QUEUE 64
+static block_sector_t ra_queue[READ_AHEAD_QUEUE];
+static size_t ra_head, ra_tail;         /* Next to read, next free. */
+static struct condition ra_queued;      /* The queue became non-empty. */
+
+/* Most sectors the read-ahead thread reads at once. */
+#define READ_AHEAD_BATCH 8
+
+/* Statistics. */
+static unsigned long long hit_cnt, miss_cnt, writeback_cnt;
+static unsigned long long meta_hit_cnt, meta_miss_cnt;
+static unsigned long long read_ahead_cnt;
+
+static struct cache_entry *cache_get (block_sector_t, enum cache_class);
+static void set_class (struct cache_entry *, enum cache_class);
+static void cache_put (struct cache_entry *);
+static struct cache_entry *cache_evict (bool bare_ok);
+static bool fill_from_journal (struct cache_entry *);
+static void read_sector (block_sector_t, void *buffer, int ofs, int size,
+                         enum cache_class);
+static void write_sector (block_sector_t, const void *buffer, int ofs,
+                          int size, bool meta);
+static void write_back_one (block_sector_t);
+static void commit (void);
+static thread_func read_ahead_thread NO_RETURN;
+static thread_func flush_thread NO_RETURN;
+static int compare_sectors (const void *, const void *);
+static hash_hash_func entry_hash;
+static hash_less_func entry_less;
+static size_t shrink_count (void);
+static size_t shrink_scan (size_t nr);
+
+static struct shrinker cache_shrinker =
+  {
+    .name = "buffer cache",
+    .count = shrink_count,
+    .scan = shrink_scan,
+  };
+
+/**
+ * cache_init - initialize the buffer cache
+*/
+void cache_init(void)
+{
+	size_t i;
+
+	tunable_register(&size_tunable);
+
+	entries = calloc(cache_size, sizeof *entries);
+	flushing = calloc(cache_size, sizeof *flushing);
+	flush_reqs = calloc(cache_size, sizeof *flush_reqs);
+	if (entries == NULL || flushing == NULL || flush_reqs == NULL ||
+	    !hash_init(&table, entry_hash, entry_less, NULL))
+		PANIC("buffer cache allocation failed");
+	for (i = 0; i < cache_size; i++) {
+		entries[i].data = malloc(BLOCK_SECTOR_SIZE);
+		entries[i].class = CLASS_DATA;
+		if (entries[i].data == NULL)
+			PANIC("buffer cache allocation failed");
+		lock_init(&entries[i].lock);
+	}
+	lock_init_named(&cache_lock, "cache");
+	cond_init(&entry_released);
+	cond_init(&ra_queued);
+	lock_init_named(&flush_lock, "cache flush");
+	shrinker_register(&cache_shrinker);
+	if (thread_create("read-ahead", PRI_DEFAULT, read_ahead_thread,
+			  NULL) == TID_ERROR)
+		PANIC("read-ahead thread creation failed");
+	if (cache_flush_ticks > 0) {
+		tunable_register(&flush_tunable);
+		if (thread_create("flusher", PRI_DEFAULT, flush_thread,
+				  NULL) == TID_ERROR)
+			PANIC("flusher thread creation failed");
+	}
+}
+
+/**
+ * cache_read - read part of a sector through the cache
+ *
+ * @sector: sector of the file system device
+ * @buffer: buffer to read into
+ * @ofs: offset in the sector of the first byte to read
+ * @size: number of bytes to read
+*/
+void cache_read(block_sector_t sector, void *buffer, int ofs, int size)
+{
+	read_sector(sector, buffer, ofs, size, CLASS_DATA);
+}
+
+/**
+ * cache_read_meta - read part of a metadata sector through the cache
+ *
+ * @sector: sector of the file system device
+ * @buffer: buffer to read into
+ * @ofs: offset in the sector of the first byte to read
+ * @size: number of bytes to read
+ *
+ * Like cache_read(), but for inode, index, directory and free map
+ * sectors, which are kept in the cache ahead of file data.
+*/
+void cache_read_meta(block_sector_t sector, void *buffer, int ofs,
+		     int size)
+{
+	read_sector(sector, buffer, ofs, size, CLASS_META);
+}
+
+/**
+ * cache_write - write part of a sector through the cache
+ *
+ * @sector: sector of the file system device
+ * @buffer: data to write
+ * @ofs: offset in the sector of the first byte to write
+ * @size: number of bytes to write
+ *
+ * The sector is read from disk first only if it is not cached and
+ * the write does not cover all of it.  It is written back to disk
+ * later.
+*/
+void cache_write(block_sector_t sector, const void *buffer, int ofs,
+		 int size)
+{
+	write_sector(sector, buffer, ofs, size, false);
+}
+
+/**
+ * cache_write_meta - write part of a metadata sector through the cache
+ *
+ * @sector: sector of the file system device
+ * @buffer: data to write
+ * @ofs: offset in the sector of the first byte to write
+ * @size: number of bytes to write
+ *
+ * Like cache_write(), but for inode, index, directory and free
+ * map sectors, which are written back to disk through the journal.
+ * The caller must be between journal_begin() and journal_end().
+*/
+void cache_write_meta(block_sector_t sector, const void *buffer, int ofs,
+		      int size)
+{
+	write_sector(sector, buffer, ofs, size, true);
+}
+
+/**
+ * cache_read_ahead - read a sector into the cache in the background
+ *
+ * @sector: sector of the file system device, soon to be read
+ *
+ * Queue the given sector to be read by the read-ahead thread,
+ * unless it is already cached or the queue is full.
+*/
+void cache_read_ahead(block_sector_t sector)
+{
+	struct cache_entry key;
+
+	key.sector = sector;
+
+	lock_acquire(&cache_lock);
+	if (hash_find(&table, &key.elem) == NULL &&
+	    (ra_tail + 1) % READ_AHEAD_QUEUE != ra_head) {
+		ra_queue[ra_tail] = sector;
+		ra_tail = (ra_tail + 1) % READ_AHEAD_QUEUE;
+		cond_signal(&ra_queued, &cache_lock);
+	}
+	lock_release(&cache_lock);
+}
+
+/**
+ * cache_drop - let a sector that is no longer needed go first
+ *
+ * @sector: sector of the file system device
+ *
+ * If the given data sector is cached, make it streaming data that
+ * has been read, the first kind of sector to be evicted.  A dirty
+ * sector is still written back first.
+*/
+void cache_drop(block_sector_t sector)
+{
+	struct cache_entry key;
+	struct hash_elem *found;
+
+	key.sector = sector;
+
+	lock_acquire(&cache_lock);
+	found = hash_find(&table, &key.elem);
+	if (found != NULL) {
+		struct cache_entry *e = hash_entry(found, struct cache_entry,
+						   elem);
+
+		if (e->class != CLASS_META) {
+			set_class(e, CLASS_STREAM);
+			e->accessed = true;
+		}
+	}
+	lock_release(&cache_lock);
+}
+
+/**
+ * cache_move - give a delayed block the sector allocated for it
+ *
+ * @old: the block's number, from CACHE_DELAYED up
+ * @new: sector of the file system device
+ *
+ * The block, which must be cached, goes on being cached as the new
+ * sector, dirty, and is no longer found under its old number.  The
+ * caller must keep other threads from using either meanwhile.
+*/
+void cache_move(block_sector_t old, block_sector_t new)
+{
+	struct cache_entry key, *e;
+
+	ASSERT(old >= CACHE_DELAYED && new < CACHE_DELAYED);
+
+	/* Usually the new sector is not cached, and the entry can
+	   simply be renamed. */
+	lock_acquire(&cache_lock);
+	key.sector = new;
+	if (hash_find(&table, &key.elem) == NULL) {
+		key.sector = old;
+		e = hash_entry(hash_find(&table, &key.elem),
+			       struct cache_entry, elem);
+		hash_delete(&table, &e->elem);
+		e->sector = new;
+		hash_insert(&table, &e->elem);
+		lock_release(&cache_lock);
+		return;
+	}
+	lock_release(&cache_lock);
+
+	/* The new sector is still cached from an earlier use.  Copy
+	   the data over it, keeping a reference to the old entry so
+	   that it stays put but not its lock, since entry locks are
+	   taken in ascending sector order. */
+	e = cache_get(old, CLASS_DATA);
+	ASSERT(e->valid);
+	lock_release(&e->lock);
+	write_sector(new, e->data, 0, BLOCK_SECTOR_SIZE, false);
+	lock_acquire(&e->lock);
+	cache_put(e);
+	cache_discard(old);
+}
+
+/**
+ * cache_discard - forget a delayed block without writing it
+ *
+ * @sector: the block's number, from CACHE_DELAYED up
+*/
+void cache_discard(block_sector_t sector)
+{
+	struct cache_entry key, *e;
+	struct hash_elem *found;
+
+	ASSERT(sector >= CACHE_DELAYED);
+
+	key.sector = sector;
+	lock_acquire(&cache_lock);
+	found = hash_find(&table, &key.elem);
+	if (found != NULL) {
+		e = hash_entry(found, struct cache_entry, elem);
+		hash_delete(&table, &e->elem);
+		e->in_table = false;
+		e->accessed = false;
+		set_class(e, CLASS_DATA);
+	}
+	lock_release(&cache_lock);
+}
+
+/**
+ * cache_write_back - write some dirty sectors back to disk
+ *
+ * @sectors: sectors of the file system device, not metadata
+ * @cnt: number of sectors
+ *
+ * Write back those of the given sectors that are cached and dirty,
+ * as cache_flush() does, and wait for them.  Metadata sectors are
+ * skipped, since only a journal commit may write them.
+*/
+void cache_write_back(const block_sector_t *sectors, size_t cnt)
+{
+	struct cache_entry **batch;
+	struct block_request *reqs;
+	size_t n = 0, i;
+
+	if (cnt == 0)
+		return;
+	batch = malloc(cnt * sizeof *batch);
+	reqs = malloc(cnt * sizeof *reqs);
+	if (batch == NULL || reqs == NULL) {
+		free(batch);
+		free(reqs);
+		for (i = 0; i < cnt; i++)
+			write_back_one(sectors[i]);
+		return;
+	}
+
+	lock_acquire(&cache_lock);
+	for (i = 0; i < cnt; i++) {
+		struct cache_entry key;
+		struct hash_elem *found;
+
+		key.sector = sectors[i];
+		found = hash_find(&table, &key.elem);
+		if (found != NULL) {
+			struct cache_entry *e = hash_entry(found,
+							   struct cache_entry,
+							   elem);
+
+			if (e->dirty && !e->meta) {
+				e->ref_cnt++;
+				batch[n++] = e;
+			}
+		}
+	}
+	lock_release(&cache_lock);
+
+	/* Entry locks are taken in ascending sector order. */
+	qsort(batch, n, sizeof *batch, compare_sectors);
+	for (i = 0; i < n; i++) {
+		struct cache_entry *e = batch[i];
+
+		lock_acquire(&e->lock);
+		if (e->valid && e->dirty && !e->meta) {
+			block_request_init(&reqs[i], true, e->sector, 1,
+					   e->data, NULL, NULL);
+			block_submit(fs_device, &reqs[i]);
+			e->dirty = false;
+			writeback_cnt++;
+		} else {
+			reqs[i].cnt = 0;
+		}
+	}
+	for (i = 0; i < n; i++) {
+		if (reqs[i].cnt > 0)
+			block_wait(&reqs[i]);
+		cache_put(batch[i]);
+	}
+	free(batch);
+	free(reqs);
+}
+
+/**
+ * cache_bypass - keep the cache coherent with I/O that bypasses it
+ *
+ * @sector: sector of the file system device
+ * @write: true before and after writing the sector, false before
+ *	   reading it
+ *
+ * Before a read, write back the cached copy of the sector if it is
+ * dirty.  Around a write, throw the cached copy away, dirty or
+ * not, so that it is neither written back over the new data nor
+ * read instead of it.  Return false, doing nothing, if the copy is
+ * metadata, which the journal may also have a copy of: the caller
+ * must then go through the cache for this sector.
+*/
+bool cache_bypass(block_sector_t sector, bool write)
+{
+	struct cache_entry key, *e = NULL;
+	struct hash_elem *found;
+	bool ok = true;
+
+	key.sector = sector;
+	lock_acquire(&cache_lock);
+	found = hash_find(&table, &key.elem);
+	if (found != NULL) {
+		e = hash_entry(found, struct cache_entry, elem);
+		e->ref_cnt++;
+	}
+	lock_release(&cache_lock);
+	if (e == NULL)
+		return true;
+
+	lock_acquire(&e->lock);
+	if (e->meta) {
+		ok = false;
+	} else if (write) {
+		e->valid = false;
+		e->dirty = false;
+	} else if (e->valid && e->dirty) {
+		block_write(fs_device, e->sector, e->data);
+		e->dirty = false;
+		writeback_cnt++;
+	}
+	cache_put(e);
+	return ok;
+}
+
+/**
+ * cache_flush - write every dirty sector back to disk
+ *
+ * All the writes are submitted before waiting for any, in
+ * ascending sector order, so that the disk head sweeps across once
+ * and adjacent sectors go out in one transfer.  A sector written
+ * to while the flush is in progress may be left dirty.  Metadata
+ * is then committed to the journal, after the data it refers to
+ * is on disk.  Delayed blocks are given sectors first, so that they
+ * are written too.  The disk's write cache is flushed after the
+ * data, so that the commit cannot reach the medium before it, and
+ * at the end, so that everything is durable on return.
+*/
+void cache_flush(void)
+{
+	size_t cnt = 0, i;
+
+	inode_allocate_delayed();
+	lock_acquire(&flush_lock);
+
+	/* DIRTY belongs to the entry's lock, so this is only a hint,
+	   rechecked below. */
+	lock_acquire(&cache_lock);
+	for (i = 0; i < cache_size; i++) {
+		struct cache_entry *e = &entries[i];
+
+		if (e->in_table && e->dirty && !e->meta &&
+		    e->sector < CACHE_DELAYED) {
+			e->ref_cnt++;
+			flushing[cnt++] = e;
+		}
+	}
+	lock_release(&cache_lock);
+
+	qsort(flushing, cnt, sizeof *flushing, compare_sectors);
+	for (i = 0; i < cnt; i++) {
+		struct cache_entry *e = flushing[i];
+
+		lock_acquire(&e->lock);
+		if (e->valid && e->dirty && !e->meta) {
+			block_request_init(&flush_reqs[i], true, e->sector, 1,
+					   e->data, NULL, NULL);
+			block_submit(fs_device, &flush_reqs[i]);
+			e->dirty = false;
+			writeback_cnt++;
+		} else {
+			flush_reqs[i].cnt = 0;
+		}
+	}
+	for (i = 0; i < cnt; i++) {
+		if (flush_reqs[i].cnt > 0)
+			block_wait(&flush_reqs[i]);
+		cache_put(flushing[i]);
+	}
+
+	if (journal_active()) {
+		if (cnt > 0)
+			block_flush(fs_device);
+		commit();
+	}
+	block_flush(fs_device);
+	lock_release(&flush_lock);
+}
+
+/**
+ * cache_print_stats - print buffer cache statistics
+*/
+void cache_print_stats(void)
+{
+	printf("Cache: %llu hits, %llu misses, %llu writebacks, "
+	       "%llu read ahead\n", hit_cnt, miss_cnt, writeback_cnt,
+	       read_ahead_cnt);
+	printf("Cache: metadata %llu hits, %llu misses, %zu sectors\n",
+	       meta_hit_cnt, meta_miss_cnt, meta_cnt);
+}
+
+/* Returns the entry holding SECTOR, with a reference to it and
+   its lock held, making room for it if it is not cached.  The
+   entry's data is not valid if the sector was not cached.  CLASS
+   is the kind of use, which a sector already cached moves up to:
+   metadata stays metadata, and streaming data read again becomes
+   random data.  Only CLASS_STREAM, for read-ahead, does not count
+   as a use. */
+static struct cache_entry *
+cache_get (block_sector_t sector, enum cache_class class)
+{
+  struct cache_entry key, *e;
+  struct hash_elem *found;
+  bool tried = false;
+  uint8_t *spare = NULL;
+
+  key.sector = sector;
+
+ retry:
+  lock_acquire (&cache_lock);
+  found = hash_find (&table, &key.elem);
+  if (found != NULL)
+    {
+      e = hash_entry (found, struct cache_entry, elem);
+      e->ref_cnt++;
+      hit_cnt++;
+      if (class == CLASS_META)
+        meta_hit_cnt++;
+      if (class == CLASS_META
+          || (class == CLASS_DATA && e->class == CLASS_STREAM && e->accessed))
+        set_class (e, class);
+      if (class != CLASS_STREAM)
+        e->accessed = true;
+      lock_release (&cache_lock);
+
+      free (spare);
+      lock_acquire (&e->lock);
+      return e;
+    }
+
+  /* Grow back into a bare entry if a buffer can be had.  It is
+     allocated without cache_lock, which the page allocator's
+     shrinkers try to take, so the table is searched again. */
+  if (bare_cnt > 0 && !tried)
+    {
+      lock_release (&cache_lock);
+      spare = malloc (BLOCK_SECTOR_SIZE);
+      tried = true;
+      goto retry;
+    }
+
+  while ((e = cache_evict (spare != NULL)) == NULL)
+    cond_wait (&entry_released, &cache_lock);
+
+  /* Nobody holds a reference, so nobody holds the lock.  Dirty
+     metadata is stashed before the table stops listing it, so
+     that a thread looking for it finds it in one or the other.
+     Other dirty data is written back while the table still lists
+     it, with a reference held, so that a thread looking for it
+     waits for the lock instead of reading what is on the disk
+     before the write.  Then SECTOR may have been cached meanwhile,
+     so the search starts over. */
+  lock_acquire (&e->lock);
+  if (e->in_table && e->valid && e->dirty
+      && !(e->meta && journal_stash (e->sector, e->data)))
+    {
+      e->ref_cnt++;
+      lock_release (&cache_lock);
+      block_write (fs_device, e->sector, e->data);
+      writeback_cnt++;
+      e->dirty = false;
+      cache_put (e);
+      goto retry;
+    }
+  miss_cnt++;
+  if (class == CLASS_META)
+    meta_miss_cnt++;
+  if (e->data == NULL)
+    {
+      e->data = spare;
+      spare = NULL;
+      bare_cnt--;
+    }
+  if (e->in_table)
+    hash_delete (&table, &e->elem);
+  e->sector = sector;
+  e->in_table = true;
+  e->ref_cnt = 1;
+  e->accessed = class != CLASS_STREAM;
+  set_class (e, class);
+  hash_insert (&table, &e->elem);
+  lock_release (&cache_lock);
+  free (spare);
+
+  e->valid = false;
+  e->dirty = false;
+  e->meta = false;
+  return e;
+}
+
+/* Puts entry E in CLASS, keeping count of metadata.  Caller must
+   hold cache_lock. */
+static void
+set_class (struct cache_entry *e, enum cache_class class)
+{
+  if (e->class == CLASS_META)
+    meta_cnt--;
+  if (class == CLASS_META)
+    meta_cnt++;
+  e->class = class;
+}
+
+/* Releases the lock and a reference to entry E, obtained from
+   cache_get(). */
+static void
+cache_put (struct cache_entry *e)
+{
+  lock_release (&e->lock);
+
+  lock_acquire (&cache_lock);
+  if (--e->ref_cnt == 0)
+    cond_signal (&entry_released, &cache_lock);
+  lock_release (&cache_lock);
+}
+
+/* Returns true if entry E, which has a buffer, may be evicted:
+   no thread refers to it and it has a sector to go to. */
+static bool
+evictable (const struct cache_entry *e)
+{
+  return (e->ref_cnt == 0 && e->data != NULL
+          && !(e->in_table && e->sector >= CACHE_DELAYED));
+}
+
+/* Picks an entry that no thread refers to, or returns a null
+   pointer if every entry is in use.  If BARE_OK, an entry without
+   a buffer is picked first, if there is one; otherwise, only
+   entries with buffers are.  Then streaming data that has been
+   read goes first, then the clock algorithm picks other data, and
+   metadata only beyond META_SHARE or when there is nothing else.
+   Caller must hold cache_lock. */
+static struct cache_entry *
+cache_evict (bool bare_ok)
+{
+  size_t steps, i;
+  int pass;
+
+  if (bare_ok && bare_cnt > 0)
+    for (i = 0; i < cache_size; i++)
+      if (entries[i].data == NULL)
+        return &entries[i];
+
+  for (i = 0; i < cache_size; i++)
+    {
+      struct cache_entry *e = &entries[(hand + i) % cache_size];
+
+      if (evictable (e) && e->in_table && e->class == CLASS_STREAM
+          && e->accessed)
+        {
+          hand = (hand + i + 1) % cache_size;
+          return e;
+        }
+    }
+
+  /* Two sweeps clear every accessed bit, so a longer search
+     cannot succeed.  The first pass spares metadata, unless it
+     has more than its share; the second does not. */
+  for (pass = 0; pass < 2; pass++)
+    {
+      bool spare_meta = pass == 0 && meta_cnt <= META_SHARE (cache_size);
+
+      for (steps = 0; steps < 2 * cache_size; steps++)
+        {
+          struct cache_entry *e = &entries[hand];
+
+          hand = (hand + 1) % cache_size;
+          if (!evictable (e))
+            continue;
+          if (e->in_table && e->class == CLASS_META && spare_meta)
+            continue;
+          if (e->accessed && e->in_table)
+            {
+              e->accessed = false;
+              continue;
+            }
+          return e;
+        }
+    }
+  return NULL;
+}
+
+/* Reads the sectors queued by cache_read_ahead() into the
+   cache, forever.  Takes up to READ_AHEAD_BATCH of them at a time,
+   but no more than half the cache, and submits all their reads
+   before waiting for any. */
+static void
+read_ahead_thread (void *aux UNUSED)
+{
+  size_t batch_max = cache_size / 2 < READ_AHEAD_BATCH
+                     ? cache_size / 2 : READ_AHEAD_BATCH;
+
+  if (batch_max == 0)
+    batch_max = 1;
+  block_set_class (BLOCK_CLASS_IDLE);
+  for (;;)
+    {
+      block_sector_t sectors[READ_AHEAD_BATCH];
+      struct block_request reqs[READ_AHEAD_BATCH];
+      struct cache_entry *batch[READ_AHEAD_BATCH];
+      size_t cnt = 0, i;
+
+      lock_acquire (&cache_lock);
+      while (ra_head == ra_tail)
+        cond_wait (&ra_queued, &cache_lock);
+      while (ra_head != ra_tail && cnt < batch_max)
+        {
+          block_sector_t sector = ra_queue[ra_head];
+
+          /* Keep SECTORS ascending and without duplicates: entry
+             locks are taken in ascending order, as cache_flush()
+             does, and holding one twice would deadlock. */
+          for (i = cnt; i > 0 && sectors[i - 1] > sector; i--)
+            continue;
+          if (i == 0 || sectors[i - 1] != sector)
+            {
+              memmove (&sectors[i + 1], &sectors[i],
+                       (cnt - i) * sizeof *sectors);
+              sectors[i] = sector;
+              cnt++;
+            }
+          ra_head = (ra_head + 1) % READ_AHEAD_QUEUE;
+        }
+      lock_release (&cache_lock);
+
+      for (i = 0; i < cnt; i++)
+        {
+          struct cache_entry *e = batch[i] = cache_get (sectors[i],
+                                                        CLASS_STREAM);
+
+          if (!e->valid && !fill_from_journal (e))
+            {
+              block_request_init (&reqs[i], false, sectors[i], 1, e->data,
+                                  NULL, NULL);
+              block_submit (fs_device, &reqs[i]);
+            }
+        }
+      for (i = 0; i < cnt; i++)
+        {
+          struct cache_entry *e = batch[i];
+
+          if (!e->valid)
+            {
+              block_wait (&reqs[i]);
+              e->valid = true;
+              read_ahead_cnt++;
+            }
+          cache_put (e);
+        }
+    }
+}
+
+/* Fills entry E, which is not valid, from the journal if it holds
+   a newer copy of E's sector than the disk does.  Returns true if
+   successful, false if E is left to be read from the disk.
+   Caller must hold E's lock. */
+static bool
+fill_from_journal (struct cache_entry *e)
+{
+  bool dirty;
+
+  if (!journal_read (e->sector, e->data, &dirty))
+    return false;
+  e->valid = true;
+  e->meta = true;
+  e->dirty = dirty;
+  return true;
+}
+
+/* Reads SIZE bytes from SECTOR at offset OFS into BUFFER, as
+   cache_read() or cache_read_meta() does, for CLASS. */
+static void
+read_sector (block_sector_t sector, void *buffer, int ofs, int size,
+             enum cache_class class)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, class);
+  if (!e->valid && !fill_from_journal (e))
+    {
+      block_read (fs_device, sector, e->data);
+      e->valid = true;
+    }
+  memcpy (buffer, e->data + ofs, size);
+  cache_put (e);
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR at offset OFS, as
+   cache_write() or, if META is true, cache_write_meta() does. */
+static void
+write_sector (block_sector_t sector, const void *buffer, int ofs,
+              int size, bool meta)
+{
+  struct cache_entry *e;
+  bool was_pending;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, meta ? CLASS_META : CLASS_DATA);
+  if (!e->valid && !fill_from_journal (e) && size < BLOCK_SECTOR_SIZE)
+    block_read (fs_device, sector, e->data);
+  e->valid = true;
+  memcpy (e->data + ofs, buffer, size);
+
+  /* The journal counts the metadata sectors waiting to commit. */
+  was_pending = e->meta && e->dirty;
+  e->meta = e->meta || (meta && journal_active ());
+  e->dirty = true;
+  if (e->meta && !was_pending)
+    journal_dirtied ();
+  cache_put (e);
+}
+
+/* Writes SECTOR back to disk and waits for it, if it is cached,
+   dirty and not metadata. */
+static void
+write_back_one (block_sector_t sector)
+{
+  struct cache_entry key, *e = NULL;
+  struct hash_elem *found;
+
+  key.sector = sector;
+  lock_acquire (&cache_lock);
+  found = hash_find (&table, &key.elem);
+  if (found != NULL)
+    {
+      e = hash_entry (found, struct cache_entry, elem);
+      e->ref_cnt++;
+    }
+  lock_release (&cache_lock);
+  if (e == NULL)
+    return;
+
+  lock_acquire (&e->lock);
+  if (e->valid && e->dirty && !e->meta)
+    {
+      block_write (fs_device, e->sector, e->data);
+      e->dirty = false;
+      writeback_cnt++;
+    }
+  cache_put (e);
+}
+
+/* Commits the dirty metadata sectors to the journal, as a single
+   transaction of everything that the operations finished so far
+   have changed.  The entries it copies are then clean: until the
+   journal writes them home, it is where they are read from if
+   they are evicted.  Caller must hold flush_lock. */
+static void
+commit (void)
+{
+  size_t cnt = 0, i;
+
+  journal_pause ();
+
+  /* With cache_lock held, no dirty metadata moves between the
+     table and the stash.  Entries with references may be being
+     filled from the stash, and are checked under their locks. */
+  lock_acquire (&cache_lock);
+  journal_take_stash ();
+  for (i = 0; i < cache_size; i++)
+    {
+      struct cache_entry *e = &entries[i];
+
+      if (e->in_table && (e->dirty || e->ref_cnt > 0))
+        {
+          e->ref_cnt++;
+          flushing[cnt++] = e;
+        }
+    }
+  lock_release (&cache_lock);
+
+  qsort (flushing, cnt, sizeof *flushing, compare_sectors);
+  for (i = 0; i < cnt; i++)
+    {
+      struct cache_entry *e = flushing[i];
+
+      lock_acquire (&e->lock);
+      if (e->valid && e->dirty && e->meta)
+        {
+          journal_log (e->sector, e->data);
+          e->dirty = false;
+        }
+      cache_put (e);
+    }
+
+  journal_commit ();
+}
+
+/* Writes the dirty sectors back every cache_flush_ticks timer
+   ticks, or up to a quarter of that later, forever.  The slack lets
+   its wake-ups line up with other sleepers'. */
+static void
+flush_thread (void *aux UNUSED)
+{
+  block_set_class (BLOCK_CLASS_IDLE);
+  for (;;)
+    {
+      timer_sleep_slack (cache_flush_ticks, cache_flush_ticks / 4);
+      cache_flush ();
+    }
+}
+
+/* Returns how many buffers the shrinker may free: those of the
+   entries beyond CACHE_MIN_BUFFERS.  Read without cache_lock, as
+   a hint. */
+static size_t
+shrink_count (void)
+{
+  size_t buffers = cache_size - bare_cnt;
+
+  return buffers > CACHE_MIN_BUFFERS ? buffers - CACHE_MIN_BUFFERS : 0;
+}
+
+/* Frees the buffers of up to NR clean entries that no thread
+   refers to, passing over recently used ones as cache_evict()
+   does, and returns how many it freed.  A sector whose buffer is
+   freed leaves the cache. */
+static size_t
+shrink_scan (size_t nr)
+{
+  size_t freed = 0, steps;
+
+  if (lock_held_by_current_thread (&cache_lock)
+      || !lock_try_acquire (&cache_lock))
+    return 0;
+  for (steps = 0; steps < cache_size && freed < nr
+         && cache_size - bare_cnt > CACHE_MIN_BUFFERS; steps++)
+    {
+      struct cache_entry *e = &entries[hand];
+
+      hand = (hand + 1) % cache_size;
+      if (e->ref_cnt > 0 || e->data == NULL
+          || (e->in_table && e->sector >= CACHE_DELAYED))
+        continue;
+      if (e->accessed && e->in_table)
+        {
+          e->accessed = false;
+          continue;
+        }
+
+      /* Nobody holds a reference, so nobody holds the lock. */
+      if (!lock_try_acquire (&e->lock))
+        continue;
+      if (!e->dirty)
+        {
+          if (e->in_table)
+            {
+              hash_delete (&table, &e->elem);
+              e->in_table = false;
+              set_class (e, CLASS_DATA);
+            }
+          e->valid = false;
+          free (e->data);
+          e->data = NULL;
+          bare_cnt++;
+          freed++;
+        }
+      lock_release (&e->lock);
+    }
+  lock_release (&cache_lock);
+  return freed;
+}
+
+/* Compares the sectors held by the cache entries that A and B
+   point to, for qsort(). */
+static int
+compare_sectors (const void *a_, const void *b_)
+{
+  const struct cache_entry *a = *(struct cache_entry *const *) a_;
+  const struct cache_entry *b = *(struct cache_entry *const *) b_;
+
+  return a->sector < b->sector ? -1 : a->sector > b->sector;
+}
+
+/* Returns a hash value for cache entry E. */
+static unsigned
+entry_hash (const struct hash_elem *e_, void *aux UNUSED)
+{
+  const struct cache_entry *e = hash_entry (e_, struct cache_entry, elem);
+  return hash_int (e->sector);
+}
+
+/* Returns true if cache entry A precedes cache entry B. */
+static bool
+entry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct cache_entry *a = hash_entry (a_, struct cache_entry, elem);
+  const struct cache_entry *b = hash_entry (b_, struct cache_entry, elem);
+
+  return a->sector < b->sector;
+}
@@ -0,0 +1,33 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include <stddef.h>
+#include "devices/block.h"
+
+/* Number of sectors in the buffer cache. */
+extern size_t cache_size;
+
+/* Timer ticks between write-behind flushes, 0 for none. */
+extern unsigned cache_flush_ticks;
+
+/* Sector numbers from here up are not on the device.  They name
+   blocks written before being given a sector, which stay cached
+   until cache_move() gives them one. */
+#define CACHE_DELAYED 0x80000000u
+
+void cache_init (void);
+void cache_read (block_sector_t, void *buffer, int ofs, int size);
+void cache_read_meta (block_sector_t, void *buffer, int ofs, int size);
+void cache_write (block_sector_t, const void *buffer, int ofs, int size);
+void cache_write_meta (block_sector_t, const void *buffer, int ofs,
+                       int size);
+void cache_read_ahead (block_sector_t);
+void cache_drop (block_sector_t);
+void cache_move (block_sector_t old, block_sector_t new);
+void cache_discard (block_sector_t);
+bool cache_bypass (block_sector_t, bool write);
+void cache_write_back (const block_sector_t *, size_t cnt);
+void cache_flush (void);
+void cache_print_stats (void);
+
+#endif /* filesys/cache.h */
@@ -1,10 +1,46 @@
 #include "filesys/directory.h"
+#include <debug.h>
+#include <dirent.h>
+#include <hash.h>
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/rcu.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "userprog/process.h"
+
+/* A directory is a hash table of directory entries, stored in
+   the directory's file with no header: the number of slots is
+   the file's length divided by the size of an entry.  An entry
+   lives in the slot its name hashes to or in one of the
+   PROBE_MAX - 1 slots after it, wrapping around, so a lookup
+   reads at most PROBE_MAX entries.  Removing an entry leaves a
+   tombstone that later lookups probe past.  When no slot is
+   left in range for a new entry, the table is rebuilt with
+   twice as many slots.
+
+   Every directory has a ".." entry for its parent; the root is
+   its own parent.  "." is not stored.
+
+   Recently looked up names are also kept in memory, in a name
+   cache keyed by directory inode and name.  The cache also
+   remembers names found missing, so that walking the same path
+   again reads no directories at all.
+
+   Each operation that reads or changes a directory's table holds
+   the directory inode's lock (see inode_lock()), which also keeps
+   the name cache in step with the table.  Removing a directory
+   also takes the lock of the directory being removed, always
+   after its parent's. */
+#define PROBE_MAX 16
+
+/* Slots in an empty directory's table when it first grows. */
+#define MIN_SLOTS 16
 
 /* A directory. */
 struct dir 
@@ -13,20 +49,106 @@ struct dir
     off_t pos;                          /* Current position. */
   };
 
+/* States of a slot in a directory. */
+enum slot_state
+  {
+    SLOT_FREE,                          /* Never used. */
+    SLOT_USED,                          /* Holds an entry. */
+    SLOT_DELETED                        /* Held an entry, removed. */
+  };
+
 /* A single directory entry. */
 struct dir_entry 
   {
     block_sector_t inode_sector;        /* Sector number of header. */
     char name[NAME_MAX + 1];            /* Null terminated file name. */
-    bool in_use;                        /* In use or free? */
+    uint8_t state;                      /* A slot_state. */
+  };
+
+/* A name in the name cache. */
+struct name_entry
+  {
+    struct list_elem elem;              /* Element in a bucket of names. */
+    struct list_elem lru_elem;          /* In names_lru or names_free. */
+    struct rcu_head rcu;                /* Frees it once replaced. */
+    bool accessed;                      /* Looked up since passed over? */
+    block_sector_t dir;                 /* Directory inode sector. */
+    char name[NAME_MAX + 1];            /* Name in the directory. */
+    block_sector_t inode_sector;        /* Inode sector, 0 if missing. */
   };
 
+/* Name cache.
+
+   Lookups read the cache under rcu_read_lock() alone, walking the
+   bucket of the name without taking NAMES_LOCK, and only mark the
+   entry they find as accessed.  Writers hold NAMES_LOCK.  A writer
+   updates an entry's inode sector in place, a single word, but
+   replaces an entry for another name by unlinking it, with
+   rcu_call() putting it on NAMES_FREE once no lookup can still be
+   reading it, and linking in a free entry with the new name.  The
+   buckets never change size.
+
+   NAMES_LRU lists the cached entries, oldest first.  It is only
+   used by writers, which replace entries with the clock algorithm,
+   passing over those accessed since they were last passed over.
+   There are NAME_CACHE_SPARE entries beyond NAME_CACHE_SIZE to
+   cover replaced entries awaiting their grace period; a name finds
+   no free entry only if more replacements than that happen between
+   two context switches, and then it is not cached. */
+#define NAME_CACHE_SIZE 64
+#define NAME_CACHE_SPARE 8
+#define NAME_BUCKETS 64                 /* Power of 2. */
+static struct name_entry name_entries[NAME_CACHE_SIZE + NAME_CACHE_SPARE];
+static struct list names[NAME_BUCKETS];
+static struct list names_lru;
+static size_t name_cnt;                 /* Entries in names_lru. */
+static struct list names_free;          /* Free entries, interrupts off. */
+static struct lock names_lock;
+static unsigned name_hit_cnt, name_miss_cnt;
+
+/* Cache of `struct dir's. */
+static struct kmem_cache *dir_cache;
+
+static bool name_cache_get (block_sector_t dir, const char *name,
+                            block_sector_t *inode_sector);
+static void name_cache_put (block_sector_t dir, const char *name,
+                            block_sector_t inode_sector);
+static void name_cache_purge (block_sector_t dir);
+static void name_entry_free (struct rcu_head *);
+
+/* Initializes the directory module. */
+void
+dir_init (void) 
+{
+  size_t i;
+
+  dir_cache = kmem_cache_create ("dir", sizeof (struct dir), NULL);
+  if (dir_cache == NULL)
+    PANIC ("dir cache creation failed");
+  for (i = 0; i < NAME_BUCKETS; i++)
+    list_init (&names[i]);
+  list_init (&names_lru);
+  list_init (&names_free);
+  for (i = 0; i < NAME_CACHE_SIZE + NAME_CACHE_SPARE; i++)
+    list_push_back (&names_free, &name_entries[i].lru_elem);
+  lock_init_named (&names_lock, "dir names");
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+   given SECTOR, whose parent directory's inode is in sector
+   PARENT.  Returns true if successful, false on failure. */
 bool
-dir_create (block_sector_t sector, size_t entry_cnt)
+dir_create (block_sector_t sector, size_t entry_cnt, block_sector_t parent)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  struct dir *dir;
+  bool success;
+
+  if (!inode_create (sector, entry_cnt * sizeof (struct dir_entry), true))
+    return false;
+  dir = dir_open (inode_open (sector));
+  success = dir != NULL && dir_add (dir, "..", parent);
+  dir_close (dir);
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -34,7 +156,7 @@ dir_create (block_sector_t sector, size_t entry_cnt)
 struct dir *
 dir_open (struct inode *inode) 
 {
-  struct dir *dir = calloc (1, sizeof *dir);
+  struct dir *dir = kmem_cache_alloc (dir_cache);
   if (inode != NULL && dir != NULL)
     {
       dir->inode = inode;
@@ -44,7 +166,7 @@ dir_open (struct inode *inode)
   else
     {
       inode_close (inode);
-      free (dir);
+      kmem_cache_free (dir_cache, dir);
       return NULL; 
     }
 }
@@ -72,7 +194,7 @@ dir_close (struct dir *dir)
   if (dir != NULL)
     {
       inode_close (dir->inode);
-      free (dir);
+      kmem_cache_free (dir_cache, dir);
     }
 }
 
@@ -83,6 +205,51 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
+/* Sets the position at which dir_readdir() reads DIR's next
+   entry to POS, a value returned by dir_tell(). */
+void
+dir_seek (struct dir *dir, off_t pos)
+{
+  dir->pos = pos;
+}
+
+/* Returns the position at which dir_readdir() reads DIR's next
+   entry. */
+off_t
+dir_tell (const struct dir *dir)
+{
+  return dir->pos;
+}
+
+/* Returns the number of slots in DIR's table. */
+static size_t
+slot_cnt (const struct dir *dir)
+{
+  return inode_length (dir->inode) / sizeof (struct dir_entry);
+}
+
+/* Returns the hash of NAME that picks its slot on disk, 32-bit
+   FNV-1.  It is kept apart from hash_string(), which is free to
+   change, because existing directories depend on it. */
+static unsigned
+slot_hash (const char *name)
+{
+  const unsigned char *s = (const unsigned char *) name;
+  unsigned hash = 2166136261u;
+
+  while (*s != '\0')
+    hash = (hash * 16777619u) ^ *s++;
+  return hash;
+}
+
+/* Returns the byte offset of the Ith slot probed for NAME in a
+   table of CNT slots. */
+static off_t
+probe_ofs (const char *name, size_t i, size_t cnt)
+{
+  return (slot_hash (name) + i) % cnt * sizeof (struct dir_entry);
+}
+
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
@@ -93,24 +260,94 @@ lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
   struct dir_entry e;
-  size_t ofs;
+  size_t cnt, i;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
-      }
+  cnt = slot_cnt (dir);
+  for (i = 0; i < PROBE_MAX && i < cnt; i++)
+    {
+      off_t ofs = probe_ofs (name, i, cnt);
+
+      if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e
+          || e.state == SLOT_FREE)
+        break;
+      if (e.state == SLOT_USED && !strcmp (name, e.name)) 
+        {
+          if (ep != NULL)
+            *ep = e;
+          if (ofsp != NULL)
+            *ofsp = ofs;
+          return true;
+        }
+    }
+  return false;
+}
+
+/* Stores E in a free slot within probing range of its home slot
+   in TABLE, which has CNT slots.  Returns true if successful,
+   false if every slot in range is taken. */
+static bool
+place (struct dir_entry *table, size_t cnt, const struct dir_entry *e)
+{
+  size_t i;
+
+  for (i = 0; i < PROBE_MAX && i < cnt; i++)
+    {
+      struct dir_entry *slot = &table[probe_ofs (e->name, i, cnt)
+                                      / sizeof *slot];
+      if (slot->state == SLOT_FREE)
+        {
+          *slot = *e;
+          return true;
+        }
+    }
   return false;
 }
 
+/* Rebuilds DIR's table with at least twice as many slots,
+   dropping its tombstones.  Returns true if successful, false if
+   memory or disk space runs out. */
+static bool
+rehash (struct dir *dir)
+{
+  size_t old_cnt = slot_cnt (dir);
+  size_t cnt = old_cnt > 0 ? old_cnt * 2 : MIN_SLOTS;
+  struct dir_entry *old, *table = NULL;
+  bool success = false;
+  size_t i;
+
+  old = malloc (old_cnt * sizeof *old);
+  if (old == NULL && old_cnt > 0)
+    return false;
+  if (inode_read_at (dir->inode, old, old_cnt * sizeof *old, 0)
+      != (off_t) (old_cnt * sizeof *old))
+    goto done;
+
+  /* Grow further until every entry fits in range. */
+  for (;; cnt *= 2)
+    {
+      table = calloc (cnt, sizeof *table);
+      if (table == NULL)
+        goto done;
+      for (i = 0; i < old_cnt; i++)
+        if (old[i].state == SLOT_USED && !place (table, cnt, &old[i]))
+          break;
+      if (i == old_cnt)
+        break;
+      free (table);
+    }
+
+  success = (inode_write_at (dir->inode, table, cnt * sizeof *table, 0)
+             == (off_t) (cnt * sizeof *table));
+
+ done:
+  free (table);
+  free (old);
+  return success;
+}
+
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
@@ -119,15 +356,27 @@ bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
+  block_sector_t dir_sector = inode_get_inumber (dir->inode);
+  block_sector_t sector;
   struct dir_entry e;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
-  else
-    *inode = NULL;
+  if (!strcmp (name, "."))
+    {
+      *inode = inode_reopen (dir->inode);
+      return true;
+    }
+
+  if (!name_cache_get (dir_sector, name, &sector))
+    {
+      inode_lock (dir->inode);
+      sector = lookup (dir, name, &e, NULL) ? e.inode_sector : 0;
+      name_cache_put (dir_sector, name, sector);
+      inode_unlock (dir->inode);
+    }
+  *inode = sector != 0 ? inode_open (sector) : NULL;
 
   return *inode != NULL;
 }
@@ -136,101 +385,364 @@ dir_lookup (const struct dir *dir, const char *name,
    file by that name.  The file's inode is in sector
    INODE_SECTOR.
    Returns true if successful, false on failure.
-   Fails if NAME is invalid (i.e. too long) or a disk or memory
-   error occurs. */
+   Fails if NAME is invalid (i.e. too long or "."), if DIR has
+   been removed, or if a disk or memory error occurs. */
 bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
+  block_sector_t dir_sector = inode_get_inumber (dir->inode);
+  block_sector_t sector;
   struct dir_entry e;
-  off_t ofs;
   bool success = false;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
   /* Check NAME for validity. */
-  if (*name == '\0' || strlen (name) > NAME_MAX)
+  if (*name == '\0' || strlen (name) > NAME_MAX || !strcmp (name, "."))
     return false;
+  inode_lock (dir->inode);
+  if (inode_is_removed (dir->inode))
+    goto done;
 
   /* Check that NAME is not in use. */
-  if (lookup (dir, name, NULL, NULL))
+  if (name_cache_get (dir_sector, name, &sector)
+      ? sector != 0 : lookup (dir, name, NULL, NULL))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-     
+  /* Write the entry to the first slot in range that holds none,
+     rebuilding the table until there is one.
+
      inode_read_at() will only return a short read at end of file.
      Otherwise, we'd need to verify that we didn't get a short
      read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
+  while (!success)
+    {
+      size_t cnt = slot_cnt (dir);
+      size_t i;
 
-  /* Write slot. */
-  e.in_use = true;
-  strlcpy (e.name, name, sizeof e.name);
-  e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+      for (i = 0; i < PROBE_MAX && i < cnt; i++)
+        {
+          off_t ofs = probe_ofs (name, i, cnt);
+
+          if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+            goto done;
+          if (e.state != SLOT_USED)
+            {
+              e.state = SLOT_USED;
+              strlcpy (e.name, name, sizeof e.name);
+              e.inode_sector = inode_sector;
+              success = (inode_write_at (dir->inode, &e, sizeof e, ofs)
+                         == sizeof e);
+              if (!success)
+                goto done;
+              break;
+            }
+        }
+      if (!success && !rehash (dir))
+        goto done;
+    }
+  name_cache_put (dir_sector, name, inode_sector);
 
  done:
+  inode_unlock (dir->inode);
   return success;
 }
 
+/* Returns true if directory INODE has no entries but "..". */
+static bool
+is_empty (struct inode *inode)
+{
+  struct dir_entry e;
+  off_t ofs;
+
+  for (ofs = 0; inode_read_at (inode, &e, sizeof e, ofs) == sizeof e;
+       ofs += sizeof e)
+    if (e.state == SLOT_USED && strcmp (e.name, ".."))
+      return false;
+  return true;
+}
+
 /* Removes any entry for NAME in DIR.
    Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+   which occurs only if there is no file with the given NAME, if
+   NAME is "." or "..", or if it is a directory that is not
+   empty. */
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
   struct dir_entry e;
   struct inode *inode = NULL;
+  bool locked = false;
   bool success = false;
   off_t ofs;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  if (!strcmp (name, ".") || !strcmp (name, ".."))
+    return false;
+  inode_lock (dir->inode);
+
   /* Find directory entry. */
   if (!lookup (dir, name, &e, &ofs))
     goto done;
 
-  /* Open inode. */
+  /* Open inode.  A directory stays locked until it is marked
+     removed, so that nothing is added to it meanwhile. */
   inode = inode_open (e.inode_sector);
   if (inode == NULL)
     goto done;
+  if (inode_is_dir (inode))
+    {
+      inode_lock (inode);
+      locked = true;
+      if (!is_empty (inode))
+        goto done;
+    }
 
   /* Erase directory entry. */
-  e.in_use = false;
+  name_cache_put (inode_get_inumber (dir->inode), name, 0);
+  e.state = SLOT_DELETED;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
 
-  /* Remove inode. */
+  /* Remove inode, and whatever is cached under it: the names in a
+     directory, including its "..", or an executable image. */
   inode_remove (inode);
+  if (inode_is_dir (inode))
+    name_cache_purge (e.inode_sector);
+  else
+    process_uncache (inode);
   success = true;
 
  done:
+  if (locked)
+    inode_unlock (inode);
   inode_close (inode);
+  inode_unlock (dir->inode);
   return success;
 }
 
-/* Reads the next directory entry in DIR and stores the name in
-   NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
+/* Reads the next directory entry in DIR, other than "..", and
+   stores the name in NAME.  Returns true if successful, false if
+   the directory contains no more entries. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
   struct dir_entry e;
+  bool found = false;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+  inode_lock (dir->inode);
+  while (!found
+         && inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e)
     {
       dir->pos += sizeof e;
-      if (e.in_use)
+      if (e.state == SLOT_USED && strcmp (e.name, ".."))
         {
           strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
+          found = true;
         } 
     }
-  return false;
+  inode_unlock (dir->inode);
+  return found;
+}
+
+/* Directory entries that dir_getdents() reads at once, about a
+   sector's worth. */
+#define GETDENTS_BATCH (BLOCK_SECTOR_SIZE / sizeof (struct dir_entry))
+
+/* Reads up to CNT of the next entries in DIR, other than "..",
+   into ENTS, as dir_readdir() would one at a time, and returns the
+   number read, which is 0 if there are no more entries.  Slots
+   are read a sector's worth at a time.  IS_DIR and SIZE, which
+   spare the caller a stat() per entry, are found out with DIR
+   unlocked, since opening and closing an inode may take part
+   in a file system operation of its own. */
+size_t
+dir_getdents (struct dir *dir, struct dirent *ents, size_t cnt)
+{
+  struct dir_entry slots[GETDENTS_BATCH];
+  size_t found = 0, i;
+
+  inode_lock (dir->inode);
+  while (found < cnt)
+    {
+      off_t size = inode_read_at (dir->inode, slots, sizeof slots, dir->pos);
+      size_t slot_cnt = size / sizeof *slots;
+
+      if (slot_cnt == 0)
+        break;
+      for (i = 0; i < slot_cnt && found < cnt; i++)
+        {
+          struct dir_entry *e = &slots[i];
+
+          dir->pos += sizeof *e;
+          if (e->state == SLOT_USED && strcmp (e->name, ".."))
+            {
+              ents[found].inumber = e->inode_sector;
+              strlcpy (ents[found].name, e->name, sizeof ents[found].name);
+              found++;
+            }
+        }
+    }
+  inode_unlock (dir->inode);
+
+  for (i = 0; i < found; i++)
+    {
+      struct inode *inode = inode_open (ents[i].inumber);
+
+      ents[i].is_dir = inode != NULL && inode_is_dir (inode);
+      ents[i].size = inode != NULL ? inode_length (inode) : 0;
+      inode_close (inode);
+    }
+  return found;
+}
+
+/* Prints name cache statistics. */
+void
+dir_print_stats (void)
+{
+  printf ("Name cache: %u hits, %u misses\n", name_hit_cnt, name_miss_cnt);
+}
+
+/* Returns the cached NAME in directory DIR, or a null pointer if
+   it is not cached.  Caller must hold names_lock or be in a
+   read-side section. */
+static struct name_entry *
+name_find (block_sector_t dir, const char *name)
+{
+  struct list *bucket;
+  struct list_elem *e;
+
+  if (strlen (name) > NAME_MAX)
+    return NULL;
+  bucket = &names[(hash_string (name) ^ hash_int (dir)) & (NAME_BUCKETS - 1)];
+  for (e = list_begin (bucket); e != list_end (bucket); e = list_next (e))
+    {
+      struct name_entry *n = list_entry (e, struct name_entry, elem);
+
+      if (n->dir == dir && !strcmp (n->name, name))
+        return n;
+    }
+  return NULL;
+}
+
+/* Looks up NAME in directory DIR in the name cache.  If it is
+   there, sets *INODE_SECTOR to the sector of its inode, or to 0
+   if NAME is known to be missing, and returns true; otherwise,
+   returns false. */
+static bool
+name_cache_get (block_sector_t dir, const char *name,
+                block_sector_t *inode_sector)
+{
+  struct name_entry *n;
+
+  rcu_read_lock ();
+  n = name_find (dir, name);
+  if (n != NULL)
+    {
+      *inode_sector = n->inode_sector;
+      n->accessed = true;
+      name_hit_cnt++;
+    }
+  else
+    name_miss_cnt++;
+  rcu_read_unlock ();
+  return n != NULL;
+}
+
+/* Records in the name cache that NAME in directory DIR has its
+   inode in INODE_SECTOR, or is missing if INODE_SECTOR is 0,
+   replacing a name not used lately if need be. */
+static void
+name_cache_put (block_sector_t dir, const char *name,
+                block_sector_t inode_sector)
+{
+  struct name_entry *n;
+  enum intr_level old_level;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&names_lock);
+  n = name_find (dir, name);
+  if (n != NULL)
+    {
+      n->inode_sector = inode_sector;
+      n->accessed = true;
+      lock_release (&names_lock);
+      return;
+    }
+
+  /* Replace the first entry not accessed since it was last passed
+     over.  Lookups may still be reading it, so it only becomes free
+     after a grace period. */
+  while (name_cnt >= NAME_CACHE_SIZE)
+    {
+      n = list_entry (list_pop_front (&names_lru), struct name_entry,
+                      lru_elem);
+      if (n->accessed)
+        {
+          n->accessed = false;
+          list_push_back (&names_lru, &n->lru_elem);
+          continue;
+        }
+      list_remove (&n->elem);
+      name_cnt--;
+      rcu_call (&n->rcu, name_entry_free);
+    }
+
+  old_level = intr_disable ();
+  n = (list_empty (&names_free) ? NULL
+       : list_entry (list_pop_front (&names_free), struct name_entry,
+                     lru_elem));
+  intr_set_level (old_level);
+  if (n != NULL)
+    {
+      n->accessed = false;
+      n->dir = dir;
+      strlcpy (n->name, name, sizeof n->name);
+      n->inode_sector = inode_sector;
+      list_push_back_rcu (&names[(hash_string (name) ^ hash_int (dir))
+                                 & (NAME_BUCKETS - 1)], &n->elem);
+      list_push_back (&names_lru, &n->lru_elem);
+      name_cnt++;
+    }
+  lock_release (&names_lock);
+}
+
+/* Drops every name in directory DIR from the name cache, so that
+   none is found there once DIR's sector is reused. */
+static void
+name_cache_purge (block_sector_t dir)
+{
+  struct list_elem *e, *next;
+
+  lock_acquire (&names_lock);
+  for (e = list_begin (&names_lru); e != list_end (&names_lru); e = next)
+    {
+      struct name_entry *n = list_entry (e, struct name_entry, lru_elem);
+
+      next = list_next (e);
+      if (n->dir == dir)
+        {
+          list_remove (&n->elem);
+          list_remove (&n->lru_elem);
+          name_cnt--;
+          rcu_call (&n->rcu, name_entry_free);
+        }
+    }
+  lock_release (&names_lock);
+}
+
+/* Puts a replaced name cache entry back on the free list, once no
+   lookup can be reading it.  Callback for rcu_call(), run with
+   interrupts off. */
+static void
+name_entry_free (struct rcu_head *head)
+{
+  struct name_entry *n = rcu_entry (head, struct name_entry, rcu);
+
+  list_push_back (&names_free, &n->lru_elem);
 }
@@ -1,43 +1,116 @@
 #include "filesys/file.h"
 #include <debug.h>
+#include "devices/block.h"
 #include "filesys/inode.h"
-#include "threads/malloc.h"
+#include "filesys/pipe.h"
+#include "threads/slab.h"
+#include "threads/tunable.h"
+#include "userprog/process.h"
 
-/* An open file. */
+/* An open file, or an end of a pipe.  The operations on files
+   that make sense for a pipe are passed on to it; a pipe has no
+   length and no position. */
 struct file 
   {
-    struct inode *inode;        /* File's inode. */
+    struct inode *inode;        /* File's inode, or NULL for a pipe. */
+    struct pipe *pipe;          /* Pipe, or NULL for a file. */
+    bool write_end;             /* Write end of PIPE? */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    off_t ra_next;              /* Where a sequential read would start. */
+    off_t ra_end;               /* End of the data read ahead so far. */
+    enum advice advice;         /* From file_advise(). */
+    bool direct;                /* Bypass the buffer cache? */
+    bool append;                /* Write at the end of the file? */
   };
 
+/* How far ahead of a sequential reader to read, in bytes, and
+   how far if the file is advised to be read sequentially. */
+static unsigned read_ahead_size = 8 * BLOCK_SECTOR_SIZE;
+static struct tunable read_ahead_tunable =
+  {
+    .name = "file.read_ahead",
+    .value = &read_ahead_size,
+    .min = 0,
+    .max = 256 * 1024,
+  };
+#define READ_AHEAD_SEQ(SIZE) (4 * (SIZE))
+
+/* Cache of `struct file's. */
+static struct kmem_cache *file_cache;
+
+/* Initializes the file module. */
+void
+file_init (void) 
+{
+  file_cache = kmem_cache_create ("file", sizeof (struct file), NULL);
+  if (file_cache == NULL)
+    PANIC ("file cache creation failed");
+  tunable_register (&read_ahead_tunable);
+}
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
 struct file *
 file_open (struct inode *inode) 
 {
-  struct file *file = calloc (1, sizeof *file);
+  struct file *file = kmem_cache_alloc (file_cache);
   if (inode != NULL && file != NULL)
     {
       file->inode = inode;
+      file->pipe = NULL;
       file->pos = 0;
       file->deny_write = false;
+      file->ra_next = file->ra_end = 0;
+      file->advice = ADV_NORMAL;
+      file->direct = false;
+      file->append = false;
       return file;
     }
   else
     {
       inode_close (inode);
-      free (file);
+      kmem_cache_free (file_cache, file);
       return NULL; 
     }
 }
 
-/* Opens and returns a new file for the same inode as FILE.
-   Returns a null pointer if unsuccessful. */
+/* Opens and returns a file for an end of PIPE, the write end if
+   WRITE_END is true, of which it takes ownership.  Returns a null
+   pointer, closing the end, if an allocation fails. */
+struct file *
+file_open_pipe (struct pipe *pipe, bool write_end)
+{
+  struct file *file = kmem_cache_alloc (file_cache);
+  if (file == NULL)
+    {
+      pipe_close (pipe, write_end);
+      return NULL;
+    }
+  file->inode = NULL;
+  file->pipe = pipe;
+  file->write_end = write_end;
+  file->pos = 0;
+  file->deny_write = false;
+  file->ra_next = file->ra_end = 0;
+  file->advice = ADV_NORMAL;
+  file->direct = false;
+  file->append = false;
+  return file;
+}
+
+/* Opens and returns a new file for the same inode, or the same
+   end of the same pipe, as FILE.  Returns a null pointer if
+   unsuccessful. */
 struct file *
 file_reopen (struct file *file) 
 {
+  if (file->pipe != NULL)
+    {
+      pipe_reopen (file->pipe, file->write_end);
+      return file_open_pipe (file->pipe, file->write_end);
+    }
   return file_open (inode_reopen (file->inode));
 }
 
@@ -45,31 +118,95 @@ file_reopen (struct file *file)
 void
 file_close (struct file *file) 
 {
-  if (file != NULL)
+  if (file != NULL && file->pipe != NULL)
+    {
+      pipe_close (file->pipe, file->write_end);
+      kmem_cache_free (file_cache, file);
+    }
+  else if (file != NULL)
     {
       file_allow_write (file);
       inode_close (file->inode);
-      free (file); 
+      kmem_cache_free (file_cache, file); 
     }
 }
 
-/* Returns the inode encapsulated by FILE. */
+/* Returns the inode encapsulated by FILE, or a null pointer if
+   FILE is a pipe. */
 struct inode *
 file_get_inode (struct file *file) 
 {
   return file->inode;
 }
 
+/* Returns the pipe FILE is an end of, or a null pointer if FILE
+   is not a pipe. */
+struct pipe *
+file_get_pipe (struct file *file)
+{
+  return file->pipe;
+}
+
+/* Returns true if FILE is a directory. */
+bool
+file_is_dir (struct file *file)
+{
+  return file->inode != NULL && inode_is_dir (file->inode);
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
    starting at the file's current position.
    Returns the number of bytes actually read,
    which may be less than SIZE if end of file is reached.
-   Advances FILE's position by the number of bytes read. */
+   Advances FILE's position by the number of bytes read.
+   A read that starts where the last one ended has the data that
+   follows read ahead, unless FILE is advised to be read randomly,
+   and further ahead if it is advised to be read sequentially.
+   In direct mode, whole sectors are read from the disk without
+   going through the buffer cache or reading ahead.
+   A read from a pipe waits for data and returns what there is,
+   up to SIZE bytes, or 0 at end of file. */
 off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
-  off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  bool sequential;
+  off_t bytes_read;
+  off_t ra_size;
+
+  if (file->pipe != NULL)
+    {
+      int n = file_pipe_read (file, buffer, size, NULL);
+      return n > 0 ? n : 0;
+    }
+  if (file->direct)
+    {
+      bytes_read = inode_read_direct (file->inode, buffer, size, file->pos);
+      if (bytes_read < size)
+        bytes_read += inode_read_at (file->inode, (uint8_t *) buffer
+                                     + bytes_read, size - bytes_read,
+                                     file->pos + bytes_read);
+      file->pos += bytes_read;
+      return bytes_read;
+    }
+
+  ra_size = read_ahead_size;
+  if (file->advice == ADV_SEQUENTIAL)
+    ra_size = READ_AHEAD_SEQ (ra_size);
+  sequential = (file->advice != ADV_RANDOM
+                && file->pos == file->ra_next);
+  bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
   file->pos += bytes_read;
+  file->ra_next = file->pos;
+
+  if (!sequential || file->ra_end < file->pos)
+    file->ra_end = file->pos;
+  if (sequential && bytes_read > 0
+      && file->ra_end < file->pos + ra_size)
+    {
+      inode_read_ahead (file->inode, file->pos + ra_size - file->ra_end,
+                        file->ra_end);
+      file->ra_end = file->pos + ra_size;
+    }
   return bytes_read;
 }
 
@@ -90,11 +227,40 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs)
    which may be less than SIZE if end of file is reached.
    (Normally we'd grow the file in that case, but file growth is
    not yet implemented.)
-   Advances FILE's position by the number of bytes read. */
+   Advances FILE's position by the number of bytes read.
+   In direct mode, whole sectors that the file already has are
+   written to the disk without going through the buffer cache.
+   In append mode, the bytes go at the end of the file instead,
+   through the buffer cache, and the position moves past them.
+   A write to a pipe waits for room for all SIZE bytes, and is
+   short only if the pipe has no readers left. */
 off_t
 file_write (struct file *file, const void *buffer, off_t size) 
 {
-  off_t bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
+  off_t bytes_written = 0;
+
+  if (file->pipe != NULL)
+    {
+      int n = file_pipe_write (file, buffer, size, NULL);
+      return n > 0 ? n : 0;
+    }
+
+  process_uncache (file->inode);
+  if (file->append)
+    {
+      off_t ofs;
+
+      bytes_written = inode_append (file->inode, buffer, size, &ofs);
+      file->pos = ofs + bytes_written;
+      return bytes_written;
+    }
+  if (file->direct)
+    bytes_written = inode_write_direct (file->inode, buffer, size,
+                                        file->pos);
+  if (bytes_written < size)
+    bytes_written += inode_write_at (file->inode, (const uint8_t *) buffer
+                                     + bytes_written, size - bytes_written,
+                                     file->pos + bytes_written);
   file->pos += bytes_written;
   return bytes_written;
 }
@@ -110,9 +276,134 @@ off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
                off_t file_ofs) 
 {
+  process_uncache (file->inode);
   return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Reads up to SIZE bytes from pipe end FILE into BUFFER, copying
+   with COPY if BUFFER is a user buffer and COPY is not null, as
+   pipe_read() does.  Returns the number of bytes read, 0 at end
+   of file, or -1 if FILE is the write end or COPY fails. */
+int
+file_pipe_read (struct file *file, void *buffer, off_t size,
+                pipe_copy_func *copy)
+{
+  ASSERT (file->pipe != NULL);
+  if (file->write_end || size < 0)
+    return -1;
+  return pipe_read (file->pipe, buffer, size, copy);
+}
+
+/* Writes SIZE bytes from BUFFER to pipe end FILE, copying with
+   COPY if BUFFER is a user buffer and COPY is not null, as
+   pipe_write() does.  Returns the number of bytes written, or -1
+   if FILE is the read end, the pipe has no readers, or COPY
+   fails. */
+int
+file_pipe_write (struct file *file, const void *buffer, off_t size,
+                 pipe_copy_func *copy)
+{
+  ASSERT (file->pipe != NULL);
+  if (!file->write_end || size < 0)
+    return -1;
+  if (size == 0)
+    return 0;
+  return pipe_write (file->pipe, buffer, size, copy);
+}
+
+/* Puts FILE in direct mode if DIRECT is true, in which
+   file_read() and file_write() transfer whole sectors between the
+   caller's buffer and the disk, bypassing the buffer cache, or
+   takes it out of direct mode.  Returns false if FILE is a pipe
+   or a directory. */
+bool
+file_set_direct (struct file *file, bool direct)
+{
+  ASSERT (file != NULL);
+  if (file->inode == NULL || inode_is_dir (file->inode))
+    return false;
+  file->direct = direct;
+  return true;
+}
+
+/* Returns true if FILE is in direct mode. */
+bool
+file_is_direct (const struct file *file)
+{
+  return file->direct;
+}
+
+/* Puts FILE in append mode if APPEND is true, in which
+   file_write() writes at the end of the file, without excluding
+   other appenders while it copies, or takes it out of append
+   mode.  Returns false if FILE is a pipe or a directory. */
+bool
+file_set_append (struct file *file, bool append)
+{
+  ASSERT (file != NULL);
+  if (file->inode == NULL || inode_is_dir (file->inode))
+    return false;
+  file->append = append;
+  return true;
+}
+
+/* Returns true if FILE is in append mode. */
+bool
+file_is_append (const struct file *file)
+{
+  return file->append;
+}
+
+/* Makes the data written to FILE durable, along with what is
+   needed to find it.  Returns false if FILE is a pipe. */
+bool
+file_sync (struct file *file)
+{
+  ASSERT (file != NULL);
+  if (file->inode == NULL)
+    return false;
+  inode_sync (file->inode);
+  return true;
+}
+
+/* Acts on ADVICE about how the LEN bytes of FILE starting at
+   OFFSET, or those up to end of file if LEN is 0, will be read.
+   ADV_NORMAL, ADV_SEQUENTIAL and ADV_RANDOM apply to all of FILE
+   and set how far file_read() reads ahead.  ADV_WILLNEED has the
+   range read into the buffer cache in the background, and
+   ADV_DONTNEED lets its cached sectors be evicted first.  Returns
+   false if FILE is a pipe or a directory, or the arguments are
+   out of range. */
+bool
+file_advise (struct file *file, off_t offset, off_t len, enum advice advice)
+{
+  ASSERT (file != NULL);
+  if (file->inode == NULL || inode_is_dir (file->inode)
+      || offset < 0 || len < 0)
+    return false;
+  if (len == 0 || len > inode_length (file->inode) - offset)
+    len = inode_length (file->inode) - offset;
+
+  switch (advice)
+    {
+    case ADV_NORMAL:
+    case ADV_SEQUENTIAL:
+    case ADV_RANDOM:
+      file->advice = advice;
+      return true;
+    case ADV_WILLNEED:
+      if (len > 0)
+        inode_read_ahead (file->inode, len, offset);
+      return true;
+    case ADV_DONTNEED:
+      if (len > 0)
+        inode_drop (file->inode, len, offset);
+      return true;
+    default:
+      return false;
+    }
+}
+
 /* Prevents write operations on FILE's underlying inode
    until file_allow_write() is called or FILE is closed. */
 void
@@ -140,22 +431,23 @@ file_allow_write (struct file *file)
     }
 }
 
-/* Returns the size of FILE in bytes. */
+/* Returns the size of FILE in bytes, 0 for a pipe. */
 off_t
 file_length (struct file *file) 
 {
   ASSERT (file != NULL);
-  return inode_length (file->inode);
+  return file->inode != NULL ? inode_length (file->inode) : 0;
 }
 
 /* Sets the current position in FILE to NEW_POS bytes from the
-   start of the file. */
+   start of the file.  A pipe's position stays at 0. */
 void
 file_seek (struct file *file, off_t new_pos)
 {
   ASSERT (file != NULL);
   ASSERT (new_pos >= 0);
-  file->pos = new_pos;
+  if (file->pipe == NULL)
+    file->pos = new_pos;
 }
 
 /* Returns the current position in FILE as a byte offset from the
@@ -1,15 +1,21 @@
 #ifndef FILESYS_FILE_H
 #define FILESYS_FILE_H
 
+#include <advice.h>
+#include <stdbool.h>
 #include "filesys/off_t.h"
+#include "filesys/pipe.h"
 
 struct inode;
 
+void file_init (void);
+
 /* Opening and closing files. */
 struct file *file_open (struct inode *);
 struct file *file_reopen (struct file *);
 void file_close (struct file *);
 struct inode *file_get_inode (struct file *);
+bool file_is_dir (struct file *);
 
 /* Reading and writing. */
 off_t file_read (struct file *, void *, off_t);
@@ -17,10 +23,24 @@ off_t file_read_at (struct file *, void *, off_t size, off_t start);
 off_t file_write (struct file *, const void *, off_t);
 off_t file_write_at (struct file *, const void *, off_t size, off_t start);
 
+/* Pipes. */
+struct file *file_open_pipe (struct pipe *, bool write_end);
+struct pipe *file_get_pipe (struct file *);
+int file_pipe_read (struct file *, void *, off_t, pipe_copy_func *);
+int file_pipe_write (struct file *, const void *, off_t, pipe_copy_func *);
+
 /* Preventing writes. */
 void file_deny_write (struct file *);
 void file_allow_write (struct file *);
 
+/* Access pattern advice. */
+bool file_advise (struct file *, off_t offset, off_t len, enum advice);
+bool file_sync (struct file *);
+bool file_set_direct (struct file *, bool);
+bool file_is_direct (const struct file *);
+bool file_set_append (struct file *, bool);
+bool file_is_append (const struct file *);
+
 /* File position. */
 void file_seek (struct file *, off_t);
 off_t file_tell (struct file *);
@@ -2,15 +2,20 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "filesys/directory.h"
+#include "threads/thread.h"
+#include "userprog/process.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
 
 static void do_format (void);
+static struct dir *resolve (const char *path, char name[NAME_MAX + 1]);
 
 /* Initializes the file system module.
    If FORMAT is true, reformats the file system. */
@@ -21,8 +26,13 @@ filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
   inode_init ();
+  file_init ();
+  pipe_init ();
+  dir_init ();
   free_map_init ();
+  journal_init (format);
 
   if (format) 
     do_format ();
@@ -35,9 +45,22 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
+  inode_allocate_delayed ();
   free_map_close ();
+  cache_flush ();
 }
 
+/* Allocates a sector for the inode of a new file in DIR, near
+   DIR's own inode unless the new file is a directory, as
+   IS_DIR says, and stores it in *SECTORP.  Returns true if
+   successful, false if the disk is full. */
+static bool
+allocate_inode (struct dir *dir, bool is_dir, block_sector_t *sectorp)
+{
+  return free_map_allocate_inode (inode_get_inumber (dir_get_inode (dir)),
+                                  is_dir, sectorp);
+}
+
 /* Creates a file named NAME with the given INITIAL_SIZE.
    Returns true if successful, false otherwise.
    Fails if a file named NAME already exists,
@@ -46,14 +69,60 @@ bool
 filesys_create (const char *name, off_t initial_size) 
 {
   block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
+  char part[NAME_MAX + 1];
+  struct dir *dir;
+  bool success;
+
+  journal_begin ();
+  dir = resolve (name, part);
+  success = (dir != NULL
+             && allocate_inode (dir, false, &inode_sector)
+             && inode_create (inode_sector, initial_size, false)
+             && dir_add (dir, part, inode_sector));
   if (!success && inode_sector != 0) 
     free_map_release (inode_sector, 1);
   dir_close (dir);
+  journal_end ();
+
+  return success;
+}
+
+/* Creates a directory named NAME.
+   Returns true if successful, false otherwise.
+   Fails if a file named NAME already exists,
+   or if internal memory allocation fails. */
+bool
+filesys_mkdir (const char *name)
+{
+  block_sector_t inode_sector = 0;
+  char part[NAME_MAX + 1];
+  struct dir *dir;
+  bool created = false;
+  bool success;
+
+  journal_begin ();
+  dir = resolve (name, part);
+  success = (dir != NULL
+             && allocate_inode (dir, true, &inode_sector)
+             && (created = dir_create (inode_sector, 16, inode_get_inumber
+                                                    (dir_get_inode (dir))))
+             && dir_add (dir, part, inode_sector));
+  if (!success && created)
+    {
+      /* Free the new directory's table along with its inode. */
+      struct inode *inode = inode_open (inode_sector);
+
+      if (inode != NULL)
+        {
+          inode_remove (inode);
+          inode_close (inode);
+          inode_sector = 0;
+        }
+    }
+  if (!success && inode_sector != 0) 
+    free_map_release (inode_sector, 1);
+  dir_close (dir);
+  journal_end ();
 
   return success;
 }
@@ -66,29 +135,223 @@ filesys_create (const char *name, off_t initial_size)
 struct file *
 filesys_open (const char *name)
 {
-  struct dir *dir = dir_open_root ();
+  char part[NAME_MAX + 1];
+  struct dir *dir = resolve (name, part);
   struct inode *inode = NULL;
 
   if (dir != NULL)
-    dir_lookup (dir, name, &inode);
+    dir_lookup (dir, part, &inode);
   dir_close (dir);
 
   return file_open (inode);
 }
 
+/* Creates a file named DST that is a clone of the file named SRC,
+   as by inode_clone(): it shares SRC's data until either file is
+   written.  Returns true if successful, false otherwise.  Fails
+   if no file named SRC exists, if it is a directory or memory
+   mapped, if a file named DST already exists, if the disk is
+   full, or if an internal memory allocation fails. */
+bool
+filesys_clone (const char *src, const char *dst)
+{
+  block_sector_t inode_sector = 0;
+  struct inode *src_inode = NULL, *dst_inode = NULL;
+  char part[NAME_MAX + 1];
+  struct dir *dir;
+  bool success;
+
+  dir = resolve (src, part);
+  if (dir != NULL)
+    dir_lookup (dir, part, &src_inode);
+  dir_close (dir);
+  if (src_inode == NULL)
+    return false;
+
+  /* DST only appears in its directory once it holds the data. */
+  journal_begin ();
+  dir = resolve (dst, part);
+  success = (dir != NULL
+             && allocate_inode (dir, false, &inode_sector)
+             && inode_create (inode_sector, 0, false)
+             && (dst_inode = inode_open (inode_sector)) != NULL
+             && inode_clone (dst_inode, src_inode)
+             && dir_add (dir, part, inode_sector));
+  if (!success && dst_inode != NULL)
+    inode_remove (dst_inode);
+  else if (!success && inode_sector != 0)
+    free_map_release (inode_sector, 1);
+  inode_close (dst_inode);
+  dir_close (dir);
+  journal_end ();
+
+  inode_close (src_inode);
+  return success;
+}
+
+/* Stores the attributes of the file named NAME in *ST, without
+   opening it.  Returns true if successful, false if no file named
+   NAME exists or an internal memory allocation fails. */
+bool
+filesys_stat (const char *name, struct stat *st)
+{
+  char part[NAME_MAX + 1];
+  struct dir *dir = resolve (name, part);
+  struct inode *inode = NULL;
+
+  if (dir != NULL)
+    dir_lookup (dir, part, &inode);
+  dir_close (dir);
+  if (inode == NULL)
+    return false;
+
+  inode_stat (inode, st);
+  inode_close (inode);
+  return true;
+}
+
 /* Deletes the file named NAME.
    Returns true if successful, false on failure.
-   Fails if no file named NAME exists,
-   or if an internal memory allocation fails. */
+   Fails if no file named NAME exists, if it is a directory that
+   is not empty, or if an internal memory allocation fails. */
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  char part[NAME_MAX + 1];
+  struct dir *dir;
+  bool success;
+
+  journal_begin ();
+  dir = resolve (name, part);
+  success = dir != NULL && dir_remove (dir, part);
   dir_close (dir); 
+  journal_end ();
 
   return success;
 }
+
+/* Makes the directory named NAME the current thread's working
+   directory.
+   Returns true if successful, false on failure.
+   Fails if no directory named NAME exists,
+   or if an internal memory allocation fails. */
+bool
+filesys_chdir (const char *name)
+{
+  struct thread *t = process_current ();
+  struct dir *old;
+  char part[NAME_MAX + 1];
+  struct dir *dir = resolve (name, part);
+  struct inode *inode = NULL;
+
+  if (dir != NULL)
+    dir_lookup (dir, part, &inode);
+  dir_close (dir);
+
+  if (inode == NULL || !inode_is_dir (inode))
+    {
+      inode_close (inode);
+      return false;
+    }
+  dir = dir_open (inode);
+  if (dir == NULL)
+    return false;
+
+  lock_acquire (&t->fds_lock);
+  old = t->cwd;
+  t->cwd = dir;
+  lock_release (&t->fds_lock);
+  dir_close (old);
+  return true;
+}
+
+/* Extracts a file name part from *SRCP into PART, and updates
+   *SRCP so that the next call will return the next file name
+   part.  Returns 1 if successful, 0 at end of string, -1 for a
+   too-long file name part. */
+static int
+get_next_part (char part[NAME_MAX + 1], const char **srcp)
+{
+  const char *src = *srcp;
+  char *dst = part;
+
+  /* Skip leading slashes.  If it's all slashes, we're done. */
+  while (*src == '/')
+    src++;
+  if (*src == '\0')
+    return 0;
+
+  /* Copy up to NAME_MAX character from SRC to DST.  Add null
+     terminator. */
+  while (*src != '/' && *src != '\0')
+    {
+      if (dst < part + NAME_MAX)
+        *dst++ = *src;
+      else
+        return -1;
+      src++;
+    }
+  *dst = '\0';
+
+  /* Advance source pointer. */
+  *srcp = src;
+  return 1;
+}
+
+/* Walks PATH, relative to the current thread's working directory
+   unless it starts with "/", down to its last part.  Copies the
+   last part into NAME, "." if PATH is all slashes, and returns
+   the directory that should contain it, which the caller must
+   close.  Returns a null pointer if PATH is empty or a directory
+   on the way does not exist. */
+static struct dir *
+resolve (const char *path, char name[NAME_MAX + 1])
+{
+  struct thread *t = process_current ();
+  struct dir *dir;
+  char next[NAME_MAX + 1];
+  int ok;
+
+  if (*path == '\0')
+    return NULL;
+  lock_acquire (&t->fds_lock);
+  if (*path == '/' || t->cwd == NULL)
+    dir = dir_open_root ();
+  else
+    dir = dir_reopen (t->cwd);
+  lock_release (&t->fds_lock);
+  if (dir == NULL)
+    return NULL;
+
+  ok = get_next_part (name, &path);
+  if (ok == 0)
+    strlcpy (name, ".", NAME_MAX + 1);
+  while (ok > 0)
+    {
+      struct inode *inode;
+
+      ok = get_next_part (next, &path);
+      if (ok == 0)
+        return dir;
+      if (ok < 0 || !dir_lookup (dir, name, &inode))
+        break;
+
+      dir_close (dir);
+      if (!inode_is_dir (inode))
+        {
+          inode_close (inode);
+          return NULL;
+        }
+      dir = dir_open (inode);
+      if (dir == NULL)
+        return NULL;
+      strlcpy (name, next, NAME_MAX + 1);
+    }
+  if (ok == 0)
+    return dir;
+  dir_close (dir);
+  return NULL;
+}
 
 /* Formats the file system. */
 static void
@@ -96,7 +359,7 @@ do_format (void)
 {
   printf ("Formatting file system...");
   free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR, 16))
+  if (!dir_create (ROOT_DIR_SECTOR, 16, ROOT_DIR_SECTOR))
     PANIC ("root directory creation failed");
   free_map_close ();
   printf ("done.\n");
@@ -4,9 +4,14 @@
 #include <stdbool.h>
 #include "filesys/off_t.h"
 
+struct stat;
+
 /* Sectors of system file inodes. */
 #define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
 #define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
+#define JOURNAL_SECTOR 2        /* Journal header sector. */
+#define SUPER_SECTOR 128        /* Superblock, just past the journal. */
+#define REFCOUNT_SECTOR 129     /* Sector sharing counts file inode sector. */
 
 /* Block device that contains the file system. */
 struct block *fs_device;
@@ -14,7 +19,11 @@ struct block *fs_device;
 void filesys_init (bool format);
 void filesys_done (void);
 bool filesys_create (const char *name, off_t initial_size);
+bool filesys_mkdir (const char *name);
 struct file *filesys_open (const char *name);
+bool filesys_stat (const char *name, struct stat *);
+bool filesys_clone (const char *src, const char *dst);
 bool filesys_remove (const char *name);
+bool filesys_chdir (const char *name);
 
 #endif /* filesys/filesys.h */
@@ -1,22 +1,390 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include "filesys/cache.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* The free map has a bit per sector of the file system device,
+   set for sectors in use, which it keeps in memory and writes
+   through to the free map file as it changes.
+
+   The device is divided into block groups of GROUP_SECTORS
+   sectors each, so that each group's part of the map is one
+   sector of the free map file.  The first GROUP_INODES sectors of
+   a group are its inode region, where the inodes of files in the
+   group go, and the rest is its data region, where their data
+   goes, so that a file's inode is a short seek from its
+   directory's and from its data.  A new file goes in the group of
+   its directory, and a new directory in the group with the most
+   free space, so that the disk fills evenly and each directory
+   has room to grow next to it.  A run of sectors never crosses a
+   group boundary.  Either region may be used for the other when
+   its group has no other space, and any group when the one asked
+   for is full.
+
+   Each group has a lock of its own, for its bits and its free
+   count, so that allocations in different groups do not wait for
+   each other.  free_map_lock protects only the totals and the
+   superblock.
+
+   A group's part of the free map file is only written once the
+   group is first used, so that formatting takes the same time
+   whatever the size of the disk.  The superblock records which
+   groups have been initialized that way; the others are all free
+   and their part of the file, whose sectors are allocated but
+   never written, is not read.
+
+   A data sector may also belong to more than one file, after
+   free_map_share(), which cloned files use to share their data
+   until one of them writes it.  The reference count file has a
+   byte per sector counting its owners beyond the first, and
+   free_map_release() only frees a sector once that count is 0,
+   taking one off it otherwise.  It is kept like the free map: in
+   memory, only for groups that have shared sectors, and written
+   through to the file, whose part for a group is first written
+   whole, as the superblock records. */
+
+/* Sectors in a block group: as many as one sector of the map
+   covers. */
+#define GROUP_SECTORS (BLOCK_SECTOR_SIZE * 8)
+
+/* Sectors at the start of each group set aside for inodes. */
+#define GROUP_INODES 256
+
+/* Identifies a superblock. */
+#define SUPER_MAGIC 0x53555053
+
+/* Superblock, in sector SUPER_SECTOR.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct superblock
+  {
+    unsigned magic;                  /* SUPER_MAGIC. */
+    uint32_t group_cnt;              /* Number of block groups. */
+    uint8_t initialized[(BLOCK_SECTOR_SIZE - 8) / 2]; /* Bit per
+                                        group, set once its part of
+                                        the free map file is
+                                        written. */
+    uint8_t shared[(BLOCK_SECTOR_SIZE - 8) / 2]; /* Bit per group,
+                                        set once its part of the
+                                        reference count file is
+                                        written. */
+  };
+
+/* Block groups that the superblock can mark uninitialized.  Any
+   beyond are initialized when the file system is formatted. */
+#define SUPER_GROUPS (sizeof ((struct superblock *) 0)->initialized * 8)
+
+/* A block group. */
+struct group
+  {
+    struct lock lock;                /* Protects the members below and
+                                        the group's bits in FREE_MAP. */
+    size_t free_cnt;                 /* Sectors free in the group. */
+    uint8_t *refs;                   /* Extra owners of each sector,
+                                        or null if none has any. */
+  };
+
+/* Where in a group to allocate. */
+enum region
+  {
+    REGION_INODES,                   /* Inode region. */
+    REGION_DATA,                     /* Data region. */
+    REGION_ANY                       /* Either. */
+  };
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static struct group *groups;         /* Block groups. */
+static size_t group_cnt;             /* Number of GROUPS. */
+static struct lock free_map_lock;    /* Protects the members below. */
+static size_t free_cnt;              /* Sectors free in FREE_MAP. */
+static size_t reserved_cnt;          /* Free sectors promised by
+                                        free_map_reserve(). */
+static struct superblock super;      /* Superblock. */
+static size_t shared_cnt;            /* Sum of the groups' REFS. */
+static struct file *refcount_file;   /* Reference count file. */
+
+static void count_free (void);
 
 /* Initializes the free map. */
 void
 free_map_init (void) 
 {
+  size_t i;
+
+  ASSERT (sizeof super == BLOCK_SECTOR_SIZE);
+  ASSERT (JOURNAL_SECTOR + JOURNAL_SECTORS <= SUPER_SECTOR);
+
+  if (block_size (fs_device) <= SUPER_SECTOR)
+    PANIC ("file system device is too small");
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
+  group_cnt = DIV_ROUND_UP (bitmap_size (free_map), GROUP_SECTORS);
+  groups = malloc (group_cnt * sizeof *groups);
+  if (groups == NULL)
+    PANIC ("block group allocation failed");
+  for (i = 0; i < group_cnt; i++)
+    {
+      lock_init_named (&groups[i].lock, "block group");
+      groups[i].refs = NULL;
+    }
+  lock_init_named (&free_map_lock, "free map");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_mark (free_map, SUPER_SECTOR);
+  bitmap_mark (free_map, REFCOUNT_SECTOR);
+
+  /* The journal's region, whether or not it is in use. */
+  if (JOURNAL_SECTOR + JOURNAL_SECTORS <= bitmap_size (free_map))
+    bitmap_set_multiple (free_map, JOURNAL_SECTOR, JOURNAL_SECTORS, true);
+  count_free ();
+}
+
+/* Sets the free counts from the bits of FREE_MAP. */
+static void
+count_free (void)
+{
+  size_t i;
+
+  free_cnt = 0;
+  for (i = 0; i < group_cnt; i++)
+    {
+      size_t start = i * GROUP_SECTORS;
+      size_t cnt = bitmap_size (free_map) - start;
+
+      if (cnt > GROUP_SECTORS)
+        cnt = GROUP_SECTORS;
+      groups[i].free_cnt = bitmap_count (free_map, start, cnt, false);
+      free_cnt += groups[i].free_cnt;
+    }
+}
+
+/* Returns the block group that SECTOR is in. */
+static size_t
+group_of (block_sector_t sector)
+{
+  return sector / GROUP_SECTORS;
+}
+
+/* Stores in *START and *END the bounds of REGION of group G. */
+static void
+region_bounds (size_t g, enum region region, size_t *start, size_t *end)
+{
+  size_t size = bitmap_size (free_map);
+  size_t first = g * GROUP_SECTORS;
+  size_t last = first + GROUP_SECTORS < size ? first + GROUP_SECTORS : size;
+  size_t data = first + GROUP_INODES < last ? first + GROUP_INODES : last;
+
+  *start = region == REGION_DATA ? data : first;
+  *end = region == REGION_INODES ? data : last;
+}
+
+/* Returns true if group G's part of the free map file has been
+   written. */
+static bool
+is_initialized (size_t g)
+{
+  return g >= SUPER_GROUPS || (super.initialized[g / 8] >> (g % 8)) & 1;
+}
+
+/* Writes the part of the free map file that holds the CNT bits
+   starting at SECTOR, all in group G, or the whole of G's part
+   if G has not been initialized, marking it initialized in the
+   superblock.  Does nothing while the free map file is being
+   created.  Returns true if successful, false on failure.  Caller
+   must hold G's lock. */
+static bool
+write_bits (size_t g, block_sector_t sector, size_t cnt)
+{
+  size_t start, end;
+  bool success;
+
+  if (free_map_file == NULL)
+    return true;
+  if (is_initialized (g))
+    return bitmap_write_range (free_map, free_map_file, sector, cnt);
+
+  /* The part of the file and the superblock change in one
+     transaction. */
+  region_bounds (g, REGION_ANY, &start, &end);
+  journal_begin ();
+  success = bitmap_write_range (free_map, free_map_file, start, end - start);
+  if (success)
+    {
+      lock_acquire (&free_map_lock);
+      super.initialized[g / 8] |= 1 << (g % 8);
+      cache_write_meta (SUPER_SECTOR, &super, 0, sizeof super);
+      lock_release (&free_map_lock);
+    }
+  journal_end ();
+  return success;
+}
+
+/* Returns true if group G's part of the reference count file has
+   been written. */
+static bool
+refs_written (size_t g)
+{
+  return g >= SUPER_GROUPS || (super.shared[g / 8] >> (g % 8)) & 1;
+}
+
+/* Writes the reference count of SECTOR, in group G, to the
+   reference count file, or the whole of G's part if it has not
+   been written before, marking it written in the superblock.
+   Returns true if successful, false on failure.  Caller must hold
+   G's lock. */
+static bool
+write_refs (size_t g, block_sector_t sector)
+{
+  size_t start, end;
+  bool success;
+
+  if (refs_written (g))
+    return file_write_at (refcount_file,
+                          groups[g].refs + sector % GROUP_SECTORS, 1,
+                          sector) == 1;
+
+  region_bounds (g, REGION_ANY, &start, &end);
+  journal_begin ();
+  success = (file_write_at (refcount_file, groups[g].refs, end - start, start)
+             == (off_t) (end - start));
+  if (success)
+    {
+      lock_acquire (&free_map_lock);
+      super.shared[g / 8] |= 1 << (g % 8);
+      cache_write_meta (SUPER_SECTOR, &super, 0, sizeof super);
+      lock_release (&free_map_lock);
+    }
+  journal_end ();
+  return success;
+}
+
+/* Adds COUNT, which may be negative, to SHARED_CNT. */
+static void
+count_shared (int count)
+{
+  lock_acquire (&free_map_lock);
+  shared_cnt += count;
+  lock_release (&free_map_lock);
+}
+
+/* Debits CNT sectors from the free count, and from the promises
+   made by free_map_reserve() if RESERVED is true.  Returns true
+   if successful, false if there are not CNT sectors free and, if
+   RESERVED is false, unpromised. */
+static bool
+debit (size_t cnt, bool reserved)
+{
+  bool success;
+
+  lock_acquire (&free_map_lock);
+  ASSERT (!reserved || reserved_cnt >= cnt);
+  success = reserved || free_cnt - reserved_cnt >= cnt;
+  if (success)
+    {
+      free_cnt -= cnt;
+      if (reserved)
+        reserved_cnt -= cnt;
+    }
+  lock_release (&free_map_lock);
+  return success;
+}
+
+/* Undoes debit (CNT, RESERVED). */
+static void
+credit (size_t cnt, bool reserved)
+{
+  lock_acquire (&free_map_lock);
+  free_cnt += cnt;
+  if (reserved)
+    reserved_cnt += cnt;
+  lock_release (&free_map_lock);
+}
+
+/* Finds CNT free sectors in REGION of group G, the first at or
+   after GOAL if GOAL is in the region and otherwise the first in
+   the region, marks them allocated, and writes the part of the
+   free map they are in to disk.  Returns the first sector, or
+   BITMAP_ERROR if there is no such run or the free map file could
+   not be written.  The caller has debited them already. */
+static block_sector_t
+allocate_in (size_t g, enum region region, size_t cnt, block_sector_t goal)
+{
+  struct group *group = &groups[g];
+  block_sector_t sector = BITMAP_ERROR;
+  size_t start, end;
+
+  region_bounds (g, region, &start, &end);
+  if (end - start < cnt)
+    return BITMAP_ERROR;
+
+  lock_acquire (&group->lock);
+  if (group->free_cnt >= cnt)
+    {
+      if (goal > start && goal < end)
+        sector = bitmap_scan_range (free_map, goal, end, cnt, false);
+      if (sector == BITMAP_ERROR)
+        sector = bitmap_scan_range (free_map, start, end, cnt, false);
+    }
+  if (sector != BITMAP_ERROR)
+    {
+      bitmap_set_multiple (free_map, sector, cnt, true);
+      if (!write_bits (g, sector, cnt))
+        {
+          bitmap_set_multiple (free_map, sector, cnt, false);
+          sector = BITMAP_ERROR;
+        }
+      else
+        group->free_cnt -= cnt;
+    }
+  lock_release (&group->lock);
+  return sector;
+}
+
+/* Allocates CNT consecutive free sectors, preferably in REGION of
+   group G near GOAL, as allocate_in() does, and otherwise in the
+   same region of the groups after G in turn, then anywhere in
+   them.  Sectors promised by free_map_reserve() are only handed
+   out if RESERVED is true, in which case CNT of the promises are
+   used up.  Returns the first sector, or BITMAP_ERROR on
+   failure. */
+static block_sector_t
+allocate (size_t cnt, size_t g, enum region region, block_sector_t goal,
+          bool reserved)
+{
+  block_sector_t sector = BITMAP_ERROR;
+  size_t i;
+
+  if (!debit (cnt, reserved))
+    return BITMAP_ERROR;
+  for (i = 0; i < group_cnt && sector == BITMAP_ERROR; i++)
+    sector = allocate_in ((g + i) % group_cnt, region, cnt, goal);
+  for (i = 0; i < group_cnt && sector == BITMAP_ERROR; i++)
+    sector = allocate_in ((g + i) % group_cnt, REGION_ANY, cnt, goal);
+  if (sector == BITMAP_ERROR)
+    credit (cnt, reserved);
+  return sector;
+}
+
+/* Allocates CNT consecutive sectors of data near GOAL, as
+   free_map_allocate_near() does, using up promises if RESERVED
+   is true.  Returns the first sector, or BITMAP_ERROR on
+   failure. */
+static block_sector_t
+allocate_near (size_t cnt, block_sector_t goal, bool reserved)
+{
+  if (goal >= bitmap_size (free_map))
+    goal = 0;
+  return allocate (cnt, group_of (goal), REGION_DATA, goal, reserved);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
@@ -27,26 +395,259 @@ free_map_init (void)
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  return free_map_allocate_near (cnt, 0, sectorp);
+}
+
+/* Like free_map_allocate(), but picks the first CNT free sectors
+   at or after GOAL in the data region of its block group, so that
+   related data stays close together on disk, falling back to the
+   other groups in turn if there are none. */
+bool
+free_map_allocate_near (size_t cnt, block_sector_t goal,
+                        block_sector_t *sectorp)
+{
+  block_sector_t sector = allocate_near (cnt, goal, false);
+
+  if (sector == BITMAP_ERROR)
+    return false;
+  *sectorp = sector;
+  return true;
+}
+
+/* Allocates a sector for the inode of a new file in the
+   directory whose inode is sector PARENT, and stores it in
+   *SECTORP: in the inode region of PARENT's block group, or, for
+   a directory if IS_DIR is true, of the group with the most free
+   sectors.  Returns true if successful, false if the disk is
+   full. */
+bool
+free_map_allocate_inode (block_sector_t parent, bool is_dir,
+                         block_sector_t *sectorp)
+{
+  size_t g = group_of (parent) < group_cnt ? group_of (parent) : 0;
+  block_sector_t sector;
+
+  if (is_dir)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      size_t best = g, i;
+
+      /* Counts change under us, but any group with room will do;
+         this is only a hint. */
+      for (i = 1; i < group_cnt; i++)
+        {
+          size_t cur = (g + i) % group_cnt;
+          if (groups[cur].free_cnt > groups[best].free_cnt)
+            best = cur;
+        }
+      g = best;
     }
-  if (sector != BITMAP_ERROR)
-    *sectorp = sector;
-  return sector != BITMAP_ERROR;
+  sector = allocate (1, g, REGION_INODES, parent, false);
+  if (sector == BITMAP_ERROR)
+    return false;
+  *sectorp = sector;
+  return true;
+}
+
+/* Returns where to put data that should go in the block group
+   SKIP groups after the one HOME is in, to spread a large file
+   over the disk so that it does not fill its directory's group:
+   GOAL if GOAL is in that group, and otherwise the start of the
+   group's data region. */
+block_sector_t
+free_map_spread_goal (block_sector_t home, size_t skip, block_sector_t goal)
+{
+  size_t g = (group_of (home) + skip) % group_cnt;
+  size_t start, end;
+
+  if (group_of (goal) == g)
+    return goal;
+  region_bounds (g, REGION_DATA, &start, &end);
+  return start;
+}
+
+/* Promises CNT sectors to a later free_map_allocate_reserved(),
+   without choosing them yet, so that other allocations cannot
+   take them meanwhile.  Returns true if successful, false if
+   fewer than CNT sectors are free and unpromised. */
+bool
+free_map_reserve (size_t cnt)
+{
+  bool success;
+
+  lock_acquire (&free_map_lock);
+  success = free_cnt - reserved_cnt >= cnt;
+  if (success)
+    reserved_cnt += cnt;
+  lock_release (&free_map_lock);
+  return success;
+}
+
+/* Takes back CNT sectors promised by free_map_reserve() that are
+   no longer needed. */
+void
+free_map_unreserve (size_t cnt)
+{
+  lock_acquire (&free_map_lock);
+  ASSERT (reserved_cnt >= cnt);
+  reserved_cnt -= cnt;
+  lock_release (&free_map_lock);
+}
+
+/* Like free_map_allocate_near(), but takes CNT sectors promised
+   by free_map_reserve(), so that it fails only if CNT consecutive
+   sectors cannot be found.  The promises are kept on failure. */
+bool
+free_map_allocate_reserved (size_t cnt, block_sector_t goal,
+                            block_sector_t *sectorp)
+{
+  block_sector_t sector = allocate_near (cnt, goal, true);
+
+  if (sector == BITMAP_ERROR)
+    return false;
+  *sectorp = sector;
+  return true;
 }
 
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
-  ASSERT (bitmap_all (free_map, sector, cnt));
-  bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  while (cnt > 0)
+    {
+      size_t g = group_of (sector);
+      struct group *group = &groups[g];
+      size_t n = GROUP_SECTORS - sector % GROUP_SECTORS;
+
+      if (n > cnt)
+        n = cnt;
+      lock_acquire (&group->lock);
+      ASSERT (bitmap_all (free_map, sector, n));
+      if (group->refs == NULL)
+        {
+          bitmap_set_multiple (free_map, sector, n, false);
+          group->free_cnt += n;
+          write_bits (g, sector, n);
+          lock_release (&group->lock);
+          credit (n, false);
+        }
+      else
+        {
+          /* Shared sectors only lose an owner. */
+          size_t freed = 0, unshared = 0, i;
+
+          for (i = 0; i < n; i++)
+            {
+              uint8_t *ref = &group->refs[(sector + i) % GROUP_SECTORS];
+
+              if (*ref > 0)
+                {
+                  --*ref;
+                  write_refs (g, sector + i);
+                  unshared++;
+                }
+              else
+                {
+                  bitmap_reset (free_map, sector + i);
+                  write_bits (g, sector + i, 1);
+                  freed++;
+                }
+            }
+          group->free_cnt += freed;
+          lock_release (&group->lock);
+          credit (freed, false);
+          if (unshared > 0)
+            count_shared (-(int) unshared);
+        }
+
+      sector += n;
+      cnt -= n;
+    }
+}
+
+/* Adds an owner to SECTOR, which is in use, so that it takes one
+   more free_map_release() to free it.  Returns true if successful,
+   false if SECTOR has as many owners as can be counted or memory
+   is not available. */
+bool
+free_map_share (block_sector_t sector)
+{
+  size_t g = group_of (sector);
+  struct group *group = &groups[g];
+  bool success = false;
+
+  lock_acquire (&group->lock);
+  ASSERT (bitmap_test (free_map, sector));
+  if (group->refs == NULL)
+    group->refs = calloc (GROUP_SECTORS, 1);
+  if (group->refs != NULL && group->refs[sector % GROUP_SECTORS] < UINT8_MAX)
+    {
+      uint8_t *ref = &group->refs[sector % GROUP_SECTORS];
+
+      ++*ref;
+      success = write_refs (g, sector);
+      if (!success)
+        --*ref;
+    }
+  lock_release (&group->lock);
+  if (success)
+    count_shared (1);
+  return success;
+}
+
+/* Returns true if SECTOR, which is in use, belongs to more than
+   one file.  Takes no lock, so that writes to the reference count
+   file may ask: a sector only becomes shared while its owner's
+   rwlock excludes writers to it. */
+bool
+free_map_is_shared (block_sector_t sector)
+{
+  const uint8_t *refs = groups[group_of (sector)].refs;
+
+  return shared_cnt > 0 && refs != NULL && refs[sector % GROUP_SECTORS] > 0;
+}
+
+/* Counts the runs of free sectors, which never cross a group
+   boundary: HIST[I] is incremented for each run of at least 2**I
+   sectors and fewer than 2**(I+1), except that HIST[CNT - 1] takes
+   every run at least that long.  Returns the length of the
+   longest run. */
+size_t
+free_map_extents (size_t hist[], size_t cnt)
+{
+  size_t g, longest = 0;
+
+  ASSERT (cnt > 0);
+
+  for (g = 0; g < group_cnt; g++)
+    {
+      size_t start = g * GROUP_SECTORS;
+      size_t end = start + GROUP_SECTORS;
+      size_t sector;
+
+      if (end > bitmap_size (free_map))
+        end = bitmap_size (free_map);
+      lock_acquire (&groups[g].lock);
+      for (sector = start; sector < end; )
+        {
+          size_t run = 0, bucket = 0;
+
+          while (sector + run < end && !bitmap_test (free_map, sector + run))
+            run++;
+          if (run == 0)
+            {
+              sector++;
+              continue;
+            }
+          while (bucket + 1 < cnt && run >> (bucket + 1) != 0)
+            bucket++;
+          hist[bucket]++;
+          if (run > longest)
+            longest = run;
+          sector += run;
+        }
+      lock_release (&groups[g].lock);
+    }
+  return longest;
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -56,30 +657,116 @@ free_map_open (void)
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_read (free_map, free_map_file))
-    PANIC ("can't read free map");
+  size_t i;
+
+  cache_read_meta (SUPER_SECTOR, &super, 0, sizeof super);
+  if (super.magic != SUPER_MAGIC || super.group_cnt != group_cnt)
+    PANIC ("bad superblock--file system needs formatting");
+  for (i = 0; i < group_cnt; i++)
+    if (is_initialized (i))
+      {
+        size_t start, end;
+
+        region_bounds (i, REGION_ANY, &start, &end);
+        if (!bitmap_read_range (free_map, free_map_file, start, end - start))
+          PANIC ("can't read free map");
+      }
+  count_free ();
+
+  /* Reference counts, kept only for groups with shared sectors. */
+  refcount_file = file_open (inode_open (REFCOUNT_SECTOR));
+  if (refcount_file == NULL)
+    PANIC ("can't open reference count file");
+  for (i = 0; i < group_cnt; i++)
+    if (refs_written (i))
+      {
+        struct group *group = &groups[i];
+        size_t start, end, j, sum = 0;
+
+        region_bounds (i, REGION_ANY, &start, &end);
+        group->refs = calloc (GROUP_SECTORS, 1);
+        if (group->refs == NULL
+            || file_read_at (refcount_file, group->refs, end - start, start)
+               != (off_t) (end - start))
+          PANIC ("can't read reference counts");
+        for (j = 0; j < end - start; j++)
+          sum += group->refs[j];
+        if (sum == 0)
+          {
+            free (group->refs);
+            group->refs = NULL;
+          }
+        shared_cnt += sum;
+      }
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void
 free_map_close (void) 
 {
+  file_close (refcount_file);
   file_close (free_map_file);
 }
 
-/* Creates a new free map file on disk and writes the free map to
-   it. */
+/* Creates a new free map file on disk and the superblock, and
+   writes the parts of the free map for the block groups in use.
+   The rest of the file is allocated but left unwritten. */
 void
 free_map_create (void) 
 {
+  struct file *file;
+  size_t i;
+
   /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), false))
     PANIC ("free map creation failed");
 
-  /* Write bitmap to file. */
-  free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
-  if (free_map_file == NULL)
-    PANIC ("can't open free map");
-  if (!bitmap_write (free_map, free_map_file))
-    PANIC ("can't write free map");
+  /* Allocate the file's sectors, changing the bitmap as it goes;
+     until that is done, free_map_file stays null so that the
+     allocations do not write the file themselves. */
+  file = file_open (inode_open (FREE_MAP_SECTOR));
+  if (file == NULL
+      || !inode_preallocate (file_get_inode (file), file_length (file)))
+    PANIC ("can't allocate free map");
+
+  /* Likewise the reference count file, a byte per sector. */
+  if (!inode_create (REFCOUNT_SECTOR, bitmap_size (free_map), false))
+    PANIC ("reference count file creation failed");
+  refcount_file = file_open (inode_open (REFCOUNT_SECTOR));
+  if (refcount_file == NULL
+      || !inode_preallocate (file_get_inode (refcount_file),
+                             file_length (refcount_file)))
+    PANIC ("can't allocate reference count file");
+  free_map_file = file;
+
+  /* Initialize the groups that have sectors in use: the file
+     system's own, and the free map file's. */
+  memset (&super, 0, sizeof super);
+  super.magic = SUPER_MAGIC;
+  super.group_cnt = group_cnt;
+  journal_begin ();
+  cache_write_meta (SUPER_SECTOR, &super, 0, sizeof super);
+  for (i = 0; i < group_cnt; i++)
+    {
+      size_t start, end;
+
+      region_bounds (i, REGION_ANY, &start, &end);
+      lock_acquire (&groups[i].lock);
+      if ((i >= SUPER_GROUPS || groups[i].free_cnt < end - start)
+          && !write_bits (i, start, end - start))
+        PANIC ("can't write free map");
+      lock_release (&groups[i].lock);
+
+      if (i >= SUPER_GROUPS)
+        {
+          uint8_t *zeros = calloc (end - start, 1);
+
+          if (zeros == NULL
+              || file_write_at (refcount_file, zeros, end - start, start)
+                 != (off_t) (end - start))
+            PANIC ("can't write reference counts");
+          free (zeros);
+        }
+    }
+  journal_end ();
 }
@@ -12,6 +12,19 @@ void free_map_open (void);
 void free_map_close (void);
 
 bool free_map_allocate (size_t, block_sector_t *);
+bool free_map_allocate_near (size_t, block_sector_t goal, block_sector_t *);
+bool free_map_reserve (size_t);
+void free_map_unreserve (size_t);
+bool free_map_allocate_reserved (size_t, block_sector_t goal,
+                                 block_sector_t *);
 void free_map_release (block_sector_t, size_t);
+bool free_map_share (block_sector_t);
+bool free_map_is_shared (block_sector_t);
+size_t free_map_extents (size_t hist[], size_t cnt);
+
+bool free_map_allocate_inode (block_sector_t parent, bool is_dir,
+                              block_sector_t *);
+block_sector_t free_map_spread_goal (block_sector_t home, size_t skip,
+                                     block_sector_t goal);
 
 #endif /* filesys/free-map.h */
@@ -1,16 +1,24 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <inttypes.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ustar.h>
+#include "devices/timer.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
-#include "threads/malloc.h"
+#include "filesys/free-map.h"
+#include "filesys/inode.h"
+#include "threads/arena.h"
 #include "threads/palloc.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
+static void print_throughput (unsigned long long bytes, int64_t ticks);
+
 /* List files in the root directory. */
 void
 fsutil_ls (char **argv UNUSED) 
@@ -36,13 +44,17 @@ fsutil_cat (char **argv)
   const char *file_name = argv[1];
   
   struct file *file;
+  size_t mark;
   char *buffer;
 
   printf ("Printing '%s' to the console...\n", file_name);
   file = filesys_open (file_name);
   if (file == NULL)
     PANIC ("%s: open failed", file_name);
-  buffer = palloc_get_page (PAL_ASSERT);
+  mark = arena_begin ();
+  buffer = arena_alloc (PGSIZE);
+  if (buffer == NULL)
+    PANIC ("couldn't allocate buffer");
   for (;;) 
     {
       off_t pos = file_tell (file);
@@ -52,7 +64,7 @@ fsutil_cat (char **argv)
 
       hex_dump (pos, buffer, n, true); 
     }
-  palloc_free_page (buffer);
+  arena_end (mark);
   file_close (file);
 }
 
@@ -67,19 +79,30 @@ fsutil_rm (char **argv)
     PANIC ("%s: delete failed\n", file_name);
 }
 
+/* Pages in fsutil_extract()'s data buffer. */
+#define EXTRACT_PAGES 16
+
 /* Extracts a ustar-format tar archive from the scratch block
-   device into the Pintos file system. */
+   device into the Pintos file system.  Each file's data is read
+   and written EXTRACT_PAGES pages at a time, so that the scratch
+   device sees large sequential reads and the file system large
+   writes. */
 void
 fsutil_extract (char **argv UNUSED) 
 {
   static block_sector_t sector = 0;
+  const size_t chunk_sectors = EXTRACT_PAGES * PGSIZE / BLOCK_SECTOR_SIZE;
 
   struct block *src;
   void *header, *data;
+  unsigned long long bytes = 0;
+  int64_t start;
+  size_t mark;
 
   /* Allocate buffers. */
-  header = malloc (BLOCK_SECTOR_SIZE);
-  data = malloc (BLOCK_SECTOR_SIZE);
+  mark = arena_begin ();
+  header = arena_alloc (BLOCK_SECTOR_SIZE);
+  data = palloc_get_multiple (0, EXTRACT_PAGES);
   if (header == NULL || data == NULL)
     PANIC ("couldn't allocate buffers");
 
@@ -91,6 +114,7 @@ fsutil_extract (char **argv UNUSED)
   printf ("Extracting ustar archive from scratch device "
           "into file system...\n");
 
+  start = timer_ticks ();
   for (;;)
     {
       const char *file_name;
@@ -117,7 +141,7 @@ fsutil_extract (char **argv UNUSED)
 
           printf ("Putting '%s' into the file system...\n", file_name);
 
-          /* Create destination file. */
+          /* Create destination file, with its final size. */
           if (!filesys_create (file_name, size))
             PANIC ("%s: create failed", file_name);
           dst = filesys_open (file_name);
@@ -125,22 +149,31 @@ fsutil_extract (char **argv UNUSED)
             PANIC ("%s: open failed", file_name);
 
           /* Do copy. */
+          bytes += size;
           while (size > 0)
             {
-              int chunk_size = (size > BLOCK_SECTOR_SIZE
-                                ? BLOCK_SECTOR_SIZE
-                                : size);
-              block_read (src, sector++, data);
+              size_t cnt = DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
+              int chunk_size;
+
+              if (cnt > chunk_sectors)
+                cnt = chunk_sectors;
+              chunk_size = cnt * BLOCK_SECTOR_SIZE;
+              if (chunk_size > size)
+                chunk_size = size;
+              block_read_multiple (src, sector, cnt, data);
+              sector += cnt;
               if (file_write (dst, data, chunk_size) != chunk_size)
                 PANIC ("%s: write failed with %d bytes unwritten",
                        file_name, size);
               size -= chunk_size;
+              thread_cond_yield ();
             }
 
           /* Finish up. */
           file_close (dst);
         }
     }
+  print_throughput (bytes, timer_elapsed (start));
 
   /* Erase the ustar header from the start of the block device,
      so that the extraction operation is idempotent.  We erase
@@ -151,8 +184,18 @@ fsutil_extract (char **argv UNUSED)
   block_write (src, 0, header);
   block_write (src, 1, header);
 
-  free (data);
-  free (header);
+  palloc_free_multiple (data, EXTRACT_PAGES);
+  arena_end (mark);
+}
+
+/* Reports that BYTES bytes were extracted in TICKS timer ticks. */
+static void
+print_throughput (unsigned long long bytes, int64_t ticks)
+{
+  printf ("Extracted %llu bytes in %"PRId64" ticks", bytes, ticks);
+  if (ticks > 0)
+    printf (" (%llu kB/s)", bytes * TIMER_FREQ / ticks / 1024);
+  printf (".\n");
 }
 
 /* Copies file FILE_NAME from the file system to the scratch
@@ -173,11 +216,13 @@ fsutil_append (char **argv)
   struct file *src;
   struct block *dst;
   off_t size;
+  size_t mark;
 
   printf ("Appending '%s' to ustar archive on scratch device...\n", file_name);
 
   /* Allocate buffer. */
-  buffer = malloc (BLOCK_SECTOR_SIZE);
+  mark = arena_begin ();
+  buffer = arena_alloc (BLOCK_SECTOR_SIZE);
   if (buffer == NULL)
     PANIC ("couldn't allocate buffer");
 
@@ -219,5 +264,131 @@ fsutil_append (char **argv)
 
   /* Finish up. */
   file_close (src);
-  free (buffer);
+  arena_end (mark);
+}
+
+/* Buckets of the free extent histogram printed by fsutil_frag(). */
+#define FRAG_BUCKETS 13
+
+/* Reports how fragmented the file system is: how many runs of
+   free sectors there are of each size, in powers of two, and how
+   many extents, runs of consecutive sectors, each file in the root
+   directory has. */
+void
+fsutil_frag (char **argv UNUSED)
+{
+  size_t hist[FRAG_BUCKETS];
+  char name[NAME_MAX + 1];
+  size_t longest, i;
+  struct dir *dir;
+
+  memset (hist, 0, sizeof hist);
+  longest = free_map_extents (hist, FRAG_BUCKETS);
+  printf ("Free extents (sectors: count):\n");
+  for (i = 0; i < FRAG_BUCKETS; i++)
+    if (hist[i] > 0)
+      printf ("  %5zu%s %zu\n", (size_t) 1 << i,
+              i + 1 < FRAG_BUCKETS ? "+:" : "++", hist[i]);
+  printf ("Longest free extent: %zu sectors.\n", longest);
+
+  printf ("Extents of files in the root directory:\n");
+  dir = dir_open_root ();
+  if (dir == NULL)
+    PANIC ("root dir open failed");
+  while (dir_readdir (dir, name))
+    {
+      struct file *file = filesys_open (name);
+
+      if (file == NULL)
+        continue;
+      printf ("  %s: %"PROTd" bytes in %zu extents\n", name,
+              file_length (file),
+              inode_extent_cnt (file_get_inode (file)));
+      file_close (file);
+    }
+  dir_close (dir);
+  printf ("End of listing.\n");
+}
+
+/* Relocates the sectors of each file in the root directory so
+   that it is in as few extents as the free space allows, moving
+   no more than RATE kB per second if RATE is nonzero.  Returns the
+   number of sectors moved. */
+static size_t
+defrag_root (unsigned rate)
+{
+  char name[NAME_MAX + 1];
+  size_t moved = 0;
+  struct dir *dir;
+
+  dir = dir_open_root ();
+  if (dir == NULL)
+    return 0;
+  while (dir_readdir (dir, name))
+    {
+      struct file *file = filesys_open (name);
+      struct inode *inode;
+      off_t ofs = 0;
+
+      if (file == NULL)
+        continue;
+      inode = file_get_inode (file);
+      while (ofs < inode_length (inode))
+        {
+          size_t chunk = 0;
+
+          ofs = inode_defrag (inode, ofs, &chunk);
+          moved += chunk;
+          if (rate > 0 && chunk > 0)
+            timer_sleep ((int64_t) chunk * BLOCK_SECTOR_SIZE * TIMER_FREQ
+                         / ((int64_t) rate * 1024) + 1);
+        }
+      file_close (file);
+    }
+  dir_close (dir);
+  return moved;
+}
+
+/* Defragments the files in the root directory, as fast as the
+   disk allows. */
+void
+fsutil_defrag (char **argv UNUSED)
+{
+  int64_t start = timer_ticks ();
+  size_t moved;
+
+  printf ("Defragmenting the root directory...\n");
+  moved = defrag_root (0);
+  printf ("Moved %zu sectors in %"PRId64" ticks.\n",
+          moved, timer_elapsed (start));
+}
+
+/* Background defragmentation thread, which moves no more than
+   RATE_ kB per second, so as to leave the disk to others. */
+static void
+defrag_thread (void *rate_)
+{
+  unsigned rate = (unsigned) rate_;
+  size_t moved;
+
+  block_set_class (BLOCK_CLASS_IDLE);
+  moved = defrag_root (rate);
+  printf ("Background defragmentation moved %zu sectors.\n", moved);
+}
+
+/* Starts defragmenting the files in the root directory in a
+   low-priority background thread, moving at most ARGV[1] kB per
+   second, and returns at once. */
+void
+fsutil_defrag_bg (char **argv)
+{
+  int rate = atoi (argv[1]);
+
+  if (rate <= 0)
+    PANIC ("defrag-bg: rate must be a positive number of kB/s");
+  printf ("Defragmenting the root directory at up to %d kB/s "
+          "in the background...\n", rate);
+  if (thread_create ("defrag", PRI_MIN, defrag_thread,
+                     (void *) rate) == TID_ERROR)
+    PANIC ("defrag-bg: thread creation failed");
 }
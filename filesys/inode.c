@@ -1,76 +1,863 @@
 #include "filesys/inode.h"
-#include <list.h>
+#include <atomic.h>
+#include <hash.h>
 #include <debug.h>
+#include <list.h>
 #include <round.h>
+#include <stat.h>
+#include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/percpu.h"
+#include "threads/shrinker.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Sector numbers in the inode itself, and in an index sector. */
+#define INODE_DIRECT 123
+#define INODE_PTRS (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+
+/* Largest number of data sectors in a file. */
+#define INODE_MAX_SECTORS \
+  (INODE_DIRECT + INODE_PTRS + INODE_PTRS * INODE_PTRS)
+
+/* Most delayed data sectors an inode may have. */
+#define INODE_PENDING_MAX 64
+
+/* Data sectors past the direct ones go to the next block group
+   every INODE_SPREAD sectors (1 MB), so that a large file is
+   spread over the disk rather than filling its directory's
+   group. */
+#define INODE_SPREAD 2048
+
+/* Largest file whose data fits in the inode itself. */
+#define INODE_INLINE_MAX \
+  ((INODE_DIRECT + 2) * sizeof (block_sector_t))
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   The first INODE_DIRECT data sectors are listed in DIRECT, the
+   next INODE_PTRS in the index sector INDIRECT, and the rest in
+   the index sectors listed in the index sector DOUBLY_INDIRECT.
+   Sector 0 holds the free map inode, so a sector number of 0
+   means none; index sectors start out all zeros.  Data sectors,
+   and the index sectors that list them, are only allocated when
+   first written, so parts of the file never written are holes
+   with no sectors, which read as zeros.
+
+   A file of at most INODE_INLINE_MAX bytes keeps its data in
+   INLINE_DATA instead, in place of the sector numbers, so that it
+   takes no sectors besides the inode and is read along with it.
+   Growing it past that moves the data to a sector of its own, and
+   the file keeps its sectors from then on. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
+    union
+      {
+        struct
+          {
+            block_sector_t direct[INODE_DIRECT]; /* Direct data sectors. */
+            block_sector_t indirect;    /* Index of data sectors. */
+            block_sector_t doubly_indirect; /* Index of index sectors. */
+          };
+        uint8_t inline_data[INODE_INLINE_MAX]; /* Data of a small file. */
+      };
     off_t length;                       /* File size in bytes. */
+    uint16_t is_dir;                    /* Nonzero for a directory. */
+    uint16_t is_inline;                 /* Data in INLINE_DATA? */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
   };
 
-/* Returns the number of sectors to allocate for an inode SIZE
-   bytes long. */
-static inline size_t
-bytes_to_sectors (off_t size)
-{
-  return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
-}
+/* The block map in the on-disk inode is read and written in the
+   buffer cache as an index sector's entries are: the direct
+   sectors are entries 0 through INODE_DIRECT - 1 of the inode's
+   sector, followed by these two. */
+#define INODE_INDIRECT_ENTRY INODE_DIRECT
+#define INODE_DOUBLY_INDIRECT_ENTRY (INODE_DIRECT + 1)
+STATIC_ASSERT (offsetof (struct inode_disk, indirect)
+               == INODE_INDIRECT_ENTRY * sizeof (block_sector_t));
+STATIC_ASSERT (offsetof (struct inode_disk, doubly_indirect)
+               == INODE_DOUBLY_INDIRECT_ENTRY * sizeof (block_sector_t));
+
+/* In-memory copy of an index sector. */
+struct index_copy
+  {
+    block_sector_t sector;              /* Sector copied, or 0 if none. */
+    block_sector_t *entries;            /* Its entries, or NULL. */
+  };
+
+/* In-memory inode.
+
+   Only the on-disk inode's length, type and index roots are kept
+   here.  The direct sectors and inline data stay in the inode's
+   sector in the buffer cache, where they are read and written in
+   place, so an open inode takes a fraction of a sector.
 
-/* In-memory inode. */
+   RWLOCK protects LENGTH, IS_INLINE, the index roots, REMOVED,
+   DENY_WRITE_CNT, META_DIRTY and the PAGES index.  Reads, and
+   writes that stay within the file, hold it for reading, so they
+   go on in parallel; the contents of each sector are protected
+   by its buffer cache entry.  Growing the file, and changing
+   REMOVED or DENY_WRITE_CNT, hold it for writing.  INDEX_LOCK
+   protects the index copies, which readers update, and VERSION.
+   LOCK is not used by the inode layer: it is for inode_lock()
+   callers, which use it to make several operations atomic.
+
+   Data sectors that an extending write adds past the end of the
+   file are not allocated right away but delayed: they are written
+   to the buffer cache under made-up numbers, and reserved in the
+   free map, until inode_allocate_delayed() allocates consecutive
+   sectors for all of them at once.  An inode's delayed sectors are
+   always the PEND_CNT sectors starting at sector PEND_FIRST of the
+   file, which the index on disk lists as holes meanwhile.
+
+   The pages of a memory-mapped file are held in frames of the
+   mappings, which add them to PAGES, indexed by offset, so that
+   reads take the data from there rather than from a second copy
+   in the buffer cache, and writes go to both, so that the mappings
+   see them.  Whatever is written through a mapping reaches the
+   cache when its frame leaves the index.
+
+   A clone shares its data sectors with the file it was cloned
+   from, as the free map's reference counts record, until a write
+   to either gives the writer a copy of the sector of its own.
+   Cloning holds the source's RWLOCK for writing, so a sector only
+   becomes shared while no write to it is under way.
+
+   Appends reserve the range at the end of the file they write
+   under APPEND_LOCK, which protects the members after it, and
+   copy their data under RWLOCK for reading, in parallel.  See
+   inode_append().
+
+   Locks are taken in the order LOCK, APPEND_LOCK, RWLOCK,
+   delayed_lock, INDEX_LOCK, copies_lock, and then the free map's
+   locks and buffer cache entry locks. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in open_inodes. */
     block_sector_t sector;              /* Sector number of disk location. */
-    int open_cnt;                       /* Number of openers. */
+    atomic_t open_cnt;                  /* Number of openers. */
+    struct lock lock;                   /* For inode_lock(). */
+    struct lock append_lock;            /* Protects the members below. */
+    struct condition appended;          /* Signaled as APPEND_TURN moves. */
+    off_t append_end;                   /* End of the ranges reserved. */
+    unsigned append_next;               /* Ticket of the next append. */
+    unsigned append_turn;               /* Ticket that may grow LENGTH. */
+    struct rwlock rwlock;               /* Protects the members below. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
-    struct inode_disk data;             /* Inode content. */
+    bool meta_dirty;                    /* Metadata changed since synced? */
+    off_t length;                       /* File size in bytes. */
+    bool is_dir;                        /* True for a directory. */
+    bool is_inline;                     /* Data in the on-disk inode? */
+    block_sector_t indirect_sector;     /* Index of data sectors. */
+    block_sector_t doubly_indirect_sector; /* Index of index sectors. */
+    block_sector_t *pending;            /* Numbers of delayed sectors. */
+    size_t pend_first, pend_cnt;        /* Range of delayed sectors. */
+    struct list_elem pend_elem;         /* In delayed_inodes if any. */
+    struct hash *pages;                 /* Pages in memory, or NULL. */
+    size_t page_cnt;                    /* Number of PAGES. */
+
+    /* Copies of the index sectors last used to find a data
+       sector, so that finding the next one needs no cache
+       lookups. */
+    struct lock index_lock;             /* Protects the members below. */
+    struct index_copy indirect;         /* The indirect index. */
+    struct index_copy doubly_indirect;  /* The doubly-indirect index. */
+    struct index_copy leaf;             /* One of the indexes it lists. */
+    unsigned version;                   /* Bumped by every write. */
+
+    /* Protected by copies_lock. */
+    bool has_copies;                    /* In copy_inodes? */
+    struct list_elem copy_elem;         /* Element in copy_inodes. */
+  };
+
+/* Returns entry IDX of index sector SECTOR. */
+static block_sector_t
+read_index (block_sector_t sector, size_t idx)
+{
+  block_sector_t entry;
+
+  cache_read_meta (sector, &entry, idx * sizeof entry, sizeof entry);
+  return entry;
+}
+
+/* Sets entry IDX of index sector SECTOR to ENTRY. */
+static void
+write_index (block_sector_t sector, size_t idx, block_sector_t entry)
+{
+  cache_write_meta (sector, &entry, idx * sizeof entry, sizeof entry);
+}
+
+/* Reads SIZE bytes at offset OFS of INODE's on-disk inode into
+   DST. */
+static void
+read_disk (const struct inode *inode, size_t ofs, void *dst, size_t size)
+{
+  cache_read_meta (inode->sector, dst, ofs, size);
+}
+
+/* Writes SIZE bytes from SRC at offset OFS of INODE's on-disk
+   inode. */
+static void
+write_disk (struct inode *inode, size_t ofs, const void *src, size_t size)
+{
+  cache_write_meta (inode->sector, src, ofs, size);
+}
+
+/* Inodes with index copies, and how many copies they have in
+   all, for the shrinker, which frees the copies of inodes that it
+   finds idle.  copies_lock is taken after an inode's INDEX_LOCK,
+   or before it by the shrinker, which only tries for it. */
+static struct list copy_inodes;
+static size_t copy_cnt;
+static struct lock copies_lock;
+
+static size_t copies_count (void);
+static size_t copies_scan (size_t nr);
+
+static struct shrinker copies_shrinker =
+  {
+    .name = "inode index copies",
+    .count = copies_count,
+    .scan = copies_scan,
   };
 
+/* Returns entry IDX of index sector SECTOR, making COPY, one of
+   INODE's, a copy of SECTOR first if it is not already.  If that
+   runs out of memory, reads the entry from the cache instead.
+   Caller must hold INODE's index_lock. */
+static block_sector_t
+lookup_index (struct inode *inode, struct index_copy *copy,
+              block_sector_t sector, size_t idx)
+{
+  if (copy->sector != sector)
+    {
+      if (copy->entries == NULL)
+        {
+          copy->entries = malloc (BLOCK_SECTOR_SIZE);
+          if (copy->entries == NULL)
+            return read_index (sector, idx);
+
+          lock_acquire (&copies_lock);
+          copy_cnt++;
+          if (!inode->has_copies)
+            {
+              list_push_back (&copy_inodes, &inode->copy_elem);
+              inode->has_copies = true;
+            }
+          lock_release (&copies_lock);
+        }
+      cache_read_meta (sector, copy->entries, 0, BLOCK_SECTOR_SIZE);
+      copy->sector = sector;
+    }
+  return copy->entries[idx];
+}
+
+/* Returns the block device sector that holds data sector IDX of
+   INODE, or 0 if that sector is a hole.  IDX may lie past the end
+   of the file, whose sectors are all holes.  Caller must hold
+   INODE's rwlock. */
+static block_sector_t
+lookup_sector (struct inode *inode, size_t idx)
+{
+  block_sector_t sector = 0;
+
+  ASSERT (idx < INODE_MAX_SECTORS);
+  if (idx - inode->pend_first < inode->pend_cnt)
+    return inode->pending[idx - inode->pend_first];
+  if (idx < INODE_DIRECT)
+    return read_index (inode->sector, idx);
+  idx -= INODE_DIRECT;
+
+  lock_acquire (&inode->index_lock);
+  if (idx < INODE_PTRS)
+    {
+      if (inode->indirect_sector != 0)
+        sector = lookup_index (inode, &inode->indirect,
+                               inode->indirect_sector, idx);
+    }
+  else if (inode->doubly_indirect_sector != 0)
+    {
+      block_sector_t index;
+
+      idx -= INODE_PTRS;
+      index = lookup_index (inode, &inode->doubly_indirect,
+                            inode->doubly_indirect_sector,
+                            idx / INODE_PTRS);
+      if (index != 0)
+        sector = lookup_index (inode, &inode->leaf, index,
+                               idx % INODE_PTRS);
+    }
+  lock_release (&inode->index_lock);
+  return sector;
+}
+
 /* Returns the block device sector that contains byte offset POS
-   within INODE.
+   within INODE, or 0 if POS lies in a hole.
    Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   POS.  Caller must hold INODE's rwlock. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+byte_to_sector (struct inode *inode, off_t pos) 
 {
   ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
-  else
+  if (pos >= inode->length)
     return -1;
+  return lookup_sector (inode, pos / BLOCK_SECTOR_SIZE);
+}
+
+/* Returns true if any of the SIZE bytes of INODE starting at
+   OFFSET lie in a hole, as all past the end of the file do, or in
+   a data sector shared with another file, so that writing them
+   needs a new sector.  Caller must hold INODE's rwlock. */
+static bool
+needs_sector (struct inode *inode, off_t offset, off_t size)
+{
+  size_t idx;
+
+  for (idx = offset / BLOCK_SECTOR_SIZE;
+       idx <= (size_t) (offset + size - 1) / BLOCK_SECTOR_SIZE; idx++)
+    {
+      block_sector_t sector = lookup_sector (inode, idx);
+
+      if (sector == 0
+          || (sector < CACHE_DELAYED && free_map_is_shared (sector)))
+        return true;
+    }
+  return false;
+}
+
+/* Frees INODE's index copies, if any, and takes it off
+   copy_inodes.  Returns the number freed.  Caller must hold
+   INODE's index_lock and copies_lock. */
+static size_t
+free_copies (struct inode *inode)
+{
+  struct index_copy *copies[] = { &inode->indirect, &inode->doubly_indirect,
+                                  &inode->leaf };
+  size_t freed = 0, i;
+
+  for (i = 0; i < sizeof copies / sizeof *copies; i++)
+    if (copies[i]->entries != NULL)
+      {
+        free (copies[i]->entries);
+        copies[i]->entries = NULL;
+        copies[i]->sector = 0;
+        freed++;
+      }
+  copy_cnt -= freed;
+  if (inode->has_copies)
+    {
+      list_remove (&inode->copy_elem);
+      inode->has_copies = false;
+    }
+  return freed;
+}
+
+/* Returns the number of index copies, for the shrinker. */
+static size_t
+copies_count (void)
+{
+  return copy_cnt;
+}
+
+/* Frees the index copies of inodes whose index_lock is free,
+   oldest first, until NR or more have been freed.  Returns the
+   number freed. */
+static size_t
+copies_scan (size_t nr)
+{
+  struct list_elem *e, *next;
+  size_t freed = 0;
+
+  if (lock_held_by_current_thread (&copies_lock)
+      || !lock_try_acquire (&copies_lock))
+    return 0;
+  for (e = list_begin (&copy_inodes); e != list_end (&copy_inodes)
+         && freed < nr; e = next)
+    {
+      struct inode *inode = list_entry (e, struct inode, copy_elem);
+
+      next = list_next (e);
+      if (lock_held_by_current_thread (&inode->index_lock)
+          || !lock_try_acquire (&inode->index_lock))
+        continue;
+      freed += free_copies (inode);
+      lock_release (&inode->index_lock);
+    }
+  lock_release (&copies_lock);
+  return freed;
+}
+
+/* Forgets INODE's copies of its index sectors, after they have
+   changed.  Caller must hold INODE's rwlock for writing, so that
+   no reader is using them. */
+static void
+forget_indexes (struct inode *inode)
+{
+  inode->indirect.sector = 0;
+  inode->doubly_indirect.sector = 0;
+  inode->leaf.sector = 0;
+}
+
+/* A sector's worth of zeros. */
+static char zeros[BLOCK_SECTOR_SIZE];
+
+/* Allocates a sector as close after *GOAL as possible, stores
+   its number in *SECTOR and advances *GOAL past it.  Zeroes the
+   sector if ZERO is true; otherwise the caller is about to
+   overwrite all of it.  Returns true if successful, false if the
+   disk is full. */
+static bool
+allocate_sector (block_sector_t *sector, block_sector_t *goal, bool zero)
+{
+  if (!free_map_allocate_near (1, *goal, sector))
+    return false;
+  if (zero)
+    cache_write (*sector, zeros, 0, BLOCK_SECTOR_SIZE);
+  *goal = *sector + 1;
+  return true;
+}
+
+/* Returns where to place data sector IDX of INODE, which would
+   otherwise go after GOAL: in the block group that IDX's part of
+   the file is spread to. */
+static block_sector_t
+spread_goal (struct inode *inode, size_t idx, block_sector_t goal)
+{
+  if (idx < INODE_DIRECT)
+    return goal;
+  return free_map_spread_goal (inode->sector,
+                               (idx - INODE_DIRECT) / INODE_SPREAD + 1,
+                               goal);
+}
+
+/* Allocates an index sector, zeroed, as allocate_sector() does. */
+static bool
+allocate_index (block_sector_t *sector, block_sector_t *goal)
+{
+  if (!allocate_sector (sector, goal, false))
+    return false;
+  cache_write_meta (*sector, zeros, 0, BLOCK_SECTOR_SIZE);
+  return true;
+}
+
+/* Allocates data sector IDX, a hole, of INODE, along with the
+   index sectors that it needs, and stores its number in *SECTOR.
+   The data sector is zeroed if ZERO is true, as by
+   allocate_sector().  If *SECTOR is nonzero, it is a sector
+   already allocated, which is used instead.  Returns true if
+   successful, false if the disk is full.  Index sectors allocated
+   on failure stay in INODE, to be released with the rest.  New
+   sectors are placed after *GOAL if possible, as by
+   allocate_sector().  Caller must hold INODE's rwlock for
+   writing. */
+static bool
+fill_hole (struct inode *inode, size_t idx, bool zero,
+           block_sector_t *goal, block_sector_t *sector)
+{
+  block_sector_t index;
+
+  ASSERT (idx < INODE_MAX_SECTORS);
+
+  /* Find the index sector where the new sector number goes: the
+     inode's own for a direct sector. */
+  if (idx < INODE_DIRECT)
+    index = inode->sector;
+  else if (idx - INODE_DIRECT < INODE_PTRS)
+    {
+      idx -= INODE_DIRECT;
+      if (inode->indirect_sector == 0)
+        {
+          if (!allocate_index (&inode->indirect_sector, goal))
+            return false;
+          write_index (inode->sector, INODE_INDIRECT_ENTRY,
+                       inode->indirect_sector);
+        }
+      index = inode->indirect_sector;
+    }
+  else
+    {
+      idx -= INODE_DIRECT + INODE_PTRS;
+      if (inode->doubly_indirect_sector == 0)
+        {
+          if (!allocate_index (&inode->doubly_indirect_sector, goal))
+            return false;
+          write_index (inode->sector, INODE_DOUBLY_INDIRECT_ENTRY,
+                       inode->doubly_indirect_sector);
+        }
+      index = read_index (inode->doubly_indirect_sector, idx / INODE_PTRS);
+      if (index == 0)
+        {
+          if (!allocate_index (&index, goal))
+            return false;
+          write_index (inode->doubly_indirect_sector, idx / INODE_PTRS,
+                       index);
+        }
+      idx %= INODE_PTRS;
+    }
+
+  if (*sector == 0 && !allocate_sector (sector, goal, zero))
+    return false;
+  write_index (index, idx, *sector);
+  return true;
+}
+
+/* Copies the data of sector SRC to sector DST through the buffer
+   cache.  Returns false if memory is not available. */
+static bool
+copy_sector (block_sector_t dst, block_sector_t src)
+{
+  void *buffer = malloc (BLOCK_SECTOR_SIZE);
+
+  if (buffer == NULL)
+    return false;
+  cache_read (src, buffer, 0, BLOCK_SECTOR_SIZE);
+  cache_write (dst, buffer, 0, BLOCK_SECTOR_SIZE);
+  free (buffer);
+  return true;
+}
+
+/* Gives data sector IDX of INODE, sector OLD, which is shared
+   with another file, a sector of its own, placed as by
+   allocate_sector(), holding a copy of OLD's data unless COVERED
+   is true because the caller is about to overwrite all of it.
+   OLD loses INODE as an owner.  Returns the new sector, or 0 if
+   the disk is full or memory is not available.  Caller must hold
+   INODE's rwlock for writing. */
+static block_sector_t
+unshare_sector (struct inode *inode, size_t idx, block_sector_t old,
+                bool covered, block_sector_t *goal)
+{
+  block_sector_t sector = 0;
+
+  if (!allocate_sector (&sector, goal, false))
+    return 0;
+  if (!covered && !copy_sector (sector, old))
+    {
+      free_map_release (sector, 1);
+      return 0;
+    }
+  if (!fill_hole (inode, idx, false, goal, &sector))
+    NOT_REACHED ();
+  free_map_release (old, 1);
+  return sector;
+}
+
+/* Releases SECTOR and, if it is an index sector LEVELS levels
+   above the data, every sector listed in it, recursively. */
+static void
+release_tree (block_sector_t sector, int levels)
+{
+  if (sector == 0)
+    return;
+  if (levels > 0)
+    {
+      size_t i;
+
+      for (i = 0; i < INODE_PTRS; i++)
+        release_tree (read_index (sector, i), levels - 1);
+      thread_cond_yield ();
+    }
+  free_map_release (sector, 1);
+}
+
+/* Releases every data and index sector of INODE, but not the
+   inode's own sector, from which the direct sectors are read. */
+static void
+release_sectors (struct inode *inode)
+{
+  size_t i;
+
+  if (inode->is_inline)
+    return;
+  for (i = 0; i < INODE_DIRECT; i++)
+    release_tree (read_index (inode->sector, i), 0);
+  release_tree (inode->indirect_sector, 1);
+  release_tree (inode->doubly_indirect_sector, 2);
+}
+
+/* Moves the data of INODE, which is inline, to a data sector of
+   its own, allocated as by allocate_sector(), so that the file can
+   grow past INODE_INLINE_MAX bytes.  The sector is written as
+   metadata if META is true.  Returns true if successful, false if
+   the disk is full or memory is not available.  Caller must hold
+   INODE's rwlock for writing. */
+static bool
+move_inline (struct inode *inode, bool meta, block_sector_t *goal)
+{
+  block_sector_t sector = 0;
+  uint16_t is_inline = false;
+
+  ASSERT (inode->is_inline);
+  if (inode->length > 0)
+    {
+      uint8_t *data = malloc (inode->length);
+
+      if (data == NULL)
+        return false;
+      if (!allocate_sector (&sector, goal, true))
+        {
+          free (data);
+          return false;
+        }
+      read_disk (inode, offsetof (struct inode_disk, inline_data), data,
+                 inode->length);
+      if (meta)
+        cache_write_meta (sector, data, 0, inode->length);
+      else
+        cache_write (sector, data, 0, inode->length);
+      free (data);
+    }
+  write_disk (inode, offsetof (struct inode_disk, inline_data), zeros,
+              INODE_INLINE_MAX);
+  write_index (inode->sector, 0, sector);
+  write_disk (inode, offsetof (struct inode_disk, is_inline), &is_inline,
+              sizeof is_inline);
+  inode->is_inline = false;
+  forget_indexes (inode);
+  return true;
+}
+
+/* Inodes with delayed sectors, and how many there are in all,
+   at most half the buffer cache, whose entries they hold on to.
+   Delayed sectors are numbered from CACHE_DELAYED up, in turn; a
+   number is only reused after 2**31 others, long after the
+   flusher has given its sector a real one. */
+static struct list delayed_inodes;
+static size_t delayed_cnt;
+static block_sector_t next_delayed = CACHE_DELAYED;
+static struct lock delayed_lock;
+
+/* Statistics. */
+static unsigned long long delayed_total, delayed_runs;
+
+/* Makes data sector IDX of INODE, a hole past the end of the
+   file, a delayed sector, and stores its made-up number in
+   *SECTOR.  It is zeroed if ZERO is true, as by allocate_sector().
+   Returns true if successful, false if the sector should be
+   allocated right away instead because IDX does not follow
+   INODE's other delayed sectors or there are too many of them.
+   Caller must hold INODE's rwlock for writing. */
+static bool
+delay_sector (struct inode *inode, size_t idx, bool zero,
+              block_sector_t *sector)
+{
+  size_t sector_cnt = DIV_ROUND_UP (inode_length (inode), BLOCK_SECTOR_SIZE);
+
+  if (idx < sector_cnt
+      || (inode->pend_cnt > 0 && idx != inode->pend_first + inode->pend_cnt)
+      || inode->pend_cnt >= INODE_PENDING_MAX)
+    return false;
+  if (inode->pending == NULL)
+    {
+      inode->pending = malloc (INODE_PENDING_MAX * sizeof *inode->pending);
+      if (inode->pending == NULL)
+        return false;
+    }
+
+  lock_acquire (&delayed_lock);
+  if (delayed_cnt >= cache_size / 2 || !free_map_reserve (1))
+    {
+      lock_release (&delayed_lock);
+      return false;
+    }
+  delayed_cnt++;
+  delayed_total++;
+  *sector = next_delayed++;
+  if (next_delayed == 0)
+    next_delayed = CACHE_DELAYED;
+  if (inode->pend_cnt == 0)
+    {
+      inode->pend_first = idx;
+      list_push_back (&delayed_inodes, &inode->pend_elem);
+    }
+  lock_release (&delayed_lock);
+
+  inode->pending[inode->pend_cnt++] = *sector;
+  if (zero)
+    cache_write (*sector, zeros, 0, BLOCK_SECTOR_SIZE);
+  return true;
+}
+
+/* Stops INODE's PEND_CNT delayed sectors from being delayed,
+   which have either been allocated or been discarded, and takes
+   INODE off delayed_inodes.  Caller must hold INODE's rwlock for
+   writing. */
+static void
+end_delay (struct inode *inode)
+{
+  lock_acquire (&delayed_lock);
+  delayed_cnt -= inode->pend_cnt;
+  list_remove (&inode->pend_elem);
+  lock_release (&delayed_lock);
+  inode->pend_cnt = 0;
+}
+
+/* Allocates sectors for INODE's delayed sectors, consecutive ones
+   near the sector before them if possible, and moves their data
+   there.  A delayed sector whose index sectors cannot be
+   allocated becomes a hole, and its data is lost, as if the write
+   had found the disk full.  Caller must hold INODE's rwlock for
+   writing, between journal_begin() and journal_end(). */
+static void
+allocate_pending (struct inode *inode)
+{
+  size_t cnt = inode->pend_cnt, i;
+  block_sector_t goal = inode->sector + 1, start = 0, prev;
+  bool consecutive;
+
+  if (cnt == 0)
+    return;
+  if (inode->pend_first > 0
+      && (prev = lookup_sector (inode, inode->pend_first - 1)) != 0)
+    goal = prev + 1;
+  goal = spread_goal (inode, inode->pend_first, goal);
+
+  /* One allocation for the whole run, or one per sector if there
+     is no run long enough; the reservation covers the sectors
+     either way. */
+  consecutive = free_map_allocate_reserved (cnt, goal, &start);
+  if (consecutive)
+    delayed_runs++;
+  for (i = 0; i < cnt; i++)
+    {
+      block_sector_t sector = start + i;
+
+      if (!consecutive && !free_map_allocate_reserved (1, goal, &sector))
+        NOT_REACHED ();
+      cache_move (inode->pending[i], sector);
+      goal = sector + 1;
+      if (!fill_hole (inode, inode->pend_first + i, false, &goal, &sector))
+        free_map_release (sector, 1);
+    }
+  end_delay (inode);
+  forget_indexes (inode);
+  inode->meta_dirty = true;
+}
+
+/* Forgets INODE's delayed sectors and their data, for a file
+   being deleted.  Caller must hold INODE's rwlock for writing. */
+static void
+discard_pending (struct inode *inode)
+{
+  size_t i;
+
+  if (inode->pend_cnt == 0)
+    return;
+  for (i = 0; i < inode->pend_cnt; i++)
+    cache_discard (inode->pending[i]);
+  free_map_unreserve (inode->pend_cnt);
+  end_delay (inode);
+}
+
+/**
+ * inode_allocate_delayed - allocate every open file's delayed sectors
+ *
+ * Called by cache_flush() before it writes back the cache, so that
+ * the data of delayed sectors is written too, and at shutdown.
+ * Does nothing when called within a file system operation, as
+ * from journal_begin(), which cannot wait for inodes' rwlocks.
+*/
+void inode_allocate_delayed(void)
+{
+	if (thread_current()->journal_depth > 0)
+		return;
+
+	for (;;) {
+		struct inode *inode = NULL;
+		struct list_elem *e;
+
+		/* An inode being closed for the last time allocates its
+		   own delayed sectors. */
+		lock_acquire(&delayed_lock);
+		for (e = list_begin(&delayed_inodes);
+		     e != list_end(&delayed_inodes); e = list_next(e)) {
+			inode = list_entry(e, struct inode, pend_elem);
+			if (atomic_add_unless(&inode->open_cnt, 1, 0))
+				break;
+			inode = NULL;
+		}
+		lock_release(&delayed_lock);
+		if (inode == NULL)
+			break;
+
+		journal_begin();
+		rwlock_acquire_write(&inode->rwlock);
+		allocate_pending(inode);
+		rwlock_release_write(&inode->rwlock);
+		journal_end();
+		inode_close(inode);
+	}
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Open inodes, hashed by sector, so that opening a single inode
+   twice returns the same `struct inode'.  Opens of inodes already
+   open only read the table, so they go on in parallel. */
+static struct hash open_inodes;
+static struct rwlock open_inodes_lock;
+
+/* Statistics.  Misses are counted under open_inodes_lock. */
+static struct percpu_counter open_hit_cnt;
+static unsigned long long open_miss_cnt;
+
+/* Cache of `struct inode's. */
+static struct kmem_cache *inode_cache;
+
+static hash_hash_func inode_hash;
+static hash_less_func inode_less;
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  if (!hash_init (&open_inodes, inode_hash, inode_less, NULL))
+    PANIC ("open inode table creation failed");
+  rwlock_init (&open_inodes_lock);
+  list_init (&delayed_inodes);
+  lock_init_named (&delayed_lock, "delayed sectors");
+  list_init (&copy_inodes);
+  lock_init_named (&copies_lock, "inode index copies");
+  shrinker_register (&copies_shrinker);
+  inode_cache = kmem_cache_create ("inode", sizeof (struct inode), NULL);
+  if (inode_cache == NULL)
+    PANIC ("inode cache creation failed");
+}
+
+/* Returns the open inode for SECTOR, reopened, or a null pointer
+   if it is not open.  Caller must hold open_inodes_lock. */
+static struct inode *
+find_open (block_sector_t sector)
+{
+  struct inode key;
+  struct hash_elem *e;
+
+  key.sector = sector;
+  e = hash_find (&open_inodes, &key.elem);
+  if (e == NULL)
+    return NULL;
+  return inode_reopen (hash_entry (e, struct inode, elem));
 }
 
-/* Initializes an inode with LENGTH bytes of data and
-   writes the new inode to sector SECTOR on the file system
-   device.
+/* Initializes an inode with LENGTH bytes of data, for a
+   directory if IS_DIR is true, and writes the new inode to sector
+   SECTOR on the file system device.  The data starts out as one
+   hole, or as zeros in the inode if it fits there, so no data
+   sectors are allocated or written.
    Returns true if successful.
-   Returns false if memory or disk allocation fails. */
+   Returns false if memory allocation fails. */
 bool
-inode_create (block_sector_t sector, off_t length)
+inode_create (block_sector_t sector, off_t length, bool is_dir)
 {
   struct inode_disk *disk_inode = NULL;
   bool success = false;
@@ -84,24 +871,140 @@ inode_create (block_sector_t sector, off_t length)
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
+      disk_inode->is_dir = is_dir;
+      disk_inode->is_inline = length <= (off_t) INODE_INLINE_MAX;
+      journal_begin ();
+      cache_write_meta (sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
+      journal_end ();
+      success = true; 
+      free (disk_inode);
+    }
+  return success;
+}
+
+/* Allocates sectors for the holes in the first LENGTH bytes of
+   INODE, which must lie within the file, without writing them, so
+   that writes there later do not allocate.  Until written, the
+   new sectors hold whatever was on the disk, so this is only for
+   a caller that keeps track of which parts it has written, as the
+   free map does.  Returns true if successful, false if the disk
+   is full. */
+bool
+inode_preallocate (struct inode *inode, off_t length)
+{
+  block_sector_t goal = inode->sector + 1;
+  size_t cnt = DIV_ROUND_UP (length, BLOCK_SECTOR_SIZE), idx;
+  bool success = true;
+
+  journal_begin ();
+  rwlock_acquire_write (&inode->rwlock);
+  ASSERT (length <= inode_length (inode));
+  if (!inode->is_inline)
+    {
+      for (idx = 0; success && idx < cnt; idx++)
+        {
+          block_sector_t sector = lookup_sector (inode, idx);
+
+          if (sector == 0)
+            success = fill_hole (inode, idx, false, &goal, &sector);
+          goal = sector + 1;
+        }
+      forget_indexes (inode);
+      inode->meta_dirty = true;
+    }
+  rwlock_release_write (&inode->rwlock);
+  journal_end ();
+  return success;
+}
+
+/* Makes DST, an empty file, a clone of SRC: a file of the same
+   length whose data sectors are SRC's own, shared until either
+   file writes them, so that cloning takes time and space for the
+   index only.  Sectors not yet allocated, and the data of an
+   inline file, are copied instead.  Returns true if successful,
+   false if SRC is a directory or is memory-mapped, whose pages
+   may hold data not yet written back, or if the disk is full or
+   memory is not available, in which case DST may be left holding
+   some of the data. */
+bool
+inode_clone (struct inode *dst, struct inode *src)
+{
+  block_sector_t goal = dst->sector + 1;
+  size_t sector_cnt, idx;
+  bool success = true;
+
+  ASSERT (dst != src);
+
+  journal_begin ();
+  rwlock_acquire_write (&src->rwlock);
+  rwlock_acquire_write (&dst->rwlock);
+  if (src->is_dir || src->page_cnt > 0 || dst->is_dir
+      || dst->length != 0 || dst->deny_write_cnt > 0)
+    success = false;
+  else if (src->is_inline)
+    {
+      uint8_t *data = malloc (src->length + 1);
+
+      success = data != NULL && (dst->is_inline || src->length == 0);
+      if (success)
+        {
+          read_disk (src, offsetof (struct inode_disk, inline_data), data,
+                     src->length);
+          write_disk (dst, offsetof (struct inode_disk, inline_data), data,
+                      src->length);
+        }
+      free (data);
+    }
+  else if (!dst->is_inline || move_inline (dst, false, &goal))
+    {
+      sector_cnt = DIV_ROUND_UP (src->length, BLOCK_SECTOR_SIZE);
+      for (idx = 0; success && idx < sector_cnt; idx++)
         {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
+          block_sector_t sector = lookup_sector (src, idx);
+
+          if (sector == 0)
+            continue;
+          if (sector < CACHE_DELAYED && free_map_share (sector))
             {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
+              success = fill_hole (dst, idx, false, &goal, &sector);
+              if (!success)
+                free_map_release (sector, 1);
             }
-          success = true; 
-        } 
-      free (disk_inode);
+          else
+            {
+              /* Delayed, or with too many owners to share. */
+              block_sector_t copy = 0;
+
+              success = allocate_sector (&copy, &goal, false);
+              if (success && !fill_hole (dst, idx, false, &goal, &copy))
+                {
+                  free_map_release (copy, 1);
+                  success = false;
+                }
+              success = success && copy_sector (copy, sector);
+            }
+          thread_cond_yield ();
+        }
+      forget_indexes (dst);
     }
+  else
+    success = false;
+
+  if (success)
+    {
+      dst->length = src->length;
+      write_disk (dst, offsetof (struct inode_disk, length), &dst->length,
+                  sizeof dst->length);
+      lock_acquire (&dst->index_lock);
+      dst->version++;
+      lock_release (&dst->index_lock);
+    }
+  dst->meta_dirty = true;
+  rwlock_release_write (&dst->rwlock);
+  rwlock_release_write (&src->rwlock);
+  journal_end ();
   return success;
 }
 
@@ -111,33 +1014,77 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
   struct inode *inode;
+  uint16_t is_dir, is_inline;
 
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  rwlock_acquire_read (&open_inodes_lock);
+  inode = find_open (sector);
+  rwlock_release_read (&open_inodes_lock);
+  if (inode != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
+      percpu_counter_inc (&open_hit_cnt);
+      return inode;
+    }
+
+  /* Check again, now excluding other openers. */
+  rwlock_acquire_write (&open_inodes_lock);
+  inode = find_open (sector);
+  if (inode != NULL)
+    {
+      rwlock_release_write (&open_inodes_lock);
+      return inode;
     }
 
   /* Allocate memory. */
-  inode = malloc (sizeof *inode);
+  inode = kmem_cache_alloc (inode_cache);
   if (inode == NULL)
-    return NULL;
+    {
+      rwlock_release_write (&open_inodes_lock);
+      return NULL;
+    }
 
   /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
   inode->sector = sector;
-  inode->open_cnt = 1;
+  atomic_set (&inode->open_cnt, 1);
+  lock_init (&inode->lock);
+  lock_init (&inode->append_lock);
+  cond_init (&inode->appended);
+  inode->append_end = 0;
+  inode->append_next = inode->append_turn = 0;
+  rwlock_init (&inode->rwlock);
+  lock_init (&inode->index_lock);
   inode->deny_write_cnt = 0;
+  inode->meta_dirty = false;
+  inode->version = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  inode->indirect.entries = NULL;
+  inode->doubly_indirect.entries = NULL;
+  inode->leaf.entries = NULL;
+  inode->has_copies = false;
+  inode->pending = NULL;
+  inode->pend_first = inode->pend_cnt = 0;
+  inode->pages = NULL;
+  inode->page_cnt = 0;
+  forget_indexes (inode);
+  read_disk (inode, offsetof (struct inode_disk, length), &inode->length,
+             sizeof inode->length);
+  read_disk (inode, offsetof (struct inode_disk, is_dir), &is_dir,
+             sizeof is_dir);
+  read_disk (inode, offsetof (struct inode_disk, is_inline), &is_inline,
+             sizeof is_inline);
+  inode->is_dir = is_dir != 0;
+  inode->is_inline = is_inline != 0;
+  inode->indirect_sector = inode->doubly_indirect_sector = 0;
+  if (!inode->is_inline)
+    {
+      inode->indirect_sector = read_index (sector, INODE_INDIRECT_ENTRY);
+      inode->doubly_indirect_sector
+        = read_index (sector, INODE_DOUBLY_INDIRECT_ENTRY);
+    }
+  hash_insert (&open_inodes, &inode->elem);
+  open_miss_cnt++;
+  rwlock_release_write (&open_inodes_lock);
   return inode;
 }
 
@@ -146,7 +1093,7 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    atomic_inc (&inode->open_cnt);
   return inode;
 }
 
@@ -163,27 +1110,64 @@ inode_get_inumber (const struct inode *inode)
 void
 inode_close (struct inode *inode) 
 {
+  bool last;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
+  /* Only the last close needs to exclude openers, so that none
+     finds INODE once it is gone. */
+  if (atomic_add_unless (&inode->open_cnt, -1, 1))
+    return;
+
+  rwlock_acquire_write (&open_inodes_lock);
+  last = atomic_dec_and_test (&inode->open_cnt);
+  if (last)
+    hash_delete (&open_inodes, &inode->elem);
+  rwlock_release_write (&open_inodes_lock);
+
   /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  if (last)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
-      /* Deallocate blocks if removed. */
+      /* Deallocate blocks if removed, or else allocate the
+         delayed ones.  No other thread can hold the rwlock now,
+         but allocate_pending() expects it held. */
       if (inode->removed) 
         {
+          journal_begin ();
+          rwlock_acquire_write (&inode->rwlock);
+          discard_pending (inode);
+          rwlock_release_write (&inode->rwlock);
+          release_sectors (inode);
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          journal_end ();
+        }
+      else if (inode->pend_cnt > 0)
+        {
+          journal_begin ();
+          rwlock_acquire_write (&inode->rwlock);
+          allocate_pending (inode);
+          rwlock_release_write (&inode->rwlock);
+          journal_end ();
         }
 
-      free (inode); 
-    }
-}
+      lock_acquire (&inode->index_lock);
+      lock_acquire (&copies_lock);
+      free_copies (inode);
+      lock_release (&copies_lock);
+      lock_release (&inode->index_lock);
+      free (inode->pending);
+      ASSERT (inode->page_cnt == 0);
+      if (inode->pages != NULL)
+        {
+          hash_destroy (inode->pages, NULL);
+          free (inode->pages);
+        }
+
+      kmem_cache_free (inode_cache, inode); 
+    }
+}
 
 /* Marks INODE to be deleted when it is closed by the last caller who
    has it open. */
@@ -191,19 +1175,87 @@ void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  rwlock_acquire_write (&inode->rwlock);
   inode->removed = true;
+  rwlock_release_write (&inode->rwlock);
 }
 
-/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
-   Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
-off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
+/* Returns true if INODE has been removed. */
+bool
+inode_is_removed (const struct inode *inode)
+{
+  return inode->removed;
+}
+
+/* Acquires INODE's lock, which the inode layer itself never
+   takes, so that callers can make a series of operations on INODE
+   atomic with respect to each other, as the directory layer does
+   for directory updates. */
+void
+inode_lock (struct inode *inode)
+{
+  lock_acquire (&inode->lock);
+}
+
+/* Releases INODE's lock, acquired with inode_lock(). */
+void
+inode_unlock (struct inode *inode)
+{
+  lock_release (&inode->lock);
+}
+
+/* Returns true if INODE is a directory. */
+bool
+inode_is_dir (const struct inode *inode)
+{
+  return inode->is_dir;
+}
+
+/* Statistics. */
+static unsigned long long page_read_cnt, page_write_cnt;
+
+/* Returns the page in memory that holds byte OFFSET of INODE's
+   data, or a null pointer if there is none.  Caller must hold
+   INODE's rwlock. */
+static struct inode_page *
+find_page (struct inode *inode, off_t offset)
+{
+  struct inode_page key;
+  struct hash_elem *e;
+
+  if (inode->page_cnt == 0)
+    return NULL;
+  key.ofs = ROUND_DOWN (offset, PGSIZE);
+  e = hash_find (inode->pages, &key.elem);
+  if (e == NULL)
+    return NULL;
+  return hash_entry (e, struct inode_page, elem);
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at OFFSET, as
+   inode_read_at() does.  Caller must hold INODE's rwlock. */
+static off_t
+read_at (struct inode *inode, uint8_t *buffer, off_t size, off_t offset)
 {
-  uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
 
+  /* Directories, the free map and the reference counts are
+     metadata, kept cached ahead of file data. */
+  bool meta = (inode_is_dir (inode) || inode->sector == FREE_MAP_SECTOR
+               || inode->sector == REFCOUNT_SECTOR);
+
+  if (inode->is_inline)
+    {
+      if (size > inode_length (inode) - offset)
+        size = inode_length (inode) - offset;
+      if (size > 0)
+        {
+          read_disk (inode, offsetof (struct inode_disk, inline_data)
+                     + offset, buffer, size);
+          bytes_read = size;
+        }
+      size = 0;
+    }
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
@@ -217,113 +1269,878 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 
       /* Number of bytes to actually copy out of this sector. */
       int chunk_size = size < min_left ? size : min_left;
+      struct inode_page *page;
+
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      page = find_page (inode, offset);
+      if (page != NULL && offset - page->ofs < page->size)
         {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
+          /* Only the part of the sector in the page. */
+          if (chunk_size > page->size - (offset - page->ofs))
+            chunk_size = page->size - (offset - page->ofs);
+          memcpy (buffer + bytes_read, page->data + (offset - page->ofs),
+                  chunk_size);
+          page_read_cnt++;
         }
+      else if (sector_idx != 0 && meta)
+        cache_read_meta (sector_idx, buffer + bytes_read, sector_ofs,
+                         chunk_size);
+      else if (sector_idx != 0)
+        cache_read (sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
+      else
+        memset (buffer + bytes_read, 0, chunk_size);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
-
   return bytes_read;
 }
 
-/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
-   Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
+   Returns the number of bytes actually read, which may be less
+   than SIZE if an error occurs or end of file is reached. */
 off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
-                off_t offset) 
+inode_read_at (struct inode *inode, void *buffer, off_t size, off_t offset) 
+{
+  off_t bytes_read;
+
+  rwlock_acquire_read (&inode->rwlock);
+  bytes_read = read_at (inode, buffer, size, offset);
+  rwlock_release_read (&inode->rwlock);
+  return bytes_read;
+}
+
+/* Has the SIZE bytes of INODE starting at OFFSET, or those of
+   them within the file and not in holes, read into the cache in
+   the background.  Inline data is cached with the inode. */
+void
+inode_read_ahead (struct inode *inode, off_t size, off_t offset)
+{
+  off_t end = offset + size;
+
+  rwlock_acquire_read (&inode->rwlock);
+  if (end > inode_length (inode))
+    end = inode_length (inode);
+  if (inode->is_inline)
+    end = 0;
+  for (offset -= offset % BLOCK_SECTOR_SIZE; offset < end;
+       offset += BLOCK_SECTOR_SIZE)
+    {
+      block_sector_t sector = byte_to_sector (inode, offset);
+
+      /* Delayed sectors are cached until they are allocated. */
+      if (sector != 0 && sector < CACHE_DELAYED)
+        cache_read_ahead (sector);
+    }
+  rwlock_release_read (&inode->rwlock);
+}
+
+/* Lets the cached sectors of the SIZE bytes of INODE starting at
+   OFFSET be evicted before those still in use. */
+void
+inode_drop (struct inode *inode, off_t size, off_t offset)
+{
+  off_t end = offset + size;
+
+  rwlock_acquire_read (&inode->rwlock);
+  if (end > inode_length (inode))
+    end = inode_length (inode);
+  if (inode->is_inline)
+    end = 0;
+  for (offset -= offset % BLOCK_SECTOR_SIZE; offset < end;
+       offset += BLOCK_SECTOR_SIZE)
+    {
+      block_sector_t sector = byte_to_sector (inode, offset);
+
+      if (sector != 0)
+        cache_drop (sector);
+    }
+  rwlock_release_read (&inode->rwlock);
+}
+
+/* Returns the sector to write data sector IDX of INODE to: the
+   one it has, unless that is a hole, which gets a new sector,
+   zeroed unless COVERED because the caller is about to overwrite
+   all of it, or is shared with another file, which gets a copy
+   of its own.  Past the end of the file, file data waits to be
+   given a sector until it is written back.  New sectors are
+   placed after *GOAL, as by allocate_sector(), and *GOAL is moved
+   past the sector returned.  Sets *DIRTY if INODE's index
+   changes.  Returns 0 if the disk is full.  Caller must hold
+   INODE's rwlock, for writing if IDX is a hole or shared. */
+static block_sector_t
+own_sector (struct inode *inode, size_t idx, bool covered, bool meta,
+            block_sector_t *goal, bool *dirty)
+{
+  block_sector_t sector = lookup_sector (inode, idx);
+
+  if (sector == 0)
+    {
+      if (meta || !delay_sector (inode, idx, !covered, &sector))
+        {
+          *goal = spread_goal (inode, idx, *goal);
+          if (!fill_hole (inode, idx, !covered, goal, &sector))
+            return 0;
+          forget_indexes (inode);
+          *dirty = true;
+        }
+    }
+  else if (sector < CACHE_DELAYED && free_map_is_shared (sector))
+    {
+      *goal = spread_goal (inode, idx, *goal);
+      sector = unshare_sector (inode, idx, sector, covered, goal);
+      if (sector == 0)
+        return 0;
+      forget_indexes (inode);
+      *dirty = true;
+    }
+  if (sector < CACHE_DELAYED)
+    *goal = sector + 1;
+  return sector;
+}
+
+/* Gives the data sectors that the SIZE bytes of INODE starting at
+   OFFSET lie in sectors of their own, as own_sector() does, for
+   an append that writes them after letting go of the write lock.
+   Returns how many of the bytes have sectors, fewer than SIZE if
+   the disk fills up.  Caller must hold INODE's rwlock for
+   writing. */
+static off_t
+own_sectors (struct inode *inode, off_t offset, off_t size, bool meta)
+{
+  block_sector_t goal = inode->sector + 1, prev;
+  size_t idx = offset / BLOCK_SECTOR_SIZE;
+  off_t done = 0;
+  bool dirty = false;
+
+  if (idx > 0 && (prev = lookup_sector (inode, idx - 1)) != 0)
+    goal = prev + 1;
+  while (done < size)
+    {
+      int sector_ofs = (offset + done) % BLOCK_SECTOR_SIZE;
+      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
+      int chunk_size = size - done < sector_left ? size - done : sector_left;
+
+      idx = (offset + done) / BLOCK_SECTOR_SIZE;
+      if (own_sector (inode, idx, chunk_size == BLOCK_SECTOR_SIZE, meta,
+                      &goal, &dirty) == 0)
+        break;
+      done += chunk_size;
+    }
+  if (dirty)
+    inode->meta_dirty = true;
+  return done;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET, as
+   inode_write_at() does.  Also writes them to the pages of INODE
+   in memory that hold them, if THROUGH is true.  If APPEND is
+   true, the bytes are a range past the end of the file that
+   inode_append() reserved, which gets its sectors under the write
+   lock and is then written under the read lock, without growing
+   the file. */
+static off_t
+write_at (struct inode *inode, const uint8_t *buffer, off_t size,
+          off_t offset, bool through, bool append)
 {
-  const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
+  block_sector_t goal = inode->sector + 1, prev;
+  bool exclusive, dirty = false;
+  size_t idx;
+
+  /* Directories, the free map and the reference counts are
+     metadata, to be journaled. */
+  bool meta = (inode_is_dir (inode) || inode->sector == FREE_MAP_SECTOR
+               || inode->sector == REFCOUNT_SECTOR);
 
+  journal_begin ();
+  rwlock_acquire_read (&inode->rwlock);
   if (inode->deny_write_cnt)
-    return 0;
+    size = 0;
+  if (append)
+    {
+      /* No sector taken can become a hole or shared again while
+         the write lock is let go, unless the file is cloned. */
+      const off_t max = (off_t) INODE_MAX_SECTORS * BLOCK_SECTOR_SIZE;
+
+      ASSERT (!inode->is_inline);
+      if (size > max - offset)
+        size = offset < max ? max - offset : 0;
+      while (size > 0 && needs_sector (inode, offset, size))
+        {
+          rwlock_release_read (&inode->rwlock);
+          rwlock_acquire_write (&inode->rwlock);
+          size = own_sectors (inode, offset, size, meta);
+          rwlock_release_write (&inode->rwlock);
+          rwlock_acquire_read (&inode->rwlock);
+        }
+    }
+  exclusive = (size > 0 && !append
+               && (inode->is_inline
+                   || offset + size > inode_length (inode)
+                   || needs_sector (inode, offset, size)));
+  if (exclusive)
+    {
+      rwlock_release_read (&inode->rwlock);
+      rwlock_acquire_write (&inode->rwlock);
+      if (inode->deny_write_cnt)
+        size = 0;
+
+      /* Inline data is written along with the inode, unless the
+         write takes the file past INODE_INLINE_MAX bytes. */
+      if (inode->is_inline && size > 0)
+        {
+          if (offset + size <= (off_t) INODE_INLINE_MAX)
+            {
+              write_disk (inode, offsetof (struct inode_disk, inline_data)
+                          + offset, buffer, size);
+              bytes_written = size;
+              offset += size;
+              size = 0;
+              dirty = true;
+            }
+          else if (move_inline (inode, meta, &goal))
+            dirty = true;
+          else
+            size = 0;
+        }
+
+      /* Place new sectors after the one before OFFSET. */
+      idx = offset / BLOCK_SECTOR_SIZE;
+      if (!inode->is_inline && idx > 0 && idx <= INODE_MAX_SECTORS
+          && (prev = lookup_sector (inode, idx - 1)) != 0)
+        goal = prev + 1;
+    }
 
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx;
+      struct inode_page *page;
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      /* Number of bytes to actually write into this sector. */
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
+      int chunk_size = size < sector_left ? size : sector_left;
 
-      /* Number of bytes to actually write into this sector. */
-      int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
+      idx = offset / BLOCK_SECTOR_SIZE;
+      if (idx >= INODE_MAX_SECTORS)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else 
+      /* Only an exclusive write can reach a hole or a sector
+         shared with a clone. */
+      sector_idx = own_sector (inode, idx, chunk_size == BLOCK_SECTOR_SIZE,
+                               meta, &goal, &dirty);
+      if (sector_idx == 0)
+        break;
+
+      /* A page in memory is written first, so that a write back
+         of the page racing with this write leaves the cache with
+         the new data either way. */
+      if (through && (page = find_page (inode, offset)) != NULL
+          && offset - page->ofs < page->size)
         {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
+          off_t page_left = page->size - (offset - page->ofs);
 
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
+          memcpy (page->data + (offset - page->ofs), buffer + bytes_written,
+                  chunk_size < page_left ? chunk_size : page_left);
+          page_write_cnt++;
         }
 
+      /* The sector is read in first if the chunk does not cover
+         all of it and it is not cached. */
+      if (meta)
+        cache_write_meta (sector_idx, buffer + bytes_written, sector_ofs,
+                          chunk_size);
+      else
+        cache_write (sector_idx, buffer + bytes_written, sector_ofs,
+                     chunk_size);
+
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
+
+  /* Extend the file only as far as the data written. */
+  if (!append && bytes_written > 0 && offset > inode_length (inode))
+    {
+      inode->length = offset;
+      write_disk (inode, offsetof (struct inode_disk, length), &inode->length,
+                  sizeof inode->length);
+      dirty = true;
+    }
+  if (dirty)
+    inode->meta_dirty = true;
+  if (bytes_written > 0)
+    {
+      lock_acquire (&inode->index_lock);
+      inode->version++;
+      lock_release (&inode->index_lock);
+    }
+  if (exclusive)
+    rwlock_release_write (&inode->rwlock);
+  else
+    rwlock_release_read (&inode->rwlock);
+  journal_end ();
 
   return bytes_written;
 }
 
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+   Returns the number of bytes actually written, which may be
+   less than SIZE if the disk fills up or an error occurs.
+   A write past end of file extends the inode, leaving a hole in
+   any gap before OFFSET.  Only writes that extend INODE, fill its
+   holes or copy its shared sectors, allocating sectors, exclude
+   other accesses to it; the file never shrinks, holes never
+   reappear, and sectors only become shared while writers are
+   excluded, so a write found to need none of these under the read
+   lock keeps needing none. */
+off_t
+inode_write_at (struct inode *inode, const void *buffer, off_t size,
+                off_t offset) 
+{
+  return write_at (inode, buffer, size, offset, true, false);
+}
+
+/* Writes SIZE bytes from BUFFER at the end of INODE, and stores
+   the offset they went to in *OFFSET.  Returns the number of
+   bytes actually written, which may be less than SIZE if the disk
+   fills up.  Concurrent appends write ranges that do not overlap.
+
+   Only reserving the range, past the ranges that other appends
+   have reserved, excludes other appenders, along with giving the
+   file the sectors the range needs; the data is copied into the
+   buffer cache while other appends copy theirs.  The file then
+   grows over the range once the appends reserved before it have
+   grown it over theirs, so that readers never find a range whose
+   data is not in yet.  A file whose data is inline is appended
+   to one writer at a time, as it is small. */
+off_t
+inode_append (struct inode *inode, const void *buffer, off_t size,
+              off_t *offset)
+{
+  off_t written;
+  unsigned ticket;
+
+  lock_acquire (&inode->append_lock);
+  rwlock_acquire_read (&inode->rwlock);
+  if (inode->is_inline)
+    {
+      rwlock_release_read (&inode->rwlock);
+      *offset = inode_length (inode);
+      written = write_at (inode, buffer, size, *offset, true, false);
+      lock_release (&inode->append_lock);
+      return written;
+    }
+  if (inode->append_next == inode->append_turn
+      || inode->append_end < inode->length)
+    inode->append_end = inode->length;
+  *offset = inode->append_end;
+  inode->append_end += size;
+  ticket = inode->append_next++;
+  rwlock_release_read (&inode->rwlock);
+  lock_release (&inode->append_lock);
+
+  written = write_at (inode, buffer, size, *offset, true, true);
+
+  lock_acquire (&inode->append_lock);
+  while (inode->append_turn != ticket)
+    cond_wait (&inode->appended, &inode->append_lock);
+  lock_release (&inode->append_lock);
+
+  if (written > 0)
+    {
+      journal_begin ();
+      rwlock_acquire_write (&inode->rwlock);
+      if (*offset + written > inode->length)
+        {
+          inode->length = *offset + written;
+          write_disk (inode, offsetof (struct inode_disk, length),
+                      &inode->length, sizeof inode->length);
+          inode->meta_dirty = true;
+        }
+      rwlock_release_write (&inode->rwlock);
+      journal_end ();
+    }
+
+  lock_acquire (&inode->append_lock);
+  inode->append_turn++;
+  cond_broadcast (&inode->appended, &inode->append_lock);
+  lock_release (&inode->append_lock);
+  return written;
+}
+
+/* Returns a hash value for page P. */
+static unsigned
+page_hash (const struct hash_elem *p_, void *aux UNUSED)
+{
+  const struct inode_page *p = hash_entry (p_, struct inode_page, elem);
+  return hash_int (p->ofs / PGSIZE);
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct inode_page *a = hash_entry (a_, struct inode_page, elem);
+  const struct inode_page *b = hash_entry (b_, struct inode_page, elem);
+
+  return a->ofs < b->ofs;
+}
+
+/* Fills PAGE, whose OFS, SIZE and DATA are set, with the SIZE
+   bytes of INODE starting at OFS, and adds it to INODE's pages in
+   memory, so that reads of those bytes are served from PAGE and
+   writes to them go to PAGE too, until inode_remove_page().  The
+   cached copies of the sectors read are dropped first when the
+   cache needs room, as PAGE holds the same data.  Returns false,
+   leaving PAGE alone, if INODE already has a page at OFS or
+   memory is not available. */
+bool
+inode_add_page (struct inode *inode, struct inode_page *page)
+{
+  off_t ofs;
+
+  ASSERT (page->ofs % PGSIZE == 0);
+  ASSERT (page->size > 0 && page->size <= PGSIZE);
+
+  /* Excluding writers keeps the data from changing between
+     reading it and adding PAGE. */
+  rwlock_acquire_write (&inode->rwlock);
+  if (inode->pages == NULL)
+    {
+      inode->pages = malloc (sizeof *inode->pages);
+      if (inode->pages != NULL
+          && !hash_init (inode->pages, page_hash, page_less, NULL))
+        {
+          free (inode->pages);
+          inode->pages = NULL;
+        }
+    }
+  if (inode->pages == NULL || find_page (inode, page->ofs) != NULL)
+    {
+      rwlock_release_write (&inode->rwlock);
+      return false;
+    }
+
+  read_at (inode, page->data, page->size, page->ofs);
+  if (!inode->is_inline)
+    for (ofs = page->ofs; ofs < page->ofs + page->size;
+         ofs += BLOCK_SECTOR_SIZE)
+      {
+        block_sector_t sector = byte_to_sector (inode, ofs);
+
+        if (sector != 0 && sector != (block_sector_t) -1)
+          cache_drop (sector);
+      }
+  hash_insert (inode->pages, &page->elem);
+  inode->page_cnt++;
+  rwlock_release_write (&inode->rwlock);
+  return true;
+}
+
+/* Returns INODE's page in memory at OFS, as added by
+   inode_add_page(), or a null pointer if there is none.  The
+   caller must keep the page from being removed while it uses it. */
+struct inode_page *
+inode_find_page (struct inode *inode, off_t ofs)
+{
+  struct inode_page *page;
+
+  rwlock_acquire_read (&inode->rwlock);
+  page = find_page (inode, ofs);
+  if (page != NULL && page->ofs != ofs)
+    page = NULL;
+  rwlock_release_read (&inode->rwlock);
+  return page;
+}
+
+/* Removes PAGE from INODE's pages in memory, first writing its
+   data back to the cache if DIRTY is true, because it was modified
+   other than by inode_write_at(), which writes through to the
+   cache.  The data must not be modified that way meanwhile. */
+void
+inode_remove_page (struct inode *inode, struct inode_page *page,
+                   bool dirty)
+{
+  if (dirty)
+    write_at (inode, page->data, page->size, page->ofs, false, false);
+
+  rwlock_acquire_write (&inode->rwlock);
+  hash_delete (inode->pages, &page->elem);
+  inode->page_cnt--;
+  rwlock_release_write (&inode->rwlock);
+}
+
+/* Most data sectors inode_read_direct() and inode_write_direct()
+   transfer at once. */
+#define DIRECT_BATCH 8
+
+/* Statistics. */
+static unsigned long long direct_read_cnt, direct_write_cnt;
+
+/* Transfers the CNT data sectors of INODE starting at sector
+   IDX, which all have disk sectors, between the disk and BUFFER,
+   with one block request per run of consecutive disk sectors,
+   submitted together.  Writes the data to disk if WRITE is true,
+   reads it otherwise, keeping the cache coherent with
+   cache_bypass().  A sector that must go through the cache
+   instead is transferred with cache_read() or cache_write().  CNT
+   may be at most DIRECT_BATCH.  Caller must hold INODE's rwlock. */
+static void
+transfer_direct (struct inode *inode, size_t idx, size_t cnt,
+                 uint8_t *buffer, bool write)
+{
+  block_sector_t sectors[DIRECT_BATCH];
+  bool bypass[DIRECT_BATCH];
+  struct block_request reqs[DIRECT_BATCH];
+  size_t req_cnt = 0, i;
+
+  ASSERT (cnt <= DIRECT_BATCH);
+  for (i = 0; i < cnt; i++)
+    {
+      sectors[i] = lookup_sector (inode, idx + i);
+      bypass[i] = cache_bypass (sectors[i], write);
+    }
+
+  for (i = 0; i < cnt; )
+    {
+      uint8_t *p = buffer + i * BLOCK_SECTOR_SIZE;
+      size_t run = 1;
+
+      if (!bypass[i])
+        {
+          if (write)
+            cache_write (sectors[i], p, 0, BLOCK_SECTOR_SIZE);
+          else
+            cache_read (sectors[i], p, 0, BLOCK_SECTOR_SIZE);
+          i++;
+          continue;
+        }
+      while (i + run < cnt && bypass[i + run]
+             && sectors[i + run] == sectors[i] + run)
+        run++;
+      block_request_init (&reqs[req_cnt], write, sectors[i], run, p,
+                          NULL, NULL);
+      block_submit (fs_device, &reqs[req_cnt++]);
+      i += run;
+    }
+  for (i = 0; i < req_cnt; i++)
+    block_wait (&reqs[i]);
+
+  /* Read-ahead may have cached the old data meanwhile. */
+  if (write)
+    for (i = 0; i < cnt; i++)
+      if (bypass[i])
+        cache_bypass (sectors[i], true);
+}
+
+/* Reads or writes, according to WRITE, whole sectors of INODE
+   between the disk and BUFFER without going through the buffer
+   cache, starting at OFFSET, as inode_read_direct() and
+   inode_write_direct() do. */
+static off_t
+access_direct (struct inode *inode, void *buffer_, off_t size, off_t offset,
+               bool write)
+{
+  uint8_t *buffer = buffer_;
+  off_t done = 0;
+  size_t idx;
+
+  if (offset % BLOCK_SECTOR_SIZE != 0 || size % BLOCK_SECTOR_SIZE != 0)
+    return 0;
+
+  rwlock_acquire_read (&inode->rwlock);
+  if (write && inode->deny_write_cnt)
+    size = 0;
+  if (inode->is_inline || inode->page_cnt > 0)
+    size = 0;
+  if (size > inode_length (inode) - offset)
+    size = ROUND_DOWN (inode_length (inode) - offset, BLOCK_SECTOR_SIZE);
+  for (idx = offset / BLOCK_SECTOR_SIZE; done < size; )
+    {
+      size_t cnt = 0;
+
+      /* Gather sectors up to the first that has no disk sector.
+         A hole is read as zeros, and a delayed sector from the
+         cache, where alone its data is, but a write to either,
+         or to a sector shared with a clone, is left to the
+         caller. */
+      while (cnt < DIRECT_BATCH
+             && done + (off_t) (cnt * BLOCK_SECTOR_SIZE) < size)
+        {
+          block_sector_t sector = lookup_sector (inode, idx + cnt);
+
+          if (sector == 0 || sector >= CACHE_DELAYED
+              || (write && free_map_is_shared (sector)))
+            break;
+          cnt++;
+        }
+      if (cnt > 0)
+        {
+          transfer_direct (inode, idx, cnt, buffer + done, write);
+          if (write)
+            direct_write_cnt += cnt;
+          else
+            direct_read_cnt += cnt;
+        }
+      else if (write)
+        break;
+      else
+        {
+          block_sector_t sector = lookup_sector (inode, idx);
+
+          if (sector == 0)
+            memset (buffer + done, 0, BLOCK_SECTOR_SIZE);
+          else
+            cache_read (sector, buffer + done, 0, BLOCK_SECTOR_SIZE);
+          cnt = 1;
+        }
+      idx += cnt;
+      done += cnt * BLOCK_SECTOR_SIZE;
+    }
+  if (write && done > 0)
+    {
+      lock_acquire (&inode->index_lock);
+      inode->version++;
+      lock_release (&inode->index_lock);
+    }
+  rwlock_release_read (&inode->rwlock);
+  return done;
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at OFFSET,
+   straight from the disk rather than through the buffer cache,
+   so that a large read does not evict what is cached.  Cached
+   sectors that are dirty are written back first.  Only whole
+   sectors are read: returns 0 unless OFFSET and SIZE are
+   multiples of BLOCK_SECTOR_SIZE, and stops short of a partial
+   sector at end of file, leaving the caller to read the rest
+   through the cache. */
+off_t
+inode_read_direct (struct inode *inode, void *buffer, off_t size,
+                   off_t offset)
+{
+  return access_direct (inode, buffer, size, offset, false);
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET,
+   straight to the disk rather than through the buffer cache, and
+   drops any cached copies of the sectors written.  Only overwrites
+   whole sectors that already exist: returns 0 unless OFFSET and
+   SIZE are multiples of BLOCK_SECTOR_SIZE, and stops at a hole, a
+   delayed sector, a sector shared with a clone, or a partial
+   sector at end of file, leaving the caller to write the rest
+   through the cache, which allocates sectors. */
+off_t
+inode_write_direct (struct inode *inode, const void *buffer, off_t size,
+                    off_t offset)
+{
+  return access_direct (inode, (void *) buffer, size, offset, true);
+}
+
+/* Returns the number of extents of INODE's data: runs of
+   consecutive sectors, not counting holes or delayed sectors. */
+size_t
+inode_extent_cnt (struct inode *inode)
+{
+  size_t sector_cnt, idx, extent_cnt = 0;
+  block_sector_t prev = 0;
+
+  rwlock_acquire_read (&inode->rwlock);
+  sector_cnt = (inode->is_inline ? 0
+                : DIV_ROUND_UP (inode_length (inode), BLOCK_SECTOR_SIZE));
+  for (idx = 0; idx < sector_cnt; idx++)
+    {
+      block_sector_t sector = lookup_sector (inode, idx);
+
+      if (sector == 0 || sector >= CACHE_DELAYED)
+        sector = 0;
+      else if (prev == 0 || sector != prev + 1)
+        extent_cnt++;
+      prev = sector;
+    }
+  rwlock_release_read (&inode->rwlock);
+  return extent_cnt;
+}
+
+/* Data sectors that inode_defrag() moves at a time. */
+#define DEFRAG_CHUNK 64
+
+/* Moves the data sectors of INODE from the one holding byte
+   OFFSET up to DEFRAG_CHUNK of them, unless they already follow
+   one another and the sector before them, to consecutive free
+   sectors after that sector, through the buffer cache, and frees
+   the old ones.  Holes, delayed sectors and sectors shared with a
+   clone stay as they are.  Adds the number of sectors moved to
+   *MOVED.  Returns the offset
+   just past the sectors considered, at most INODE's length; a
+   caller moves a whole file by calling again from there until it
+   gets the length back.  Directories, the free map and inline
+   files are left alone. */
+off_t
+inode_defrag (struct inode *inode, off_t offset, size_t *moved)
+{
+  block_sector_t sectors[DEFRAG_CHUNK];
+  block_sector_t prev, last, goal, start;
+  size_t first, end, idx, cnt = 0;
+  bool scattered = false, joinable = false;
+  off_t length;
+  void *buffer;
+
+  buffer = malloc (BLOCK_SECTOR_SIZE);
+  if (buffer == NULL)
+    return inode_length (inode);
+
+  journal_begin ();
+  rwlock_acquire_write (&inode->rwlock);
+  length = inode_length (inode);
+  first = offset / BLOCK_SECTOR_SIZE;
+  end = DIV_ROUND_UP (length, BLOCK_SECTOR_SIZE);
+  if (inode->is_inline || inode->is_dir || inode->page_cnt > 0
+      || inode->sector == FREE_MAP_SECTOR)
+    first = end;
+  if (end > first + DEFRAG_CHUNK)
+    end = first + DEFRAG_CHUNK;
+
+  /* Find the chunk's sectors, and whether they are in order. */
+  prev = first > 0 && first < end ? lookup_sector (inode, first - 1) : 0;
+  if (prev >= CACHE_DELAYED)
+    prev = 0;
+  last = 0;
+  for (idx = first; idx < end; idx++)
+    {
+      block_sector_t sector = lookup_sector (inode, idx);
+
+      if (sector < CACHE_DELAYED && free_map_is_shared (sector))
+        sector = 0;
+      sectors[idx - first] = sector;
+      if (sector == 0 || sector >= CACHE_DELAYED)
+        continue;
+      if (last == 0)
+        joinable = prev != 0 && sector != prev + 1;
+      else if (sector != last + 1)
+        scattered = true;
+      last = sector;
+      cnt++;
+    }
+
+  /* Move them to a run of their own, unless they already make
+     one and the new run would not join the previous chunk's
+     either. */
+  goal = spread_goal (inode, first, prev != 0 ? prev + 1 : inode->sector + 1);
+  if (!(scattered || joinable) || !free_map_allocate_near (cnt, goal, &start))
+    cnt = 0;
+  else if (!scattered && start != prev + 1)
+    {
+      free_map_release (start, cnt);
+      cnt = 0;
+    }
+  if (cnt > 0)
+    {
+      for (idx = first; idx < end; idx++)
+        {
+          block_sector_t old = sectors[idx - first];
+
+          if (old == 0 || old >= CACHE_DELAYED)
+            continue;
+          cache_read (old, buffer, 0, BLOCK_SECTOR_SIZE);
+          cache_write (start, buffer, 0, BLOCK_SECTOR_SIZE);
+          if (!fill_hole (inode, idx, false, &goal, &start))
+            NOT_REACHED ();
+          free_map_release (old, 1);
+          cache_drop (old);
+          start++;
+          (*moved)++;
+        }
+      forget_indexes (inode);
+      inode->meta_dirty = true;
+    }
+  rwlock_release_write (&inode->rwlock);
+  journal_end ();
+  free (buffer);
+
+  offset = end * BLOCK_SECTOR_SIZE;
+  return offset < length ? offset : length;
+}
+
+/* Data sectors that inode_sync() writes back at once. */
+#define SYNC_BATCH 64
+
+/* Makes the data written to INODE so far durable, and the
+   metadata that finds it: the length and the index, which change
+   only when the file grows or its holes are filled.  Delayed
+   sectors are allocated first.  If the metadata has not changed
+   since the last call, only INODE's own dirty data sectors are
+   written back.  Otherwise, since metadata reaches the disk only
+   in a journal commit, which must follow all the data it refers
+   to, the whole cache is flushed.  A directory's data is metadata
+   too. */
+void
+inode_sync (struct inode *inode)
+{
+  block_sector_t sectors[SYNC_BATCH];
+  size_t sector_cnt, idx;
+  bool meta;
+
+  journal_begin ();
+  rwlock_acquire_write (&inode->rwlock);
+  allocate_pending (inode);
+  meta = inode->meta_dirty || inode_is_dir (inode);
+  inode->meta_dirty = false;
+  rwlock_release_write (&inode->rwlock);
+  journal_end ();
+
+  if (meta)
+    {
+      cache_flush ();
+      return;
+    }
+
+  rwlock_acquire_read (&inode->rwlock);
+  sector_cnt = (inode->is_inline ? 0
+                : DIV_ROUND_UP (inode_length (inode), BLOCK_SECTOR_SIZE));
+  for (idx = 0; idx < sector_cnt; )
+    {
+      size_t n = 0;
+
+      while (n < SYNC_BATCH && idx < sector_cnt)
+        {
+          block_sector_t sector = lookup_sector (inode, idx++);
+
+          if (sector != 0 && sector < CACHE_DELAYED)
+            sectors[n++] = sector;
+        }
+      cache_write_back (sectors, n);
+    }
+  rwlock_release_read (&inode->rwlock);
+  block_flush (fs_device);
+}
+
+/* Returns INODE's version, which changes whenever INODE is
+   written to. */
+unsigned
+inode_get_version (const struct inode *inode)
+{
+  return inode->version;
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
 inode_deny_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rwlock);
   inode->deny_write_cnt++;
-  ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  ASSERT (inode->deny_write_cnt <= atomic_read (&inode->open_cnt));
+  rwlock_release_write (&inode->rwlock);
 }
 
 /* Re-enables writes to INODE.
@@ -332,14 +2149,71 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rwlock);
   ASSERT (inode->deny_write_cnt > 0);
-  ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  ASSERT (inode->deny_write_cnt <= atomic_read (&inode->open_cnt));
   inode->deny_write_cnt--;
+  rwlock_release_write (&inode->rwlock);
+}
+
+/* Prints open inode table statistics. */
+void
+inode_print_stats (void)
+{
+  printf ("Inodes: %llu opens of open inodes, %llu of closed ones\n",
+          percpu_counter_sum (&open_hit_cnt), open_miss_cnt);
+  printf ("Inodes: %llu delayed sectors, %llu runs allocated at once\n",
+          delayed_total, delayed_runs);
+  printf ("Inodes: %llu sectors read directly, %llu written directly\n",
+          direct_read_cnt, direct_write_cnt);
+  printf ("Inodes: %llu reads from mapped pages, %llu writes to them\n",
+          page_read_cnt, page_write_cnt);
+}
+
+/* Returns a hash value for inode I. */
+static unsigned
+inode_hash (const struct hash_elem *i_, void *aux UNUSED)
+{
+  const struct inode *i = hash_entry (i_, struct inode, elem);
+  return hash_int (i->sector);
+}
+
+/* Returns true if inode A precedes inode B. */
+static bool
+inode_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct inode *a = hash_entry (a_, struct inode, elem);
+  const struct inode *b = hash_entry (b_, struct inode, elem);
+
+  return a->sector < b->sector;
 }
 
 /* Returns the length, in bytes, of INODE's data. */
 off_t
 inode_length (const struct inode *inode)
 {
-  return inode->data.length;
+  return inode->length;
+}
+
+/* Stores INODE's attributes in *ST, from what is in memory and
+   the cached index, without opening a file.  A delayed sector
+   counts as on disk, since it soon will be; a hole and the data
+   of an inline file do not. */
+void
+inode_stat (struct inode *inode, struct stat *st)
+{
+  size_t sector_cnt, idx;
+
+  rwlock_acquire_read (&inode->rwlock);
+  st->inumber = inode->sector;
+  st->is_dir = inode->is_dir;
+  st->size = inode->length;
+  st->blocks = 0;
+  sector_cnt = (inode->is_inline ? 0
+                : DIV_ROUND_UP (inode->length, BLOCK_SECTOR_SIZE));
+  for (idx = 0; idx < sector_cnt; idx++)
+    if (lookup_sector (inode, idx) != 0)
+      st->blocks++;
+  rwlock_release_read (&inode->rwlock);
 }
@@ -1,23 +1,59 @@
 #ifndef FILESYS_INODE_H
 #define FILESYS_INODE_H
 
+#include <hash.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include "filesys/off_t.h"
 #include "devices/block.h"
 
 struct bitmap;
+struct stat;
+
+/* A page of a file's data held in memory, by the frame of a
+   memory mapping, which reads of the file use in place of the
+   buffer cache and writes update along with it. */
+struct inode_page
+  {
+    struct hash_elem elem;      /* Element in the inode's pages. */
+    off_t ofs;                  /* Offset in the file, page-aligned. */
+    off_t size;                 /* Bytes of file data in the page. */
+    uint8_t *data;              /* The page, zeroed past SIZE. */
+  };
 
 void inode_init (void);
-bool inode_create (block_sector_t, off_t);
+bool inode_create (block_sector_t, off_t, bool is_dir);
 struct inode *inode_open (block_sector_t);
 struct inode *inode_reopen (struct inode *);
+bool inode_preallocate (struct inode *, off_t length);
+bool inode_clone (struct inode *dst, struct inode *src);
 block_sector_t inode_get_inumber (const struct inode *);
+unsigned inode_get_version (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
+bool inode_is_removed (const struct inode *);
+void inode_lock (struct inode *);
+void inode_unlock (struct inode *);
+bool inode_is_dir (const struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
+void inode_read_ahead (struct inode *, off_t size, off_t offset);
+void inode_drop (struct inode *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+off_t inode_append (struct inode *, const void *, off_t size, off_t *offset);
+off_t inode_read_direct (struct inode *, void *, off_t size, off_t offset);
+off_t inode_write_direct (struct inode *, const void *, off_t size,
+                          off_t offset);
+bool inode_add_page (struct inode *, struct inode_page *);
+struct inode_page *inode_find_page (struct inode *, off_t ofs);
+void inode_remove_page (struct inode *, struct inode_page *, bool dirty);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
+void inode_allocate_delayed (void);
+void inode_sync (struct inode *);
+size_t inode_extent_cnt (struct inode *);
+off_t inode_defrag (struct inode *, off_t offset, size_t *moved);
 off_t inode_length (const struct inode *);
+void inode_stat (struct inode *, struct stat *);
+void inode_print_stats (void);
 
 #endif /* filesys/inode.h */
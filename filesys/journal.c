@@ -0,0 +1,475 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <hash.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Metadata journal.
+
+   Inode, index, directory and free map sectors are metadata: the
+   buffer cache never writes them back in place on its own, but
+   logs them here, so that a crash leaves either all or none of
+   the changes made between two commits on disk.
+
+   File system operations that change metadata run between
+   journal_begin() and journal_end().  Every flush of the cache
+   commits the metadata changed since the last one as a single
+   transaction, a group commit: it waits for the operations in
+   progress to finish, holding off new ones, copies each dirty
+   metadata sector into the transaction, and lets operations go
+   on again.  It then writes the copies to the journal region in
+   one sequential transfer, followed by the header that lists
+   their home sectors, which commits them.  Only then does it
+   write each copy home, and finally clears the header.
+   journal_init() replays a committed transaction, copying its
+   sectors home again, if the system went down before the header
+   was cleared.
+
+   Until a sector's copy has reached its home, the journal is the
+   authority for it: the cache reads it from the journal instead
+   of the disk.  A dirty metadata sector evicted from the cache
+   between commits is stashed here, to be read back from the
+   stash or logged by the next commit.
+
+   A commit that finds more dirty metadata than one transaction
+   holds writes it as several, each atomic on its own.
+   journal_begin() commits early to keep that rare. */
+
+/* Identifies a journal header. */
+#define JOURNAL_MAGIC 0x4a524e4c
+
+/* Dirty metadata sectors at which journal_begin() commits before
+   letting another operation start, leaving room for what the
+   operations in progress still change. */
+#define JOURNAL_LIMIT (JOURNAL_MAX * 3 / 4)
+
+/* Journal header, in sector JOURNAL_SECTOR.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.  CNT is 0 unless
+   a transaction has been committed but not yet written home: then
+   sector JOURNAL_SECTOR + 1 + I holds the contents of SECTORS[I],
+   for each I < CNT. */
+struct journal_header
+  {
+    unsigned magic;                     /* JOURNAL_MAGIC. */
+    uint32_t seq;                       /* Transaction number. */
+    uint32_t cnt;                       /* Sectors committed. */
+    block_sector_t sectors[JOURNAL_MAX]; /* Home of each sector. */
+  };
+
+/* A stashed metadata sector, in the stash. */
+struct stash_copy
+  {
+    struct hash_elem elem;              /* Element in the stash. */
+    block_sector_t sector;              /* Home sector. */
+    uint8_t data[BLOCK_SECTOR_SIZE];    /* Contents. */
+  };
+
+/* Is the file system journaled?  Set once by journal_init(). */
+static bool enabled;
+
+/* The transaction, in memory.  HEADER lists the sectors logged so
+   far, DATA holds their contents in the same order.  They are
+   protected by journal_lock, but the thread committing may read
+   them without it, since only it changes them. */
+static struct journal_header *header;
+static uint8_t *data;
+
+/* Pages in DATA. */
+#define DATA_PAGES \
+  DIV_ROUND_UP (JOURNAL_MAX * BLOCK_SECTOR_SIZE, PGSIZE)
+
+/* Home write requests, one per logged sector. */
+static struct block_request *reqs;
+
+/* Protects the members below, and HEADER and DATA. */
+static struct lock journal_lock;
+static struct hash stash;               /* Stashed sectors. */
+static size_t pending_cnt;              /* Dirty metadata sectors. */
+static int active_cnt;                  /* Operations in progress. */
+static bool paused;                     /* Commit holding them off? */
+static struct condition quiet;          /* ACTIVE_CNT fell to 0. */
+static struct condition resumed;        /* PAUSED became false. */
+
+/* Statistics. */
+static unsigned long long commit_cnt, transaction_cnt, logged_cnt;
+static unsigned long long stash_cnt, replay_cnt;
+
+static bool add_sector (block_sector_t, const void *buf);
+static void write_transaction (void);
+static void replay (void);
+static hash_hash_func stash_hash;
+static hash_less_func stash_less;
+
+/**
+ * journal_init - initialize the journal
+ *
+ * @format: true if the file system is being formatted
+ *
+ * A newly formatted file system gets an empty journal.  Otherwise
+ * a committed transaction left by a crash is replayed; a file
+ * system without a journal, or a device too small for one, is used
+ * without.
+*/
+void journal_init(bool format)
+{
+	ASSERT(sizeof *header == BLOCK_SECTOR_SIZE);
+
+	if (block_size(fs_device) < 4 * (JOURNAL_SECTOR + JOURNAL_SECTORS))
+		return;
+
+	header = palloc_get_page(PAL_ZERO);
+	data = palloc_get_multiple(0, DATA_PAGES);
+	reqs = calloc(JOURNAL_MAX, sizeof *reqs);
+	if (header == NULL || data == NULL || reqs == NULL ||
+	    !hash_init(&stash, stash_hash, stash_less, NULL))
+		PANIC("journal allocation failed");
+	lock_init_named(&journal_lock, "journal");
+	cond_init(&quiet);
+	cond_init(&resumed);
+
+	if (format) {
+		header->magic = JOURNAL_MAGIC;
+		block_write(fs_device, JOURNAL_SECTOR, header);
+	} else {
+		block_read(fs_device, JOURNAL_SECTOR, header);
+		if (header->magic != JOURNAL_MAGIC) {
+			printf("%s: no journal, not journaling\n",
+			       block_name(fs_device));
+			return;
+		}
+		replay();
+	}
+	enabled = true;
+}
+
+/**
+ * journal_active - return true if metadata goes through the journal
+*/
+bool journal_active(void)
+{
+	return enabled;
+}
+
+/**
+ * journal_begin - start a file system operation that changes metadata
+ *
+ * Waits while a commit is collecting a transaction, and commits
+ * first if too much metadata is dirty.  May nest; only the
+ * outermost call waits.  The caller must not hold any file system
+ * lock, or a commit could wait on it forever.
+*/
+void journal_begin(void)
+{
+	if (thread_current()->journal_depth++ > 0 || !enabled)
+		return;
+
+	lock_acquire(&journal_lock);
+	while (paused || pending_cnt >= JOURNAL_LIMIT) {
+		if (paused) {
+			cond_wait(&resumed, &journal_lock);
+		} else {
+			lock_release(&journal_lock);
+			cache_flush();
+			lock_acquire(&journal_lock);
+		}
+	}
+	active_cnt++;
+	lock_release(&journal_lock);
+}
+
+/**
+ * journal_end - finish an operation started with journal_begin()
+*/
+void journal_end(void)
+{
+	ASSERT(thread_current()->journal_depth > 0);
+
+	if (--thread_current()->journal_depth > 0 || !enabled)
+		return;
+
+	lock_acquire(&journal_lock);
+	if (--active_cnt == 0)
+		cond_signal(&quiet, &journal_lock);
+	lock_release(&journal_lock);
+}
+
+/**
+ * journal_read - read a sector whose newest contents are in the journal
+ *
+ * @sector: sector of the file system device
+ * @buf: buffer to read into, BLOCK_SECTOR_SIZE bytes
+ * @dirty: set to true if the contents are not yet committed
+ *
+ * A stashed sector is taken out of the stash, so the caller must
+ * keep it dirty.  Return true if the journal had the sector, false
+ * if it is up to date on disk.
+*/
+bool journal_read(block_sector_t sector, void *buf, bool *dirty)
+{
+	struct stash_copy key, *c;
+	struct hash_elem *found;
+	bool success = false;
+	size_t i;
+
+	if (!enabled)
+		return false;
+
+	key.sector = sector;
+	lock_acquire(&journal_lock);
+	found = hash_delete(&stash, &key.elem);
+	if (found != NULL) {
+		c = hash_entry(found, struct stash_copy, elem);
+		memcpy(buf, c->data, BLOCK_SECTOR_SIZE);
+		free(c);
+		*dirty = success = true;
+	} else {
+		for (i = 0; i < header->cnt; i++)
+			if (header->sectors[i] == sector) {
+				memcpy(buf, data + i * BLOCK_SECTOR_SIZE,
+				       BLOCK_SECTOR_SIZE);
+				*dirty = false;
+				success = true;
+				break;
+			}
+	}
+	lock_release(&journal_lock);
+	return success;
+}
+
+/**
+ * journal_stash - keep a dirty metadata sector evicted from the cache
+ *
+ * @sector: sector of the file system device
+ * @buf: its contents
+ *
+ * Return true if successful, false if out of memory, in which case
+ * the caller writes the sector home and the current transaction is
+ * not atomic.
+*/
+bool journal_stash(block_sector_t sector, const void *buf)
+{
+	struct stash_copy *c = malloc(sizeof *c);
+	struct hash_elem *old;
+
+	lock_acquire(&journal_lock);
+	if (c != NULL) {
+		c->sector = sector;
+		memcpy(c->data, buf, BLOCK_SECTOR_SIZE);
+		old = hash_replace(&stash, &c->elem);
+		if (old != NULL) {
+			free(hash_entry(old, struct stash_copy, elem));
+			pending_cnt--;
+		}
+		stash_cnt++;
+	} else {
+		pending_cnt--;
+	}
+	lock_release(&journal_lock);
+	return c != NULL;
+}
+
+/**
+ * journal_dirtied - count a metadata sector newly dirty in the cache
+*/
+void journal_dirtied(void)
+{
+	lock_acquire(&journal_lock);
+	pending_cnt++;
+	lock_release(&journal_lock);
+}
+
+/**
+ * journal_pause - wait for operations to finish, holding off new ones
+ *
+ * Starts a commit, which journal_take_stash() and journal_log()
+ * fill, and journal_commit() completes.  Only cache_flush() commits,
+ * one at a time.
+*/
+void journal_pause(void)
+{
+	lock_acquire(&journal_lock);
+	paused = true;
+	while (active_cnt > 0)
+		cond_wait(&quiet, &journal_lock);
+	lock_release(&journal_lock);
+}
+
+/**
+ * journal_take_stash - log every stashed sector in the transaction
+*/
+void journal_take_stash(void)
+{
+	struct hash_iterator i;
+
+	lock_acquire(&journal_lock);
+	while (hash_size(&stash) > 0) {
+		struct stash_copy *c;
+
+		hash_first(&i, &stash);
+		c = hash_entry(hash_next(&i), struct stash_copy, elem);
+
+		/* C stays findable until it is in the transaction. */
+		if (add_sector(c->sector, c->data)) {
+			hash_delete(&stash, &c->elem);
+			free(c);
+		} else {
+			lock_release(&journal_lock);
+			write_transaction();
+			lock_acquire(&journal_lock);
+		}
+	}
+	lock_release(&journal_lock);
+}
+
+/**
+ * journal_log - add a dirty metadata sector to the transaction
+ *
+ * @sector: sector of the file system device
+ * @buf: its contents
+ *
+ * A full transaction is written out first.
+*/
+void journal_log(block_sector_t sector, const void *buf)
+{
+	lock_acquire(&journal_lock);
+	while (!add_sector(sector, buf)) {
+		lock_release(&journal_lock);
+		write_transaction();
+		lock_acquire(&journal_lock);
+	}
+	lock_release(&journal_lock);
+}
+
+/**
+ * journal_commit - commit the transaction started by journal_pause()
+ *
+ * Lets operations go on again, since the transaction holds copies
+ * of what they would change, and then writes it out.
+*/
+void journal_commit(void)
+{
+	lock_acquire(&journal_lock);
+	pending_cnt = 0;
+	paused = false;
+	cond_broadcast(&resumed, &journal_lock);
+	lock_release(&journal_lock);
+
+	if (header->cnt > 0) {
+		write_transaction();
+		commit_cnt++;
+	}
+}
+
+/**
+ * journal_print_stats - print journal statistics
+*/
+void journal_print_stats(void)
+{
+	if (enabled)
+		printf("Journal: %llu commits in %llu transactions, "
+		       "%llu sectors logged, %llu stashed, %llu replayed\n",
+		       commit_cnt, transaction_cnt, logged_cnt, stash_cnt,
+		       replay_cnt);
+}
+
+/* Adds SECTOR, with contents BUF, to the transaction, replacing
+   any copy of it already there.  Returns true if successful,
+   false if the transaction is full.  Caller must hold
+   journal_lock. */
+static bool
+add_sector (block_sector_t sector, const void *buf)
+{
+  size_t i;
+
+  for (i = 0; i < header->cnt; i++)
+    if (header->sectors[i] == sector)
+      break;
+  if (i == JOURNAL_MAX)
+    return false;
+  if (i == header->cnt)
+    header->sectors[header->cnt++] = sector;
+  memcpy (data + i * BLOCK_SECTOR_SIZE, buf, BLOCK_SECTOR_SIZE);
+  return true;
+}
+
+/* Writes the transaction to the journal region, commits it by
+   writing the header, writes each sector home, and then clears
+   the header and the transaction. */
+static void
+write_transaction (void)
+{
+  size_t cnt = header->cnt, i;
+
+  header->seq++;
+  block_write_multiple (fs_device, JOURNAL_SECTOR + 1, cnt, data);
+  block_write (fs_device, JOURNAL_SECTOR, header);
+
+  for (i = 0; i < cnt; i++)
+    {
+      block_request_init (&reqs[i], true, header->sectors[i], 1,
+                          data + i * BLOCK_SECTOR_SIZE, NULL, NULL);
+      block_submit (fs_device, &reqs[i]);
+    }
+  for (i = 0; i < cnt; i++)
+    block_wait (&reqs[i]);
+
+  lock_acquire (&journal_lock);
+  header->cnt = 0;
+  lock_release (&journal_lock);
+  block_write (fs_device, JOURNAL_SECTOR, header);
+
+  transaction_cnt++;
+  logged_cnt += cnt;
+}
+
+/* Copies the sectors of a transaction committed before a crash,
+   as read into HEADER, to their homes, and clears the header. */
+static void
+replay (void)
+{
+  size_t i;
+
+  if (header->cnt == 0)
+    return;
+  if (header->cnt > JOURNAL_MAX)
+    PANIC ("journal header lists %"PRIu32" sectors", header->cnt);
+
+  printf ("%s: replaying journal transaction %"PRIu32", %"PRIu32
+          " sectors\n", block_name (fs_device), header->seq, header->cnt);
+  block_read_multiple (fs_device, JOURNAL_SECTOR + 1, header->cnt, data);
+  for (i = 0; i < header->cnt; i++)
+    block_write (fs_device, header->sectors[i],
+                 data + i * BLOCK_SECTOR_SIZE);
+  replay_cnt += header->cnt;
+
+  header->cnt = 0;
+  block_write (fs_device, JOURNAL_SECTOR, header);
+}
+
+/* Returns a hash value for stashed sector C. */
+static unsigned
+stash_hash (const struct hash_elem *c_, void *aux UNUSED)
+{
+  const struct stash_copy *c = hash_entry (c_, struct stash_copy, elem);
+  return hash_int (c->sector);
+}
+
+/* Returns true if stashed sector A precedes stashed sector B. */
+static bool
+stash_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct stash_copy *a = hash_entry (a_, struct stash_copy, elem);
+  const struct stash_copy *b = hash_entry (b_, struct stash_copy, elem);
+
+  return a->sector < b->sector;
+}
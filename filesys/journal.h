@@ -0,0 +1,31 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Most sectors logged by one transaction, as many as the journal
+   header has room to list. */
+#define JOURNAL_MAX (BLOCK_SECTOR_SIZE / sizeof (block_sector_t) - 3)
+
+/* Sectors in the journal region, which starts at JOURNAL_SECTOR:
+   the header, then the logged sectors. */
+#define JOURNAL_SECTORS (1 + JOURNAL_MAX)
+
+void journal_init (bool format);
+bool journal_active (void);
+void journal_begin (void);
+void journal_end (void);
+
+/* For the buffer cache. */
+bool journal_read (block_sector_t, void *data, bool *dirty);
+bool journal_stash (block_sector_t, const void *data);
+void journal_dirtied (void);
+void journal_pause (void);
+void journal_take_stash (void);
+void journal_log (block_sector_t, const void *data);
+void journal_commit (void);
+
+void journal_print_stats (void);
+
+#endif /* filesys/journal.h */
@@ -0,0 +1,307 @@
+#include "filesys/pipe.h"
+#include <debug.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "userprog/process.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
+
+/* Pipes.
+
+   A pipe buffers the bytes written to its write end until they
+   are read from its read end, in a ring of PIPE_PAGES pages that
+   are allocated as the ring first fills them and kept until the
+   pipe goes away.  HEAD and TAIL count the bytes ever read and
+   written, so TAIL - HEAD bytes are buffered, starting at byte
+   HEAD % PIPE_SIZE of the ring.
+
+   Data is copied once on each side, straight between the ring
+   and the user's buffer.  A read of a whole page into a whole,
+   resident page of the reader's buffer does not copy at all: the
+   ring's page and the one behind the reader's buffer trade places
+   (see page_exchange()), and the reader's old page takes the
+   ring's slot for the writer to fill next.  The bytes a writer
+   writes stay in its own buffer, so writes always copy.
+
+   Readers wait on READABLE while the pipe is empty and writers
+   on WRITABLE while it is full.  A read returns whatever is
+   buffered, up to the size asked for; a write returns only once
+   all of its bytes are in the ring.  Reads return 0 at end of
+   file, once the pipe is empty and has no write ends open, and
+   writes fail once it has no read ends open.
+
+   A thread of an exiting process stops waiting, so that it can
+   end: pipe_wake_all() wakes every waiting thread to check. */
+
+/* Pages in a pipe's ring, and the bytes they hold. */
+#define PIPE_PAGES 16
+#define PIPE_SIZE (PIPE_PAGES * PGSIZE)
+
+/* A pipe. */
+struct pipe
+  {
+    struct lock lock;           /* Protects the members below. */
+    struct condition readable;  /* Signaled when data is added. */
+    struct condition writable;  /* Signaled when data is removed. */
+    size_t head;                /* Bytes ever read. */
+    size_t tail;                /* Bytes ever written. */
+    int readers;                /* Open read ends. */
+    int writers;                /* Open write ends. */
+    void *pages[PIPE_PAGES];    /* Ring, NULL where never filled. */
+    struct list_elem elem;      /* Element in all_pipes. */
+  };
+
+/* Every pipe, protected by all_pipes_lock. */
+static struct list all_pipes = LIST_INITIALIZER (all_pipes);
+static struct lock all_pipes_lock;
+
+static void pipe_destroy (struct pipe *);
+
+/**
+ * pipe_init - initialize the pipe module
+*/
+void pipe_init(void)
+{
+	lock_init_named(&all_pipes_lock, "all pipes");
+}
+
+/**
+ * pipe_create - create a pipe
+ *
+ * Return a new, empty pipe with one open read end and one open
+ * write end, or a null pointer if memory is not available.
+*/
+struct pipe *pipe_create(void)
+{
+	struct pipe *p = calloc(1, sizeof *p);
+
+	if (p == NULL)
+		return NULL;
+	lock_init_named(&p->lock, "pipe");
+	cond_init(&p->readable);
+	cond_init(&p->writable);
+	p->readers = p->writers = 1;
+	lock_acquire(&all_pipes_lock);
+	list_push_back(&all_pipes, &p->elem);
+	lock_release(&all_pipes_lock);
+	return p;
+}
+
+/**
+ * pipe_reopen - open another end of a pipe
+ *
+ * @p: pointer to the pipe
+ * @write_end: whether to open a write end rather than a read end
+*/
+void pipe_reopen(struct pipe *p, bool write_end)
+{
+	lock_acquire(&p->lock);
+	if (write_end)
+		p->writers++;
+	else
+		p->readers++;
+	lock_release(&p->lock);
+}
+
+/**
+ * pipe_close - close an end of a pipe
+ *
+ * @p: pointer to the pipe
+ * @write_end: whether the end is a write end rather than a read end
+ *
+ * Wake the threads waiting on the other end, which may now be at
+ * end of file or unable to write, and free the pipe along with its
+ * last end.
+*/
+void pipe_close(struct pipe *p, bool write_end)
+{
+	bool last;
+
+	lock_acquire(&p->lock);
+	if (write_end) {
+		ASSERT(p->writers > 0);
+		p->writers--;
+		cond_broadcast(&p->readable, &p->lock);
+	} else {
+		ASSERT(p->readers > 0);
+		p->readers--;
+		cond_broadcast(&p->writable, &p->lock);
+	}
+	last = p->readers == 0 && p->writers == 0;
+	lock_release(&p->lock);
+
+	if (last)
+		pipe_destroy(p);
+}
+
+/**
+ * pipe_read - read from a pipe
+ *
+ * @p: pointer to the pipe
+ * @buf: buffer to read into
+ * @size: number of bytes to read at most
+ * @copy: function to copy with if @buf is a user buffer, or NULL
+ *
+ * Wait until the pipe holds data, or has no write end open, then
+ * read as much of it as fits.  Stop waiting, and read nothing, if
+ * the process is exiting.  Whole pages read into whole pages of
+ * a user buffer are exchanged rather than copied where the VM layer
+ * allows.  Return the number of bytes read, 0 at end of file, or -1
+ * if @copy fails.
+*/
+int pipe_read(struct pipe *p, void *buf, size_t size,
+	      pipe_copy_func *copy)
+{
+	uint8_t *dst = buf;
+	size_t done = 0;
+
+	lock_acquire(&p->lock);
+	while (p->head == p->tail && p->writers > 0 && size > 0 &&
+	       !process_dying())
+		cond_wait(&p->readable, &p->lock);
+
+	while (done < size && p->head != p->tail) {
+		size_t slot = p->head / PGSIZE % PIPE_PAGES;
+		size_t ofs = p->head % PGSIZE;
+		size_t chunk = PGSIZE - ofs;
+
+		if (chunk > size - done)
+			chunk = size - done;
+		if (chunk > p->tail - p->head)
+			chunk = p->tail - p->head;
+
+#ifdef VM
+		if (copy != NULL && chunk == PGSIZE &&
+		    pg_ofs(dst + done) == 0 && is_user_vaddr(dst + done)) {
+			void *old = page_exchange(dst + done, p->pages[slot]);
+
+			if (old != NULL) {
+				p->pages[slot] = old;
+				p->head += chunk;
+				done += chunk;
+				continue;
+			}
+		}
+#endif
+		if (copy == NULL)
+			memcpy(dst + done, (uint8_t *)p->pages[slot] + ofs,
+			       chunk);
+		else if (!copy(dst + done, (uint8_t *)p->pages[slot] + ofs,
+			       chunk)) {
+			lock_release(&p->lock);
+			return -1;
+		}
+		p->head += chunk;
+		done += chunk;
+	}
+
+	if (done > 0)
+		cond_broadcast(&p->writable, &p->lock);
+	lock_release(&p->lock);
+	return done;
+}
+
+/**
+ * pipe_write - write to a pipe
+ *
+ * @p: pointer to the pipe
+ * @buf: buffer to write from
+ * @size: number of bytes to write
+ * @copy: function to copy with if @buf is a user buffer, or NULL
+ *
+ * Write all of the given bytes, waiting for readers to make room
+ * as needed.  Return the number of bytes written, which is short
+ * only if the last read end is closed meanwhile, memory for the
+ * ring runs out or the process is exiting, or -1 if none could be
+ * written for any of these reasons or @copy fails.
+*/
+int pipe_write(struct pipe *p, const void *buf, size_t size,
+	       pipe_copy_func *copy)
+{
+	const uint8_t *src = buf;
+	size_t done = 0;
+
+	lock_acquire(&p->lock);
+	while (done < size) {
+		size_t slot = p->tail / PGSIZE % PIPE_PAGES;
+		size_t ofs = p->tail % PGSIZE;
+		size_t chunk = PGSIZE - ofs;
+
+		if (p->readers == 0)
+			break;
+		if (p->tail - p->head == PIPE_SIZE) {
+			if (process_dying())
+				break;
+			cond_wait(&p->writable, &p->lock);
+			continue;
+		}
+
+		if (chunk > size - done)
+			chunk = size - done;
+		if (chunk > PIPE_SIZE - (p->tail - p->head))
+			chunk = PIPE_SIZE - (p->tail - p->head);
+		if (p->pages[slot] == NULL) {
+			p->pages[slot] = palloc_get_page(0);
+			if (p->pages[slot] == NULL)
+				break;
+		}
+
+		if (copy == NULL)
+			memcpy((uint8_t *)p->pages[slot] + ofs, src + done,
+			       chunk);
+		else if (!copy((uint8_t *)p->pages[slot] + ofs, src + done,
+			       chunk)) {
+			done = 0;
+			break;
+		}
+		p->tail += chunk;
+		done += chunk;
+		cond_broadcast(&p->readable, &p->lock);
+	}
+	lock_release(&p->lock);
+	return done > 0 ? (int)done : -1;
+}
+
+/**
+ * pipe_wake_all - wake every thread waiting on a pipe
+ *
+ * Called once a process is marked as exiting, so that its threads
+ * waiting to read or write a pipe see the mark and stop waiting.
+ * Since they check it under the pipe's lock, a thread about to
+ * wait either is woken here or does not wait at all.
+*/
+void pipe_wake_all(void)
+{
+	struct list_elem *e;
+
+	lock_acquire(&all_pipes_lock);
+	for (e = list_begin(&all_pipes); e != list_end(&all_pipes);
+	     e = list_next(e)) {
+		struct pipe *p = list_entry(e, struct pipe, elem);
+
+		lock_acquire(&p->lock);
+		cond_broadcast(&p->readable, &p->lock);
+		cond_broadcast(&p->writable, &p->lock);
+		lock_release(&p->lock);
+	}
+	lock_release(&all_pipes_lock);
+}
+
+/* Frees pipe P, which has no ends open, and its ring. */
+static void
+pipe_destroy (struct pipe *p)
+{
+  size_t i;
+
+  lock_acquire (&all_pipes_lock);
+  list_remove (&p->elem);
+  lock_release (&all_pipes_lock);
+
+  for (i = 0; i < PIPE_PAGES; i++)
+    palloc_free_page (p->pages[i]);
+  free (p);
+}
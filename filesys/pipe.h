@@ -0,0 +1,21 @@
+#ifndef FILESYS_PIPE_H
+#define FILESYS_PIPE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct pipe;
+
+/* Copies SIZE bytes from SRC to DST, one of which may be a user
+   address.  Returns false if the user address faulted. */
+typedef bool pipe_copy_func (void *dst, const void *src, size_t size);
+
+void pipe_init (void);
+struct pipe *pipe_create (void);
+void pipe_reopen (struct pipe *, bool write_end);
+void pipe_close (struct pipe *, bool write_end);
+int pipe_read (struct pipe *, void *, size_t, pipe_copy_func *);
+int pipe_write (struct pipe *, const void *, size_t, pipe_copy_func *);
+void pipe_wake_all (void);
+
+#endif /* filesys/pipe.h */
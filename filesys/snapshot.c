@@ -0,0 +1,614 @@
+#include "filesys/snapshot.h"
+#include <bitmap.h>
+#include <console.h>
+#include <debug.h>
+#include <hash.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/pci.h"
+#include "devices/serial.h"
+#include "devices/shutdown.h"
+#include "devices/timer.h"
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/shrinker.h"
+#include "threads/vaddr.h"
+#include "userprog/fpu.h"
+#include "userprog/gdt.h"
+
+/* Memory snapshots.
+
+   The "snapshot" action saves the state of the whole kernel to
+   the snapshot device, like hibernation, and powers off.  The
+   next boot that finds a snapshot there resumes it instead of
+   starting afresh: kernel data, kernel pool and user pool come
+   back as they were, threads, buffer cache and all, and the
+   resumed kernel goes on to run the actions on the new boot's
+   command line.  So a restart keeps whatever warmed up over the
+   run before.
+
+   Saving works like Linux's swsusp.  With interrupts off, no
+   block transfer under way and the FPU's registers in memory,
+   the CPU's context is saved and every page of RAM that may hold
+   data is copied to free pages set aside beforehand, so that the
+   copy is atomic.  Then, with interrupts back on, the copy is
+   written out: an index of the frame numbers of the pages, the
+   pages, and last a header.  The kernel's text is not saved, only
+   its checksum, since the resuming kernel must be the same one.
+   Nor are free pages, or the page holding the loader's command
+   line, through which the resumed kernel gets the new one.
+
+   A new boot resumes the snapshot once its block devices are
+   found, before it mounts the file system, which must not have
+   changed since: a checksum of the whole device tells.  It
+   reads each page into a free page that the snapshot does not
+   overwrite, or straight into place where a free page is where
+   the data belongs, and snapshot_restore() switches to a page
+   directory of its own, copies each page into place and restores
+   the saved context, returning into snapshot_save() in the
+   snapshotted kernel.  That discards the snapshot, since the disk
+   goes on to change.
+
+   Devices are assumed to need no more than booting set up, as
+   holds for the IDE disks, timer and serial port.  A bus master,
+   such as an e1000 or a virtio or AHCI disk, may have DMA under
+   way into memory the copy replaces, so a kernel using one
+   neither saves nor resumes. */
+
+#define SNAPSHOT_MAGIC 0x50414e53       /* "SNAP". */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Sector 0 of the snapshot device.  The index of frame numbers
+   follows, from sector 1, then the pages, in index order. */
+struct snapshot_header
+  {
+    uint32_t magic;             /* SNAPSHOT_MAGIC if valid. */
+    uint32_t text_sum;          /* Checksum of the kernel's text. */
+    uint32_t ram_pages;         /* Pages of RAM. */
+    uint32_t fs_sum;            /* Checksum of the file system device. */
+    uint32_t page_cnt;          /* Number of pages saved. */
+    uint32_t data_sum;          /* Checksum of the index and pages. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 6 * sizeof (uint32_t)];
+  };
+
+/* CPU context of a snapshot.  The offsets of the members must
+   match those in resume.S. */
+struct snapshot_context
+  {
+    uint32_t ebx, esi, edi, ebp;        /* Preserved across calls. */
+    uint32_t esp, eip;                  /* Stack and return address. */
+    uint32_t cr0, cr3, cr4;             /* Control registers. */
+  };
+
+/* A page of pages for snapshot_restore() to copy, by kernel
+   virtual address. */
+#define PAIRS_PER_PAGE ((PGSIZE - 8) / 8)
+struct restore_pairs
+  {
+    uint32_t cnt;                       /* Number of pairs. */
+    struct restore_pairs *next;         /* Next page of pairs. */
+    struct
+      {
+        void *dst;                      /* Where the page belongs. */
+        const void *src;                /* Page read from the device. */
+      }
+    pairs[PAIRS_PER_PAGE];
+  };
+
+int snapshot_save_context (struct snapshot_context *)
+  __attribute__ ((returns_twice));
+void snapshot_restore (uint32_t page_dir, struct restore_pairs *,
+                       struct snapshot_context *) NO_RETURN;
+
+/* Context saved with the snapshot.  Restoring the snapshot
+   overwrites it with the saved one before snapshot_restore()
+   reads it. */
+static struct snapshot_context context;
+
+/* Pages set aside for the copy, by frame number, and the frame
+   number of each page copied.  Static, so that the resumed kernel
+   can free them. */
+static struct bitmap *copies;
+static uint32_t *frames;
+
+static struct snapshot_header header;
+static uint8_t sector_buf[BLOCK_SECTOR_SIZE];
+
+/* Returns a checksum of the kernel's text and read-only data. */
+static uint32_t
+text_sum (void)
+{
+  extern char _start, _end_kernel_text;
+
+  return hash_bytes (&_start, &_end_kernel_text - &_start);
+}
+
+/* Returns a checksum of every sector of the file system device,
+   as read from the disk, or 0 if there is no file system device.
+   File data is covered along with metadata, since the buffer
+   cache in the snapshot may hold any of it, and a data write
+   made in place changes no metadata. */
+static uint32_t
+fs_sum (void)
+{
+  struct block *fs = block_get_role (BLOCK_FILESYS);
+  block_sector_t sector;
+  uint32_t sum = 0;
+
+  if (fs == NULL)
+    return 0;
+  for (sector = 0; sector < block_size (fs); sector++)
+    {
+      block_read (fs, sector, sector_buf);
+      sum = sum * 31 + hash_bytes (sector_buf, BLOCK_SECTOR_SIZE);
+    }
+  return sum;
+}
+
+/* Returns true if page frame PFN is one to save. */
+static bool
+page_saved (size_t pfn)
+{
+  extern char _start, _end_kernel_text, _end;
+  uint8_t *page = ptov (pfn * PGSIZE);
+
+  if (pfn == 0 || page == pg_round_down (ptov (LOADER_ARGS)))
+    return false;               /* BIOS data, new command line. */
+  else if (page < (uint8_t *) &_start)
+    return true;                /* Initial thread. */
+  else if (page < (uint8_t *) &_end_kernel_text)
+    return false;               /* Kernel text, checked by sum. */
+  else if (page < (uint8_t *) pg_round_up (&_end))
+    return true;                /* Kernel data. */
+  else if (page < (uint8_t *) ptov (1024 * 1024))
+    return false;               /* Video memory and ROMs. */
+  else
+    return !bitmap_test (copies, pfn) && palloc_page_live (page);
+}
+
+/* Returns the number of pages to save.  Interrupts must be
+   off. */
+static size_t
+count_pages (void)
+{
+  size_t cnt = 0;
+  size_t pfn;
+
+  for (pfn = 0; pfn < init_ram_pages; pfn++)
+    if (page_saved (pfn))
+      cnt++;
+  return cnt;
+}
+
+/* Copies each page to save to the next page of COPIES, recording
+   its frame number in FRAMES.  Returns the number of pages
+   copied, or SIZE_MAX if there are more than COPY_CNT.
+   Interrupts must be off. */
+static size_t
+copy_pages (size_t copy_cnt)
+{
+  size_t copy = 0, cnt = 0;
+  size_t pfn;
+
+  for (pfn = 0; pfn < init_ram_pages; pfn++)
+    if (page_saved (pfn))
+      {
+        if (cnt >= copy_cnt)
+          return SIZE_MAX;
+        copy = bitmap_scan (copies, copy, 1, true);
+        memcpy (ptov (copy * PGSIZE), ptov (pfn * PGSIZE), PGSIZE);
+        frames[cnt++] = pfn;
+        copy++;
+      }
+  return cnt;
+}
+
+/* Frees the pages set aside for the copy, and the index. */
+static void
+free_copies (void)
+{
+  size_t pfn;
+
+  if (copies != NULL)
+    {
+      for (pfn = 0; (pfn = bitmap_scan (copies, pfn, 1, true)) != BITMAP_ERROR;
+           pfn++)
+        palloc_free_page (ptov (pfn * PGSIZE));
+      bitmap_destroy (copies);
+      copies = NULL;
+    }
+  free (frames);
+  frames = NULL;
+}
+
+/* Marks the snapshot on BLOCK invalid. */
+static void
+discard (struct block *block)
+{
+  memset (&header, 0, sizeof header);
+  block_write (block, 0, &header);
+  block_flush (block);
+}
+
+/* Writes the PAGE_CNT pages copied, with FS_SUM as the checksum
+   of the file system, to BLOCK.  Returns false if BLOCK is too
+   small. */
+static bool
+write_snapshot (struct block *block, size_t page_cnt, uint32_t fs_sum)
+{
+  size_t index_sectors = DIV_ROUND_UP (page_cnt * sizeof *frames,
+                                       BLOCK_SECTOR_SIZE);
+  block_sector_t sector = 1 + index_sectors;
+  uint32_t sum;
+  size_t copy = 0;
+  size_t i;
+
+  /* A snapshot half overwritten must not be resumed. */
+  discard (block);
+  if (sector + (uint64_t) page_cnt * SECTORS_PER_PAGE > block_size (block))
+    return false;
+
+  sum = hash_bytes (frames, page_cnt * sizeof *frames);
+  block_write_multiple (block, 1, index_sectors, frames);
+  for (i = 0; i < page_cnt; i++)
+    {
+      void *page;
+
+      copy = bitmap_scan (copies, copy, 1, true);
+      page = ptov (copy++ * PGSIZE);
+      sum = sum * 31 + hash_bytes (page, PGSIZE);
+      block_write_multiple (block, sector, SECTORS_PER_PAGE, page);
+      sector += SECTORS_PER_PAGE;
+    }
+  block_flush (block);
+
+  header.magic = SNAPSHOT_MAGIC;
+  header.text_sum = text_sum ();
+  header.ram_pages = init_ram_pages;
+  header.fs_sum = fs_sum;
+  header.page_cnt = page_cnt;
+  header.data_sum = sum;
+  block_write (block, 0, &header);
+  block_flush (block);
+  return true;
+}
+
+/* Continues snapshot_save() in the kernel that resumed the
+   snapshot.  Only static data may be used here: locals were
+   saved as they were before the copy. */
+static bool
+resumed (void)
+{
+  /* Reload the GDT's task register, whose descriptor the
+     snapshot has marked busy. */
+  gdt_init ();
+  intr_enable ();
+
+  free_copies ();
+  discard (block_get_role (BLOCK_SNAPSHOT));
+  printf ("snapshot: resumed\n");
+  return true;
+}
+
+/* Saves a snapshot of the kernel to the snapshot device and
+   powers off.  Returns false, having printed why, if it cannot
+   be saved, or true in the kernel that resumes the snapshot
+   later, once it has. */
+bool
+snapshot_save (void)
+{
+  struct block *block = block_get_role (BLOCK_SNAPSHOT);
+  struct pci_dev *master = pci_bus_master ();
+  enum intr_level old_level;
+  size_t copy_cnt, page_cnt, i;
+  uint32_t fs;
+
+  if (block == NULL)
+    {
+      printf ("snapshot: no snapshot device\n");
+      return false;
+    }
+  if (master != NULL)
+    {
+      printf ("snapshot: %s is a bus master\n", master->driver->name);
+      return false;
+    }
+
+  /* Put the file system on disk, so that the disk and the
+     snapshot agree, and free what caches can give back. */
+  inode_allocate_delayed ();
+  cache_flush ();
+  shrink_memory (init_ram_pages);
+  fs = fs_sum ();
+
+  /* Set aside pages for the copy, with some to spare for the
+     memory that taking them uses. */
+  copies = bitmap_create (init_ram_pages);
+  if (copies == NULL)
+    goto no_memory;
+  old_level = intr_disable ();
+  copy_cnt = count_pages ();
+  intr_set_level (old_level);
+  copy_cnt += copy_cnt / 16 + 32;
+  frames = malloc (ROUND_UP (copy_cnt * sizeof *frames, BLOCK_SECTOR_SIZE));
+  if (frames == NULL)
+    goto no_memory;
+  for (i = 0; i < copy_cnt; i++)
+    {
+      void *page = palloc_get_page (PAL_USER);
+      if (page == NULL)
+        page = palloc_get_page (0);
+      if (page == NULL)
+        goto no_memory;
+      bitmap_mark (copies, vtop (page) >> PGBITS);
+    }
+
+  printf ("snapshot: saving to %s\n", block_name (block));
+  console_flush ();
+  serial_flush ();
+
+  /* Wait for transfers under way to finish. */
+  for (;;)
+    {
+      old_level = intr_disable ();
+      if (block_quiescent ())
+        break;
+      intr_set_level (old_level);
+      timer_msleep (1);
+    }
+
+  fpu_release ();
+  if (snapshot_save_context (&context) != 0)
+    return resumed ();
+  page_cnt = copy_pages (copy_cnt);
+  intr_set_level (old_level);
+
+  if (page_cnt == SIZE_MAX)
+    {
+      printf ("snapshot: memory grew while saving\n");
+      free_copies ();
+      return false;
+    }
+  if (!write_snapshot (block, page_cnt, fs))
+    {
+      printf ("snapshot: %s too small for %zu pages\n",
+              block_name (block), page_cnt);
+      free_copies ();
+      return false;
+    }
+  printf ("snapshot: saved %zu pages\n", page_cnt);
+  free_copies ();
+  shutdown_power_off ();
+
+ no_memory:
+  printf ("snapshot: out of memory\n");
+  free_copies ();
+  return false;
+}
+
+/* Removes and returns the first page of list *SAFE, linked
+   through the pages' first words. */
+static void *
+take_page (void **safe)
+{
+  void *page = *safe;
+
+  ASSERT (page != NULL);
+  *safe = *(void **) page;
+  return page;
+}
+
+/* Replaces the loader's command line by ARGV, preceded by -q or
+   -r if this boot is to power off or reboot when done, for the
+   resumed kernel to read.  The page that holds it is not part of
+   the snapshot. */
+static void
+write_command_line (char **argv)
+{
+  char buf[LOADER_ARGS_LEN];
+  enum shutdown_type how = shutdown_get_type ();
+  size_t ofs = 0;
+  uint32_t argc = 0;
+
+  if (how != SHUTDOWN_NONE)
+    {
+      strlcpy (buf, how == SHUTDOWN_POWER_OFF ? "-q" : "-r", sizeof buf);
+      ofs = 3;
+      argc++;
+    }
+  for (; *argv != NULL; argv++)
+    {
+      size_t len = strlen (*argv) + 1;
+
+      if (ofs + len > sizeof buf)
+        break;
+      memcpy (buf + ofs, *argv, len);
+      ofs += len;
+      argc++;
+    }
+
+  memcpy (ptov (LOADER_ARGS), buf, ofs);
+  *(uint32_t *) ptov (LOADER_ARG_CNT) = argc;
+}
+
+/* Builds, from the pages of list *SAFE, a page directory that
+   maps all of RAM at PHYS_BASE and nothing else, and returns
+   it. */
+static uint32_t *
+map_ram (void **safe)
+{
+  uint32_t *pd = take_page (safe);
+  size_t pfn;
+
+  memset (pd, 0, PGSIZE);
+  for (pfn = 0; pfn < init_ram_pages; pfn++)
+    {
+      void *page = ptov (pfn * PGSIZE);
+      uint32_t *pde = &pd[pd_no (page)];
+
+      if (*pde == 0)
+        {
+          uint32_t *pt = take_page (safe);
+
+          memset (pt, 0, PGSIZE);
+          *pde = pde_create (pt);
+        }
+      pde_get_pt (*pde)[pt_no (page)] = pte_create_kernel (page, true);
+    }
+  return pd;
+}
+
+/* Resumes the snapshot on the snapshot device, if there is one
+   that this kernel can resume, to run the actions in ARGV, the
+   rest of this boot's command line.  Returns only if it does
+   not, having printed why if there was a snapshot.  Must be
+   called before the file system is mounted. */
+void
+snapshot_resume (char **argv)
+{
+  struct block *block = block_get_role (BLOCK_SNAPSHOT);
+  struct bitmap *dests = NULL, *mine = NULL;
+  struct restore_pairs *pairs = NULL;
+  const char *why = NULL;
+  void *safe = NULL;
+  size_t index_sectors, extra, direct_cnt, safe_cnt, pfn, i;
+  uint32_t *pd;
+  uint32_t sum;
+
+  if (block == NULL)
+    return;
+  block_read (block, 0, &header);
+  if (header.magic != SNAPSHOT_MAGIC)
+    return;
+
+  index_sectors = DIV_ROUND_UP (header.page_cnt * sizeof *frames,
+                                BLOCK_SECTOR_SIZE);
+  if (header.text_sum != text_sum ())
+    why = "kernel differs";
+  else if (header.ram_pages != init_ram_pages)
+    why = "RAM size differs";
+  else if (header.fs_sum != fs_sum ())
+    why = "file system changed";
+  else if (1 + index_sectors + (uint64_t) header.page_cnt * SECTORS_PER_PAGE
+           > block_size (block))
+    why = "snapshot truncated";
+  else if (pci_bus_master () != NULL)
+    why = "bus master in use";
+  if (why != NULL)
+    {
+      printf ("snapshot: not resuming: %s\n", why);
+      return;
+    }
+  printf ("snapshot: resuming %"PRIu32" pages from %s\n",
+          header.page_cnt, block_name (block));
+
+  /* Read the index and mark where the pages go. */
+  frames = malloc (index_sectors * BLOCK_SECTOR_SIZE);
+  dests = bitmap_create (init_ram_pages);
+  mine = bitmap_create (init_ram_pages);
+  if (frames == NULL || dests == NULL || mine == NULL)
+    {
+      why = "out of memory";
+      goto fail;
+    }
+  block_read_multiple (block, 1, index_sectors, frames);
+  sum = hash_bytes (frames, header.page_cnt * sizeof *frames);
+  for (i = 0; i < header.page_cnt; i++)
+    {
+      if (frames[i] >= init_ram_pages || bitmap_test (dests, frames[i]))
+        {
+          why = "snapshot corrupt";
+          goto fail;
+        }
+      bitmap_mark (dests, frames[i]);
+    }
+
+  /* Take free pages until there is one for each page that does
+     not land on a page of ours where it belongs, plus the pages
+     of pairs, the page tables and the page directory, none of
+     which the copy may overwrite. */
+  extra = (DIV_ROUND_UP (header.page_cnt, PAIRS_PER_PAGE)
+           + DIV_ROUND_UP (init_ram_pages, PGSIZE / sizeof (uint32_t)) + 1);
+  direct_cnt = safe_cnt = 0;
+  while (safe_cnt < header.page_cnt - direct_cnt + extra)
+    {
+      void *page = palloc_get_page (PAL_USER);
+
+      if (page == NULL)
+        page = palloc_get_page (0);
+      if (page == NULL)
+        {
+          why = "out of memory";
+          goto fail;
+        }
+      pfn = vtop (page) >> PGBITS;
+      bitmap_mark (mine, pfn);
+      if (bitmap_test (dests, pfn))
+        direct_cnt++;
+      else
+        {
+          *(void **) page = safe;
+          safe = page;
+          safe_cnt++;
+        }
+    }
+
+  /* Read the pages. */
+  for (i = 0; i < header.page_cnt; i++)
+    {
+      void *dst = ptov (frames[i] * PGSIZE);
+      void *page = dst;
+
+      if (!bitmap_test (mine, frames[i]))
+        {
+          page = take_page (&safe);
+          if (pairs == NULL || pairs->cnt == PAIRS_PER_PAGE)
+            {
+              struct restore_pairs *p = take_page (&safe);
+
+              p->cnt = 0;
+              p->next = pairs;
+              pairs = p;
+            }
+          pairs->pairs[pairs->cnt].dst = dst;
+          pairs->pairs[pairs->cnt].src = page;
+          pairs->cnt++;
+        }
+      block_read_multiple (block, 1 + index_sectors + i * SECTORS_PER_PAGE,
+                           SECTORS_PER_PAGE, page);
+      sum = sum * 31 + hash_bytes (page, PGSIZE);
+    }
+  if (sum != header.data_sum)
+    {
+      why = "snapshot corrupt";
+      goto fail;
+    }
+
+  pd = map_ram (&safe);
+  write_command_line (argv);
+  console_flush ();
+  serial_flush ();
+  intr_disable ();
+  snapshot_restore (vtop (pd), pairs, &context);
+
+ fail:
+  printf ("snapshot: not resuming: %s\n", why);
+  if (mine != NULL)
+    for (pfn = 0; (pfn = bitmap_scan (mine, pfn, 1, true)) != BITMAP_ERROR;
+         pfn++)
+      palloc_free_page (ptov (pfn * PGSIZE));
+  bitmap_destroy (mine);
+  bitmap_destroy (dests);
+  free (frames);
+  frames = NULL;
+}
@@ -0,0 +1,10 @@
+#ifndef FILESYS_SNAPSHOT_H
+#define FILESYS_SNAPSHOT_H
+
+#include <stdbool.h>
+
+bool snapshot_save (void);
+void snapshot_resume (char **argv);
+void snapshot_discard (void);
+
+#endif /* filesys/snapshot.h */
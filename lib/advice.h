@@ -0,0 +1,15 @@
+#ifndef __LIB_ADVICE_H
+#define __LIB_ADVICE_H
+
+/* Access pattern advice for madvise() and fadvise(), shared by
+   the kernel and user programs. */
+enum advice
+  {
+    ADV_NORMAL,                 /* No particular pattern. */
+    ADV_SEQUENTIAL,             /* Read ahead far, drop behind. */
+    ADV_RANDOM,                 /* Do not read ahead. */
+    ADV_WILLNEED,               /* Start reading in now. */
+    ADV_DONTNEED                /* Drop from memory now. */
+  };
+
+#endif /* lib/advice.h */
@@ -9,6 +9,10 @@
 #define NO_INLINE __attribute__ ((noinline))
 #define PRINTF_FORMAT(FMT, FIRST) __attribute__ ((format (printf, FMT, FIRST)))
 
+/* Fails compilation unless constant expression CONDITION is
+   true. */
+#define STATIC_ASSERT(CONDITION) _Static_assert (CONDITION, #CONDITION)
+
 /* Halts the OS, printing the source file name, line number, and
    function name, plus a user-specific message. */
 #define PANIC(...) debug_panic (__FILE__, __LINE__, __func__, __VA_ARGS__)
@@ -0,0 +1,20 @@
+#ifndef __LIB_DIRENT_H
+#define __LIB_DIRENT_H
+
+#include <stdbool.h>
+
+/* Longest file name in a directory entry, not counting the null
+   terminator. */
+#define DIRENT_NAME_MAX 14
+
+/* A directory entry as returned by getdents(), shared by the
+   kernel and user programs. */
+struct dirent
+  {
+    int inumber;                        /* Inode number. */
+    bool is_dir;                        /* A directory? */
+    int size;                           /* Length in bytes. */
+    char name[DIRENT_NAME_MAX + 1];     /* Null-terminated name. */
+  };
+
+#endif /* lib/dirent.h */
@@ -0,0 +1,17 @@
+#ifndef __LIB_FCNTL_H
+#define __LIB_FCNTL_H
+
+/* Commands for fcntl(), shared by the kernel and user programs. */
+enum fcntl_cmd
+  {
+    F_GETFL,                    /* Return the descriptor's flags. */
+    F_SETFL                     /* Set the descriptor's flags. */
+  };
+
+/* Descriptor flags. */
+#define O_DIRECT 0x1            /* Read and write whole sectors
+                                   around the buffer cache. */
+#define O_APPEND 0x2            /* Write at the end of the file,
+                                   up to a page at once. */
+
+#endif /* lib/fcntl.h */
@@ -2,11 +2,15 @@
  * fixed_point.h is a 32-bit fixed_point numeric library.
  *
  * The datatype fixed_t is a typedef of int
- * which has FP_SHIFT_BITS fractional bits.
+ * which has FP_SHIFT_BITS fractional bits.  Products and quotients
+ * of two fixed_t are computed in 64 bits; the FP_W* variants also
+ * keep a 64-bit result where the 32-bit one may overflow.
 */
 #ifndef __FIXED_POINT_H
 #define __FIXED_POINT_H
 
+#include <stdint.h>
+
 /* Max and min comparison. */
 #define MAX(a, b) (((a) > (b)) ? (a) : (b))
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
@@ -73,4 +77,25 @@ typedef int fixed_t;
 #define FP_IDIVI(m, n) ((fixed_t)((((int64_t)(m)) << (2 * FP_SHIFT_BITS)) / \
 			          ((n) << FP_SHIFT_BITS)))
 
-#endif /* __FIXED_POINT_H */
\ No newline at end of file
+/* Multiply a fixed_t by an int, with a 64-bit result. */
+#define FP_WMULI(a, n) (((int64_t)(a)) * (n))
+
+/* Round a 64-bit fixed-point value to int. */
+#define FP_WRND(a) ((int)(((a) >= 0) ? \
+		   (((a) + (1LL << (FP_SHIFT_BITS - 1))) >> FP_SHIFT_BITS) : \
+		   (((a) - (1LL << (FP_SHIFT_BITS - 1))) >> FP_SHIFT_BITS)))
+
+/* Raise a fixed_t to the power of a non-negative int, by squaring. */
+static inline fixed_t fp_pow(fixed_t a, unsigned n)
+{
+	fixed_t r = FP_FIX(1);
+
+	for (; n > 0; n >>= 1) {
+		if (n & 1)
+			r = FP_MUL(r, a);
+		a = FP_MUL(a, a);
+	}
+	return r;
+}
+
+#endif /* __FIXED_POINT_H */
\ No newline at end of file
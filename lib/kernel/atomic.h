@@ -0,0 +1,151 @@
+#ifndef __LIB_KERNEL_ATOMIC_H
+#define __LIB_KERNEL_ATOMIC_H
+
+/* Atomic operations.
+
+   Each operation is a single x86 instruction with the `lock'
+   prefix, so that it is atomic with respect to interrupts on the
+   local CPU and to other CPUs alike, without turning interrupts
+   off or taking a lock.  All of them are also compiler barriers.
+
+   atomic64_t is updated with CMPXCHG8B, as i386 has no 64-bit
+   arithmetic in one instruction. */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* An int updated atomically. */
+typedef struct
+  {
+    volatile int value;
+  }
+atomic_t;
+
+/* A 64-bit counter updated atomically. */
+typedef struct
+  {
+    volatile uint64_t value;
+  }
+atomic64_t;
+
+/* Initializer for an atomic_t or atomic64_t holding V. */
+#define ATOMIC_INIT(V) { (V) }
+
+/* Returns the value of A. */
+static inline int
+atomic_read (const atomic_t *a)
+{
+  return a->value;
+}
+
+/* Sets A to V. */
+static inline void
+atomic_set (atomic_t *a, int v)
+{
+  a->value = v;
+}
+
+/* Adds N to A and returns the value A had before. */
+static inline int
+atomic_fetch_add (atomic_t *a, int n)
+{
+  asm volatile ("lock xaddl %0, %1"
+                : "+r" (n), "+m" (a->value) : : "memory", "cc");
+  return n;
+}
+
+/* Adds N to A. */
+static inline void
+atomic_add (atomic_t *a, int n)
+{
+  asm volatile ("lock addl %1, %0"
+                : "+m" (a->value) : "ir" (n) : "memory", "cc");
+}
+
+/* Increments A. */
+static inline void
+atomic_inc (atomic_t *a)
+{
+  asm volatile ("lock incl %0" : "+m" (a->value) : : "memory", "cc");
+}
+
+/* Decrements A and returns true if it became 0. */
+static inline bool
+atomic_dec_and_test (atomic_t *a)
+{
+  bool zero;
+
+  asm volatile ("lock decl %0; sete %1"
+                : "+m" (a->value), "=qm" (zero) : : "memory", "cc");
+  return zero;
+}
+
+/* Sets A to V and returns the value A had before. */
+static inline int
+atomic_xchg (atomic_t *a, int v)
+{
+  /* XCHG with a memory operand is always locked. */
+  asm volatile ("xchgl %0, %1"
+                : "+r" (v), "+m" (a->value) : : "memory");
+  return v;
+}
+
+/* Sets A to NEW if it is OLD.  Returns the value A had before,
+   which is OLD if and only if A was set. */
+static inline int
+atomic_cmpxchg (atomic_t *a, int old, int new)
+{
+  asm volatile ("lock cmpxchgl %2, %1"
+                : "+a" (old), "+m" (a->value) : "r" (new)
+                : "memory", "cc");
+  return old;
+}
+
+/* Adds N to A unless A is U.  Returns true if N was added. */
+static inline bool
+atomic_add_unless (atomic_t *a, int n, int u)
+{
+  int old = atomic_read (a);
+
+  while (old != u)
+    {
+      int seen = atomic_cmpxchg (a, old, old + n);
+      if (seen == old)
+        return true;
+      old = seen;
+    }
+  return false;
+}
+
+/* Sets A to NEW if it is OLD.  Returns the value A had before.  */
+static inline uint64_t
+atomic64_cmpxchg (atomic64_t *a, uint64_t old, uint64_t new)
+{
+  asm volatile ("lock cmpxchg8b %1"
+                : "+A" (old), "+m" (a->value)
+                : "b" ((uint32_t) new), "c" ((uint32_t) (new >> 32))
+                : "memory", "cc");
+  return old;
+}
+
+/* Returns the value of A, never torn by a concurrent update. */
+static inline uint64_t
+atomic64_read (atomic64_t *a)
+{
+  /* Either writes back the value already there or fails, and
+     returns it in both cases. */
+  return atomic64_cmpxchg (a, 0, 0);
+}
+
+/* Adds N to A. */
+static inline void
+atomic64_add (atomic64_t *a, uint64_t n)
+{
+  uint64_t old = a->value;
+  uint64_t seen;
+
+  while ((seen = atomic64_cmpxchg (a, old, old + n)) != old)
+    old = seen;
+}
+
+#endif /* lib/kernel/atomic.h */
@@ -3,6 +3,8 @@
 #include <limits.h>
 #include <round.h>
 #include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
 #ifdef FILESYS
 #include "filesys/file.h"
@@ -23,11 +25,21 @@ typedef unsigned long elem_type;
 
 /* From the outside, a bitmap is an array of bits.  From the
    inside, it's an array of elem_type (defined above) that
-   simulates an array of bits. */
+   simulates an array of bits.
+
+   A second, smaller array summarizes the first: bit I of the
+   summary is set when element I of BITS is full, that is, has
+   all of its bits set, so a scan for an unset bit skips up to
+   ELEM_BITS full elements at once instead of one.  The bitmap
+   also keeps a count of its set bits.  Every change to BITS goes
+   through store_elem(), which keeps both up to date. */
 struct bitmap
   {
     size_t bit_cnt;     /* Number of bits. */
+    size_t set_cnt;     /* Number of bits set to true. */
+    size_t next;        /* Where bitmap_scan_and_flip_next() resumes. */
     elem_type *bits;    /* Elements that represent bits. */
+    elem_type *full;    /* Bit I set if BITS[I] is full. */
   };
 
 /* Returns the index of the element that contains the bit
@@ -60,6 +72,36 @@ byte_cnt (size_t bit_cnt)
   return sizeof (elem_type) * elem_cnt (bit_cnt);
 }
 
+/* Returns the number of bytes required for BIT_CNT bits and
+   their summary. */
+static inline size_t
+storage_cnt (size_t bit_cnt)
+{
+  return byte_cnt (bit_cnt) + byte_cnt (elem_cnt (bit_cnt));
+}
+
+/* Returns an elem_type where the bits corresponding to bits
+   START through START + CNT - 1 of the element containing START
+   are turned on.  START + CNT must not run past that element. */
+static inline elem_type
+range_mask (size_t start, size_t cnt)
+{
+  elem_type mask = cnt < ELEM_BITS ? ((elem_type) 1 << cnt) - 1
+                                   : (elem_type) -1;
+  return mask << (start % ELEM_BITS);
+}
+
+/* Returns the number of bits set in WORD. */
+static inline unsigned
+popcount (elem_type word)
+{
+  /* __builtin_popcount() would need libgcc. */
+  word = word - ((word >> 1) & 0x55555555);
+  word = (word & 0x33333333) + ((word >> 2) & 0x33333333);
+  word = (word + (word >> 4)) & 0x0f0f0f0f;
+  return (word * 0x01010101) >> 24;
+}
+
 /* Returns a bit mask in which the bits actually used in the last
    element of B's bits are set to 1 and the rest are set to 0. */
 static inline elem_type
@@ -68,6 +110,69 @@ last_mask (const struct bitmap *b)
   int last_bits = b->bit_cnt % ELEM_BITS;
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
+
+/* Sets or clears the bit for element IDX in B's summary,
+   according to whether that element is now full. */
+static inline void
+summarize_elem (struct bitmap *b, size_t idx)
+{
+  elem_type full = (idx == elem_cnt (b->bit_cnt) - 1
+                    ? last_mask (b) : (elem_type) -1);
+
+  if (b->bits[idx] == full)
+    b->full[elem_idx (idx)] |= bit_mask (idx);
+  else
+    b->full[elem_idx (idx)] &= ~bit_mask (idx);
+}
+
+/* Stores WORD into element IDX of B's bits and updates B's
+   summary and count of set bits to match.  Interrupts must be
+   off, so that the three stay consistent. */
+static void
+store_elem (struct bitmap *b, size_t idx, elem_type word)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  b->set_cnt = b->set_cnt + popcount (word) - popcount (b->bits[idx]);
+  b->bits[idx] = word;
+  summarize_elem (b, idx);
+}
+
+#ifdef FILESYS
+/* Returns the number of bits set in elements FIRST through
+   LAST - 1 of B's bits. */
+static size_t
+count_elems (const struct bitmap *b, size_t first, size_t last)
+{
+  size_t cnt = 0;
+
+  for (; first < last; first++)
+    cnt += popcount (b->bits[first]);
+  return cnt;
+}
+
+/* Brings B's summary and count up to date after elements FIRST
+   through LAST - 1 of its bits, which had OLD_CNT bits set, were
+   overwritten directly. */
+static void
+resummarize (struct bitmap *b, size_t first, size_t last, size_t old_cnt)
+{
+  enum intr_level old_level = intr_disable ();
+
+  b->set_cnt += count_elems (b, first, last) - old_cnt;
+  for (; first < last; first++)
+    summarize_elem (b, first);
+  intr_set_level (old_level);
+}
+#endif
+
+/* Sets all of new bitmap B's bits, and its summary, to false. */
+static void
+init_bits (struct bitmap *b)
+{
+  memset (b->bits, 0, storage_cnt (b->bit_cnt));
+  b->set_cnt = 0;
+}
 
 /* Creation and destruction. */
 
@@ -82,10 +187,12 @@ bitmap_create (size_t bit_cnt)
   if (b != NULL)
     {
       b->bit_cnt = bit_cnt;
-      b->bits = malloc (byte_cnt (bit_cnt));
+      b->next = 0;
+      b->bits = malloc (storage_cnt (bit_cnt));
       if (b->bits != NULL || bit_cnt == 0)
         {
-          bitmap_set_all (b, false);
+          b->full = b->bits + elem_cnt (bit_cnt);
+          init_bits (b);
           return b;
         }
       free (b);
@@ -104,8 +211,10 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
   ASSERT (block_size >= bitmap_buf_size (bit_cnt));
 
   b->bit_cnt = bit_cnt;
+  b->next = 0;
   b->bits = (elem_type *) (b + 1);
-  bitmap_set_all (b, false);
+  b->full = b->bits + elem_cnt (bit_cnt);
+  init_bits (b);
   return b;
 }
 
@@ -114,7 +223,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 size_t
 bitmap_buf_size (size_t bit_cnt) 
 {
-  return sizeof (struct bitmap) + byte_cnt (bit_cnt);
+  return sizeof (struct bitmap) + storage_cnt (bit_cnt);
 }
 
 /* Destroys bitmap B, freeing its storage.
@@ -157,12 +266,14 @@ void
 bitmap_mark (struct bitmap *b, size_t bit_idx) 
 {
   size_t idx = elem_idx (bit_idx);
-  elem_type mask = bit_mask (bit_idx);
-
-  /* This is equivalent to `b->bits[idx] |= mask' except that it
-     is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the OR instruction in [IA32-v2b]. */
-  asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  enum intr_level old_level;
+
+  /* Turning interrupts off makes this atomic on a uniprocessor
+     machine, even though the summary and count change along
+     with the bit. */
+  old_level = intr_disable ();
+  store_elem (b, idx, b->bits[idx] | bit_mask (bit_idx));
+  intr_set_level (old_level);
 }
 
 /* Atomically sets the bit numbered BIT_IDX in B to false. */
@@ -170,12 +281,11 @@ void
 bitmap_reset (struct bitmap *b, size_t bit_idx) 
 {
   size_t idx = elem_idx (bit_idx);
-  elem_type mask = bit_mask (bit_idx);
+  enum intr_level old_level;
 
-  /* This is equivalent to `b->bits[idx] &= ~mask' except that it
-     is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the AND instruction in [IA32-v2a]. */
-  asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+  old_level = intr_disable ();
+  store_elem (b, idx, b->bits[idx] & ~bit_mask (bit_idx));
+  intr_set_level (old_level);
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -185,12 +295,11 @@ void
 bitmap_flip (struct bitmap *b, size_t bit_idx) 
 {
   size_t idx = elem_idx (bit_idx);
-  elem_type mask = bit_mask (bit_idx);
+  enum intr_level old_level;
 
-  /* This is equivalent to `b->bits[idx] ^= mask' except that it
-     is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the XOR instruction in [IA32-v2b]. */
-  asm ("xorl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  old_level = intr_disable ();
+  store_elem (b, idx, b->bits[idx] ^ bit_mask (bit_idx));
+  intr_set_level (old_level);
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -213,35 +322,58 @@ bitmap_set_all (struct bitmap *b, bool value)
   bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Atomically sets the CNT bits starting at START in B to VALUE.
+   Whole elements are stored at once. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
+  enum intr_level old_level;
+
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  old_level = intr_disable ();
+  while (cnt > 0)
+    {
+      size_t idx = elem_idx (start);
+      size_t ofs = start % ELEM_BITS;
+      size_t n = ELEM_BITS - ofs < cnt ? ELEM_BITS - ofs : cnt;
+      elem_type mask = range_mask (ofs, n);
+
+      store_elem (b, idx, value ? b->bits[idx] | mask : b->bits[idx] & ~mask);
+      start += n;
+      cnt -= n;
+    }
+  intr_set_level (old_level);
 }
 
 /* Returns the number of bits in B between START and START + CNT,
-   exclusive, that are set to VALUE. */
+   exclusive, that are set to VALUE.  Counting all of B's bits
+   takes constant time. */
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i, value_cnt;
+  size_t value_cnt;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
+  if (start == 0 && cnt == b->bit_cnt)
+    return value ? b->set_cnt : b->bit_cnt - b->set_cnt;
+
   value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
+  while (cnt > 0)
+    {
+      size_t ofs = start % ELEM_BITS;
+      size_t n = ELEM_BITS - ofs < cnt ? ELEM_BITS - ofs : cnt;
+      elem_type word = b->bits[elem_idx (start)] & range_mask (ofs, n);
+
+      value_cnt += value ? popcount (word) : n - popcount (word);
+      start += n;
+      cnt -= n;
+    }
   return value_cnt;
 }
 
@@ -250,15 +382,22 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
+  elem_type flip = value ? 0 : (elem_type) -1;
+
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
+  while (cnt > 0)
+    {
+      size_t ofs = start % ELEM_BITS;
+      size_t n = ELEM_BITS - ofs < cnt ? ELEM_BITS - ofs : cnt;
+
+      if ((b->bits[elem_idx (start)] ^ flip) & range_mask (ofs, n))
+        return true;
+      start += n;
+      cnt -= n;
+    }
   return false;
 }
 
@@ -288,6 +427,60 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
 
 /* Finding set or unset bits. */
 
+/* Returns the index of the first element of B's bits at or after
+   element IDX that is not full, or the number of elements if
+   there is none.  Reads only the summary, so it passes over up
+   to ELEM_BITS full elements with a single compare. */
+static size_t
+next_not_full (const struct bitmap *b, size_t idx)
+{
+  size_t last = elem_cnt (b->bit_cnt);
+  size_t sum_idx;
+  elem_type word;
+
+  if (idx >= last)
+    return last;
+
+  sum_idx = elem_idx (idx);
+  word = ~b->full[sum_idx] & ~(bit_mask (idx) - 1);
+  while (word == 0)
+    {
+      if (++sum_idx >= elem_cnt (last))
+        return last;
+      word = ~b->full[sum_idx];
+    }
+  idx = sum_idx * ELEM_BITS + __builtin_ctz (word);
+  return idx < last ? idx : last;
+}
+
+/* Returns the index of the first bit in B at or after START, and
+   before END, that is set to VALUE, or END if there is none.
+   Elements without such a bit are skipped with a single compare,
+   and when looking for false bits, full elements are skipped by
+   way of the summary. */
+static size_t
+find_next (const struct bitmap *b, size_t start, size_t end, bool value)
+{
+  elem_type flip = value ? 0 : (elem_type) -1;
+  size_t idx, bit;
+  elem_type word;
+
+  if (start >= end)
+    return end;
+
+  idx = elem_idx (start);
+  word = (b->bits[idx] ^ flip) & ~(bit_mask (start) - 1);
+  while (word == 0)
+    {
+      idx = value ? idx + 1 : next_not_full (b, idx + 1);
+      if (idx * ELEM_BITS >= end)
+        return end;
+      word = b->bits[idx] ^ flip;
+    }
+  bit = idx * ELEM_BITS + __builtin_ctz (word);
+  return bit < end ? bit : end;
+}
+
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
@@ -298,13 +491,33 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
-  if (cnt <= b->bit_cnt) 
+  return bitmap_scan_range (b, start, b->bit_cnt, cnt, value);
+}
+
+/* Like bitmap_scan(), but only finds a group that lies wholly
+   before bit END. */
+size_t
+bitmap_scan_range (const struct bitmap *b, size_t start, size_t end,
+                   size_t cnt, bool value)
+{
+  ASSERT (b != NULL);
+  ASSERT (start <= end && end <= b->bit_cnt);
+
+  if (cnt == 0)
+    return start;
+  while (start + cnt <= end)
     {
-      size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      /* Find the next run of VALUE bits, and whether it is long
+         enough, looking no further into it than CNT bits. */
+      size_t begin = find_next (b, start, end, value);
+      size_t stop;
+
+      if (begin + cnt > end)
+        break;
+      stop = find_next (b, begin, begin + cnt, !value);
+      if (stop == begin + cnt)
+        return begin;
+      start = stop;
     }
   return BITMAP_ERROR;
 }
@@ -324,7 +537,29 @@ bitmap_scan_and_flip (struct bitmap *b, size_t start, size_t cnt, bool value)
     bitmap_set_multiple (b, idx, cnt, !value);
   return idx;
 }
-
+
+/* Like bitmap_scan_and_flip(), but next fit: the scan starts just
+   past the group returned by the previous call, wrapping around
+   to bit 0, so that repeated calls do not rescan the groups they
+   flipped before. */
+size_t
+bitmap_scan_and_flip_next (struct bitmap *b, size_t cnt, bool value)
+{
+  size_t idx;
+
+  ASSERT (b != NULL);
+
+  idx = bitmap_scan (b, b->next, cnt, value);
+  if (idx == BITMAP_ERROR && b->next > 0)
+    idx = bitmap_scan (b, 0, cnt, value);
+  if (idx != BITMAP_ERROR)
+    {
+      bitmap_set_multiple (b, idx, cnt, !value);
+      b->next = idx + cnt < b->bit_cnt ? idx + cnt : 0;
+    }
+  return idx;
+}
+
 /* File input and output. */
 
 #ifdef FILESYS
@@ -344,12 +579,44 @@ bitmap_read (struct bitmap *b, struct file *file)
   if (b->bit_cnt > 0) 
     {
       off_t size = byte_cnt (b->bit_cnt);
+      size_t last = elem_cnt (b->bit_cnt);
+      size_t old_cnt = count_elems (b, 0, last);
+
       success = file_read_at (file, b->bits, size, 0) == size;
-      b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+      b->bits[last - 1] &= last_mask (b);
+      resummarize (b, 0, last, old_cnt);
     }
   return success;
 }
 
+/* Reads from FILE only the elements of B that hold the CNT bits
+   starting at START, from where bitmap_write() would have put
+   them.  Returns true if successful, false otherwise. */
+bool
+bitmap_read_range (struct bitmap *b, struct file *file,
+                   size_t start, size_t cnt)
+{
+  size_t first, last, old_cnt;
+  off_t ofs, size;
+  bool success;
+
+  ASSERT (b != NULL);
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (cnt <= b->bit_cnt - start);
+
+  if (cnt == 0)
+    return true;
+  first = elem_idx (start);
+  last = elem_idx (start + cnt - 1) + 1;
+  old_cnt = count_elems (b, first, last);
+  ofs = sizeof (elem_type) * first;
+  size = sizeof (elem_type) * last - ofs;
+  success = file_read_at (file, (uint8_t *) b->bits + ofs, size, ofs) == size;
+  b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+  resummarize (b, first, last, old_cnt);
+  return success;
+}
+
 /* Writes B to FILE.  Return true if successful, false
    otherwise. */
 bool
@@ -358,6 +625,27 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes to FILE only the elements of B that hold the CNT bits
+   starting at START, where bitmap_write() would have put them.
+   Return true if successful, false otherwise. */
+bool
+bitmap_write_range (const struct bitmap *b, struct file *file,
+                    size_t start, size_t cnt)
+{
+  off_t ofs, size;
+
+  ASSERT (b != NULL);
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (cnt <= b->bit_cnt - start);
+
+  if (cnt == 0)
+    return true;
+  ofs = sizeof (elem_type) * elem_idx (start);
+  size = sizeof (elem_type) * (elem_idx (start + cnt - 1) + 1) - ofs;
+  return file_write_at (file, (const uint8_t *) b->bits + ofs, size, ofs)
+         == size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
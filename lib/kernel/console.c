@@ -1,14 +1,22 @@
 #include <console.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
+#include "devices/intq.h"
 #include "devices/serial.h"
 #include "devices/vga.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 
 static void vprintf_helper (char, void *);
 static void putchar_have_lock (uint8_t c);
+static void putbuf_have_lock (const char *, size_t);
+static void emit (const char *, size_t);
+static void log_append (const char *, size_t);
+static void log_drain (void);
+static thread_func log_thread;
 
 /* The console lock.
    Both the vga and serial layers do their own locking, so it's
@@ -59,14 +67,64 @@ static int console_lock_depth;
 /* Number of characters written to console. */
 static int64_t write_cnt;
 
+/* Number of buffers handed to the vga and serial layers. */
+static int64_t batch_cnt;
+
+/* Log ring capacity, in bytes.  Must be a power of 2. */
+#define LOG_SIZE 16384
+
+/* Once the log thread is running, output goes into a ring that
+   the log thread drains to the vga display and serial port, so
+   that printf() need not wait for a 9600 bps serial line.
+   Producers add to the ring with interrupts briefly disabled,
+   which serializes them; the consumer is whoever holds
+   log_lock, normally the log thread. */
+static bool log_running;
+static struct spscq log_ring;
+static uint8_t log_buf[LOG_SIZE];
+static struct semaphore log_ready;      /* Upped when data arrives. */
+static struct lock log_lock;            /* Serializes draining. */
+
+/* Characters that interrupt handlers found no room for. */
+static int64_t log_dropped;
+
 /* Enable console locking. */
 void
 console_init (void) 
 {
-  lock_init (&console_lock);
+  lock_init_named (&console_lock, "console");
   use_console_lock = true;
 }
 
+/* Starts the log thread, after which console output is written
+   asynchronously.  Must be called after thread_start(). */
+void
+console_start_log (void)
+{
+  spscq_init (&log_ring, log_buf, sizeof log_buf);
+  sema_init (&log_ready, 0);
+  lock_init_named (&log_lock, "console log");
+  if (thread_create ("log", PRI_MIN, log_thread, NULL) != TID_ERROR)
+    log_running = true;
+}
+
+/* Writes out everything in the log ring before returning. */
+void
+console_flush (void)
+{
+  if (!log_running)
+    return;
+
+  if (intr_context ())
+    log_drain ();
+  else
+    {
+      lock_acquire (&log_lock);
+      log_drain ();
+      lock_release (&log_lock);
+    }
+}
+
 /* Notifies the console that a kernel panic is underway,
    which warns it to avoid trying to take the console lock from
    now on. */
@@ -74,13 +132,25 @@ void
 console_panic (void) 
 {
   use_console_lock = false;
+
+  /* Switch back to synchronous output, after writing out what
+     the log thread has not gotten to.  The log thread may never
+     run again. */
+  if (log_running)
+    {
+      enum intr_level old_level = intr_disable ();
+      log_running = false;
+      log_drain ();
+      intr_set_level (old_level);
+    }
 }
 
 /* Prints console statistics. */
 void
 console_print_stats (void) 
 {
-  printf ("Console: %lld characters output\n", write_cnt);
+  printf ("Console: %lld characters output in %lld batches, "
+          "%lld dropped\n", write_cnt, batch_cnt, log_dropped);
 }
 
 /* Acquires the console lock. */
@@ -119,19 +189,30 @@ console_locked_by_current_thread (void)
           || lock_held_by_current_thread (&console_lock));
 }
 
+/* Auxiliary data for vprintf_helper(). */
+struct vprintf_aux
+  {
+    int char_cnt;               /* Characters formatted so far. */
+    size_t len;                 /* Characters in BUF. */
+    char buf[64];               /* Output not yet written. */
+  };
+
 /* The standard vprintf() function,
    which is like printf() but uses a va_list.
    Writes its output to both vga display and serial port. */
 int
 vprintf (const char *format, va_list args) 
 {
-  int char_cnt = 0;
+  struct vprintf_aux aux;
 
+  aux.char_cnt = 0;
+  aux.len = 0;
   acquire_console ();
-  __vprintf (format, args, vprintf_helper, &char_cnt);
+  __vprintf (format, args, vprintf_helper, &aux);
+  putbuf_have_lock (aux.buf, aux.len);
   release_console ();
 
-  return char_cnt;
+  return aux.char_cnt;
 }
 
 /* Writes string S to the console, followed by a new-line
@@ -140,8 +221,7 @@ int
 puts (const char *s) 
 {
   acquire_console ();
-  while (*s != '\0')
-    putchar_have_lock (*s++);
+  putbuf_have_lock (s, strlen (s));
   putchar_have_lock ('\n');
   release_console ();
 
@@ -153,8 +233,7 @@ void
 putbuf (const char *buffer, size_t n) 
 {
   acquire_console ();
-  while (n-- > 0)
-    putchar_have_lock (*buffer++);
+  putbuf_have_lock (buffer, n);
   release_console ();
 }
 
@@ -169,13 +248,20 @@ putchar (int c)
   return c;
 }
 
-/* Helper function for vprintf(). */
+/* Helper function for vprintf().  Collects characters in AUX's
+   buffer and writes them out whenever it fills up. */
 static void
-vprintf_helper (char c, void *char_cnt_) 
+vprintf_helper (char c, void *aux_) 
 {
-  int *char_cnt = char_cnt_;
-  (*char_cnt)++;
-  putchar_have_lock (c);
+  struct vprintf_aux *aux = aux_;
+
+  aux->char_cnt++;
+  aux->buf[aux->len++] = c;
+  if (aux->len >= sizeof aux->buf)
+    {
+      putbuf_have_lock (aux->buf, aux->len);
+      aux->len = 0;
+    }
 }
 
 /* Writes C to the vga display and serial port.
@@ -183,9 +269,88 @@ vprintf_helper (char c, void *char_cnt_)
    appropriate. */
 static void
 putchar_have_lock (uint8_t c) 
+{
+  char ch = c;
+  putbuf_have_lock (&ch, 1);
+}
+
+/* Writes the N characters in BUFFER to the vga display and
+   serial port, through the log ring if the log thread is
+   running.  The caller has already acquired the console lock if
+   appropriate. */
+static void
+putbuf_have_lock (const char *buffer, size_t n)
 {
   ASSERT (console_locked_by_current_thread ());
-  write_cnt++;
-  serial_putc (c);
-  vga_putc (c);
+  if (n == 0)
+    return;
+  write_cnt += n;
+  if (log_running)
+    log_append (buffer, n);
+  else
+    emit (buffer, n);
+}
+
+/* Hands the N characters in BUFFER to the vga display and serial
+   port, each of them taking the whole buffer at once. */
+static void
+emit (const char *buffer, size_t n)
+{
+  batch_cnt++;
+  serial_putbuf (buffer, n);
+  vga_putbuf (buffer, n);
+}
+
+/* Adds the N characters in BUFFER to the log ring and wakes up
+   the log thread.  If the ring fills up, a kernel thread drains
+   it itself, but an interrupt handler, which cannot wait, drops
+   what does not fit. */
+static void
+log_append (const char *buffer, size_t n)
+{
+  for (;;)
+    {
+      enum intr_level old_level = intr_disable ();
+      size_t cnt = spscq_put (&log_ring, buffer, n);
+      if (cnt > 0 && log_ready.value == 0)
+        sema_up (&log_ready);
+      intr_set_level (old_level);
+
+      buffer += cnt;
+      n -= cnt;
+      if (n == 0)
+        break;
+      if (intr_context ())
+        {
+          log_dropped += n;
+          break;
+        }
+      console_flush ();
+    }
+}
+
+/* Writes everything in the log ring to the vga display and
+   serial port.  The caller must be the ring's only consumer,
+   by holding log_lock or by having interrupts off for good. */
+static void
+log_drain (void)
+{
+  char chunk[256];
+  size_t n;
+
+  while ((n = spscq_get (&log_ring, chunk, sizeof chunk)) > 0)
+    emit (chunk, n);
+}
+
+/* Log thread.  Drains the log ring whenever data arrives. */
+static void
+log_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      sema_down (&log_ready);
+      lock_acquire (&log_lock);
+      log_drain ();
+      lock_release (&log_lock);
+    }
 }
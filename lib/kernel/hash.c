@@ -6,6 +6,7 @@
    See hash.h for basic information. */
 
 #include "hash.h"
+#include <string.h>
 #include "../debug.h"
 #include "threads/malloc.h"
 
@@ -15,6 +16,11 @@
 static struct list *find_bucket (struct hash *, struct hash_elem *);
 static struct hash_elem *find_elem (struct hash *, struct list *,
                                     struct hash_elem *);
+static struct hash_elem *lookup (struct hash *, struct hash_elem *,
+                                 struct list **);
+static struct list *next_bucket (struct hash *, struct list *);
+static void clear_buckets (struct hash *, struct list *, size_t cnt,
+                           hash_action_func *);
 static void insert_elem (struct hash *, struct list *, struct hash_elem *);
 static void remove_elem (struct hash *, struct hash_elem *);
 static void rehash (struct hash *);
@@ -28,6 +34,9 @@ hash_init (struct hash *h,
   h->elem_cnt = 0;
   h->bucket_cnt = 4;
   h->buckets = malloc (sizeof *h->buckets * h->bucket_cnt);
+  h->old_buckets = NULL;
+  h->old_bucket_cnt = 0;
+  h->migrate_idx = 0;
   h->hash = hash;
   h->less = less;
   h->aux = aux;
@@ -53,22 +62,15 @@ hash_init (struct hash *h,
 void
 hash_clear (struct hash *h, hash_action_func *destructor) 
 {
-  size_t i;
-
-  for (i = 0; i < h->bucket_cnt; i++) 
+  clear_buckets (h, h->buckets, h->bucket_cnt, destructor);
+  if (h->old_buckets != NULL)
     {
-      struct list *bucket = &h->buckets[i];
-
-      if (destructor != NULL) 
-        while (!list_empty (bucket)) 
-          {
-            struct list_elem *list_elem = list_pop_front (bucket);
-            struct hash_elem *hash_elem = list_elem_to_hash_elem (list_elem);
-            destructor (hash_elem, h->aux);
-          }
-
-      list_init (bucket); 
-    }    
+      /* Abandon the migration in progress. */
+      clear_buckets (h, h->old_buckets + h->migrate_idx,
+                     h->old_bucket_cnt - h->migrate_idx, destructor);
+      free (h->old_buckets);
+      h->old_buckets = NULL;
+    }
 
   h->elem_cnt = 0;
 }
@@ -89,6 +91,7 @@ hash_destroy (struct hash *h, hash_action_func *destructor)
   if (destructor != NULL)
     hash_clear (h, destructor);
   free (h->buckets);
+  free (h->old_buckets);
 }
 
 /* Inserts NEW into hash table H and returns a null pointer, if
@@ -98,8 +101,8 @@ hash_destroy (struct hash *h, hash_action_func *destructor)
 struct hash_elem *
 hash_insert (struct hash *h, struct hash_elem *new)
 {
-  struct list *bucket = find_bucket (h, new);
-  struct hash_elem *old = find_elem (h, bucket, new);
+  struct list *bucket;
+  struct hash_elem *old = lookup (h, new, &bucket);
 
   if (old == NULL) 
     insert_elem (h, bucket, new);
@@ -114,8 +117,8 @@ hash_insert (struct hash *h, struct hash_elem *new)
 struct hash_elem *
 hash_replace (struct hash *h, struct hash_elem *new) 
 {
-  struct list *bucket = find_bucket (h, new);
-  struct hash_elem *old = find_elem (h, bucket, new);
+  struct list *bucket;
+  struct hash_elem *old = lookup (h, new, &bucket);
 
   if (old != NULL)
     remove_elem (h, old);
@@ -131,7 +134,7 @@ hash_replace (struct hash *h, struct hash_elem *new)
 struct hash_elem *
 hash_find (struct hash *h, struct hash_elem *e) 
 {
-  return find_elem (h, find_bucket (h, e), e);
+  return lookup (h, e, NULL);
 }
 
 /* Finds, removes, and returns an element equal to E in hash
@@ -144,7 +147,7 @@ hash_find (struct hash *h, struct hash_elem *e)
 struct hash_elem *
 hash_delete (struct hash *h, struct hash_elem *e)
 {
-  struct hash_elem *found = find_elem (h, find_bucket (h, e), e);
+  struct hash_elem *found = lookup (h, e, NULL);
   if (found != NULL) 
     {
       remove_elem (h, found);
@@ -162,13 +165,12 @@ hash_delete (struct hash *h, struct hash_elem *e)
 void
 hash_apply (struct hash *h, hash_action_func *action) 
 {
-  size_t i;
+  struct list *bucket;
   
   ASSERT (action != NULL);
 
-  for (i = 0; i < h->bucket_cnt; i++) 
+  for (bucket = h->buckets; bucket != NULL; bucket = next_bucket (h, bucket))
     {
-      struct list *bucket = &h->buckets[i];
       struct list_elem *elem, *next;
 
       for (elem = list_begin (bucket); elem != list_end (bucket); elem = next) 
@@ -223,7 +225,8 @@ hash_next (struct hash_iterator *i)
   i->elem = list_elem_to_hash_elem (list_next (&i->elem->list_elem));
   while (i->elem == list_elem_to_hash_elem (list_end (i->bucket)))
     {
-      if (++i->bucket >= i->hash->buckets + i->hash->bucket_cnt)
+      i->bucket = next_bucket (i->hash, i->bucket);
+      if (i->bucket == NULL)
         {
           i->elem = NULL;
           break;
@@ -257,50 +260,101 @@ hash_empty (struct hash *h)
   return h->elem_cnt == 0;
 }
 
-/* Fowler-Noll-Vo hash constants, for 32-bit word sizes. */
-#define FNV_32_PRIME 16777619u
-#define FNV_32_BASIS 2166136261u
+/* The hash functions below are MurmurHash3 (x86, 32-bit) by
+   Austin Appleby, which is in the public domain.  It consumes
+   its input 4 bytes at a time and ends with a finalizer in which
+   every input bit affects every output bit, so the low bits used
+   to pick a bucket are well mixed even for sequential keys. */
+#define MURMUR_C1 0xcc9e2d51u
+#define MURMUR_C2 0x1b873593u
+#define MURMUR_SEED 0x9747b28cu
+
+/* Returns X rotated left by N bits, for 0 < N < 32. */
+static inline unsigned
+rotl (unsigned x, int n)
+{
+  return (x << n) | (x >> (32 - n));
+}
+
+/* Scrambles block K for mixing into a MurmurHash3 state. */
+static inline unsigned
+murmur_block (unsigned k)
+{
+  k *= MURMUR_C1;
+  k = rotl (k, 15);
+  return k * MURMUR_C2;
+}
+
+/* MurmurHash3 finalizer: mixes the bits of H thoroughly. */
+static inline unsigned
+murmur_fmix (unsigned h)
+{
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
 
 /* Returns a hash of the SIZE bytes in BUF. */
 unsigned
 hash_bytes (const void *buf_, size_t size)
 {
-  /* Fowler-Noll-Vo 32-bit hash, for bytes. */
-  const unsigned char *buf = buf_;
-  unsigned hash;
+  const uint8_t *buf = buf_;
+  unsigned hash = MURMUR_SEED;
+  unsigned k;
+  size_t i;
+
+  ASSERT (buf != NULL || size == 0);
 
-  ASSERT (buf != NULL);
+  /* Whole words.  x86 allows unaligned loads, so BUF need not be
+     aligned, and the hash does not depend on its alignment. */
+  for (i = 0; i + 4 <= size; i += 4)
+    {
+      hash ^= murmur_block (*(const uint32_t *) (buf + i));
+      hash = rotl (hash, 13);
+      hash = hash * 5 + 0xe6546b64u;
+    }
 
-  hash = FNV_32_BASIS;
-  while (size-- > 0)
-    hash = (hash * FNV_32_PRIME) ^ *buf++;
+  /* Remaining 0 to 3 bytes. */
+  k = 0;
+  switch (size & 3)
+    {
+    case 3:
+      k ^= buf[i + 2] << 16;
+      /* Fall through. */
+    case 2:
+      k ^= buf[i + 1] << 8;
+      /* Fall through. */
+    case 1:
+      k ^= buf[i];
+      hash ^= murmur_block (k);
+    }
 
-  return hash;
+  return murmur_fmix (hash ^ size);
 } 
 
-/* Returns a hash of string S. */
+/* Returns a hash of string S, the same as hash_bytes() over its
+   characters, not including the null terminator. */
 unsigned
-hash_string (const char *s_) 
+hash_string (const char *s) 
 {
-  const unsigned char *s = (const unsigned char *) s_;
-  unsigned hash;
-
   ASSERT (s != NULL);
 
-  hash = FNV_32_BASIS;
-  while (*s != '\0')
-    hash = (hash * FNV_32_PRIME) ^ *s++;
-
-  return hash;
+  return hash_bytes (s, strlen (s));
 }
 
-/* Returns a hash of integer I. */
+/* Returns a hash of integer I.  Both steps are bijections on
+   32-bit values, so distinct integers never collide, and the
+   finalizer spreads sequential page and sector numbers across
+   all the bits. */
 unsigned
 hash_int (int i) 
 {
-  return hash_bytes (&i, sizeof i);
+  return murmur_fmix ((unsigned) i * MURMUR_C1);
 }
-
+
 /* Returns the bucket in H that E belongs in. */
 static struct list *
 find_bucket (struct hash *h, struct hash_elem *e) 
@@ -325,6 +379,75 @@ find_elem (struct hash *h, struct list *bucket, struct hash_elem *e)
   return NULL;
 }
 
+/* Searches H for a hash element equal to E, looking in the old
+   bucket array too while a migration is in progress.  Returns it
+   if found or a null pointer otherwise.  If BUCKETP is non-null,
+   stores the bucket where E belongs, which is always in the
+   current array, in *BUCKETP. */
+static struct hash_elem *
+lookup (struct hash *h, struct hash_elem *e, struct list **bucketp)
+{
+  unsigned hash = h->hash (e, h->aux);
+  struct list *bucket = &h->buckets[hash & (h->bucket_cnt - 1)];
+  struct hash_elem *found = find_elem (h, bucket, e);
+
+  if (found == NULL && h->old_buckets != NULL)
+    {
+      size_t old_idx = hash & (h->old_bucket_cnt - 1);
+      if (old_idx >= h->migrate_idx)
+        found = find_elem (h, &h->old_buckets[old_idx], e);
+    }
+
+  if (bucketp != NULL)
+    *bucketp = bucket;
+  return found;
+}
+
+/* Returns the bucket in H that follows BUCKET, or a null pointer
+   if BUCKET is the last one.  The buckets of the current array
+   come first, followed by those of the old array that have not
+   been migrated yet. */
+static struct list *
+next_bucket (struct hash *h, struct list *bucket)
+{
+  if (bucket >= h->buckets && bucket < h->buckets + h->bucket_cnt)
+    {
+      if (++bucket < h->buckets + h->bucket_cnt)
+        return bucket;
+      if (h->old_buckets == NULL)
+        return NULL;
+      bucket = h->old_buckets + h->migrate_idx;
+    }
+  else
+    bucket++;
+
+  return bucket < h->old_buckets + h->old_bucket_cnt ? bucket : NULL;
+}
+
+/* Empties the CNT buckets starting at BUCKETS in H, calling
+   DESTRUCTOR, if non-null, for each element. */
+static void
+clear_buckets (struct hash *h, struct list *buckets, size_t cnt,
+               hash_action_func *destructor)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++) 
+    {
+      struct list *bucket = &buckets[i];
+
+      if (destructor != NULL) 
+        while (!list_empty (bucket)) 
+          {
+            struct list_elem *list_elem = list_pop_front (bucket);
+            struct hash_elem *hash_elem = list_elem_to_hash_elem (list_elem);
+            destructor (hash_elem, h->aux);
+          }
+
+      list_init (bucket); 
+    }    
+}
+
 /* Returns X with its lowest-order bit set to 1 turned off. */
 static inline size_t
 turn_off_least_1bit (size_t x) 
@@ -339,41 +462,56 @@ is_power_of_2 (size_t x)
   return x != 0 && turn_off_least_1bit (x) == 0;
 }
 
-/* Element per bucket ratios. */
+/* Element per bucket ratios.  Doubling the number of buckets
+   when there are more than 4 elements per bucket, or halving it
+   when there are fewer than 1, leaves about 2 per bucket. */
 #define MIN_ELEMS_PER_BUCKET  1 /* Elems/bucket < 1: reduce # of buckets. */
-#define BEST_ELEMS_PER_BUCKET 2 /* Ideal elems/bucket. */
 #define MAX_ELEMS_PER_BUCKET  4 /* Elems/bucket > 4: increase # of buckets. */
 
-/* Changes the number of buckets in hash table H to match the
-   ideal.  This function can fail because of an out-of-memory
-   condition, but that'll just make hash accesses less efficient;
-   we can still continue. */
+/* Old buckets moved to the new array per insertion, replacement,
+   or deletion.  Growing from N to 2N buckets happens at 4N
+   elements and the next growth at 8N, while shrinking from N to
+   N/2 happens at N elements and the next at N/2, so moving 2
+   buckets per operation always finishes one migration before the
+   next one is due. */
+#define MIGRATE_BUCKETS 2
+
+/* Moves up to CNT of the old buckets in H into the current
+   bucket array, and frees the old array once it is empty. */
 static void
-rehash (struct hash *h) 
+migrate (struct hash *h, size_t cnt)
 {
-  size_t old_bucket_cnt, new_bucket_cnt;
-  struct list *new_buckets, *old_buckets;
-  size_t i;
+  for (; cnt > 0 && h->migrate_idx < h->old_bucket_cnt; cnt--)
+    {
+      struct list *old_bucket = &h->old_buckets[h->migrate_idx++];
 
-  ASSERT (h != NULL);
+      while (!list_empty (old_bucket))
+        {
+          struct list_elem *elem = list_pop_front (old_bucket);
+          list_push_front (find_bucket (h, list_elem_to_hash_elem (elem)),
+                           elem);
+        }
+    }
 
-  /* Save old bucket info for later use. */
-  old_buckets = h->buckets;
-  old_bucket_cnt = h->bucket_cnt;
+  if (h->migrate_idx >= h->old_bucket_cnt)
+    {
+      free (h->old_buckets);
+      h->old_buckets = NULL;
+    }
+}
 
-  /* Calculate the number of buckets to use now.
-     We want one bucket for about every BEST_ELEMS_PER_BUCKET.
-     We must have at least four buckets, and the number of
-     buckets must be a power of 2. */
-  new_bucket_cnt = h->elem_cnt / BEST_ELEMS_PER_BUCKET;
-  if (new_bucket_cnt < 4)
-    new_bucket_cnt = 4;
-  while (!is_power_of_2 (new_bucket_cnt))
-    new_bucket_cnt = turn_off_least_1bit (new_bucket_cnt);
+/* Starts moving the elements of H into a new array of
+   NEW_BUCKET_CNT buckets.  This function can fail because of an
+   out-of-memory condition, but that'll just make hash accesses
+   less efficient; we can still continue. */
+static void
+resize (struct hash *h, size_t new_bucket_cnt)
+{
+  struct list *new_buckets;
+  size_t i;
 
-  /* Don't do anything if the bucket count wouldn't change. */
-  if (new_bucket_cnt == old_bucket_cnt)
-    return;
+  ASSERT (h->old_buckets == NULL);
+  ASSERT (is_power_of_2 (new_bucket_cnt));
 
   /* Allocate new buckets and initialize them as empty. */
   new_buckets = malloc (sizeof *new_buckets * new_bucket_cnt);
@@ -387,29 +525,36 @@ rehash (struct hash *h)
   for (i = 0; i < new_bucket_cnt; i++) 
     list_init (&new_buckets[i]);
 
-  /* Install new bucket info. */
+  /* Install new bucket info, keeping the old buckets until
+     migrate() has emptied them. */
+  h->old_buckets = h->buckets;
+  h->old_bucket_cnt = h->bucket_cnt;
+  h->migrate_idx = 0;
   h->buckets = new_buckets;
   h->bucket_cnt = new_bucket_cnt;
+}
 
-  /* Move each old element into the appropriate new bucket. */
-  for (i = 0; i < old_bucket_cnt; i++) 
-    {
-      struct list *old_bucket;
-      struct list_elem *elem, *next;
+/* Moves hash table H a step closer to the ideal number of
+   buckets: continues a migration in progress, or starts one if
+   the number of elements per bucket is out of range.  Each call
+   does a bounded amount of work. */
+static void
+rehash (struct hash *h) 
+{
+  ASSERT (h != NULL);
 
-      old_bucket = &old_buckets[i];
-      for (elem = list_begin (old_bucket);
-           elem != list_end (old_bucket); elem = next) 
-        {
-          struct list *new_bucket
-            = find_bucket (h, list_elem_to_hash_elem (elem));
-          next = list_next (elem);
-          list_remove (elem);
-          list_push_front (new_bucket, elem);
-        }
+  if (h->old_buckets == NULL)
+    {
+      /* We must have at least four buckets. */
+      if (h->elem_cnt > h->bucket_cnt * MAX_ELEMS_PER_BUCKET)
+        resize (h, h->bucket_cnt * 2);
+      else if (h->bucket_cnt > 4
+               && h->elem_cnt < h->bucket_cnt * MIN_ELEMS_PER_BUCKET)
+        resize (h, h->bucket_cnt / 2);
     }
 
-  free (old_buckets);
+  if (h->old_buckets != NULL)
+    migrate (h, MIGRATE_BUCKETS);
 }
 
 /* Inserts E into BUCKET (in hash table H). */
@@ -18,7 +18,15 @@
    conversion from a struct hash_elem back to a structure object
    that contains it.  This is the same technique used in the
    linked list implementation.  Refer to lib/kernel/list.h for a
-   detailed explanation. */
+   detailed explanation.
+
+   The number of buckets doubles or halves as the table grows or
+   shrinks.  Rather than moving every element at once, which
+   would make a single insertion or deletion take time
+   proportional to the size of the table, the table keeps the old
+   bucket array around and moves a few of its buckets into the
+   new array during each later insertion, replacement, or
+   deletion.  Until that is done, lookups check both arrays. */
 
 #include <stdbool.h>
 #include <stddef.h>
@@ -61,6 +69,9 @@ struct hash
     size_t elem_cnt;            /* Number of elements in table. */
     size_t bucket_cnt;          /* Number of buckets, a power of 2. */
     struct list *buckets;       /* Array of `bucket_cnt' lists. */
+    struct list *old_buckets;   /* Buckets being migrated, or null. */
+    size_t old_bucket_cnt;      /* Number of old buckets, a power of 2. */
+    size_t migrate_idx;         /* Old buckets before this are empty. */
     hash_hash_func *hash;       /* Hash function. */
     hash_less_func *less;       /* Comparison function. */
     void *aux;                  /* Auxiliary data for `hash' and `less'. */
@@ -0,0 +1,42 @@
+#include "hist.h"
+#include <stdio.h>
+
+/* Counts VALUE in histogram H. */
+void
+hist_add (histogram h, uint64_t value)
+{
+  int bucket = 0;
+
+  while (value > 1 && bucket < HIST_BUCKETS - 1)
+    {
+      value >>= 1;
+      bucket++;
+    }
+  h[bucket]++;
+}
+
+/* Prints TITLE and the non-empty buckets of histogram H, each as
+   its smallest value and its count, on one line. */
+void
+hist_print (const char *title, const histogram h)
+{
+  int i;
+
+  printf (" %s", title);
+  for (i = 0; i < HIST_BUCKETS; i++)
+    if (h[i] > 0)
+      printf (" %llu:%llu", 1ULL << i, h[i]);
+  printf ("\n");
+}
+
+/* Returns the number of values counted in histogram H. */
+uint64_t
+hist_count (const histogram h)
+{
+  uint64_t cnt = 0;
+  int i;
+
+  for (i = 0; i < HIST_BUCKETS; i++)
+    cnt += h[i];
+  return cnt;
+}
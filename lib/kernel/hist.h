@@ -0,0 +1,16 @@
+#ifndef __LIB_KERNEL_HIST_H
+#define __LIB_KERNEL_HIST_H
+
+#include <stdint.h>
+
+/* Histograms with logarithmic buckets.  Bucket I counts values
+   from 2**I up to 2**(I + 1) - 1, the last bucket also anything
+   larger, and bucket 0 also zero. */
+#define HIST_BUCKETS 40
+typedef unsigned long long histogram[HIST_BUCKETS];
+
+void hist_add (histogram, uint64_t value);
+void hist_print (const char *title, const histogram);
+uint64_t hist_count (const histogram);
+
+#endif /* lib/kernel/hist.h */
@@ -219,6 +219,23 @@ list_push_back (struct list *list, struct list_elem *elem)
   list_insert (list_end (list), elem);
 }
 
+/* Inserts ELEM at the end of LIST, like list_push_back(), but
+   links it in only once it points into LIST, so that code walking
+   LIST forward meanwhile, without a lock, sees either the old list
+   or the new one.  See threads/rcu.h. */
+void
+list_push_back_rcu (struct list *list, struct list_elem *elem)
+{
+  ASSERT (list != NULL);
+  ASSERT (elem != NULL);
+
+  elem->prev = list->tail.prev;
+  elem->next = &list->tail;
+  asm volatile ("" : : : "memory");
+  list->tail.prev->next = elem;
+  list->tail.prev = elem;
+}
+
 /* Removes ELEM from its list and returns the element that
    followed it.  Undefined behavior if ELEM is not in a list.
 
@@ -349,92 +366,121 @@ is_sorted (struct list_elem *a, struct list_elem *b,
   return true;
 }
 
-/* Finds a run, starting at A and ending not after B, of list
-   elements that are in nondecreasing order according to LESS
-   given auxiliary data AUX.  Returns the (exclusive) end of the
-   run.
-   A through B (exclusive) must form a non-empty range. */
+/* Returns the end of the run of list elements in nondecreasing
+   order according to LESS given auxiliary data AUX that starts
+   at A, in a null-terminated chain linked through `next'.  The
+   run is cut off from the rest of the chain, whose first element
+   is stored in *REST.  A must not be null. */
 static struct list_elem *
-find_end_of_run (struct list_elem *a, struct list_elem *b,
-                 list_less_func *less, void *aux)
+take_run (struct list_elem *a, struct list_elem **rest,
+          list_less_func *less, void *aux)
 {
+  struct list_elem *run = a;
+
   ASSERT (a != NULL);
-  ASSERT (b != NULL);
-  ASSERT (less != NULL);
-  ASSERT (a != b);
-  
-  do 
-    {
-      a = list_next (a);
-    }
-  while (a != b && !less (a, list_prev (a), aux));
-  return a;
+
+  while (a->next != NULL && !less (a->next, a, aux))
+    a = a->next;
+  *rest = a->next;
+  a->next = NULL;
+  return run;
 }
 
-/* Merges A0 through A1B0 (exclusive) with A1B0 through B1
-   (exclusive) to form a combined range also ending at B1
-   (exclusive).  Both input ranges must be nonempty and sorted in
-   nondecreasing order according to LESS given auxiliary data
-   AUX.  The output range will be sorted the same way. */
-static void
-inplace_merge (struct list_elem *a0, struct list_elem *a1b0,
-               struct list_elem *b1,
-               list_less_func *less, void *aux)
+/* Merges A and B, null-terminated chains linked through `next'
+   that are each sorted in nondecreasing order according to LESS
+   given auxiliary data AUX, and returns the merged chain.  Equal
+   elements from A come before those from B, so the sort is
+   stable as long as A holds the earlier elements. */
+static struct list_elem *
+merge (struct list_elem *a, struct list_elem *b,
+       list_less_func *less, void *aux)
 {
-  ASSERT (a0 != NULL);
-  ASSERT (a1b0 != NULL);
-  ASSERT (b1 != NULL);
-  ASSERT (less != NULL);
-  ASSERT (is_sorted (a0, a1b0, less, aux));
-  ASSERT (is_sorted (a1b0, b1, less, aux));
+  struct list_elem head;
+  struct list_elem *tail = &head;
 
-  while (a0 != a1b0 && a1b0 != b1)
-    if (!less (a1b0, a0, aux)) 
-      a0 = list_next (a0);
-    else 
+  while (a != NULL && b != NULL)
+    if (!less (b, a, aux))
+      {
+        tail->next = a;
+        tail = a;
+        a = a->next;
+      }
+    else
       {
-        a1b0 = list_next (a1b0);
-        list_splice (a0, list_prev (a1b0), a1b0);
+        tail->next = b;
+        tail = b;
+        b = b->next;
       }
+  tail->next = a != NULL ? a : b;
+  return head.next;
 }
 
+/* Maximum number of pending runs in list_sort().  Run I holds
+   about 2**I of the input's natural runs, so this many covers
+   any list that fits in memory. */
+#define MAX_PENDING 32
+
 /* Sorts LIST according to LESS given auxiliary data AUX, using a
-   natural iterative merge sort that runs in O(n lg n) time and
-   O(1) space in the number of elements in LIST. */
+   natural bottom-up merge sort that runs in O(n lg n) time and
+   O(1) space in the number of elements in LIST.  The sort is
+   stable, and input that is already sorted takes O(n) time.
+
+   The list is taken apart into its runs of nondecreasing
+   elements, which are merged like the digits of a binary counter
+   being incremented: PENDING[I] is either empty or the result of
+   merging 2**I runs, so every merge combines two lists of
+   similar length. */
 void
 list_sort (struct list *list, list_less_func *less, void *aux)
 {
-  size_t output_run_cnt;        /* Number of runs output in current pass. */
+  struct list_elem *pending[MAX_PENDING];
+  struct list_elem *rest, *run, *e, *prev;
+  int i, top;
 
   ASSERT (list != NULL);
   ASSERT (less != NULL);
 
-  /* Pass over the list repeatedly, merging adjacent runs of
-     nondecreasing elements, until only one run is left. */
-  do
-    {
-      struct list_elem *a0;     /* Start of first run. */
-      struct list_elem *a1b0;   /* End of first run, start of second. */
-      struct list_elem *b1;     /* End of second run. */
+  if (list_empty (list))
+    return;
+
+  /* Turn the list into a null-terminated chain. */
+  list_back (list)->next = NULL;
+  rest = list_front (list);
 
-      output_run_cnt = 0;
-      for (a0 = list_begin (list); a0 != list_end (list); a0 = b1)
+  /* Merge each run into the pending runs. */
+  top = 0;
+  while (rest != NULL)
+    {
+      run = take_run (rest, &rest, less, aux);
+      for (i = 0; i < top && pending[i] != NULL; i++)
+        {
+          run = merge (pending[i], run, less, aux);
+          pending[i] = NULL;
+        }
+      if (i == top)
         {
-          /* Each iteration produces one output run. */
-          output_run_cnt++;
-
-          /* Locate two adjacent runs of nondecreasing elements
-             A0...A1B0 and A1B0...B1. */
-          a1b0 = find_end_of_run (a0, list_end (list), less, aux);
-          if (a1b0 == list_end (list))
-            break;
-          b1 = find_end_of_run (a1b0, list_end (list), less, aux);
-
-          /* Merge the runs. */
-          inplace_merge (a0, a1b0, b1, less, aux);
+          ASSERT (top < MAX_PENDING);
+          top++;
         }
+      pending[i] = run;
     }
-  while (output_run_cnt > 1);
+
+  /* Merge the pending runs, newest (and shortest) first. */
+  run = NULL;
+  for (i = 0; i < top; i++)
+    if (pending[i] != NULL)
+      run = run != NULL ? merge (pending[i], run, less, aux) : pending[i];
+
+  /* Restore the `prev' links and put the chain back into LIST. */
+  prev = &list->head;
+  for (e = run; e != NULL; e = e->next)
+    {
+      e->prev = prev;
+      prev->next = e;
+      prev = e;
+    }
+  prev->next = &list->tail;
+  list->tail.prev = prev;
 
   ASSERT (is_sorted (list_begin (list), list_end (list), less, aux));
 }
@@ -458,6 +504,27 @@ list_insert_ordered (struct list *list, struct list_elem *elem,
   return list_insert (e, elem);
 }
 
+/* Inserts ELEM in the same position as list_insert_ordered(),
+   but searches LIST from the back, so it runs in O(1) time
+   when ELEM belongs at or near the end, as when elements are
+   usually added in order.  Runs in O(n) average case in the
+   number of elements in LIST otherwise. */
+void
+list_insert_ordered_back (struct list *list, struct list_elem *elem,
+                          list_less_func *less, void *aux)
+{
+  struct list_elem *e;
+
+  ASSERT (list != NULL);
+  ASSERT (elem != NULL);
+  ASSERT (less != NULL);
+
+  for (e = list_rbegin (list); e != list_rend (list); e = list_prev (e))
+    if (!less (elem, e, aux))
+      break;
+  return list_insert (list_next (e), elem);
+}
+
 /* Iterates through LIST and removes all but the first in each
    set of adjacent elements that are equal according to LESS
    given auxiliary data AUX.  If DUPLICATES is non-null, then the
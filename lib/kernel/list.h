@@ -142,6 +142,7 @@ void list_splice (struct list_elem *before,
                   struct list_elem *first, struct list_elem *last);
 void list_push_front (struct list *, struct list_elem *);
 void list_push_back (struct list *, struct list_elem *);
+void list_push_back_rcu (struct list *, struct list_elem *);
 
 /* List removal. */
 struct list_elem *list_remove (struct list_elem *);
@@ -171,6 +172,8 @@ void list_sort (struct list *,
                 list_less_func *, void *aux);
 void list_insert_ordered (struct list *, struct list_elem *,
                           list_less_func *, void *aux);
+void list_insert_ordered_back (struct list *, struct list_elem *,
+                               list_less_func *, void *aux);
 void list_unique (struct list *, struct list *duplicates,
                   list_less_func *, void *aux);
 
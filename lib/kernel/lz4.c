@@ -0,0 +1,205 @@
+/* LZ4 block compression.
+
+   See lz4.h for basic information. */
+
+#include "lz4.h"
+#include <string.h>
+#include "../debug.h"
+
+/* Shortest match worth encoding. */
+#define MIN_MATCH 4
+
+/* The last sequence holds at least this many literals, and no
+   match starts this close to the end of the input. */
+#define LAST_LITERALS 5
+#define MATCH_LIMIT 12
+
+/* Returns the 4 bytes at P, which need not be aligned. */
+static inline uint32_t
+read32 (const uint8_t *p)
+{
+  uint32_t v;
+  memcpy (&v, p, sizeof v);
+  return v;
+}
+
+/* Returns the position table index for the 4 bytes V. */
+static inline unsigned
+hash_bytes (uint32_t v)
+{
+  return (v * 2654435761u) >> (32 - LZ4_HASH_LOG);
+}
+
+/* Appends the continuation bytes of count LEN, already reduced by
+   15, at *OP, which must stay before OEND.  Returns false if there
+   is no room. */
+static bool
+put_count (uint8_t **op, const uint8_t *oend, size_t len)
+{
+  for (; len >= 255; len -= 255)
+    {
+      if (*op >= oend)
+        return false;
+      *(*op)++ = 255;
+    }
+  if (*op >= oend)
+    return false;
+  *(*op)++ = len;
+  return true;
+}
+
+/* Appends a sequence of the LIT_LEN literal bytes at LIT followed,
+   if MATCH_LEN is nonzero, by a match of MATCH_LEN bytes at
+   OFFSET bytes back, at *OP, which must stay before OEND.
+   Returns false if there is no room. */
+static bool
+put_sequence (uint8_t **op, const uint8_t *oend, const uint8_t *lit,
+              size_t lit_len, size_t offset, size_t match_len)
+{
+  size_t match_code = match_len > 0 ? match_len - MIN_MATCH : 0;
+
+  if (*op >= oend)
+    return false;
+  *(*op)++ = ((lit_len < 15 ? lit_len : 15) << 4
+              | (match_code < 15 ? match_code : 15));
+  if (lit_len >= 15 && !put_count (op, oend, lit_len - 15))
+    return false;
+  if ((size_t) (oend - *op) < lit_len)
+    return false;
+  memcpy (*op, lit, lit_len);
+  *op += lit_len;
+
+  if (match_len == 0)
+    return true;
+  if (oend - *op < 2)
+    return false;
+  *(*op)++ = offset;
+  *(*op)++ = offset >> 8;
+  return match_code < 15 || put_count (op, oend, match_code - 15);
+}
+
+/* Compresses the SRC_SIZE bytes at SRC into the DST_SIZE bytes
+   at DST, using TABLE, which must have LZ4_HASH_SIZE entries, to
+   find matches.  Returns the size of the compressed data, or 0
+   if it would not fit in DST_SIZE bytes. */
+size_t
+lz4_compress (const void *src_, size_t src_size,
+              void *dst_, size_t dst_size, uint16_t *table)
+{
+  const uint8_t *src = src_;
+  const uint8_t *end = src + src_size;
+  const uint8_t *ip = src;
+  const uint8_t *anchor = src;
+  uint8_t *op = dst_;
+  const uint8_t *oend = op + dst_size;
+
+  ASSERT (src_size <= LZ4_MAX_INPUT);
+
+  memset (table, 0, LZ4_HASH_SIZE * sizeof *table);
+  if (src_size > MATCH_LIMIT)
+    {
+      const uint8_t *match_start_limit = end - MATCH_LIMIT;
+      const uint8_t *match_end_limit = end - LAST_LITERALS;
+
+      while (ip < match_start_limit)
+        {
+          uint32_t seq = read32 (ip);
+          unsigned h = hash_bytes (seq);
+          const uint8_t *ref = src + table[h];
+          const uint8_t *m, *r;
+
+          table[h] = ip - src;
+          if (ref >= ip || read32 (ref) != seq)
+            {
+              /* Move faster through data that does not match. */
+              ip += 1 + ((ip - anchor) >> 6);
+              continue;
+            }
+
+          m = ip + MIN_MATCH;
+          r = ref + MIN_MATCH;
+          while (m < match_end_limit && *m == *r)
+            m++, r++;
+          if (!put_sequence (&op, oend, anchor, ip - anchor, ip - ref,
+                             m - ip))
+            return 0;
+          ip = anchor = m;
+        }
+    }
+
+  if (!put_sequence (&op, oend, anchor, end - anchor, 0, 0))
+    return 0;
+  return op - (uint8_t *) dst_;
+}
+
+/* Decompresses the SRC_SIZE bytes of compressed data at SRC into
+   the DST_SIZE bytes at DST.  Returns true if successful, false
+   if the data is corrupt or does not decompress to exactly
+   DST_SIZE bytes. */
+bool
+lz4_decompress (const void *src_, size_t src_size,
+                void *dst_, size_t dst_size)
+{
+  const uint8_t *ip = src_;
+  const uint8_t *iend = ip + src_size;
+  uint8_t *dst = dst_;
+  uint8_t *op = dst;
+  uint8_t *oend = dst + dst_size;
+
+  while (ip < iend)
+    {
+      unsigned token = *ip++;
+      size_t lit_len = token >> 4;
+      size_t match_len = token & 15;
+      size_t offset;
+      const uint8_t *ref;
+
+      if (lit_len == 15)
+        {
+          uint8_t b;
+          do
+            {
+              if (ip >= iend)
+                return false;
+              b = *ip++;
+              lit_len += b;
+            }
+          while (b == 255);
+        }
+      if (lit_len > (size_t) (iend - ip) || lit_len > (size_t) (oend - op))
+        return false;
+      memcpy (op, ip, lit_len);
+      op += lit_len;
+      ip += lit_len;
+      if (ip >= iend)
+        break;
+
+      if (iend - ip < 2)
+        return false;
+      offset = ip[0] | (ip[1] << 8);
+      ip += 2;
+      if (offset == 0 || offset > (size_t) (op - dst))
+        return false;
+      if (match_len == 15)
+        {
+          uint8_t b;
+          do
+            {
+              if (ip >= iend)
+                return false;
+              b = *ip++;
+              match_len += b;
+            }
+          while (b == 255);
+        }
+      match_len += MIN_MATCH;
+      if (match_len > (size_t) (oend - op))
+        return false;
+
+      /* Byte by byte, since the match may overlap its own
+         output, as in a run of one repeated byte. */
+      for (ref = op - offset; match_len > 0; match_len--)
+        *op++ = *ref++;
+    }
+  return op == oend;
+}
@@ -0,0 +1,36 @@
+#ifndef __LIB_KERNEL_LZ4_H
+#define __LIB_KERNEL_LZ4_H
+
+/* LZ4 block compression.
+
+   The compressed form is a series of sequences, each a token
+   byte giving a count of literal bytes and the length of a match,
+   the literal bytes themselves, then a 2-byte little-endian offset
+   back into the data already produced from which to copy the
+   match.  Counts of 15 or more continue in further bytes, and the
+   last sequence has literals only, as in the LZ4 block format.
+
+   Matches are found through a table of recent positions indexed
+   by a hash of the 4 bytes found there, which the caller supplies
+   so that it need not live on the kernel stack.  Compression is
+   greedy and single-pass: it trades ratio for speed, which is the
+   right trade for data that is about to be read back. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Number of entries in the position table that lz4_compress()
+   takes. */
+#define LZ4_HASH_LOG 12
+#define LZ4_HASH_SIZE (1u << LZ4_HASH_LOG)
+
+/* Largest amount of data that can be compressed at once. */
+#define LZ4_MAX_INPUT 65535
+
+size_t lz4_compress (const void *src, size_t src_size,
+                     void *dst, size_t dst_size, uint16_t *table);
+bool lz4_decompress (const void *src, size_t src_size,
+                     void *dst, size_t dst_size);
+
+#endif /* lib/kernel/lz4.h */
@@ -0,0 +1,357 @@
+/* Open-addressing hash table.
+
+   See ohash.h for basic information. */
+
+#include "ohash.h"
+#include "../debug.h"
+#include "threads/malloc.h"
+
+/* Smallest number of slots a table has. */
+#define MIN_SLOTS 8
+
+static size_t find_slot (struct ohash *, struct ohash_elem *, unsigned hash);
+static void insert_new (struct ohash *, size_t slot, struct ohash_elem *);
+static void remove_slot (struct ohash *, size_t slot);
+static bool resize (struct ohash *, size_t slot_cnt);
+
+/* Initializes hash table H to compute hash values using HASH and
+   compare hash elements using LESS, given auxiliary data AUX.
+   Returns true if successful, false if memory for the slot array
+   could not be allocated. */
+bool
+ohash_init (struct ohash *h,
+            ohash_hash_func *hash, ohash_less_func *less, void *aux)
+{
+  h->elem_cnt = 0;
+  h->slot_cnt = MIN_SLOTS;
+  h->slots = calloc (h->slot_cnt, sizeof *h->slots);
+  h->hash = hash;
+  h->less = less;
+  h->aux = aux;
+
+  return h->slots != NULL;
+}
+
+/* Removes all the elements from H.
+
+   If DESTRUCTOR is non-null, then it is called for each element
+   in the hash.  DESTRUCTOR may, if appropriate, deallocate the
+   memory used by the hash element.  However, modifying hash
+   table H while ohash_clear() is running, using any of the
+   functions ohash_clear(), ohash_destroy(), ohash_insert(),
+   ohash_replace(), or ohash_delete(), yields undefined behavior,
+   whether done in DESTRUCTOR or elsewhere. */
+void
+ohash_clear (struct ohash *h, ohash_action_func *destructor)
+{
+  size_t i;
+
+  for (i = 0; i < h->slot_cnt; i++)
+    {
+      struct ohash_elem *e = h->slots[i].elem;
+
+      if (e != NULL)
+        {
+          h->slots[i].elem = NULL;
+          if (destructor != NULL)
+            destructor (e, h->aux);
+        }
+    }
+
+  h->elem_cnt = 0;
+}
+
+/* Destroys hash table H.
+
+   If DESTRUCTOR is non-null, then it is first called for each
+   element in the hash, with the same restrictions as in
+   ohash_clear(). */
+void
+ohash_destroy (struct ohash *h, ohash_action_func *destructor)
+{
+  if (destructor != NULL)
+    ohash_clear (h, destructor);
+  free (h->slots);
+}
+
+/* Makes room for one more element in H, growing the slot array
+   once it would be more than 3/4 full.  If growing fails, the
+   table keeps filling up, and only a table with no empty slot
+   left is fatal, because probing relies on finding one. */
+static void
+reserve (struct ohash *h)
+{
+  if ((h->elem_cnt + 1) * 4 <= h->slot_cnt * 3)
+    return;
+  if (!resize (h, h->slot_cnt * 2) && h->elem_cnt + 1 >= h->slot_cnt)
+    PANIC ("out of memory growing hash table of %zu elements",
+           h->elem_cnt);
+}
+
+/* Inserts NEW into hash table H and returns a null pointer, if
+   no equal element is already in the table.
+   If an equal element is already in the table, returns it
+   without inserting NEW. */
+struct ohash_elem *
+ohash_insert (struct ohash *h, struct ohash_elem *new)
+{
+  unsigned hash = h->hash (new, h->aux);
+  size_t slot = find_slot (h, new, hash);
+  struct ohash_elem *old = h->slots[slot].elem;
+
+  if (old == NULL)
+    {
+      new->hash = hash;
+      reserve (h);
+      insert_new (h, find_slot (h, new, hash), new);
+    }
+
+  return old;
+}
+
+/* Inserts NEW into hash table H, replacing any equal element
+   already in the table, which is returned. */
+struct ohash_elem *
+ohash_replace (struct ohash *h, struct ohash_elem *new)
+{
+  unsigned hash = h->hash (new, h->aux);
+  size_t slot = find_slot (h, new, hash);
+  struct ohash_elem *old = h->slots[slot].elem;
+
+  new->hash = hash;
+  if (old != NULL)
+    h->slots[slot].elem = new;
+  else
+    {
+      reserve (h);
+      insert_new (h, find_slot (h, new, hash), new);
+    }
+
+  return old;
+}
+
+/* Finds and returns an element equal to E in hash table H, or a
+   null pointer if no equal element exists in the table. */
+struct ohash_elem *
+ohash_find (struct ohash *h, struct ohash_elem *e)
+{
+  return h->slots[find_slot (h, e, h->hash (e, h->aux))].elem;
+}
+
+/* Finds, removes, and returns an element equal to E in hash
+   table H.  Returns a null pointer if no equal element existed
+   in the table.
+
+   If the elements of the hash table are dynamically allocated,
+   or own resources that are, then it is the caller's
+   responsibility to deallocate them. */
+struct ohash_elem *
+ohash_delete (struct ohash *h, struct ohash_elem *e)
+{
+  size_t slot = find_slot (h, e, h->hash (e, h->aux));
+  struct ohash_elem *found = h->slots[slot].elem;
+
+  if (found != NULL)
+    {
+      remove_slot (h, slot);
+
+      /* Shrinking is only an optimization, so failure is fine. */
+      if (h->slot_cnt > MIN_SLOTS && h->elem_cnt * 8 < h->slot_cnt)
+        resize (h, h->slot_cnt / 2);
+    }
+  return found;
+}
+
+/* Calls ACTION for each element in hash table H in arbitrary
+   order.
+   Modifying hash table H while ohash_apply() is running, using
+   any of the functions ohash_clear(), ohash_destroy(),
+   ohash_insert(), ohash_replace(), or ohash_delete(), yields
+   undefined behavior, whether done from ACTION or elsewhere. */
+void
+ohash_apply (struct ohash *h, ohash_action_func *action)
+{
+  size_t i;
+
+  ASSERT (action != NULL);
+
+  for (i = 0; i < h->slot_cnt; i++)
+    if (h->slots[i].elem != NULL)
+      action (h->slots[i].elem, h->aux);
+}
+
+/* Initializes I for iterating hash table H.
+
+   Iteration idiom:
+
+      struct ohash_iterator i;
+
+      ohash_first (&i, h);
+      while (ohash_next (&i))
+        {
+          struct foo *f = ohash_entry (ohash_cur (&i), struct foo, elem);
+          ...do something with f...
+        }
+
+   Modifying hash table H during iteration, using any of the
+   functions ohash_clear(), ohash_destroy(), ohash_insert(),
+   ohash_replace(), or ohash_delete(), invalidates all
+   iterators. */
+void
+ohash_first (struct ohash_iterator *i, struct ohash *h)
+{
+  ASSERT (i != NULL);
+  ASSERT (h != NULL);
+
+  i->hash = h;
+  i->slot = 0;
+  i->elem = NULL;
+}
+
+/* Advances I to the next element in the hash table and returns
+   it.  Returns a null pointer if no elements are left.  Elements
+   are returned in arbitrary order. */
+struct ohash_elem *
+ohash_next (struct ohash_iterator *i)
+{
+  ASSERT (i != NULL);
+
+  i->elem = NULL;
+  while (i->slot < i->hash->slot_cnt)
+    {
+      i->elem = i->hash->slots[i->slot++].elem;
+      if (i->elem != NULL)
+        break;
+    }
+
+  return i->elem;
+}
+
+/* Returns the current element in the hash table iteration, or a
+   null pointer at the end of the table.  Undefined behavior
+   after calling ohash_first() but before ohash_next(). */
+struct ohash_elem *
+ohash_cur (struct ohash_iterator *i)
+{
+  return i->elem;
+}
+
+/* Returns the number of elements in H. */
+size_t
+ohash_size (struct ohash *h)
+{
+  return h->elem_cnt;
+}
+
+/* Returns true if H contains no elements, false otherwise. */
+bool
+ohash_empty (struct ohash *h)
+{
+  return h->elem_cnt == 0;
+}
+
+/* Returns the slot where an element with the given HASH belongs
+   if nothing else were in the way. */
+static inline size_t
+home_slot (const struct ohash *h, unsigned hash)
+{
+  return hash & (h->slot_cnt - 1);
+}
+
+/* Returns the index of the slot in H that holds an element equal
+   to E, whose hash value is HASH, or of the empty slot that ends
+   E's probe sequence if there is no such element.  The element
+   itself is only compared when the stored hash values match. */
+static size_t
+find_slot (struct ohash *h, struct ohash_elem *e, unsigned hash)
+{
+  size_t mask = h->slot_cnt - 1;
+  size_t i;
+
+  for (i = home_slot (h, hash); ; i = (i + 1) & mask)
+    {
+      struct ohash_slot *s = &h->slots[i];
+
+      if (s->elem == NULL)
+        return i;
+      if (s->hash == hash
+          && !h->less (s->elem, e, h->aux) && !h->less (e, s->elem, h->aux))
+        return i;
+    }
+}
+
+/* Stores E, whose hash value is already in E->hash, in the empty
+   SLOT of H. */
+static void
+insert_new (struct ohash *h, size_t slot, struct ohash_elem *e)
+{
+  ASSERT (h->slots[slot].elem == NULL);
+
+  h->slots[slot].hash = e->hash;
+  h->slots[slot].elem = e;
+  h->elem_cnt++;
+}
+
+/* Empties SLOT of H, then closes the hole by moving back each
+   later element of the same run whose home slot does not lie
+   between the hole and the element's current slot.  That keeps
+   every element reachable from its home slot without leaving a
+   "deleted" marker behind. */
+static void
+remove_slot (struct ohash *h, size_t slot)
+{
+  size_t mask = h->slot_cnt - 1;
+  size_t hole = slot;
+  size_t i;
+
+  for (i = (slot + 1) & mask; h->slots[i].elem != NULL; i = (i + 1) & mask)
+    {
+      size_t home = home_slot (h, h->slots[i].hash);
+
+      if (((i - home) & mask) >= ((i - hole) & mask))
+        {
+          h->slots[hole] = h->slots[i];
+          hole = i;
+        }
+    }
+
+  h->slots[hole].elem = NULL;
+  h->elem_cnt--;
+}
+
+/* Moves the elements of H into a new array of SLOT_CNT slots,
+   which must be a power of 2 and have room for all of them.
+   Returns true if successful, false if memory was not available,
+   in which case H is unchanged. */
+static bool
+resize (struct ohash *h, size_t slot_cnt)
+{
+  struct ohash_slot *old_slots = h->slots;
+  size_t old_slot_cnt = h->slot_cnt;
+  struct ohash_slot *new_slots;
+  size_t i;
+
+  ASSERT ((slot_cnt & (slot_cnt - 1)) == 0);
+  ASSERT (slot_cnt > h->elem_cnt);
+
+  new_slots = calloc (slot_cnt, sizeof *new_slots);
+  if (new_slots == NULL)
+    return false;
+
+  h->slots = new_slots;
+  h->slot_cnt = slot_cnt;
+  for (i = 0; i < old_slot_cnt; i++)
+    if (old_slots[i].elem != NULL)
+      {
+        size_t mask = slot_cnt - 1;
+        size_t j;
+
+        for (j = home_slot (h, old_slots[i].hash); new_slots[j].elem != NULL;
+             j = (j + 1) & mask)
+          continue;
+        new_slots[j] = old_slots[i];
+      }
+
+  free (old_slots);
+  return true;
+}
@@ -0,0 +1,112 @@
+#ifndef __LIB_KERNEL_OHASH_H
+#define __LIB_KERNEL_OHASH_H
+
+/* Open-addressing hash table.
+
+   This is a drop-in alternative to the chained hash table in
+   hash.h for tables that are looked up much more often than they
+   change.  Instead of an array of lists, the table is a single
+   array of slots, each holding an element pointer and that
+   element's hash value.  A lookup hashes the key, then scans
+   consecutive slots from the one the hash selects ("linear
+   probing") until it finds an equal element or an empty slot.
+   Comparing the stored hash values first means that the scan
+   reads only the slot array, which is contiguous in memory, and
+   dereferences an element only when its hash matches.
+
+   The table never holds more than 3/4 as many elements as it has
+   slots, so that scans stay short.  Deletion moves later
+   elements of the same run back into the hole, so no "deleted"
+   markers are needed and lookups never slow down over time.
+
+   As with struct hash, elements are not allocated by the table.
+   Each structure that can be in an ohash embeds a struct
+   ohash_elem member, and ohash_entry converts a pointer to that
+   member back into a pointer to the structure, just like
+   hash_entry.  Unlike struct hash, the table does allocate its
+   slot array, so ohash_insert() and ohash_replace() may need to
+   grow it; if that allocation fails when the table is full, the
+   kernel panics. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Open-addressing hash element. */
+struct ohash_elem
+  {
+    unsigned hash;              /* Hash value, while in a table. */
+  };
+
+/* Converts pointer to hash element OHASH_ELEM into a pointer to
+   the structure that OHASH_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the hash element. */
+#define ohash_entry(OHASH_ELEM, STRUCT, MEMBER)                 \
+        ((STRUCT *) ((uint8_t *) &(OHASH_ELEM)->hash            \
+                     - offsetof (STRUCT, MEMBER.hash)))
+
+/* Computes and returns the hash value for hash element E, given
+   auxiliary data AUX. */
+typedef unsigned ohash_hash_func (const struct ohash_elem *e, void *aux);
+
+/* Compares the value of two hash elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool ohash_less_func (const struct ohash_elem *a,
+                              const struct ohash_elem *b,
+                              void *aux);
+
+/* Performs some operation on hash element E, given auxiliary
+   data AUX. */
+typedef void ohash_action_func (struct ohash_elem *e, void *aux);
+
+/* A slot in an open-addressing hash table. */
+struct ohash_slot
+  {
+    unsigned hash;              /* Hash value of ELEM. */
+    struct ohash_elem *elem;    /* Element, or a null pointer if empty. */
+  };
+
+/* Open-addressing hash table. */
+struct ohash
+  {
+    size_t elem_cnt;            /* Number of elements in table. */
+    size_t slot_cnt;            /* Number of slots, a power of 2. */
+    struct ohash_slot *slots;   /* Array of `slot_cnt' slots. */
+    ohash_hash_func *hash;      /* Hash function. */
+    ohash_less_func *less;      /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `hash' and `less'. */
+  };
+
+/* An open-addressing hash table iterator. */
+struct ohash_iterator
+  {
+    struct ohash *hash;         /* The hash table. */
+    size_t slot;                /* Index of the next slot to look at. */
+    struct ohash_elem *elem;    /* Current hash element. */
+  };
+
+/* Basic life cycle. */
+bool ohash_init (struct ohash *, ohash_hash_func *, ohash_less_func *,
+                 void *aux);
+void ohash_clear (struct ohash *, ohash_action_func *);
+void ohash_destroy (struct ohash *, ohash_action_func *);
+
+/* Search, insertion, deletion. */
+struct ohash_elem *ohash_insert (struct ohash *, struct ohash_elem *);
+struct ohash_elem *ohash_replace (struct ohash *, struct ohash_elem *);
+struct ohash_elem *ohash_find (struct ohash *, struct ohash_elem *);
+struct ohash_elem *ohash_delete (struct ohash *, struct ohash_elem *);
+
+/* Iteration. */
+void ohash_apply (struct ohash *, ohash_action_func *);
+void ohash_first (struct ohash_iterator *, struct ohash *);
+struct ohash_elem *ohash_next (struct ohash_iterator *);
+struct ohash_elem *ohash_cur (struct ohash_iterator *);
+
+/* Information. */
+size_t ohash_size (struct ohash *);
+bool ohash_empty (struct ohash *);
+
+#endif /* lib/kernel/ohash.h */
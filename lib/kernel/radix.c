@@ -0,0 +1,363 @@
+/* Radix tree.
+
+   See radix.h for basic information. */
+
+#include "radix.h"
+#include <string.h>
+#include "../debug.h"
+#include "threads/interrupt.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+
+/* Bits in a key. */
+#define KEY_BITS (sizeof (unsigned long) * 8)
+
+/* A node.  Slots of a node whose shift is 0 hold items; others
+   hold child nodes. */
+struct radix_node
+  {
+    struct radix_node *parent;  /* Parent, or a null pointer at the root. */
+    uint8_t shift;              /* Key bits below this level. */
+    uint8_t offset;             /* Slot in the parent. */
+    uint8_t count;              /* Number of non-null slots. */
+    void *slots[RADIX_FANOUT];  /* Children or items. */
+  };
+
+/* Cache of nodes, shared by every tree. */
+static struct kmem_cache *node_cache;
+
+static struct radix_node *node_create (unsigned shift,
+                                       struct radix_node *parent,
+                                       unsigned offset);
+static void destroy_node (struct radix_node *);
+static void prune (struct radix_tree *, struct radix_node *);
+
+/* Returns true if KEY lies within the range of keys that NODE
+   spans. */
+static inline bool
+covers (const struct radix_node *node, unsigned long key)
+{
+  unsigned top = node->shift + RADIX_BITS;
+
+  return top >= KEY_BITS || (key >> top) == 0;
+}
+
+/* Returns the slot of NODE on the path to KEY. */
+static inline unsigned
+slot_of (const struct radix_node *node, unsigned long key)
+{
+  return (key >> node->shift) & (RADIX_FANOUT - 1);
+}
+
+/* Creates the cache that every tree allocates its nodes from.
+   Must be called once, before any tree is used. */
+void
+radix_cache_init (void)
+{
+  node_cache = kmem_cache_create ("radix", sizeof (struct radix_node),
+                                  NULL);
+  if (node_cache == NULL)
+    PANIC ("radix node cache creation failed");
+}
+
+/* Initializes T as an empty tree. */
+void
+radix_init (struct radix_tree *t)
+{
+  t->root = NULL;
+  t->size = 0;
+}
+
+/* Frees T's nodes, leaving it empty.  Does nothing to the items
+   that it held. */
+void
+radix_destroy (struct radix_tree *t)
+{
+  if (t->root != NULL)
+    destroy_node (t->root);
+  t->root = NULL;
+  t->size = 0;
+}
+
+/* Returns the item stored at KEY in T, or a null pointer if there
+   is none. */
+void *
+radix_lookup (const struct radix_tree *t, unsigned long key)
+{
+  enum intr_level old_level = intr_disable ();
+  struct radix_node *node = t->root;
+  void *item = NULL;
+
+  if (node != NULL && covers (node, key))
+    for (;;)
+      {
+        void *slot = node->slots[slot_of (node, key)];
+
+        if (node->shift == 0)
+          item = slot;
+        if (node->shift == 0 || slot == NULL)
+          break;
+        node = slot;
+      }
+  intr_set_level (old_level);
+  return item;
+}
+
+/* Stores ITEM, which must not be a null pointer, at KEY in T,
+   replacing any item already there.  Returns true if successful,
+   false if a node could not be allocated, in which case T is
+   unchanged. */
+bool
+radix_store (struct radix_tree *t, unsigned long key, void *item)
+{
+  struct radix_node *node;
+  unsigned slot;
+
+  ASSERT (item != NULL);
+
+  /* Start with a root just tall enough for KEY, or put taller
+     roots over the old one until it is. */
+  if (t->root == NULL)
+    {
+      unsigned shift = 0;
+
+      while (shift + RADIX_BITS < KEY_BITS
+             && (key >> (shift + RADIX_BITS)) != 0)
+        shift += RADIX_BITS;
+      node = node_create (shift, NULL, 0);
+      if (node == NULL)
+        return false;
+      barrier ();
+      t->root = node;
+    }
+  while (!covers (t->root, key))
+    {
+      struct radix_node *root = t->root;
+
+      node = node_create (root->shift + RADIX_BITS, NULL, 0);
+      if (node == NULL)
+        {
+          prune (t, t->root);
+          return false;
+        }
+      node->slots[0] = root;
+      node->count = 1;
+      root->parent = node;
+      barrier ();
+      t->root = node;
+    }
+
+  /* Walk down, filling in missing nodes. */
+  node = t->root;
+  while (node->shift > 0)
+    {
+      struct radix_node *child;
+
+      slot = slot_of (node, key);
+      child = node->slots[slot];
+      if (child == NULL)
+        {
+          child = node_create (node->shift - RADIX_BITS, node, slot);
+          if (child == NULL)
+            {
+              prune (t, node);
+              return false;
+            }
+          barrier ();
+          node->slots[slot] = child;
+          node->count++;
+        }
+      node = child;
+    }
+
+  slot = slot_of (node, key);
+  if (node->slots[slot] == NULL)
+    {
+      node->count++;
+      t->size++;
+    }
+  barrier ();
+  node->slots[slot] = item;
+  return true;
+}
+
+/* Removes the item at KEY from T and returns it, or returns a
+   null pointer if there is none.  Frees the nodes that this
+   empties. */
+void *
+radix_delete (struct radix_tree *t, unsigned long key)
+{
+  struct radix_node *node = t->root;
+  unsigned slot;
+  void *item;
+
+  if (node == NULL || !covers (node, key))
+    return NULL;
+  while (node->shift > 0)
+    {
+      node = node->slots[slot_of (node, key)];
+      if (node == NULL)
+        return NULL;
+    }
+
+  slot = slot_of (node, key);
+  item = node->slots[slot];
+  if (item != NULL)
+    {
+      node->slots[slot] = NULL;
+      node->count--;
+      t->size--;
+      prune (t, node);
+    }
+  return item;
+}
+
+/* Returns the item in T with the least key not less than *KEY,
+   and stores its key in *KEY, or returns a null pointer if there
+   is no such item.  Visits only the nodes that hold items, so a
+   walk over the items whose keys lie in [FIRST, LAST] costs time
+   in proportion to the populated part of the range:
+
+      unsigned long key = FIRST;
+      void *item;
+
+      for (; (item = radix_next (t, &key)) != NULL && key <= LAST; key++)
+        {
+          ...do something with item...
+          if (key == ULONG_MAX)
+            break;
+        }
+*/
+void *
+radix_next (const struct radix_tree *t, unsigned long *keyp)
+{
+  enum intr_level old_level = intr_disable ();
+  unsigned long key = *keyp;
+  void *item = NULL;
+
+  for (;;)
+    {
+      struct radix_node *node = t->root;
+      unsigned top;
+
+      if (node == NULL || !covers (node, key))
+        break;
+
+      /* Go down along the first populated slot at or after
+         KEY's, as long as there is one. */
+      for (;;)
+        {
+          unsigned first = slot_of (node, key);
+          unsigned slot = first;
+
+          while (slot < RADIX_FANOUT && node->slots[slot] == NULL)
+            slot++;
+          if (slot == RADIX_FANOUT)
+            break;
+          if (slot != first)
+            {
+              /* Skip ahead to the start of SLOT's range. */
+              top = node->shift + RADIX_BITS;
+              key = ((top >= KEY_BITS ? 0 : key >> top << top)
+                     | (unsigned long) slot << node->shift);
+            }
+          if (node->shift == 0)
+            {
+              item = node->slots[slot];
+              *keyp = key;
+              goto done;
+            }
+          node = node->slots[slot];
+        }
+
+      /* Nothing at or after KEY in NODE's range, so start over
+         from the root with the first key past it. */
+      top = node->shift + RADIX_BITS;
+      if (top >= KEY_BITS || ((key >> top) + 1) << top == 0)
+        break;
+      key = ((key >> top) + 1) << top;
+    }
+
+ done:
+  intr_set_level (old_level);
+  return item;
+}
+
+/* Returns the number of items in T. */
+size_t
+radix_size (const struct radix_tree *t)
+{
+  return t->size;
+}
+
+/* Returns true if T holds no items, false otherwise. */
+bool
+radix_empty (const struct radix_tree *t)
+{
+  return t->root == NULL;
+}
+
+/* Returns a new, empty node at level SHIFT in slot OFFSET of
+   PARENT, or a null pointer if memory is not available.  Does not
+   link it into PARENT. */
+static struct radix_node *
+node_create (unsigned shift, struct radix_node *parent, unsigned offset)
+{
+  struct radix_node *node = kmem_cache_alloc (node_cache);
+
+  if (node != NULL)
+    {
+      node->parent = parent;
+      node->shift = shift;
+      node->offset = offset;
+      node->count = 0;
+      memset (node->slots, 0, sizeof node->slots);
+    }
+  return node;
+}
+
+/* Frees NODE and every node below it. */
+static void
+destroy_node (struct radix_node *node)
+{
+  size_t i;
+
+  if (node->shift > 0)
+    for (i = 0; i < RADIX_FANOUT; i++)
+      if (node->slots[i] != NULL)
+        destroy_node (node->slots[i]);
+  kmem_cache_free (node_cache, node);
+}
+
+/* Frees NODE if it is empty, and then each ancestor that that
+   empties, then lowers T's root while only its first slot is in
+   use, so that T is no taller than its largest key needs. */
+static void
+prune (struct radix_tree *t, struct radix_node *node)
+{
+  while (node != NULL && node->count == 0)
+    {
+      struct radix_node *parent = node->parent;
+
+      if (parent != NULL)
+        {
+          parent->slots[node->offset] = NULL;
+          parent->count--;
+        }
+      else
+        t->root = NULL;
+      kmem_cache_free (node_cache, node);
+      node = parent;
+    }
+
+  while (t->root != NULL && t->root->shift > 0
+         && t->root->count == 1 && t->root->slots[0] != NULL)
+    {
+      struct radix_node *root = t->root;
+      struct radix_node *child = root->slots[0];
+
+      child->parent = NULL;
+      t->root = child;
+      kmem_cache_free (node_cache, root);
+    }
+}
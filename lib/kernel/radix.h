@@ -0,0 +1,66 @@
+#ifndef __LIB_KERNEL_RADIX_H
+#define __LIB_KERNEL_RADIX_H
+
+/* Radix tree.
+
+   A radix tree maps integer keys to pointers.  Each node has
+   RADIX_FANOUT slots and consumes RADIX_BITS bits of the key, so
+   a tree of 32-bit keys is at most 6 levels deep, and each level
+   is indexed directly instead of compared or hashed.  The tree
+   is only as tall as its largest key needs, and only as wide as
+   its populated ranges, so it suits sparse maps whose keys
+   cluster, such as page numbers, sector numbers, or thread IDs:
+   a run of 64 neighboring keys costs one node, and the keys come
+   out in order, so a walk over a range of keys visits only the
+   nodes that cover populated parts of it.
+
+   Unlike the list and hash table, the tree allocates its nodes,
+   from a slab cache, so radix_store() may fail for lack of
+   memory.  The items themselves are not the tree's business; it
+   stores any non-null pointer.
+
+   Synchronization: writers, that is, radix_store(),
+   radix_delete() and radix_destroy(), must exclude each other,
+   for example with a lock.  Readers, radix_lookup() and
+   radix_next(), take no lock and may run alongside a writer, or
+   in an interrupt handler: a writer publishes each new node only
+   once it is filled in, and readers walk the tree with
+   interrupts off, so a writer never frees a node that a reader
+   is in. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Key bits per level, and slots per node. */
+#define RADIX_BITS 6
+#define RADIX_FANOUT (1 << RADIX_BITS)
+
+struct radix_node;
+
+/* Radix tree. */
+struct radix_tree
+  {
+    struct radix_node *root;    /* Root, or a null pointer if empty. */
+    size_t size;                /* Number of items. */
+  };
+
+void radix_cache_init (void);
+
+/* Basic life cycle. */
+void radix_init (struct radix_tree *);
+void radix_destroy (struct radix_tree *);
+
+/* Search, insertion, deletion. */
+void *radix_lookup (const struct radix_tree *, unsigned long key);
+bool radix_store (struct radix_tree *, unsigned long key, void *item);
+void *radix_delete (struct radix_tree *, unsigned long key);
+
+/* Iteration in key order. */
+void *radix_next (const struct radix_tree *, unsigned long *key);
+
+/* Information. */
+size_t radix_size (const struct radix_tree *);
+bool radix_empty (const struct radix_tree *);
+
+#endif /* lib/kernel/radix.h */
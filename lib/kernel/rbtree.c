@@ -0,0 +1,367 @@
+/* Red-black tree.
+
+   See rbtree.h for basic information.  The algorithms follow
+   [CLRS] chapter 13, with null pointers standing in for the
+   black leaves. */
+
+#include "rbtree.h"
+#include "../debug.h"
+
+static void rotate_left (struct rb_tree *, struct rb_node *);
+static void rotate_right (struct rb_tree *, struct rb_node *);
+static void transplant (struct rb_tree *, struct rb_node *old,
+                        struct rb_node *new);
+static void insert_fixup (struct rb_tree *, struct rb_node *);
+static void remove_fixup (struct rb_tree *, struct rb_node *,
+                          struct rb_node *parent);
+
+/* Initializes T as an empty tree ordered by LESS, given
+   auxiliary data AUX. */
+void
+rb_init (struct rb_tree *t, rb_less_func *less, void *aux)
+{
+  ASSERT (t != NULL);
+  ASSERT (less != NULL);
+
+  t->root = NULL;
+  t->first = NULL;
+  t->size = 0;
+  t->less = less;
+  t->aux = aux;
+}
+
+/* Inserts NODE into T, after any nodes equal to it. */
+void
+rb_insert (struct rb_tree *t, struct rb_node *node)
+{
+  struct rb_node **link = &t->root;
+  struct rb_node *parent = NULL;
+  bool leftmost = true;
+
+  ASSERT (node != NULL);
+
+  while (*link != NULL)
+    {
+      parent = *link;
+      if (t->less (node, parent, t->aux))
+        link = &parent->left;
+      else
+        {
+          link = &parent->right;
+          leftmost = false;
+        }
+    }
+
+  node->parent = parent;
+  node->left = node->right = NULL;
+  node->red = true;
+  *link = node;
+  if (leftmost)
+    t->first = node;
+  t->size++;
+
+  insert_fixup (t, node);
+}
+
+/* Removes NODE, which must be in T, from T. */
+void
+rb_remove (struct rb_tree *t, struct rb_node *node)
+{
+  struct rb_node *x, *x_parent;
+  bool removed_red = node->red;
+
+  ASSERT (t->size > 0);
+
+  if (t->first == node)
+    t->first = rb_next (node);
+
+  if (node->left == NULL)
+    {
+      x = node->right;
+      x_parent = node->parent;
+      transplant (t, node, x);
+    }
+  else if (node->right == NULL)
+    {
+      x = node->left;
+      x_parent = node->parent;
+      transplant (t, node, x);
+    }
+  else
+    {
+      /* Replace NODE by its successor Y, the leftmost node of its
+         right subtree, which has no left child. */
+      struct rb_node *y = node->right;
+
+      while (y->left != NULL)
+        y = y->left;
+      removed_red = y->red;
+      x = y->right;
+      if (y->parent == node)
+        x_parent = y;
+      else
+        {
+          x_parent = y->parent;
+          transplant (t, y, x);
+          y->right = node->right;
+          y->right->parent = y;
+        }
+      transplant (t, node, y);
+      y->left = node->left;
+      y->left->parent = y;
+      y->red = node->red;
+    }
+  t->size--;
+
+  /* Taking out a black node shortens the paths through X. */
+  if (!removed_red)
+    remove_fixup (t, x, x_parent);
+}
+
+/* Returns the least node in T, or a null pointer if T is
+   empty. */
+struct rb_node *
+rb_first (const struct rb_tree *t)
+{
+  return t->first;
+}
+
+/* Returns the node after NODE in order, or a null pointer if
+   NODE is the last node of its tree. */
+struct rb_node *
+rb_next (const struct rb_node *node)
+{
+  if (node->right != NULL)
+    {
+      node = node->right;
+      while (node->left != NULL)
+        node = node->left;
+      return (struct rb_node *) node;
+    }
+
+  while (node->parent != NULL && node == node->parent->right)
+    node = node->parent;
+  return node->parent;
+}
+
+/* Returns the first node in T that is not less than KEY, or a
+   null pointer if every node is less.  KEY need not be in T; it
+   is typically a node embedded in a structure on the stack with
+   just the fields that the comparison function reads. */
+struct rb_node *
+rb_lower_bound (const struct rb_tree *t, const struct rb_node *key)
+{
+  struct rb_node *node = t->root;
+  struct rb_node *bound = NULL;
+
+  while (node != NULL)
+    if (t->less (node, key, t->aux))
+      node = node->right;
+    else
+      {
+        bound = node;
+        node = node->left;
+      }
+  return bound;
+}
+
+/* Returns the number of nodes in T. */
+size_t
+rb_size (const struct rb_tree *t)
+{
+  return t->size;
+}
+
+/* Returns true if T is empty, false otherwise. */
+bool
+rb_empty (const struct rb_tree *t)
+{
+  return t->root == NULL;
+}
+
+/* Returns true if NODE is red.  Null leaves are black. */
+static inline bool
+is_red (const struct rb_node *node)
+{
+  return node != NULL && node->red;
+}
+
+/* Puts NEW, which may be a null pointer, in the place of OLD
+   below OLD's parent.  OLD's own links are left alone. */
+static void
+transplant (struct rb_tree *t, struct rb_node *old, struct rb_node *new)
+{
+  if (old->parent == NULL)
+    t->root = new;
+  else if (old == old->parent->left)
+    old->parent->left = new;
+  else
+    old->parent->right = new;
+  if (new != NULL)
+    new->parent = old->parent;
+}
+
+/* Rotates X's right child up into X's place, making X its left
+   child. */
+static void
+rotate_left (struct rb_tree *t, struct rb_node *x)
+{
+  struct rb_node *y = x->right;
+
+  x->right = y->left;
+  if (y->left != NULL)
+    y->left->parent = x;
+  transplant (t, x, y);
+  y->left = x;
+  x->parent = y;
+}
+
+/* Rotates X's left child up into X's place, making X its right
+   child. */
+static void
+rotate_right (struct rb_tree *t, struct rb_node *x)
+{
+  struct rb_node *y = x->left;
+
+  x->left = y->right;
+  if (y->right != NULL)
+    y->right->parent = x;
+  transplant (t, x, y);
+  y->right = x;
+  x->parent = y;
+}
+
+/* Restores the red-black rules after red node Z was linked in,
+   which breaks them only if Z's parent is red too. */
+static void
+insert_fixup (struct rb_tree *t, struct rb_node *z)
+{
+  struct rb_node *p;
+
+  while (is_red (p = z->parent))
+    {
+      /* P is red, so it is not the root and Z has a grandparent. */
+      struct rb_node *g = p->parent;
+
+      if (p == g->left)
+        {
+          struct rb_node *uncle = g->right;
+
+          if (is_red (uncle))
+            {
+              /* Push G's blackness down and retry from G. */
+              p->red = uncle->red = false;
+              g->red = true;
+              z = g;
+              continue;
+            }
+          if (z == p->right)
+            {
+              rotate_left (t, p);
+              z = p;
+              p = z->parent;
+            }
+          p->red = false;
+          g->red = true;
+          rotate_right (t, g);
+        }
+      else
+        {
+          struct rb_node *uncle = g->left;
+
+          if (is_red (uncle))
+            {
+              p->red = uncle->red = false;
+              g->red = true;
+              z = g;
+              continue;
+            }
+          if (z == p->left)
+            {
+              rotate_right (t, p);
+              z = p;
+              p = z->parent;
+            }
+          p->red = false;
+          g->red = true;
+          rotate_left (t, g);
+        }
+    }
+  t->root->red = false;
+}
+
+/* Restores the red-black rules after a black node was taken out
+   above X, a child of PARENT that may be a null leaf, leaving
+   the paths through X one black node short. */
+static void
+remove_fixup (struct rb_tree *t, struct rb_node *x, struct rb_node *parent)
+{
+  while (x != t->root && !is_red (x))
+    {
+      /* X is short of a black node, so its sibling W exists. */
+      if (x == parent->left)
+        {
+          struct rb_node *w = parent->right;
+
+          if (w->red)
+            {
+              w->red = false;
+              parent->red = true;
+              rotate_left (t, parent);
+              w = parent->right;
+            }
+          if (!is_red (w->left) && !is_red (w->right))
+            {
+              /* Shorten W's side too and retry one level up. */
+              w->red = true;
+              x = parent;
+              parent = x->parent;
+              continue;
+            }
+          if (!is_red (w->right))
+            {
+              w->left->red = false;
+              w->red = true;
+              rotate_right (t, w);
+              w = parent->right;
+            }
+          w->red = parent->red;
+          parent->red = false;
+          w->right->red = false;
+          rotate_left (t, parent);
+        }
+      else
+        {
+          struct rb_node *w = parent->left;
+
+          if (w->red)
+            {
+              w->red = false;
+              parent->red = true;
+              rotate_right (t, parent);
+              w = parent->left;
+            }
+          if (!is_red (w->left) && !is_red (w->right))
+            {
+              w->red = true;
+              x = parent;
+              parent = x->parent;
+              continue;
+            }
+          if (!is_red (w->left))
+            {
+              w->right->red = false;
+              w->red = true;
+              rotate_left (t, w);
+              w = parent->left;
+            }
+          w->red = parent->red;
+          parent->red = false;
+          w->left->red = false;
+          rotate_right (t, parent);
+        }
+      x = t->root;
+    }
+  if (x != NULL)
+    x->red = false;
+}
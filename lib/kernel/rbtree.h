@@ -0,0 +1,83 @@
+#ifndef __LIB_KERNEL_RBTREE_H
+#define __LIB_KERNEL_RBTREE_H
+
+/* Red-black tree.
+
+   A red-black tree is a binary search tree that keeps itself
+   balanced by coloring each node red or black and restoring
+   two rules after every change: a red node has no red child,
+   and every path from a node down to a leaf passes the same
+   number of black nodes.  Together they bound the height of a
+   tree of N nodes by 2 log2(N + 1), so insertion and removal
+   take O(log n) time, with at most three rotations each.
+
+   As with the list and hash table, nodes are not allocated by
+   the tree.  Each structure that can be in a tree embeds a
+   struct rb_node member, and rb_entry converts a pointer to
+   that member back into a pointer to the structure.
+
+   Elements are ordered by a caller-supplied "less than"
+   function.  Elements that compare equal are allowed, and an
+   element inserted later sorts after the equal ones already in
+   the tree, so a tree keyed on a value that ties often hands
+   ties out in FIFO order.  The tree caches its leftmost node,
+   so rb_first() takes O(1) time, which suits a tree used as a
+   priority queue. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Red-black tree node. */
+struct rb_node
+  {
+    struct rb_node *parent;     /* Parent, or a null pointer at the root. */
+    struct rb_node *left;       /* Lesser child. */
+    struct rb_node *right;      /* Greater or equal child. */
+    bool red;                   /* Red or black? */
+  };
+
+/* Converts pointer to tree node RB_NODE into a pointer to the
+   structure that RB_NODE is embedded inside.  Supply the name of
+   the outer structure STRUCT and the member name MEMBER of the
+   tree node. */
+#define rb_entry(RB_NODE, STRUCT, MEMBER)                       \
+        ((STRUCT *) ((uint8_t *) &(RB_NODE)->parent             \
+                     - offsetof (STRUCT, MEMBER.parent)))
+
+/* Compares the value of two tree nodes A and B, given auxiliary
+   data AUX.  Returns true if A is less than B, or false if A is
+   greater than or equal to B. */
+typedef bool rb_less_func (const struct rb_node *a,
+                           const struct rb_node *b,
+                           void *aux);
+
+/* Red-black tree. */
+struct rb_tree
+  {
+    struct rb_node *root;       /* Root, or a null pointer if empty. */
+    struct rb_node *first;      /* Leftmost node, or a null pointer. */
+    size_t size;                /* Number of nodes. */
+    rb_less_func *less;         /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+void rb_init (struct rb_tree *, rb_less_func *, void *aux);
+
+/* Insertion and removal. */
+void rb_insert (struct rb_tree *, struct rb_node *);
+void rb_remove (struct rb_tree *, struct rb_node *);
+
+/* Traversal in order. */
+struct rb_node *rb_first (const struct rb_tree *);
+struct rb_node *rb_next (const struct rb_node *);
+
+/* Search. */
+struct rb_node *rb_lower_bound (const struct rb_tree *,
+                                const struct rb_node *key);
+
+/* Information. */
+size_t rb_size (const struct rb_tree *);
+bool rb_empty (const struct rb_tree *);
+
+#endif /* lib/kernel/rbtree.h */
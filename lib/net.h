@@ -0,0 +1,62 @@
+#ifndef __LIB_NET_H
+#define __LIB_NET_H
+
+#include <stdint.h>
+
+/* Raw Ethernet packet rings, shared by the kernel and user
+   programs. */
+
+/* Entries in each ring.  A power of 2. */
+#define NET_RING_ENTRIES 64
+
+/* Bytes in each packet buffer. */
+#define NET_BUF_SIZE 2048
+
+/* Longest packet, without the frame check sequence, which the
+   network card adds and strips. */
+#define NET_PACKET_MAX 1514
+
+/* Shortest packet sent.  Shorter ones are padded. */
+#define NET_PACKET_MIN 60
+
+/* The rings' control page, the first of the pages that
+   net_map() maps.
+
+   Receive: the kernel puts each packet the card receives into
+   the buffer for index RX_TAIL, sets its entry of RX_LEN, and
+   advances RX_TAIL.  The process consumes packets from RX_HEAD
+   and advances it to give their buffers back, which the kernel
+   notices at the next net_recv().
+
+   Send: the process fills in the buffer and entry of TX_LEN for
+   index TX_TAIL and advances it, then calls net_send() to have
+   the card send every packet up to TX_TAIL.  The kernel advances
+   TX_HEAD as the card finishes with them, and the process may
+   not reuse a buffer until then.
+
+   Indexes run freely and are taken modulo NET_RING_ENTRIES. */
+struct net_ring
+  {
+    uint32_t rx_head;           /* Next packet for the process. */
+    uint32_t rx_tail;           /* Next packet for the kernel. */
+    uint32_t tx_head;           /* Next packet for the card to finish. */
+    uint32_t tx_tail;           /* Next packet for the process. */
+    uint16_t rx_len[NET_RING_ENTRIES];  /* Bytes received. */
+    uint16_t tx_len[NET_RING_ENTRIES];  /* Bytes to send. */
+    uint8_t mac[6];             /* The card's Ethernet address. */
+  };
+
+/* Bytes mapped by net_map(): the control page, then the receive
+   buffers, then the send buffers. */
+#define NET_CONTROL_SIZE 4096
+#define NET_MAP_SIZE (NET_CONTROL_SIZE + 2 * NET_RING_ENTRIES * NET_BUF_SIZE)
+
+/* Buffer for index I of the receive or send ring mapped at
+   RING. */
+#define NET_RX_BUF(RING, I)                                     \
+        ((uint8_t *) (RING) + NET_CONTROL_SIZE                  \
+         + ((I) % NET_RING_ENTRIES) * NET_BUF_SIZE)
+#define NET_TX_BUF(RING, I)                                     \
+        (NET_RX_BUF (RING, I) + NET_RING_ENTRIES * NET_BUF_SIZE)
+
+#endif /* lib/net.h */
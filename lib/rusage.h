@@ -0,0 +1,24 @@
+#ifndef __LIB_RUSAGE_H
+#define __LIB_RUSAGE_H
+
+#include <stdint.h>
+
+/* Whose resource usage getrusage() returns. */
+#define RUSAGE_SELF 0           /* The calling process. */
+#define RUSAGE_CHILDREN (-1)    /* Its children waited for, and theirs. */
+
+/* Resources used by a process, shared by the kernel and user
+   programs. */
+struct rusage
+  {
+    uint64_t user_ticks;        /* Timer ticks running user code. */
+    uint64_t kernel_ticks;      /* Timer ticks in the kernel for it. */
+    uint64_t minor_faults;      /* Page faults served without I/O. */
+    uint64_t major_faults;      /* Page faults that read a file or swap. */
+    uint64_t block_reads;       /* Sectors it had read from disk. */
+    uint64_t block_writes;      /* Sectors it had written to disk. */
+    uint64_t switches;          /* Context switches away from it. */
+    uint32_t max_resident;      /* Most pages it had in frames at once. */
+  };
+
+#endif /* lib/rusage.h */
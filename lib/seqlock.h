@@ -0,0 +1,77 @@
+#ifndef __LIB_SEQLOCK_H
+#define __LIB_SEQLOCK_H
+
+/* Sequence counters, shared by the kernel and user programs.
+
+   A sequence counter lets readers take a consistent snapshot of
+   data that one writer at a time updates, without the readers
+   writing to shared memory or blocking the writer.  The writer
+   makes the count odd while it updates the data and even again
+   afterward; a reader that saw an odd count, or a different count
+   after reading the data, read a torn snapshot and retries:
+
+      unsigned seq;
+      do
+        {
+          seq = seq_read_begin (&s);
+          ...copy the data...
+        }
+      while (seq_read_retry (&s, seq));
+
+   Writers must exclude each other by other means.  A reader that
+   interrupted a writer would spin forever, so in the kernel
+   writers run with interrupts turned off.
+
+   x86 does not reorder loads with other loads or stores with
+   other stores, so compiler barriers order the accesses well
+   enough even between CPUs. */
+
+/* A sequence counter. */
+typedef struct
+  {
+    volatile unsigned seq;
+  }
+seqcount_t;
+
+/* Initializer for a seqcount_t. */
+#define SEQCOUNT_INIT { 0 }
+
+/* Begins a read of the data that S protects.  Returns the count
+   to pass to seq_read_retry(). */
+static inline unsigned
+seq_read_begin (const seqcount_t *s)
+{
+  unsigned seq;
+
+  while ((seq = s->seq) & 1)
+    asm volatile ("pause");
+  asm volatile ("" : : : "memory");
+  return seq;
+}
+
+/* Returns true if the data that S protects changed since
+   seq_read_begin() returned SEQ, so that it must be read again. */
+static inline int
+seq_read_retry (const seqcount_t *s, unsigned seq)
+{
+  asm volatile ("" : : : "memory");
+  return s->seq != seq;
+}
+
+/* Begins an update of the data that S protects. */
+static inline void
+seq_write_begin (seqcount_t *s)
+{
+  s->seq++;
+  asm volatile ("" : : : "memory");
+}
+
+/* Ends an update of the data that S protects. */
+static inline void
+seq_write_end (seqcount_t *s)
+{
+  asm volatile ("" : : : "memory");
+  s->seq++;
+}
+
+#endif /* lib/seqlock.h */
@@ -0,0 +1,29 @@
+#ifndef __LIB_SPAWN_H
+#define __LIB_SPAWN_H
+
+/* Process creation with spawn(), shared by the kernel and user
+   programs. */
+
+/* Kinds of file descriptor action. */
+#define SPAWN_END 0             /* Ends the list of actions. */
+#define SPAWN_DUP2 1            /* Child's CHILD_FD is a copy of FD. */
+#define SPAWN_CLOSE 2           /* Child's CHILD_FD is closed. */
+
+/* An action on the file descriptors of a spawned process.  Its
+   descriptors start out as exec() would leave them: 0 and 1 as
+   the parent has them redirected, if at all, and no others.  Then
+   the actions are carried out in order. */
+struct spawn_action
+  {
+    int op;                     /* SPAWN_*. */
+    int fd;                     /* Parent's descriptor, for SPAWN_DUP2. */
+    int child_fd;               /* Child's descriptor. */
+  };
+
+/* Most actions a spawn() may take. */
+#define SPAWN_ACTIONS_MAX 16
+
+/* Flags for spawn(). */
+#define SPAWN_NOWAIT 0x1        /* Return before the program loads. */
+
+#endif /* lib/spawn.h */
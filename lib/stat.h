@@ -0,0 +1,16 @@
+#ifndef __LIB_STAT_H
+#define __LIB_STAT_H
+
+#include <stdbool.h>
+
+/* A file's attributes as returned by stat() and fstat(), shared
+   by the kernel and user programs. */
+struct stat
+  {
+    int inumber;                        /* Inode number. */
+    bool is_dir;                        /* A directory? */
+    int size;                           /* Length in bytes. */
+    int blocks;                         /* Data sectors on disk. */
+  };
+
+#endif /* lib/stat.h */
@@ -3,6 +3,7 @@
 #include <random.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /* Converts a string representation of a signed decimal integer
    in S into an `int', which is returned. */
@@ -48,11 +49,24 @@ compare_thunk (const void *a, const void *b, void *aux)
   return (*compare) (a, b);
 }
 
+/* State shared by the helpers of sort_range(). */
+struct sorter
+  {
+    size_t size;                /* Bytes per element. */
+    bool words;                 /* Swap 4 bytes at a time? */
+    int (*compare) (const void *, const void *, void *aux);
+    void *aux;                  /* Auxiliary data for `compare'. */
+    int (*qcompare) (const void *, const void *); /* qsort() comparator. */
+  };
+
+static void sort_range (const struct sorter *, unsigned char *, size_t cnt,
+                        int depth);
+
 /* Sorts ARRAY, which contains CNT elements of SIZE bytes each,
    using COMPARE.  When COMPARE is passed a pair of elements A
    and B, respectively, it must return a strcmp()-type result,
    i.e. less than zero if A < B, zero if A == B, greater than
-   zero if A > B.  Runs in O(n lg n) time and O(1) space in
+   zero if A > B.  Runs in O(n lg n) time and O(lg n) space in
    CNT. */
 void
 qsort (void *array, size_t cnt, size_t size,
@@ -61,42 +75,59 @@ qsort (void *array, size_t cnt, size_t size,
   sort (array, cnt, size, compare_thunk, &compare);
 }
 
-/* Swaps elements with 1-based indexes A_IDX and B_IDX in ARRAY
-   with elements of SIZE bytes each. */
-static void
-do_swap (unsigned char *array, size_t a_idx, size_t b_idx, size_t size)
+/* Compares elements A and B using S's comparison function and
+   returns a strcmp()-type result.  The comparator that qsort()
+   was given is called directly rather than through
+   compare_thunk(). */
+static inline int
+do_compare (const struct sorter *s, const void *a, const void *b)
+{
+  return (s->qcompare != NULL
+          ? s->qcompare (a, b)
+          : s->compare (a, b, s->aux));
+}
+
+/* Swaps elements A and B of S's element size, a word at a time
+   when the size allows. */
+static inline void
+do_swap (const struct sorter *s, unsigned char *a, unsigned char *b)
 {
-  unsigned char *a = array + (a_idx - 1) * size;
-  unsigned char *b = array + (b_idx - 1) * size;
   size_t i;
 
-  for (i = 0; i < size; i++)
+  if (a == b)
+    return;
+  if (s->words)
     {
-      unsigned char t = a[i];
-      a[i] = b[i];
-      b[i] = t;
+      uint32_t *x = (uint32_t *) a, *y = (uint32_t *) b;
+
+      for (i = 0; i < s->size / 4; i++)
+        {
+          uint32_t t = x[i];
+          x[i] = y[i];
+          y[i] = t;
+        }
     }
+  else
+    for (i = 0; i < s->size; i++)
+      {
+        unsigned char t = a[i];
+        a[i] = b[i];
+        b[i] = t;
+      }
 }
 
-/* Compares elements with 1-based indexes A_IDX and B_IDX in
-   ARRAY with elements of SIZE bytes each, using COMPARE to
-   compare elements, passing AUX as auxiliary data, and returns a
-   strcmp()-type result. */
-static int
-do_compare (unsigned char *array, size_t a_idx, size_t b_idx, size_t size,
-            int (*compare) (const void *, const void *, void *aux),
-            void *aux) 
+/* Returns the element with 1-based index IDX in ARRAY, whose
+   elements have S's element size. */
+static inline unsigned char *
+heap_elem (const struct sorter *s, unsigned char *array, size_t idx)
 {
-  return compare (array + (a_idx - 1) * size, array + (b_idx - 1) * size, aux);
+  return array + (idx - 1) * s->size;
 }
 
 /* "Float down" the element with 1-based index I in ARRAY of CNT
-   elements of SIZE bytes each, using COMPARE to compare
-   elements, passing AUX as auxiliary data. */
+   elements, using S to compare and swap elements. */
 static void
-heapify (unsigned char *array, size_t i, size_t cnt, size_t size,
-         int (*compare) (const void *, const void *, void *aux),
-         void *aux) 
+heapify (const struct sorter *s, unsigned char *array, size_t i, size_t cnt)
 {
   for (;;) 
     {
@@ -105,10 +136,13 @@ heapify (unsigned char *array, size_t i, size_t cnt, size_t size,
       size_t left = 2 * i;
       size_t right = 2 * i + 1;
       size_t max = i;
-      if (left <= cnt && do_compare (array, left, max, size, compare, aux) > 0)
+      if (left <= cnt
+          && do_compare (s, heap_elem (s, array, left),
+                         heap_elem (s, array, max)) > 0)
         max = left;
       if (right <= cnt
-          && do_compare (array, right, max, size, compare, aux) > 0) 
+          && do_compare (s, heap_elem (s, array, right),
+                         heap_elem (s, array, max)) > 0) 
         max = right;
 
       /* If the maximum value is already in element I, we're
@@ -117,38 +151,161 @@ heapify (unsigned char *array, size_t i, size_t cnt, size_t size,
         break;
 
       /* Swap and continue down the heap. */
-      do_swap (array, i, max, size);
+      do_swap (s, heap_elem (s, array, i), heap_elem (s, array, max));
       i = max;
     }
 }
 
+/* Sorts the CNT elements of ARRAY by heapsort, using S to
+   compare and swap elements. */
+static void
+heap_sort (const struct sorter *s, unsigned char *array, size_t cnt)
+{
+  size_t i;
+
+  /* Build a heap. */
+  for (i = cnt / 2; i > 0; i--)
+    heapify (s, array, i, cnt);
+
+  /* Sort the heap. */
+  for (i = cnt; i > 1; i--) 
+    {
+      do_swap (s, heap_elem (s, array, 1), heap_elem (s, array, i));
+      heapify (s, array, 1, i - 1); 
+    }
+}
+
+/* Sorts the CNT elements of ARRAY by insertion sort, using S to
+   compare and swap elements. */
+static void
+insertion_sort (const struct sorter *s, unsigned char *array, size_t cnt)
+{
+  size_t size = s->size;
+  size_t i;
+
+  for (i = 1; i < cnt; i++)
+    {
+      unsigned char *p;
+
+      for (p = array + i * size;
+           p > array && do_compare (s, p - size, p) > 0; p -= size)
+        do_swap (s, p - size, p);
+    }
+}
+
+/* Ranges this short are finished by insertion sort. */
+#define INSERTION_SORT_CNT 16
+
+/* Sorts the CNT elements of ARRAY using S, by introsort:
+   quicksort with a median-of-three pivot, switching to insertion
+   sort for short ranges and, once DEPTH more levels of
+   partitioning have not finished the job, to heapsort, so that
+   no input takes more than O(n lg n) time.  Recursing only into
+   the smaller side keeps the stack O(lg n) deep. */
+static void
+sort_range (const struct sorter *s, unsigned char *array, size_t cnt,
+            int depth)
+{
+  size_t size = s->size;
+
+  while (cnt > INSERTION_SORT_CNT)
+    {
+      unsigned char *first = array;
+      unsigned char *mid = array + cnt / 2 * size;
+      unsigned char *last = array + (cnt - 1) * size;
+      unsigned char *pivot = last - size;
+      unsigned char *i, *j;
+      size_t left_cnt, right_cnt;
+
+      if (depth-- == 0)
+        {
+          heap_sort (s, array, cnt);
+          return;
+        }
+
+      /* Order the first, middle, and last elements, then park the
+         median, which becomes the pivot, next to the last one.
+         The first and last elements then stop the scans below
+         without bounds checks. */
+      if (do_compare (s, mid, first) < 0)
+        do_swap (s, mid, first);
+      if (do_compare (s, last, mid) < 0)
+        {
+          do_swap (s, last, mid);
+          if (do_compare (s, mid, first) < 0)
+            do_swap (s, mid, first);
+        }
+      do_swap (s, mid, pivot);
+
+      /* Partition.  Stopping at elements equal to the pivot keeps
+         the halves balanced when there are many duplicates. */
+      i = first;
+      j = pivot;
+      for (;;)
+        {
+          do
+            i += size;
+          while (do_compare (s, i, pivot) < 0);
+          do
+            j -= size;
+          while (do_compare (s, j, pivot) > 0);
+          if (i >= j)
+            break;
+          do_swap (s, i, j);
+        }
+      do_swap (s, i, pivot);
+
+      left_cnt = (i - array) / size;
+      right_cnt = cnt - left_cnt - 1;
+      if (left_cnt < right_cnt)
+        {
+          sort_range (s, array, left_cnt, depth);
+          array = i + size;
+          cnt = right_cnt;
+        }
+      else
+        {
+          sort_range (s, i + size, right_cnt, depth);
+          cnt = left_cnt;
+        }
+    }
+
+  insertion_sort (s, array, cnt);
+}
+
 /* Sorts ARRAY, which contains CNT elements of SIZE bytes each,
    using COMPARE to compare elements, passing AUX as auxiliary
    data.  When COMPARE is passed a pair of elements A and B,
    respectively, it must return a strcmp()-type result, i.e. less
    than zero if A < B, zero if A == B, greater than zero if A >
-   B.  Runs in O(n lg n) time and O(1) space in CNT. */
+   B.  Runs in O(n lg n) time and O(lg n) space in CNT. */
 void
 sort (void *array, size_t cnt, size_t size,
       int (*compare) (const void *, const void *, void *aux),
       void *aux) 
 {
-  size_t i;
+  struct sorter s;
+  int depth;
+  size_t n;
 
   ASSERT (array != NULL || cnt == 0);
   ASSERT (compare != NULL);
   ASSERT (size > 0);
 
-  /* Build a heap. */
-  for (i = cnt / 2; i > 0; i--)
-    heapify (array, i, cnt, size, compare, aux);
+  s.size = size;
+  s.words = size % 4 == 0 && (uintptr_t) array % 4 == 0;
+  s.compare = compare;
+  s.aux = aux;
+  s.qcompare = (compare == compare_thunk
+                ? *(int (**) (const void *, const void *)) aux
+                : NULL);
 
-  /* Sort the heap. */
-  for (i = cnt; i > 1; i--) 
-    {
-      do_swap (array, 1, i, size);
-      heapify (array, 1, i - 1, size, compare, aux); 
-    }
+  /* Allow 2 * floor(lg CNT) levels of partitioning. */
+  depth = 0;
+  for (n = cnt; n > 1; n /= 2)
+    depth += 2;
+
+  sort_range (&s, array, cnt, depth);
 }
 
 /* Searches ARRAY, which contains CNT elements of SIZE bytes
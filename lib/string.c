@@ -1,19 +1,56 @@
 #include <string.h>
 #include <debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Word-at-a-time scanning.  The loops below that read past the
+   end of a string load only aligned words, which never straddle
+   a page boundary, so they cannot fault where a byte-at-a-time
+   loop would not. */
+#define ONES 0x01010101u        /* 1 in every byte. */
+#define HIGHS 0x80808080u       /* High bit of every byte. */
+
+/* Returns true if any byte of W is zero. */
+static inline bool
+has_zero (uint32_t w)
+{
+  return ((w - ONES) & ~w & HIGHS) != 0;
+}
+
+/* Returns true if P is aligned on a word boundary. */
+static inline bool
+is_aligned (const void *p)
+{
+  return (uintptr_t) p % sizeof (uint32_t) == 0;
+}
 
 /* Copies SIZE bytes from SRC to DST, which must not overlap.
-   Returns DST. */
+   Returns DST.
+
+   Large copies move the bytes up to a word-aligned DST one at a
+   time, then whole words with `rep movsl', then the rest. */
 void *
 memcpy (void *dst_, const void *src_, size_t size) 
 {
   unsigned char *dst = dst_;
   const unsigned char *src = src_;
+  size_t head, words;
 
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
-  while (size-- > 0)
-    *dst++ = *src++;
+  if (size >= 16)
+    {
+      head = -(uintptr_t) dst & 3;
+      words = (size - head) / 4;
+      size = (size - head) % 4;
+      asm volatile ("rep movsb"
+                    : "+D" (dst), "+S" (src), "+c" (head) : : "memory");
+      asm volatile ("rep movsl"
+                    : "+D" (dst), "+S" (src), "+c" (words) : : "memory");
+    }
+  asm volatile ("rep movsb"
+                : "+D" (dst), "+S" (src), "+c" (size) : : "memory");
 
   return dst_;
 }
@@ -25,24 +62,32 @@ memmove (void *dst_, const void *src_, size_t size)
 {
   unsigned char *dst = dst_;
   const unsigned char *src = src_;
+  size_t tail, words;
 
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
-  if (dst < src) 
-    {
-      while (size-- > 0)
-        *dst++ = *src++;
-    }
-  else 
-    {
-      dst += size;
-      src += size;
-      while (size-- > 0)
-        *--dst = *--src;
-    }
+  /* Copying upward is safe unless DST overlaps the end of SRC. */
+  if (dst <= src || dst >= src + size)
+    return memcpy (dst_, src_, size);
+
+  /* Copy downward: the bytes past the last whole word first,
+     then the words, with the direction flag set meanwhile. */
+  dst += size - 1;
+  src += size - 1;
+  tail = size % 4;
+  words = size / 4;
+  asm volatile ("std\n\t"
+                "rep movsb\n\t"
+                "subl $3, %%esi\n\t"
+                "subl $3, %%edi\n\t"
+                "movl %3, %%ecx\n\t"
+                "rep movsl\n\t"
+                "cld"
+                : "+D" (dst), "+S" (src), "+c" (tail)
+                : "r" (words) : "memory");
 
-  return dst;
+  return dst_;
 }
 
 /* Find the first differing byte in the two blocks of SIZE bytes
@@ -58,6 +103,12 @@ memcmp (const void *a_, const void *b_, size_t size)
   ASSERT (a != NULL || size == 0);
   ASSERT (b != NULL || size == 0);
 
+  /* Skip equal words, then find the difference byte by byte.
+     These loads stay inside both blocks, so they may be
+     unaligned. */
+  for (; size >= 4; a += 4, b += 4, size -= 4)
+    if (*(const uint32_t *) a != *(const uint32_t *) b)
+      break;
   for (; size-- > 0; a++, b++)
     if (*a != *b)
       return *a > *b ? +1 : -1;
@@ -78,6 +129,22 @@ strcmp (const char *a_, const char *b_)
   ASSERT (a != NULL);
   ASSERT (b != NULL);
 
+  /* If A and B are equally misaligned, compare a word at a time
+     once they are aligned, until the words differ or A's word
+     holds the terminator. */
+  if ((uintptr_t) a % 4 == (uintptr_t) b % 4)
+    {
+      for (; !is_aligned (a); a++, b++)
+        if (*a == '\0' || *a != *b)
+          return *a < *b ? -1 : *a > *b;
+      while (*(const uint32_t *) a == *(const uint32_t *) b
+             && !has_zero (*(const uint32_t *) a))
+        {
+          a += 4;
+          b += 4;
+        }
+    }
+
   while (*a != '\0' && *a == *b) 
     {
       a++;
@@ -98,6 +165,15 @@ memchr (const void *block_, int ch_, size_t size)
 
   ASSERT (block != NULL || size == 0);
 
+  for (; size > 0 && !is_aligned (block); size--, block++)
+    if (*block == ch)
+      return (void *) block;
+
+  /* Skip words that do not contain CH. */
+  for (; size >= 4; size -= 4, block += 4)
+    if (has_zero (*(const uint32_t *) block ^ (ch * ONES)))
+      break;
+
   for (; size-- > 0; block++)
     if (*block == ch)
       return (void *) block;
@@ -279,11 +355,24 @@ void *
 memset (void *dst_, int value, size_t size) 
 {
   unsigned char *dst = dst_;
+  uint32_t word = (unsigned char) value * 0x01010101u;
+  size_t head, words;
 
   ASSERT (dst != NULL || size == 0);
-  
-  while (size-- > 0)
-    *dst++ = value;
+
+  /* Like memcpy(), store whole aligned words with `rep stosl'. */
+  if (size >= 16)
+    {
+      head = -(uintptr_t) dst & 3;
+      words = (size - head) / 4;
+      size = (size - head) % 4;
+      asm volatile ("rep stosb"
+                    : "+D" (dst), "+c" (head) : "a" (word) : "memory");
+      asm volatile ("rep stosl"
+                    : "+D" (dst), "+c" (words) : "a" (word) : "memory");
+    }
+  asm volatile ("rep stosb"
+                : "+D" (dst), "+c" (size) : "a" (word) : "memory");
 
   return dst_;
 }
@@ -296,7 +385,12 @@ strlen (const char *string)
 
   ASSERT (string != NULL);
 
-  for (p = string; *p != '\0'; p++)
+  for (p = string; !is_aligned (p); p++)
+    if (*p == '\0')
+      return p - string;
+  while (!has_zero (*(const uint32_t *) p))
+    p += 4;
+  for (; *p != '\0'; p++)
     continue;
   return p - string;
 }
@@ -28,7 +28,45 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_FORK,                   /* Duplicate this process. */
+    SYS_GETPID,                 /* Obtain this process's pid. */
+    SYS_READV,                  /* Read into several buffers. */
+    SYS_WRITEV,                 /* Write from several buffers. */
+    SYS_IO_RING_SETUP,          /* Map an I/O ring. */
+    SYS_IO_RING_ENTER,          /* Carry out queued I/O ring operations. */
+    SYS_WAITANY,                /* Wait for any child process to die. */
+    SYS_SENDFILE,               /* Copy between files in the kernel. */
+    SYS_VMSTAT,                 /* Obtain memory statistics. */
+    SYS_FUTEX_WAIT,             /* Sleep on a word of memory. */
+    SYS_FUTEX_WAKE,             /* Wake threads sleeping on a word. */
+    SYS_THREAD_SPAWN,           /* Start a thread in the process. */
+    SYS_THREAD_JOIN,            /* Wait for a thread to exit. */
+    SYS_SBRK,                   /* Move the end of the heap. */
+    SYS_SHM_CREATE,             /* Create a shared memory segment. */
+    SYS_SHM_MAP,                /* Map a shared memory segment. */
+    SYS_PIPE,                   /* Create a pipe. */
+    SYS_DUP2,                   /* Duplicate a file descriptor. */
+    SYS_MADVISE,                /* Advise on use of memory. */
+    SYS_FADVISE,                /* Advise on use of a file. */
+    SYS_GETDENTS,               /* Reads several directory entries. */
+    SYS_FSYNC,                  /* Makes a file's data and metadata durable. */
+    SYS_FDATASYNC,              /* Makes a file's data durable. */
+    SYS_FCNTL,                  /* Gets or sets a descriptor's flags. */
+    SYS_NET_MAP,                /* Map the network card's packet rings. */
+    SYS_NET_SEND,               /* Send packets queued in the rings. */
+    SYS_NET_RECV,               /* Wait for received packets. */
+    SYS_SCHED_DEADLINE,         /* Reserve CPU time for this thread. */
+    SYS_STAT,                   /* Obtain a named file's attributes. */
+    SYS_FSTAT,                  /* Obtain an open file's attributes. */
+    SYS_CLONE_FILE,             /* Copy a file, sharing its data. */
+    SYS_GETRUSAGE,              /* Obtain resources used by processes. */
+    SYS_SPAWN,                  /* Start a program with set up descriptors. */
+    SYS_SPAWN_STATUS,           /* Wait for a spawned program to load. */
+    SYS_SYSCTL_GET,             /* Describe a kernel tunable. */
+    SYS_SYSCTL_SET              /* Set a kernel tunable. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -0,0 +1,19 @@
+#ifndef __LIB_SYSCTL_H
+#define __LIB_SYSCTL_H
+
+#include <stdbool.h>
+
+/* Longest name of a kernel tunable, not counting the null. */
+#define SYSCTL_NAME_MAX 31
+
+/* A kernel tunable, as sysctl_get() reports it to user
+   programs. */
+struct sysctl
+  {
+    char name[SYSCTL_NAME_MAX + 1];     /* Such as "sched.time_slice". */
+    unsigned value;                     /* Current value. */
+    unsigned min, max;                  /* Values it may be set to. */
+    bool boot_only;                     /* Set only at boot? */
+  };
+
+#endif /* lib/sysctl.h */
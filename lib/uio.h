@@ -0,0 +1,67 @@
+#ifndef __LIB_UIO_H
+#define __LIB_UIO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Vectored and batched I/O, shared by the kernel and user
+   programs. */
+
+/* One buffer of a readv() or writev(). */
+struct iovec
+  {
+    void *iov_base;             /* Start of buffer. */
+    size_t iov_len;             /* Length of buffer in bytes. */
+  };
+
+/* Maximum number of buffers in one readv() or writev(). */
+#define IOV_MAX 32
+
+/* Operations that can be queued in an I/O ring. */
+enum io_ring_op
+  {
+    IO_RING_READ,               /* Like read(). */
+    IO_RING_WRITE,              /* Like write(). */
+    IO_RING_SEEK                /* Like seek(). */
+  };
+
+/* A queued operation. */
+struct io_ring_sqe
+  {
+    uint32_t op;                /* An IO_RING_* operation. */
+    int fd;                     /* File descriptor. */
+    void *buf;                  /* Buffer to read into or write from. */
+    uint32_t len;               /* Bytes to transfer, or position
+                                   for IO_RING_SEEK. */
+    uint32_t user_data;         /* Passed back in the completion. */
+  };
+
+/* A completed operation. */
+struct io_ring_cqe
+  {
+    uint32_t user_data;         /* From the operation's entry. */
+    int32_t res;                /* What the system call would return. */
+  };
+
+/* Entries in each queue.  A power of 2. */
+#define IO_RING_ENTRIES 128
+
+/* An I/O ring: one page shared by a process and the kernel.
+
+   The process fills in entries of SQ starting at index SQ_TAIL
+   and then advances SQ_TAIL.  io_ring_enter() carries out the
+   entries from SQ_HEAD up to SQ_TAIL in order, advancing
+   SQ_HEAD, and posts a completion for each at CQ_TAIL, which it
+   advances too.  The process consumes completions from CQ_HEAD.
+   Indexes run freely and are taken modulo IO_RING_ENTRIES. */
+struct io_ring
+  {
+    uint32_t sq_head;           /* Next entry for the kernel. */
+    uint32_t sq_tail;           /* Next entry for the process. */
+    uint32_t cq_head;           /* Next completion for the process. */
+    uint32_t cq_tail;           /* Next completion for the kernel. */
+    struct io_ring_sqe sq[IO_RING_ENTRIES];
+    struct io_ring_cqe cq[IO_RING_ENTRIES];
+  };
+
+#endif /* lib/uio.h */
@@ -0,0 +1,74 @@
+#include <clock.h>
+#include <vdso.h>
+#include "threads/cycle.h"
+
+/* The kernel's shared page. */
+static const struct vdso_data *const vdso = VDSO_ADDR;
+
+/* Returns the number of timer ticks since the OS booted. */
+int64_t
+clock_ticks (void)
+{
+  unsigned seq;
+  int64_t ticks;
+
+  do
+    {
+      seq = seq_read_begin (&vdso->seq);
+      ticks = vdso->ticks;
+    }
+  while (seq_read_retry (&vdso->seq, seq));
+  return ticks;
+}
+
+/* Returns the number of timer ticks per second. */
+unsigned
+clock_ticks_per_sec (void)
+{
+  return vdso->timer_freq;
+}
+
+/* Returns the number of TSC cycles per second, as the kernel
+   measured it at boot. */
+uint64_t
+clock_tsc_hz (void)
+{
+  unsigned seq;
+  uint64_t hz;
+
+  do
+    {
+      seq = seq_read_begin (&vdso->seq);
+      hz = vdso->tsc_hz;
+    }
+  while (seq_read_retry (&vdso->seq, seq));
+  return hz;
+}
+
+/* Returns the number of nanoseconds since the OS booted, the same
+   as the kernel's timer_ns(). */
+uint64_t
+clock_ns (void)
+{
+  uint64_t hz, base, delta;
+  int64_t base_ticks;
+  unsigned seq;
+  uint32_t ns_per_tick = 1000 * 1000 * 1000 / vdso->timer_freq;
+
+  do
+    {
+      seq = seq_read_begin (&vdso->seq);
+      hz = vdso->tsc_hz;
+      base = vdso->tsc_base;
+      base_ticks = vdso->tsc_base_ticks;
+    }
+  while (seq_read_retry (&vdso->seq, seq));
+  if (hz == 0)
+    return clock_ticks () * ns_per_tick;
+
+  /* Split the division so that delta * 10^9 cannot overflow. */
+  delta = rdtsc () - base;
+  return (base_ticks * ns_per_tick
+          + delta / hz * 1000 * 1000 * 1000
+          + delta % hz * 1000 * 1000 * 1000 / hz);
+}
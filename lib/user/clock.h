@@ -0,0 +1,14 @@
+#ifndef __LIB_USER_CLOCK_H
+#define __LIB_USER_CLOCK_H
+
+#include <stdint.h>
+
+/* The kernel's monotonic clock, read from the page it shares
+   with every process (see lib/vdso.h), without a system call. */
+
+int64_t clock_ticks (void);
+unsigned clock_ticks_per_sec (void);
+uint64_t clock_tsc_hz (void);
+uint64_t clock_ns (void);
+
+#endif /* lib/user/clock.h */
@@ -1,14 +1,41 @@
 #include <stdio.h>
+#include <malloc.h>
 #include <string.h>
+#include <synch.h>
 #include <syscall.h>
 #include <syscall-nr.h>
 
+/* A buffered output handle. */
+struct FILE
+  {
+    int handle;                 /* File handle written to. */
+    int mode;                   /* _IOFBF, _IOLBF, or _IONBF. */
+    bool newline;               /* New-line buffered by this call? */
+    bool error;                 /* Has a write failed? */
+    struct mutex lock;          /* Serializes threads. */
+    struct FILE *next;          /* Next in open_files. */
+    size_t len;                 /* Bytes in BUF. */
+    char buf[BUFSIZ];           /* Output not yet written. */
+  };
+
+static FILE stdout_file = {.handle = STDOUT_FILENO, .mode = _IOLBF};
+FILE *stdout = &stdout_file;
+
+/* Every FILE, for fflush(NULL) at exit(). */
+static FILE *open_files = &stdout_file;
+static struct mutex open_files_lock;
+
+static void begin (FILE *);
+static void end (FILE *);
+static void put (FILE *, const char *, size_t);
+static void flush (FILE *);
+
 /* The standard vprintf() function,
    which is like printf() but uses a va_list. */
 int
 vprintf (const char *format, va_list args) 
 {
-  return vhprintf (STDOUT_FILENO, format, args);
+  return vfprintf (stdout, format, args);
 }
 
 /* Like printf(), but writes output to the given HANDLE. */
@@ -30,8 +57,10 @@ hprintf (int handle, const char *format, ...)
 int
 puts (const char *s) 
 {
-  write (STDOUT_FILENO, s, strlen (s));
-  putchar ('\n');
+  begin (stdout);
+  put (stdout, s, strlen (s));
+  put (stdout, "\n", 1);
+  end (stdout);
 
   return 0;
 }
@@ -39,12 +68,215 @@ puts (const char *s)
 /* Writes C to the console. */
 int
 putchar (int c) 
+{
+  return fputc (c, stdout);
+}
+
+/* Returns a new fully buffered FILE that writes to HANDLE, or a
+   null pointer if memory is not available. */
+FILE *
+fdopen (int handle)
+{
+  FILE *f = malloc (sizeof *f);
+
+  if (f == NULL)
+    return NULL;
+  f->handle = handle;
+  f->mode = _IOFBF;
+  f->newline = f->error = false;
+  mutex_init (&f->lock);
+  f->len = 0;
+
+  mutex_lock (&open_files_lock);
+  f->next = open_files;
+  open_files = f;
+  mutex_unlock (&open_files_lock);
+  return f;
+}
+
+/* Flushes F, closes its handle, and frees it.  Returns 0 if
+   successful, EOF if any write to it failed. */
+int
+fclose (FILE *f)
+{
+  FILE **fp;
+  int retval = fflush (f);
+
+  mutex_lock (&open_files_lock);
+  for (fp = &open_files; *fp != f; fp = &(*fp)->next)
+    continue;
+  *fp = f->next;
+  mutex_unlock (&open_files_lock);
+
+  close (f->handle);
+  if (f != stdout)
+    free (f);
+  return retval;
+}
+
+/* Writes out the output buffered in F, or in every FILE if F is
+   a null pointer.  Returns 0 if successful, EOF if any write to
+   F failed. */
+int
+fflush (FILE *f)
+{
+  int retval;
+
+  if (f == NULL)
+    {
+      mutex_lock (&open_files_lock);
+      for (f = open_files; f != NULL; f = f->next)
+        fflush (f);
+      mutex_unlock (&open_files_lock);
+      return 0;
+    }
+
+  mutex_lock (&f->lock);
+  flush (f);
+  retval = f->error ? EOF : 0;
+  mutex_unlock (&f->lock);
+  return retval;
+}
+
+/* Sets the buffering of F to MODE, one of _IOFBF, _IOLBF, or
+   _IONBF. */
+void
+setvbuf (FILE *f, int mode)
+{
+  mutex_lock (&f->lock);
+  flush (f);
+  f->mode = mode;
+  mutex_unlock (&f->lock);
+}
+
+/* Writes C to F.  Returns C. */
+int
+fputc (int c, FILE *f)
 {
   char c2 = c;
-  write (STDOUT_FILENO, &c2, 1);
+
+  begin (f);
+  put (f, &c2, 1);
+  end (f);
   return c;
 }
-
+
+/* Writes string S to F.  Returns 0. */
+int
+fputs (const char *s, FILE *f)
+{
+  begin (f);
+  put (f, s, strlen (s));
+  end (f);
+  return 0;
+}
+
+/* Writes CNT elements of SIZE bytes each from BUF to F.  Returns
+   CNT. */
+size_t
+fwrite (const void *buf, size_t size, size_t cnt, FILE *f)
+{
+  begin (f);
+  put (f, buf, size * cnt);
+  end (f);
+  return cnt;
+}
+
+/* Like printf(), but writes output to F. */
+int
+fprintf (FILE *f, const char *format, ...)
+{
+  va_list args;
+  int retval;
+
+  va_start (args, format);
+  retval = vfprintf (f, format, args);
+  va_end (args);
+
+  return retval;
+}
+
+/* Auxiliary data for vfprintf_helper(). */
+struct vfprintf_aux
+  {
+    FILE *file;         /* Output file. */
+    int char_cnt;       /* Total characters written so far. */
+  };
+
+/* Adds C to the FILE in AUX. */
+static void
+vfprintf_helper (char c, void *aux_)
+{
+  struct vfprintf_aux *aux = aux_;
+
+  put (aux->file, &c, 1);
+  aux->char_cnt++;
+}
+
+/* Like vprintf(), but writes output to F. */
+int
+vfprintf (FILE *f, const char *format, va_list args)
+{
+  struct vfprintf_aux aux;
+
+  aux.file = f;
+  aux.char_cnt = 0;
+  begin (f);
+  __vprintf (format, args, vfprintf_helper, &aux);
+  end (f);
+  return aux.char_cnt;
+}
+
+/* Begins a call that writes to F. */
+static void
+begin (FILE *f)
+{
+  mutex_lock (&f->lock);
+  f->newline = false;
+}
+
+/* Ends a call that wrote to F, writing out what it buffered if
+   F's mode calls for it. */
+static void
+end (FILE *f)
+{
+  if (f->mode == _IONBF || (f->mode == _IOLBF && f->newline))
+    flush (f);
+  mutex_unlock (&f->lock);
+}
+
+/* Buffers the SIZE bytes at S for F, writing out the buffer
+   whenever it fills up.  Writes more than a bufferful straight
+   from S. */
+static void
+put (FILE *f, const char *s, size_t size)
+{
+  if (f->mode == _IOLBF && memchr (s, '\n', size) != NULL)
+    f->newline = true;
+
+  if (f->len + size > BUFSIZ)
+    {
+      flush (f);
+      if (size > BUFSIZ)
+        {
+          if (write (f->handle, s, size) != (int) size)
+            f->error = true;
+          return;
+        }
+    }
+  memcpy (f->buf + f->len, s, size);
+  f->len += size;
+}
+
+/* Writes out the output buffered in F. */
+static void
+flush (FILE *f)
+{
+  if (f->len > 0 && write (f->handle, f->buf, f->len) != (int) f->len)
+    f->error = true;
+  f->len = 0;
+}
+
 /* Auxiliary data for vhprintf_helper(). */
 struct vhprintf_aux 
   {
@@ -55,20 +287,23 @@ struct vhprintf_aux
   };
 
 static void add_char (char, void *);
-static void flush (struct vhprintf_aux *);
+static void flush_aux (struct vhprintf_aux *);
 
 /* Formats the printf() format specification FORMAT with
    arguments given in ARGS and writes the output to the given
-   HANDLE. */
+   HANDLE, unbuffered.  Output buffered in stdout goes first. */
 int
 vhprintf (int handle, const char *format, va_list args) 
 {
   struct vhprintf_aux aux;
+
+  if (handle == STDOUT_FILENO)
+    fflush (stdout);
   aux.p = aux.buf;
   aux.char_cnt = 0;
   aux.handle = handle;
   __vprintf (format, args, add_char, &aux);
-  flush (&aux);
+  flush_aux (&aux);
   return aux.char_cnt;
 }
 
@@ -80,13 +315,13 @@ add_char (char c, void *aux_)
   struct vhprintf_aux *aux = aux_;
   *aux->p++ = c;
   if (aux->p >= aux->buf + sizeof aux->buf)
-    flush (aux);
+    flush_aux (aux);
   aux->char_cnt++;
 }
 
 /* Flushes the buffer in AUX. */
 static void
-flush (struct vhprintf_aux *aux)
+flush_aux (struct vhprintf_aux *aux)
 {
   if (aux->p > aux->buf)
     write (aux->handle, aux->buf, aux->p - aux->buf);
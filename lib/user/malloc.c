@@ -0,0 +1,338 @@
+#include <malloc.h>
+#include <debug.h>
+#include <stdint.h>
+#include <string.h>
+#include <synch.h>
+#include <syscall.h>
+
+/* A size-class allocator on sbrk().
+
+   A request of up to BLOCK_MAX bytes is rounded up to a power of
+   two, at least BLOCK_MIN, and served from a page carved into
+   blocks of that size.  Each thread takes blocks from, and gives
+   them back to, one of CACHE_CNT caches picked by the stack slot
+   its stack is in (see userprog/process.c), so that up to
+   CACHE_CNT threads each have a cache to themselves.  The mutex
+   on a cache is then never contended, and taking it never makes
+   a system call.  Pages of blocks are not given back.
+
+   A larger request gets a run of whole pages of its own.  A freed
+   run is merged with free neighbors, and once TRIM_PAGES of them
+   end the heap, they are given back with a negative sbrk().
+
+   Every page of blocks, and every run, starts with a struct
+   page_hdr, which free() finds by rounding the block's address
+   down to a page boundary. */
+
+/* Bytes in a page. */
+#define PAGE_SIZE 4096
+
+/* Smallest block, and number of block sizes. */
+#define BLOCK_MIN 16
+#define CLASS_CNT 7
+#define BLOCK_MAX (BLOCK_MIN << (CLASS_CNT - 1))
+
+/* Number of caches, and log2 of the bytes in a stack slot. */
+#define CACHE_CNT 8
+#define STACK_SLOT_SHIFT 18
+
+/* Free pages at the end of the heap that are given back. */
+#define TRIM_PAGES 32
+
+/* Header of a page of blocks or of a run. */
+struct page_hdr
+  {
+    unsigned magic;             /* Detects bad pointers. */
+    unsigned class;             /* Size class, or CLASS_CNT for a run. */
+    size_t page_cnt;            /* Pages in a run. */
+    struct page_hdr *next;      /* Next free run, in address order. */
+  };
+
+/* Bytes of each page taken up by its header, keeping blocks
+   aligned to BLOCK_MIN. */
+#define HDR_SIZE 16
+
+#define PAGE_MAGIC 0x9a548eed
+
+/* A free block. */
+struct block
+  {
+    struct block *next;
+  };
+
+/* Free blocks of each size, for the threads that pick it.  Each
+   cache has a cache line of its own. */
+struct cache
+  {
+    struct mutex lock;
+    struct block *free[CLASS_CNT];
+  }
+__attribute__ ((aligned (64)));
+
+static struct cache caches[CACHE_CNT];
+
+/* Free runs, in address order, and the mutex that guards them
+   and sbrk(). */
+static struct page_hdr *free_runs;
+static struct mutex heap_lock;
+
+static void *get_pages (size_t page_cnt);
+static void free_pages (struct page_hdr *);
+
+/* Returns the cache of the running thread. */
+static struct cache *
+cache_current (void)
+{
+  int local;
+
+  return &caches[((uintptr_t) &local >> STACK_SLOT_SHIFT) % CACHE_CNT];
+}
+
+/* Returns the header of the page holding block P. */
+static struct page_hdr *
+page_of (void *p)
+{
+  struct page_hdr *h = (struct page_hdr *) ((uintptr_t) p
+                                            & ~(PAGE_SIZE - 1));
+
+  ASSERT (h->magic == PAGE_MAGIC);
+  return h;
+}
+
+/* Returns the usable bytes of block P. */
+static size_t
+block_size (void *p)
+{
+  struct page_hdr *h = page_of (p);
+
+  if (h->class == CLASS_CNT)
+    return h->page_cnt * PAGE_SIZE - HDR_SIZE;
+  return BLOCK_MIN << h->class;
+}
+
+/* Obtains and returns a new block of at least SIZE bytes.
+   Returns a null pointer if SIZE is 0 or memory is not
+   available. */
+void *
+malloc (size_t size)
+{
+  struct cache *c;
+  struct block *b;
+  unsigned class;
+
+  if (size == 0)
+    return NULL;
+
+  if (size > BLOCK_MAX)
+    {
+      size_t page_cnt = (size + HDR_SIZE + PAGE_SIZE - 1) / PAGE_SIZE;
+      struct page_hdr *h;
+
+      if (size > SIZE_MAX - HDR_SIZE - PAGE_SIZE)
+        return NULL;
+      h = get_pages (page_cnt);
+      if (h == NULL)
+        return NULL;
+      h->class = CLASS_CNT;
+      h->page_cnt = page_cnt;
+      return (uint8_t *) h + HDR_SIZE;
+    }
+
+  for (class = 0; (size_t) BLOCK_MIN << class < size; class++)
+    continue;
+
+  c = cache_current ();
+  mutex_lock (&c->lock);
+  if (c->free[class] == NULL)
+    {
+      /* Carve a new page into blocks. */
+      size_t bsize = BLOCK_MIN << class;
+      struct page_hdr *h = get_pages (1);
+      uint8_t *p;
+
+      if (h == NULL)
+        {
+          mutex_unlock (&c->lock);
+          return NULL;
+        }
+      h->class = class;
+      for (p = (uint8_t *) h + PAGE_SIZE - bsize;
+           p >= (uint8_t *) h + HDR_SIZE; p -= bsize)
+        {
+          b = (struct block *) p;
+          b->next = c->free[class];
+          c->free[class] = b;
+        }
+    }
+  b = c->free[class];
+  c->free[class] = b->next;
+  mutex_unlock (&c->lock);
+  return b;
+}
+
+/* Allocates and returns A times B bytes initialized to zeroes.
+   Returns a null pointer if memory is not available. */
+void *
+calloc (size_t a, size_t b)
+{
+  void *p;
+  size_t size;
+
+  size = a * b;
+  if (size < a || size < b)
+    return NULL;
+
+  p = malloc (size);
+  if (p != NULL)
+    memset (p, 0, size);
+  return p;
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
+   moving it in the process.  If successful, returns the new
+   block; on failure, returns a null pointer.  A call with null
+   OLD_BLOCK is equivalent to malloc(NEW_SIZE).  A call with zero
+   NEW_SIZE is equivalent to free(OLD_BLOCK). */
+void *
+realloc (void *old_block, size_t new_size)
+{
+  void *new_block;
+  size_t old_size;
+
+  if (new_size == 0)
+    {
+      free (old_block);
+      return NULL;
+    }
+  if (old_block == NULL)
+    return malloc (new_size);
+
+  old_size = block_size (old_block);
+  if (new_size <= old_size)
+    return old_block;
+  new_block = malloc (new_size);
+  if (new_block != NULL)
+    {
+      memcpy (new_block, old_block, old_size);
+      free (old_block);
+    }
+  return new_block;
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void
+free (void *p)
+{
+  struct page_hdr *h;
+  struct cache *c;
+  struct block *b = p;
+
+  if (p == NULL)
+    return;
+
+  h = page_of (p);
+  if (h->class == CLASS_CNT)
+    {
+      free_pages (h);
+      return;
+    }
+
+#ifndef NDEBUG
+  /* Clear the block to help detect use-after-free bugs. */
+  memset (p, 0xcc, BLOCK_MIN << h->class);
+#endif
+
+  c = cache_current ();
+  mutex_lock (&c->lock);
+  b->next = c->free[h->class];
+  c->free[h->class] = b;
+  mutex_unlock (&c->lock);
+}
+
+/* Returns PAGE_CNT contiguous pages, headed by a struct page_hdr
+   with only its magic number set, from the free runs or else by
+   growing the heap.  Returns a null pointer if memory is not
+   available. */
+static void *
+get_pages (size_t page_cnt)
+{
+  struct page_hdr **rp, *h = NULL;
+  uint8_t *brk;
+  size_t pad;
+
+  mutex_lock (&heap_lock);
+  for (rp = &free_runs; *rp != NULL; rp = &(*rp)->next)
+    if ((*rp)->page_cnt >= page_cnt)
+      {
+        /* Take the tail of the run, or all of it. */
+        struct page_hdr *r = *rp;
+
+        r->page_cnt -= page_cnt;
+        if (r->page_cnt == 0)
+          {
+            *rp = r->next;
+            h = r;
+          }
+        else
+          h = (struct page_hdr *) ((uint8_t *) r + r->page_cnt * PAGE_SIZE);
+        break;
+      }
+
+  if (h == NULL)
+    {
+      /* Grow the heap by whole pages, after aligning the break if
+         someone else left it unaligned. */
+      brk = sbrk (0);
+      pad = -(uintptr_t) brk % PAGE_SIZE;
+      if (brk != SBRK_FAILED
+          && page_cnt <= (SIZE_MAX - pad) / PAGE_SIZE
+          && sbrk (pad + page_cnt * PAGE_SIZE) != SBRK_FAILED)
+        h = (struct page_hdr *) (brk + pad);
+    }
+  mutex_unlock (&heap_lock);
+
+  if (h != NULL)
+    h->magic = PAGE_MAGIC;
+  return h;
+}
+
+/* Returns run H to the free runs, merging it with its neighbors,
+   and gives back the last run if it ends the heap and is big
+   enough. */
+static void
+free_pages (struct page_hdr *h)
+{
+  struct page_hdr **rp, *prev = NULL;
+
+  mutex_lock (&heap_lock);
+  for (rp = &free_runs; *rp != NULL && *rp < h; rp = &(*rp)->next)
+    prev = *rp;
+  h->next = *rp;
+  *rp = h;
+
+  /* Merge with the next run, then the previous one. */
+  if (h->next != NULL
+      && (uint8_t *) h + h->page_cnt * PAGE_SIZE == (uint8_t *) h->next)
+    {
+      h->page_cnt += h->next->page_cnt;
+      h->next = h->next->next;
+    }
+  if (prev != NULL
+      && (uint8_t *) prev + prev->page_cnt * PAGE_SIZE == (uint8_t *) h)
+    {
+      prev->page_cnt += h->page_cnt;
+      prev->next = h->next;
+      h = prev;
+    }
+
+  if (h->next == NULL && h->page_cnt >= TRIM_PAGES
+      && (uint8_t *) h + h->page_cnt * PAGE_SIZE == sbrk (0))
+    {
+      for (rp = &free_runs; *rp != h; rp = &(*rp)->next)
+        continue;
+      *rp = NULL;
+      sbrk (-(intptr_t) (h->page_cnt * PAGE_SIZE));
+    }
+  mutex_unlock (&heap_lock);
+}
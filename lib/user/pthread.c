@@ -0,0 +1,102 @@
+#include <pthread.h>
+
+/* Runs START on ARG in a new thread, and ends the thread with
+   its result. */
+static void
+run_thread (void *start_, void *arg)
+{
+  void *(*start) (void *) = (void *(*) (void *)) start_;
+
+  pthread_exit (start (arg));
+}
+
+/* Starts a thread running START on ARG, and stores its id in
+   *THREAD.  Returns 0 if successful, -1 on failure. */
+int
+pthread_create (pthread_t *thread, void *(*start) (void *), void *arg)
+{
+  tid_t tid = thread_spawn (run_thread, (void *) start, arg);
+
+  if (tid == TID_ERROR)
+    return -1;
+  *thread = tid;
+  return 0;
+}
+
+/* Waits for THREAD to exit and, if RESULT is non-null, stores its
+   result in *RESULT.  Returns 0 if successful, -1 if THREAD is not
+   a thread of this process or was already joined. */
+int
+pthread_join (pthread_t thread, void **result)
+{
+  int status;
+
+  if (thread_join (thread, &status) < 0)
+    return -1;
+  if (result != NULL)
+    *result = (void *) status;
+  return 0;
+}
+
+/* Ends the calling thread with RESULT.  In the first thread of a
+   process, this is exit() with RESULT as the status. */
+void
+pthread_exit (void *result)
+{
+  exit ((int) result);
+}
+
+int
+pthread_mutex_init (pthread_mutex_t *m, const void *attr UNUSED)
+{
+  mutex_init (m);
+  return 0;
+}
+
+int
+pthread_mutex_lock (pthread_mutex_t *m)
+{
+  mutex_lock (m);
+  return 0;
+}
+
+int
+pthread_mutex_trylock (pthread_mutex_t *m)
+{
+  return mutex_trylock (m) ? 0 : EBUSY;
+}
+
+int
+pthread_mutex_unlock (pthread_mutex_t *m)
+{
+  mutex_unlock (m);
+  return 0;
+}
+
+int
+pthread_cond_init (pthread_cond_t *cv, const void *attr UNUSED)
+{
+  condvar_init (cv);
+  return 0;
+}
+
+int
+pthread_cond_wait (pthread_cond_t *cv, pthread_mutex_t *m)
+{
+  condvar_wait (cv, m);
+  return 0;
+}
+
+int
+pthread_cond_signal (pthread_cond_t *cv)
+{
+  condvar_signal (cv);
+  return 0;
+}
+
+int
+pthread_cond_broadcast (pthread_cond_t *cv)
+{
+  condvar_broadcast (cv);
+  return 0;
+}
@@ -0,0 +1,41 @@
+#ifndef __LIB_USER_PTHREAD_H
+#define __LIB_USER_PTHREAD_H
+
+#include <debug.h>
+#include <synch.h>
+#include <syscall.h>
+
+/* POSIX-style threads, on thread_spawn() and thread_join().
+
+   A thread's start routine returns a result, or passes one to
+   pthread_exit(), that pthread_join() hands back.  Only threads
+   of the same process may join a thread, and only once.  When
+   the first thread of a process exits, every other thread ends
+   with it.
+
+   Mutexes and condition variables are those of <synch.h>.  The
+   functions on them return 0, or an error number, as POSIX has
+   them do. */
+
+typedef tid_t pthread_t;
+typedef struct mutex pthread_mutex_t;
+typedef struct condvar pthread_cond_t;
+
+/* Error number of pthread_mutex_trylock() on a held mutex. */
+#define EBUSY 16
+
+int pthread_create (pthread_t *, void *(*start) (void *), void *arg);
+int pthread_join (pthread_t, void **result);
+void pthread_exit (void *result) NO_RETURN;
+
+int pthread_mutex_init (pthread_mutex_t *, const void *attr);
+int pthread_mutex_lock (pthread_mutex_t *);
+int pthread_mutex_trylock (pthread_mutex_t *);
+int pthread_mutex_unlock (pthread_mutex_t *);
+
+int pthread_cond_init (pthread_cond_t *, const void *attr);
+int pthread_cond_wait (pthread_cond_t *, pthread_mutex_t *);
+int pthread_cond_signal (pthread_cond_t *);
+int pthread_cond_broadcast (pthread_cond_t *);
+
+#endif /* lib/user/pthread.h */
@@ -4,4 +4,37 @@
 int hprintf (int, const char *, ...) PRINTF_FORMAT (2, 3);
 int vhprintf (int, const char *, va_list) PRINTF_FORMAT (2, 0);
 
+/* Buffered output.
+
+   A FILE collects output for a file handle and writes it with a
+   single write() when its buffer fills, when fflush() is called,
+   or at exit().  A line-buffered FILE also writes it at the end of
+   each call that output a new-line, and an unbuffered one at the
+   end of each call.  stdout, which printf(), puts() and putchar()
+   use, is line-buffered.  Threads may share a FILE. */
+
+typedef struct FILE FILE;
+extern FILE *stdout;
+
+/* Buffering modes. */
+#define _IOFBF 0                /* Fully buffered. */
+#define _IOLBF 1                /* Line buffered. */
+#define _IONBF 2                /* Unbuffered. */
+
+/* Bytes in a FILE's buffer. */
+#define BUFSIZ 1024
+
+/* Returned on failure. */
+#define EOF (-1)
+
+FILE *fdopen (int handle);
+int fclose (FILE *);
+int fflush (FILE *);
+void setvbuf (FILE *, int mode);
+int fputc (int, FILE *);
+int fputs (const char *, FILE *);
+size_t fwrite (const void *, size_t size, size_t cnt, FILE *);
+int fprintf (FILE *, const char *, ...) PRINTF_FORMAT (2, 3);
+int vfprintf (FILE *, const char *, va_list) PRINTF_FORMAT (2, 0);
+
 #endif /* lib/user/stdio.h */
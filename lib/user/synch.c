@@ -0,0 +1,127 @@
+#include <synch.h>
+#include <limits.h>
+#include <syscall.h>
+
+/* The mutex is the three-state one of Drepper, "Futexes Are
+   Tricky": a thread that finds the mutex held marks it as having
+   waiters before it sleeps, so that only an unlock that sees the
+   mark makes a system call. */
+
+/* Atomically stores NEW in *P and returns the old value. */
+static inline int
+atomic_xchg (int *p, int new)
+{
+  asm volatile ("xchgl %0, %1" : "+r" (new), "+m" (*p) : : "memory");
+  return new;
+}
+
+/* Atomically stores NEW in *P if it holds OLD, and returns the
+   value *P held. */
+static inline int
+atomic_cmpxchg (int *p, int old, int new)
+{
+  asm volatile ("lock cmpxchgl %2, %1"
+                : "+a" (old), "+m" (*p) : "r" (new) : "memory");
+  return old;
+}
+
+/* Atomically adds N to *P and returns the old value. */
+static inline int
+atomic_fetch_add (int *p, int n)
+{
+  asm volatile ("lock xaddl %0, %1" : "+r" (n), "+m" (*p) : : "memory");
+  return n;
+}
+
+/* Initializes M as an unlocked mutex. */
+void
+mutex_init (struct mutex *m)
+{
+  m->state = 0;
+}
+
+/* Acquires M, sleeping until it is available if necessary. */
+void
+mutex_lock (struct mutex *m)
+{
+  int c = atomic_cmpxchg (&m->state, 0, 1);
+
+  if (c == 0)
+    return;
+
+  /* Mark M as having waiters, then sleep until an unlock finds
+     it free for us.  Having slept, we cannot know whether others
+     still wait, so we keep the mark when we take M. */
+  if (c != 2)
+    c = atomic_xchg (&m->state, 2);
+  while (c != 0)
+    {
+      futex_wait (&m->state, 2);
+      c = atomic_xchg (&m->state, 2);
+    }
+}
+
+/* Tries to acquire M without sleeping.  Returns true if
+   successful, false if M is held by another thread. */
+bool
+mutex_trylock (struct mutex *m)
+{
+  return atomic_cmpxchg (&m->state, 0, 1) == 0;
+}
+
+/* Releases M, which the caller must hold, and wakes a thread
+   waiting for it, if any. */
+void
+mutex_unlock (struct mutex *m)
+{
+  if (atomic_fetch_add (&m->state, -1) != 1)
+    {
+      m->state = 0;
+      futex_wake (&m->state, 1);
+    }
+}
+
+/* Initializes CV as a condition variable. */
+void
+condvar_init (struct condvar *cv)
+{
+  cv->seq = 0;
+}
+
+/* Atomically releases M and waits for CV to be signaled, then
+   reacquires M before returning.  M must be held on entry.
+   Wake-ups may be spurious, so the caller must test its
+   condition again afterward.
+
+   A signal between releasing M and going to sleep changes the
+   sequence number, so futex_wait() returns at once instead of
+   missing it. */
+void
+condvar_wait (struct condvar *cv, struct mutex *m)
+{
+  int seq = cv->seq;
+
+  mutex_unlock (m);
+  futex_wait (&cv->seq, seq);
+
+  /* Other threads may still be waiting on M, so take it with the
+     waiters mark set, as mutex_lock() does after sleeping. */
+  while (atomic_xchg (&m->state, 2) != 0)
+    futex_wait (&m->state, 2);
+}
+
+/* Wakes one thread waiting on CV, if any. */
+void
+condvar_signal (struct condvar *cv)
+{
+  atomic_fetch_add (&cv->seq, 1);
+  futex_wake (&cv->seq, 1);
+}
+
+/* Wakes all threads waiting on CV. */
+void
+condvar_broadcast (struct condvar *cv)
+{
+  atomic_fetch_add (&cv->seq, 1);
+  futex_wake (&cv->seq, INT_MAX);
+}
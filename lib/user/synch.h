@@ -0,0 +1,33 @@
+#ifndef __LIB_USER_SYNCH_H
+#define __LIB_USER_SYNCH_H
+
+#include <stdbool.h>
+
+/* Mutexes and condition variables for threads that share memory,
+   built on the futex system calls.  Taking a free mutex, and
+   releasing one that no thread waits for, do not enter the
+   kernel at all. */
+
+/* Mutex. */
+struct mutex
+  {
+    int state;                  /* 0: free, 1: held, 2: held, waiters. */
+  };
+
+void mutex_init (struct mutex *);
+void mutex_lock (struct mutex *);
+bool mutex_trylock (struct mutex *);
+void mutex_unlock (struct mutex *);
+
+/* Condition variable. */
+struct condvar
+  {
+    int seq;                    /* Bumped by every signal. */
+  };
+
+void condvar_init (struct condvar *);
+void condvar_wait (struct condvar *, struct mutex *);
+void condvar_signal (struct condvar *);
+void condvar_broadcast (struct condvar *);
+
+#endif /* lib/user/synch.h */
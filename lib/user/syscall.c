@@ -1,31 +1,50 @@
 #include <syscall.h>
+#include <stdio.h>
 #include "../syscall-nr.h"
 
+/* Nonzero if system calls enter the kernel with SYSENTER, which
+   the kernel accepts whenever the CPU supports it.  Set by
+   syscall_init_entry(), but may be cleared to force
+   "int $0x30". */
+int syscall_use_sysenter;
+
+/* Enters the kernel for the system call whose number and
+   arguments have been pushed: with SYSENTER, passing the stack
+   pointer in ECX and the address to return to in EDX, if
+   syscall_use_sysenter is set, otherwise with "int $0x30".
+   Either way ECX and EDX are clobbered. */
+#define SYSCALL_ENTER                                           \
+        "cmpl $0, syscall_use_sysenter; je 1f; "                \
+        "movl %%esp, %%ecx; movl $2f, %%edx; sysenter; "        \
+        "1: int $0x30; 2: "
+
 /* Invokes syscall NUMBER, passing no arguments, and returns the
    return value as an `int'. */
 #define syscall0(NUMBER)                                        \
         ({                                                      \
           int retval;                                           \
           asm volatile                                          \
-            ("pushl %[number]; int $0x30; addl $4, %%esp"       \
+            ("pushl %[number]; " SYSCALL_ENTER                  \
+             "addl $4, %%esp"                                   \
                : "=a" (retval)                                  \
                : [number] "i" (NUMBER)                          \
-               : "memory");                                     \
+               : "ecx", "edx", "memory");                       \
           retval;                                               \
         })
 
 /* Invokes syscall NUMBER, passing argument ARG0, and returns the
    return value as an `int'. */
-#define syscall1(NUMBER, ARG0)                                           \
-        ({                                                               \
-          int retval;                                                    \
-          asm volatile                                                   \
-            ("pushl %[arg0]; pushl %[number]; int $0x30; addl $8, %%esp" \
-               : "=a" (retval)                                           \
-               : [number] "i" (NUMBER),                                  \
-                 [arg0] "g" (ARG0)                                       \
-               : "memory");                                              \
-          retval;                                                        \
+#define syscall1(NUMBER, ARG0)                                  \
+        ({                                                      \
+          int retval;                                           \
+          asm volatile                                          \
+            ("pushl %[arg0]; pushl %[number]; " SYSCALL_ENTER   \
+             "addl $8, %%esp"                                   \
+               : "=a" (retval)                                  \
+               : [number] "i" (NUMBER),                         \
+                 [arg0] "g" (ARG0)                              \
+               : "ecx", "edx", "memory");                       \
+          retval;                                               \
         })
 
 /* Invokes syscall NUMBER, passing arguments ARG0 and ARG1, and
@@ -35,12 +54,13 @@
           int retval;                                           \
           asm volatile                                          \
             ("pushl %[arg1]; pushl %[arg0]; "                   \
-             "pushl %[number]; int $0x30; addl $12, %%esp"      \
+             "pushl %[number]; " SYSCALL_ENTER                  \
+             "addl $12, %%esp"                                  \
                : "=a" (retval)                                  \
                : [number] "i" (NUMBER),                         \
                  [arg0] "r" (ARG0),                             \
                  [arg1] "r" (ARG1)                              \
-               : "memory");                                     \
+               : "ecx", "edx", "memory");                       \
           retval;                                               \
         })
 
@@ -51,16 +71,49 @@
           int retval;                                           \
           asm volatile                                          \
             ("pushl %[arg2]; pushl %[arg1]; pushl %[arg0]; "    \
-             "pushl %[number]; int $0x30; addl $16, %%esp"      \
+             "pushl %[number]; " SYSCALL_ENTER                  \
+             "addl $16, %%esp"                                  \
                : "=a" (retval)                                  \
                : [number] "i" (NUMBER),                         \
                  [arg0] "r" (ARG0),                             \
                  [arg1] "r" (ARG1),                             \
                  [arg2] "r" (ARG2)                              \
-               : "memory");                                     \
+               : "ecx", "edx", "memory");                       \
+          retval;                                               \
+        })
+
+/* Invokes syscall NUMBER, passing arguments ARG0, ARG1, ARG2,
+   and ARG3, and returns the return value as an `int'.  ARG3 is
+   pushed first, while any stack-relative operand still refers
+   to where the compiler put it. */
+#define syscall4(NUMBER, ARG0, ARG1, ARG2, ARG3)                \
+        ({                                                      \
+          int retval;                                           \
+          asm volatile                                          \
+            ("pushl %[arg3]; pushl %[arg2]; pushl %[arg1]; "    \
+             "pushl %[arg0]; pushl %[number]; " SYSCALL_ENTER   \
+             "addl $20, %%esp"                                  \
+               : "=a" (retval)                                  \
+               : [number] "i" (NUMBER),                         \
+                 [arg0] "r" (ARG0),                             \
+                 [arg1] "r" (ARG1),                             \
+                 [arg2] "r" (ARG2),                             \
+                 [arg3] "g" (ARG3)                              \
+               : "ecx", "edx", "memory");                       \
           retval;                                               \
         })
 
+/* Sets syscall_use_sysenter if the CPU supports SYSENTER, as
+   reported by CPUID function 1 in EDX bit 11. */
+void
+syscall_init_entry (void)
+{
+  unsigned eax = 1, ebx, ecx, edx;
+
+  asm ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  syscall_use_sysenter = (edx & (1u << 11)) != 0;
+}
+
 void
 halt (void) 
 {
@@ -71,6 +124,7 @@ halt (void)
 void
 exit (int status)
 {
+  fflush (NULL);
   syscall1 (SYS_EXIT, status);
   NOT_REACHED ();
 }
@@ -182,3 +236,226 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+pid_t
+fork (void)
+{
+  return (pid_t) syscall0 (SYS_FORK);
+}
+
+pid_t
+getpid (void)
+{
+  return (pid_t) syscall0 (SYS_GETPID);
+}
+
+pid_t
+waitany (int *status)
+{
+  return (pid_t) syscall1 (SYS_WAITANY, status);
+}
+
+int
+readv (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_READV, fd, iov, iovcnt);
+}
+
+int
+writev (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_WRITEV, fd, iov, iovcnt);
+}
+
+bool
+io_ring_setup (struct io_ring *ring)
+{
+  return syscall1 (SYS_IO_RING_SETUP, ring);
+}
+
+int
+io_ring_enter (void)
+{
+  return syscall0 (SYS_IO_RING_ENTER);
+}
+
+int
+sendfile (int out_fd, int in_fd, unsigned *offset, unsigned count)
+{
+  return syscall4 (SYS_SENDFILE, out_fd, in_fd, offset, count);
+}
+
+void
+vmstat (struct vmstat *st)
+{
+  syscall1 (SYS_VMSTAT, st);
+}
+
+int
+futex_wait (int *addr, int val)
+{
+  return syscall2 (SYS_FUTEX_WAIT, addr, val);
+}
+
+int
+futex_wake (int *addr, int cnt)
+{
+  return syscall2 (SYS_FUTEX_WAKE, addr, cnt);
+}
+
+tid_t
+thread_spawn (void (*entry) (void *, void *), void *aux1, void *aux2)
+{
+  return syscall3 (SYS_THREAD_SPAWN, entry, aux1, aux2);
+}
+
+int
+thread_join (tid_t tid, int *status)
+{
+  return syscall2 (SYS_THREAD_JOIN, tid, status);
+}
+
+void *
+sbrk (intptr_t increment)
+{
+  return (void *) syscall1 (SYS_SBRK, increment);
+}
+
+int
+shm_create (size_t size)
+{
+  return syscall1 (SYS_SHM_CREATE, size);
+}
+
+mapid_t
+shm_map (int id, void *addr)
+{
+  return syscall2 (SYS_SHM_MAP, id, addr);
+}
+
+void
+shm_unmap (mapid_t mapid)
+{
+  munmap (mapid);
+}
+
+int
+pipe (int fds[2])
+{
+  return syscall1 (SYS_PIPE, fds);
+}
+
+int
+dup2 (int old_fd, int new_fd)
+{
+  return syscall2 (SYS_DUP2, old_fd, new_fd);
+}
+
+int
+madvise (void *addr, size_t size, enum advice advice)
+{
+  return syscall3 (SYS_MADVISE, addr, size, advice);
+}
+
+int
+fadvise (int fd, unsigned offset, unsigned len, enum advice advice)
+{
+  return syscall4 (SYS_FADVISE, fd, offset, len, advice);
+}
+
+int
+getdents (int fd, struct dirent *ents, size_t cnt)
+{
+  return syscall3 (SYS_GETDENTS, fd, ents, cnt);
+}
+
+int
+fsync (int fd)
+{
+  return syscall1 (SYS_FSYNC, fd);
+}
+
+int
+fdatasync (int fd)
+{
+  return syscall1 (SYS_FDATASYNC, fd);
+}
+
+int
+fcntl (int fd, enum fcntl_cmd cmd, int arg)
+{
+  return syscall3 (SYS_FCNTL, fd, cmd, arg);
+}
+
+bool
+net_map (struct net_ring *ring)
+{
+  return syscall1 (SYS_NET_MAP, ring);
+}
+
+int
+net_send (void)
+{
+  return syscall0 (SYS_NET_SEND);
+}
+
+int
+net_recv (bool wait)
+{
+  return syscall1 (SYS_NET_RECV, wait);
+}
+
+bool
+sched_deadline (int runtime, int period, int deadline)
+{
+  return syscall3 (SYS_SCHED_DEADLINE, runtime, period, deadline);
+}
+
+int
+stat (const char *file, struct stat *st)
+{
+  return syscall2 (SYS_STAT, file, st);
+}
+
+int
+fstat (int fd, struct stat *st)
+{
+  return syscall2 (SYS_FSTAT, fd, st);
+}
+
+bool
+clone_file (const char *src, const char *dst)
+{
+  return syscall2 (SYS_CLONE_FILE, src, dst);
+}
+
+int
+getrusage (int who, struct rusage *usage)
+{
+  return syscall2 (SYS_GETRUSAGE, who, usage);
+}
+
+pid_t
+spawn (const char *file, char *const argv[],
+       const struct spawn_action *actions, int flags)
+{
+  return syscall4 (SYS_SPAWN, file, argv, actions, flags);
+}
+
+int
+spawn_status (pid_t pid)
+{
+  return syscall1 (SYS_SPAWN_STATUS, pid);
+}
+
+bool
+sysctl_get (unsigned idx, struct sysctl *sc)
+{
+  return syscall2 (SYS_SYSCTL_GET, idx, sc);
+}
+
+bool
+sysctl_set (const char *name, unsigned value)
+{
+  return syscall2 (SYS_SYSCTL_SET, name, value);
+}
@@ -2,16 +2,34 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <advice.h>
 #include <debug.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <net.h>
+#include <rusage.h>
+#include <spawn.h>
+#include <stat.h>
+#include <sysctl.h>
+#include <uio.h>
+#include <vmstat.h>
 
 /* Process identifier. */
 typedef int pid_t;
 #define PID_ERROR ((pid_t) -1)
 
+/* Thread identifier. */
+typedef int tid_t;
+#define TID_ERROR ((tid_t) -1)
+
 /* Map region identifier. */
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
 
+/* Return value of sbrk() on failure. */
+#define SBRK_FAILED ((void *) -1)
+
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
@@ -45,4 +63,48 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+pid_t fork (void);
+pid_t getpid (void);
+pid_t waitany (int *status);
+int readv (int fd, const struct iovec *, int iovcnt);
+int writev (int fd, const struct iovec *, int iovcnt);
+bool io_ring_setup (struct io_ring *);
+int io_ring_enter (void);
+int sendfile (int out_fd, int in_fd, unsigned *offset, unsigned count);
+void vmstat (struct vmstat *);
+int futex_wait (int *addr, int val);
+int futex_wake (int *addr, int cnt);
+tid_t thread_spawn (void (*entry) (void *, void *), void *aux1, void *aux2);
+int thread_join (tid_t, int *status);
+void *sbrk (intptr_t increment);
+int shm_create (size_t size);
+mapid_t shm_map (int id, void *addr);
+void shm_unmap (mapid_t);
+int pipe (int fds[2]);
+int dup2 (int old_fd, int new_fd);
+int madvise (void *addr, size_t size, enum advice);
+int fadvise (int fd, unsigned offset, unsigned len, enum advice);
+int getdents (int fd, struct dirent *, size_t cnt);
+int fsync (int fd);
+int fdatasync (int fd);
+int fcntl (int fd, enum fcntl_cmd, int arg);
+bool net_map (struct net_ring *);
+int net_send (void);
+int net_recv (bool wait);
+bool sched_deadline (int runtime, int period, int deadline);
+int stat (const char *file, struct stat *);
+int fstat (int fd, struct stat *);
+bool clone_file (const char *src, const char *dst);
+int getrusage (int who, struct rusage *);
+pid_t spawn (const char *file, char *const argv[],
+             const struct spawn_action *actions, int flags);
+int spawn_status (pid_t);
+bool sysctl_get (unsigned idx, struct sysctl *);
+bool sysctl_set (const char *name, unsigned value);
+
+/* Entry into the kernel.  Set up by _start(). */
+extern int syscall_use_sysenter;
+void syscall_init_entry (void);
+
 #endif /* lib/user/syscall.h */
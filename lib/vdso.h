@@ -0,0 +1,29 @@
+#ifndef __LIB_VDSO_H
+#define __LIB_VDSO_H
+
+#include <stdint.h>
+#include <seqlock.h>
+
+/* Timekeeping data, shared by the kernel and user programs.
+
+   The kernel keeps this structure at the start of a page of its
+   own, which every process's page directory maps read-only at
+   VDSO_ADDR, so that user programs can read the time without a
+   system call.  SEQ protects the other members: only the timer
+   interrupt updates them, and readers retry if it did while they
+   were reading (see lib/seqlock.h). */
+struct vdso_data
+  {
+    seqcount_t seq;             /* Protects the members below. */
+    uint32_t timer_freq;        /* Timer ticks per second. */
+    int64_t ticks;              /* Timer ticks since boot. */
+    uint64_t tsc_hz;            /* TSC cycles per second, or 0. */
+    uint64_t tsc_base;          /* TSC at timer tick TSC_BASE_TICKS. */
+    int64_t tsc_base_ticks;
+  };
+
+/* User virtual address of the page, just below where executables
+   are linked. */
+#define VDSO_ADDR ((void *) 0x08047000)
+
+#endif /* lib/vdso.h */
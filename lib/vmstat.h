@@ -0,0 +1,63 @@
+#ifndef __LIB_VMSTAT_H
+#define __LIB_VMSTAT_H
+
+#include <stdint.h>
+
+/* Memory statistics, shared by the kernel and user programs. */
+
+/* Memory events the kernel counts. */
+enum vmstat_event
+  {
+    VMSTAT_FAULT,               /* Page faults. */
+    VMSTAT_MINOR,               /* Faults served without I/O. */
+    VMSTAT_MAJOR,               /* Faults that read a file or swap. */
+    VMSTAT_ZERO_FILL,           /* Faults served by zeros. */
+    VMSTAT_COW,                 /* Copy-on-write pages copied. */
+    VMSTAT_STACK,               /* Faults that grew the stack. */
+    VMSTAT_FAULT_AROUND,        /* Pages mapped ahead of a fault. */
+    VMSTAT_EVICT_CLEAN,         /* Frames evicted without writing. */
+    VMSTAT_EVICT_DIRTY,         /* Frames written out to evict them. */
+    VMSTAT_SWAP_IN,             /* Pages read from the swap device. */
+    VMSTAT_SWAP_OUT,            /* Pages written to the swap device. */
+    VMSTAT_DROP_BEHIND,         /* Pages dropped behind a sequential scan. */
+    VMSTAT_ZSWAP_IN,            /* Pages decompressed from swap. */
+    VMSTAT_ZSWAP_OUT,           /* Pages compressed into swap. */
+    VMSTAT_PREZEROED,           /* PAL_ZERO pages zeroed ahead of time. */
+    VMSTAT_ZEROED,              /* PAL_ZERO requests zeroed on demand. */
+    VMSTAT_MERGED,              /* Identical pages merged into one frame. */
+    VMSTAT_LARGE,               /* 4 MB pages mapped for faults. */
+    VMSTAT_EVENT_CNT
+  };
+
+/* Names of the events, in order, as an initializer. */
+#define VMSTAT_EVENT_NAMES                                      \
+        {"faults", "minor", "major", "zero-fill", "cow",        \
+         "stack", "fault-around", "evict-clean", "evict-dirty", \
+         "swap-in", "swap-out", "drop-behind", "zswap-in",     \
+         "zswap-out", "prezeroed", "zeroed", "merged", "large"}
+
+/* Most malloc() size classes. */
+#define VMSTAT_CLASSES 10
+
+/* Usage of one malloc() size class. */
+struct vmstat_class
+  {
+    uint32_t block_size;        /* Size of each block in bytes. */
+    uint32_t arenas;            /* Pages holding blocks. */
+    uint32_t used;              /* Blocks allocated. */
+    uint32_t free;              /* Blocks free. */
+  };
+
+/* A snapshot of the statistics. */
+struct vmstat
+  {
+    uint64_t events[VMSTAT_EVENT_CNT]; /* Counts of each event. */
+    uint32_t kernel_pages;      /* Pages in the kernel pool. */
+    uint32_t kernel_free;       /* Free pages in the kernel pool. */
+    uint32_t user_pages;        /* Pages in the user pool. */
+    uint32_t user_free;         /* Free pages in the user pool. */
+    uint32_t class_cnt;         /* Number of CLASSES in use. */
+    struct vmstat_class classes[VMSTAT_CLASSES];
+  };
+
+#endif /* lib/vmstat.h */
@@ -0,0 +1,93 @@
+/* Kernel-mode microbenchmarks, run with the `bench' action.
+
+   Each benchmark times one or more metrics and reports each of
+   them on a line of its own, in a format meant for scripts that
+   track results across builds:
+
+      BENCH name=NAME metric=METRIC ops=N cycles=C ticks=T cycles/op=X
+
+   where C is the number of TSC cycles and T the number of timer
+   ticks that N operations took. */
+
+#include "tests/bench/bench.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/cycle.h"
+
+struct bench
+  {
+    const char *name;
+    bench_func *function;
+  };
+
+static const struct bench benches[] =
+  {
+    {"ctxsw", bench_ctxsw},
+    {"lock", bench_lock},
+    {"sema", bench_sema},
+    {"malloc", bench_malloc},
+    {"palloc", bench_palloc},
+    {"list", bench_list},
+    {"runq", bench_runq},
+    {"hash", bench_hash},
+    {"rbtree", bench_rbtree},
+    {"bitmap", bench_bitmap},
+    {"trap", bench_trap},
+    {"threads", bench_threads},
+    {"sched", bench_sched},
+  };
+
+static const char *bench_name;
+
+/* Runs the benchmark named NAME, or all of them if NAME is
+   "all". */
+void
+run_bench (const char *name)
+{
+  const struct bench *b;
+  bool found = false;
+
+  for (b = benches; b < benches + sizeof benches / sizeof *benches; b++)
+    if (!strcmp (name, "all") || !strcmp (name, b->name))
+      {
+        bench_name = b->name;
+        b->function ();
+        found = true;
+      }
+  if (!found)
+    PANIC ("no benchmark named \"%s\"", name);
+}
+
+/* Starts timing with T. */
+void
+bench_start (struct bench_timer *t)
+{
+  t->start_ticks = timer_ticks ();
+  t->start = rdtsc ();
+}
+
+/* Stops timing with T and reports that the time since
+   bench_start() was spent on OPS operations measured as
+   METRIC. */
+void
+bench_stop (struct bench_timer *t, const char *metric, uint64_t ops)
+{
+  uint64_t cycles = rdtsc () - t->start;
+
+  bench_report (metric, ops, cycles, timer_elapsed (t->start_ticks));
+}
+
+/* Reports that OPS operations measured as METRIC took CYCLES
+   cycles over TICKS timer ticks, for a metric not timed from
+   start to end with a bench_timer. */
+void
+bench_report (const char *metric, uint64_t ops, uint64_t cycles,
+              int64_t ticks)
+{
+  printf ("BENCH name=%s metric=%s ops=%llu cycles=%llu ticks=%lld "
+          "cycles/op=%llu\n", bench_name, metric, ops, cycles, ticks,
+          ops > 0 ? cycles / ops : 0);
+}
@@ -0,0 +1,36 @@
+#ifndef TESTS_BENCH_BENCH_H
+#define TESTS_BENCH_BENCH_H
+
+#include <stdint.h>
+
+void run_bench (const char *);
+
+typedef void bench_func (void);
+
+extern bench_func bench_ctxsw;
+extern bench_func bench_lock;
+extern bench_func bench_sema;
+extern bench_func bench_malloc;
+extern bench_func bench_palloc;
+extern bench_func bench_list;
+extern bench_func bench_runq;
+extern bench_func bench_hash;
+extern bench_func bench_rbtree;
+extern bench_func bench_bitmap;
+extern bench_func bench_trap;
+extern bench_func bench_threads;
+extern bench_func bench_sched;
+
+/* A timed stretch of a benchmark. */
+struct bench_timer
+  {
+    uint64_t start;             /* TSC at bench_start(). */
+    int64_t start_ticks;        /* Timer ticks at bench_start(). */
+  };
+
+void bench_start (struct bench_timer *);
+void bench_stop (struct bench_timer *, const char *metric, uint64_t ops);
+void bench_report (const char *metric, uint64_t ops, uint64_t cycles,
+                   int64_t ticks);
+
+#endif /* tests/bench/bench.h */
@@ -0,0 +1,40 @@
+/* Times bitmap_scan() for single bits and for runs of bits in a
+   bitmap that is nearly full, the hard case for allocators that
+   use one. */
+
+#include "tests/bench/bench.h"
+#include <bitmap.h>
+#include <debug.h>
+
+#define BIT_CNT 8192            /* Bits in the bitmap. */
+#define SCANS 256               /* Scans timed per metric. */
+
+void
+bench_bitmap (void)
+{
+  struct bench_timer t;
+  struct bitmap *b;
+  int i;
+
+  b = bitmap_create (BIT_CNT);
+  if (b == NULL)
+    PANIC ("bitmap_create failed");
+
+  /* Leave only the last 8 bits free. */
+  bitmap_set_all (b, true);
+  bitmap_set_multiple (b, BIT_CNT - 8, 8, false);
+
+  bench_start (&t);
+  for (i = 0; i < SCANS; i++)
+    if (bitmap_scan (b, 0, 1, false) != BIT_CNT - 8)
+      PANIC ("bitmap_scan found the wrong bit");
+  bench_stop (&t, "scan-1", SCANS);
+
+  bench_start (&t);
+  for (i = 0; i < SCANS; i++)
+    if (bitmap_scan (b, 0, 8, false) != BIT_CNT - 8)
+      PANIC ("bitmap_scan found the wrong run");
+  bench_stop (&t, "scan-8", SCANS);
+
+  bitmap_destroy (b);
+}
@@ -0,0 +1,39 @@
+/* Two threads of equal priority yield to each other, so that
+   every thread_yield() is a context switch. */
+
+#include "tests/bench/bench.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define SWITCHES 20000          /* Yields by each thread. */
+
+static thread_func yielder;
+
+void
+bench_ctxsw (void)
+{
+  struct bench_timer t;
+  struct semaphore done;
+  int i;
+
+  sema_init (&done, 0);
+  thread_create ("yielder", thread_get_priority (), yielder, &done);
+
+  bench_start (&t);
+  for (i = 0; i < SWITCHES; i++)
+    thread_yield ();
+  sema_down (&done);
+  bench_stop (&t, "switch", 2 * SWITCHES);
+}
+
+/* Yields SWITCHES times, then ups semaphore DONE_. */
+static void
+yielder (void *done_)
+{
+  struct semaphore *done = done_;
+  int i;
+
+  for (i = 0; i < SWITCHES; i++)
+    thread_yield ();
+  sema_up (done);
+}
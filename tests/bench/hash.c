@@ -0,0 +1,78 @@
+/* Times insertion, lookup, and deletion in a hash table keyed by
+   integers, as the page and sector tables are. */
+
+#include "tests/bench/bench.h"
+#include <debug.h>
+#include <hash.h>
+#include <random.h>
+#include <round.h>
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+#define ELEM_CNT 4096           /* Elements in the table. */
+#define LOOKUPS 65536           /* Lookups timed. */
+#define ITEM_PAGES DIV_ROUND_UP (ELEM_CNT * sizeof (struct item), PGSIZE)
+
+struct item
+  {
+    struct hash_elem elem;
+    int key;
+  };
+
+/* The items, allocated while the benchmark runs rather than
+   taking up room in the kernel image. */
+static struct item *items;
+
+/* Returns a hash of item E's key. */
+static unsigned
+item_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct item, elem)->key);
+}
+
+/* Returns true if item A's key is less than item B's. */
+static bool
+item_less (const struct hash_elem *a, const struct hash_elem *b,
+           void *aux UNUSED)
+{
+  return (hash_entry (a, struct item, elem)->key
+          < hash_entry (b, struct item, elem)->key);
+}
+
+void
+bench_hash (void)
+{
+  struct bench_timer t;
+  struct item probe;
+  struct hash h;
+  int i;
+
+  if (!hash_init (&h, item_hash, item_less, NULL))
+    PANIC ("hash_init failed");
+  items = palloc_get_multiple (PAL_ASSERT, ITEM_PAGES);
+
+  bench_start (&t);
+  for (i = 0; i < ELEM_CNT; i++)
+    {
+      items[i].key = i;
+      hash_insert (&h, &items[i].elem);
+    }
+  bench_stop (&t, "insert", ELEM_CNT);
+
+  bench_start (&t);
+  for (i = 0; i < LOOKUPS; i++)
+    {
+      probe.key = random_ulong () % ELEM_CNT;
+      if (hash_find (&h, &probe.elem) == NULL)
+        PANIC ("key %d missing", probe.key);
+    }
+  bench_stop (&t, "find", LOOKUPS);
+
+  bench_start (&t);
+  for (i = 0; i < ELEM_CNT; i++)
+    hash_delete (&h, &items[i].elem);
+  bench_stop (&t, "delete", ELEM_CNT);
+
+  hash_destroy (&h, NULL);
+  palloc_free_multiple (items, ITEM_PAGES);
+}
@@ -0,0 +1,72 @@
+/* Times queue operations on a list and sorting it, both when it
+   is shuffled and when it is already sorted. */
+
+#include "tests/bench/bench.h"
+#include <debug.h>
+#include <list.h>
+#include <random.h>
+
+#define ELEM_CNT 1024           /* Elements in the list. */
+#define ROUNDS 64               /* Passes over the elements. */
+
+struct value
+  {
+    struct list_elem elem;
+    int value;
+  };
+
+static struct value values[ELEM_CNT];
+
+/* Returns true if value A is less than value B. */
+static bool
+value_less (const struct list_elem *a_, const struct list_elem *b_,
+            void *aux UNUSED)
+{
+  const struct value *a = list_entry (a_, struct value, elem);
+  const struct value *b = list_entry (b_, struct value, elem);
+  return a->value < b->value;
+}
+
+void
+bench_list (void)
+{
+  struct bench_timer t;
+  struct list list;
+  int round, i;
+
+  list_init (&list);
+  bench_start (&t);
+  for (round = 0; round < ROUNDS; round++)
+    {
+      for (i = 0; i < ELEM_CNT; i++)
+        list_push_back (&list, &values[i].elem);
+      for (i = 0; i < ELEM_CNT; i++)
+        list_pop_front (&list);
+    }
+  bench_stop (&t, "push+pop", ROUNDS * ELEM_CNT);
+
+  bench_start (&t);
+  for (round = 0; round < ROUNDS; round++)
+    {
+      /* Filling the list is part of the time, but small next to
+         sorting it. */
+      for (i = 0; i < ELEM_CNT; i++)
+        {
+          values[i].value = random_ulong ();
+          list_push_back (&list, &values[i].elem);
+        }
+      list_sort (&list, value_less, NULL);
+      list_init (&list);
+    }
+  bench_stop (&t, "sort-random", ROUNDS);
+
+  for (i = 0; i < ELEM_CNT; i++)
+    {
+      values[i].value = i;
+      list_push_back (&list, &values[i].elem);
+    }
+  bench_start (&t);
+  for (round = 0; round < ROUNDS; round++)
+    list_sort (&list, value_less, NULL);
+  bench_stop (&t, "sort-sorted", ROUNDS);
+}
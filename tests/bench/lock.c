@@ -0,0 +1,60 @@
+/* Two threads of equal priority take turns holding a lock.  Each
+   yields while holding it, so the other blocks in lock_acquire()
+   and gets the lock handed over on release. */
+
+#include "tests/bench/bench.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define HANDOFFS 10000          /* Acquisitions by each thread. */
+
+struct handoff
+  {
+    struct lock lock;
+    struct semaphore done;
+  };
+
+static thread_func contender;
+static void take_turns (struct lock *);
+
+void
+bench_lock (void)
+{
+  struct bench_timer t;
+  struct handoff h;
+
+  lock_init (&h.lock);
+  sema_init (&h.done, 0);
+  thread_create ("contender", thread_get_priority (), contender, &h);
+
+  bench_start (&t);
+  take_turns (&h.lock);
+  sema_down (&h.done);
+  bench_stop (&t, "handoff", 2 * HANDOFFS);
+}
+
+/* Acquires LOCK HANDOFFS times, yielding while holding it and
+   again after releasing it. */
+static void
+take_turns (struct lock *lock)
+{
+  int i;
+
+  for (i = 0; i < HANDOFFS; i++)
+    {
+      lock_acquire (lock);
+      thread_yield ();
+      lock_release (lock);
+      thread_yield ();
+    }
+}
+
+/* Takes turns with the benchmark thread, then signals H_. */
+static void
+contender (void *h_)
+{
+  struct handoff *h = h_;
+
+  take_turns (&h->lock);
+  sema_up (&h->done);
+}
@@ -0,0 +1,47 @@
+/* Times malloc() and free() of blocks of a few sizes, keeping
+   LIVE blocks allocated at a time. */
+
+#include "tests/bench/bench.h"
+#include <debug.h>
+#include "threads/malloc.h"
+
+#define ROUNDS 500              /* Allocations of LIVE blocks. */
+#define LIVE 32                 /* Blocks allocated at once. */
+
+void
+bench_malloc (void)
+{
+  static const struct
+    {
+      size_t size;
+      const char *metric;
+    }
+  kinds[] =
+    {
+      {16, "malloc+free-16"},
+      {128, "malloc+free-128"},
+      {1024, "malloc+free-1024"},
+    };
+  static void *blocks[LIVE];
+  size_t i;
+
+  for (i = 0; i < sizeof kinds / sizeof *kinds; i++)
+    {
+      struct bench_timer t;
+      int round, j;
+
+      bench_start (&t);
+      for (round = 0; round < ROUNDS; round++)
+        for (j = 0; j < LIVE; j++)
+          {
+            if (round > 0)
+              free (blocks[j]);
+            blocks[j] = malloc (kinds[i].size);
+            if (blocks[j] == NULL)
+              PANIC ("malloc(%zu) failed", kinds[i].size);
+          }
+      for (j = 0; j < LIVE; j++)
+        free (blocks[j]);
+      bench_stop (&t, kinds[i].metric, ROUNDS * LIVE);
+    }
+}
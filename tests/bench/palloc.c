@@ -0,0 +1,31 @@
+/* Times palloc_get_page() and palloc_free_page(), one page at a
+   time and in runs of LIVE pages. */
+
+#include "tests/bench/bench.h"
+#include "threads/palloc.h"
+
+#define ROUNDS 200              /* Allocations of LIVE pages. */
+#define LIVE 16                 /* Pages allocated at once. */
+
+void
+bench_palloc (void)
+{
+  static void *pages[LIVE];
+  struct bench_timer t;
+  int round, j;
+
+  bench_start (&t);
+  for (round = 0; round < ROUNDS * LIVE; round++)
+    palloc_free_page (palloc_get_page (PAL_ASSERT));
+  bench_stop (&t, "get+free", ROUNDS * LIVE);
+
+  bench_start (&t);
+  for (round = 0; round < ROUNDS; round++)
+    {
+      for (j = 0; j < LIVE; j++)
+        pages[j] = palloc_get_page (PAL_ASSERT);
+      for (j = 0; j < LIVE; j++)
+        palloc_free_page (pages[j]);
+    }
+  bench_stop (&t, "get+free-batch", ROUNDS * LIVE);
+}
@@ -0,0 +1,123 @@
+/* Times a red-black tree against a sorted list, as the ordered
+   queues in the kernel could use either: ordered insertion,
+   searching for the first element not less than a key, and
+   taking elements from the front. */
+
+#include "tests/bench/bench.h"
+#include <debug.h>
+#include <list.h>
+#include <random.h>
+#include <rbtree.h>
+#include <round.h>
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+#define ELEM_CNT 1024           /* Elements in the list or tree. */
+#define LOOKUPS 4096            /* Searches timed. */
+#define ITEM_PAGES DIV_ROUND_UP (ELEM_CNT * sizeof (struct item), PGSIZE)
+
+struct item
+  {
+    struct list_elem list_elem;
+    struct rb_node rb_node;
+    int key;
+  };
+
+/* The items, allocated while the benchmark runs rather than
+   taking up room in the kernel image. */
+static struct item *items;
+
+/* Returns true if item A's key is less than item B's, for the
+   list. */
+static bool
+list_item_less (const struct list_elem *a, const struct list_elem *b,
+                void *aux UNUSED)
+{
+  return (list_entry (a, struct item, list_elem)->key
+          < list_entry (b, struct item, list_elem)->key);
+}
+
+/* Returns true if item A's key is less than item B's, for the
+   tree. */
+static bool
+rb_item_less (const struct rb_node *a, const struct rb_node *b,
+              void *aux UNUSED)
+{
+  return (rb_entry (a, struct item, rb_node)->key
+          < rb_entry (b, struct item, rb_node)->key);
+}
+
+/* Gives each item a random key. */
+static void
+shuffle_keys (void)
+{
+  int i;
+
+  for (i = 0; i < ELEM_CNT; i++)
+    items[i].key = random_ulong () % (ELEM_CNT * 4);
+}
+
+void
+bench_rbtree (void)
+{
+  struct bench_timer t;
+  struct list list;
+  struct rb_tree tree;
+  struct item probe;
+  unsigned found = 0;
+  int i;
+
+  items = palloc_get_multiple (PAL_ASSERT, ITEM_PAGES);
+
+  /* Sorted list. */
+  shuffle_keys ();
+  list_init (&list);
+  bench_start (&t);
+  for (i = 0; i < ELEM_CNT; i++)
+    list_insert_ordered (&list, &items[i].list_elem, list_item_less, NULL);
+  bench_stop (&t, "list-insert", ELEM_CNT);
+
+  bench_start (&t);
+  for (i = 0; i < LOOKUPS; i++)
+    {
+      struct list_elem *e;
+
+      probe.key = random_ulong () % (ELEM_CNT * 4);
+      for (e = list_begin (&list); e != list_end (&list); e = list_next (e))
+        if (!list_item_less (e, &probe.list_elem, NULL))
+          break;
+      found += e != list_end (&list);
+    }
+  bench_stop (&t, "list-lower-bound", LOOKUPS);
+
+  bench_start (&t);
+  while (!list_empty (&list))
+    list_pop_front (&list);
+  bench_stop (&t, "list-pop-first", ELEM_CNT);
+
+  /* Tree, with the same kind of keys. */
+  shuffle_keys ();
+  rb_init (&tree, rb_item_less, NULL);
+  bench_start (&t);
+  for (i = 0; i < ELEM_CNT; i++)
+    rb_insert (&tree, &items[i].rb_node);
+  bench_stop (&t, "rb-insert", ELEM_CNT);
+
+  bench_start (&t);
+  for (i = 0; i < LOOKUPS; i++)
+    {
+      probe.key = random_ulong () % (ELEM_CNT * 4);
+      found += rb_lower_bound (&tree, &probe.rb_node) != NULL;
+    }
+  bench_stop (&t, "rb-lower-bound", LOOKUPS);
+
+  bench_start (&t);
+  while (!rb_empty (&tree))
+    rb_remove (&tree, rb_first (&tree));
+  bench_stop (&t, "rb-pop-first", ELEM_CNT);
+  palloc_free_multiple (items, ITEM_PAGES);
+
+  /* Keep the searches from being optimized away. */
+  if (found > 2 * LOOKUPS)
+    PANIC ("found %u of %d", found, 2 * LOOKUPS);
+}
@@ -0,0 +1,70 @@
+/* Times the walks that the scheduler and the wait queues make
+   over threads: finding the highest-priority thread on a list,
+   inserting threads into a list in priority order, and pushing
+   and popping threads on a waitq.  The threads are real struct
+   threads, each in a page of its own as thread_create() would
+   put them, so that a walk touches one cache line per thread if
+   the fields it reads share one. */
+
+#include "tests/bench/bench.h"
+#include <debug.h>
+#include <list.h>
+#include <random.h>
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define THREAD_CNT 128          /* Threads, one page each. */
+#define ROUNDS 64               /* Passes over the threads. */
+
+static struct thread *threads[THREAD_CNT];
+
+void
+bench_runq (void)
+{
+  struct bench_timer t;
+  struct list list;
+  struct waitq q;
+  bool desc = false;
+  int round, i;
+
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      threads[i] = palloc_get_page (PAL_ZERO);
+      if (threads[i] == NULL)
+        PANIC ("bench_runq: out of pages");
+      threads[i]->priority = random_ulong () % (PRI_MAX + 1);
+    }
+
+  list_init (&list);
+  for (i = 0; i < THREAD_CNT; i++)
+    list_push_back (&list, &threads[i]->elem);
+  bench_start (&t);
+  for (round = 0; round < ROUNDS; round++)
+    list_max (&list, thread_cmp_priority, &desc);
+  bench_stop (&t, "max-walk", ROUNDS * THREAD_CNT);
+
+  bench_start (&t);
+  for (round = 0; round < ROUNDS; round++)
+    {
+      list_init (&list);
+      for (i = 0; i < THREAD_CNT; i++)
+        list_insert_ordered (&list, &threads[i]->elem,
+                             thread_cmp_priority, &desc);
+    }
+  bench_stop (&t, "insert-ordered", ROUNDS * THREAD_CNT);
+
+  waitq_init (&q);
+  bench_start (&t);
+  for (round = 0; round < ROUNDS; round++)
+    {
+      for (i = 0; i < THREAD_CNT; i++)
+        waitq_push (&q, &threads[i]->waitelem, threads[i]->priority);
+      while (!waitq_empty (&q))
+        waitq_pop (&q);
+    }
+  bench_stop (&t, "waitq-push+pop", ROUNDS * THREAD_CNT);
+
+  for (i = 0; i < THREAD_CNT; i++)
+    palloc_free_page (threads[i]);
+}
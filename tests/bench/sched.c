@@ -0,0 +1,214 @@
+/* Measures how the scheduler shares the CPU among a mix of
+   threads for a fixed interval: CPU-bound threads at nice 0,
+   CPU-bound threads at a higher nice, and I/O-bound threads that
+   sleep for a tick and then do a short burst of work.  Every
+   thread counts the loop iterations it gets through.  Reports
+   the aggregate throughput, the share of it each class got,
+   Jain's fairness index over the nice 0 threads, and the
+   percentiles of the time from an I/O thread's wake-up deadline
+   to it running again.
+
+   Run it under each scheduler, e.g. "-sched=mlfqs bench sched",
+   to compare them by the numbers.  Outside the MLFQS, which has
+   no niceness of its own, the niced threads lower their priority
+   by their niceness instead. */
+
+#include "tests/bench/bench.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define CPU_THREADS 4           /* CPU-bound threads at nice 0. */
+#define NICE_THREADS 2          /* CPU-bound threads at NICE. */
+#define IO_THREADS 4            /* Sleeping threads. */
+#define NICE 10                 /* Niceness of the niced threads. */
+#define RUN_TICKS (5 * TIMER_FREQ) /* Length of the run. */
+#define IO_BURST 1000           /* Iterations per I/O thread wake-up. */
+#define LAT_MAX (IO_THREADS * RUN_TICKS) /* Latency samples kept. */
+#define NS_PER_TICK (1000 * 1000 * 1000 / TIMER_FREQ)
+
+enum sched_class
+  {
+    CLASS_CPU,                  /* CPU-bound at nice 0. */
+    CLASS_NICE,                 /* CPU-bound at NICE. */
+    CLASS_IO,                   /* I/O-bound. */
+    CLASS_CNT
+  };
+
+static const char *class_names[CLASS_CNT] = {"cpu", "nice", "io"};
+
+#define THREAD_CNT (CPU_THREADS + NICE_THREADS + IO_THREADS)
+
+/* One benchmark thread. */
+struct worker
+  {
+    enum sched_class class;
+    uint64_t iterations;        /* Loop iterations it got through. */
+  };
+
+/* Shared by the benchmark and its threads. */
+static struct worker workers[THREAD_CNT];
+static struct semaphore go, done;
+static volatile bool stop;
+static uint32_t *latencies;     /* Wake-up latencies, in ns. */
+static int lat_cnt;
+
+static thread_func worker_thread;
+static int compare_u32 (const void *, const void *);
+
+void
+bench_sched (void)
+{
+  uint64_t total = 0, class_total[CLASS_CNT] = {0, 0, 0};
+  uint64_t max = 0, sum = 0, sum_sq = 0;
+  struct bench_timer t;
+  int shift;
+  int i;
+
+  latencies = malloc (LAT_MAX * sizeof *latencies);
+  if (latencies == NULL)
+    PANIC ("bench sched: out of memory");
+  lat_cnt = 0;
+  stop = false;
+  sema_init (&go, 0);
+  sema_init (&done, 0);
+
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      struct worker *w = &workers[i];
+
+      w->class = (i < CPU_THREADS ? CLASS_CPU
+                  : i < CPU_THREADS + NICE_THREADS ? CLASS_NICE
+                  : CLASS_IO);
+      w->iterations = 0;
+      if (thread_create (class_names[w->class], thread_get_priority (),
+                         worker_thread, w) == TID_ERROR)
+        PANIC ("bench sched: thread_create failed");
+    }
+
+  /* Let them all run for RUN_TICKS. */
+  bench_start (&t);
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_up (&go);
+  timer_sleep (RUN_TICKS);
+  stop = true;
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&done);
+
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      uint64_t n = workers[i].iterations;
+
+      total += n;
+      class_total[workers[i].class] += n;
+      if (workers[i].class == CLASS_CPU && n > max)
+        max = n;
+    }
+  bench_stop (&t, "iterations", total);
+
+  /* Iteration counts run into the billions, so scale them down
+     far enough that squaring them cannot overflow. */
+  for (shift = 0; max >> shift >= 1 << 24; shift++)
+    continue;
+  for (i = 0; i < THREAD_CNT; i++)
+    if (workers[i].class == CLASS_CPU)
+      {
+        uint64_t n = workers[i].iterations >> shift;
+
+        sum += n;
+        sum_sq += n * n;
+      }
+
+  /* Share of the iterations each class got, in tenths of a
+     percent, and Jain's index (sum x)^2 / (n * sum x^2) over the
+     nice 0 threads, in thousandths: 1000 when they got the same
+     and 1000 / n when one of them got all of it. */
+  printf ("bench sched: scheduler %s, %d ticks\n",
+          thread_sched_name (), RUN_TICKS);
+  for (i = 0; i < CLASS_CNT; i++)
+    {
+      unsigned share = total ? class_total[i] * 1000 / total : 0;
+
+      printf ("bench sched: %s share %u.%u%%\n",
+              class_names[i], share / 10, share % 10);
+    }
+  if (sum_sq != 0)
+    {
+      unsigned jain = sum * sum * 1000 / (CPU_THREADS * sum_sq);
+
+      printf ("bench sched: jain %u.%03u over %d cpu threads\n",
+              jain / 1000, jain % 1000, CPU_THREADS);
+    }
+
+  if (lat_cnt > 0)
+    {
+      qsort (latencies, lat_cnt, sizeof *latencies, compare_u32);
+      printf ("bench sched: wake latency p50 %"PRIu32" ns, "
+              "p90 %"PRIu32" ns, p99 %"PRIu32" ns, max %"PRIu32" ns "
+              "over %d wake-ups\n",
+              latencies[lat_cnt / 2], latencies[lat_cnt * 9 / 10],
+              latencies[lat_cnt * 99 / 100], latencies[lat_cnt - 1],
+              lat_cnt);
+    }
+  free (latencies);
+
+  /* Let the threads exit. */
+  timer_sleep (2);
+}
+
+/* Runs the worker W_ until the benchmark says to stop. */
+static void
+worker_thread (void *w_)
+{
+  struct worker *w = w_;
+  uint64_t n = 0;
+
+  if (w->class == CLASS_NICE)
+    {
+      if (thread_mlfqs)
+        thread_set_nice (NICE);
+      else
+        thread_set_priority (thread_get_priority () - NICE);
+    }
+
+  sema_down (&go);
+  if (w->class != CLASS_IO)
+    while (!stop)
+      n++;
+  else
+    while (!stop)
+      {
+        int64_t deadline = timer_ticks () + 1;
+        uint64_t now, due = (uint64_t) deadline * NS_PER_TICK;
+        enum intr_level old_level;
+        int i;
+
+        timer_sleep (1);
+        now = timer_ns ();
+        old_level = intr_disable ();
+        if (lat_cnt < LAT_MAX)
+          latencies[lat_cnt++] = now > due ? now - due : 0;
+        intr_set_level (old_level);
+        for (i = 0; i < IO_BURST; i++)
+          barrier ();
+        n += IO_BURST;
+      }
+  w->iterations = n;
+  sema_up (&done);
+}
+
+/* Compares the uint32_t values A and B for qsort(). */
+static int
+compare_u32 (const void *a_, const void *b_)
+{
+  const uint32_t *a = a_;
+  const uint32_t *b = b_;
+
+  return *a < *b ? -1 : *a > *b;
+}
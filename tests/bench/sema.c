@@ -0,0 +1,51 @@
+/* Two threads bounce control back and forth through a pair of
+   semaphores, so each round trip is two sema_up()/sema_down()
+   pairs and two context switches. */
+
+#include "tests/bench/bench.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define ROUND_TRIPS 10000
+
+struct ping_pong
+  {
+    struct semaphore ping;
+    struct semaphore pong;
+  };
+
+static thread_func ponger;
+
+void
+bench_sema (void)
+{
+  struct bench_timer t;
+  struct ping_pong p;
+  int i;
+
+  sema_init (&p.ping, 0);
+  sema_init (&p.pong, 0);
+  thread_create ("ponger", thread_get_priority (), ponger, &p);
+
+  bench_start (&t);
+  for (i = 0; i < ROUND_TRIPS; i++)
+    {
+      sema_up (&p.ping);
+      sema_down (&p.pong);
+    }
+  bench_stop (&t, "round-trip", ROUND_TRIPS);
+}
+
+/* Answers each ping of P_ with a pong. */
+static void
+ponger (void *p_)
+{
+  struct ping_pong *p = p_;
+  int i;
+
+  for (i = 0; i < ROUND_TRIPS; i++)
+    {
+      sema_down (&p->ping);
+      sema_up (&p->pong);
+    }
+}
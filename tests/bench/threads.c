@@ -0,0 +1,158 @@
+/* Times how the thread system scales with the number of threads,
+   for 1, 10, 100, 1000, and 4000 of them, or as many as the
+   kernel pool has pages for.  For each count, times creating the
+   threads, a round of yields among them, so that each yield is a
+   context switch with that many threads ready, a walk over all of
+   them with thread_foreach(), and a mix of yielding, sleeping for
+   a tick, and handing a contended lock around, during which it
+   also reports the time the timer interrupt handler took per
+   tick.  Prints the kernel pages each thread took, too. */
+
+#include "tests/bench/bench.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define SPARE_PAGES 64          /* Kernel pages left for the rest. */
+#define YIELDS 16000            /* Yields in all per thread count. */
+#define MIX_ROUNDS 8            /* Rounds of the mix per thread. */
+#define TIMER_VEC 0x20          /* Vector of the timer interrupt. */
+
+static const int counts[] = {1, 10, 100, 1000, 4000};
+
+/* Shared by the benchmark and its threads. */
+static struct semaphore go_yield, go_mix, done;
+static struct lock mix_lock;
+static int yields_each;
+
+static thread_func worker;
+static thread_action_func count_thread;
+static void run_count (int cnt);
+
+void
+bench_threads (void)
+{
+  size_t i;
+
+  lock_init (&mix_lock);
+  for (i = 0; i < sizeof counts / sizeof *counts; i++)
+    {
+      size_t free_cnt = palloc_free_cnt (0);
+      int cnt = counts[i];
+
+      if ((size_t) cnt + SPARE_PAGES > free_cnt)
+        {
+          if (free_cnt <= SPARE_PAGES)
+            break;
+          printf ("bench threads: only %zu threads fit, not %d\n",
+                  free_cnt - SPARE_PAGES, cnt);
+          cnt = free_cnt - SPARE_PAGES;
+        }
+      run_count (cnt);
+      if (cnt < counts[i])
+        break;
+    }
+}
+
+/* Times CNT threads through the phases described at the top. */
+static void
+run_count (int cnt)
+{
+  struct bench_timer t;
+  uint64_t start_cnt, start_cycles, end_cnt, end_cycles;
+  size_t free_before = palloc_free_cnt (0);
+  int64_t start_ticks;
+  char metric[32];
+  int created, walked;
+  int i;
+
+  sema_init (&go_yield, 0);
+  sema_init (&go_mix, 0);
+  sema_init (&done, 0);
+  yields_each = DIV_ROUND_UP (YIELDS, cnt);
+
+  bench_start (&t);
+  for (created = 0; created < cnt; created++)
+    if (thread_create ("bench", thread_get_priority (), worker, NULL)
+        == TID_ERROR)
+      break;
+  snprintf (metric, sizeof metric, "create-%d", cnt);
+  bench_stop (&t, metric, created);
+  printf ("bench threads: %d threads took %zu kernel pages\n",
+          created, free_before - palloc_free_cnt (0));
+
+  walked = 0;
+  bench_start (&t);
+  thread_foreach (count_thread, &walked);
+  snprintf (metric, sizeof metric, "foreach-%d", cnt);
+  bench_stop (&t, metric, walked);
+
+  bench_start (&t);
+  for (i = 0; i < created; i++)
+    sema_up (&go_yield);
+  for (i = 0; i < created; i++)
+    sema_down (&done);
+  snprintf (metric, sizeof metric, "switch-%d", cnt);
+  bench_stop (&t, metric, (uint64_t) created * yields_each);
+
+  intr_vec_stats (TIMER_VEC, &start_cnt, &start_cycles);
+  start_ticks = timer_ticks ();
+  bench_start (&t);
+  for (i = 0; i < created; i++)
+    sema_up (&go_mix);
+  for (i = 0; i < created; i++)
+    sema_down (&done);
+  snprintf (metric, sizeof metric, "mix-%d", cnt);
+  bench_stop (&t, metric, (uint64_t) created * MIX_ROUNDS);
+  intr_vec_stats (TIMER_VEC, &end_cnt, &end_cycles);
+  snprintf (metric, sizeof metric, "tick-%d", cnt);
+  bench_report (metric, end_cnt - start_cnt, end_cycles - start_cycles,
+                timer_elapsed (start_ticks));
+
+  /* Let the threads exit and their pages come free. */
+  timer_sleep (2);
+}
+
+/* Yields, then runs the mix, each when the benchmark says to. */
+static void
+worker (void *aux UNUSED)
+{
+  int i;
+
+  sema_down (&go_yield);
+  for (i = 0; i < yields_each; i++)
+    thread_yield ();
+  sema_up (&done);
+
+  sema_down (&go_mix);
+  for (i = 0; i < MIX_ROUNDS; i++)
+    switch (i % 4)
+      {
+      case 0:
+        thread_yield ();
+        break;
+      case 1:
+        timer_sleep (1);
+        break;
+      default:
+        lock_acquire (&mix_lock);
+        thread_yield ();
+        lock_release (&mix_lock);
+        break;
+      }
+  sema_up (&done);
+}
+
+/* Counts thread T in *CNT_. */
+static void
+count_thread (struct thread *t UNUSED, void *cnt_)
+{
+  int *cnt = cnt_;
+
+  (*cnt)++;
+}
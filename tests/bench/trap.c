@@ -0,0 +1,39 @@
+/* Round trips through the interrupt entry and exit paths: a
+   software interrupt raised from kernel code, to a handler that
+   does nothing, which is what a timer interrupt of a busy kernel
+   or the idle thread costs before the timer's own work. */
+
+#include "tests/bench/bench.h"
+#include <debug.h>
+#include <stdbool.h>
+#include "threads/interrupt.h"
+
+#define TRAPS 100000            /* Interrupts raised. */
+#define TRAP_VEC 0x40           /* Vector otherwise unused. */
+
+static intr_handler_func trap_handler;
+
+void
+bench_trap (void)
+{
+  static bool registered;
+  struct bench_timer t;
+  int i;
+
+  if (!registered)
+    {
+      intr_register_int (TRAP_VEC, 0, INTR_OFF, trap_handler, "bench trap");
+      registered = true;
+    }
+
+  bench_start (&t);
+  for (i = 0; i < TRAPS; i++)
+    asm volatile ("int %0" : : "i" (TRAP_VEC) : "memory");
+  bench_stop (&t, "trap", TRAPS);
+}
+
+/* Does nothing. */
+static void
+trap_handler (struct intr_frame *f UNUSED)
+{
+}
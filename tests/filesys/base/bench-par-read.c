@@ -0,0 +1,84 @@
+/* Times CHILD_CNT processes reading files in parallel, first
+   each its own file and then all of them the same file, and
+   reports the cycles per read() call of each.  With a global
+   file system lock both take about as long as CHILD_CNT
+   processes reading one after another; with per-inode locking
+   neither should. */
+
+#include <random.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/filesys/base/bench-par-read.h"
+
+static char buf[FILE_SIZE];
+
+/* Returns the time stamp counter. */
+static uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Creates file NAME holding BUF. */
+static void
+make_file (const char *name)
+{
+  int fd;
+
+  CHECK (create (name, 0), "create \"%s\"", name);
+  CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write \"%s\"", name);
+  close (fd);
+}
+
+/* Runs CHILD_CNT children, child I reading the file named
+   "file I" if SHARED is false or the shared file if it is true,
+   waits for all of them, and returns the cycles elapsed. */
+static uint64_t
+run (bool shared)
+{
+  pid_t children[CHILD_CNT];
+  uint64_t start = rdtsc ();
+  size_t i;
+
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      char cmd_line[128];
+
+      if (shared)
+        snprintf (cmd_line, sizeof cmd_line, "child-par-read %zu %s",
+                  i, shared_name);
+      else
+        snprintf (cmd_line, sizeof cmd_line, "child-par-read %zu file%zu",
+                  i, i);
+      CHECK ((children[i] = exec (cmd_line)) != PID_ERROR,
+             "exec \"%s\"", cmd_line);
+    }
+  wait_children (children, CHILD_CNT);
+  return rdtsc () - start;
+}
+
+void
+test_main (void)
+{
+  const uint64_t reads = CHILD_CNT * PASSES * (FILE_SIZE / CHUNK_SIZE);
+  size_t i;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "file%zu", i);
+      make_file (name);
+    }
+  make_file (shared_name);
+
+  msg ("separate files: %llu cycles/read", run (false) / reads);
+  msg ("shared file: %llu cycles/read", run (true) / reads);
+}
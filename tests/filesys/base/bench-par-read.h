@@ -0,0 +1,11 @@
+#ifndef TESTS_FILESYS_BASE_BENCH_PAR_READ_H
+#define TESTS_FILESYS_BASE_BENCH_PAR_READ_H
+
+#define CHILD_CNT 4             /* Number of reading processes. */
+#define FILE_SIZE 8192          /* Size of each file, in bytes. */
+#define CHUNK_SIZE 512          /* Bytes per read() call. */
+#define PASSES 16               /* Times each child reads its file. */
+
+static const char shared_name[] = "shared";
+
+#endif /* tests/filesys/base/bench-par-read.h */
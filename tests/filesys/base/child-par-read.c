@@ -0,0 +1,43 @@
+/* Child process for bench-par-read test.
+   Reads the file named by its second argument PASSES times,
+   CHUNK_SIZE bytes at a time, checking its contents, and exits
+   with the index given as its first argument. */
+
+#include <random.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/filesys/base/bench-par-read.h"
+
+const char *test_name = "child-par-read";
+
+static char buf[FILE_SIZE];
+
+int
+main (int argc, const char *argv[])
+{
+  char chunk[CHUNK_SIZE];
+  int pass, fd;
+  size_t ofs;
+
+  quiet = true;
+
+  CHECK (argc == 3, "argc must be 3, actually %d", argc);
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  CHECK ((fd = open (argv[2])) > 1, "open \"%s\"", argv[2]);
+  for (pass = 0; pass < PASSES; pass++)
+    {
+      seek (fd, 0);
+      for (ofs = 0; ofs < sizeof buf; ofs += sizeof chunk)
+        {
+          CHECK (read (fd, chunk, sizeof chunk) == sizeof chunk,
+                 "read \"%s\"", argv[2]);
+          compare_bytes (chunk, buf + ofs, sizeof chunk, ofs, argv[2]);
+        }
+    }
+  close (fd);
+
+  return atoi (argv[1]);
+}
@@ -0,0 +1,39 @@
+/* Child process for syn-append test.
+   Appends records to a test file through a descriptor set to
+   O_APPEND with fcntl().  Other processes will be appending to
+   the same file at the same time. */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/filesys/base/syn-append.h"
+
+int
+main (int argc, char *argv[])
+{
+  char record[RECORD_SIZE];
+  int child_idx;
+  int fd, seq;
+
+  quiet = true;
+
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (fcntl (fd, F_SETFL, O_APPEND) == 0, "fcntl \"%s\"", file_name);
+  memset (record, 'a' + child_idx, sizeof record);
+  record[0] = child_idx;
+  for (seq = 0; seq < RECORD_CNT; seq++)
+    {
+      record[1] = seq;
+      if (write (fd, record, sizeof record) != sizeof record)
+        fail ("append record %d to \"%s\" failed", seq, file_name);
+    }
+  msg ("close \"%s\"", file_name);
+  close (fd);
+
+  return child_idx;
+}
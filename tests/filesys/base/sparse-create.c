@@ -0,0 +1,55 @@
+/* Creates a file larger than the whole file system, which only
+   works if its sectors are allocated when first written, writes
+   a block in the middle of it, and checks that the block reads
+   back and that the rest of the file reads as zeros. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (4 * 1024 * 1024)     /* Twice the file system. */
+#define BLOCK_OFS (FILE_SIZE / 2 + 100) /* Unaligned on purpose. */
+
+static char block[1024];
+static char buf[sizeof block];
+static char zeros[sizeof block];
+
+void
+test_main (void) 
+{
+  const char *file_name = "sparse";
+  int fd;
+
+  memset (block, 0x5a, sizeof block);
+  CHECK (create (file_name, FILE_SIZE), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  if (filesize (fd) != FILE_SIZE)
+    fail ("filesize is %d, not %d", filesize (fd), FILE_SIZE);
+
+  msg ("write \"%s\" at %d", file_name, BLOCK_OFS);
+  seek (fd, BLOCK_OFS);
+  if (write (fd, block, sizeof block) != sizeof block)
+    fail ("write failed");
+
+  msg ("verify \"%s\"", file_name);
+  seek (fd, BLOCK_OFS);
+  if (read (fd, buf, sizeof buf) != sizeof buf)
+    fail ("read of written block failed");
+  compare_bytes (buf, block, sizeof buf, BLOCK_OFS, file_name);
+  seek (fd, 0);
+  if (read (fd, buf, sizeof buf) != sizeof buf)
+    fail ("read of hole at start failed");
+  compare_bytes (buf, zeros, sizeof buf, 0, file_name);
+  seek (fd, BLOCK_OFS - sizeof buf);
+  if (read (fd, buf, sizeof buf) != sizeof buf)
+    fail ("read of hole before block failed");
+  compare_bytes (buf, zeros, sizeof buf, BLOCK_OFS - sizeof buf, file_name);
+  seek (fd, FILE_SIZE - sizeof buf);
+  if (read (fd, buf, sizeof buf) != sizeof buf)
+    fail ("read of hole at end failed");
+  compare_bytes (buf, zeros, sizeof buf, FILE_SIZE - sizeof buf, file_name);
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sparse-create) begin
+(sparse-create) create "sparse"
+(sparse-create) open "sparse"
+(sparse-create) write "sparse" at 2097252
+(sparse-create) verify "sparse"
+(sparse-create) close "sparse"
+(sparse-create) end
+EOF
+pass;
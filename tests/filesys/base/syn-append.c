@@ -0,0 +1,53 @@
+/* Spawns several child processes that each append records to
+   the same file through a descriptor set to O_APPEND, and waits
+   for them to finish.  Then reads back the file and verifies
+   that it holds every record exactly once, whole, and in the
+   order each child appended them. */
+
+#include <syscall.h>
+#include "tests/filesys/base/syn-append.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[BUF_SIZE];
+
+void
+test_main (void)
+{
+  pid_t children[CHILD_CNT];
+  int next_seq[CHILD_CNT];
+  int fd, size, i, j;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+
+  exec_children ("child-syn-app", children, CHILD_CNT);
+  wait_children (children, CHILD_CNT);
+
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  size = filesize (fd);
+  if (size != BUF_SIZE)
+    fail ("\"%s\" is %d bytes, not %d", file_name, size, BUF_SIZE);
+  CHECK (read (fd, buf, sizeof buf) == BUF_SIZE, "read \"%s\"", file_name);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+
+  for (i = 0; i < CHILD_CNT; i++)
+    next_seq[i] = 0;
+  for (i = 0; i < BUF_SIZE; i += RECORD_SIZE)
+    {
+      const char *record = buf + i;
+      int child = record[0];
+
+      if (child < 0 || child >= CHILD_CNT)
+        fail ("record at offset %d has bad child %d", i, child);
+      if (record[1] != next_seq[child])
+        fail ("record at offset %d is child %d's record %d, not %d",
+              i, child, record[1], next_seq[child]);
+      for (j = 2; j < RECORD_SIZE; j++)
+        if (record[j] != 'a' + child)
+          fail ("record at offset %d overlaps another at offset %d",
+                i, i + j);
+      next_seq[child]++;
+    }
+  msg ("verified %d records", BUF_SIZE / RECORD_SIZE);
+}
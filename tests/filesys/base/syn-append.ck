@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(syn-append) begin
+(syn-append) create "log"
+(syn-append) exec child 1 of 4: "child-syn-app 0"
+(syn-append) exec child 2 of 4: "child-syn-app 1"
+(syn-append) exec child 3 of 4: "child-syn-app 2"
+(syn-append) exec child 4 of 4: "child-syn-app 3"
+(syn-append) wait for child 1 of 4 returned 0 (expected 0)
+(syn-append) wait for child 2 of 4 returned 1 (expected 1)
+(syn-append) wait for child 3 of 4 returned 2 (expected 2)
+(syn-append) wait for child 4 of 4 returned 3 (expected 3)
+(syn-append) open "log"
+(syn-append) read "log"
+(syn-append) close "log"
+(syn-append) verified 100 records
+(syn-append) end
+EOF
+pass;
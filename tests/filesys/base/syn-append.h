@@ -0,0 +1,12 @@
+#ifndef TESTS_FILESYS_BASE_SYN_APPEND_H
+#define TESTS_FILESYS_BASE_SYN_APPEND_H
+
+/* Record SEQ of child CHILD is RECORD_SIZE bytes: CHILD, SEQ,
+   and then 'a' + CHILD in all the rest. */
+#define CHILD_CNT 4
+#define RECORD_CNT 25           /* Records each child appends. */
+#define RECORD_SIZE 100         /* Bytes per record. */
+#define BUF_SIZE (CHILD_CNT * RECORD_CNT * RECORD_SIZE)
+static const char file_name[] = "log";
+
+#endif /* tests/filesys/base/syn-append.h */
@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"src" => ["a" x 3000 . "c" x 512 . "a" x 2488],
+		"dst" => ["a" x 1000 . "b" x 512 . "a" x 4488]});
+pass;
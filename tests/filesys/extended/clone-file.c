@@ -0,0 +1,62 @@
+/* Clones a file with clone_file(), then writes to the clone and
+   to the original in turn.  Each write must show up in the file
+   written and leave the other one as it was. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 6000
+
+static char src_buf[FILE_SIZE];
+static char dst_buf[FILE_SIZE];
+
+/* Writes SIZE copies of C at offset OFS of the file named NAME. */
+static void
+fill_at (const char *name, unsigned ofs, char c, size_t size)
+{
+  char block[512];
+  int fd;
+
+  ASSERT (size <= sizeof block);
+  memset (block, c, size);
+  CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+  seek (fd, ofs);
+  if (write (fd, block, size) != (int) size)
+    fail ("write %zu bytes at offset %u in \"%s\" failed", size, ofs, name);
+  msg ("close \"%s\"", name);
+  close (fd);
+}
+
+void
+test_main (void)
+{
+  int fd;
+
+  memset (src_buf, 'a', sizeof src_buf);
+  CHECK (create ("src", 0), "create \"src\"");
+  CHECK ((fd = open ("src")) > 1, "open \"src\"");
+  if (write (fd, src_buf, sizeof src_buf) != sizeof src_buf)
+    fail ("write \"src\" failed");
+  msg ("close \"src\"");
+  close (fd);
+
+  CHECK (clone_file ("src", "dst"), "clone_file \"src\" to \"dst\"");
+  check_file ("dst", src_buf, sizeof src_buf);
+
+  /* A write to the clone leaves the original alone. */
+  fill_at ("dst", 1000, 'b', 512);
+  memcpy (dst_buf, src_buf, sizeof dst_buf);
+  memset (dst_buf + 1000, 'b', 512);
+  check_file ("src", src_buf, sizeof src_buf);
+  check_file ("dst", dst_buf, sizeof dst_buf);
+
+  /* And a write to the original leaves the clone alone. */
+  fill_at ("src", 3000, 'c', 512);
+  memset (src_buf + 3000, 'c', 512);
+  check_file ("src", src_buf, sizeof src_buf);
+  check_file ("dst", dst_buf, sizeof dst_buf);
+
+  CHECK (!clone_file ("src", "dst"), "clone_file \"src\" over \"dst\"");
+}
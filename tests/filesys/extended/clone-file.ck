@@ -0,0 +1,33 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(clone-file) begin
+(clone-file) create "src"
+(clone-file) open "src"
+(clone-file) close "src"
+(clone-file) clone_file "src" to "dst"
+(clone-file) open "dst" for verification
+(clone-file) verified contents of "dst"
+(clone-file) close "dst"
+(clone-file) open "dst"
+(clone-file) close "dst"
+(clone-file) open "src" for verification
+(clone-file) verified contents of "src"
+(clone-file) close "src"
+(clone-file) open "dst" for verification
+(clone-file) verified contents of "dst"
+(clone-file) close "dst"
+(clone-file) open "src"
+(clone-file) close "src"
+(clone-file) open "src" for verification
+(clone-file) verified contents of "src"
+(clone-file) close "src"
+(clone-file) open "dst" for verification
+(clone-file) verified contents of "dst"
+(clone-file) close "dst"
+(clone-file) clone_file "src" over "dst"
+(clone-file) end
+EOF
+pass;
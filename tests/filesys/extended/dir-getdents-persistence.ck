@@ -0,0 +1,9 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($fs);
+$fs->{'a'}{'d'} = {};
+$fs->{'a'}{"f$_"} = [''] foreach 0...9;
+check_archive ($fs);
+pass;
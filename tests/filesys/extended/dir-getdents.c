@@ -0,0 +1,70 @@
+/* Reads a directory of many entries a few at a time with
+   getdents() and checks that each entry comes back exactly once,
+   with its type and inumber. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 10
+#define BATCH 4
+
+void
+test_main (void) 
+{
+  struct dirent ents[BATCH];
+  bool seen[FILE_CNT + 1];
+  int fd, cnt, total = 0;
+  int i;
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      char name[16];
+
+      snprintf (name, sizeof name, "a/f%d", i);
+      CHECK (create (name, 0), "create \"%s\"", name);
+    }
+  CHECK (mkdir ("a/d"), "mkdir \"a/d\"");
+
+  CHECK ((fd = open ("a")) > 1, "open \"a\"");
+  memset (seen, 0, sizeof seen);
+  msg ("read entries %d at a time", BATCH);
+  while ((cnt = getdents (fd, ents, BATCH)) > 0)
+    {
+      if (cnt > BATCH)
+        fail ("getdents returned %d entries, asked for %d", cnt, BATCH);
+      for (i = 0; i < cnt; i++)
+        {
+          struct dirent *e = &ents[i];
+          int idx;
+
+          if (!strcmp (e->name, "d"))
+            {
+              idx = FILE_CNT;
+              if (!e->is_dir)
+                fail ("\"d\" not reported as a directory");
+            }
+          else if (e->name[0] == 'f' && e->name[1] >= '0'
+                   && e->name[1] < '0' + FILE_CNT && e->name[2] == '\0')
+            {
+              idx = e->name[1] - '0';
+              if (e->is_dir)
+                fail ("\"%s\" reported as a directory", e->name);
+            }
+          else
+            fail ("unexpected entry \"%s\"", e->name);
+          if (seen[idx])
+            fail ("entry \"%s\" returned twice", e->name);
+          if (e->inumber <= 1)
+            fail ("entry \"%s\" has inumber %d", e->name, e->inumber);
+          seen[idx] = true;
+          total++;
+        }
+    }
+  CHECK (cnt == 0, "getdents at end of directory");
+  CHECK (total == FILE_CNT + 1, "read all %d entries", FILE_CNT + 1);
+  CHECK (getdents (fd, ents, BATCH) == 0, "getdents after end");
+}
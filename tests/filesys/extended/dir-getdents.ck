@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-getdents) begin
+(dir-getdents) mkdir "a"
+(dir-getdents) create "a/f0"
+(dir-getdents) create "a/f1"
+(dir-getdents) create "a/f2"
+(dir-getdents) create "a/f3"
+(dir-getdents) create "a/f4"
+(dir-getdents) create "a/f5"
+(dir-getdents) create "a/f6"
+(dir-getdents) create "a/f7"
+(dir-getdents) create "a/f8"
+(dir-getdents) create "a/f9"
+(dir-getdents) mkdir "a/d"
+(dir-getdents) open "a"
+(dir-getdents) read entries 4 at a time
+(dir-getdents) getdents at end of directory
+(dir-getdents) read all 11 entries
+(dir-getdents) getdents after end
+(dir-getdents) end
+EOF
+pass;
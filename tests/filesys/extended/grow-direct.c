@@ -0,0 +1,57 @@
+/* Switches a file into direct mode with fcntl(), then writes it
+   1,024 bytes at a time, partly over its initial length and
+   partly past it, ending with a partial block.  Reads it back in
+   direct mode, then once more through the buffer cache. */
+
+#include <fcntl.h>
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BLOCK_SIZE 1024
+#define TEST_SIZE 12900
+
+static char buf[TEST_SIZE];
+
+void
+test_main (void) 
+{
+  const char *file_name = "direct";
+  size_t ofs;
+  int fd;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create (file_name, 8192), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (fcntl (fd, F_SETFL, O_DIRECT) == 0,
+         "set O_DIRECT on \"%s\"", file_name);
+  CHECK (fcntl (fd, F_GETFL, 0) == O_DIRECT,
+         "get flags of \"%s\"", file_name);
+
+  msg ("writing \"%s\"", file_name);
+  for (ofs = 0; ofs < TEST_SIZE; ofs += BLOCK_SIZE)
+    {
+      size_t block_size = TEST_SIZE - ofs < BLOCK_SIZE
+                          ? TEST_SIZE - ofs : BLOCK_SIZE;
+      if (write (fd, buf + ofs, block_size) != (int) block_size)
+        fail ("write %zu bytes at offset %zu in \"%s\" failed",
+              block_size, ofs, file_name);
+    }
+
+  msg ("reading \"%s\"", file_name);
+  seek (fd, 0);
+  for (ofs = 0; ofs < TEST_SIZE; ofs += BLOCK_SIZE)
+    {
+      char block[BLOCK_SIZE];
+      size_t block_size = TEST_SIZE - ofs < BLOCK_SIZE
+                          ? TEST_SIZE - ofs : BLOCK_SIZE;
+      if (read (fd, block, block_size) != (int) block_size)
+        fail ("read %zu bytes at offset %zu in \"%s\" failed",
+              block_size, ofs, file_name);
+      compare_bytes (block, buf + ofs, block_size, ofs, file_name);
+    }
+  msg ("close \"%s\"", file_name);
+  close (fd);
+  check_file (file_name, buf, TEST_SIZE);
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-direct) begin
+(grow-direct) create "direct"
+(grow-direct) open "direct"
+(grow-direct) set O_DIRECT on "direct"
+(grow-direct) get flags of "direct"
+(grow-direct) writing "direct"
+(grow-direct) reading "direct"
+(grow-direct) close "direct"
+(grow-direct) open "direct" for verification
+(grow-direct) verified contents of "direct"
+(grow-direct) close "direct"
+(grow-direct) end
+EOF
+pass;
@@ -0,0 +1,33 @@
+/* Grows a file 1,234 bytes at a time, making each write durable
+   with fsync() or fdatasync(), in turn, before the next. */
+
+#include <syscall.h>
+#include "tests/filesys/seq-test.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[5678];
+
+static size_t
+return_block_size (void) 
+{
+  return 1234;
+}
+
+static void
+sync_file (int fd, long ofs) 
+{
+  bool data_only = ofs / 1234 % 2 == 0;
+
+  if ((data_only ? fdatasync (fd) : fsync (fd)) != 0)
+    fail ("%s at offset %ld failed", data_only ? "fdatasync" : "fsync",
+          ofs);
+}
+
+void
+test_main (void) 
+{
+  seq_test ("synced",
+            buf, sizeof buf, 0,
+            return_block_size, sync_file);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-fsync) begin
+(grow-fsync) create "synced"
+(grow-fsync) open "synced"
+(grow-fsync) writing "synced"
+(grow-fsync) close "synced"
+(grow-fsync) open "synced" for verification
+(grow-fsync) verified contents of "synced"
+(grow-fsync) close "synced"
+(grow-fsync) end
+EOF
+pass;
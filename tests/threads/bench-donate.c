@@ -0,0 +1,109 @@
+/* Modeled on priority-donate-chain, but deeper: the main thread
+   holds lock 0 at PRI_MIN, and donor thread i, at priority
+   PRI_MIN + i, acquires EXTRA_LOCKS private locks and lock i
+   before blocking on lock i - 1, so that each donation walks the
+   whole chain and every holder has several locks to account.
+   The main thread then releases lock 0 and the chain unwinds.
+   Reports the average donation bookkeeping cost of acquiring and
+   releasing a lock, excluding the time spent blocked, which locks
+   only time while lock_stats is set. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define DEPTH 48                /* Length of the donation chain. */
+#define EXTRA_LOCKS 8           /* Additional locks held per donor. */
+#define ROUNDS 4                /* Times to build the chain. */
+
+struct lock_pair
+  {
+    struct lock *first;         /* Lock to hold. */
+    struct lock *second;        /* Lock to block on. */
+  };
+
+static thread_func donor_thread_func;
+
+/* Too large for the stack. */
+static struct lock locks[DEPTH];
+static struct lock_pair lock_pairs[DEPTH];
+
+void
+test_bench_donate (void)
+{
+  uint64_t acquire_cnt0, acquire_cycles0, release_cnt0, release_cycles0;
+  uint64_t acquire_cnt, acquire_cycles, release_cnt, release_cycles;
+  bool old_lock_stats = lock_stats;
+  int round, i;
+
+  /* This benchmark does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  msg ("Building a donation chain of %d threads holding %d locks each "
+       "%d times.", DEPTH - 1, EXTRA_LOCKS + 1, ROUNDS);
+
+  thread_set_priority (PRI_MIN);
+  lock_stats = true;
+  lock_donation_stats (&acquire_cnt0, &acquire_cycles0,
+                       &release_cnt0, &release_cycles0);
+  for (round = 0; round < ROUNDS; round++)
+    {
+      for (i = 0; i < DEPTH; i++)
+        lock_init (&locks[i]);
+      lock_acquire (&locks[0]);
+
+      for (i = 1; i < DEPTH; i++)
+        {
+          char name[16];
+
+          snprintf (name, sizeof name, "donor %d", i);
+          lock_pairs[i].first = &locks[i];
+          lock_pairs[i].second = &locks[i - 1];
+          thread_create (name, PRI_MIN + i, donor_thread_func,
+                         &lock_pairs[i]);
+        }
+      if (thread_get_priority () != PRI_MIN + DEPTH - 1)
+        fail ("main thread has priority %d instead of %d",
+              thread_get_priority (), PRI_MIN + DEPTH - 1);
+
+      /* Every donor runs to completion before we get back. */
+      lock_release (&locks[0]);
+    }
+  lock_donation_stats (&acquire_cnt, &acquire_cycles,
+                       &release_cnt, &release_cycles);
+  lock_stats = old_lock_stats;
+
+  acquire_cnt -= acquire_cnt0;
+  acquire_cycles -= acquire_cycles0;
+  release_cnt -= release_cnt0;
+  release_cycles -= release_cycles0;
+  msg ("acquires: %llu, cycles/acquire: %llu",
+       acquire_cnt, acquire_cnt ? acquire_cycles / acquire_cnt : 0);
+  msg ("releases: %llu, cycles/release: %llu",
+       release_cnt, release_cnt ? release_cycles / release_cnt : 0);
+  pass ();
+}
+
+/* Donor thread. */
+static void
+donor_thread_func (void *locks_)
+{
+  struct lock_pair *locks = locks_;
+  struct lock extra[EXTRA_LOCKS];
+  int i;
+
+  for (i = 0; i < EXTRA_LOCKS; i++)
+    {
+      lock_init (&extra[i]);
+      lock_acquire (&extra[i]);
+    }
+  lock_acquire (locks->first);
+  lock_acquire (locks->second);
+
+  lock_release (locks->second);
+  lock_release (locks->first);
+  for (i = 0; i < EXTRA_LOCKS; i++)
+    lock_release (&extra[i]);
+}
@@ -0,0 +1,244 @@
+/* Measures the throughput of hash_bytes() and how evenly
+   hash_int() spreads regular keys over buckets, each against
+   byte-at-a-time FNV-1.  Then inserts ELEM_CNT keys into a
+   chained hash table (hash.h) and an open-addressing hash table
+   (ohash.h), looks up present and absent keys in random order,
+   deletes them all, and reports the average cycles per operation
+   for each table. */
+
+#include <hash.h>
+#include <ohash.h>
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/cycle.h"
+#include "threads/malloc.h"
+
+#define ELEM_CNT 4096           /* Keys in each table. */
+#define LOOKUPS 65536           /* Lookups of each kind. */
+#define BUF_SIZE 4096           /* Bytes per hash_bytes() call. */
+#define BUF_ROUNDS 64           /* hash_bytes() calls timed. */
+#define BUCKET_CNT 1024         /* Buckets for distribution checks. */
+
+struct item
+  {
+    int key;                    /* Even for present keys. */
+    struct hash_elem h_elem;    /* Element in the chained table. */
+    struct ohash_elem o_elem;   /* Element in the open-addressing table. */
+  };
+
+static unsigned
+item_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct item, h_elem)->key);
+}
+
+static bool
+item_less (const struct hash_elem *a, const struct hash_elem *b,
+           void *aux UNUSED)
+{
+  return (hash_entry (a, struct item, h_elem)->key
+          < hash_entry (b, struct item, h_elem)->key);
+}
+
+static unsigned
+item_ohash (const struct ohash_elem *e, void *aux UNUSED)
+{
+  return hash_int (ohash_entry (e, struct item, o_elem)->key);
+}
+
+static bool
+item_oless (const struct ohash_elem *a, const struct ohash_elem *b,
+            void *aux UNUSED)
+{
+  return (ohash_entry (a, struct item, o_elem)->key
+          < ohash_entry (b, struct item, o_elem)->key);
+}
+
+/* 32-bit FNV-1 over the SIZE bytes in BUF, for comparison. */
+static unsigned
+fnv_bytes (const void *buf_, size_t size)
+{
+  const unsigned char *buf = buf_;
+  unsigned hash = 2166136261u;
+
+  while (size-- > 0)
+    hash = (hash * 16777619u) ^ *buf++;
+  return hash;
+}
+
+/* Hashes ELEM_CNT keys spaced STRIDE apart with hash_int() and
+   with FNV-1 into BUCKET_CNT buckets by their low bits, and
+   reports the fullest bucket each time.  Perfect spreading puts
+   ELEM_CNT / BUCKET_CNT keys in every bucket. */
+static void
+bench_spread (const char *what, int stride)
+{
+  static unsigned short loads[2][BUCKET_CNT];
+  unsigned max[2] = {0, 0};
+  int i, j;
+
+  memset (loads, 0, sizeof loads);
+  for (i = 0; i < ELEM_CNT; i++)
+    {
+      int key = i * stride;
+      unsigned hashes[2];
+
+      hashes[0] = hash_int (key);
+      hashes[1] = fnv_bytes (&key, sizeof key);
+      for (j = 0; j < 2; j++)
+        {
+          unsigned load = ++loads[j][hashes[j] % BUCKET_CNT];
+          if (load > max[j])
+            max[j] = load;
+        }
+    }
+
+  msg ("%s keys: fullest of %d buckets: hash_int %u, FNV-1 %u (ideal %d)",
+       what, BUCKET_CNT, max[0], max[1], ELEM_CNT / BUCKET_CNT);
+}
+
+/* Compares hash functions. */
+static void
+bench_functions (void)
+{
+  static uint8_t buf[BUF_SIZE];
+  uint64_t start, cycles[2];
+  volatile unsigned sink;
+  int i;
+
+  for (i = 0; i < BUF_SIZE; i++)
+    buf[i] = random_ulong ();
+
+  start = rdtsc ();
+  for (i = 0; i < BUF_ROUNDS; i++)
+    sink = hash_bytes (buf + i % 4, BUF_SIZE - 4);
+  cycles[0] = rdtsc () - start;
+
+  start = rdtsc ();
+  for (i = 0; i < BUF_ROUNDS; i++)
+    sink = fnv_bytes (buf + i % 4, BUF_SIZE - 4);
+  cycles[1] = rdtsc () - start;
+  (void) sink;
+
+  msg ("cycles per KB: hash_bytes %llu, FNV-1 %llu",
+       cycles[0] * 1024 / ((uint64_t) BUF_ROUNDS * (BUF_SIZE - 4)),
+       cycles[1] * 1024 / ((uint64_t) BUF_ROUNDS * (BUF_SIZE - 4)));
+
+  bench_spread ("Sequential", 1);
+  bench_spread ("Page-aligned", 4096);
+}
+
+void
+test_bench_hash (void)
+{
+  struct item *items;
+  struct item probe;
+  struct hash h;
+  struct ohash o;
+  uint64_t start, insert, hit, miss, delete;
+  int i;
+
+  bench_functions ();
+
+  items = malloc (sizeof *items * ELEM_CNT);
+  if (items == NULL)
+    fail ("out of memory");
+  for (i = 0; i < ELEM_CNT; i++)
+    items[i].key = i * 2;
+
+  msg ("Inserting %d keys, looking up %d present and %d absent keys, "
+       "deleting %d keys.", ELEM_CNT, LOOKUPS, LOOKUPS, ELEM_CNT);
+
+  /* Chained hash table. */
+  if (!hash_init (&h, item_hash, item_less, NULL))
+    fail ("hash_init failed");
+
+  start = rdtsc ();
+  for (i = 0; i < ELEM_CNT; i++)
+    if (hash_insert (&h, &items[i].h_elem) != NULL)
+      fail ("hash_insert found duplicate of key %d", items[i].key);
+  insert = rdtsc () - start;
+
+  start = rdtsc ();
+  for (i = 0; i < LOOKUPS; i++)
+    {
+      struct item *it = &items[random_ulong () % ELEM_CNT];
+      probe.key = it->key;
+      if (hash_find (&h, &probe.h_elem) != &it->h_elem)
+        fail ("hash_find missed key %d", probe.key);
+    }
+  hit = rdtsc () - start;
+
+  start = rdtsc ();
+  for (i = 0; i < LOOKUPS; i++)
+    {
+      probe.key = random_ulong () % ELEM_CNT * 2 + 1;
+      if (hash_find (&h, &probe.h_elem) != NULL)
+        fail ("hash_find found absent key %d", probe.key);
+    }
+  miss = rdtsc () - start;
+
+  start = rdtsc ();
+  for (i = 0; i < ELEM_CNT; i++)
+    if (hash_delete (&h, &items[i].h_elem) != &items[i].h_elem)
+      fail ("hash_delete missed key %d", items[i].key);
+  delete = rdtsc () - start;
+
+  if (!hash_empty (&h))
+    fail ("chained hash table not empty");
+  hash_destroy (&h, NULL);
+
+  msg ("chained: cycles/insert: %llu, cycles/hit: %llu, "
+       "cycles/miss: %llu, cycles/delete: %llu",
+       insert / ELEM_CNT, hit / LOOKUPS,
+       miss / LOOKUPS, delete / ELEM_CNT);
+
+  /* Open-addressing hash table. */
+  if (!ohash_init (&o, item_ohash, item_oless, NULL))
+    fail ("ohash_init failed");
+
+  start = rdtsc ();
+  for (i = 0; i < ELEM_CNT; i++)
+    if (ohash_insert (&o, &items[i].o_elem) != NULL)
+      fail ("ohash_insert found duplicate of key %d", items[i].key);
+  insert = rdtsc () - start;
+
+  start = rdtsc ();
+  for (i = 0; i < LOOKUPS; i++)
+    {
+      struct item *it = &items[random_ulong () % ELEM_CNT];
+      probe.key = it->key;
+      if (ohash_find (&o, &probe.o_elem) != &it->o_elem)
+        fail ("ohash_find missed key %d", probe.key);
+    }
+  hit = rdtsc () - start;
+
+  start = rdtsc ();
+  for (i = 0; i < LOOKUPS; i++)
+    {
+      probe.key = random_ulong () % ELEM_CNT * 2 + 1;
+      if (ohash_find (&o, &probe.o_elem) != NULL)
+        fail ("ohash_find found absent key %d", probe.key);
+    }
+  miss = rdtsc () - start;
+
+  start = rdtsc ();
+  for (i = 0; i < ELEM_CNT; i++)
+    if (ohash_delete (&o, &items[i].o_elem) != &items[i].o_elem)
+      fail ("ohash_delete missed key %d", items[i].key);
+  delete = rdtsc () - start;
+
+  if (!ohash_empty (&o))
+    fail ("open-addressing hash table not empty");
+  ohash_destroy (&o, NULL);
+
+  msg ("open addressing: cycles/insert: %llu, cycles/hit: %llu, "
+       "cycles/miss: %llu, cycles/delete: %llu",
+       insert / ELEM_CNT, hit / LOOKUPS,
+       miss / LOOKUPS, delete / ELEM_CNT);
+
+  free (items);
+  pass ();
+}
@@ -0,0 +1,123 @@
+/* Creates N threads of equal priority, each of which enters a
+   short critical section M times, guarded first by a plain lock,
+   then by a plain lock that hands itself over on release, and
+   then by an adaptive lock, and reports the average cycles per
+   critical section for each, along with how often the adaptive
+   lock had to spin or block.  Contention arises when a thread
+   gets preempted within its critical section. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/cycle.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define THREAD_CNT 8            /* Number of contending threads. */
+#define ITERATIONS 5000         /* Critical sections per thread. */
+#define CS_LOOPS 1000           /* Work per critical section. */
+
+static void plain_thread (void *);
+static void adaptive_thread (void *);
+static uint64_t run (thread_func *);
+
+static struct lock plain;
+static struct adaptive_lock adaptive;
+static volatile unsigned counter;
+
+/* Signaled by each thread as it finishes. */
+static struct semaphore done;
+
+void
+test_bench_lock (void)
+{
+  uint64_t cycles;
+
+  /* This benchmark does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  msg ("Creating %d threads to enter a critical section %d times each.",
+       THREAD_CNT, ITERATIONS);
+
+  lock_init (&plain);
+  cycles = run (plain_thread);
+  msg ("lock: cycles/section: %llu", cycles / (THREAD_CNT * ITERATIONS));
+
+  lock_set_handoff (&plain, true);
+  cycles = run (plain_thread);
+  msg ("handoff lock: cycles/section: %llu",
+       cycles / (THREAD_CNT * ITERATIONS));
+
+  adaptive_lock_init (&adaptive);
+  cycles = run (adaptive_thread);
+  msg ("adaptive lock: cycles/section: %llu",
+       cycles / (THREAD_CNT * ITERATIONS));
+  msg ("adaptive lock: spun %u times, blocked %u times",
+       adaptive.spin_cnt, adaptive.block_cnt);
+
+  if (counter != 3 * THREAD_CNT * ITERATIONS * CS_LOOPS)
+    fail ("counter is %u instead of %u", counter,
+          3 * THREAD_CNT * ITERATIONS * CS_LOOPS);
+  pass ();
+}
+
+/* Runs THREAD_CNT threads executing FUNC, waits for all of them,
+   and returns the cycles elapsed. */
+static uint64_t
+run (thread_func *func)
+{
+  uint64_t start;
+  int i;
+
+  sema_init (&done, 0);
+  start = rdtsc ();
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "contender %d", i);
+      thread_create (name, PRI_DEFAULT, func, NULL);
+    }
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&done);
+  return rdtsc () - start;
+}
+
+/* Critical section. */
+static void
+critical_section (void)
+{
+  int i;
+
+  for (i = 0; i < CS_LOOPS; i++)
+    counter++;
+}
+
+/* Plain lock contender. */
+static void
+plain_thread (void *aux UNUSED)
+{
+  int i;
+
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      lock_acquire (&plain);
+      critical_section ();
+      lock_release (&plain);
+    }
+  sema_up (&done);
+}
+
+/* Adaptive lock contender. */
+static void
+adaptive_thread (void *aux UNUSED)
+{
+  int i;
+
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      adaptive_lock_acquire (&adaptive);
+      critical_section ();
+      adaptive_lock_release (&adaptive);
+    }
+  sema_up (&done);
+}
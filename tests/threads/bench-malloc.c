@@ -0,0 +1,63 @@
+/* Randomly allocates and frees blocks of 1 to MAX_SIZE bytes,
+   keeping up to LIVE_MAX blocks allocated, and reports the
+   average cycles per malloc() and per free(). */
+
+#include <random.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/cycle.h"
+#include "threads/malloc.h"
+
+#define ITERATIONS 50000        /* Allocations plus frees. */
+#define LIVE_MAX 64             /* Maximum blocks allocated at once. */
+#define MAX_SIZE 1024           /* Maximum bytes per block. */
+
+static void *blocks[LIVE_MAX];
+
+void
+test_bench_malloc (void)
+{
+  uint64_t malloc_cnt = 0, malloc_cycles = 0, free_cnt = 0, free_cycles = 0;
+  size_t live = 0;
+  uint64_t start;
+  int i;
+
+  msg ("Allocating and freeing blocks of up to %d bytes %d times.",
+       MAX_SIZE, ITERATIONS);
+
+  for (i = 0; i < ITERATIONS; i++)
+    if (live == 0 || (live < LIVE_MAX && random_ulong () % 2))
+      {
+        /* Mostly small blocks. */
+        size_t size = random_ulong () % 4
+                      ? random_ulong () % 64 + 1
+                      : random_ulong () % MAX_SIZE + 1;
+        void *p;
+
+        start = rdtsc ();
+        p = malloc (size);
+        malloc_cycles += rdtsc () - start;
+        malloc_cnt++;
+        if (p == NULL)
+          fail ("malloc(%zu) failed", size);
+        blocks[live++] = p;
+      }
+    else
+      {
+        size_t j = random_ulong () % live;
+
+        start = rdtsc ();
+        free (blocks[j]);
+        free_cycles += rdtsc () - start;
+        free_cnt++;
+        blocks[j] = blocks[--live];
+      }
+  while (live > 0)
+    free (blocks[--live]);
+
+  msg ("mallocs: %llu, cycles/malloc: %llu",
+       malloc_cnt, malloc_cnt ? malloc_cycles / malloc_cnt : 0);
+  msg ("frees: %llu, cycles/free: %llu",
+       free_cnt, free_cnt ? free_cycles / free_cnt : 0);
+  pass ();
+}
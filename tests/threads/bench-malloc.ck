@@ -0,0 +1,36 @@
+# -*- perl -*-
+
+# The malloc and free counts must add up to the iterations run,
+# with no more blocks left to free at the end than may be live at
+# once, and each operation must have taken some cycles.
+
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing PASS in output"
+  unless grep ($_ eq '(bench-malloc) PASS', @output);
+
+my ($iterations) = map (/up to \d+ bytes (\d+) times\./, @output);
+fail "missing description of the run\n" if !defined $iterations;
+
+my ($mallocs, $malloc_cycles)
+  = map (/mallocs: (\d+), cycles\/malloc: (\d+)$/, @output);
+fail "missing malloc results\n" if !defined $malloc_cycles;
+my ($frees, $free_cycles) = map (/frees: (\d+), cycles\/free: (\d+)$/, @output);
+fail "missing free results\n" if !defined $free_cycles;
+
+fail "$mallocs mallocs and $frees frees, expected $iterations in all\n"
+  if $mallocs + $frees != $iterations;
+fail "$mallocs mallocs but $frees frees\n"
+  if $frees > $mallocs || $mallocs - $frees > 64;
+fail "mallocs took no cycles\n" if $malloc_cycles == 0;
+fail "frees took no cycles\n" if $frees > 0 && $free_cycles == 0;
+
+pass;
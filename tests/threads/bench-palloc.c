@@ -0,0 +1,117 @@
+/* Randomly allocates and frees runs of 1 to MAX_PAGES user pages,
+   keeping up to LIVE_MAX runs allocated, and reports the average
+   cycles per allocation and per free, how many allocations failed,
+   and the largest run still allocatable with the live runs held.
+   Run with and without -palloc-ff to compare the first-fit and
+   buddy allocators. */
+
+#include <random.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/cycle.h"
+#include "threads/init.h"
+#include "threads/palloc.h"
+
+#define ITERATIONS 20000        /* Allocations plus frees. */
+#define LIVE_MAX 64             /* Maximum runs allocated at once. */
+#define MAX_PAGES 16            /* Maximum pages per run. */
+
+/* A run of allocated pages. */
+struct run
+  {
+    void *pages;                /* First page. */
+    size_t page_cnt;            /* Number of pages. */
+  };
+
+static struct run runs[LIVE_MAX];
+
+static size_t largest_run (void);
+
+void
+test_bench_palloc (void)
+{
+  uint64_t alloc_cnt = 0, alloc_cycles = 0, free_cnt = 0, free_cycles = 0;
+  unsigned fail_cnt = 0;
+  size_t live = 0;
+  uint64_t start;
+  int i;
+
+  msg ("Allocating and freeing user pages %d times, %s.",
+       ITERATIONS, palloc_first_fit ? "first fit" : "buddy");
+
+  for (i = 0; i < ITERATIONS; i++)
+    if (live == 0 || (live < LIVE_MAX && random_ulong () % 2))
+      {
+        /* Mostly single pages, sometimes longer runs. */
+        size_t page_cnt = random_ulong () % 4
+                          ? 1 : random_ulong () % MAX_PAGES + 1;
+        void *pages;
+
+        start = rdtsc ();
+        pages = palloc_get_multiple (PAL_USER, page_cnt);
+        alloc_cycles += rdtsc () - start;
+        alloc_cnt++;
+        if (pages == NULL)
+          fail_cnt++;
+        else
+          {
+            runs[live].pages = pages;
+            runs[live].page_cnt = page_cnt;
+            live++;
+          }
+      }
+    else
+      {
+        size_t j = random_ulong () % live;
+
+        start = rdtsc ();
+        palloc_free_multiple (runs[j].pages, runs[j].page_cnt);
+        free_cycles += rdtsc () - start;
+        free_cnt++;
+        runs[j] = runs[--live];
+      }
+
+  msg ("allocs: %llu, cycles/alloc: %llu, failed: %u",
+       alloc_cnt, alloc_cnt ? alloc_cycles / alloc_cnt : 0, fail_cnt);
+  msg ("frees: %llu, cycles/free: %llu",
+       free_cnt, free_cnt ? free_cycles / free_cnt : 0);
+  msg ("largest run with %zu runs live: %zu pages", live, largest_run ());
+
+  while (live > 0)
+    {
+      live--;
+      palloc_free_multiple (runs[live].pages, runs[live].page_cnt);
+    }
+  pass ();
+}
+
+/* Returns the largest number of contiguous user pages that can
+   currently be allocated. */
+static size_t
+largest_run (void)
+{
+  size_t lo = 0, hi = 1;
+  void *pages;
+
+  /* Double up to the first failure, then bisect. */
+  while ((pages = palloc_get_multiple (PAL_USER, hi)) != NULL)
+    {
+      palloc_free_multiple (pages, hi);
+      lo = hi;
+      hi *= 2;
+    }
+  while (hi - lo > 1)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+
+      pages = palloc_get_multiple (PAL_USER, mid);
+      if (pages != NULL)
+        {
+          palloc_free_multiple (pages, mid);
+          lo = mid;
+        }
+      else
+        hi = mid;
+    }
+  return lo;
+}
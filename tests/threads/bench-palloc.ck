@@ -0,0 +1,39 @@
+# -*- perl -*-
+
+# The allocation and free counts must add up to the iterations
+# run, each operation must have taken some cycles, and a run of at
+# least one page must still be allocatable with the live runs held.
+
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing PASS in output"
+  unless grep ($_ eq '(bench-palloc) PASS', @output);
+
+my ($iterations) = map (/freeing user pages (\d+) times, (?:first fit|buddy)\./,
+                        @output);
+fail "missing description of the run\n" if !defined $iterations;
+
+my ($allocs, $alloc_cycles, $failed)
+  = map (/allocs: (\d+), cycles\/alloc: (\d+), failed: (\d+)$/, @output);
+fail "missing allocation results\n" if !defined $failed;
+my ($frees, $free_cycles) = map (/frees: (\d+), cycles\/free: (\d+)$/, @output);
+fail "missing free results\n" if !defined $free_cycles;
+my ($largest) = map (/largest run with \d+ runs live: (\d+) pages$/, @output);
+fail "missing largest run\n" if !defined $largest;
+
+fail "$allocs allocations and $frees frees, expected $iterations in all\n"
+  if $allocs + $frees != $iterations;
+fail "$failed of $allocs allocations failed\n" if $failed > $allocs;
+fail "allocations took no cycles\n" if $alloc_cycles == 0;
+fail "frees took no cycles\n" if $frees > 0 && $free_cycles == 0;
+fail "no page is allocatable\n" if $largest < 1;
+
+pass;
@@ -0,0 +1,68 @@
+/* Creates N threads, each of which sleeps until a random deadline
+   M times, then reports the average cost of inserting a sleeper
+   into the sleep queue and of waking it in the timer interrupt. */
+
+#include <random.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define THREAD_CNT 100          /* Number of sleeping threads. */
+#define ITERATIONS 4            /* Sleeps per thread. */
+#define MAX_DELAY 64            /* Maximum ticks per sleep. */
+
+static void sleeper (void *);
+
+/* Signaled by each sleeper as it finishes. */
+static struct semaphore done;
+
+void
+test_bench_sleep (void)
+{
+  uint64_t insert_cnt0, insert_cycles0, wake_cnt0, wake_cycles0;
+  uint64_t insert_cnt, insert_cycles, wake_cnt, wake_cycles;
+  int i;
+
+  /* This benchmark does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  msg ("Creating %d threads to sleep %d times each at random deadlines.",
+       THREAD_CNT, ITERATIONS);
+
+  sema_init (&done, 0);
+  thread_sleep_stats (&insert_cnt0, &insert_cycles0,
+                      &wake_cnt0, &wake_cycles0);
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "sleeper %d", i);
+      thread_create (name, PRI_DEFAULT, sleeper, NULL);
+    }
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&done);
+  thread_sleep_stats (&insert_cnt, &insert_cycles, &wake_cnt, &wake_cycles);
+
+  insert_cnt -= insert_cnt0;
+  insert_cycles -= insert_cycles0;
+  wake_cnt -= wake_cnt0;
+  wake_cycles -= wake_cycles0;
+  msg ("inserts: %llu, cycles/insert: %llu",
+       insert_cnt, insert_cnt ? insert_cycles / insert_cnt : 0);
+  msg ("wakes: %llu, cycles/wake: %llu",
+       wake_cnt, wake_cnt ? wake_cycles / wake_cnt : 0);
+  pass ();
+}
+
+/* Sleeper thread. */
+static void
+sleeper (void *aux UNUSED)
+{
+  int i;
+
+  for (i = 0; i < ITERATIONS; i++)
+    timer_sleep (random_ulong () % MAX_DELAY + 1);
+  sema_up (&done);
+}
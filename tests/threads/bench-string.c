@@ -0,0 +1,124 @@
+/* Times memcpy(), memmove() and memset() for a sweep of sizes up
+   to a page, next to a byte-at-a-time loop for reference, then
+   strlen(), strcmp(), memchr() and memcmp() for a sweep of
+   lengths and alignments, and reports the average cycles per
+   call of each. */
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/cycle.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+#define REPEAT 64               /* Calls per size. */
+
+static void byte_copy (void *, const void *, size_t);
+static void bench_scan (uint8_t *, uint8_t *);
+
+void
+test_bench_string (void)
+{
+  static const size_t sizes[] = {16, 64, 256, 1024, PGSIZE};
+  uint8_t *src, *dst;
+  size_t i;
+
+  src = palloc_get_multiple (PAL_ASSERT | PAL_ZERO, 2);
+  dst = src + PGSIZE;
+  msg ("Timing string functions over %d calls per size.", REPEAT);
+
+  for (i = 0; i < sizeof sizes / sizeof *sizes; i++)
+    {
+      uint64_t bytes = 0, copy = 0, move = 0, set = 0, start;
+      size_t size = sizes[i];
+      int j;
+
+      for (j = 0; j < REPEAT; j++)
+        {
+          start = rdtsc ();
+          byte_copy (dst, src, size);
+          bytes += rdtsc () - start;
+
+          start = rdtsc ();
+          memcpy (dst, src, size);
+          copy += rdtsc () - start;
+
+          /* Overlapping, so memmove() copies downward. */
+          start = rdtsc ();
+          memmove (dst + 4, dst, size - 4);
+          move += rdtsc () - start;
+
+          start = rdtsc ();
+          memset (dst, j, size);
+          set += rdtsc () - start;
+        }
+      msg ("%4zu bytes: cycles/call: byte loop %llu, memcpy %llu, "
+           "memmove %llu, memset %llu", size, bytes / REPEAT,
+           copy / REPEAT, move / REPEAT, set / REPEAT);
+    }
+
+  bench_scan (src, dst);
+
+  palloc_free_multiple (src, 2);
+  pass ();
+}
+
+/* Copies SIZE bytes from SRC to DST one at a time. */
+static void
+byte_copy (void *dst_, const void *src_, size_t size)
+{
+  volatile uint8_t *dst = dst_;
+  const uint8_t *src = src_;
+
+  while (size-- > 0)
+    *dst++ = *src++;
+}
+
+/* Times the scanning functions on strings and blocks of a sweep
+   of lengths at each alignment, using SRC and DST as two pages of
+   scratch space. */
+static void
+bench_scan (uint8_t *src, uint8_t *dst)
+{
+  static const size_t lengths[] = {4, 16, 64, 256, 1024};
+  volatile size_t sink;
+  size_t i, align;
+
+  for (i = 0; i < sizeof lengths / sizeof *lengths; i++)
+    for (align = 0; align < 4; align++)
+      {
+        uint64_t len = 0, cmp = 0, chr = 0, mcmp = 0, start;
+        size_t length = lengths[i];
+        char *a = (char *) src + align;
+        char *b = (char *) dst + align;
+        int j;
+
+        /* Two equal strings, so every function scans them whole. */
+        memset (a, 'x', length);
+        a[length] = '\0';
+        memcpy (b, a, length + 1);
+
+        for (j = 0; j < REPEAT; j++)
+          {
+            start = rdtsc ();
+            sink = strlen (a);
+            len += rdtsc () - start;
+
+            start = rdtsc ();
+            sink = strcmp (a, b);
+            cmp += rdtsc () - start;
+
+            start = rdtsc ();
+            sink = (size_t) memchr (a, '\0', length + 1);
+            chr += rdtsc () - start;
+
+            start = rdtsc ();
+            sink = memcmp (a, b, length);
+            mcmp += rdtsc () - start;
+          }
+        msg ("%4zu bytes at +%zu: cycles/call: strlen %llu, strcmp %llu, "
+             "memchr %llu, memcmp %llu", length, align, len / REPEAT,
+             cmp / REPEAT, chr / REPEAT, mcmp / REPEAT);
+      }
+  (void) sink;
+}
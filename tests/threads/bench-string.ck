@@ -0,0 +1,36 @@
+# -*- perl -*-
+
+# Every size must be reported, in order, and at a page the string
+# instructions must beat the byte-at-a-time loop.
+
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing PASS in output"
+  unless grep ($_ eq '(bench-string) PASS', @output);
+
+my (@sizes) = (16, 64, 256, 1024, 4096);
+my (@results) = grep (/bytes: cycles\/call: byte loop/, @output);
+fail scalar (@results) . " sizes reported, expected " . scalar (@sizes) . "\n"
+  if @results != @sizes;
+
+for my $i (0...$#sizes) {
+    my ($size, $bytes, $copy, $move, $set)
+      = $results[$i] =~ /(\d+) bytes: cycles\/call: byte loop (\d+), memcpy (\d+), memmove (\d+), memset (\d+)$/
+      or fail "malformed result: $results[$i]\n";
+    fail "size $size reported, expected $sizes[$i]\n" if $size != $sizes[$i];
+    next if $size != 4096;
+    fail "memcpy of $size bytes took $copy cycles, byte loop $bytes\n"
+      if $copy >= $bytes;
+    fail "memset of $size bytes took $set cycles, byte loop $bytes\n"
+      if $set >= $bytes;
+}
+
+pass;
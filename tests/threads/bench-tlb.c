@@ -0,0 +1,36 @@
+/* Reads one word from every page of RAM through the kernel's
+   mapping of physical memory, several times over, and reports the
+   average cycles per read.  Each read touches a new page, so with
+   4 kB mappings nearly all of them miss in the TLB; with 4 MB
+   mappings (the default, unless -no-pse) almost none do. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/cycle.h"
+#include "threads/init.h"
+#include "threads/loader.h"
+#include "threads/vaddr.h"
+
+#define REPEAT 8                /* Passes over RAM. */
+
+void
+test_bench_tlb (void)
+{
+  volatile uint32_t sum = 0;
+  uint64_t start, cycles;
+  size_t page;
+  int i;
+
+  msg ("Reading %"PRIu32" pages %d times with %s pages.",
+       init_ram_pages, REPEAT, init_large_pages ? "4 MB" : "4 kB");
+
+  start = rdtsc ();
+  for (i = 0; i < REPEAT; i++)
+    for (page = 0; page < init_ram_pages; page++)
+      sum += *(uint32_t *) ptov (page * PGSIZE);
+  cycles = rdtsc () - start;
+
+  msg ("cycles/read: %llu", cycles / ((uint64_t) REPEAT * init_ram_pages));
+  pass ();
+}
@@ -0,0 +1,28 @@
+# -*- perl -*-
+
+# The run must say which page size it used and read at least one
+# page, and the reads must have taken some cycles.
+
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing PASS in output"
+  unless grep ($_ eq '(bench-tlb) PASS', @output);
+
+my ($pages) = map (/Reading (\d+) pages \d+ times with (?:4 MB|4 kB) pages\./,
+                   @output);
+fail "missing description of the run\n" if !defined $pages;
+fail "no pages read\n" if $pages == 0;
+
+my ($cycles) = map (/cycles\/read: (\d+)$/, @output);
+fail "missing cycles per read\n" if !defined $cycles;
+fail "reads took no cycles\n" if $cycles == 0;
+
+pass;
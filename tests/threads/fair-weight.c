@@ -0,0 +1,72 @@
+/* Checks that the fair scheduler shares the CPU in proportion to
+   the weights of the threads' priorities.
+
+   Three threads spin for 20 seconds, two at PRI_DEFAULT and one
+   at PRI_DEFAULT + 5, which weighs 3121 against 1024.  They
+   should receive 396, 396 and 1208 of the 2000 ticks,
+   respectively. */
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define THREAD_CNT 3
+
+struct thread_info
+  {
+    int64_t start_time;
+    int tick_count;
+  };
+
+static thread_func load_thread;
+
+void
+test_fair_weight (void)
+{
+  static const int priorities[THREAD_CNT] =
+    {PRI_DEFAULT, PRI_DEFAULT, PRI_DEFAULT + 5};
+  struct thread_info info[THREAD_CNT];
+  int64_t start_time;
+  int i;
+
+  ASSERT (!strcmp (thread_sched_name (), "fair"));
+
+  start_time = timer_ticks ();
+  msg ("Starting %d threads...", THREAD_CNT);
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      char name[16];
+
+      info[i].start_time = start_time;
+      info[i].tick_count = 0;
+      snprintf (name, sizeof name, "load %d", i);
+      thread_create (name, priorities[i], load_thread, &info[i]);
+    }
+
+  msg ("Sleeping 30 seconds to let threads run, please wait...");
+  timer_sleep (30 * TIMER_FREQ);
+
+  for (i = 0; i < THREAD_CNT; i++)
+    msg ("Thread %d received %d ticks.", i, info[i].tick_count);
+}
+
+static void
+load_thread (void *ti_)
+{
+  struct thread_info *ti = ti_;
+  int64_t sleep_time = 5 * TIMER_FREQ;
+  int64_t spin_time = sleep_time + 20 * TIMER_FREQ;
+  int64_t last_time = 0;
+
+  timer_sleep (sleep_time - timer_elapsed (ti->start_time));
+  while (timer_elapsed (ti->start_time) < spin_time)
+    {
+      int64_t cur_time = timer_ticks ();
+      if (cur_time != last_time)
+        ti->tick_count++;
+      last_time = cur_time;
+    }
+}
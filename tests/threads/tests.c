@@ -38,6 +38,16 @@ static const struct test tests[] =
     {"mlfqs-nice-2", test_mlfqs_nice_2},
     {"mlfqs-nice-10", test_mlfqs_nice_10},
     {"mlfqs-block", test_mlfqs_block},
+    {"fair-weight", test_fair_weight},
+    {"workqueue", test_workqueue},
+    {"bench-sleep", test_bench_sleep},
+    {"bench-donate", test_bench_donate},
+    {"bench-lock", test_bench_lock},
+    {"bench-palloc", test_bench_palloc},
+    {"bench-malloc", test_bench_malloc},
+    {"bench-string", test_bench_string},
+    {"bench-tlb", test_bench_tlb},
+    {"bench-hash", test_bench_hash},
   };
 
 static const char *test_name;
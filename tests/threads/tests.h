@@ -32,6 +32,16 @@ extern test_func test_mlfqs_fair_20;
 extern test_func test_mlfqs_nice_2;
 extern test_func test_mlfqs_nice_10;
 extern test_func test_mlfqs_block;
+extern test_func test_fair_weight;
+extern test_func test_workqueue;
+extern test_func test_bench_sleep;
+extern test_func test_bench_donate;
+extern test_func test_bench_lock;
+extern test_func test_bench_palloc;
+extern test_func test_bench_malloc;
+extern test_func test_bench_string;
+extern test_func test_bench_tlb;
+extern test_func test_bench_hash;
 
 void msg (const char *, ...);
 void fail (const char *, ...);
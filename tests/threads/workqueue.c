@@ -0,0 +1,92 @@
+/* Checks that a workqueue runs work by priority, runs delayed
+   work once it falls due, including work due earlier than what
+   the queue was already waiting for, and can take queued work
+   back. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+#include "devices/timer.h"
+
+static struct semaphore gate;
+static struct semaphore done;
+static int64_t early_ran;
+
+static work_func wait_gate, say, say_early;
+
+void
+test_workqueue (void)
+{
+  struct workqueue *wq;
+  struct work gate_work, high, normal, low, early, late, cancelled;
+  int64_t start;
+  int i;
+
+  wq = workqueue_create ("test", 1);
+  ASSERT (wq != NULL);
+  sema_init (&gate, 0);
+  sema_init (&done, 0);
+
+  /* Queue work behind a gate, so that all of it is queued by the
+     time the single worker looks. */
+  work_init (&gate_work, wait_gate, NULL, WORK_HIGH);
+  work_init (&low, say, "low", WORK_LOW);
+  work_init (&normal, say, "normal", WORK_NORMAL);
+  work_init (&high, say, "high", WORK_HIGH);
+  work_submit (wq, &gate_work);
+  work_submit (wq, &low);
+  work_submit (wq, &normal);
+  work_submit (wq, &high);
+  msg ("Opening the gate.");
+  sema_up (&gate);
+  for (i = 0; i < 3; i++)
+    sema_down (&done);
+
+  /* Let the worker wait for late work, then submit earlier work. */
+  work_init (&late, say, "late", WORK_NORMAL);
+  work_submit_delayed (wq, &late, 50);
+  timer_sleep (10);
+  start = timer_ticks ();
+  work_init (&early, say_early, "early", WORK_NORMAL);
+  work_submit_delayed (wq, &early, 5);
+
+  work_init (&cancelled, say, "cancelled", WORK_NORMAL);
+  work_submit_delayed (wq, &cancelled, 20);
+  if (!work_cancel (&cancelled))
+    fail ("delayed work could not be cancelled");
+  if (work_cancel (&cancelled))
+    fail ("cancelled work was still queued");
+
+  for (i = 0; i < 2; i++)
+    sema_down (&done);
+  if (early_ran - start < 5 || early_ran - start > 20)
+    fail ("work delayed by 5 ticks ran after %lld ticks",
+          early_ran - start);
+  msg ("Delayed work ran on time.");
+}
+
+/* Holds up the worker until the gate opens. */
+static void
+wait_gate (void *aux UNUSED)
+{
+  sema_down (&gate);
+}
+
+/* Names the work that ran. */
+static void
+say (void *name)
+{
+  msg ("Running %s work.", (const char *) name);
+  sema_up (&done);
+}
+
+/* Names the work that ran, and notes when. */
+static void
+say_early (void *name)
+{
+  early_ran = timer_ticks ();
+  say (name);
+}
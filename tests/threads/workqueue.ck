@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(workqueue) begin
+(workqueue) Opening the gate.
+(workqueue) Running high work.
+(workqueue) Running normal work.
+(workqueue) Running low work.
+(workqueue) Running early work.
+(workqueue) Running late work.
+(workqueue) Delayed work ran on time.
+(workqueue) end
+EOF
+pass;
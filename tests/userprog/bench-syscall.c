@@ -0,0 +1,47 @@
+/* Times the round trip through the kernel of the null system
+   call, getpid(), entering with "int $0x30" and, if the CPU
+   supports it, with SYSENTER. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CALLS 1000              /* Calls timed per entry method. */
+
+/* Returns the time stamp counter. */
+static uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Returns the average cycles per call of getpid(). */
+static uint64_t
+time_getpid (void)
+{
+  uint64_t start = rdtsc ();
+  int i;
+
+  for (i = 0; i < CALLS; i++)
+    getpid ();
+  return (rdtsc () - start) / CALLS;
+}
+
+void
+test_main (void)
+{
+  int sysenter = syscall_use_sysenter;
+
+  syscall_use_sysenter = 0;
+  msg ("int $0x30: %llu cycles/call", time_getpid ());
+  if (sysenter)
+    {
+      syscall_use_sysenter = 1;
+      msg ("sysenter: %llu cycles/call", time_getpid ());
+    }
+  else
+    msg ("sysenter: not supported by CPU");
+}
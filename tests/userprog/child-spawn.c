@@ -0,0 +1,24 @@
+/* Child process run by the spawn-fds test, with descriptor 1
+   redirected to a file, 4 a copy of the parent's descriptor for
+   "sample.txt", and 5 closed by an action after being copied.
+   Reports what it finds to descriptor 1. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+
+const char *test_name = "child-spawn";
+
+int
+main (void)
+{
+  char buf[sizeof sample - 1];
+
+  if (read (4, buf, sizeof buf) == sizeof buf
+      && !memcmp (buf, sample, sizeof buf))
+    msg ("fd 4 reads \"sample.txt\"");
+  if (dup2 (5, 6) == -1)
+    msg ("fd 5 is closed");
+  return 0;
+}
@@ -0,0 +1,35 @@
+/* Exercises the futex system calls and the user mutex within a
+   single thread: waiting on a word that no longer holds the
+   expected value must return at once, waking a word nobody
+   sleeps on must wake nobody, and a held mutex must refuse a
+   second acquisition until it is released. */
+
+#include <synch.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  static int word = 5;
+  struct mutex m;
+  struct condvar cv;
+
+  CHECK (futex_wait (&word, 4) == -1, "futex_wait on changed word");
+  CHECK (futex_wake (&word, 1) == 0, "futex_wake with no waiters");
+
+  mutex_init (&m);
+  CHECK (mutex_trylock (&m), "mutex_trylock on free mutex");
+  CHECK (!mutex_trylock (&m), "mutex_trylock on held mutex");
+  mutex_unlock (&m);
+  mutex_lock (&m);
+  msg ("mutex_lock after unlock");
+  mutex_unlock (&m);
+  CHECK (m.state == 0, "mutex free after unlock");
+
+  condvar_init (&cv);
+  condvar_signal (&cv);
+  condvar_broadcast (&cv);
+  msg ("signaled condvar with no waiters");
+}
@@ -0,0 +1,86 @@
+/* Checks getrusage().  Before any child is waited for, the
+   children's usage is all zero.  The process's own usage never
+   goes down.  Spinning in user mode adds user ticks, and writing
+   a file and syncing it adds sector writes and context switches.
+   An unknown WHO fails. */
+
+#include <rusage.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Most rounds of spinning to wait for a timer tick. */
+#define SPIN_ROUNDS 100000
+
+static char buf[16384];
+
+/* Gets the process's own usage into *RU. */
+static void
+get_self (struct rusage *ru)
+{
+  if (getrusage (RUSAGE_SELF, ru) != 0)
+    fail ("getrusage(RUSAGE_SELF) failed");
+}
+
+/* Fails unless no counter in NEW is below its value in OLD. */
+static void
+check_monotonic (const struct rusage *old, const struct rusage *new)
+{
+  if (new->user_ticks < old->user_ticks
+      || new->kernel_ticks < old->kernel_ticks
+      || new->minor_faults < old->minor_faults
+      || new->major_faults < old->major_faults
+      || new->block_reads < old->block_reads
+      || new->block_writes < old->block_writes
+      || new->switches < old->switches
+      || new->max_resident < old->max_resident)
+    fail ("a counter went down");
+}
+
+void
+test_main (void)
+{
+  static const struct rusage zero;
+  struct rusage start, spun, synced, children;
+  volatile int sink = 0;
+  int fd, i, j;
+
+  CHECK (getrusage (RUSAGE_CHILDREN, &children) == 0,
+         "getrusage(RUSAGE_CHILDREN)");
+  if (memcmp (&children, &zero, sizeof zero))
+    fail ("children's usage is not zero before any wait()");
+  CHECK (getrusage (12345, &children) == -1, "getrusage(12345)");
+
+  /* Spin until a timer tick lands in user mode. */
+  get_self (&start);
+  for (i = 0; i < SPIN_ROUNDS; i++)
+    {
+      for (j = 0; j < 10000; j++)
+        sink += j;
+      get_self (&spun);
+      check_monotonic (&start, &spun);
+      if (spun.user_ticks > start.user_ticks)
+        break;
+    }
+  if (i == SPIN_ROUNDS)
+    fail ("user ticks did not increase while spinning");
+  msg ("user ticks increased while spinning");
+
+  CHECK (create ("data", sizeof buf), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+  memset (buf, 0x5a, sizeof buf);
+  if (write (fd, buf, sizeof buf) != sizeof buf)
+    fail ("write \"data\" failed");
+  CHECK (fsync (fd) == 0, "fsync \"data\"");
+  msg ("close \"data\"");
+  close (fd);
+
+  get_self (&synced);
+  check_monotonic (&spun, &synced);
+  if (synced.block_writes == spun.block_writes)
+    fail ("sector writes did not increase after fsync()");
+  if (synced.switches == spun.switches)
+    fail ("context switches did not increase after fsync()");
+  msg ("sector writes and context switches increased");
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rusage-basic) begin
+(rusage-basic) getrusage(RUSAGE_CHILDREN)
+(rusage-basic) getrusage(12345)
+(rusage-basic) user ticks increased while spinning
+(rusage-basic) create "data"
+(rusage-basic) open "data"
+(rusage-basic) fsync "data"
+(rusage-basic) close "data"
+(rusage-basic) sector writes and context switches increased
+(rusage-basic) end
+rusage-basic: exit(0)
+EOF
+pass;
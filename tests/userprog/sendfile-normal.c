@@ -0,0 +1,36 @@
+/* Copies "sample.txt" into a new file with sendfile() in two
+   halves, at an explicit offset, which must advance while the
+   input file's position stays put, and verifies the copy. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  unsigned size = sizeof sample - 1;
+  unsigned ofs = 0;
+  int in_fd, out_fd;
+
+  CHECK (create ("copy.txt", 0), "create \"copy.txt\"");
+  CHECK ((in_fd = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((out_fd = open ("copy.txt")) > 1, "open \"copy.txt\"");
+
+  if (sendfile (out_fd, in_fd, &ofs, size / 2) != (int) (size / 2))
+    fail ("sendfile() of first half failed");
+  if (ofs != size / 2)
+    fail ("offset is %u after first half, not %u", ofs, size / 2);
+  if (sendfile (out_fd, in_fd, &ofs, size) != (int) (size - size / 2))
+    fail ("sendfile() of second half failed");
+  if (ofs != size)
+    fail ("offset is %u after second half, not %u", ofs, size);
+  if (tell (in_fd) != 0)
+    fail ("input position moved to %u", tell (in_fd));
+  msg ("copied %u bytes", ofs);
+
+  close (in_fd);
+  close (out_fd);
+  check_file ("copy.txt", sample, size);
+}
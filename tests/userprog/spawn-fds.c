@@ -0,0 +1,45 @@
+/* Spawns a child with file descriptor actions that redirect its
+   descriptor 1 to a file, copy a descriptor of the parent's to
+   4 and to 5, and then close 5.  The child reports what it finds
+   to the file, which is then checked. */
+
+#include <spawn.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static const char expected[] =
+  "(child-spawn) fd 4 reads \"sample.txt\"\n"
+  "(child-spawn) fd 5 is closed\n";
+
+void
+test_main (void)
+{
+  char *argv[] = {(char *) "child-spawn", NULL};
+  struct spawn_action actions[5];
+  int in_fd, out_fd;
+  pid_t pid;
+
+  CHECK (create ("out.txt", 0), "create \"out.txt\"");
+  CHECK ((out_fd = open ("out.txt")) > 1, "open \"out.txt\"");
+  CHECK ((in_fd = open ("sample.txt")) > 1, "open \"sample.txt\"");
+
+  actions[0] = (struct spawn_action) {SPAWN_DUP2, out_fd, 1};
+  actions[1] = (struct spawn_action) {SPAWN_DUP2, in_fd, 4};
+  actions[2] = (struct spawn_action) {SPAWN_DUP2, in_fd, 5};
+  actions[3] = (struct spawn_action) {SPAWN_CLOSE, 0, 5};
+  actions[4] = (struct spawn_action) {SPAWN_END, 0, 0};
+  CHECK ((pid = spawn ("child-spawn", argv, actions, 0)) != PID_ERROR,
+         "spawn \"child-spawn\"");
+  CHECK (spawn_status (pid) == 1, "spawn_status");
+  CHECK (wait (pid) == 0, "wait for child");
+
+  if (tell (in_fd) != 0)
+    fail ("parent's position in \"sample.txt\" moved to %u", tell (in_fd));
+  msg ("close \"sample.txt\"");
+  close (in_fd);
+  msg ("close \"out.txt\"");
+  close (out_fd);
+  check_file ("out.txt", expected, sizeof expected - 1);
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(spawn-fds) begin
+(spawn-fds) create "out.txt"
+(spawn-fds) open "out.txt"
+(spawn-fds) open "sample.txt"
+(spawn-fds) spawn "child-spawn"
+(spawn-fds) spawn_status
+(spawn-fds) wait for child
+(spawn-fds) close "sample.txt"
+(spawn-fds) close "out.txt"
+(spawn-fds) open "out.txt" for verification
+(spawn-fds) verified contents of "out.txt"
+(spawn-fds) close "out.txt"
+(spawn-fds) end
+EOF
+pass;
@@ -0,0 +1,45 @@
+/* Checks spawn() with SPAWN_NOWAIT, which returns before the
+   child loads, and spawn_status(), which waits for the load and
+   tells how it went: for a program that loads, for one that is
+   missing, and for a pid that is not a child.  Without
+   SPAWN_NOWAIT, spawning a missing program and giving an invalid
+   action must fail at once. */
+
+#include <spawn.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  char *argv[] = {(char *) "child-simple", NULL};
+  static const struct spawn_action bad_actions[] =
+    {
+      {99, 0, 3},
+      {SPAWN_END, 0, 0},
+    };
+  int loaded, status;
+  pid_t pid;
+
+  /* Output while a child runs would be interleaved with its own. */
+  pid = spawn ("child-simple", argv, NULL, SPAWN_NOWAIT);
+  if (pid == PID_ERROR)
+    fail ("spawn \"child-simple\" failed");
+  loaded = spawn_status (pid);
+  status = wait (pid);
+  msg ("child-simple: spawn_status %d, wait %d", loaded, status);
+
+  pid = spawn ("no-such-file", argv, NULL, SPAWN_NOWAIT);
+  if (pid == PID_ERROR)
+    fail ("spawn \"no-such-file\" without waiting failed");
+  loaded = spawn_status (pid);
+  status = wait (pid);
+  msg ("no-such-file: spawn_status %d, wait %d", loaded, status);
+  msg ("spawn_status again: %d", spawn_status (pid));
+
+  msg ("spawn \"no-such-file\": %d",
+       spawn ("no-such-file", argv, NULL, 0));
+  msg ("spawn with a bad action: %d",
+       spawn ("child-simple", argv, bad_actions, 0));
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(spawn-nowait) begin
+(child-simple) run
+(spawn-nowait) child-simple: spawn_status 1, wait 81
+load: no-such-file: open failed
+(spawn-nowait) no-such-file: spawn_status 0, wait -1
+(spawn-nowait) spawn_status again: -1
+load: no-such-file: open failed
+(spawn-nowait) spawn "no-such-file": -1
+(spawn-nowait) spawn with a bad action: -1
+(spawn-nowait) end
+EOF
+pass;
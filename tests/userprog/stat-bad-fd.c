@@ -0,0 +1,20 @@
+/* Tries to fstat() invalid fds, which must either fail with -1
+   or terminate the process with exit code -1. */
+
+#include <limits.h>
+#include <stat.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  static const int fds[] = {0x20101234, 5, 1234, -1, -1024, INT_MIN, INT_MAX};
+  struct stat st;
+  size_t i;
+
+  for (i = 0; i < sizeof fds / sizeof *fds; i++)
+    if (fstat (fds[i], &st) != -1)
+      fail ("fstat(%d) succeeded", fds[i]);
+}
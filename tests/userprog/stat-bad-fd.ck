@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF', <<'EOF']);
+(stat-bad-fd) begin
+(stat-bad-fd) end
+stat-bad-fd: exit(0)
+EOF
+(stat-bad-fd) begin
+stat-bad-fd: exit(-1)
+EOF
+pass;
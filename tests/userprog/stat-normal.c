@@ -0,0 +1,52 @@
+/* Checks stat() and fstat() on "sample.txt" and on a new
+   directory.  Both calls must agree, give the file's size, and
+   tell the directory from the file.  stat() of a missing file
+   must fail. */
+
+#include <stat.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Checks that stat() and fstat() of NAME agree, and returns what
+   they found in *ST. */
+static void
+check_stat (const char *name, struct stat *st)
+{
+  struct stat fst;
+  int fd;
+
+  CHECK (stat (name, st) == 0, "stat \"%s\"", name);
+  CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+  CHECK (fstat (fd, &fst) == 0, "fstat \"%s\"", name);
+  if (fst.inumber != st->inumber || fst.is_dir != st->is_dir
+      || fst.size != st->size || fst.blocks != st->blocks)
+    fail ("stat() and fstat() of \"%s\" disagree", name);
+  if (st->inumber != inumber (fd))
+    fail ("inode number of \"%s\" is %d, not %d",
+          name, st->inumber, inumber (fd));
+  close (fd);
+}
+
+void
+test_main (void)
+{
+  struct stat st;
+
+  check_stat ("sample.txt", &st);
+  if (st.is_dir)
+    fail ("\"sample.txt\" is a directory");
+  if (st.size != sizeof sample - 1)
+    fail ("\"sample.txt\" is %d bytes, not %d", st.size,
+          (int) sizeof sample - 1);
+  msg ("\"sample.txt\" is a %d-byte file", st.size);
+
+  CHECK (mkdir ("dir"), "mkdir \"dir\"");
+  check_stat ("dir", &st);
+  if (!st.is_dir)
+    fail ("\"dir\" is not a directory");
+  msg ("\"dir\" is a directory");
+
+  CHECK (stat ("no-such-file", &st) == -1, "stat \"no-such-file\"");
+}
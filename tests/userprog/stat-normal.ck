@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(stat-normal) begin
+(stat-normal) stat "sample.txt"
+(stat-normal) open "sample.txt"
+(stat-normal) fstat "sample.txt"
+(stat-normal) "sample.txt" is a 239-byte file
+(stat-normal) mkdir "dir"
+(stat-normal) stat "dir"
+(stat-normal) open "dir"
+(stat-normal) fstat "dir"
+(stat-normal) "dir" is a directory
+(stat-normal) stat "no-such-file"
+(stat-normal) end
+stat-normal: exit(0)
+EOF
+pass;
@@ -0,0 +1,34 @@
+/* Writes to a file through a buffered FILE and checks that the
+   output only reaches the file when it is flushed. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  static const char text[] = "buffered line\n";
+  char buf[sizeof text];
+  FILE *f;
+  int fd;
+
+  CHECK (create ("out", sizeof text), "create \"out\"");
+  CHECK ((fd = open ("out")) > 1, "open \"out\"");
+  CHECK ((f = fdopen (open ("out"))) != NULL, "fdopen \"out\"");
+
+  fputs (text, f);
+  CHECK (read (fd, buf, sizeof text - 1) == sizeof text - 1, "read \"out\"");
+  CHECK (buf[0] == '\0', "nothing written before fflush");
+
+  CHECK (fflush (f) == 0, "fflush");
+  seek (fd, 0);
+  read (fd, buf, sizeof text - 1);
+  buf[sizeof text - 1] = '\0';
+  CHECK (!strcmp (buf, text), "text written by fflush");
+
+  CHECK (fclose (f) == 0, "fclose");
+  close (fd);
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(stdio-buffered) begin
+(stdio-buffered) create "out"
+(stdio-buffered) open "out"
+(stdio-buffered) fdopen "out"
+(stdio-buffered) read "out"
+(stdio-buffered) nothing written before fflush
+(stdio-buffered) fflush
+(stdio-buffered) text written by fflush
+(stdio-buffered) fclose
+(stdio-buffered) end
+stdio-buffered: exit(0)
+EOF
+pass;
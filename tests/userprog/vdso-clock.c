@@ -0,0 +1,31 @@
+/* Reads the kernel's clock from the page it shares with every
+   process: the tick count must advance on its own, without any
+   system call, and the nanosecond clock must never go back. */
+
+#include <clock.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  int64_t start = clock_ticks ();
+  uint64_t ns = clock_ns ();
+  int i;
+
+  CHECK (clock_ticks_per_sec () > 0, "clock_ticks_per_sec is set");
+  CHECK (clock_tsc_hz () > 0, "clock_tsc_hz is set");
+
+  while (clock_ticks () < start + 2)
+    continue;
+  msg ("clock_ticks advanced");
+
+  for (i = 0; i < 1000; i++)
+    {
+      uint64_t now = clock_ns ();
+      if (now < ns)
+        fail ("clock_ns went back");
+      ns = now;
+    }
+  msg ("clock_ns is monotonic");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(vdso-clock) begin
+(vdso-clock) clock_ticks_per_sec is set
+(vdso-clock) clock_tsc_hz is set
+(vdso-clock) clock_ticks advanced
+(vdso-clock) clock_ns is monotonic
+(vdso-clock) end
+vdso-clock: exit(0)
+EOF
+pass;
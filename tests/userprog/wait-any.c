@@ -0,0 +1,42 @@
+/* Runs several children at once, waits for the first with
+   wait() and for the others with waitany(), which must return
+   each of them exactly once with its exit code, and then -1. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_CNT 3
+
+void
+test_main (void) 
+{
+  pid_t children[CHILD_CNT];
+  int i, status;
+
+  for (i = 0; i < CHILD_CNT; i++)
+    if ((children[i] = exec ("child-simple")) == PID_ERROR)
+      fail ("exec(\"child-simple\") failed");
+
+  /* Output until every child is reaped would be interleaved with
+     the children's. */
+  status = wait (children[0]);
+  if (status != 81)
+    fail ("wait() returned exit code %d", status);
+  for (i = 1; i < CHILD_CNT; i++)
+    {
+      pid_t pid = waitany (&status);
+      int j;
+
+      for (j = 1; j < CHILD_CNT; j++)
+        if (children[j] == pid)
+          break;
+      if (j == CHILD_CNT)
+        fail ("waitany() returned pid %d, not an unreaped child", pid);
+      if (status != 81)
+        fail ("waitany() returned exit code %d", status);
+      children[j] = PID_ERROR;
+    }
+  msg ("reaped %d children", CHILD_CNT);
+  msg ("waitany() = %d", waitany (&status));
+}
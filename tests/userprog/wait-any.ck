@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(wait-any) begin
+(child-simple) run
+(child-simple) run
+(child-simple) run
+(wait-any) reaped 3 children
+(wait-any) waitany() = -1
+(wait-any) end
+EOF
+pass;
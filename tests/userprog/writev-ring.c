@@ -0,0 +1,45 @@
+/* Writes to the console with writev() and through an I/O ring,
+   checking the byte counts reported back. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* An address not otherwise used by the test. */
+#define RING_ADDR ((struct io_ring *) 0x10000000)
+
+void
+test_main (void)
+{
+  static char one[] = "(writev-ring) writev: one ";
+  static char two[] = "two\n";
+  static char *lines[] = {"(writev-ring) ring: one\n",
+                          "(writev-ring) ring: two\n"};
+  struct iovec iov[2] = {{one, sizeof one - 1}, {two, sizeof two - 1}};
+  struct io_ring *ring = RING_ADDR;
+  unsigned i;
+
+  CHECK (writev (STDOUT_FILENO, iov, 2) == (int) (strlen (one) + strlen (two)),
+         "writev");
+
+  CHECK (io_ring_setup (ring), "io_ring_setup");
+  for (i = 0; i < 2; i++)
+    {
+      struct io_ring_sqe *sqe = &ring->sq[ring->sq_tail++ % IO_RING_ENTRIES];
+      sqe->op = IO_RING_WRITE;
+      sqe->fd = STDOUT_FILENO;
+      sqe->buf = lines[i];
+      sqe->len = strlen (lines[i]);
+      sqe->user_data = i;
+    }
+  CHECK (io_ring_enter () == 2, "io_ring_enter");
+
+  for (i = 0; i < 2; i++)
+    {
+      struct io_ring_cqe *cqe = &ring->cq[ring->cq_head++ % IO_RING_ENTRIES];
+      if (cqe->user_data != i || cqe->res != (int) strlen (lines[i]))
+        fail ("bad completion %u", i);
+    }
+}
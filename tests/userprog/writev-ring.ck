@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(writev-ring) begin
+(writev-ring) writev
+(writev-ring) writev: one two
+(writev-ring) io_ring_setup
+(writev-ring) io_ring_enter
+(writev-ring) ring: one
+(writev-ring) ring: two
+(writev-ring) end
+writev-ring: exit(0)
+EOF
+pass;
@@ -0,0 +1,29 @@
+/* Child process for shm-share test.
+   Maps the segment named by argv[1], checks the parent's data,
+   and overwrites it. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SHM_SIZE (3 * 4096)
+
+const char *test_name = "child-shm";
+
+int
+main (int argc UNUSED, char *argv[])
+{
+  char *actual = (char *) 0x10000000;
+  size_t i;
+
+  quiet = true;
+  CHECK (shm_map (atoi (argv[1]), actual) != MAP_FAILED, "shm_map");
+  for (i = 0; i < SHM_SIZE; i++)
+    if (actual[i] != (char) (i % 251))
+      fail ("parent's write not seen at byte %zu", i);
+  for (i = 0; i < SHM_SIZE; i++)
+    actual[i] = i % 13;
+  return 0;
+}
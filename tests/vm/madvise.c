@@ -0,0 +1,40 @@
+/* Gives each kind of advice about a file mapping and the file
+   itself, and checks that the data read afterward is unchanged. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  char *actual = (char *) 0x10000000;
+  char buf[sizeof sample];
+  int handle;
+  mapid_t map;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, actual)) != MAP_FAILED, "mmap \"sample.txt\"");
+
+  CHECK (madvise (actual, 4096, ADV_WILLNEED) == 0, "madvise willneed");
+  CHECK (madvise (actual, 4096, ADV_SEQUENTIAL) == 0, "madvise sequential");
+  if (memcmp (actual, sample, strlen (sample)))
+    fail ("read of mmap'd file reported bad data");
+  CHECK (madvise (actual, 4096, ADV_DONTNEED) == 0, "madvise dontneed");
+  if (memcmp (actual, sample, strlen (sample)))
+    fail ("read of dropped mapping reported bad data");
+  CHECK (madvise (actual + 1, 4096, ADV_RANDOM) == -1,
+         "madvise misaligned address fails");
+  munmap (map);
+
+  CHECK (fadvise (handle, 0, 0, ADV_SEQUENTIAL) == 0, "fadvise sequential");
+  CHECK (fadvise (handle, 0, 0, ADV_WILLNEED) == 0, "fadvise willneed");
+  CHECK (read (handle, buf, strlen (sample)) == (int) strlen (sample),
+         "read \"sample.txt\"");
+  if (memcmp (buf, sample, strlen (sample)))
+    fail ("read of file reported bad data");
+  CHECK (fadvise (handle, 0, 0, ADV_DONTNEED) == 0, "fadvise dontneed");
+  close (handle);
+}
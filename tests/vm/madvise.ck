@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(madvise) begin
+(madvise) open "sample.txt"
+(madvise) mmap "sample.txt"
+(madvise) madvise willneed
+(madvise) madvise sequential
+(madvise) madvise dontneed
+(madvise) madvise misaligned address fails
+(madvise) fadvise sequential
+(madvise) fadvise willneed
+(madvise) read "sample.txt"
+(madvise) fadvise dontneed
+(madvise) end
+EOF
+pass;
@@ -0,0 +1,47 @@
+/* Maps a file twice and checks that a write through either
+   mapping shows up in the other, and in read() of the file, and
+   that write() to the file shows up in both mappings, all without
+   unmapping the file in between. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  char *actual[2] = {(char *) 0x10000000, (char *) 0x20000000};
+  static const char overwrite[] = "Coherent";
+  size_t size = strlen (sample);
+  char buf[1024];
+  int handle;
+  size_t i;
+
+  CHECK (create ("sample.txt", size), "create \"sample.txt\"");
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  for (i = 0; i < 2; i++)
+    CHECK (mmap (handle, actual[i]) != MAP_FAILED,
+           "mmap \"sample.txt\" #%zu at %p", i, (void *) actual[i]);
+
+  /* Write through one mapping, read through the other. */
+  memcpy (actual[0], sample, size);
+  CHECK (!memcmp (actual[1], sample, size),
+         "compare mapping #1 against data written to mapping #0");
+  CHECK (read (handle, buf, size) == (int) size, "read \"sample.txt\"");
+  CHECK (!memcmp (buf, sample, size),
+         "compare read data against data written to mapping #0");
+
+  /* Write to the file, read through both mappings. */
+  seek (handle, 0);
+  CHECK (write (handle, overwrite, strlen (overwrite))
+         == (int) strlen (overwrite), "write \"sample.txt\"");
+  for (i = 0; i < 2; i++)
+    CHECK (!memcmp (actual[i], overwrite, strlen (overwrite))
+           && !memcmp (actual[i] + strlen (overwrite),
+                       sample + strlen (overwrite),
+                       size - strlen (overwrite)),
+           "compare mapping #%zu against written data", i);
+  close (handle);
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-coherent) begin
+(mmap-coherent) create "sample.txt"
+(mmap-coherent) open "sample.txt"
+(mmap-coherent) mmap "sample.txt" #0 at 0x10000000
+(mmap-coherent) mmap "sample.txt" #1 at 0x20000000
+(mmap-coherent) compare mapping #1 against data written to mapping #0
+(mmap-coherent) read "sample.txt"
+(mmap-coherent) compare read data against data written to mapping #0
+(mmap-coherent) write "sample.txt"
+(mmap-coherent) compare mapping #0 against written data
+(mmap-coherent) compare mapping #1 against written data
+(mmap-coherent) end
+EOF
+pass;
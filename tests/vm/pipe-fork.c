@@ -0,0 +1,89 @@
+/* Passes data through a pipe within the process, from a forked
+   writer, whose whole pages the reader may receive without a
+   copy, and from a child run with exec() whose standard output
+   is redirected to the pipe. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define DATA_SIZE (3 * 4096 + 100)
+
+static char data[DATA_SIZE];
+static char page[4096] __attribute__ ((aligned (4096)));
+
+/* Reads FD until end of file into BUF, which has room for SIZE
+   bytes, a page at a time, and returns the number of bytes
+   read. */
+static int
+read_all (int fd, char *buf, int size)
+{
+  int total = 0;
+  int n;
+
+  while ((n = read (fd, page, sizeof page)) > 0)
+    {
+      if (total + n > size)
+        fail ("read %d bytes, more than the %d written", total + n, size);
+      memcpy (buf + total, page, n);
+      total += n;
+    }
+  return total;
+}
+
+void
+test_main (void)
+{
+  static char buf[DATA_SIZE];
+  const char *expected = "(child-simple) run\n";
+  int fds[2];
+  pid_t pid;
+  size_t i;
+
+  CHECK (pipe (fds) == 0, "pipe");
+  CHECK (write (fds[1], "hello", 5) == 5, "write to pipe");
+  CHECK (read (fds[0], buf, sizeof buf) == 5 && !memcmp (buf, "hello", 5),
+         "read back from pipe");
+
+  /* Nothing is printed until the writer is waited for, so that
+     its exit message comes out in order. */
+  for (i = 0; i < DATA_SIZE; i++)
+    data[i] = i % 251;
+  pid = fork ();
+  if (pid == 0)
+    {
+      close (fds[0]);
+      exit (write (fds[1], data, DATA_SIZE) == DATA_SIZE ? 0 : 1);
+    }
+  if (pid == PID_ERROR)
+    fail ("fork");
+  close (fds[1]);
+  if (read_all (fds[0], buf, DATA_SIZE) != DATA_SIZE
+      || memcmp (buf, data, DATA_SIZE))
+    fail ("data from forked writer differs");
+  close (fds[0]);
+  CHECK (wait (pid) == 0, "wait for forked writer");
+  msg ("read all data from forked writer");
+
+  CHECK (pipe (fds) == 0, "pipe");
+  pid = fork ();
+  if (pid == 0)
+    {
+      dup2 (fds[1], STDOUT_FILENO);
+      close (fds[0]);
+      close (fds[1]);
+      exit (wait (exec ("child-simple")));
+    }
+  if (pid == PID_ERROR)
+    fail ("fork");
+  close (fds[1]);
+  memset (buf, 0, sizeof buf);
+  if (read_all (fds[0], buf, DATA_SIZE) != (int) strlen (expected)
+      || strcmp (buf, expected))
+    fail ("redirected output differs");
+  close (fds[0]);
+  CHECK (wait (pid) == 81, "wait for redirected child");
+  msg ("read output of redirected child");
+}
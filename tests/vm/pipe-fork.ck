@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pipe-fork) begin
+(pipe-fork) pipe
+(pipe-fork) write to pipe
+(pipe-fork) read back from pipe
+pipe-fork: exit(0)
+(pipe-fork) wait for forked writer
+(pipe-fork) read all data from forked writer
+(pipe-fork) pipe
+child-simple: exit(81)
+pipe-fork: exit(81)
+(pipe-fork) wait for redirected child
+(pipe-fork) read output of redirected child
+(pipe-fork) end
+pipe-fork: exit(0)
+EOF
+pass;
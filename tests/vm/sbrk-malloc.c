@@ -0,0 +1,58 @@
+/* Grows and shrinks the heap with sbrk(), then checks that blocks
+   from malloc() of small and large sizes keep their contents, and
+   that realloc() carries them over. */
+
+#include <malloc.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BLOCK_CNT 256
+#define LARGE_SIZE (100 * 1024)
+
+void
+test_main (void)
+{
+  static unsigned char *blocks[BLOCK_CNT];
+  unsigned char *brk, *large;
+  size_t i, j;
+
+  brk = sbrk (0);
+  CHECK (sbrk (8192) == brk, "sbrk grows the heap");
+  memset (brk, 0x5a, 8192);
+  CHECK (sbrk (-8192) == brk + 8192, "sbrk shrinks the heap");
+  CHECK (sbrk (0) == brk, "break is back where it was");
+  CHECK (sbrk (-(intptr_t) 0x10000000) == SBRK_FAILED,
+         "sbrk refuses to shrink past the start");
+
+  for (i = 0; i < BLOCK_CNT; i++)
+    {
+      size_t size = 1 + i * 7 % 1500;
+
+      blocks[i] = malloc (size);
+      if (blocks[i] == NULL)
+        fail ("malloc of %zu bytes failed", size);
+      memset (blocks[i], i, size);
+    }
+  for (i = 0; i < BLOCK_CNT; i++)
+    for (j = 0; j < 1 + i * 7 % 1500; j++)
+      if (blocks[i][j] != (unsigned char) i)
+        fail ("block %zu corrupted at byte %zu", i, j);
+  msg ("small blocks keep their contents");
+
+  large = malloc (LARGE_SIZE);
+  CHECK (large != NULL, "malloc large block");
+  memset (large, 0xa5, LARGE_SIZE);
+  large = realloc (large, 2 * LARGE_SIZE);
+  CHECK (large != NULL, "realloc large block");
+  for (j = 0; j < LARGE_SIZE; j++)
+    if (large[j] != 0xa5)
+      fail ("realloc lost byte %zu", j);
+  msg ("realloc keeps the contents");
+
+  for (i = 0; i < BLOCK_CNT; i++)
+    free (blocks[i]);
+  free (large);
+  msg ("freed all blocks");
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sbrk-malloc) begin
+(sbrk-malloc) sbrk grows the heap
+(sbrk-malloc) sbrk shrinks the heap
+(sbrk-malloc) break is back where it was
+(sbrk-malloc) sbrk refuses to shrink past the start
+(sbrk-malloc) small blocks keep their contents
+(sbrk-malloc) malloc large block
+(sbrk-malloc) realloc large block
+(sbrk-malloc) realloc keeps the contents
+(sbrk-malloc) freed all blocks
+(sbrk-malloc) end
+sbrk-malloc: exit(0)
+EOF
+pass;
@@ -0,0 +1,46 @@
+/* Creates a shared memory segment, writes to it, and runs
+   child-shm, which maps the same segment, checks the data, and
+   writes its own.  The parent must see the child's writes, and
+   the segment must outlive the child's mapping. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SHM_SIZE (3 * 4096)
+
+void
+test_main (void)
+{
+  char *actual = (char *) 0x54321000;
+  char cmd[32];
+  size_t i;
+  int id;
+  mapid_t map;
+
+  CHECK ((id = shm_create (SHM_SIZE)) != -1, "shm_create");
+  CHECK ((map = shm_map (id, actual)) != MAP_FAILED, "shm_map");
+  for (i = 0; i < SHM_SIZE; i++)
+    if (actual[i] != 0)
+      fail ("new segment not zeroed at byte %zu", i);
+  for (i = 0; i < SHM_SIZE; i++)
+    actual[i] = i % 251;
+
+  snprintf (cmd, sizeof cmd, "child-shm %d", id);
+  CHECK (wait (exec (cmd)) == 0, "wait for child-shm");
+
+  for (i = 0; i < SHM_SIZE; i++)
+    if (actual[i] != (char) (i % 13))
+      fail ("child's write not seen at byte %zu", i);
+  msg ("child's writes are shared");
+
+  shm_unmap (map);
+  CHECK (shm_map (id, actual) != MAP_FAILED, "shm_map again");
+  CHECK (actual[1] == 1, "segment kept its contents");
+  CHECK (shm_map (id + 1, actual + SHM_SIZE) == MAP_FAILED,
+         "shm_map of unknown segment fails");
+  CHECK (shm_map (id, actual) == MAP_FAILED,
+         "shm_map over a mapping fails");
+}
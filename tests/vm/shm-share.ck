@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(shm-share) begin
+(shm-share) shm_create
+(shm-share) shm_map
+child-shm: exit(0)
+(shm-share) wait for child-shm
+(shm-share) child's writes are shared
+(shm-share) shm_map again
+(shm-share) segment kept its contents
+(shm-share) shm_map of unknown segment fails
+(shm-share) shm_map over a mapping fails
+(shm-share) end
+shm-share: exit(0)
+EOF
+pass;
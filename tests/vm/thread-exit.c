@@ -0,0 +1,87 @@
+/* Has the first thread exit while the other threads of the process
+   are asleep on a mutex, asleep joining a thread, spinning, and
+   waiting to read an empty pipe.
+   The process must end with them, rather than wait forever for
+   them to exit on their own. */
+
+#include <pthread.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define THREAD_CNT 4
+
+static pthread_mutex_t mutex;
+static int fds[2];
+static volatile bool started[THREAD_CNT];
+static volatile bool stop;
+
+/* Sleeps on MUTEX, which the first thread never releases. */
+static void *
+sleeper (void *aux UNUSED)
+{
+  started[0] = true;
+  pthread_mutex_lock (&mutex);
+  fail ("sleeper acquired the mutex");
+  return NULL;
+}
+
+/* Joins the sleeper, which never returns. */
+static void *
+joiner (void *aux)
+{
+  started[1] = true;
+  pthread_join ((pthread_t) aux, NULL);
+  fail ("joiner joined the sleeper");
+  return NULL;
+}
+
+/* Spins in user mode without entering the kernel, since STOP is
+   never set. */
+static void *
+spinner (void *aux UNUSED)
+{
+  started[2] = true;
+  while (!stop)
+    continue;
+  fail ("spinner stopped");
+  return NULL;
+}
+
+/* Reads the pipe, whose write end the first thread keeps open
+   without writing to it. */
+static void *
+reader (void *aux UNUSED)
+{
+  char c;
+
+  started[3] = true;
+  read (fds[0], &c, 1);
+  fail ("reader read the pipe");
+  return NULL;
+}
+
+void
+test_main (void)
+{
+  pthread_t threads[THREAD_CNT];
+  int i;
+
+  pthread_mutex_init (&mutex, NULL);
+  pthread_mutex_lock (&mutex);
+  CHECK (pipe (fds) == 0, "pipe");
+  CHECK (pthread_create (&threads[0], sleeper, NULL) == 0,
+         "spawn sleeper");
+  CHECK (pthread_create (&threads[1], joiner, (void *) threads[0]) == 0,
+         "spawn joiner");
+  CHECK (pthread_create (&threads[2], spinner, NULL) == 0,
+         "spawn spinner");
+  CHECK (pthread_create (&threads[3], reader, NULL) == 0,
+         "spawn reader");
+
+  for (i = 0; i < THREAD_CNT; i++)
+    while (!started[i])
+      continue;
+  msg ("all threads started");
+  exit (57);
+}
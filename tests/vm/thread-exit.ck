@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(thread-exit) begin
+(thread-exit) pipe
+(thread-exit) spawn sleeper
+(thread-exit) spawn joiner
+(thread-exit) spawn spinner
+(thread-exit) spawn reader
+(thread-exit) all threads started
+thread-exit: exit(57)
+EOF
+pass;
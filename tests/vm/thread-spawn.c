@@ -0,0 +1,70 @@
+/* Spawns threads that share the process's memory: each checks in
+   through a condition variable, then adds to a shared counter
+   under a mutex and returns its own result.  The main thread
+   waits for all to check in, joins each, and checks the results
+   and the final count. */
+
+#include <pthread.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define THREAD_CNT 4
+#define ITER_CNT 1000
+
+static pthread_mutex_t mutex;
+static pthread_cond_t checked_in;
+static int arrived;
+static int counter;
+
+static void *
+worker (void *aux)
+{
+  int id = (int) aux;
+  int i;
+
+  pthread_mutex_lock (&mutex);
+  arrived++;
+  pthread_cond_signal (&checked_in);
+  pthread_mutex_unlock (&mutex);
+
+  for (i = 0; i < ITER_CNT; i++)
+    {
+      pthread_mutex_lock (&mutex);
+      counter++;
+      pthread_mutex_unlock (&mutex);
+    }
+  return (void *) (id + 100);
+}
+
+void
+test_main (void)
+{
+  pthread_t threads[THREAD_CNT];
+  int i;
+
+  pthread_mutex_init (&mutex, NULL);
+  pthread_cond_init (&checked_in, NULL);
+  for (i = 0; i < THREAD_CNT; i++)
+    CHECK (pthread_create (&threads[i], worker, (void *) i) == 0,
+           "spawn thread %d", i);
+
+  pthread_mutex_lock (&mutex);
+  while (arrived < THREAD_CNT)
+    pthread_cond_wait (&checked_in, &mutex);
+  pthread_mutex_unlock (&mutex);
+  msg ("all threads checked in");
+
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      void *result;
+
+      CHECK (pthread_join (threads[i], &result) == 0, "join thread %d", i);
+      if ((int) result != i + 100)
+        fail ("thread %d returned %d, not %d", i, (int) result, i + 100);
+    }
+  CHECK (pthread_join (threads[0], NULL) == -1, "join thread 0 again");
+  if (counter != THREAD_CNT * ITER_CNT)
+    fail ("counter is %d, not %d", counter, THREAD_CNT * ITER_CNT);
+  msg ("counter is %d", counter);
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(thread-spawn) begin
+(thread-spawn) spawn thread 0
+(thread-spawn) spawn thread 1
+(thread-spawn) spawn thread 2
+(thread-spawn) spawn thread 3
+(thread-spawn) all threads checked in
+(thread-spawn) join thread 0
+(thread-spawn) join thread 1
+(thread-spawn) join thread 2
+(thread-spawn) join thread 3
+(thread-spawn) join thread 0 again
+(thread-spawn) counter is 4000
+(thread-spawn) end
+thread-spawn: exit(0)
+EOF
+pass;
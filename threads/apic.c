@@ -0,0 +1,551 @@
+#include "threads/apic.h"
+#include <debug.h>
+#include <packed.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/loader.h"
+#include "threads/mmio.h"
+#include "threads/pte.h"
+#include "threads/vaddr.h"
+
+/* Local APIC and I/O APIC interrupt controllers.
+
+   Each CPU has a local APIC, which delivers interrupts to it,
+   takes the end of interrupt as a single memory-mapped write, and
+   has a timer of its own.  An I/O APIC takes the interrupt lines
+   of devices and routes each to a vector on the CPU named in its
+   redirection table entry.  See [IA32-v3a] chapter 10 "Advanced
+   Programmable Interrupt Controller (APIC)" and [82093AA].
+
+   The I/O APIC and the way ISA interrupt lines are wired to its
+   pins are found in the ACPI "APIC" table (MADT).  Each ISA IRQ
+   is routed to vector 0x20 + IRQ, just as the 8259A PICs deliver
+   it, so that the rest of the kernel need not care which
+   controller is in use. */
+
+/* Local APIC registers, as byte offsets. */
+#define LAPIC_ID        0x020   /* Local APIC ID, in bits 24...31. */
+#define LAPIC_TPR       0x080   /* Task priority. */
+#define LAPIC_EOI       0x0b0   /* End of interrupt. */
+#define LAPIC_SVR       0x0f0   /* Spurious interrupt vector. */
+#define LAPIC_IRR       0x200   /* Interrupt request, 8 words. */
+#define LAPIC_LVT_TIMER 0x320   /* Timer local vector table entry. */
+#define LAPIC_TIMER_INIT 0x380  /* Timer initial count. */
+#define LAPIC_TIMER_CUR 0x390   /* Timer current count. */
+#define LAPIC_TIMER_DIV 0x3e0   /* Timer divide configuration. */
+
+#define SVR_ENABLE    0x100     /* Software enable, in LAPIC_SVR. */
+#define LVT_MASKED    (1u << 16) /* Interrupt masked, in an LVT entry. */
+#define LVT_PERIODIC  (1u << 17) /* Periodic timer mode. */
+#define TIMER_DIV_16  0x3       /* Timer counts bus clocks / 16. */
+
+/* IA32_APIC_BASE model-specific register. */
+#define MSR_APIC_BASE 0x1b
+#define APIC_BASE_ENABLE (1u << 11) /* Global enable. */
+
+/* I/O APIC registers, reached through a select and a window
+   register. */
+#define IOAPIC_SEL    0x00      /* Register select, byte offset. */
+#define IOAPIC_WIN    0x10      /* Register window, byte offset. */
+#define IOAPIC_VER    0x01      /* Version, max entry in bits 16...23. */
+#define IOAPIC_REDTBL(PIN) (0x10 + 2 * (PIN)) /* Redirection entry. */
+
+#define RED_LOW_ACTIVE (1u << 13) /* Active low, in an entry's low word. */
+#define RED_LEVEL     (1u << 15) /* Level triggered. */
+#define RED_MASKED    (1u << 16) /* Interrupt masked. */
+
+/* Number of ISA interrupt lines, routed to vectors 0x20...0x2f. */
+#define ISA_IRQ_CNT 16
+
+/* Pin of an ISA IRQ that is not wired to the I/O APIC. */
+#define NO_PIN 0xff
+
+/* ACPI root system description pointer.  See [ACPI] 5.2.5. */
+struct rsdp
+  {
+    char signature[8];          /* "RSD PTR ". */
+    uint8_t checksum;           /* Bytes sum to 0. */
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_addr;         /* Physical address of the RSDT. */
+  }
+PACKED;
+
+/* ACPI system description table header.  See [ACPI] 5.2.6. */
+struct sdt_header
+  {
+    char signature[4];          /* "RSDT", "APIC", .... */
+    uint32_t length;            /* Bytes, including the header. */
+    uint8_t revision;
+    uint8_t checksum;           /* Bytes sum to 0. */
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+  }
+PACKED;
+
+/* Longest ACPI table believed. */
+#define TABLE_MAX 65536
+
+/* ACPI multiple APIC description table.  See [ACPI] 5.2.12. */
+struct madt
+  {
+    struct sdt_header header;
+    uint32_t lapic_addr;        /* Physical address of local APICs. */
+    uint32_t flags;
+    uint8_t entries[];          /* Interrupt controller structures. */
+  }
+PACKED;
+
+/* MADT entry types, each starting with its type and length. */
+#define MADT_LAPIC    0         /* Processor local APIC. */
+#define MADT_IOAPIC   1         /* I/O APIC. */
+#define MADT_OVERRIDE 2         /* Interrupt source override. */
+
+struct madt_lapic
+  {
+    uint8_t type, length;
+    uint8_t acpi_id;            /* ACPI processor ID. */
+    uint8_t apic_id;            /* Local APIC ID. */
+    uint32_t flags;             /* Bit 0: enabled. */
+  }
+PACKED;
+
+struct madt_ioapic
+  {
+    uint8_t type, length;
+    uint8_t ioapic_id;
+    uint8_t reserved;
+    uint32_t addr;              /* Physical address of registers. */
+    uint32_t gsi_base;          /* Interrupt of its pin 0. */
+  }
+PACKED;
+
+struct madt_override
+  {
+    uint8_t type, length;
+    uint8_t bus;                /* 0, for ISA. */
+    uint8_t source;             /* ISA IRQ. */
+    uint32_t gsi;               /* Interrupt it is wired to. */
+    uint16_t flags;             /* Polarity and trigger mode. */
+  }
+PACKED;
+
+/* If false, use the 8259A PICs even if an I/O APIC is present. */
+bool apic_enabled = true;
+
+/* Mapped registers, valid if active. */
+static bool active;
+static volatile uint32_t *lapic;
+static volatile uint32_t *ioapic;
+static int ioapic_pins;         /* Number of I/O APIC pins. */
+
+/* Local APIC IDs of the enabled CPUs, bootstrap CPU first. */
+static uint8_t cpu_apic_ids[APIC_CPU_MAX];
+static int cpu_cnt;
+
+/* How each ISA IRQ is wired to the I/O APIC. */
+struct isa_irq
+  {
+    uint8_t pin;                /* I/O APIC pin, or NO_PIN. */
+    uint32_t mode;              /* RED_LOW_ACTIVE, RED_LEVEL. */
+    int cpu;                    /* CPU it is routed to. */
+  };
+static struct isa_irq isa_irqs[ISA_IRQ_CNT];
+
+static bool cpu_has_apic (void);
+static uint32_t rdmsr (uint32_t msr);
+static void wrmsr (uint32_t msr, uint32_t value);
+static const void *map_phys (uintptr_t paddr, size_t size);
+static bool checksum_ok (const void *, size_t size);
+static const struct rsdp *find_rsdp (void);
+static const struct madt *find_madt (void);
+static bool parse_madt (const struct madt *, uintptr_t *ioapic_addr);
+static uint32_t lapic_read (int reg);
+static void lapic_write (int reg, uint32_t value);
+static uint32_t ioapic_read (int reg);
+static void ioapic_write (int reg, uint32_t value);
+static void write_route (int irq);
+
+/* Switches interrupt delivery from the 8259A PICs to the local
+   and I/O APICs, if the CPU has a local APIC, the ACPI tables
+   describe an I/O APIC, and "-no-apic" was not given.  Routes
+   every ISA IRQ to the bootstrap CPU at vector 0x20 + IRQ,
+   unmasked.  Returns true if successful, in which case the caller
+   must mask the PICs; otherwise, the PICs stay in use.  Must be
+   called after paging_init(), with interrupts off. */
+bool
+apic_init (void)
+{
+  const struct madt *madt;
+  uintptr_t ioapic_addr;
+  uint32_t base;
+  uint8_t boot_id;
+  int irq, pin, i;
+
+  if (!apic_enabled || !cpu_has_apic ())
+    return false;
+  madt = find_madt ();
+  if (madt == NULL || !parse_madt (madt, &ioapic_addr))
+    return false;
+
+  /* Enable the local APIC, if the BIOS left it disabled, and map
+     its registers and the I/O APIC's uncached. */
+  base = rdmsr (MSR_APIC_BASE);
+  if (!(base & APIC_BASE_ENABLE))
+    wrmsr (MSR_APIC_BASE, base | APIC_BASE_ENABLE);
+  lapic = mmio_map (base & PTE_ADDR, PGSIZE);
+  ioapic = mmio_map (ioapic_addr, IOAPIC_WIN + 4);
+  ioapic_pins = ((ioapic_read (IOAPIC_VER) >> 16) & 0xff) + 1;
+
+  /* Put the bootstrap CPU first among the CPUs. */
+  boot_id = lapic_read (LAPIC_ID) >> 24;
+  for (i = 0; i < cpu_cnt; i++)
+    if (cpu_apic_ids[i] == boot_id)
+      break;
+  if (i == cpu_cnt)
+    {
+      if (cpu_cnt == APIC_CPU_MAX)
+        cpu_cnt--;
+      i = cpu_cnt++;
+    }
+  cpu_apic_ids[i] = cpu_apic_ids[0];
+  cpu_apic_ids[0] = boot_id;
+
+  /* Mask every pin, then route the ISA IRQs. */
+  for (pin = 0; pin < ioapic_pins; pin++)
+    {
+      ioapic_write (IOAPIC_REDTBL (pin) + 1, 0);
+      ioapic_write (IOAPIC_REDTBL (pin), RED_MASKED);
+    }
+  active = true;
+  for (irq = 0; irq < ISA_IRQ_CNT; irq++)
+    if (isa_irqs[irq].pin < ioapic_pins)
+      {
+        write_route (irq);
+        apic_mask_irq (irq, false);
+      }
+
+  /* Accept every priority and enable the local APIC. */
+  lapic_write (LAPIC_TPR, 0);
+  lapic_write (LAPIC_SVR, SVR_ENABLE | APIC_SPURIOUS_VEC);
+
+  printf ("Interrupts: I/O APIC with %d pins, %d CPU%s.\n",
+          ioapic_pins, cpu_cnt, cpu_cnt == 1 ? "" : "s");
+  return true;
+}
+
+/* Returns true if apic_init() switched to the APICs. */
+bool
+apic_active (void)
+{
+  return active;
+}
+
+/* Signals the end of the interrupt being serviced to the local
+   APIC, with a single write that does not leave the CPU. */
+void
+apic_eoi (void)
+{
+  ASSERT (active);
+  lapic_write (LAPIC_EOI, 0);
+}
+
+/* Returns true if the local APIC has accepted interrupt VEC_NO
+   but not delivered it yet, e.g. since interrupts are off. */
+bool
+apic_pending (uint8_t vec_no)
+{
+  ASSERT (active);
+  return (lapic_read (LAPIC_IRR + 0x10 * (vec_no / 32))
+          >> (vec_no % 32)) & 1;
+}
+
+/* Masks ISA interrupt IRQ if MASKED is true, otherwise unmasks
+   it. */
+void
+apic_mask_irq (int irq, bool masked)
+{
+  uint8_t pin;
+  uint32_t low;
+
+  ASSERT (active);
+  ASSERT (irq >= 0 && irq < ISA_IRQ_CNT);
+
+  pin = isa_irqs[irq].pin;
+  if (pin >= ioapic_pins)
+    return;
+  low = ioapic_read (IOAPIC_REDTBL (pin));
+  ioapic_write (IOAPIC_REDTBL (pin),
+                masked ? low | RED_MASKED : low & ~RED_MASKED);
+}
+
+/* Routes ISA interrupt IRQ to CPU, an index less than
+   apic_cpu_cnt(), so that interrupts can be spread over CPUs.
+   Returns false if IRQ is not wired to the I/O APIC. */
+bool
+apic_route_irq (int irq, int cpu)
+{
+  ASSERT (active);
+  ASSERT (irq >= 0 && irq < ISA_IRQ_CNT);
+  ASSERT (cpu >= 0 && cpu < cpu_cnt);
+
+  if (isa_irqs[irq].pin >= ioapic_pins)
+    return false;
+  isa_irqs[irq].cpu = cpu;
+  write_route (irq);
+  return true;
+}
+
+/* Returns the number of enabled CPUs the ACPI tables list, at
+   least 1. */
+int
+apic_cpu_cnt (void)
+{
+  return active ? cpu_cnt : 1;
+}
+
+/* Starts the local APIC timer counting down from COUNT, at the
+   bus clock divided by 16.  If PERIODIC is true, it reloads
+   COUNT when it reaches 0.  Each time it reaches 0, it raises
+   interrupt VEC_NO, unless VEC_NO is 0, in which case the
+   interrupt is masked.  Restarts the count if already running. */
+void
+apic_timer_start (uint8_t vec_no, uint32_t count, bool periodic)
+{
+  ASSERT (active);
+
+  lapic_write (LAPIC_TIMER_DIV, TIMER_DIV_16);
+  lapic_write (LAPIC_LVT_TIMER, (vec_no != 0 ? vec_no : LVT_MASKED)
+                                | (periodic ? LVT_PERIODIC : 0));
+  lapic_write (LAPIC_TIMER_INIT, count);
+}
+
+/* Returns the local APIC timer's current count. */
+uint32_t
+apic_timer_count (void)
+{
+  ASSERT (active);
+  return lapic_read (LAPIC_TIMER_CUR);
+}
+
+/* Returns true if the CPU has a local APIC, as reported by
+   CPUID function 1 in EDX bit 9.  See [IA32-v2a] "CPUID--CPU
+   Identification". */
+static bool
+cpu_has_apic (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+
+  asm ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  return (edx & (1u << 9)) != 0;
+}
+
+/* Returns the low 32 bits of model-specific register MSR. */
+static uint32_t
+rdmsr (uint32_t msr)
+{
+  uint32_t low, high;
+
+  asm volatile ("rdmsr" : "=a" (low), "=d" (high) : "c" (msr));
+  return low;
+}
+
+/* Sets model-specific register MSR to VALUE. */
+static void
+wrmsr (uint32_t msr, uint32_t value)
+{
+  asm volatile ("wrmsr" : : "c" (msr), "a" (value), "d" (0));
+}
+
+/* Returns a virtual address through which the SIZE bytes at
+   physical address PADDR can be read: in RAM, its kernel
+   mapping, otherwise a new mapping. */
+static const void *
+map_phys (uintptr_t paddr, size_t size)
+{
+  if (paddr + size <= init_ram_pages * PGSIZE)
+    return ptov (paddr);
+  return mmio_map (paddr, size);
+}
+
+/* Returns true if the SIZE bytes at P sum to 0, as ACPI
+   checksums require. */
+static bool
+checksum_ok (const void *p_, size_t size)
+{
+  const uint8_t *p = p_;
+  uint8_t sum = 0;
+
+  while (size-- > 0)
+    sum += *p++;
+  return sum == 0;
+}
+
+/* Searches the first kB of the extended BIOS data area and then
+   the BIOS ROM for the RSDP, as [ACPI] 5.2.5.1 describes.
+   Returns it, or a null pointer if there is none. */
+static const struct rsdp *
+find_rsdp (void)
+{
+  uintptr_t ebda = *(uint16_t *) ptov (0x40e) << 4;
+  const uintptr_t ranges[][2] = {{ebda, ebda + 1024},
+                                 {0xe0000, 0x100000}};
+  size_t i;
+
+  for (i = 0; i < sizeof ranges / sizeof *ranges; i++)
+    {
+      uintptr_t p;
+
+      if (ranges[i][0] == 0)
+        continue;
+      for (p = ranges[i][0]; p + sizeof (struct rsdp) <= ranges[i][1];
+           p += 16)
+        {
+          const struct rsdp *rsdp = ptov (p);
+          if (!memcmp (rsdp->signature, "RSD PTR ", 8)
+              && checksum_ok (rsdp, sizeof *rsdp))
+            return rsdp;
+        }
+    }
+  return NULL;
+}
+
+/* Returns the MADT listed in the RSDT, or a null pointer if there
+   is none. */
+static const struct madt *
+find_madt (void)
+{
+  const struct rsdp *rsdp = find_rsdp ();
+  const struct sdt_header *rsdt;
+  size_t i, cnt;
+
+  if (rsdp == NULL)
+    return NULL;
+  rsdt = map_phys (rsdp->rsdt_addr, sizeof *rsdt);
+  if (memcmp (rsdt->signature, "RSDT", 4)
+      || rsdt->length < sizeof *rsdt || rsdt->length > TABLE_MAX)
+    return NULL;
+  rsdt = map_phys (rsdp->rsdt_addr, rsdt->length);
+  if (!checksum_ok (rsdt, rsdt->length))
+    return NULL;
+
+  cnt = (rsdt->length - sizeof *rsdt) / sizeof (uint32_t);
+  for (i = 0; i < cnt; i++)
+    {
+      uint32_t addr = ((const uint32_t *) (rsdt + 1))[i];
+      const struct sdt_header *h = map_phys (addr, sizeof *h);
+
+      if (memcmp (h->signature, "APIC", 4)
+          || h->length < sizeof (struct madt) || h->length > TABLE_MAX)
+        continue;
+      h = map_phys (addr, h->length);
+      if (checksum_ok (h, h->length))
+        return (const struct madt *) h;
+    }
+  return NULL;
+}
+
+/* Records the enabled CPUs and the ISA IRQ wiring from MADT, and
+   stores the physical address of the I/O APIC whose pin 0 is
+   interrupt 0 into *IOAPIC_ADDR.  Returns false if there is no
+   such I/O APIC.  Any other I/O APICs only serve interrupts
+   beyond the ISA IRQs, which are not used. */
+static bool
+parse_madt (const struct madt *madt, uintptr_t *ioapic_addr)
+{
+  const uint8_t *p = madt->entries;
+  const uint8_t *end = (const uint8_t *) madt + madt->header.length;
+  bool found = false;
+  int irq;
+
+  for (irq = 0; irq < ISA_IRQ_CNT; irq++)
+    {
+      isa_irqs[irq].pin = irq;
+      isa_irqs[irq].mode = 0;
+      isa_irqs[irq].cpu = 0;
+    }
+
+  for (; p + 2 <= end && p[1] >= 2 && p + p[1] <= end; p += p[1])
+    if (p[0] == MADT_LAPIC && p[1] >= sizeof (struct madt_lapic))
+      {
+        const struct madt_lapic *e = (const struct madt_lapic *) p;
+        if ((e->flags & 1) && cpu_cnt < APIC_CPU_MAX)
+          cpu_apic_ids[cpu_cnt++] = e->apic_id;
+      }
+    else if (p[0] == MADT_IOAPIC && p[1] >= sizeof (struct madt_ioapic))
+      {
+        const struct madt_ioapic *e = (const struct madt_ioapic *) p;
+        if (e->gsi_base == 0)
+          {
+            *ioapic_addr = e->addr;
+            found = true;
+          }
+      }
+    else if (p[0] == MADT_OVERRIDE
+             && p[1] >= sizeof (struct madt_override))
+      {
+        const struct madt_override *e = (const struct madt_override *) p;
+        if (e->bus != 0 || e->source >= ISA_IRQ_CNT || e->gsi >= NO_PIN)
+          continue;
+
+        /* No other IRQ keeps the pin, e.g. the unused cascade IRQ 2
+           once the PIT's IRQ 0 is wired to pin 2. */
+        for (irq = 0; irq < ISA_IRQ_CNT; irq++)
+          if (isa_irqs[irq].pin == e->gsi)
+            isa_irqs[irq].pin = NO_PIN;
+        isa_irqs[e->source].pin = e->gsi;
+        isa_irqs[e->source].mode = (((e->flags & 3) == 3 ? RED_LOW_ACTIVE : 0)
+                                    | (((e->flags >> 2) & 3) == 3
+                                       ? RED_LEVEL : 0));
+      }
+  return found;
+}
+
+/* Returns local APIC register REG. */
+static uint32_t
+lapic_read (int reg)
+{
+  return lapic[reg / 4];
+}
+
+/* Sets local APIC register REG to VALUE. */
+static void
+lapic_write (int reg, uint32_t value)
+{
+  lapic[reg / 4] = value;
+}
+
+/* Returns I/O APIC register REG. */
+static uint32_t
+ioapic_read (int reg)
+{
+  ioapic[IOAPIC_SEL / 4] = reg;
+  return ioapic[IOAPIC_WIN / 4];
+}
+
+/* Sets I/O APIC register REG to VALUE. */
+static void
+ioapic_write (int reg, uint32_t value)
+{
+  ioapic[IOAPIC_SEL / 4] = reg;
+  ioapic[IOAPIC_WIN / 4] = value;
+}
+
+/* Writes the redirection table entry of ISA interrupt IRQ,
+   keeping its mask bit if it was masked. */
+static void
+write_route (int irq)
+{
+  const struct isa_irq *r = &isa_irqs[irq];
+  uint32_t masked;
+
+  masked = ioapic_read (IOAPIC_REDTBL (r->pin)) & RED_MASKED;
+  ioapic_write (IOAPIC_REDTBL (r->pin), RED_MASKED);
+  ioapic_write (IOAPIC_REDTBL (r->pin) + 1,
+                (uint32_t) cpu_apic_ids[r->cpu] << 24);
+  ioapic_write (IOAPIC_REDTBL (r->pin),
+                masked | r->mode | (0x20 + irq));
+}
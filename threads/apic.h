@@ -0,0 +1,29 @@
+#ifndef THREADS_APIC_H
+#define THREADS_APIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Interrupt vector of spurious local APIC interrupts, which need
+   no handler and no end of interrupt. */
+#define APIC_SPURIOUS_VEC 0xff
+
+/* Most CPUs whose local APICs are recorded. */
+#define APIC_CPU_MAX 16
+
+/* If false, use the 8259A PICs even if an I/O APIC is present.
+   Controlled by kernel command-line option "-no-apic". */
+extern bool apic_enabled;
+
+bool apic_init (void);
+bool apic_active (void);
+void apic_eoi (void);
+bool apic_pending (uint8_t vec_no);
+void apic_mask_irq (int irq, bool masked);
+bool apic_route_irq (int irq, int cpu);
+int apic_cpu_cnt (void);
+
+void apic_timer_start (uint8_t vec_no, uint32_t count, bool periodic);
+uint32_t apic_timer_count (void);
+
+#endif /* threads/apic.h */
@@ -0,0 +1,111 @@
+#include "threads/arena.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Scratch memory for short-lived kernel allocations.
+
+   Each thread has up to ARENA_PAGES pages of scratch memory,
+   which it treats as one stack of bytes: arena_alloc() returns
+   the next bytes and moves the top of the stack past them.
+   Nothing is freed individually.  Instead, arena_begin()
+   returns the top of the stack as a mark, and arena_end() moves
+   the top back down to a mark, which frees everything allocated
+   since in one step.  Scopes nest, as long as they end in the
+   reverse of the order they began.
+
+   The pages belong to the thread, so allocating takes no lock,
+   and an allocation never straddles two pages, so one may be as
+   large as a page.  The first page is kept until the thread
+   exits; the rest go back to the page allocator when a scope
+   that needed them ends.
+
+   Scratch memory may not be used in interrupt context, which has
+   no thread of its own to use it. */
+
+/* Bytes to which allocations are rounded. */
+#define ARENA_ALIGN 8
+
+/* Returns the start of a new scope, to be passed to arena_end()
+   when it is over. */
+size_t
+arena_begin (void)
+{
+  ASSERT (!intr_context ());
+
+  return thread_current ()->arena_ofs;
+}
+
+/* Returns SIZE bytes of the running thread's scratch memory, or
+   a null pointer if SIZE exceeds PGSIZE or memory is not
+   available.  The memory is not initialized, and lasts until
+   the end of the innermost scope. */
+void *
+arena_alloc (size_t size)
+{
+  struct thread *t = thread_current ();
+  size_t ofs = t->arena_ofs;
+  size_t page;
+
+  ASSERT (!intr_context ());
+
+  size = ROUND_UP (size, ARENA_ALIGN);
+  if (size > PGSIZE)
+    return NULL;
+
+  /* Go on to the next page if this one is too full. */
+  if (ofs % PGSIZE + size > PGSIZE)
+    ofs = ROUND_UP (ofs, PGSIZE);
+  page = ofs / PGSIZE;
+  if (page >= ARENA_PAGES)
+    return NULL;
+  if (t->arena[page] == NULL)
+    {
+      t->arena[page] = palloc_get_page (0);
+      if (t->arena[page] == NULL)
+        return NULL;
+    }
+
+  t->arena_ofs = ofs + size;
+  return (uint8_t *) t->arena[page] + ofs % PGSIZE;
+}
+
+/* Ends the scope begun by the arena_begin() call that returned
+   MARK, freeing everything allocated since. */
+void
+arena_end (size_t mark)
+{
+  struct thread *t = thread_current ();
+  size_t page;
+
+  ASSERT (mark <= t->arena_ofs);
+
+  t->arena_ofs = mark;
+  for (page = DIV_ROUND_UP (mark, PGSIZE); page < ARENA_PAGES; page++)
+    if (page > 0 && t->arena[page] != NULL)
+      {
+        palloc_free_page (t->arena[page]);
+        t->arena[page] = NULL;
+      }
+}
+
+/* Frees all of the running thread's scratch memory.  Called as
+   it exits. */
+void
+arena_exit (void)
+{
+  struct thread *t = thread_current ();
+  size_t page;
+
+  for (page = 0; page < ARENA_PAGES; page++)
+    if (t->arena[page] != NULL)
+      {
+        palloc_free_page (t->arena[page]);
+        t->arena[page] = NULL;
+      }
+  t->arena_ofs = 0;
+}
@@ -0,0 +1,14 @@
+#ifndef THREADS_ARENA_H
+#define THREADS_ARENA_H
+
+#include <stddef.h>
+
+/* Pages of scratch memory a thread may have at once. */
+#define ARENA_PAGES 4
+
+size_t arena_begin (void);
+void *arena_alloc (size_t) __attribute__ ((malloc));
+void arena_end (size_t mark);
+void arena_exit (void);
+
+#endif /* threads/arena.h */
@@ -0,0 +1,19 @@
+#ifndef THREADS_CYCLE_H
+#define THREADS_CYCLE_H
+
+#include <stdint.h>
+
+/**
+ * rdtsc - read the time-stamp counter
+ *
+ * Return the number of CPU cycles since reset, for benchmarking.
+*/
+static inline uint64_t rdtsc(void)
+{
+	uint64_t tsc;
+
+	asm volatile("rdtsc" : "=A" (tsc));
+	return tsc;
+}
+
+#endif /* threads/cycle.h */
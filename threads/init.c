@@ -3,59 +3,103 @@
 #include <debug.h>
 #include <inttypes.h>
 #include <limits.h>
+#include <radix.h>
 #include <random.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "devices/e1000.h"
 #include "devices/kbd.h"
 #include "devices/input.h"
+#include "devices/pci.h"
 #include "devices/serial.h"
 #include "devices/shutdown.h"
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
+#include "threads/apic.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
+#include "threads/memtag.h"
 #include "threads/palloc.h"
+#include "threads/profile.h"
 #include "threads/pte.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/tunable.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
+#include "userprog/fpu.h"
 #include "userprog/gdt.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
 #else
 #include "tests/threads/tests.h"
 #endif
+#include "tests/bench/bench.h"
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/ramdisk.h"
+#include "devices/virtio.h"
+#include "devices/ahci.h"
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/snapshot.h"
+#endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/swap.h"
 #endif
 
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
 
+/* Map RAM with 4 MB pages where possible?  Cleared by -no-pse
+   or if the CPU lacks support. */
+bool init_large_pages = true;
+
 #ifdef FILESYS
 /* -f: Format the file system? */
 static bool format_filesys;
 
-/* -filesys, -scratch, -swap: Names of block devices to use,
+/* -filesys, -scratch, -snapshot: Names of block devices to use,
    overriding the defaults. */
 static const char *filesys_bdev_name;
 static const char *scratch_bdev_name;
+static const char *snapshot_bdev_name;
+
+/* -no-resume: Boot afresh even if there is a snapshot? */
+static bool no_resume;
+
+/* -ramdisk: Sizes of RAM disks to create, in kB. */
+static char *ramdisk_sizes;
 #ifdef VM
-static const char *swap_bdev_name;
+/* -swap: Block devices to use for swap, with their priorities. */
+static char *swap_bdev_names;
 #endif
 #endif /* FILESYS */
 
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
+#ifdef USERPROG
+static struct tunable user_page_limit_tunable =
+  {
+    .name = "palloc.user_limit",
+    .value = &user_page_limit,
+    .min = 1,
+    .max = SIZE_MAX,
+    .boot_only = true,
+  };
+#endif
 
 static void bss_init (void);
 static void paging_init (void);
@@ -68,6 +112,9 @@ static void usage (void);
 #ifdef FILESYS
 static void locate_block_devices (void);
 static void locate_block_device (enum block_type, const char *name);
+#ifdef VM
+static void locate_swap_devices (char *names);
+#endif
 #endif
 
 int pintos_init (void) NO_RETURN;
@@ -95,9 +142,17 @@ pintos_init (void)
           init_ram_pages * PGSIZE / 1024);
 
   /* Initialize memory system. */
+#ifdef USERPROG
+  tunable_register (&user_page_limit_tunable);
+#endif
   palloc_init (user_page_limit);
+  memtag_init ();
   malloc_init ();
+  radix_cache_init ();
   paging_init ();
+#ifdef VM
+  page_init ();
+#endif
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -108,25 +163,46 @@ pintos_init (void)
   /* Initialize interrupt handlers. */
   intr_init ();
   timer_init ();
+  profile_init ();
+  trace_init ();
   kbd_init ();
   input_init ();
 #ifdef USERPROG
   exception_init ();
+  fpu_init ();
   syscall_init ();
+  process_init ();
 #endif
 
   /* Start thread scheduler and enable interrupts. */
   thread_start ();
+  workqueue_init ();
   serial_init_queue ();
+  console_start_log ();
   timer_calibrate ();
 
+  /* Enumerate PCI functions, for the drivers below to claim. */
+  pci_init ();
+  e1000_init ();
+
 #ifdef FILESYS
   /* Initialize file system. */
   ide_init ();
+  virtio_init ();
+  ahci_init ();
+  if (ramdisk_sizes != NULL)
+    ramdisk_init (ramdisk_sizes);
   locate_block_devices ();
+  if (!format_filesys && !no_resume)
+    snapshot_resume (argv);
   filesys_init (format_filesys);
 #endif
+#ifdef VM
+  swap_init ();
+  frame_start_reclaim ();
+#endif
 
+  tunable_boot_check ();
   printf ("Boot complete.\n");
   
   if (*argv != NULL) {
@@ -154,10 +230,28 @@ bss_init (void)
   memset (&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
+/* Returns true if the CPU supports 4 MB pages, as reported by
+   CPUID function 1 in EDX bit 3.  See [IA32-v2a] "CPUID--CPU
+   Identification". */
+static bool
+cpu_has_pse (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+
+  asm ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  return (edx & (1u << 3)) != 0;
+}
+
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   If the CPU supports it, each 4 MB of RAM that is present in
+   full and holds no kernel text is mapped with a single large
+   page, so that the kernel's accesses to it need one TLB entry
+   instead of 1,024.  Kernel text keeps 4 kB pages so that it
+   stays read-only. */
 static void
 paging_init (void)
 {
@@ -165,6 +259,17 @@ paging_init (void)
   size_t page;
   extern char _start, _end_kernel_text;
 
+  if (init_large_pages && !cpu_has_pse ())
+    init_large_pages = false;
+  if (init_large_pages)
+    {
+      /* Set CR4.PSE, enabling PTE_PS in PDEs.  See [IA32-v3a]
+         2.5 "Control Registers". */
+      uint32_t cr4;
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4 | (1u << 4)));
+    }
+
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   pt = NULL;
   for (page = 0; page < init_ram_pages; page++)
@@ -175,6 +280,15 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      if (init_large_pages && pte_idx == 0
+          && page + PTSPAN / PGSIZE <= init_ram_pages
+          && (vaddr + PTSPAN <= &_start || vaddr >= &_end_kernel_text))
+        {
+          pd[pde_idx] = pde_create_large (vaddr, true);
+          page += PTSPAN / PGSIZE - 1;
+          continue;
+        }
+
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
@@ -251,18 +365,73 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-snapshot"))
+        snapshot_bdev_name = value;
+      else if (!strcmp (name, "-no-resume"))
+        no_resume = true;
+      else if (!strcmp (name, "-ramdisk"))
+        ramdisk_sizes = value;
+      else if (!strcmp (name, "-cache"))
+        cache_size = atoi (value);
+      else if (!strcmp (name, "-flush"))
+        cache_flush_ticks = atoi (value);
 #ifdef VM
       else if (!strcmp (name, "-swap"))
-        swap_bdev_name = value;
+        swap_bdev_names = value;
 #endif
 #endif
+      else if (!strcmp (name, "-baud"))
+        {
+          if (value == NULL || !serial_set_bps (atoi (value)))
+            PANIC ("unsupported serial data rate `%s'",
+                   value != NULL ? value : "");
+        }
+      else if (!strcmp (name, "-tsc-khz"))
+        timer_tsc_khz = atoi (value);
       else if (!strcmp (name, "-rs"))
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
-        thread_mlfqs = true;
+        thread_sched_select ("mlfqs");
+      else if (!strcmp (name, "-sched"))
+        {
+          if (value == NULL || !thread_sched_select (value))
+            PANIC ("unknown scheduler `%s'", value != NULL ? value : "");
+        }
+      else if (!strcmp (name, "-tickless"))
+        timer_tickless = true;
+      else if (!strcmp (name, "-sched-stats"))
+        thread_sched_stats = true;
+      else if (!strcmp (name, "-profile"))
+        profile_hz = value != NULL ? (unsigned) atoi (value) : TIMER_FREQ;
+      else if (!strcmp (name, "-trace"))
+        {
+          trace_enabled = true;
+          if (value != NULL)
+            trace_pages = atoi (value);
+        }
+      else if (!strcmp (name, "-lock-stats"))
+        lock_stats = true;
+      else if (!strcmp (name, "-intr-stats"))
+        intr_off_stats = true;
+      else if (!strcmp (name, "-mem-tags"))
+        memtag_enabled = true;
+      else if (!strcmp (name, "-palloc-ff"))
+        palloc_first_fit = true;
+      else if (!strcmp (name, "-no-pse"))
+        init_large_pages = false;
+      else if (!strcmp (name, "-no-apic"))
+        apic_enabled = false;
+      else if (!strcmp (name, "-set"))
+        tunable_boot_set (value);
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-stack-max"))
+        page_stack_max = atoi (value);
+      else if (!strcmp (name, "-frame-quota"))
+        frame_quota = atoi (value);
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -296,6 +465,37 @@ run_task (char **argv)
   printf ("Execution of '%s' complete.\n", task);
 }
 
+/* Runs the benchmark specified in ARGV[1]. */
+static void
+run_benchmark (char **argv)
+{
+  run_bench (argv[1]);
+}
+
+#ifdef FILESYS
+/* Saves a snapshot of the kernel and powers off.  In the kernel
+   that resumes the snapshot, runs the actions on the command line
+   of the boot that resumed it instead of the rest of this one's,
+   and shuts down as that one would have.  Only the -q and -r
+   options take effect, since the rest configure a boot. */
+static void
+run_snapshot (char **argv UNUSED)
+{
+  if (!snapshot_save ())
+    return;
+
+  argv = read_command_line ();
+  for (; *argv != NULL && **argv == '-'; argv++)
+    if (!strcmp (*argv, "-q"))
+      shutdown_configure (SHUTDOWN_POWER_OFF);
+    else if (!strcmp (*argv, "-r"))
+      shutdown_configure (SHUTDOWN_REBOOT);
+  run_actions (argv);
+  shutdown ();
+  thread_exit ();
+}
+#endif
+
 /* Executes all of the actions specified in ARGV[]
    up to the null pointer sentinel. */
 static void
@@ -313,12 +513,17 @@ run_actions (char **argv)
   static const struct action actions[] = 
     {
       {"run", 2, run_task},
+      {"bench", 2, run_benchmark},
 #ifdef FILESYS
       {"ls", 1, fsutil_ls},
       {"cat", 2, fsutil_cat},
       {"rm", 2, fsutil_rm},
+      {"frag", 1, fsutil_frag},
+      {"defrag", 1, fsutil_defrag},
+      {"defrag-bg", 2, fsutil_defrag_bg},
       {"extract", 1, fsutil_extract},
       {"append", 2, fsutil_append},
+      {"snapshot", 1, run_snapshot},
 #endif
       {NULL, 0, NULL},
     };
@@ -361,10 +566,16 @@ usage (void)
 #else
           "  run TEST           Run TEST.\n"
 #endif
+          "  bench NAME         Run benchmark NAME, or \"all\" of them.\n"
 #ifdef FILESYS
           "  ls                 List files in the root directory.\n"
           "  cat FILE           Print FILE to the console.\n"
           "  rm FILE            Delete FILE.\n"
+          "  frag               Report free space and file fragmentation.\n"
+          "  defrag             Defragment files in the root directory.\n"
+          "  defrag-bg RATE     Same, in the background, at up to RATE kB/s.\n"
+          "  snapshot           Save the kernel to the snapshot device and\n"
+          "                     power off, for the next boot to resume.\n"
           "Use these actions indirectly via `pintos' -g and -p options:\n"
           "  extract            Untar from scratch device into file system.\n"
           "  append FILE        Append FILE to tar file on scratch device.\n"
@@ -377,14 +588,39 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -snapshot=BDEV     Use BDEV for snapshots instead of default.\n"
+          "  -no-resume         Boot afresh even if there is a snapshot.\n"
+          "  -ramdisk=KB,...    Create RAM disks rd0, rd1... of KB kB each.\n"
+          "  -cache=COUNT       Cache COUNT file system sectors.\n"
+          "  -flush=TICKS       Write back the cache every TICKS ticks.\n"
 #ifdef VM
-          "  -swap=BDEV         Use BDEV for swap instead of default.\n"
+          "  -swap=BDEV[:PRIO],...\n"
+          "                     Swap to each BDEV, higher PRIO first, equal\n"
+          "                     PRIO striped, instead of all swap devices.\n"
 #endif
 #endif
+          "  -baud=BPS          Run the serial port at BPS bits/second.\n"
+          "  -tsc-khz=KHZ       Assume the TSC runs at KHZ kHz.\n"
           "  -rs=SEED           Set random number seed to SEED.\n"
-          "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -sched=CLASS       Schedule by CLASS: priority, mlfqs or fair.\n"
+          "  -mlfqs             Same as -sched=mlfqs.\n"
+          "  -tickless          Skip timer interrupts while idle.\n"
+          "  -sched-stats       Print per-thread scheduler statistics.\n"
+          "  -profile[=HZ]      Sample running code HZ times per second.\n"
+          "  -trace[=PAGES]     Trace kernel events into a PAGES-page ring.\n"
+          "  -lock-stats        Print contention statistics of named locks.\n"
+          "  -intr-stats        Time interrupts-off stretches by caller.\n"
+          "  -mem-tags          Account memory by allocating file and caller.\n"
+          "  -palloc-ff         Allocate pages first fit instead of buddy.\n"
+          "  -no-pse            Map kernel memory with 4 kB pages only.\n"
+          "  -no-apic           Take interrupts through the 8259A PICs.\n"
+          "  -set=NAME=VALUE    Set tunable NAME, as listed by sysctl.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -stack-max=COUNT   Limit user stacks to COUNT pages.\n"
+          "  -frame-quota=COUNT Limit each process to COUNT resident pages.\n"
 #endif
           );
   shutdown_power_off ();
@@ -397,8 +633,9 @@ locate_block_devices (void)
 {
   locate_block_device (BLOCK_FILESYS, filesys_bdev_name);
   locate_block_device (BLOCK_SCRATCH, scratch_bdev_name);
+  locate_block_device (BLOCK_SNAPSHOT, snapshot_bdev_name);
 #ifdef VM
-  locate_block_device (BLOCK_SWAP, swap_bdev_name);
+  locate_swap_devices (swap_bdev_names);
 #endif
 }
 
@@ -430,4 +667,46 @@ locate_block_device (enum block_type role, const char *name)
       block_set_role (role, block);
     }
 }
+
+#ifdef VM
+/* Sets up swap on the block devices in NAMES, a comma-separated
+   list of device names, each followed by ":PRIO" to give it
+   priority PRIO instead of 0, if NAMES is non-null, otherwise on
+   every block device of type BLOCK_SWAP, in probe order, with
+   equal priorities. */
+static void
+locate_swap_devices (char *names)
+{
+  struct block *block;
+  char *token, *save_ptr;
+
+  if (names == NULL)
+    {
+      for (block = block_first (); block != NULL; block = block_next (block))
+        if (block_type (block) == BLOCK_SWAP && swap_add_area (block, 0))
+          {
+            printf ("swap: using %s\n", block_name (block));
+            block_set_role (BLOCK_SWAP, block);
+          }
+      return;
+    }
+
+  for (token = strtok_r (names, ",", &save_ptr); token != NULL;
+       token = strtok_r (NULL, ",", &save_ptr))
+    {
+      char *prio = strchr (token, ':');
+
+      if (prio != NULL)
+        *prio++ = '\0';
+      block = block_get_by_name (token);
+      if (block == NULL)
+        PANIC ("No such block device \"%s\"", token);
+      if (!swap_add_area (block, prio != NULL ? atoi (prio) : 0))
+        PANIC ("Too many swap devices");
+      printf ("swap: using %s, priority %d\n", block_name (block),
+              prio != NULL ? atoi (prio) : 0);
+      block_set_role (BLOCK_SWAP, block);
+    }
+}
+#endif
 #endif
@@ -9,4 +9,7 @@
 /* Page directory with kernel mappings only. */
 extern uint32_t *init_page_dir;
 
+/* Kernel RAM mapped with 4 MB pages where possible? */
+extern bool init_large_pages;
+
 #endif /* threads/init.h */
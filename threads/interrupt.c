@@ -3,12 +3,18 @@
 #include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
+#include "threads/apic.h"
+#include "threads/cycle.h"
 #include "threads/flags.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "devices/timer.h"
+#ifdef VM
+#include "userprog/gdt.h"
+#include "userprog/process.h"
+#endif
 
 /* Programmable Interrupt Controller (PIC) registers.
    A PC has two PICs, called the master and slave PICs, with the
@@ -33,6 +39,12 @@ static intr_handler_func *intr_handlers[INTR_CNT];
 /* Names for each interrupt, for debugging purposes. */
 static const char *intr_names[INTR_CNT];
 
+/* Handlers for each external interrupt that several devices
+   share, as PCI devices may, in order of registration.  The
+   first is null unless the line is shared. */
+#define SHARED_MAX 4
+static intr_handler_func *shared_handlers[0x10][SHARED_MAX];
+
 /* Number of unexpected interrupts for each vector.  An
    unexpected interrupt is one that has no registered handler. */
 static unsigned int unexpected_cnt[INTR_CNT];
@@ -47,8 +59,61 @@ static unsigned int unexpected_cnt[INTR_CNT];
 static bool in_external_intr;   /* Are we processing an external interrupt? */
 static bool yield_on_return;    /* Should we yield on interrupt return? */
 
+/* Handler statistics for each vector, in TSC cycles from entry
+   to return of the handler.  Handlers that run with interrupts
+   on, such as the system call handler, also count time spent
+   blocked. */
+struct vec_stats
+  {
+    uint64_t cnt;               /* Handler invocations. */
+    uint64_t cycles;            /* Cycles spent in the handler. */
+    uint64_t max;               /* Longest single invocation. */
+  };
+static struct vec_stats vec_stats[INTR_CNT];
+
+/* If true, record how long interrupts stay disabled, by the
+   call site that disabled them.
+   Controlled by kernel command-line option "-intr-stats". */
+bool intr_off_stats;
+
+/* Interrupts-off statistics for one call site. */
+struct off_site
+  {
+    void *site;                 /* Return address of intr_disable(). */
+    uint64_t cnt;               /* Times interrupts went off here. */
+    uint64_t cycles;            /* Cycles spent with them off. */
+    uint64_t max;               /* Longest single stretch. */
+  };
+
+/* Hash table of call sites, with linear probing.  Sites beyond
+   the first OFF_SITE_CNT are only counted in off_sites_lost. */
+#define OFF_SITE_CNT 64
+static struct off_site off_sites[OFF_SITE_CNT];
+static uint64_t off_sites_lost;
+
+/* Where and when interrupts were last disabled, or a null SITE
+   if that is not being timed. */
+static void *off_site;
+static uint64_t off_start;
+
+static enum intr_level disable_from (void *site);
+static void off_done (void);
+
+/* Deferred work, run by intr_handler() with interrupts on after
+   an external interrupt has been acknowledged and before the
+   interrupted thread resumes.  A handler arriving while the list
+   is being run leaves the work to the run in progress, and
+   likewise leaves rescheduling until it is done. */
+static struct list deferred_list;
+static bool deferred_running;
+static bool deferred_yield;
+static uint64_t deferred_cnt;           /* Work items run. */
+static uint64_t deferred_cycles;        /* Cycles spent running them. */
+
+static void run_deferred (void);
+
 /* Programmable Interrupt Controller helpers. */
-static void pic_init (void);
+static void pic_init (bool unmask);
 static void pic_end_of_interrupt (int irq);
 
 /* Interrupt Descriptor Table helpers. */
@@ -59,6 +124,9 @@ static inline uint64_t make_idtr_operand (uint16_t limit, void *base);
 /* Interrupt handlers. */
 void intr_handler (struct intr_frame *args);
 static void unexpected_interrupt (const struct intr_frame *);
+static void run_shared (struct intr_frame *);
+static void account_handler (uint8_t vec_no, uint64_t cycles,
+                             bool external);
 
 /* Returns the current interrupt status. */
 enum intr_level
@@ -80,7 +148,10 @@ intr_get_level (void)
 enum intr_level
 intr_set_level (enum intr_level level) 
 {
-  return level == INTR_ON ? intr_enable () : intr_disable ();
+  if (level == INTR_ON)
+    return intr_enable ();
+  else
+    return disable_from (__builtin_return_address (0));
 }
 
 /* Enables interrupts and returns the previous interrupt status. */
@@ -90,6 +161,9 @@ intr_enable (void)
   enum intr_level old_level = intr_get_level ();
   ASSERT (!intr_context ());
 
+  if (old_level == INTR_OFF)
+    off_done ();
+
   /* Enable interrupts by setting the interrupt flag.
 
      See [IA32-v2b] "STI" and [IA32-v3a] 5.8.1 "Masking Maskable
@@ -102,6 +176,14 @@ intr_enable (void)
 /* Disables interrupts and returns the previous interrupt status. */
 enum intr_level
 intr_disable (void) 
+{
+  return disable_from (__builtin_return_address (0));
+}
+
+/* Disables interrupts on behalf of the caller at SITE and returns
+   the previous interrupt status. */
+static enum intr_level
+disable_from (void *site)
 {
   enum intr_level old_level = intr_get_level ();
 
@@ -110,8 +192,49 @@ intr_disable (void)
      Hardware Interrupts". */
   asm volatile ("cli" : : : "memory");
 
+  if (old_level == INTR_ON && intr_off_stats)
+    {
+      off_site = site;
+      off_start = rdtsc ();
+    }
+
   return old_level;
 }
+
+/* Interrupts are about to be enabled.  Charges the time since
+   they were disabled to the call site that disabled them. */
+static void
+off_done (void)
+{
+  uint64_t cycles;
+  size_t i, probe;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (off_site == NULL)
+    return;
+  cycles = rdtsc () - off_start;
+
+  i = ((uintptr_t) off_site >> 2) % OFF_SITE_CNT;
+  for (probe = 0; probe < OFF_SITE_CNT; probe++)
+    {
+      struct off_site *s = &off_sites[i];
+      if (s->site == NULL || s->site == off_site)
+        {
+          s->site = off_site;
+          s->cnt++;
+          s->cycles += cycles;
+          if (cycles > s->max)
+            s->max = cycles;
+          break;
+        }
+      i = (i + 1) % OFF_SITE_CNT;
+    }
+  if (probe == OFF_SITE_CNT)
+    off_sites_lost++;
+
+  off_site = NULL;
+}
 
 /* Initializes the interrupt system. */
 void
@@ -120,8 +243,10 @@ intr_init (void)
   uint64_t idtr_operand;
   int i;
 
-  /* Initialize interrupt controller. */
-  pic_init ();
+  /* Initialize interrupt controller: the APICs if there are any,
+     with the PICs remapped but masked, otherwise the PICs. */
+  pic_init (!apic_init ());
+  list_init (&deferred_list);
 
   /* Initialize IDT. */
   for (i = 0; i < INTR_CNT; i++)
@@ -176,13 +301,48 @@ register_handler (uint8_t vec_no, int dpl, enum intr_level level,
 
 /* Registers external interrupt VEC_NO to invoke HANDLER, which
    is named NAME for debugging purposes.  The handler will
-   execute with interrupts disabled. */
+   execute with interrupts disabled.
+
+   If VEC_NO already has a handler, because devices share its
+   line, every handler runs on each interrupt, so each must check
+   whether its own device interrupted. */
 void
 intr_register_ext (uint8_t vec_no, intr_handler_func *handler,
                    const char *name) 
 {
+  intr_handler_func **shared = shared_handlers[vec_no - 0x20];
+  enum intr_level old_level;
+  size_t i;
+
   ASSERT (vec_no >= 0x20 && vec_no <= 0x2f);
-  register_handler (vec_no, 0, INTR_OFF, handler, name);
+  if (intr_handlers[vec_no] == NULL)
+    {
+      register_handler (vec_no, 0, INTR_OFF, handler, name);
+      return;
+    }
+
+  old_level = intr_disable ();
+  if (shared[0] == NULL)
+    {
+      shared[0] = intr_handlers[vec_no];
+      intr_handlers[vec_no] = run_shared;
+    }
+  for (i = 1; i < SHARED_MAX && shared[i] != NULL; i++)
+    continue;
+  ASSERT (i < SHARED_MAX);
+  shared[i] = handler;
+  intr_set_level (old_level);
+}
+
+/* Runs every handler of the shared external interrupt in F. */
+static void
+run_shared (struct intr_frame *f)
+{
+  intr_handler_func **shared = shared_handlers[f->vec_no - 0x20];
+  size_t i;
+
+  for (i = 0; i < SHARED_MAX && shared[i] != NULL; i++)
+    shared[i] (f);
 }
 
 /* Registers internal interrupt VEC_NO to invoke HANDLER, which
@@ -233,9 +393,12 @@ intr_yield_on_return (void)
    interrupt vectors 0...15.  Those vectors are also used for CPU
    traps and exceptions, so we reprogram the PICs so that
    interrupts 0...15 are delivered to interrupt vectors 32...47
-   (0x20...0x2f) instead. */
+   (0x20...0x2f) instead.
+
+   If UNMASK is false, the PICs are left with all interrupts
+   masked, since the APICs deliver them. */
 static void
-pic_init (void)
+pic_init (bool unmask)
 {
   /* Mask all interrupts on both PICs. */
   outb (PIC0_DATA, 0xff);
@@ -254,8 +417,39 @@ pic_init (void)
   outb (PIC1_DATA, 0x01); /* ICW4: 8086 mode, normal EOI, non-buffered. */
 
   /* Unmask all interrupts. */
-  outb (PIC0_DATA, 0x00);
-  outb (PIC1_DATA, 0x00);
+  if (unmask)
+    {
+      outb (PIC0_DATA, 0x00);
+      outb (PIC1_DATA, 0x00);
+    }
+}
+
+/**
+ * intr_ext_pending - check if an external interrupt is pending
+ *
+ * @vec_no: the external interrupt vector, 0x20 to 0x2f
+ *
+ * Return true if the interrupt controller has raised the given
+ * external interrupt but it has not been serviced yet, e.g. since
+ * interrupts are off.
+*/
+bool intr_ext_pending(uint8_t vec_no)
+{
+	int irq;
+
+	ASSERT(vec_no >= 0x20 && vec_no < 0x30);
+
+	if (apic_active())
+		return apic_pending(vec_no);
+
+	/* OCW3: read the interrupt request register. */
+	irq = vec_no - 0x20;
+	if (irq < 8) {
+		outb(PIC0_CTRL, 0x0a);
+		return (inb(PIC0_CTRL) >> irq) & 1;
+	}
+	outb(PIC1_CTRL, 0x0a);
+	return (inb(PIC1_CTRL) >> (irq - 8)) & 1;
 }
 
 /* Sends an end-of-interrupt signal to the PIC for the given IRQ.
@@ -346,10 +540,12 @@ intr_handler (struct intr_frame *frame)
 {
   bool external;
   intr_handler_func *handler;
+  uint64_t start;
 
   /* External interrupts are special.
      We only handle one at a time (so interrupts must be off)
-     and they need to be acknowledged on the PIC (see below).
+     and they need to be acknowledged on the interrupt controller
+     (see below).
      An external interrupt handler cannot sleep. */
   external = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
   if (external) 
@@ -363,9 +559,11 @@ intr_handler (struct intr_frame *frame)
 
   /* Invoke the interrupt's handler. */
   handler = intr_handlers[frame->vec_no];
+  start = rdtsc ();
   if (handler != NULL)
     handler (frame);
-  else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f)
+  else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f
+           || frame->vec_no == APIC_SPURIOUS_VEC)
     {
       /* There is no handler, but this interrupt can trigger
          spuriously due to a hardware fault or hardware race
@@ -373,6 +571,7 @@ intr_handler (struct intr_frame *frame)
     }
   else
     unexpected_interrupt (frame);
+  account_handler (frame->vec_no, rdtsc () - start, external);
 
   /* Complete the processing of an external interrupt. */
   if (external) 
@@ -381,11 +580,88 @@ intr_handler (struct intr_frame *frame)
       ASSERT (intr_context ());
 
       in_external_intr = false;
-      pic_end_of_interrupt (frame->vec_no); 
+      if (apic_active ())
+        apic_eoi ();
+      else
+        pic_end_of_interrupt (frame->vec_no);
+
+      if (deferred_running)
+        deferred_yield |= yield_on_return;
+      else
+        {
+          bool yield = yield_on_return;
+
+          if (!list_empty (&deferred_list))
+            {
+              run_deferred ();
+              yield |= deferred_yield;
+              deferred_yield = false;
+            }
+          if (yield && rcu_preempt_ok ())
+            thread_yield (); 
+        }
+    }
+
+  /* If returning re-enables interrupts, then whoever disabled them
+     last is done, even though intr_enable() was never called.
+     That happens after a thread switch.  Nothing is being timed
+     unless OFF_SITE is set, so the flags are only read then. */
+  if (off_site != NULL && (frame->eflags & FLAG_IF)
+      && intr_get_level () == INTR_OFF)
+    off_done ();
+
+#ifdef VM
+  /* A thread whose process is exiting ends on its way back to
+     user mode. */
+  if (frame->cs == SEL_UCSEG)
+    process_check_dying ();
+#endif
+}
+
+/* Runs the deferred work list until it is empty, with interrupts
+   on while each item runs.  Called with interrupts off at the end
+   of an external interrupt. */
+static void
+run_deferred (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (!intr_context ());
 
-      if (yield_on_return) 
-        thread_yield (); 
+  deferred_running = true;
+  while (!list_empty (&deferred_list))
+    {
+      struct intr_work *w = list_entry (list_pop_front (&deferred_list),
+                                        struct intr_work, elem);
+      uint64_t start = rdtsc ();
+
+      w->queued = false;
+      intr_enable ();
+      w->func (w->aux);
+      intr_disable ();
+      deferred_cnt++;
+      deferred_cycles += rdtsc () - start;
     }
+  deferred_running = false;
+}
+
+/* Adds CYCLES spent in the handler for VEC_NO to its
+   statistics.  EXTERNAL is true for an external interrupt, which
+   is handled with interrupts off throughout. */
+static void
+account_handler (uint8_t vec_no, uint64_t cycles, bool external)
+{
+  struct vec_stats *v = &vec_stats[vec_no];
+
+  /* Handlers for internal interrupts may run with interrupts on,
+     so two threads could update the same vector at once. */
+  if (!external)
+    asm volatile ("pushfl; cli" : : : "memory");
+  v->cnt++;
+  v->cycles += cycles;
+  if (cycles > v->max)
+    v->max = cycles;
+  if (!external)
+    asm volatile ("popfl" : : : "memory", "cc");
 }
 
 /* Handles an unexpected interrupt with interrupt frame F.  An
@@ -436,3 +712,120 @@ intr_name (uint8_t vec)
 {
   return intr_names[vec];
 }
+
+/* Returns the average of CYCLES over CNT, or 0 if CNT is 0. */
+static uint64_t
+average (uint64_t cycles, uint64_t cnt)
+{
+  return cnt > 0 ? cycles / cnt : 0;
+}
+
+/**
+ * intr_work_init - initialize deferred interrupt work
+ *
+ * @w: the work item
+ * @func: function to run
+ * @aux: argument to pass to @func
+*/
+void intr_work_init(struct intr_work *w, intr_work_func *func, void *aux)
+{
+	ASSERT(func != NULL);
+
+	w->func = func;
+	w->aux = aux;
+	w->queued = false;
+}
+
+/**
+ * intr_defer - run work once the current interrupt has returned
+ *
+ * @w: the work item
+ *
+ * Queue @w to run with interrupts on, after the external interrupt
+ * being handled has been acknowledged but before the thread it
+ * interrupted resumes, or at the end of the next external interrupt
+ * when called outside one.  Queuing @w again before it has run has no
+ * effect.  @w runs in no thread of its own, so it must not sleep.
+ * Must be called with interrupts turned off.
+*/
+void intr_defer(struct intr_work *w)
+{
+	ASSERT(intr_get_level() == INTR_OFF);
+
+	if (!w->queued) {
+		w->queued = true;
+		list_push_back(&deferred_list, &w->elem);
+	}
+}
+
+/**
+ * intr_vec_stats - get the handler statistics of a vector
+ *
+ * @vec_no: the vector
+ * @cnt: where to store how many times its handler ran
+ * @cycles: where to store the cycles its handler took in all
+*/
+void intr_vec_stats(uint8_t vec_no, uint64_t *cnt, uint64_t *cycles)
+{
+	enum intr_level old_level = intr_disable();
+
+	*cnt = vec_stats[vec_no].cnt;
+	*cycles = vec_stats[vec_no].cycles;
+	intr_set_level(old_level);
+}
+
+/**
+ * intr_print_stats - print interrupt statistics
+ *
+ * Print the handler time of every vector that has fired and, if
+ * intr_off_stats, the call sites that kept interrupts disabled
+ * longest in total.  Stops collecting interrupts-off statistics.
+*/
+void intr_print_stats(void)
+{
+	int vec;
+	size_t i, j;
+
+	for (vec = 0; vec < INTR_CNT; vec++) {
+		struct vec_stats *v = &vec_stats[vec];
+
+		if (v->cnt == 0)
+			continue;
+		printf("Interrupt %#04x (%s): %llu calls, "
+		       "%llu avg/%llu max cycles\n",
+		       vec, intr_names[vec], v->cnt,
+		       average(v->cycles, v->cnt), v->max);
+	}
+
+	if (deferred_cnt > 0)
+		printf("Deferred interrupt work: %llu runs, %llu avg cycles\n",
+		       deferred_cnt, average(deferred_cycles, deferred_cnt));
+
+	if (!intr_off_stats)
+		return;
+	intr_off_stats = false;
+
+	/* Sort the sites by total time, longest first.  The table
+	   stops being a hash table, but nothing looks it up any more. */
+	for (i = 0; i < OFF_SITE_CNT; i++)
+		for (j = i + 1; j < OFF_SITE_CNT; j++)
+			if (off_sites[j].cycles > off_sites[i].cycles) {
+				struct off_site tmp = off_sites[i];
+				off_sites[i] = off_sites[j];
+				off_sites[j] = tmp;
+			}
+
+	for (i = 0; i < OFF_SITE_CNT && i < 10; i++) {
+		struct off_site *s = &off_sites[i];
+
+		if (s->site == NULL)
+			break;
+		printf("Interrupts off at %p: %llu times, %llu cycles, "
+		       "%llu avg/%llu max\n",
+		       s->site, s->cnt, s->cycles, average(s->cycles, s->cnt),
+		       s->max);
+	}
+	if (off_sites_lost > 0)
+		printf("Interrupts off: %llu stretches at untracked sites\n",
+		       off_sites_lost);
+}
@@ -1,6 +1,7 @@
 #ifndef THREADS_INTERRUPT_H
 #define THREADS_INTERRUPT_H
 
+#include <list.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -57,14 +58,33 @@ struct intr_frame
 
 typedef void intr_handler_func (struct intr_frame *);
 
+/* Work that an interrupt handler defers until it has returned,
+   to run with interrupts on.  See intr_defer(). */
+typedef void intr_work_func (void *aux);
+struct intr_work
+  {
+    struct list_elem elem;      /* Element in the deferred list. */
+    intr_work_func *func;       /* Function to run. */
+    void *aux;                  /* Argument to FUNC. */
+    bool queued;                /* In the deferred list? */
+  };
+
 void intr_init (void);
 void intr_register_ext (uint8_t vec, intr_handler_func *, const char *name);
 void intr_register_int (uint8_t vec, int dpl, enum intr_level,
                         intr_handler_func *, const char *name);
 bool intr_context (void);
 void intr_yield_on_return (void);
+bool intr_ext_pending(uint8_t vec_no);
 
 void intr_dump_frame (const struct intr_frame *);
 const char *intr_name (uint8_t vec);
 
+void intr_work_init(struct intr_work *, intr_work_func *, void *aux);
+void intr_defer(struct intr_work *);
+
+extern bool intr_off_stats;
+void intr_vec_stats(uint8_t vec_no, uint64_t *cnt, uint64_t *cycles);
+void intr_print_stats(void);
+
 #endif /* threads/interrupt.h */
@@ -5,6 +5,9 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <vmstat.h>
+#include "threads/interrupt.h"
+#include "threads/memtag.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -32,7 +35,25 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   With allocation tags (see memtag.h), each block starts with a
+   struct tag_header naming the source file and call site that
+   allocated it, and the caller gets the bytes after it. */
+
+/* Number of freed blocks a magazine holds. */
+#define MAG_SIZE 16
+
+/* Magazine: a stack of freed blocks of one descriptor, served
+   with interrupts off rather than the descriptor lock.  There is
+   one per CPU, and only the bootstrap CPU is up, so it is simply
+   kept within the descriptor.  Blocks in a magazine still count
+   as in use by their arena. */
+struct magazine
+  {
+    size_t cnt;                 /* Number of blocks held. */
+    void *blocks[MAG_SIZE];     /* Blocks held. */
+  };
 
 /* Descriptor. */
 struct desc
@@ -40,7 +61,9 @@ struct desc
     size_t block_size;          /* Size of each element in bytes. */
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
     struct list free_list;      /* List of free blocks. */
-    struct lock lock;           /* Lock. */
+    size_t arena_cnt;           /* Number of arenas. */
+    struct adaptive_lock lock;  /* Lock. */
+    struct magazine mag;        /* Magazine of the CPU. */
   };
 
 /* Magic number for detecting arena corruption. */
@@ -61,9 +84,22 @@ struct block
   };
 
 /* Our set of descriptors. */
+/* Header at the start of each block while allocation tags are
+   enabled. */
+struct tag_header
+  {
+    const char *tag;            /* Source file that allocated it. */
+    void *site;                 /* Address of the call. */
+  };
+
 static struct desc descs[10];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+static void *alloc (size_t size, const char *tag, void *site);
+static void *alloc_untagged (size_t);
+static size_t block_size (void *);
+static size_t usable_size (void *);
+static struct desc *size_to_desc (size_t);
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
 
@@ -76,22 +112,58 @@ malloc_init (void)
   for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2)
     {
       struct desc *d = &descs[desc_cnt++];
+      char name[16];
+
       ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
       d->block_size = block_size;
       d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
       list_init (&d->free_list);
-      lock_init (&d->lock);
+      d->arena_cnt = 0;
+      snprintf (name, sizeof name, "malloc %zu", block_size);
+      adaptive_lock_init_named (&d->lock, name);
+      d->mag.cnt = 0;
     }
 }
 
-/* Obtains and returns a new block of at least SIZE bytes.
+/* Obtains and returns a new block of at least SIZE bytes,
+   charged to TAG.
    Returns a null pointer if memory is not available. */
 void *
-malloc (size_t size) 
+malloc_tagged (size_t size, const char *tag) 
+{
+  return alloc (size, tag, __builtin_return_address (0));
+}
+
+/* Obtains and returns a new block of at least SIZE bytes, with a
+   tag header naming TAG and SITE if allocation tags are
+   enabled. */
+static void *
+alloc (size_t size, const char *tag, void *site)
+{
+  struct tag_header *h;
+
+  if (!memtag_enabled)
+    return alloc_untagged (size);
+  if (size == 0)
+    return NULL;
+
+  h = alloc_untagged (size + sizeof *h);
+  if (h == NULL)
+    return NULL;
+  h->tag = tag;
+  h->site = site;
+  memtag_charge (tag, site, block_size (h) - sizeof *h, 0);
+  return h + 1;
+}
+
+/* Does the work of malloc_tagged(), short of the tagging. */
+static void *
+alloc_untagged (size_t size) 
 {
   struct desc *d;
   struct block *b;
   struct arena *a;
+  enum intr_level old_level;
 
   /* A null pointer satisfies a request for 0 bytes. */
   if (size == 0)
@@ -99,10 +171,8 @@ malloc (size_t size)
 
   /* Find the smallest descriptor that satisfies a SIZE-byte
      request. */
-  for (d = descs; d < descs + desc_cnt; d++)
-    if (d->block_size >= size)
-      break;
-  if (d == descs + desc_cnt) 
+  d = size_to_desc (size);
+  if (d == NULL) 
     {
       /* SIZE is too big for any descriptor.
          Allocate enough pages to hold SIZE plus an arena. */
@@ -119,25 +189,33 @@ malloc (size_t size)
       return a + 1;
     }
 
-  lock_acquire (&d->lock);
+  /* Take the most recently freed block from the magazine, if any. */
+  old_level = intr_disable ();
+  b = d->mag.cnt > 0 ? d->mag.blocks[--d->mag.cnt] : NULL;
+  intr_set_level (old_level);
+  if (b != NULL)
+    return b;
+
+  adaptive_lock_acquire (&d->lock);
 
   /* If the free list is empty, create a new arena. */
   if (list_empty (&d->free_list))
     {
       size_t i;
 
-      /* Allocate a page. */
+      /* Allocate a page, without the lock, since the page
+         allocator may have shrinkers free memory. */
+      adaptive_lock_release (&d->lock);
       a = palloc_get_page (0);
       if (a == NULL) 
-        {
-          lock_release (&d->lock);
-          return NULL; 
-        }
+        return NULL; 
+      adaptive_lock_acquire (&d->lock);
 
       /* Initialize arena and add its blocks to the free list. */
       a->magic = ARENA_MAGIC;
       a->desc = d;
       a->free_cnt = d->blocks_per_arena;
+      d->arena_cnt++;
       for (i = 0; i < d->blocks_per_arena; i++) 
         {
           struct block *b = arena_to_block (a, i);
@@ -149,14 +227,15 @@ malloc (size_t size)
   b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
   a = block_to_arena (b);
   a->free_cnt--;
-  lock_release (&d->lock);
+  adaptive_lock_release (&d->lock);
   return b;
 }
 
-/* Allocates and return A times B bytes initialized to zeroes.
+/* Allocates and return A times B bytes initialized to zeroes,
+   charged to TAG.
    Returns a null pointer if memory is not available. */
 void *
-calloc (size_t a, size_t b) 
+calloc_tagged (size_t a, size_t b, const char *tag) 
 {
   void *p;
   size_t size;
@@ -167,7 +246,7 @@ calloc (size_t a, size_t b)
     return NULL;
 
   /* Allocate and zero memory. */
-  p = malloc (size);
+  p = alloc (size, tag, __builtin_return_address (0));
   if (p != NULL)
     memset (p, 0, size);
 
@@ -185,14 +264,28 @@ block_size (void *block)
   return d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs (block);
 }
 
+/* Returns the number of bytes of BLOCK, as returned to the
+   caller, that the caller may use. */
+static size_t
+usable_size (void *block)
+{
+  if (memtag_enabled)
+    {
+      struct tag_header *h = (struct tag_header *) block - 1;
+      return block_size (h) - sizeof *h;
+    }
+  return block_size (block);
+}
+
 /* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
    moving it in the process.
    If successful, returns the new block; on failure, returns a
    null pointer.
    A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
-   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
+   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK).
+   A new block is charged to TAG. */
 void *
-realloc (void *old_block, size_t new_size) 
+realloc_tagged (void *old_block, size_t new_size, const char *tag) 
 {
   if (new_size == 0) 
     {
@@ -201,10 +294,10 @@ realloc (void *old_block, size_t new_size)
     }
   else 
     {
-      void *new_block = malloc (new_size);
+      void *new_block = alloc (new_size, tag, __builtin_return_address (0));
       if (old_block != NULL && new_block != NULL)
         {
-          size_t old_size = block_size (old_block);
+          size_t old_size = usable_size (old_block);
           size_t min_size = new_size < old_size ? new_size : old_size;
           memcpy (new_block, old_block, min_size);
           free (old_block);
@@ -220,20 +313,42 @@ free (void *p)
 {
   if (p != NULL)
     {
-      struct block *b = p;
-      struct arena *a = block_to_arena (b);
-      struct desc *d = a->desc;
+      struct block *b;
+      struct arena *a;
+      struct desc *d;
+
+      if (memtag_enabled)
+        {
+          struct tag_header *h = (struct tag_header *) p - 1;
+          memtag_charge (h->tag, h->site,
+                         -(long) (block_size (h) - sizeof *h), 0);
+          p = h;
+        }
+      b = p;
+      a = block_to_arena (b);
+      d = a->desc;
       
       if (d != NULL) 
         {
           /* It's a normal block.  We handle it here. */
+          enum intr_level old_level;
+          bool stashed;
 
 #ifndef NDEBUG
           /* Clear the block to help detect use-after-free bugs. */
           memset (b, 0xcc, d->block_size);
 #endif
+
+          /* Stash the block in the magazine, if there is room. */
+          old_level = intr_disable ();
+          stashed = d->mag.cnt < MAG_SIZE;
+          if (stashed)
+            d->mag.blocks[d->mag.cnt++] = b;
+          intr_set_level (old_level);
+          if (stashed)
+            return;
   
-          lock_acquire (&d->lock);
+          adaptive_lock_acquire (&d->lock);
 
           /* Add block to free list. */
           list_push_front (&d->free_list, &b->free_elem);
@@ -250,9 +365,10 @@ free (void *p)
                   list_remove (&b->free_elem);
                 }
               palloc_free_page (a);
+              d->arena_cnt--;
             }
 
-          lock_release (&d->lock);
+          adaptive_lock_release (&d->lock);
         }
       else
         {
@@ -263,6 +379,43 @@ free (void *p)
     }
 }
 
+/* Stores the usage of each descriptor in ST.  Blocks in a
+   magazine count as free. */
+void
+malloc_vmstat (struct vmstat *st)
+{
+  size_t i;
+
+  st->class_cnt = desc_cnt < VMSTAT_CLASSES ? desc_cnt : VMSTAT_CLASSES;
+  for (i = 0; i < st->class_cnt; i++)
+    {
+      struct desc *d = &descs[i];
+      struct vmstat_class *c = &st->classes[i];
+
+      adaptive_lock_acquire (&d->lock);
+      c->block_size = d->block_size;
+      c->arenas = d->arena_cnt;
+      c->free = list_size (&d->free_list) + d->mag.cnt;
+      c->used = d->arena_cnt * d->blocks_per_arena - c->free;
+      adaptive_lock_release (&d->lock);
+    }
+}
+
+/* Returns the smallest descriptor whose blocks hold SIZE bytes,
+   or a null pointer if SIZE is too big for any.  Block sizes are
+   the powers of 2 from 16 bytes, so the descriptor index is
+   computed from the most significant bit of SIZE - 1. */
+static struct desc *
+size_to_desc (size_t size) 
+{
+  size_t idx;
+
+  ASSERT (size > 0);
+
+  idx = size <= 16 ? 0 : 28 - __builtin_clz (size - 1);
+  return idx < desc_cnt ? &descs[idx] : NULL;
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
@@ -5,9 +5,19 @@
 #include <stddef.h>
 
 void malloc_init (void);
-void *malloc (size_t) __attribute__ ((malloc));
-void *calloc (size_t, size_t) __attribute__ ((malloc));
-void *realloc (void *, size_t);
+void *malloc_tagged (size_t, const char *tag) __attribute__ ((malloc));
+void *calloc_tagged (size_t, size_t, const char *tag)
+  __attribute__ ((malloc));
+void *realloc_tagged (void *, size_t, const char *tag);
 void free (void *);
 
+struct vmstat;
+void malloc_vmstat (struct vmstat *);
+
+/* Allocations are tagged with the calling source file.  See
+   threads/memtag.h. */
+#define malloc(SIZE) malloc_tagged (SIZE, __FILE__)
+#define calloc(CNT, SIZE) calloc_tagged (CNT, SIZE, __FILE__)
+#define realloc(BLOCK, SIZE) realloc_tagged (BLOCK, SIZE, __FILE__)
+
 #endif /* threads/malloc.h */
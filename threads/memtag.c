@@ -0,0 +1,195 @@
+#include "threads/memtag.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Allocation tags.  See memtag.h for the idea.
+
+   The totals are kept in two hash tables with linear probing,
+   one by tag and one by call site, with interrupts off, since
+   malloc() may be called with them off.  Tags and sites beyond
+   the size of their table are lumped together in its last
+   entry, whose key is a null pointer.  The table of sites is too
+   big for the kernel image, so memtag_init() allocates it from
+   the kernel pool, and only if tags are enabled. */
+
+/* Usage by one tag. */
+struct tag_usage
+  {
+    const char *tag;            /* Source file, or null for the rest. */
+    long bytes;                 /* Bytes of malloc() blocks held. */
+    long peak_bytes;            /* Most bytes held at once. */
+    long blocks;                /* Number of malloc() blocks held. */
+    long pages;                 /* Pages held. */
+    long peak_pages;            /* Most pages held at once. */
+  };
+
+/* Usage by one call site. */
+struct site_usage
+  {
+    void *site;                 /* Return address, or null for the rest. */
+    const char *tag;            /* Its tag. */
+    long bytes;                 /* Bytes of malloc() blocks held. */
+    long blocks;                /* Number of malloc() blocks held. */
+    long pages;                 /* Pages held. */
+  };
+
+#define TAG_CNT 64
+#define SITE_CNT 512
+#define SITE_PAGES DIV_ROUND_UP (SITE_CNT * sizeof (struct site_usage), PGSIZE)
+static struct tag_usage tags[TAG_CNT];
+static struct site_usage *sites;
+
+/* Number of call sites printed by memtag_print_stats(). */
+#define SITES_PRINTED 10
+
+bool memtag_enabled;
+
+/* Allocates the table of call sites, if tags are enabled.  Must be
+   called right after palloc_init(). */
+void
+memtag_init (void)
+{
+  if (memtag_enabled)
+    sites = palloc_get_multiple (PAL_ASSERT | PAL_ZERO, SITE_PAGES);
+}
+
+/* Returns the entry for KEY in the table of CNT entries of SIZE
+   bytes at TABLE, whose keys are pointers at their start, adding
+   it if need be, or the last entry if the table is full.  Must be
+   called with interrupts off. */
+static void *
+lookup (void *table, size_t cnt, size_t size, const void *key)
+{
+  uint8_t *base = table;
+  size_t i = ((uintptr_t) key >> 2) % (cnt - 1);
+  size_t probe;
+
+  for (probe = 0; probe < cnt - 1; probe++)
+    {
+      const void **entry = (const void **) (base + i * size);
+
+      if (*entry == key)
+        return entry;
+      if (*entry == NULL)
+        {
+          *entry = key;
+          return entry;
+        }
+      i = (i + 1) % (cnt - 1);
+    }
+  return base + (cnt - 1) * size;
+}
+
+/* Charges BYTES of malloc() blocks and PAGES pages, either of
+   which may be negative for a release, to TAG and to call site
+   SITE.  A block counts as one block, whatever its size. */
+void
+memtag_charge (const char *tag, void *site, long bytes, long pages)
+{
+  enum intr_level old_level;
+  struct tag_usage *t;
+  struct site_usage *s;
+  long blocks = bytes > 0 ? 1 : bytes < 0 ? -1 : 0;
+
+  ASSERT (memtag_enabled);
+
+  old_level = intr_disable ();
+  t = lookup (tags, TAG_CNT, sizeof *t, tag);
+  t->bytes += bytes;
+  t->blocks += blocks;
+  t->pages += pages;
+  if (t->bytes > t->peak_bytes)
+    t->peak_bytes = t->bytes;
+  if (t->pages > t->peak_pages)
+    t->peak_pages = t->pages;
+
+  /* Not for the pages of the table of sites itself. */
+  if (sites != NULL)
+    {
+      s = lookup (sites, SITE_CNT, sizeof *s, site);
+      s->tag = s->site != NULL ? tag : NULL;
+      s->bytes += bytes;
+      s->blocks += blocks;
+      s->pages += pages;
+    }
+  intr_set_level (old_level);
+}
+
+/* Returns TAG without the leading "../" of the paths that the
+   build passes to the compiler, or "others" for the null tag. */
+static const char *
+tag_name (const char *tag)
+{
+  if (tag == NULL)
+    return "others";
+  while (tag[0] == '.' && tag[1] == '.' && tag[2] == '/')
+    tag += 3;
+  return tag;
+}
+
+/* Returns the amount of memory that site S holds, in bytes. */
+static long
+site_size (const struct site_usage *s)
+{
+  return s->bytes + s->pages * (long) PGSIZE;
+}
+
+/* Prints the memory held and the peak for each tag, and the
+   SITES_PRINTED call sites holding the most memory, which at
+   shutdown are where to look for leaks. */
+void
+memtag_print_stats (void)
+{
+  struct site_usage top[SITES_PRINTED];
+  enum intr_level old_level;
+  size_t i, j;
+
+  if (!memtag_enabled)
+    return;
+
+  for (i = 0; i < TAG_CNT; i++)
+    {
+      struct tag_usage t;
+
+      old_level = intr_disable ();
+      t = tags[i];
+      intr_set_level (old_level);
+      if (t.peak_bytes == 0 && t.peak_pages == 0)
+        continue;
+      printf ("Memory: %s: %ld bytes in %ld blocks (peak %ld), "
+              "%ld pages (peak %ld)\n", tag_name (t.tag), t.bytes, t.blocks,
+              t.peak_bytes, t.pages, t.peak_pages);
+    }
+
+  /* Pick the largest holders by insertion into TOP. */
+  memset (top, 0, sizeof top);
+  old_level = intr_disable ();
+  for (i = 0; sites != NULL && i < SITE_CNT; i++)
+    {
+      const struct site_usage *s = &sites[i];
+
+      if (site_size (s) <= 0)
+        continue;
+      j = SITES_PRINTED;
+      while (j > 0 && site_size (&top[j - 1]) < site_size (s))
+        {
+          if (j < SITES_PRINTED)
+            top[j] = top[j - 1];
+          j--;
+        }
+      if (j < SITES_PRINTED)
+        top[j] = *s;
+    }
+  intr_set_level (old_level);
+
+  for (i = 0; i < SITES_PRINTED && site_size (&top[i]) > 0; i++)
+    printf ("Memory: %p (%s) holds %ld bytes in %ld blocks, %ld pages\n",
+            top[i].site, tag_name (top[i].tag), top[i].bytes, top[i].blocks,
+            top[i].pages);
+}
@@ -0,0 +1,36 @@
+#ifndef THREADS_MEMTAG_H
+#define THREADS_MEMTAG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Allocation tags.
+
+   malloc(), calloc(), realloc(), palloc_get_page() and
+   palloc_get_multiple() are macros that pass the name of the
+   source file calling them, which serves as the tag of the
+   subsystem that the memory is for: "filesys/inode.c" for
+   inodes, "userprog/pagedir.c" for page tables, and so on.  If
+   memtag_enabled, each allocation also records its tag and the
+   address it was called from, in a header before a malloc()
+   block or in a table beside the page pool, and the bytes and
+   pages held are totalled by tag and by call site.  What is
+   still held at shutdown, or whenever memtag_print_stats() is
+   called, shows who holds kernel memory, and the peaks show how
+   much each subsystem needed at once.
+
+   Pages that malloc() takes for its arenas and big blocks are
+   charged to "threads/malloc.c", so that its total, less the
+   bytes charged to the other tags, is what malloc() loses to
+   rounding and free blocks. */
+
+/* If true, keep allocation tags.  Must be set before
+   palloc_init(), and not changed after.
+   Controlled by kernel command-line option "-mem-tags". */
+extern bool memtag_enabled;
+
+void memtag_init (void);
+void memtag_charge (const char *tag, void *site, long bytes, long pages);
+void memtag_print_stats (void);
+
+#endif /* threads/memtag.h */
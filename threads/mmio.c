@@ -0,0 +1,49 @@
+#include "threads/mmio.h"
+#include <debug.h>
+#include <round.h>
+#include "threads/init.h"
+#include "threads/loader.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/vaddr.h"
+
+/* Device registers and other memory outside RAM, which ptov()
+   does not reach, are mapped into the top 4 MB of the kernel
+   address space, one after another, uncached, for good.  All of
+   it shares one page table, which every page directory copies
+   from init_page_dir, so the first mapping must be made before
+   any process starts and later ones then show up everywhere. */
+#define MMIO_BASE ((uint8_t *) (uintptr_t) -PTSPAN)
+#define MMIO_PAGES (PTSPAN / PGSIZE)
+
+/* Number of pages mapped so far. */
+static size_t mmio_pages;
+
+/* Maps the SIZE bytes at physical address PADDR, uncached, and
+   returns their kernel virtual address.  Panics if the area for
+   such mappings is full. */
+void *
+mmio_map (uintptr_t paddr, size_t size)
+{
+  size_t ofs = paddr % PGSIZE;
+  size_t page_cnt = DIV_ROUND_UP (ofs + size, PGSIZE);
+  uint32_t *pde = &init_page_dir[pd_no (MMIO_BASE)];
+  uint32_t *pt;
+  uint8_t *vaddr;
+  size_t i;
+
+  ASSERT (PHYS_BASE + init_ram_pages * PGSIZE <= (void *) MMIO_BASE);
+
+  if (page_cnt > MMIO_PAGES - mmio_pages)
+    PANIC ("out of address space for device memory");
+  vaddr = MMIO_BASE + mmio_pages * PGSIZE;
+
+  if (*pde == 0)
+    *pde = pde_create (palloc_get_page (PAL_ASSERT | PAL_ZERO));
+  pt = pde_get_pt (*pde);
+  for (i = 0; i < page_cnt; i++)
+    pt[mmio_pages + i] = (((paddr - ofs) + i * PGSIZE)
+                          | PTE_PCD | PTE_PWT | PTE_P | PTE_W);
+  mmio_pages += page_cnt;
+  return vaddr + ofs;
+}
@@ -0,0 +1,9 @@
+#ifndef THREADS_MMIO_H
+#define THREADS_MMIO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+void *mmio_map (uintptr_t paddr, size_t size);
+
+#endif /* threads/mmio.h */
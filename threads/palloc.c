@@ -7,9 +7,15 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <vmstat.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
+#include "threads/memtag.h"
+#include "threads/percpu.h"
+#include "threads/shrinker.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "threads/vmstat.h"
 
 /* Page allocator.  Hands out memory in page-size (or
    page-multiple) chunks.  See malloc.h for an allocator that
@@ -23,22 +29,118 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Within a pool, pages are handed out by a binary buddy
+   allocator: free pages form blocks of 2**K pages aligned to 2**K
+   pages in physical memory, on one free list per order K, and a
+   freed block merges with its buddy whenever that is free too, so
+   that allocating and freeing take O(log n).  A request that is
+   not a power of 2 takes a block of the next order and gives back
+   its tail.  Since blocks are aligned physically rather than from
+   the pool base, a block of 1024 pages can be mapped by a single
+   4 MB page directory entry.  The kernel command-line option
+   "-palloc-ff" selects the original first-fit scan of the
+   used_map instead.
+
+   Zeroing a page for PAL_ZERO costs its caller a 4 kB memset().
+   The idle thread does that work ahead of time instead, through
+   palloc_zero_idle(): it takes free pages out of each pool,
+   zeroes them with interrupts on, and keeps up to ZEROED_MAX of
+   them on the pool's list of zeroed pages, where single-page
+   PAL_ZERO requests look first.  Each zeroed page is linked
+   through its first bytes, which are cleared again when it is
+   handed out.  Zeroed pages count as free, and are given back to
+   the pool whenever an allocation would fail without them.
+
+   Most requests are for a single page, and each CPU keeps a stack
+   of up to PCP_HIGH free pages of each pool in front of it, so that
+   palloc_get_page() and palloc_free_page() usually only push or pop
+   it, with interrupts off but without the pool lock.  An empty stack
+   is refilled with PCP_BATCH pages, a block of them if the pool has
+   one, and a full one gives back its PCP_BATCH coldest pages, each
+   under a single hold of the lock.  Like zeroed pages, cached pages
+   are allocated in used_map but count as free, and all CPUs' caches
+   are drained back to the pool when an allocation would fail
+   without them.
+
+   With allocation tags (see memtag.h), each pool also records the
+   tag and call site of each allocated page, in arrays after its
+   order_map, so that a page is credited to whoever took it
+   however it is freed, even a few pages at a time. */
+
+/* Number of buddy orders, enough for 4 GB of pages. */
+#define BUDDY_ORDERS 21
+
+/* Most zeroed pages kept in each pool. */
+#define ZEROED_MAX 32
+
+/* Most free pages in a CPU's cache of a pool, and how many it
+   takes from or gives back to the pool at once. */
+#define PCP_HIGH 32
+#define PCP_BATCH 16
+
+/* A CPU's cache of free pages of a pool, most recently freed on
+   top.  Used with interrupts off, by that CPU, or by pcp_drain(). */
+struct pcp
+  {
+    size_t cnt;                         /* Number of pages. */
+    void *pages[PCP_HIGH];              /* The pages. */
+  }
+__attribute__ ((aligned (CACHE_LINE_SIZE)));
+
+/* Header of a free buddy block, kept in its first page. */
+struct buddy_block
+  {
+    struct list_elem elem;              /* Element in free_lists. */
+  };
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
+    struct spinlock lock;               /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
     uint8_t *base;                      /* Base of pool. */
+    size_t page_cnt;                    /* Number of pages in pool. */
+    size_t free_cnt;                    /* Number of free pages, not
+                                           counting those in PCP. */
+    uint8_t *order_map;                 /* 1 + order of free block heads,
+                                           0 for other pages. */
+    struct list free_lists[BUDDY_ORDERS]; /* Free blocks per order. */
+    struct list zeroed;                 /* Zeroed pages, allocated in
+                                           used_map but free. */
+    size_t zeroed_cnt;                  /* Number of pages in ZEROED. */
+    const char **tags;                  /* Tag of each page in use. */
+    void **sites;                       /* Call site of each page in use. */
+    struct pcp pcp[CPU_CNT];            /* Each CPU's free pages. */
   };
 
+/* If true, allocate first fit from the used_map instead of buddy.
+   Controlled by kernel command-line option "-palloc-ff". */
+bool palloc_first_fit;
+
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
+static void *get_multiple (enum palloc_flags, size_t page_cnt);
+static struct pool *pool_of (void *page);
 static bool page_from_pool (const struct pool *, void *page);
+static void tag_pages (void *pages, size_t page_cnt, const char *tag,
+                       void *site);
+static void untag_pages (void *pages, size_t page_cnt);
+static size_t buddy_alloc(struct pool *, size_t page_cnt);
+static void buddy_free(struct pool *, size_t page_idx, size_t page_cnt);
+static void buddy_free_block(struct pool *, size_t page_idx, int order);
+static size_t pool_alloc (struct pool *, size_t page_cnt);
+static void release_zeroed (struct pool *);
+static bool zero_ahead (struct pool *);
+static void *pcp_get (struct pool *);
+static void pcp_put (struct pool *, void *page);
+static void pcp_release (struct pool *, struct pcp *, size_t cnt);
+static size_t pcp_drain (struct pool *);
+static size_t pcp_free_cnt (const struct pool *);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -61,25 +163,90 @@ palloc_init (size_t user_page_limit)
              user_pages, "user pool");
 }
 
-/* Obtains and returns a group of PAGE_CNT contiguous free pages.
+/* Obtains and returns a group of PAGE_CNT contiguous free pages,
+   charged to TAG.
    If PAL_USER is set, the pages are obtained from the user pool,
    otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
    then the pages are filled with zeros.  If too few pages are
    available, returns a null pointer, unless PAL_ASSERT is set in
    FLAGS, in which case the kernel panics. */
 void *
-palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
+palloc_get_multiple_tagged (enum palloc_flags flags, size_t page_cnt,
+                            const char *tag)
+{
+  void *pages = get_multiple (flags, page_cnt);
+
+  if (pages != NULL && memtag_enabled)
+    tag_pages (pages, page_cnt, tag, __builtin_return_address (0));
+  return pages;
+}
+
+/* Obtains a single free page, charged to TAG, and returns its
+   kernel virtual address.
+   If PAL_USER is set, the page is obtained from the user pool,
+   otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
+   then the page is filled with zeros.  If no pages are
+   available, returns a null pointer, unless PAL_ASSERT is set in
+   FLAGS, in which case the kernel panics. */
+void *
+palloc_get_page_tagged (enum palloc_flags flags, const char *tag) 
+{
+  void *page = get_multiple (flags, 1);
+
+  if (page != NULL && memtag_enabled)
+    tag_pages (page, 1, tag, __builtin_return_address (0));
+  return page;
+}
+
+/* Does the work of palloc_get_multiple_tagged(), short of the
+   tagging. */
+static void *
+get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  bool shrunk = false;
   void *pages;
   size_t page_idx;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+ retry:
+  if (page_cnt == 1 && !((flags & PAL_ZERO) && pool->zeroed_cnt > 0))
+    {
+      pages = pcp_get (pool);
+      if (pages != NULL)
+        {
+          if (flags & PAL_ZERO)
+            {
+              memset (pages, 0, PGSIZE);
+              vmstat_count (VMSTAT_ZEROED);
+            }
+          return pages;
+        }
+    }
+
+  spinlock_acquire (&pool->lock);
+  if (page_cnt == 1 && (flags & PAL_ZERO) && !list_empty (&pool->zeroed))
+    {
+      struct list_elem *e = list_pop_front (&pool->zeroed);
+      pool->zeroed_cnt--;
+      pool->free_cnt--;
+      spinlock_release (&pool->lock);
+
+      memset (e, 0, sizeof *e);
+      vmstat_count (VMSTAT_PREZEROED);
+      return e;
+    }
+  page_idx = pool_alloc (pool, page_cnt);
+  if (page_idx == BITMAP_ERROR && pool->zeroed_cnt > 0)
+    {
+      release_zeroed (pool);
+      page_idx = pool_alloc (pool, page_cnt);
+    }
+  if (page_idx != BITMAP_ERROR)
+    pool->free_cnt -= page_cnt;
+  spinlock_release (&pool->lock);
 
   if (page_idx != BITMAP_ERROR)
     pages = pool->base + PGSIZE * page_idx;
@@ -89,10 +256,23 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   if (pages != NULL) 
     {
       if (flags & PAL_ZERO)
-        memset (pages, 0, PGSIZE * page_cnt);
+        {
+          memset (pages, 0, PGSIZE * page_cnt);
+          vmstat_count (VMSTAT_ZEROED);
+        }
     }
   else 
     {
+      /* The CPUs' caches of free pages may hold enough, and kernel
+         caches may be able to give some pages back. */
+      if (pcp_drain (pool) > 0)
+        goto retry;
+      if (!(flags & PAL_USER) && !shrunk)
+        {
+          shrunk = true;
+          if (shrink_memory (page_cnt) > 0)
+            goto retry;
+        }
       if (flags & PAL_ASSERT)
         PANIC ("palloc_get: out of pages");
     }
@@ -100,19 +280,6 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   return pages;
 }
 
-/* Obtains a single free page and returns its kernel virtual
-   address.
-   If PAL_USER is set, the page is obtained from the user pool,
-   otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
-   then the page is filled with zeros.  If no pages are
-   available, returns a null pointer, unless PAL_ASSERT is set in
-   FLAGS, in which case the kernel panics. */
-void *
-palloc_get_page (enum palloc_flags flags) 
-{
-  return palloc_get_multiple (flags, 1);
-}
-
 /* Frees the PAGE_CNT pages starting at PAGES. */
 void
 palloc_free_multiple (void *pages, size_t page_cnt) 
@@ -124,21 +291,32 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   if (pages == NULL || page_cnt == 0)
     return;
 
-  if (page_from_pool (&kernel_pool, pages))
-    pool = &kernel_pool;
-  else if (page_from_pool (&user_pool, pages))
-    pool = &user_pool;
-  else
-    NOT_REACHED ();
-
+  pool = pool_of (pages);
   page_idx = pg_no (pages) - pg_no (pool->base);
+  if (memtag_enabled)
+    untag_pages (pages, page_cnt);
 
 #ifndef NDEBUG
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  if (page_cnt == 1)
+    {
+      /* Pages in the per-CPU caches stay marked used, so this
+         catches a page already given back to the pool, and
+         pcp_put() catches one still in a cache. */
+      ASSERT (bitmap_test (pool->used_map, page_idx));
+      pcp_put (pool, pages);
+      return;
+    }
+
+  spinlock_acquire (&pool->lock);
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  if (!palloc_first_fit)
+    buddy_free (pool, page_idx, page_cnt);
+  pool->free_cnt += page_cnt;
+  spinlock_release (&pool->lock);
 }
 
 /* Frees the page at PAGE. */
@@ -148,15 +326,84 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Zeroes a free page ahead of PAL_ZERO requests, if a pool is
+   short of zeroed pages.  Meant to be called by the idle thread,
+   with interrupts on.  Returns false if no page needed zeroing. */
+bool
+palloc_zero_idle (void)
+{
+  return zero_ahead (&kernel_pool) || zero_ahead (&user_pool);
+}
+
+/* Counts the free pages of pool P, storing the number of pages
+   in *PAGES and the number of free ones in *FREE. */
+static void
+pool_usage (struct pool *p, uint32_t *pages, uint32_t *free)
+{
+  spinlock_acquire (&p->lock);
+  *pages = p->page_cnt;
+  *free = p->free_cnt + pcp_free_cnt (p);
+  spinlock_release (&p->lock);
+}
+
+/* Returns the number of free pages in the user pool if PAL_USER
+   is set in FLAGS, otherwise in the kernel pool.  The count may
+   be out of date by the time it is used. */
+size_t
+palloc_free_cnt (enum palloc_flags flags)
+{
+  struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  return pool->free_cnt + pcp_free_cnt (pool);
+}
+
+/* Returns true if the page of RAM at kernel virtual address PAGE
+   may hold data: if it is outside both pools, allocated, or the
+   head of a free buddy block, which holds the block's list
+   element.  Other pages are free and hold nothing, so a snapshot
+   of memory can skip them (see filesys/snapshot.c).  Interrupts
+   must be off, so that the answer stays true. */
+bool
+palloc_page_live (void *page)
+{
+  struct pool *pool;
+  size_t page_idx;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (page_from_pool (&kernel_pool, page))
+    pool = &kernel_pool;
+  else if (page_from_pool (&user_pool, page))
+    pool = &user_pool;
+  else
+    return true;
+
+  page_idx = pg_no (page) - pg_no (pool->base);
+  return (bitmap_test (pool->used_map, page_idx)
+          || (!palloc_first_fit && pool->order_map[page_idx] != 0));
+}
+
+/* Stores the usage of the page pools in ST. */
+void
+palloc_vmstat (struct vmstat *st)
+{
+  pool_usage (&kernel_pool, &st->kernel_pages, &st->kernel_free);
+  pool_usage (&user_pool, &st->user_pages, &st->user_free);
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
+  /* We'll put the pool's used_map at its base, followed by its
+     order_map and, with allocation tags, its tags and sites.
+     Calculate the space needed for them all and subtract it from
+     the pool's size. */
+  size_t bm_size = bitmap_buf_size (page_cnt);
+  size_t tags_size = memtag_enabled ? 2 * sizeof (void *) * page_cnt : 0;
+  size_t bm_pages = DIV_ROUND_UP (bm_size + page_cnt + tags_size, PGSIZE);
+  int i;
+
   if (bm_pages > page_cnt)
     PANIC ("Not enough memory in %s for bitmap.", name);
   page_cnt -= bm_pages;
@@ -164,9 +411,203 @@ init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
   /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
+  spinlock_init (&p->lock);
+  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_size);
   p->base = base + bm_pages * PGSIZE;
+  p->page_cnt = page_cnt;
+  p->free_cnt = page_cnt;
+  p->order_map = (uint8_t *) base + bm_size;
+  memset (p->order_map, 0, page_cnt);
+  if (memtag_enabled)
+    {
+      p->tags = (const char **) ROUND_UP ((uintptr_t) p->order_map + page_cnt,
+                                          sizeof (void *));
+      p->sites = (void **) (p->tags + page_cnt);
+    }
+  for (i = 0; i < BUDDY_ORDERS; i++)
+    list_init (&p->free_lists[i]);
+  list_init (&p->zeroed);
+  p->zeroed_cnt = 0;
+  for (i = 0; i < CPU_CNT; i++)
+    p->pcp[i].cnt = 0;
+  if (!palloc_first_fit)
+    buddy_free (p, 0, page_cnt);
+}
+
+/* Returns the free buddy block header of page PAGE_IDX in P. */
+static struct buddy_block *
+buddy_block (struct pool *p, size_t page_idx)
+{
+  return (struct buddy_block *) (p->base + PGSIZE * page_idx);
+}
+
+/**
+ * buddy_alloc - allocate pages from the buddy free lists
+ *
+ * @p: pointer to the pool
+ * @page_cnt: number of pages, nonzero
+ *
+ * Take a free block of the smallest order holding the given number
+ * of pages, splitting larger blocks as needed, and give back the
+ * pages beyond page_cnt.  Return the index of its first page, or
+ * BITMAP_ERROR if no block is large enough.
+ * Must be called with the pool lock held.
+*/
+static size_t buddy_alloc(struct pool *p, size_t page_cnt)
+{
+	struct buddy_block *b;
+	size_t page_idx;
+	int order;
+	int i;
+
+	ASSERT(page_cnt > 0);
+
+	/* Smallest order holding page_cnt pages. */
+	order = page_cnt > 1 ? 32 - __builtin_clz(page_cnt - 1) : 0;
+	if (order >= BUDDY_ORDERS)
+		return BITMAP_ERROR;
+
+	/* Smallest order with a free block. */
+	for (i = order; i < BUDDY_ORDERS; i++)
+		if (!list_empty(&p->free_lists[i]))
+			break;
+	if (i == BUDDY_ORDERS)
+		return BITMAP_ERROR;
+
+	b = list_entry(list_pop_front(&p->free_lists[i]), struct buddy_block,
+		       elem);
+	page_idx = ((uint8_t *)b - p->base) / PGSIZE;
+	p->order_map[page_idx] = 0;
+
+	/* Split down to the order, keeping the lower halves. */
+	while (i > order) {
+		i--;
+		p->order_map[page_idx + ((size_t)1 << i)] = i + 1;
+		list_push_front(&p->free_lists[i],
+				&buddy_block(p, page_idx +
+					     ((size_t)1 << i))->elem);
+	}
+
+	/* Give back the tail. */
+	if (page_cnt < (size_t)1 << order)
+		buddy_free(p, page_idx + page_cnt,
+			   ((size_t)1 << order) - page_cnt);
+	return page_idx;
+}
+
+/**
+ * buddy_free - free a range of pages to the buddy free lists
+ *
+ * @p: pointer to the pool
+ * @page_idx: index of the first page
+ * @page_cnt: number of pages
+ *
+ * Split the given range into maximal aligned blocks and free each.
+ * Must be called with the pool lock held.
+*/
+static void buddy_free(struct pool *p, size_t page_idx, size_t page_cnt)
+{
+	int order;
+
+	while (page_cnt > 0) {
+		/* Largest order aligned at page_idx that fits. */
+		size_t pfn = pg_no(p->base) + page_idx;
+
+		order = pfn ? __builtin_ctz(pfn) : BUDDY_ORDERS - 1;
+		if (order > BUDDY_ORDERS - 1)
+			order = BUDDY_ORDERS - 1;
+		while ((size_t)1 << order > page_cnt)
+			order--;
+		buddy_free_block(p, page_idx, order);
+		page_idx += (size_t)1 << order;
+		page_cnt -= (size_t)1 << order;
+	}
+}
+
+/**
+ * buddy_free_block - free an aligned block to the buddy free lists
+ *
+ * @p: pointer to the pool
+ * @page_idx: index of the first page, physically aligned to 2**order
+ * @order: order of the block
+ *
+ * Merge the given block with its buddy for as long as that is a
+ * free block of the same order, then put it on its free list.
+ * Must be called with the pool lock held.
+*/
+static void buddy_free_block(struct pool *p, size_t page_idx, int order)
+{
+	size_t base = pg_no(p->base);
+	size_t buddy;
+
+	ASSERT((base + page_idx) % ((size_t)1 << order) == 0);
+
+	for (; order < BUDDY_ORDERS - 1; order++) {
+		/* Below the pool, BUDDY wraps around to a huge index. */
+		buddy = ((base + page_idx) ^ ((size_t)1 << order)) - base;
+		if (buddy >= p->page_cnt || p->order_map[buddy] != order + 1)
+			break;
+		/* Take the buddy off its list and merge. */
+		list_remove(&buddy_block(p, buddy)->elem);
+		p->order_map[buddy] = 0;
+		if (buddy < page_idx)
+			page_idx = buddy;
+	}
+	p->order_map[page_idx] = order + 1;
+	list_push_front(&p->free_lists[order],
+			&buddy_block(p, page_idx)->elem);
+}
+
+/* Returns the pool that PAGE was allocated from. */
+static struct pool *
+pool_of (void *page)
+{
+  if (page_from_pool (&kernel_pool, page))
+    return &kernel_pool;
+  else if (page_from_pool (&user_pool, page))
+    return &user_pool;
+  NOT_REACHED ();
+}
+
+/* Records TAG and SITE for each of the PAGE_CNT pages starting
+   at PAGES, and charges the pages to them. */
+static void
+tag_pages (void *pages, size_t page_cnt, const char *tag, void *site)
+{
+  struct pool *pool = pool_of (pages);
+  size_t page_idx = pg_no (pages) - pg_no (pool->base);
+  size_t i;
+
+  for (i = 0; i < page_cnt; i++)
+    {
+      pool->tags[page_idx + i] = tag;
+      pool->sites[page_idx + i] = site;
+    }
+  memtag_charge (tag, site, 0, page_cnt);
+}
+
+/* Credits each of the PAGE_CNT pages starting at PAGES to the tag
+   and site recorded for it, a run of pages with the same ones at
+   a time. */
+static void
+untag_pages (void *pages, size_t page_cnt)
+{
+  struct pool *pool = pool_of (pages);
+  size_t page_idx = pg_no (pages) - pg_no (pool->base);
+  size_t end = page_idx + page_cnt;
+
+  while (page_idx < end)
+    {
+      const char *tag = pool->tags[page_idx];
+      void *site = pool->sites[page_idx];
+      size_t run = 1;
+
+      while (page_idx + run < end && pool->tags[page_idx + run] == tag
+             && pool->sites[page_idx + run] == site)
+        run++;
+      memtag_charge (tag, site, 0, -(long) run);
+      page_idx += run;
+    }
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -176,7 +617,189 @@ page_from_pool (const struct pool *pool, void *page)
 {
   size_t page_no = pg_no (page);
   size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  size_t end_page = start_page + pool->page_cnt;
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Allocates PAGE_CNT contiguous pages of P in its used_map and
+   returns the index of the first, or BITMAP_ERROR if there are
+   not that many free.  P must be locked. */
+static size_t
+pool_alloc (struct pool *p, size_t page_cnt)
+{
+  size_t page_idx;
+
+  if (palloc_first_fit)
+    return bitmap_scan_and_flip (p->used_map, 0, page_cnt, false);
+  page_idx = buddy_alloc (p, page_cnt);
+  if (page_idx != BITMAP_ERROR)
+    bitmap_set_multiple (p->used_map, page_idx, page_cnt, true);
+  return page_idx;
+}
+
+/* Gives the zeroed pages of P back to it as ordinary free pages.
+   P must be locked. */
+static void
+release_zeroed (struct pool *p)
+{
+  while (!list_empty (&p->zeroed))
+    {
+      void *page = list_pop_front (&p->zeroed);
+      size_t page_idx = pg_no (page) - pg_no (p->base);
+
+      bitmap_reset (p->used_map, page_idx);
+      if (!palloc_first_fit)
+        buddy_free (p, page_idx, 1);
+    }
+  p->zeroed_cnt = 0;
+}
+
+/* Zeroes a free page of P and adds it to P's zeroed pages, if P
+   has fewer than ZEROED_MAX of them and more than that many other
+   free pages.  Returns true if a page was zeroed. */
+static bool
+zero_ahead (struct pool *p)
+{
+  size_t page_idx;
+  void *page;
+
+  spinlock_acquire (&p->lock);
+  if (p->zeroed_cnt >= ZEROED_MAX
+      || p->free_cnt - p->zeroed_cnt <= ZEROED_MAX)
+    page_idx = BITMAP_ERROR;
+  else
+    page_idx = pool_alloc (p, 1);
+  if (page_idx != BITMAP_ERROR)
+    p->free_cnt--;
+  spinlock_release (&p->lock);
+  if (page_idx == BITMAP_ERROR)
+    return false;
+
+  page = p->base + page_idx * PGSIZE;
+  memset (page, 0, PGSIZE);
+
+  spinlock_acquire (&p->lock);
+  list_push_front (&p->zeroed, page);
+  p->zeroed_cnt++;
+  p->free_cnt++;
+  spinlock_release (&p->lock);
+  return true;
+}
+
+/* Pops a free page of POOL off the running CPU's cache, refilling
+   the cache from POOL first if it is empty.  Returns a null
+   pointer if both are empty. */
+static void *
+pcp_get (struct pool *pool)
+{
+  enum intr_level old_level = intr_disable ();
+  struct pcp *c = &pool->pcp[cpu_id ()];
+  void *page = NULL;
+
+  if (c->cnt == 0)
+    {
+      size_t page_idx;
+      size_t i;
+
+      spinlock_acquire (&pool->lock);
+      page_idx = pool_alloc (pool, PCP_BATCH);
+      if (page_idx != BITMAP_ERROR)
+        {
+          /* Push the block so that it is handed out in order. */
+          for (i = PCP_BATCH; i-- > 0; )
+            c->pages[c->cnt++] = pool->base + PGSIZE * (page_idx + i);
+        }
+      else
+        while (c->cnt < PCP_BATCH
+               && (page_idx = pool_alloc (pool, 1)) != BITMAP_ERROR)
+          c->pages[c->cnt++] = pool->base + PGSIZE * page_idx;
+      pool->free_cnt -= c->cnt;
+      spinlock_release (&pool->lock);
+    }
+  if (c->cnt > 0)
+    page = c->pages[--c->cnt];
+  intr_set_level (old_level);
+  return page;
+}
+
+/* Pushes PAGE, a free page of POOL, onto the running CPU's cache,
+   first giving back the PCP_BATCH pages at the bottom of the cache
+   to POOL if it is full. */
+static void
+pcp_put (struct pool *pool, void *page)
+{
+  enum intr_level old_level = intr_disable ();
+  struct pcp *c = &pool->pcp[cpu_id ()];
+#ifndef NDEBUG
+  size_t i;
+
+  for (i = 0; i < c->cnt; i++)
+    ASSERT (c->pages[i] != page);
+#endif
+
+  if (c->cnt == PCP_HIGH)
+    pcp_release (pool, c, PCP_BATCH);
+  c->pages[c->cnt++] = page;
+  intr_set_level (old_level);
+}
+
+/* Gives the CNT pages at the bottom of cache C back to POOL.
+   Interrupts must be off. */
+static void
+pcp_release (struct pool *pool, struct pcp *c, size_t cnt)
+{
+  size_t i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (cnt <= c->cnt);
+
+  spinlock_acquire (&pool->lock);
+  for (i = 0; i < cnt; i++)
+    {
+      size_t page_idx = pg_no (c->pages[i]) - pg_no (pool->base);
+
+      bitmap_reset (pool->used_map, page_idx);
+      if (!palloc_first_fit)
+        buddy_free (pool, page_idx, 1);
+    }
+  pool->free_cnt += cnt;
+  spinlock_release (&pool->lock);
+
+  c->cnt -= cnt;
+  memmove (c->pages, c->pages + cnt, c->cnt * sizeof *c->pages);
+}
+
+/* Gives the pages in every CPU's cache of POOL back to it, so
+   that they may merge into larger blocks, and returns how many
+   there were.  Only the bootstrap CPU is up, so turning
+   interrupts off keeps all the caches still; with more, each
+   would have to be asked to drain its own. */
+static size_t
+pcp_drain (struct pool *pool)
+{
+  enum intr_level old_level = intr_disable ();
+  size_t cnt = 0;
+  int i;
+
+  for (i = 0; i < CPU_CNT; i++)
+    {
+      cnt += pool->pcp[i].cnt;
+      pcp_release (pool, &pool->pcp[i], pool->pcp[i].cnt);
+    }
+  intr_set_level (old_level);
+  return cnt;
+}
+
+/* Returns the number of free pages in the CPUs' caches of
+   POOL. */
+static size_t
+pcp_free_cnt (const struct pool *pool)
+{
+  size_t cnt = 0;
+  int i;
+
+  for (i = 0; i < CPU_CNT; i++)
+    cnt += pool->pcp[i].cnt;
+  return cnt;
+}
@@ -1,6 +1,7 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <stdbool.h>
 #include <stddef.h>
 
 /* How to allocate pages. */
@@ -11,10 +12,27 @@ enum palloc_flags
     PAL_USER = 004              /* User page. */
   };
 
+/* If true, allocate first fit instead of from buddy free lists.
+   Controlled by kernel command-line option "-palloc-ff". */
+extern bool palloc_first_fit;
+
 void palloc_init (size_t user_page_limit);
-void *palloc_get_page (enum palloc_flags);
-void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
+void *palloc_get_page_tagged (enum palloc_flags, const char *tag);
+void *palloc_get_multiple_tagged (enum palloc_flags, size_t page_cnt,
+                                  const char *tag);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+size_t palloc_free_cnt (enum palloc_flags);
+bool palloc_zero_idle (void);
+bool palloc_page_live (void *page);
+
+struct vmstat;
+void palloc_vmstat (struct vmstat *);
+
+/* Allocations are tagged with the calling source file.  See
+   threads/memtag.h. */
+#define palloc_get_page(FLAGS) palloc_get_page_tagged (FLAGS, __FILE__)
+#define palloc_get_multiple(FLAGS, PAGE_CNT) \
+        palloc_get_multiple_tagged (FLAGS, PAGE_CNT, __FILE__)
 
 #endif /* threads/palloc.h */
@@ -0,0 +1,76 @@
+#ifndef THREADS_PERCPU_H
+#define THREADS_PERCPU_H
+
+#include <atomic.h>
+#include <stdint.h>
+
+/* Number of CPUs scheduled.  Only the bootstrap CPU is brought up
+   for now, but the scheduler state is kept per CPU so that others
+   only need their own struct cpu. */
+#define CPU_CNT 1
+
+/* Size of a CPU cache line, for laying out data touched by
+   different CPUs or on different paths. */
+#define CACHE_LINE_SIZE 64
+
+/* Returns the index of the running CPU, less than CPU_CNT. */
+static inline unsigned
+cpu_id (void)
+{
+  /* Only the bootstrap CPU is up. */
+  return 0;
+}
+
+/* Per-CPU counter.  Each CPU adds to a slot of its own, in a cache
+   line of its own, so that counting neither turns interrupts off
+   nor takes a lock, nor bounces lines between CPUs.  Reading sums
+   the slots, which is exact once counting has stopped and a
+   snapshot while it goes on. */
+struct percpu_counter
+  {
+    struct
+      {
+        atomic64_t value;
+      }
+    __attribute__ ((aligned (CACHE_LINE_SIZE))) slots[CPU_CNT];
+  };
+
+/**
+ * percpu_counter_add - add to a per-CPU counter
+ *
+ * @c: pointer to the counter
+ * @n: amount to add
+*/
+static inline void percpu_counter_add(struct percpu_counter *c, uint64_t n)
+{
+	atomic64_add(&c->slots[cpu_id()].value, n);
+}
+
+/**
+ * percpu_counter_inc - increment a per-CPU counter
+ *
+ * @c: pointer to the counter
+*/
+static inline void percpu_counter_inc(struct percpu_counter *c)
+{
+	percpu_counter_add(c, 1);
+}
+
+/**
+ * percpu_counter_sum - read a per-CPU counter
+ *
+ * @c: pointer to the counter
+ *
+ * Return the sum of the slots of every CPU.
+*/
+static inline uint64_t percpu_counter_sum(struct percpu_counter *c)
+{
+	uint64_t sum = 0;
+	unsigned i;
+
+	for (i = 0; i < CPU_CNT; i++)
+		sum += atomic64_read(&c->slots[i].value);
+	return sum;
+}
+
+#endif /* threads/percpu.h */
@@ -0,0 +1,192 @@
+#include "threads/profile.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "devices/rtc.h"
+#include "devices/timer.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Sampling profiler.  Every sampling interrupt records the
+   address the CPU was interrupted at, and the running thread, in
+   a buffer that is printed at shutdown, aggregated by address,
+   for utils/backtrace to turn into a report of the hottest
+   functions.  Samples with a user address are attributed to the
+   thread's process by the thread name.
+
+   At TIMER_FREQ, the timer interrupt takes the samples.  At any
+   other rate, the RTC periodic interrupt does, which leaves the
+   PIT and with it the length of a tick alone.  Either way, code
+   that runs with interrupts off is never sampled; what it costs
+   shows up at the instruction that turns them back on. */
+
+/* Pages of samples, and the number of samples they hold. */
+#define PROFILE_PAGES 64
+#define PROFILE_MAX (PROFILE_PAGES * PGSIZE / sizeof(struct sample))
+
+/* Most threads whose names are remembered. */
+#define PROFILE_THREADS 64
+
+/* One sample. */
+struct sample {
+	uintptr_t eip;			/* Interrupted instruction. */
+	tid_t tid;			/* Running thread. */
+};
+
+/* A sampled thread. */
+struct sampled_thread {
+	tid_t tid;			/* Thread identifier. */
+	char name[16];			/* Name when first sampled. */
+};
+
+unsigned profile_hz;
+
+static struct sample *samples;
+static size_t sample_cnt;
+static size_t samples_lost;
+static bool profiling;
+
+static struct sampled_thread threads[PROFILE_THREADS];
+static size_t thread_cnt;
+
+static intr_handler_func rtc_sample;
+static void remember_thread(struct thread *);
+
+/**
+ * profile_init - start the sampling profiler
+ *
+ * If a profiling rate was given, allocate the sample buffer and
+ * start sampling.  Must be called after the timer is set up.
+*/
+void profile_init(void)
+{
+	if (profile_hz == 0)
+		return;
+
+	samples = palloc_get_multiple(0, PROFILE_PAGES);
+	if (samples == NULL)
+		PANIC("no memory for %zu profile samples", PROFILE_MAX);
+	if (profile_hz != TIMER_FREQ &&
+	    !rtc_start_periodic(profile_hz, rtc_sample))
+		PANIC("unsupported profiling rate %u Hz "
+		      "(use %d or a power of 2 from 2 to 8192)",
+		      profile_hz, TIMER_FREQ);
+	profiling = true;
+}
+
+/* Records where the running thread was interrupted, with frame F. */
+static void record(struct intr_frame *f)
+{
+	struct thread *t = thread_current();
+
+	if (!profiling)
+		return;
+	if (sample_cnt >= PROFILE_MAX) {
+		samples_lost++;
+		return;
+	}
+	samples[sample_cnt].eip = (uintptr_t)f->eip;
+	samples[sample_cnt].tid = t->tid;
+	sample_cnt++;
+	if (is_user_vaddr((const void *)f->eip))
+		remember_thread(t);
+}
+
+/**
+ * profile_sample - take a profile sample on a timer tick
+ *
+ * @f: frame of the interrupted code
+ *
+ * Record where the running thread was interrupted, if the
+ * profiler samples at the timer rate.  Called by the timer
+ * interrupt.
+*/
+void profile_sample(struct intr_frame *f)
+{
+	if (profile_hz == TIMER_FREQ)
+		record(f);
+}
+
+/* RTC interrupt handler for rates other than TIMER_FREQ. */
+static void rtc_sample(struct intr_frame *f)
+{
+	record(f);
+}
+
+/* Remembers the name of T, so that its user samples can be
+   attributed to its program after it has exited. */
+static void remember_thread(struct thread *t)
+{
+	static struct sampled_thread *last;
+	size_t i;
+
+	if (last != NULL && last->tid == t->tid)
+		return;
+	for (i = 0; i < thread_cnt; i++)
+		if (threads[i].tid == t->tid) {
+			last = &threads[i];
+			return;
+		}
+	if (thread_cnt < PROFILE_THREADS) {
+		last = &threads[thread_cnt++];
+		last->tid = t->tid;
+		strlcpy(last->name, t->name, sizeof last->name);
+	}
+}
+
+/* Orders samples A and B by thread, then by address. */
+static int compare_samples(const void *a_, const void *b_, void *aux UNUSED)
+{
+	const struct sample *a = a_;
+	const struct sample *b = b_;
+
+	if (a->tid != b->tid)
+		return a->tid < b->tid ? -1 : 1;
+	if (a->eip != b->eip)
+		return a->eip < b->eip ? -1 : 1;
+	return 0;
+}
+
+/**
+ * profile_print_stats - print the profile
+ *
+ * Stop sampling and print the samples, one "Profile sample" line
+ * for each thread and address sampled, with the number of
+ * samples, then one "Profile thread" line naming each thread
+ * that was sampled in user mode.  Lines look like
+ *
+ *	Profile sample TID 0xADDRESS COUNT
+ *	Profile thread TID NAME
+ *
+ * and are read by "backtrace --profile".
+*/
+void profile_print_stats(void)
+{
+	enum intr_level old_level;
+	size_t i, j;
+
+	if (samples == NULL)
+		return;
+
+	old_level = intr_disable();
+	profiling = false;
+	intr_set_level(old_level);
+
+	printf("Profile: %zu samples at %u Hz, %zu lost\n",
+	       sample_cnt, profile_hz, samples_lost);
+	sort(samples, sample_cnt, sizeof *samples, compare_samples, NULL);
+	for (i = 0; i < sample_cnt; i = j) {
+		for (j = i + 1; j < sample_cnt; j++)
+			if (compare_samples(&samples[i], &samples[j], NULL))
+				break;
+		printf("Profile sample %d %#010"PRIxPTR" %zu\n",
+		       samples[i].tid, samples[i].eip, j - i);
+	}
+	for (i = 0; i < thread_cnt; i++)
+		printf("Profile thread %d %s\n", threads[i].tid,
+		       threads[i].name);
+}
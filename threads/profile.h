@@ -0,0 +1,15 @@
+#ifndef THREADS_PROFILE_H
+#define THREADS_PROFILE_H
+
+#include <stdbool.h>
+#include "threads/interrupt.h"
+
+/* Sampling profiler rate in Hz, if nonzero.  Set by the kernel
+   command-line option "-profile". */
+extern unsigned profile_hz;
+
+void profile_init(void);
+void profile_sample(struct intr_frame *);
+void profile_print_stats(void);
+
+#endif /* threads/profile.h */
@@ -0,0 +1,84 @@
+#include "threads/rcu.h"
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+/* See threads/rcu.h.  There is one CPU, so the read-side nesting
+   is kept for the CPU rather than for each thread: a reader is
+   never switched away from, so the count is 0 at every switch. */
+unsigned rcu_read_depth;
+bool rcu_yield_pending;
+
+/* Callbacks queued by rcu_call() since the last context switch,
+   in order.  Changed only with interrupts off. */
+static struct rcu_head *callbacks;
+static struct rcu_head **callbacks_tail = &callbacks;
+
+/* Returns true if an interrupt handler may have the interrupted
+   thread yield on return.  If it is in a read-side section, notes
+   that it is to yield when it leaves instead and returns
+   false. */
+bool
+rcu_preempt_ok (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (rcu_read_depth == 0)
+    return true;
+  rcu_yield_pending = true;
+  return false;
+}
+
+/* Yields the CPU, as rcu_read_unlock() does on leaving the
+   outermost read-side section if a yield was put off during it.
+   With interrupts off, the yield is dropped: the next timer
+   interrupt will ask again. */
+void
+rcu_yield (void)
+{
+  rcu_yield_pending = false;
+  if (intr_context ())
+    intr_yield_on_return ();
+  else if (intr_get_level () == INTR_ON)
+    thread_yield ();
+}
+
+/* Arranges for FUNC to be called with HEAD once no read-side
+   section that began before now is still in progress.  FUNC is
+   called with interrupts off, during a context switch, so it must
+   not sleep.  May be called from an interrupt handler. */
+void
+rcu_call (struct rcu_head *head, void (*func) (struct rcu_head *))
+{
+  enum intr_level old_level;
+
+  head->func = func;
+  head->next = NULL;
+  old_level = intr_disable ();
+  *callbacks_tail = head;
+  callbacks_tail = &head->next;
+  intr_set_level (old_level);
+}
+
+/* Runs the callbacks queued so far, since no read-side section is
+   in progress.  Called by the scheduler at every context switch,
+   with interrupts off. */
+void
+rcu_quiescent (void)
+{
+  struct rcu_head *head;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (rcu_read_depth == 0);
+
+  rcu_yield_pending = false;
+  head = callbacks;
+  callbacks = NULL;
+  callbacks_tail = &callbacks;
+  while (head != NULL)
+    {
+      struct rcu_head *next = head->next;
+
+      head->func (head);
+      head = next;
+    }
+}
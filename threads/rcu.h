@@ -0,0 +1,84 @@
+#ifndef THREADS_RCU_H
+#define THREADS_RCU_H
+
+#include <debug.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/synch.h"
+
+/* Read-copy update.
+
+   Data that is read far more often than it changes, such as the
+   list of all threads, may be read between rcu_read_lock() and
+   rcu_read_unlock() without taking locks or turning interrupts
+   off.  Writers still exclude one another with a lock, and change
+   the data so that a reader sees either its old or its new state:
+   for a list, list_push_back_rcu() adds an element, and
+   list_remove() already leaves the element it removes pointing
+   back into the list for a reader that is on it.  Memory that a
+   writer unlinks is handed to rcu_call(), which frees it only
+   after a grace period, once no reader can still be using it.
+
+   A read-side section must not sleep, and the thread in one is
+   not preempted: a yield that an interrupt asks for is put off
+   until it leaves its outermost section.  With one CPU, then, no
+   reader is in progress at a context switch, and each switch ends
+   a grace period: callbacks passed to rcu_call() before one run
+   at the next.  Code that runs with interrupts off is a read-side
+   section too. */
+
+/* Callback for freeing an object after a grace period, embedded
+   in the object. */
+struct rcu_head
+  {
+    struct rcu_head *next;              /* Next callback queued. */
+    void (*func) (struct rcu_head *);   /* Frees the object. */
+  };
+
+/* Converts pointer to callback RCU_HEAD into a pointer to the
+   structure that it is embedded inside, given the name of the
+   outer structure STRUCT and the member name MEMBER of the
+   callback. */
+#define rcu_entry(RCU_HEAD, STRUCT, MEMBER)                     \
+        ((STRUCT *) ((uint8_t *) &(RCU_HEAD)->next              \
+                     - offsetof (STRUCT, MEMBER.next)))
+
+/* Read-side section nesting of the running code, and whether a
+   yield was put off until the outermost one ends. */
+extern unsigned rcu_read_depth;
+extern bool rcu_yield_pending;
+
+void rcu_yield (void);
+
+/* Begins a read-side section.  Sections may nest. */
+static inline void
+rcu_read_lock (void)
+{
+  rcu_read_depth++;
+  barrier ();
+}
+
+/* Ends a read-side section, yielding the CPU if that was put off
+   until the outermost section ended. */
+static inline void
+rcu_read_unlock (void)
+{
+  ASSERT (rcu_read_depth > 0);
+  barrier ();
+  if (--rcu_read_depth == 0 && rcu_yield_pending)
+    rcu_yield ();
+}
+
+/* Returns true if the running code is in a read-side section. */
+static inline bool
+rcu_read_active (void)
+{
+  return rcu_read_depth > 0;
+}
+
+bool rcu_preempt_ok (void);
+void rcu_call (struct rcu_head *, void (*func) (struct rcu_head *));
+void rcu_quiescent (void);
+
+#endif /* threads/rcu.h */
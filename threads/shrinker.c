@@ -0,0 +1,113 @@
+#include "threads/shrinker.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+
+/* Registered shrinkers.  Shrinkers register at boot and stay
+   registered, so the list is only changed with interrupts off
+   and may be walked by the one thread shrinking at a time. */
+static struct list shrinkers = LIST_INITIALIZER (shrinkers);
+
+/* True while a thread is in shrink_memory(). */
+static bool shrinking;
+
+/* A pass at priority P asks each shrinker to scan 1/2**P of its
+   objects, so the first pass is gentle and the last scans all of
+   them. */
+#define SHRINK_PRIORITY 4
+
+/* Statistics. */
+static unsigned long long shrink_cnt, shrink_page_cnt;
+
+/* Adds S to the shrinkers that shrink_memory() calls. */
+void
+shrinker_register (struct shrinker *s)
+{
+  enum intr_level old_level;
+
+  ASSERT (s->count != NULL && s->scan != NULL);
+
+  s->scan_cnt = s->free_cnt = 0;
+  old_level = intr_disable ();
+  list_push_back (&shrinkers, &s->elem);
+  intr_set_level (old_level);
+}
+
+/* Has the shrinkers free memory until PAGE_CNT more pages of the
+   kernel pool are free, or until they have scanned all their
+   objects without getting there.  Returns the number of pages
+   that came free, which may be more or less than PAGE_CNT.
+   Does nothing, and returns 0, in an interrupt handler, with
+   interrupts off, or while another thread is shrinking, which is
+   as good as shrinking again. */
+size_t
+shrink_memory (size_t page_cnt)
+{
+  enum intr_level old_level;
+  size_t start, now;
+  int priority;
+
+  if (intr_context () || intr_get_level () == INTR_OFF)
+    return 0;
+
+  old_level = intr_disable ();
+  if (shrinking)
+    {
+      intr_set_level (old_level);
+      return 0;
+    }
+  shrinking = true;
+  intr_set_level (old_level);
+
+  shrink_cnt++;
+  start = now = palloc_free_cnt (0);
+  for (priority = SHRINK_PRIORITY; priority >= 0; priority--)
+    {
+      struct list_elem *e;
+
+      for (e = list_begin (&shrinkers); e != list_end (&shrinkers);
+           e = list_next (e))
+        {
+          struct shrinker *s = list_entry (e, struct shrinker, elem);
+          size_t nr = s->count () >> priority;
+
+          if (nr > 0)
+            {
+              s->scan_cnt += nr;
+              s->free_cnt += s->scan (nr);
+            }
+        }
+
+      now = palloc_free_cnt (0);
+      if (now >= start + page_cnt)
+        break;
+    }
+  shrinking = false;
+
+  if (now <= start)
+    return 0;
+  shrink_page_cnt += now - start;
+  return now - start;
+}
+
+/* Prints shrinker statistics. */
+void
+shrinker_print_stats (void)
+{
+  struct list_elem *e;
+
+  if (shrink_cnt == 0)
+    return;
+  printf ("Shrinkers: %llu runs freed %llu pages\n",
+          shrink_cnt, shrink_page_cnt);
+  for (e = list_begin (&shrinkers); e != list_end (&shrinkers);
+       e = list_next (e))
+    {
+      struct shrinker *s = list_entry (e, struct shrinker, elem);
+
+      printf ("Shrinkers: %s: %llu of %llu objects scanned freed\n",
+              s->name, s->free_cnt, s->scan_cnt);
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef THREADS_SHRINKER_H
+#define THREADS_SHRINKER_H
+
+#include <list.h>
+#include <stddef.h>
+
+/* Shrinkers.
+
+   A cache that holds kernel memory it could do without, such as
+   the buffer cache's buffers, registers a shrinker, which reports
+   how many objects the cache could free and frees some of them on
+   request.  When the kernel pool runs out, or the reclaim thread
+   finds it running low, shrink_memory() asks every shrinker to
+   scan a share of its objects in proportion to how many it has,
+   a larger share on each pass, until enough pages are free.  So a
+   cache grows while memory is plentiful and gives memory back to
+   whichever subsystem needs it, instead of being held to a fixed
+   size.
+
+   Shrinkers may be called from within the page allocator, on
+   behalf of a thread holding any lock.  So SCAN must not wait:
+   it takes only locks that it can get with lock_try_acquire(),
+   giving up on objects whose locks are busy or held by the
+   running thread.  Memory that SCAN allocates is not shrunk
+   for. */
+struct shrinker
+  {
+    const char *name;                   /* For statistics. */
+
+    /* Returns roughly how many objects could be freed. */
+    size_t (*count) (void);
+
+    /* Tries to free up to NR objects, returning how many it did. */
+    size_t (*scan) (size_t nr);
+
+    /* Owned by the shrinker registry. */
+    struct list_elem elem;              /* Element in shrinker list. */
+    unsigned long long scan_cnt;        /* Objects asked for. */
+    unsigned long long free_cnt;        /* Objects freed. */
+  };
+
+void shrinker_register (struct shrinker *);
+size_t shrink_memory (size_t page_cnt);
+void shrinker_print_stats (void);
+
+#endif /* threads/shrinker.h */
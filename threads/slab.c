@@ -0,0 +1,229 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Object cache.  Hands out fixed-size objects, packed into
+   one-page slabs instead of rounded up to a power of 2 like
+   malloc() does.
+
+   Objects are kept constructed: the constructor runs on each
+   object once, when its slab is created, and kmem_cache_free()
+   expects the object back in its constructed state, so that
+   kmem_cache_alloc() returns it ready for use.  A slab's free
+   objects are tracked by an index stack in its header, leaving
+   the contents of free objects alone.
+
+   A slab with free objects is on its cache's partial list.  A
+   slab all of whose objects are free is given back to palloc,
+   unless it is the only slab with free objects. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Object cache. */
+struct kmem_cache
+  {
+    const char *name;           /* Name (for debugging purposes). */
+    size_t size;                /* Size of each object in bytes. */
+    size_t objs_per_slab;       /* Number of objects in a slab. */
+    size_t obj_ofs;             /* Offset of first object in a slab. */
+    kmem_ctor *ctor;            /* Constructor, may be null. */
+    struct list partial;        /* Slabs with free objects. */
+    struct adaptive_lock lock;  /* Lock. */
+  };
+
+/* Slab, at the start of its page. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct kmem_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in cache's partial list. */
+    size_t free_cnt;            /* Number of free objects. */
+    uint16_t free[];            /* Indexes of free objects. */
+  };
+
+static struct slab *slab_create (struct kmem_cache *);
+static struct slab *obj_to_slab (struct kmem_cache *, void *);
+
+/**
+ * kmem_cache_create - create an object cache
+ *
+ * @name: name of the cache, for debugging
+ * @size: size of each object in bytes
+ * @ctor: constructor of each object, or NULL
+ *
+ * Create a cache of objects of the given size, which must leave
+ * room for a slab header in a page.  Return NULL if memory is not
+ * available.
+*/
+struct kmem_cache *kmem_cache_create(const char *name, size_t size,
+				     kmem_ctor *ctor)
+{
+	struct kmem_cache *c;
+	size_t n;
+
+	ASSERT(size > 0);
+
+	c = malloc(sizeof *c);
+	if (c == NULL)
+		return NULL;
+
+	c->name = name;
+	c->size = ROUND_UP(size, sizeof(void *));
+	/* Fit as many objects as possible with their index each. */
+	n = (PGSIZE - sizeof(struct slab)) / (c->size + sizeof(uint16_t));
+	while (n > 0 &&
+	       ROUND_UP(sizeof(struct slab) + n * sizeof(uint16_t),
+			sizeof(void *)) + n * c->size > PGSIZE)
+		n--;
+	ASSERT(n > 0);
+	c->objs_per_slab = n;
+	c->obj_ofs = ROUND_UP(sizeof(struct slab) + n * sizeof(uint16_t),
+			      sizeof(void *));
+	c->ctor = ctor;
+	list_init(&c->partial);
+	adaptive_lock_init(&c->lock);
+	return c;
+}
+
+/**
+ * kmem_cache_destroy - destroy an object cache
+ *
+ * @c: pointer to the cache, all of whose objects must be free
+ *
+ * Give back every slab of the given cache and free the cache.
+*/
+void kmem_cache_destroy(struct kmem_cache *c)
+{
+	struct slab *s;
+
+	if (c == NULL)
+		return;
+
+	while (!list_empty(&c->partial)) {
+		s = list_entry(list_pop_front(&c->partial), struct slab, elem);
+		ASSERT(s->free_cnt == c->objs_per_slab);
+		palloc_free_page(s);
+	}
+	free(c);
+}
+
+/**
+ * kmem_cache_alloc - allocate an object
+ *
+ * @c: pointer to the cache
+ *
+ * Return a constructed object from the given cache, creating a new
+ * slab if needed, or NULL if memory is not available.
+*/
+void *kmem_cache_alloc(struct kmem_cache *c)
+{
+	struct slab *s;
+	void *obj;
+
+	ASSERT(c != NULL);
+
+	adaptive_lock_acquire(&c->lock);
+
+	if (list_empty(&c->partial)) {
+		s = slab_create(c);
+		if (s == NULL) {
+			adaptive_lock_release(&c->lock);
+			return NULL;
+		}
+		list_push_front(&c->partial, &s->elem);
+	}
+
+	/* Pop a free object, leaving the slab once full. */
+	s = list_entry(list_front(&c->partial), struct slab, elem);
+	obj = (uint8_t *)s + c->obj_ofs + s->free[--s->free_cnt] * c->size;
+	if (s->free_cnt == 0)
+		list_remove(&s->elem);
+
+	adaptive_lock_release(&c->lock);
+	return obj;
+}
+
+/**
+ * kmem_cache_free - free an object
+ *
+ * @c: pointer to the cache the object was allocated from
+ * @obj: pointer to the object in its constructed state, or NULL
+ *
+ * Give the given object back to its slab.
+*/
+void kmem_cache_free(struct kmem_cache *c, void *obj)
+{
+	struct slab *s;
+
+	if (obj == NULL)
+		return;
+
+	s = obj_to_slab(c, obj);
+
+	adaptive_lock_acquire(&c->lock);
+
+	/* Back on the partial list once not full. */
+	if (s->free_cnt == 0)
+		list_push_front(&c->partial, &s->elem);
+	s->free[s->free_cnt++] = ((uint8_t *)obj - (uint8_t *)s - c->obj_ofs) /
+				 c->size;
+
+	/* Give back the slab if empty, unless the only partial one. */
+	if (s->free_cnt == c->objs_per_slab &&
+	    list_begin(&c->partial) != list_rbegin(&c->partial)) {
+		list_remove(&s->elem);
+		s->magic = 0;
+		palloc_free_page(s);
+	}
+
+	adaptive_lock_release(&c->lock);
+}
+
+/* Obtains a page for a new slab of cache C and constructs its
+   objects.  Returns a null pointer if memory is not available. */
+static struct slab *
+slab_create (struct kmem_cache *c)
+{
+  struct slab *s;
+  size_t i;
+
+  s = palloc_get_page (0);
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->free_cnt = c->objs_per_slab;
+  for (i = 0; i < c->objs_per_slab; i++)
+    {
+      /* Hand out lower objects first. */
+      s->free[i] = c->objs_per_slab - 1 - i;
+      if (c->ctor != NULL)
+        c->ctor ((uint8_t *) s + c->obj_ofs + i * c->size);
+    }
+  return s;
+}
+
+/* Returns the slab that OBJ, allocated from cache C, is inside. */
+static struct slab *
+obj_to_slab (struct kmem_cache *c, void *obj)
+{
+  struct slab *s = pg_round_down (obj);
+
+  /* Check that the slab is valid and belongs to C. */
+  ASSERT (s != NULL);
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (s->cache == c);
+
+  /* Check that the object is properly aligned for the slab. */
+  ASSERT ((pg_ofs (obj) - c->obj_ofs) % c->size == 0);
+
+  return s;
+}
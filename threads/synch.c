@@ -28,9 +28,47 @@
 
 #include "threads/synch.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/cycle.h"
+#include "devices/timer.h"
+
+/* Donation statistics.  The cycles are only counted if
+   lock_stats. */
+static uint64_t acquire_cnt;    /* # of lock_acquire() calls. */
+static uint64_t acquire_cycles; /* # of cycles spent on donation. */
+static uint64_t release_cnt;    /* # of lock_release() calls. */
+static uint64_t release_cycles; /* # of cycles spent on undonation. */
+
+/* If false (default), locks keep no statistics.
+   If true, locks given a name by lock_init_named() count their
+   acquisitions and time their waits and holds, for
+   lock_print_stats(), and all locks time their donation
+   bookkeeping, for lock_donation_stats().
+   Controlled by kernel command-line option "-lock-stats". */
+bool lock_stats;
+
+/* Statistics of the named locks.  They are allocated here, not by
+   malloc(), because some locks are named before malloc() works,
+   and never freed, so only locks that last as long as the kernel
+   should be named. */
+#define LOCK_STATS_MAX 64
+static struct lock_stats lock_registry[LOCK_STATS_MAX];
+static size_t lock_registry_cnt;
+static uint64_t lock_registry_lost;
+
+static bool up (struct semaphore *);
+static void yield (void);
+static void acquire (struct lock *, uint64_t wait_start);
+static bool down (struct lock *);
+static void donate (struct lock *, struct thread *);
+static void hold (struct lock *, uint64_t wait_start, bool handed);
+static bool release (struct lock *);
+static void stats_acquired (struct lock_stats *, uint64_t wait_start);
+static void stats_spun (struct lock_stats *, uint64_t wait_start);
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -47,7 +85,7 @@ sema_init (struct semaphore *sema, unsigned value)
   ASSERT (sema != NULL);
 
   sema->value = value;
-  list_init (&sema->waiters);
+  waitq_init (&sema->waiters);
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -60,7 +98,7 @@ sema_init (struct semaphore *sema, unsigned value)
 void sema_down(struct semaphore *sema)
 {
 	enum intr_level old_level;
-	bool aux;
+	struct thread *current;
 
 	ASSERT(sema != NULL);
 	ASSERT(!intr_context());
@@ -68,11 +106,13 @@ void sema_down(struct semaphore *sema)
 	old_level = intr_disable();
 
 	/* Block the current thread for sema_down operation. */
-	aux = true;
+	current = thread_current();
 	while (sema->value == 0) {
-		/* Insert to waiters list with priority descending. */
-		list_insert_ordered(&sema->waiters, &thread_current()->elem,
-				    thread_cmp_priority, &aux);
+		/* Queue behind waiters of higher or equal priority. */
+		current->sema_waiting = sema;
+		waitq_push(&sema->waiters, &current->waitelem,
+			   current->priority);
+		TRACE(TRACE_SEMA_WAIT, sema, 0, 0);
 		thread_block();
 	}
 	/* Decrease value of the semaphore. */
@@ -119,21 +159,35 @@ sema_try_down (struct semaphore *sema)
 void sema_up(struct semaphore *sema)
 {
 	enum intr_level old_level;
-	struct thread *t;
-	bool f_yield;
-	bool aux;
 
 	ASSERT(sema != NULL);
 
 	old_level = intr_disable();
+	/* Yield if the thread woken is more prioritized. */
+	if (up(sema))
+		yield();
+	intr_set_level(old_level);
+}
+
+/* Does the work of sema_up() on SEMA, except for yielding.
+   Returns true if it woke a thread of higher priority than the
+   running thread, which should then yield.  Interrupts must be
+   off. */
+static bool up(struct semaphore *sema)
+{
+	struct thread *t;
+	bool f_yield;
+
+	ASSERT(intr_get_level() == INTR_OFF);
 
 	/* Unblock the most prioritized waiter thread if any. */
-	if (!list_empty(&sema->waiters)) {
-		aux = true;
-		/* Unblock the most prioritized waiter thread. */
-		list_sort(&sema->waiters, thread_cmp_priority, &aux);
-		t = list_entry(list_pop_front(&sema->waiters), struct thread,
-			       elem);
+	f_yield = false;
+	if (!waitq_empty(&sema->waiters)) {
+		/* The front is the most prioritized, no sorting needed. */
+		t = waitq_entry(waitq_pop(&sema->waiters), struct thread,
+				waitelem);
+		t->sema_waiting = NULL;
+		TRACE(TRACE_SEMA_WAKE, sema, t->tid, 0);
 		thread_unblock(t);
 		/* Yield if the thread is more prioritized but not here, */
 		/* Otherwise the kernel will freeze for unknown reason. */
@@ -141,16 +195,18 @@ void sema_up(struct semaphore *sema)
 	}
 	/* Increase value of the semaphore. */
 	sema->value++;
-	/* Yield if the thread above is more prioritized. */
-	if (f_yield) {
-		/* Fix kernel panics from early scheduling. */
-		if (intr_context())
-			intr_yield_on_return();
-		else
-			thread_yield();
-	}
+	return f_yield;
+}
 
-	intr_set_level(old_level);
+/* Yields the CPU to a thread just woken, or, in an interrupt
+   handler, arranges to as it returns. */
+static void yield(void)
+{
+	/* Fix kernel panics from early scheduling. */
+	if (intr_context())
+		intr_yield_on_return();
+	else
+		thread_yield();
 }
 
 static void sema_test_helper (void *sema_);
@@ -190,30 +246,6 @@ sema_test_helper (void *sema_)
     }
 }
 
-/**
- * lock_cmp_priority - compare two locks' priorities
- * 
- * @e1: pointer to elem of one lock.
- * @e2: pointer to elem of another lock.
- * @aux: pointer to direction of comparison in bool
- *
- * Compare two locks' priorities.
-*/
-bool lock_cmp_priority(const struct list_elem *e1,
-			    const struct list_elem *e2, void *aux)
-{
-	struct lock *l1;
-	struct lock *l2;
-
-	/* Convert lockselems to locks. */
-	l1 = list_entry(e1, struct lock, elem);
-	l2 = list_entry(e2, struct lock, elem);
-
-	if (*(bool *)aux)
-		return l1->priority > l2->priority;
-	return l1->priority < l2->priority;
-}
-
 /* Initializes LOCK.  A lock can be held by at most a single
    thread at any given time.  Our locks are not "recursive", that
    is, it is an error for the thread currently holding a lock to
@@ -235,9 +267,53 @@ lock_init (struct lock *lock)
   ASSERT (lock != NULL);
 
   lock->holder = NULL;
+  lock->handoff = false;
+  lock->stats = NULL;
   sema_init (&lock->semaphore, 1);
 }
 
+/* Sets whether LOCK is handed over on release.  By default, a
+   release only wakes the most prioritized waiter, and the lock
+   goes to whichever thread asks for it next, which may be the
+   releasing thread itself or a third thread barging in ahead of
+   the waiter, which then goes back to sleep.  That keeps the lock
+   busy, which is best when it is held briefly.  With HANDOFF,
+   release makes the waiter the holder before waking it, so that
+   no waiter is woken in vain and none waits indefinitely, at the
+   cost of a context switch per contended acquisition. */
+void
+lock_set_handoff (struct lock *lock, bool handoff)
+{
+  ASSERT (lock != NULL);
+
+  lock->handoff = handoff;
+}
+
+/* Initializes LOCK like lock_init(), and, if lock_stats, keeps
+   contention statistics for it under the given NAME, which is
+   copied.  LOCK must never be freed, because lock_print_stats()
+   finds its statistics until shutdown; several locks may share a
+   name, though. */
+void
+lock_init_named (struct lock *lock, const char *name)
+{
+  enum intr_level old_level;
+
+  lock_init (lock);
+  if (!lock_stats)
+    return;
+
+  old_level = intr_disable ();
+  if (lock_registry_cnt < LOCK_STATS_MAX)
+    {
+      lock->stats = &lock_registry[lock_registry_cnt++];
+      strlcpy (lock->stats->name, name, sizeof lock->stats->name);
+    }
+  else
+    lock_registry_lost++;
+  intr_set_level (old_level);
+}
+
 /**
  * lock_acquire - let the current thread acquire the lock
  *
@@ -251,10 +327,20 @@ lock_init (struct lock *lock)
  * we need to sleep.
 */
 void lock_acquire(struct lock *lock)
+{
+	acquire(lock, 0);
+}
+
+/* Acquires LOCK for lock_acquire().  WAIT_START is the time stamp
+   counter when the caller started waiting for LOCK, if it already
+   did, otherwise 0. */
+static void acquire(struct lock *lock, uint64_t wait_start)
 {
 	enum intr_level old_level;
 	struct thread *current;
-	struct lock *l;
+	uint64_t start;
+	int64_t wait_ticks;
+	bool handed;
 
 	ASSERT(lock != NULL);
 	ASSERT(!intr_context());
@@ -262,30 +348,97 @@ void lock_acquire(struct lock *lock)
 
 	/* Handler for priority scheduling. */
 	/* The current thread should if the lock is held by another thread. */
+	old_level = intr_disable();
 	current = thread_current();
-	if (!thread_mlfqs && lock->holder) {
-		/* Let the current thread wait for the lock. */
-		current->lock_waiting = lock;
-		/* Let the current thread donate priority recursively. */
-		l = lock;
-		while (l &&l->priority < current->priority) {
-			/* Update priority of the lock. */
-			l->priority = current->priority;
-			/* Donate to the lock holder. */
-			thread_donate_priority(l->holder);
-			/* Iterate recursively on its lock waiting for. */
-			l = l->holder->lock_waiting;
-		}
+	start = lock_stats ? rdtsc() : 0;
+	if (lock->holder != NULL) {
+		TRACE(TRACE_LOCK_CONTEND, lock, lock->holder->tid, 0);
+		if (wait_start == 0)
+			wait_start = start;
 	}
+	if (lock->holder)
+		donate(lock, current);
+	if (lock_stats)
+		acquire_cycles += rdtsc() - start;
+	intr_set_level(old_level);
+
+	/* Down action on the semaphore, timed if waiting. */
+	if (thread_sched_stats && lock->holder) {
+		wait_ticks = timer_ticks();
+		handed = down(lock);
+		current->stats.lock_ticks += timer_ticks() - wait_ticks;
+	} else {
+		handed = down(lock);
+	}
+
+	old_level = intr_disable();
+	hold(lock, wait_start, handed);
+	intr_set_level(old_level);
+}
 
-	/* Down action on the semaphore. */
-	sema_down(&lock->semaphore);
+/* Downs the semaphore of LOCK for the current thread, as
+   sema_down() would, unless release() hands LOCK over to the
+   thread while it waits.  Returns true in that case. */
+static bool down(struct lock *lock)
+{
+	struct semaphore *sema = &lock->semaphore;
+	struct thread *current = thread_current();
+	enum intr_level old_level;
+	bool handed;
 
 	old_level = intr_disable();
+	while (sema->value == 0 && lock->holder != current) {
+		/* Queue behind waiters of higher or equal priority. */
+		current->sema_waiting = sema;
+		waitq_push(&sema->waiters, &current->waitelem,
+			   current->priority);
+		TRACE(TRACE_SEMA_WAIT, sema, 0, 0);
+		thread_block();
+	}
+	handed = lock->holder == current;
+	if (!handed)
+		sema->value--;
+	intr_set_level(old_level);
+
+	return handed;
+}
+
+/* Makes thread T, which waits for LOCK, held by another thread,
+   donate its priority to LOCK's holder, and on through the locks
+   that holder waits for in turn.  Interrupts must be off. */
+static void donate(struct lock *lock, struct thread *t)
+{
+	struct lock *l;
+
+	ASSERT(intr_get_level() == INTR_OFF);
+
+	if (thread_mlfqs)
+		return;
+	/* Let the thread wait for the lock. */
+	t->lock_waiting = lock;
+	/* Let the thread donate priority recursively. */
+	l = lock;
+	while (l && l->holder && l->priority < t->priority) {
+		/* Donate to the lock holder. */
+		thread_donate_priority(l, t->priority);
+		/* Iterate recursively on its lock waiting for. */
+		l = l->holder->lock_waiting;
+	}
+}
+
+/* Makes the current thread, which has just downed LOCK's
+   semaphore, LOCK's holder, or, if HANDED, finishes the work
+   release() did in handing LOCK over to it.  WAIT_START is as for
+   acquire().  Interrupts must be off. */
+static void hold(struct lock *lock, uint64_t wait_start, bool handed)
+{
+	struct thread *current = thread_current();
+	uint64_t start = lock_stats ? rdtsc() : 0;
+
+	ASSERT(intr_get_level() == INTR_OFF);
 
 	/* Let the current thread hold the lock. */
-	current = thread_current();
-	if (!thread_mlfqs) {
+	if (!handed && !thread_mlfqs) {
 		/* Clear its lock_waiting. */
 		current->lock_waiting = NULL;
 		/* Set lock priority. */
@@ -294,29 +447,56 @@ void lock_acquire(struct lock *lock)
 		thread_hold_lock(lock);
 	}
 	lock->holder = current;
-
-	intr_set_level(old_level);
+	TRACE(TRACE_LOCK_ACQUIRE, lock, 0, 0);
+	if (lock->stats != NULL)
+		stats_acquired(lock->stats, wait_start);
+	if (lock_stats)
+		acquire_cycles += rdtsc() - start;
+	acquire_cnt++;
 }
 
-/* Tries to acquires LOCK and returns true if successful or false
-   on failure.  The lock must not already be held by the current
-   thread.
-
-   This function will not sleep, so it may be called within an
-   interrupt handler. */
-bool
-lock_try_acquire (struct lock *lock)
+/**
+ * lock_try_acquire - try to acquire the lock without sleeping
+ *
+ * @lock: pointer to the lock
+ *
+ * Tries to acquires LOCK and returns true if successful or false
+ * on failure.  The lock must not already be held by the current
+ * thread.  On success the lock is accounted among the locks of
+ * the current thread, just like by lock_acquire().
+ * This function will not sleep, but it must not be called within
+ * an interrupt handler: the lock would be accounted among the locks
+ * of the interrupted thread, and take part in its donations.
+*/
+bool lock_try_acquire(struct lock *lock)
 {
-  bool success;
+	enum intr_level old_level;
+	struct thread *current;
+	bool success;
 
-  ASSERT (lock != NULL);
-  ASSERT (!lock_held_by_current_thread (lock));
+	ASSERT(lock != NULL);
+	ASSERT(!intr_context());
+	ASSERT(!lock_held_by_current_thread(lock));
 
-  success = sema_try_down (&lock->semaphore);
-  if (success)
-    lock->holder = thread_current ();
-  return success;
+	old_level = intr_disable();
+	success = sema_try_down(&lock->semaphore);
+	if (success) {
+		current = thread_current();
+		/* Hold the lock so that waiters can donate through it. */
+		if (!thread_mlfqs) {
+			lock->priority = current->priority;
+			thread_hold_lock(lock);
+		}
+		lock->holder = current;
+		TRACE(TRACE_LOCK_ACQUIRE, lock, 0, 0);
+		if (lock->stats != NULL)
+			stats_acquired(lock->stats, 0);
+	}
+	intr_set_level(old_level);
+
+	return success;
 }
+
 /**
  * lock_release - let the current thread release the lock.
  *
@@ -327,15 +507,64 @@ lock_try_acquire (struct lock *lock)
 */
 void lock_release(struct lock *lock)
 {
+	enum intr_level old_level;
+
 	ASSERT(lock != NULL);
 	ASSERT(lock_held_by_current_thread(lock));
 
+	old_level = intr_disable();
+	if (release(lock))
+		yield();
+	intr_set_level(old_level);
+}
+
+/* Does the work of lock_release() on LOCK, except for yielding.
+   Returns true if the running thread should yield to the waiter
+   woken.  Interrupts must be off. */
+static bool release(struct lock *lock)
+{
+	struct thread *t;
+	uint64_t start;
+
+	ASSERT(intr_get_level() == INTR_OFF);
+
 	/* Let the current thread release the lock. */
+	start = lock_stats ? rdtsc() : 0;
 	if (!thread_mlfqs)
 		thread_release_lock(lock);
-
 	lock->holder = NULL;
-	sema_up(&lock->semaphore);
+	TRACE(TRACE_LOCK_RELEASE, lock, 0, 0);
+	if (lock->stats != NULL) {
+		struct lock_stats *s = lock->stats;
+		uint64_t hold = rdtsc() - s->held_since;
+
+		s->hold_cycles += hold;
+		if (hold > s->hold_max)
+			s->hold_max = hold;
+	}
+	if (lock_stats)
+		release_cycles += rdtsc() - start;
+	release_cnt++;
+
+	if (!lock->handoff || waitq_empty(&lock->semaphore.waiters))
+		return up(&lock->semaphore);
+
+	/* Hand the lock to the most prioritized waiter, leaving the
+	   semaphore down, and do for it what thread_hold_lock() would.
+	   The other waiters are of no higher priority, so it needs no
+	   donation from them. */
+	t = waitq_entry(waitq_pop(&lock->semaphore.waiters), struct thread,
+			waitelem);
+	t->sema_waiting = NULL;
+	if (!thread_mlfqs) {
+		t->lock_waiting = NULL;
+		lock->priority = t->priority;
+		waitq_push(&t->locks, &lock->elem, lock->priority);
+	}
+	lock->holder = t;
+	TRACE(TRACE_SEMA_WAKE, &lock->semaphore, t->tid, 0);
+	thread_unblock(t);
+	return t->priority > thread_current()->priority;
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -349,42 +578,269 @@ lock_held_by_current_thread (const struct lock *lock)
   return lock->holder == thread_current ();
 }
 
-/* One semaphore in a list. */
-struct semaphore_elem 
-  {
-    struct list_elem elem;              /* List element. */
-    struct semaphore semaphore;         /* This semaphore. */
-  };
+/**
+ * lock_donation_stats - get priority donation statistics
+ *
+ * @acquires: pointer to store # of lock acquisitions
+ * @acquire_cycles_: pointer to store # of cycles spent donating
+ * @releases: pointer to store # of lock releases
+ * @release_cycles_: pointer to store # of cycles spent undonating
+ *
+ * Get the bookkeeping cost of priority donation in lock_acquire()
+ * and lock_release(), excluding the time spent blocked.  The
+ * cycles are only counted while lock_stats is set.
+*/
+void lock_donation_stats(uint64_t *acquires, uint64_t *acquire_cycles_,
+			 uint64_t *releases, uint64_t *release_cycles_)
+{
+	enum intr_level old_level;
+
+	old_level = intr_disable();
+	*acquires = acquire_cnt;
+	*acquire_cycles_ = acquire_cycles;
+	*releases = release_cnt;
+	*release_cycles_ = release_cycles;
+	intr_set_level(old_level);
+}
+
+/* Counts an acquisition of the lock with statistics S, which
+   waited since time stamp counter WAIT_START, if nonzero, and
+   starts timing the hold.  Must be called with interrupts off. */
+static void stats_acquired(struct lock_stats *s, uint64_t wait_start)
+{
+	uint64_t now = rdtsc();
+
+	s->acquire_cnt++;
+	if (wait_start != 0) {
+		uint64_t wait = now - wait_start;
+
+		s->contend_cnt++;
+		s->wait_cycles += wait;
+		if (wait > s->wait_max)
+			s->wait_max = wait;
+	}
+	s->held_since = now;
+}
+
+/* Turns the last acquisition of the lock with statistics S, which
+   lock_try_acquire() just counted, into one that waited since
+   WAIT_START, spinning. */
+static void stats_spun(struct lock_stats *s, uint64_t wait_start)
+{
+	enum intr_level old_level = intr_disable();
+	uint64_t wait = s->held_since - wait_start;
+
+	s->contend_cnt++;
+	s->wait_cycles += wait;
+	if (wait > s->wait_max)
+		s->wait_max = wait;
+	intr_set_level(old_level);
+}
+
+/* Orders lock statistics A and B by total wait, longest first. */
+static int compare_lock_stats(const void *a_, const void *b_,
+			      void *aux UNUSED)
+{
+	const struct lock_stats *a = *(struct lock_stats *const *)a_;
+	const struct lock_stats *b = *(struct lock_stats *const *)b_;
+
+	if (a->wait_cycles != b->wait_cycles)
+		return a->wait_cycles > b->wait_cycles ? -1 : 1;
+	return strcmp(a->name, b->name);
+}
+
+/**
+ * lock_print_stats - print lock contention statistics
+ *
+ * If lock_stats, print the statistics of every named lock that
+ * was acquired, the locks that were waited for longest in total
+ * first.
+*/
+void lock_print_stats(void)
+{
+	struct lock_stats *order[LOCK_STATS_MAX];
+	size_t i;
+
+	if (!lock_stats)
+		return;
+
+	for (i = 0; i < lock_registry_cnt; i++)
+		order[i] = &lock_registry[i];
+	sort(order, lock_registry_cnt, sizeof *order, compare_lock_stats,
+	     NULL);
+	for (i = 0; i < lock_registry_cnt; i++) {
+		struct lock_stats *s = order[i];
+
+		if (s->acquire_cnt == 0)
+			continue;
+		printf("Lock %s: %llu acquires, %llu contended, "
+		       "wait %llu/%llu max, hold %llu/%llu max cycles\n",
+		       s->name, s->acquire_cnt, s->contend_cnt,
+		       s->wait_cycles, s->wait_max, s->hold_cycles,
+		       s->hold_max);
+	}
+	if (lock_registry_lost > 0)
+		printf("Lock statistics: %llu named locks untracked\n",
+		       lock_registry_lost);
+}
+
+/* Initializes SL as an unheld spinlock. */
+void
+spinlock_init (struct spinlock *sl)
+{
+  ASSERT (sl != NULL);
+
+  sl->locked = 0;
+  sl->old_level = INTR_OFF;
+}
 
 /**
- * thread_cmp_priority - compare two semaphore_elems' thread priorities
- * 
- * @e1: pointer to elem of one semaphore_elem
- * @e2: pointer to elem of another semaphore_elem
- * @aux: pointer to direction of comparison in bool
+ * spinlock_acquire - acquire the spinlock
  *
- * Compare two semaphore_elems' thread priorities.
+ * @sl: pointer to the spinlock
+ *
+ * Turn interrupts off, then spin with an atomic exchange until the
+ * given lock is available.  Spinlocks are not recursive, and with
+ * a single CPU an unavailable one would spin forever, so the lock
+ * must not be held by this CPU.
+ * This function may be called within an interrupt handler.
 */
-bool semaphore_elem_cmp_priority(const struct list_elem *e1,
-				 const struct list_elem *e2, void *aux)
+void spinlock_acquire(struct spinlock *sl)
+{
+	enum intr_level old_level;
+	uint32_t locked;
+
+	ASSERT(sl != NULL);
+
+	old_level = intr_disable();
+	for (;;) {
+		locked = 1;
+		asm volatile("xchgl %0, %1"
+			     : "+r" (locked), "+m" (sl->locked) : : "memory");
+		if (!locked)
+			break;
+		/* Held by another CPU, but spin without the bus lock. */
+		while (sl->locked)
+			asm volatile("pause");
+	}
+	sl->old_level = old_level;
+}
+
+/* Releases SL, restoring the interrupt level from before
+   spinlock_acquire(). */
+void
+spinlock_release (struct spinlock *sl)
 {
-	struct semaphore_elem *s1;
-	struct semaphore_elem *s2;
-	struct thread *t1;
-	struct thread *t2;
+  enum intr_level old_level;
 
-	/* Convert elems to semaphore_elems. */
-	s1 = list_entry(e1, struct semaphore_elem, elem);
-	s2 = list_entry(e2, struct semaphore_elem, elem);
-	/* Convert semaphore_elems to threads. */
-	t1 = list_entry(list_front(&s1->semaphore.waiters), struct thread,
-			elem);
-	t2 = list_entry(list_front(&s2->semaphore.waiters), struct thread,
-			elem);
+  ASSERT (spinlock_held (sl));
 
-	if (*(bool *)aux)
-		return t1->priority > t2->priority;
-	return t1->priority < t2->priority;
+  old_level = sl->old_level;
+  barrier ();
+  sl->locked = 0;
+  intr_set_level (old_level);
+}
+
+/* Returns true if SL is held.  With interrupts off on a single
+   CPU, it can only be held by the caller. */
+bool
+spinlock_held (const struct spinlock *sl)
+{
+  ASSERT (sl != NULL);
+
+  return sl->locked != 0;
+}
+
+/* Initializes adaptive lock AL. */
+void
+adaptive_lock_init (struct adaptive_lock *al)
+{
+  ASSERT (al != NULL);
+
+  lock_init (&al->lock);
+  al->spin_cnt = 0;
+  al->block_cnt = 0;
+}
+
+/* Initializes adaptive lock AL, keeping statistics for it under
+   NAME as lock_init_named() does. */
+void
+adaptive_lock_init_named (struct adaptive_lock *al, const char *name)
+{
+  adaptive_lock_init (al);
+  lock_init_named (&al->lock, name);
+}
+
+/**
+ * adaptive_lock_acquire - acquire the adaptive lock
+ *
+ * @al: pointer to the adaptive lock
+ *
+ * Acquire the given lock, yielding to its holder while that is
+ * preempted, at most ADAPTIVE_SPIN_MAX times, before sleeping until
+ * it becomes available.  With a single CPU the holder cannot be
+ * running while we are, so yielding is the only way to spin.
+ * Yielding only helps if the holder is ready and would get the
+ * CPU, i.e. is not less prioritized; otherwise block at once so
+ * that the holder gets our priority donated.
+ * Must not be called within an interrupt handler.
+*/
+void adaptive_lock_acquire(struct adaptive_lock *al)
+{
+	enum intr_level old_level;
+	struct thread *holder;
+	uint64_t wait_start = 0;
+	bool spin;
+	int i;
+
+	ASSERT(al != NULL);
+	ASSERT(!intr_context());
+
+	for (i = 0; i < ADAPTIVE_SPIN_MAX; i++) {
+		if (lock_try_acquire(&al->lock)) {
+			/* Counted under the lock. */
+			if (i > 0) {
+				al->spin_cnt++;
+				if (al->lock.stats != NULL)
+					stats_spun(al->lock.stats, wait_start);
+			}
+			return;
+		}
+		if (i == 0 && al->lock.stats != NULL)
+			wait_start = rdtsc();
+
+		/* Check the holder is preempted but would run. */
+		old_level = intr_disable();
+		holder = al->lock.holder;
+		spin = holder != NULL && holder->status == THREAD_READY &&
+		       holder->priority >= thread_current()->priority;
+		intr_set_level(old_level);
+		if (!spin)
+			break;
+		thread_yield();
+	}
+
+	acquire(&al->lock, wait_start);
+	al->block_cnt++;
+}
+
+/* Releases adaptive lock AL, which must be owned by the current
+   thread. */
+void
+adaptive_lock_release (struct adaptive_lock *al)
+{
+  ASSERT (al != NULL);
+
+  lock_release (&al->lock);
+}
+
+/* Returns true if the current thread holds AL, false otherwise. */
+bool
+adaptive_lock_held_by_current_thread (const struct adaptive_lock *al)
+{
+  ASSERT (al != NULL);
+
+  return lock_held_by_current_thread (&al->lock);
 }
 
 /* Initializes condition variable COND.  A condition variable
@@ -395,7 +851,7 @@ cond_init (struct condition *cond)
 {
   ASSERT (cond != NULL);
 
-  list_init (&cond->waiters);
+  waitq_init (&cond->waiters);
 }
 
 /* Atomically releases LOCK and waits for COND to be signaled by
@@ -414,6 +870,12 @@ cond_init (struct condition *cond)
    condition variables.  That is, there is a one-to-many mapping
    from locks to condition variables.
 
+   Signaling does not wake the waiter.  It moves the waiter onto
+   LOCK's queue, as if it had called lock_acquire(), so that it
+   wakes only when the signaler releases LOCK, and already holds
+   LOCK when it does, instead of waking just to block on LOCK
+   again.
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
@@ -421,18 +883,28 @@ cond_init (struct condition *cond)
 void
 cond_wait (struct condition *cond, struct lock *lock) 
 {
-  struct semaphore_elem waiter;
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
 
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
   
-  sema_init (&waiter.semaphore, 0);
-  list_push_back (&cond->waiters, &waiter.elem);
-  lock_release (lock);
-  sema_down (&waiter.semaphore);
-  lock_acquire (lock);
+  /* Queue by priority, kept up to date by synch_priority_changed(),
+     and release LOCK and block in one step, so that we are asleep
+     by the time a signal can move us. */
+  old_level = intr_disable ();
+  cur->cond_waiting = cond;
+  waitq_push (&cond->waiters, &cur->waitelem, cur->priority);
+  release (lock);
+  thread_block ();
+
+  /* A signal moved us to LOCK's queue and its release woke us.
+     Take LOCK, unless another thread got to it first, in which
+     case down() queues us again. */
+  hold (lock, 0, down (lock));
+  intr_set_level (old_level);
 }
 
 /**
@@ -442,41 +914,368 @@ cond_wait (struct condition *cond, struct lock *lock)
  * @lock: unused
  *
  * If any threads are waiting on COND (protected by LOCK), then
- * this function signals one of them to wake up from its wait.
+ * this function signals one of them, by moving it onto the queue
+ * of LOCK, to wake up holding LOCK once it is released.
  * LOCK must be held before calling this function.
  * An interrupt handler cannot acquire a lock, so it does not
  * make sense to try to signal a condition variable within an
  * interrupt handler. */
-void cond_signal(struct condition *cond, struct lock *lock UNUSED)
+void cond_signal(struct condition *cond, struct lock *lock)
 {
-	bool aux;
+	enum intr_level old_level;
+	struct thread *t;
 
 	ASSERT(cond != NULL);
 	ASSERT(lock != NULL);
 	ASSERT(!intr_context());
 	ASSERT(lock_held_by_current_thread(lock));
 
-	/* Signal the most prioritized waiter thread. */
-	if (!list_empty(&cond->waiters)) {
-		aux = true;
-		list_sort(&cond->waiters, semaphore_elem_cmp_priority, &aux);
-		sema_up(&list_entry(list_pop_front(&cond->waiters),
-				    struct semaphore_elem, elem)->semaphore);
+	/* Signal the most prioritized waiter thread, the front. */
+	old_level = intr_disable();
+	if (!waitq_empty(&cond->waiters)) {
+		t = waitq_entry(waitq_pop(&cond->waiters), struct thread,
+				waitelem);
+		t->cond_waiting = NULL;
+		t->sema_waiting = &lock->semaphore;
+		waitq_push(&lock->semaphore.waiters, &t->waitelem,
+			   t->priority);
+		donate(lock, t);
 	}
+	intr_set_level(old_level);
 }
 
-/* Wakes up all threads, if any, waiting on COND (protected by
-   LOCK).  LOCK must be held before calling this function.
+/**
+ * cond_broadcast - signal all threads waiting on the given condition
+ *
+ * @cond: pointer to the condition
+ * @lock: pointer to the lock protecting it
+ *
+ * Signal every thread waiting on COND (protected by LOCK), like
+ * cond_signal(), but by splicing the whole queue of COND into that
+ * of LOCK at once.  Only the most prioritized waiter needs to
+ * donate, as the others donate no more.  LOCK must be held before
+ * calling this function.
+ * An interrupt handler cannot acquire a lock, so it does not
+ * make sense to try to signal a condition variable within an
+ * interrupt handler. */
+void cond_broadcast(struct condition *cond, struct lock *lock)
+{
+	enum intr_level old_level;
+	struct list_elem *e;
+	struct thread *t;
+
+	ASSERT(cond != NULL);
+	ASSERT(lock != NULL);
+	ASSERT(!intr_context());
+	ASSERT(lock_held_by_current_thread(lock));
+
+	old_level = intr_disable();
+	if (!waitq_empty(&cond->waiters)) {
+		for (e = list_begin(&cond->waiters.elems);
+		     e != list_end(&cond->waiters.elems); e = list_next(e)) {
+			t = list_entry(e, struct thread, waitelem.elem);
+			t->cond_waiting = NULL;
+			t->sema_waiting = &lock->semaphore;
+			if (!thread_mlfqs)
+				t->lock_waiting = lock;
+		}
+		t = waitq_entry(waitq_front(&cond->waiters), struct thread,
+				waitelem);
+		waitq_splice(&lock->semaphore.waiters, &cond->waiters);
+		donate(lock, t);
+	}
+	intr_set_level(old_level);
+}
 
-   An interrupt handler cannot acquire a lock, so it does not
-   make sense to try to signal a condition variable within an
-   interrupt handler. */
+/* Initializes RW as an unheld reader-writer lock. */
 void
-cond_broadcast (struct condition *cond, struct lock *lock) 
+rwlock_init (struct rwlock *rw)
 {
-  ASSERT (cond != NULL);
-  ASSERT (lock != NULL);
+  ASSERT (rw != NULL);
+
+  lock_init (&rw->mutex);
+  lock_init (&rw->writer);
+  cond_init (&rw->no_readers);
+  rw->readers = 0;
+  rw->writers = 0;
+}
+
+/**
+ * rwlock_acquire_read - acquire the reader-writer lock shared
+ *
+ * @rw: pointer to the reader-writer lock
+ *
+ * Acquire the given lock for reading, sleeping while a writer holds
+ * or waits for it.  A reader waits for a writer by passing through
+ * its writer lock, which donates its priority to the writer holding
+ * it.  May sleep, so must not be called within an interrupt handler.
+*/
+void rwlock_acquire_read(struct rwlock *rw)
+{
+	ASSERT(rw != NULL);
+	ASSERT(!intr_context());
+
+	lock_acquire(&rw->mutex);
+	while (rw->writers > 0) {
+		/* Wait for the writer, donating to it. */
+		lock_release(&rw->mutex);
+		lock_acquire(&rw->writer);
+		lock_release(&rw->writer);
+		lock_acquire(&rw->mutex);
+	}
+	rw->readers++;
+	lock_release(&rw->mutex);
+}
+
+/* Releases RW, which must be held for reading by the current
+   thread, waking a writer waiting for the last reader. */
+void
+rwlock_release_read (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->mutex);
+  ASSERT (rw->readers > 0);
+  if (--rw->readers == 0)
+    cond_signal (&rw->no_readers, &rw->mutex);
+  lock_release (&rw->mutex);
+}
+
+/**
+ * rwlock_acquire_write - acquire the reader-writer lock exclusive
+ *
+ * @rw: pointer to the reader-writer lock
+ *
+ * Acquire the given lock for writing.  Announce the writer first so
+ * that no new reader gets in, then take the writer lock, then wait
+ * for the readers in to leave.  May sleep, so must not be called
+ * within an interrupt handler.
+*/
+void rwlock_acquire_write(struct rwlock *rw)
+{
+	ASSERT(rw != NULL);
+	ASSERT(!intr_context());
+
+	lock_acquire(&rw->mutex);
+	rw->writers++;
+	lock_release(&rw->mutex);
+
+	lock_acquire(&rw->writer);
+
+	lock_acquire(&rw->mutex);
+	while (rw->readers > 0)
+		cond_wait(&rw->no_readers, &rw->mutex);
+	lock_release(&rw->mutex);
+}
+
+/* Releases RW, which must be held for writing by the current
+   thread. */
+void
+rwlock_release_write (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (lock_held_by_current_thread (&rw->writer));
+
+  lock_acquire (&rw->mutex);
+  rw->writers--;
+  lock_release (&rw->mutex);
+  lock_release (&rw->writer);
+}
+
+/* Returns true if the current thread holds RW for writing, false
+   otherwise.  Holding for reading is not tracked per thread. */
+bool
+rwlock_held_by_current_thread (const struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  return lock_held_by_current_thread (&rw->writer);
+}
+
+/**
+ * synch_priority_changed - re-queue a waiting thread on priority change
+ *
+ * @t: pointer to the thread whose priority has changed
+ *
+ * Move the given thread within the waiters of the semaphore and
+ * condition it waits on, if any, to match its new priority.
+ * Must be called with interrupts turned off.
+*/
+void synch_priority_changed(struct thread *t)
+{
+	ASSERT(intr_get_level() == INTR_OFF);
+
+	if (t->sema_waiting)
+		waitq_update(&t->sema_waiting->waiters, &t->waitelem,
+			     t->priority);
+	if (t->cond_waiting)
+		waitq_update(&t->cond_waiting->waiters, &t->waitelem,
+			     t->priority);
+}
+
+/* Initializes Q as an empty waitq. */
+void
+waitq_init (struct waitq *q)
+{
+  list_init (&q->elems);
+  list_init (&q->tails);
+}
+
+/* Returns true if Q has no waiters. */
+bool
+waitq_empty (struct waitq *q)
+{
+  return list_empty (&q->elems);
+}
 
-  while (!list_empty (&cond->waiters))
-    cond_signal (cond, lock);
+/* Returns the most prioritized waiter of non-empty Q. */
+struct waitq_elem *
+waitq_front (struct waitq *q)
+{
+  ASSERT (!waitq_empty (q));
+
+  return list_entry (list_front (&q->elems), struct waitq_elem, elem);
+}
+
+/**
+ * waitq_push - queue a waiter
+ *
+ * @q: pointer to the waitq
+ * @e: pointer to the waitq_elem
+ * @priority: the priority
+ *
+ * Insert the given element after every waiter of higher or equal
+ * priority, walking at most one tail per distinct priority.
+*/
+void waitq_push(struct waitq *q, struct waitq_elem *e, int priority)
+{
+	struct list_elem *te;
+	struct waitq_elem *prev_tail;
+	struct waitq_elem *tail;
+
+	/* Find the last group of higher or equal priority. */
+	prev_tail = NULL;
+	for (te = list_begin(&q->tails); te != list_end(&q->tails);
+	     te = list_next(te)) {
+		tail = list_entry(te, struct waitq_elem, tailelem);
+		if (tail->priority < priority)
+			break;
+		prev_tail = tail;
+	}
+
+	/* Insert right after that group. */
+	e->priority = priority;
+	if (prev_tail)
+		list_insert(list_next(&prev_tail->elem), &e->elem);
+	else
+		list_push_front(&q->elems, &e->elem);
+
+	/* Become the tail of its group. */
+	if (prev_tail && prev_tail->priority == priority) {
+		list_insert(&prev_tail->tailelem, &e->tailelem);
+		list_remove(&prev_tail->tailelem);
+		prev_tail->tail = false;
+	} else {
+		list_insert(te, &e->tailelem);
+	}
+	e->tail = true;
+}
+
+/**
+ * waitq_remove - dequeue a waiter
+ *
+ * @q: pointer to the waitq
+ * @e: pointer to the waitq_elem in the queue
+ *
+ * Remove the given element, handing its tail role over to the
+ * waiter before it if of the same priority.
+*/
+void waitq_remove(struct waitq *q, struct waitq_elem *e)
+{
+	struct list_elem *prev;
+	struct waitq_elem *p;
+
+	if (e->tail) {
+		prev = list_prev(&e->elem);
+		if (prev != list_head(&q->elems)) {
+			p = list_entry(prev, struct waitq_elem, elem);
+			if (p->priority == e->priority) {
+				list_insert(&e->tailelem, &p->tailelem);
+				p->tail = true;
+			}
+		}
+		list_remove(&e->tailelem);
+		e->tail = false;
+	}
+	list_remove(&e->elem);
+}
+
+/**
+ * waitq_splice - move every waiter of a waitq into another
+ *
+ * @dst: pointer to the waitq to move the waiters into
+ * @src: pointer to the waitq to move them from
+ *
+ * Move the waiters of SRC into DST, each after every waiter of DST
+ * of higher or equal priority, just as if pushed one by one, but a
+ * whole group of equal priority at a time, walking each tail of
+ * either queue once.  SRC is left empty.
+*/
+void waitq_splice(struct waitq *dst, struct waitq *src)
+{
+	struct list_elem *te;
+	struct waitq_elem *prev_tail;
+	struct waitq_elem *tail;
+	struct waitq_elem *d;
+
+	te = list_begin(&dst->tails);
+	prev_tail = NULL;
+	while (!list_empty(&src->tails)) {
+		/* The next group of SRC runs from its front to its tail. */
+		tail = list_entry(list_pop_front(&src->tails),
+				  struct waitq_elem, tailelem);
+
+		/* Find the last group of DST of higher or equal priority. */
+		for (; te != list_end(&dst->tails); te = list_next(te)) {
+			d = list_entry(te, struct waitq_elem, tailelem);
+			if (d->priority < tail->priority)
+				break;
+			prev_tail = d;
+		}
+
+		/* Move the group right after that group. */
+		list_splice(prev_tail ? list_next(&prev_tail->elem)
+				      : list_begin(&dst->elems),
+			    list_begin(&src->elems), list_next(&tail->elem));
+
+		/* Take over as the tail of a group of equal priority. */
+		if (prev_tail && prev_tail->priority == tail->priority) {
+			list_insert(&prev_tail->tailelem, &tail->tailelem);
+			list_remove(&prev_tail->tailelem);
+			prev_tail->tail = false;
+		} else {
+			list_insert(te, &tail->tailelem);
+		}
+		prev_tail = tail;
+	}
+}
+
+/* Removes and returns the most prioritized waiter of non-empty Q. */
+struct waitq_elem *
+waitq_pop (struct waitq *q)
+{
+  struct waitq_elem *e = waitq_front (q);
+
+  waitq_remove (q, e);
+  return e;
+}
+
+/* Moves waiter E within Q to match PRIORITY. */
+void
+waitq_update (struct waitq *q, struct waitq_elem *e, int priority)
+{
+  if (e->priority == priority)
+    return;
+  waitq_remove (q, e);
+  waitq_push (q, e, priority);
 }
@@ -3,12 +3,52 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+
+struct thread;
+
+/* Priority-bucketed queue of waiters.  Waiters are kept in
+   priority-descending order, FIFO within a priority, and the last
+   waiter of each distinct priority is linked into TAILS, so that
+   the most prioritized waiter is the front, and inserting or
+   re-prioritizing a waiter walks at most one tail per priority. */
+struct waitq
+  {
+    struct list elems;          /* Waiters. */
+    struct list tails;          /* Last waiter of each priority. */
+  };
+
+/* An element of a waitq. */
+struct waitq_elem
+  {
+    struct list_elem elem;      /* Element in elems. */
+    struct list_elem tailelem;  /* Element in tails, if TAIL. */
+    bool tail;                  /* Last waiter of its priority? */
+    int priority;               /* Priority queued at. */
+  };
+
+/* Converts pointer to waitq element WAITQ_ELEM into a pointer to
+   the structure that WAITQ_ELEM is embedded inside. */
+#define waitq_entry(WAITQ_ELEM, STRUCT, MEMBER)           \
+        ((STRUCT *) ((uint8_t *) (WAITQ_ELEM)             \
+                     - offsetof (STRUCT, MEMBER)))
+
+void waitq_init (struct waitq *);
+bool waitq_empty (struct waitq *);
+struct waitq_elem *waitq_front (struct waitq *);
+void waitq_push (struct waitq *, struct waitq_elem *, int priority);
+void waitq_remove (struct waitq *, struct waitq_elem *);
+struct waitq_elem *waitq_pop (struct waitq *);
+void waitq_splice (struct waitq *dst, struct waitq *src);
+void waitq_update (struct waitq *, struct waitq_elem *, int priority);
 
 /* A counting semaphore. */
 struct semaphore 
   {
     unsigned value;             /* Current value. */
-    struct list waiters;        /* List of waiting threads. */
+    struct waitq waiters;       /* Queue of waiting threads. */
   };
 
 void sema_init (struct semaphore *, unsigned value);
@@ -17,37 +57,112 @@ bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
 void sema_self_test (void);
 
+/* Contention statistics of a named lock, kept if lock_stats. */
+struct lock_stats
+  {
+    char name[16];              /* Name given to lock_init_named(). */
+    uint64_t acquire_cnt;       /* # of acquisitions. */
+    uint64_t contend_cnt;       /* # of acquisitions that had to wait. */
+    uint64_t wait_cycles;       /* Cycles spent waiting, in total. */
+    uint64_t wait_max;          /* Longest wait in cycles. */
+    uint64_t hold_cycles;       /* Cycles the lock was held, in total. */
+    uint64_t hold_max;          /* Longest hold in cycles. */
+    uint64_t held_since;        /* Time stamp counter at acquisition. */
+  };
+
 /* Lock. */
 struct lock 
   {
     struct thread *holder;      /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
     int priority;		/* Max priority of the threads acquiring it. */
-    struct list_elem elem;	/* List element for holder thread. */
+    struct waitq_elem elem;	/* Element in holder's locks queue. */
+    bool handoff;               /* Hand over to a waiter on release? */
+    struct lock_stats *stats;   /* Statistics, if named and lock_stats. */
   };
 
-bool lock_cmp_priority(const struct list_elem *, const struct list_elem *,
-		       void *);
+extern bool lock_stats;
+
 void lock_init (struct lock *);
+void lock_init_named (struct lock *, const char *name);
+void lock_set_handoff (struct lock *, bool handoff);
 void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
+void lock_donation_stats (uint64_t *, uint64_t *, uint64_t *, uint64_t *);
+void lock_print_stats (void);
+
+/* Spinlock, for state shared with interrupt handlers or other
+   CPUs.  Holding it keeps interrupts off on the local CPU and
+   other CPUs spinning, so critical sections must be short and
+   must not sleep. */
+struct spinlock
+  {
+    volatile uint32_t locked;   /* Nonzero while held. */
+    enum intr_level old_level;  /* Interrupt level before acquire. */
+  };
+
+void spinlock_init (struct spinlock *);
+void spinlock_acquire (struct spinlock *);
+void spinlock_release (struct spinlock *);
+bool spinlock_held (const struct spinlock *);
+
+/* Adaptive lock, for short critical sections.  A contender first
+   yields to a preempted holder up to ADAPTIVE_SPIN_MAX times,
+   expecting it to leave its critical section in the meantime, and
+   only then blocks on the lock, donating its priority. */
+struct adaptive_lock
+  {
+    struct lock lock;           /* Underlying lock. */
+    unsigned spin_cnt;          /* # of acquisitions won by spinning. */
+    unsigned block_cnt;         /* # of acquisitions that blocked. */
+  };
+
+/* Maximum number of yields before blocking. */
+#define ADAPTIVE_SPIN_MAX 4
+
+void adaptive_lock_init (struct adaptive_lock *);
+void adaptive_lock_init_named (struct adaptive_lock *, const char *name);
+void adaptive_lock_acquire (struct adaptive_lock *);
+void adaptive_lock_release (struct adaptive_lock *);
+bool adaptive_lock_held_by_current_thread (const struct adaptive_lock *);
 
 /* Condition variable. */
 struct condition 
   {
-    struct list waiters;        /* List of waiting threads. */
+    struct waitq waiters;       /* Queue of waiting threads. */
   };
 
-bool semaphore_elem_cmp_priority(const struct list_elem *,
-				 const struct list_elem *, void *);
-
 void cond_init (struct condition *);
 void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Reader-writer lock.  Any number of readers or a single writer
+   may hold it at a time.  Writers are preferred: once a writer
+   waits, new readers wait behind it, so readers cannot starve
+   writers.  The holding writer holds WRITER for all its critical
+   section, so that waiting readers and writers donate it their
+   priority. */
+struct rwlock
+  {
+    struct lock mutex;          /* Protects the members below. */
+    struct lock writer;         /* Held by the writer, if any. */
+    struct condition no_readers;        /* Signaled on last reader. */
+    unsigned readers;           /* # of readers holding the lock. */
+    unsigned writers;           /* # of writers holding or waiting. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_by_current_thread (const struct rwlock *);
+
+void synch_priority_changed(struct thread *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
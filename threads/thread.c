@@ -3,35 +3,170 @@
 #include <fixed_point.h>
 #include <stddef.h>
 #include <random.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/arena.h"
+#include "threads/cycle.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
+#include "threads/loader.h"
 #include "threads/palloc.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
+#include "threads/tunable.h"
 #include "threads/vaddr.h"
+#include "devices/block.h"
+#include "devices/timer.h"
 #ifdef USERPROG
+#include "userprog/fpu.h"
 #include "userprog/process.h"
 #endif
+#ifdef VM
+#include "vm/swap.h"
+#endif
 
 /* Random value for struct thread's `magic' member.
    Used to detect stack overflow.  See the big comment at the top
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes sleeping a.k.a. blocked with ticks_sleep to come. */
-static struct list sleep_list;
+/* Binary min-heap keyed on ticks_sleep of processes sleeping a.k.a.
+   blocked with ticks_sleep to come.  sleep_heap[0] sleeps the least.
+   Every thread takes a page, so init_ram_pages entries always suffice. */
+static struct thread **sleep_heap;
+static size_t sleep_cnt;
+
+/* Number of distinct priorities, one run queue each. */
+#define PRI_CNT (PRI_MAX - PRI_MIN + 1)
+
+/* Pages of dead threads kept for reuse by thread_create(), so
+   that thread churn bypasses palloc, and the stack part of the
+   page is never zeroed either way. */
+#define THREAD_CACHE_MAX 16
+static struct thread *thread_cache[THREAD_CACHE_MAX];
+static size_t thread_cache_cnt;
+
+/* Per-CPU scheduler state.  Each CPU runs threads from its own run
+   queues, and steals from those of other CPUs when it runs dry.
+   Which of the run queues below hold the processes in THREAD_READY
+   state, that is, processes that are ready to run but not actually
+   running, depends on the scheduling class. */
+struct cpu
+  {
+    struct spinlock lock;       /* Protects the members below. */
+    size_t ready_cnt;           /* Number of ready threads. */
+
+    /* Priority and MLFQS classes: one FIFO per priority.  Bit P of
+       ready_bitmap is set iff ready_queues[P] is non-empty, so the
+       most prioritized queue is found in O(1). */
+    struct list ready_queues[PRI_CNT];
+    uint64_t ready_bitmap;
+
+    /* Fair class: threads ordered by vruntime, and a floor that
+       vruntime of the threads on this CPU has reached. */
+    struct rb_tree fair_tree;
+    uint64_t min_vruntime;
+
+    /* Deadline class, over whichever of the above is in use:
+       threads by absolute deadline. */
+    struct rb_tree dl_tree;
+  } __attribute__ ((aligned (CACHE_LINE_SIZE)));  /* One line each. */
+
+static struct cpu cpus[CPU_CNT];
+
+/* Scheduling class, the policy that orders the ready threads of
+   each CPU.  All operations are called with interrupts off, and
+   all but tick() with the CPU's lock held. */
+struct sched_class
+  {
+    const char *name;           /* Name for the "-sched" option. */
+
+    /* Adds ready thread T to the run queues of C. */
+    void (*enqueue) (struct cpu *c, struct thread *t);
+
+    /* Removes ready thread T from the run queues of C. */
+    void (*dequeue) (struct cpu *c, struct thread *t);
+
+    /* Removes and returns the thread C should run next.  C has
+       some thread ready. */
+    struct thread *(*pick_next) (struct cpu *c);
+
+    /* Accounts a timer tick to CUR, running on C, which may be
+       the idle thread.  Returns true if CUR should be preempted. */
+    bool (*tick) (struct cpu *c, struct thread *cur);
+
+    /* Repositions ready thread T in the run queues of C after its
+       priority changed from OLD_PRIORITY.  If null, T is dequeued
+       at OLD_PRIORITY and enqueued again instead. */
+    void (*priority_changed) (struct cpu *c, struct thread *t,
+                              int old_priority);
+  };
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+static void prio_enqueue (struct cpu *, struct thread *);
+static void prio_dequeue (struct cpu *, struct thread *);
+static struct thread *prio_pick_next (struct cpu *);
+static bool prio_tick (struct cpu *, struct thread *);
+static bool mlfqs_tick (struct cpu *, struct thread *);
+static void fair_enqueue (struct cpu *, struct thread *);
+static void fair_dequeue (struct cpu *, struct thread *);
+static struct thread *fair_pick_next (struct cpu *);
+static bool fair_tick (struct cpu *, struct thread *);
+static void fair_priority_changed (struct cpu *, struct thread *, int);
+static rb_less_func fair_less;
+static void dl_enqueue (struct cpu *, struct thread *);
+static void dl_dequeue (struct cpu *, struct thread *);
+static struct thread *dl_pick_next (struct cpu *);
+static bool dl_tick (struct cpu *, struct thread *);
+static void dl_priority_changed (struct cpu *, struct thread *, int);
+static rb_less_func dl_less;
+
+/* Strict priority, round-robin within a priority. */
+static const struct sched_class priority_class =
+  {"priority", prio_enqueue, prio_dequeue, prio_pick_next, prio_tick,
+   NULL};
+
+/* Multi-level feedback queues, the priority class with priorities
+   computed from nice and recent_cpu. */
+static const struct sched_class mlfqs_class =
+  {"mlfqs", prio_enqueue, prio_dequeue, prio_pick_next, mlfqs_tick,
+   NULL};
+
+/* Weighted fair sharing by virtual run time. */
+static const struct sched_class fair_class =
+  {"fair", fair_enqueue, fair_dequeue, fair_pick_next, fair_tick,
+   fair_priority_changed};
+
+/* Earliest deadline first, for threads with a CPU reservation.
+   Not selectable: it runs alongside the class in use, and its
+   threads take precedence over that class's. */
+static const struct sched_class deadline_class =
+  {"deadline", dl_enqueue, dl_dequeue, dl_pick_next, dl_tick,
+   dl_priority_changed};
+
+/* Scheduling class in use, chosen by thread_sched_select(). */
+static const struct sched_class *sched_class = &priority_class;
 
 /* List of all processes.  Processes are added to this list
-   when they are first scheduled and removed when they exit. */
+   when they are first scheduled and removed when they exit.  It is
+   read under RCU, so a dead thread's page is freed only after a
+   grace period. */
 static struct list all_list;
 
+/* Threads by tid, for thread_from_tid().  Tids are handed out in
+   sequence, so hashing by their low bits spreads the live threads
+   evenly over a fixed array of buckets, and a lookup takes O(1)
+   without a table that would have to grow, and allocate, with
+   interrupts off. */
+#define TID_BUCKETS 256
+static struct list tid_table[TID_BUCKETS];
+
+/* Serializes changes to all_list and tid_table.  Readers use
+   rcu_read_lock() instead. */
+static struct spinlock all_lock;
+
 /* Idle thread. */
 static struct thread *idle_thread;
 
@@ -51,31 +186,142 @@ struct kernel_thread_frame
 
 /* Statistics. */
 static long long ticks;		/* Number of OS timer ticks. */
-static long long idle_ticks;    /* # of timer ticks spent idle. */
-static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
-static long long user_ticks;    /* # of timer ticks in user programs. */
+static struct percpu_counter idle_ticks;   /* # of timer ticks spent idle. */
+static struct percpu_counter kernel_ticks; /* # in kernel threads. */
+static struct percpu_counter user_ticks;   /* # in user programs. */
+static uint64_t sleep_insert_cnt;	/* # of sleep heap inserts. */
+static uint64_t sleep_insert_cycles;	/* Cycles spent in inserts. */
+static uint64_t sleep_wake_cnt;	/* # of threads woken from sleep heap. */
+static uint64_t sleep_wake_cycles;	/* Cycles spent in wake-ups. */
 static fixed_t load_avg;	/* System load average. */
 
+/* Lazy MLFQS decay.  recent_cpu of a thread is brought up to date only
+   when it is examined, i.e. while running or ready each second, or
+   when it becomes ready, by replaying the per-second decays since its
+   recent_cpu_epoch.  Decay coefficients of the last MLFQS_HISTORY
+   seconds are kept for the replay. */
+#define MLFQS_HISTORY 256
+static int64_t mlfqs_epoch;	/* # of per-second MLFQS updates. */
+static fixed_t mlfqs_coef[MLFQS_HISTORY];	/* Coefficient per epoch. */
+
+/* (59/60)^K for K < MLFQS_DECAY_CNT, the decay of load_avg over K
+   seconds with no thread ready.  Beyond, it is below one unit. */
+#define MLFQS_DECAY_CNT 1024
+static fixed_t mlfqs_decay[MLFQS_DECAY_CNT];
+
+/* Per-second pass over the ready threads, deferred out of the timer
+   interrupt since its length grows with the number of threads. */
+static struct intr_work mlfqs_work;
+static void thread_mlfqs_update_ready(void *aux);
+
 /* Scheduling. */
-#define TIME_SLICE 4            /* # of timer ticks to give each thread. */
+static unsigned time_slice = 4; /* # of timer ticks to give each thread. */
 static unsigned thread_ticks;   /* # of timer ticks since last yield. */
+static struct tunable time_slice_tunable =
+  {
+    .name = "sched.time_slice",
+    .value = &time_slice,
+    .min = 1,
+    .max = 1000,
+  };
+
+/* Set when a thread more prioritized than the running one is made
+   ready by code that cannot yield on the spot, and cleared on the
+   next switch.  The timer interrupt yields on return if it is set,
+   and so does thread_cond_yield() at safe points in long kernel
+   loops. */
+static bool need_resched;
+
+/* Fair class.  vruntime of a running thread advances by FAIR_TICK
+   per tick at the default priority, and faster or slower by the
+   ratio of the default weight to its own weight.  The thread runs
+   until it is FAIR_GRANULARITY ahead of the thread with the least
+   vruntime, so that peers alternate every time_slice ticks.  A
+   thread waking up is put at most FAIR_SLEEPER_CREDIT behind the
+   others, for a quick turn without a lead of the whole time it
+   slept. */
+#define FAIR_TICK 1024
+#define FAIR_GRANULARITY (FAIR_TICK * time_slice / 2)
+#define FAIR_SLEEPER_CREDIT (FAIR_TICK * time_slice)
+
+/* Weights of the fair class, as in Linux, for the priorities from
+   PRI_DEFAULT + 20 down to PRI_DEFAULT - 19, beyond which they are
+   clamped.  Each step is worth about 10% of CPU time against a
+   neighbour, a ratio of 1.25.  PRI_DEFAULT weighs FAIR_WEIGHT_0. */
+#define FAIR_WEIGHT_0 1024
+static const uint32_t fair_weights[40] =
+  {
+    88761, 71755, 56483, 46273, 36291, 29154, 23254, 18705, 14949, 11916,
+    9548, 7620, 6100, 4904, 3906, 3121, 2501, 1991, 1586, 1277,
+    1024, 820, 655, 526, 423, 335, 272, 215, 172, 137,
+    110, 87, 70, 56, 45, 36, 29, 23, 18, 15,
+  };
 
-/* If false (default), use round-robin scheduler.
-   If true, use multi-level feedback queue scheduler.
-   Controlled by kernel command-line option "-o mlfqs". */
+/* Deadline class.  A thread in it reserves dl_runtime ticks of
+   every dl_period, to be had within dl_rel_deadline ticks of the
+   start of the period, and the ready thread with the earliest
+   absolute deadline runs first.  The budget is kept by a constant
+   bandwidth server: running charges dl_budget, and a thread that
+   uses it up is throttled, to run only as a thread of the class
+   in use until its next period, while a thread that wakes up too
+   late to use its budget by its deadline at the reserved rate
+   starts a new period instead.  So a thread that overruns cannot
+   take time reserved by others, and as long as the densities
+   dl_runtime / dl_rel_deadline add up to at most one CPU, every
+   deadline is met.  Densities are fixed-point, with DL_BW_SHIFT
+   fractional bits, and admission keeps their sum to DL_BW_MAX
+   per CPU, leaving the rest to the other threads. */
+#define DL_BW_SHIFT 20
+#define DL_BW_MAX ((95 << DL_BW_SHIFT) / 100)
+
+static struct list dl_list;	/* Threads in the deadline class. */
+static uint32_t dl_bandwidth;	/* Sum of their densities. */
+static int64_t dl_next_replenish;	/* No throttled thread due before. */
+static struct spinlock dl_lock;	/* Protects the above. */
+
+/* True if the MLFQS scheduling class is selected, in which case
+   priorities are computed rather than set and never donated.
+   Controlled by kernel command-line option "-sched=mlfqs", or
+   "-mlfqs" for short. */
 bool thread_mlfqs;
 
+/* If true, keep per-thread scheduler statistics.
+   Controlled by kernel command-line option "-sched-stats". */
+bool thread_sched_stats;
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
 static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
 static void init_thread (struct thread *, const char *name, int priority);
+static struct thread *thread_page_alloc(void);
+static void thread_page_free(struct thread *);
+static void thread_page_free_rcu(struct rcu_head *);
+static struct cpu *this_cpu(void);
+static size_t ready_threads_cnt(void);
+static void ready_queue_push(struct thread *);
+static struct thread *ready_queue_pop(struct cpu *);
+static void thread_change_priority(struct thread *, int priority);
+static const struct sched_class *class_of(const struct thread *);
+static bool runs_before(const struct thread *, const struct thread *);
+static bool dl_set(struct thread *, int64_t runtime, int64_t period,
+		   int64_t deadline);
+static void dl_wakeup(struct thread *);
+static void sleep_heap_push(struct thread *);
+static struct thread *sleep_heap_pop(void);
+static void sleep_heap_remove(size_t);
+static void thread_mlfqs_sync(struct thread *);
+static fixed_t mlfqs_coefficient(fixed_t load);
+static void thread_mlfqs_skip_idle(int64_t seconds);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
+static void sched_stats_switch(struct thread *, struct thread *);
+static void sched_stats_print(struct thread *, void *);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static tid_t register_thread (struct thread *);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -93,19 +339,52 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
+  struct cpu *c;
+  uint64_t decay;
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
-  lock_init (&tid_lock);
-	/* Initialize sleep_list. */
-	list_init(&sleep_list);
-  list_init (&ready_list);
+  lock_init_named (&tid_lock, "tid");
+	/* Sleep heap is allocated in thread_start() after palloc_init(). */
+	sleep_heap = NULL;
+	sleep_cnt = 0;
+	/* Initialize run queues of every CPU. */
+	for (c = cpus; c < cpus + CPU_CNT; c++) {
+		spinlock_init(&c->lock);
+		c->ready_cnt = 0;
+		for (i = 0; i < PRI_CNT; i++)
+			list_init(&c->ready_queues[i]);
+		c->ready_bitmap = 0;
+		rb_init(&c->fair_tree, fair_less, NULL);
+		c->min_vruntime = 0;
+		rb_init(&c->dl_tree, dl_less, NULL);
+	}
   list_init (&all_list);
+  list_init (&dl_list);
+  dl_next_replenish = INT64_MAX;
+  spinlock_init (&dl_lock);
+  intr_work_init (&mlfqs_work, thread_mlfqs_update_ready, NULL);
+  tunable_register (&time_slice_tunable);
+
+  /* Powers of 59/60, computed with 32 fractional bits so that
+     rounding errors do not pile up. */
+  decay = 1ULL << 32;
+  for (i = 0; i < MLFQS_DECAY_CNT; i++)
+    {
+      mlfqs_decay[i] = (decay + (1 << (31 - FP_SHIFT_BITS)))
+                       >> (32 - FP_SHIFT_BITS);
+      decay = decay * 59 / 60;
+    }
+  for (i = 0; i < TID_BUCKETS; i++)
+    list_init (&tid_table[i]);
+  spinlock_init (&all_lock);
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
   init_thread (initial_thread, "main", PRI_DEFAULT);
   initial_thread->status = THREAD_RUNNING;
-  initial_thread->tid = allocate_tid ();
+  register_thread (initial_thread);
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
@@ -115,6 +394,13 @@ thread_start (void)
 {
   /* Create the idle thread. */
   struct semaphore idle_started;
+
+  /* Allocate the sleep heap. */
+  sleep_heap = palloc_get_multiple (PAL_ASSERT,
+                                    DIV_ROUND_UP (init_ram_pages
+                                                  * sizeof *sleep_heap,
+                                                  PGSIZE));
+
   sema_init (&idle_started, 0);
   thread_create ("idle", PRI_MIN, idle, &idle_started);
 
@@ -128,47 +414,163 @@ thread_start (void)
 /**
  * thread_tick - do thread ticking
  *
+ * @user: true if the tick interrupted user code
+ *
  * Called by the timer interrupt handler at each timer tick.
  * Thus, this function runs in an external interrupt context.
 */
-void thread_tick(void)
+void thread_tick(bool user UNUSED)
 {
 	struct thread *current = thread_current();
+	struct cpu *c = this_cpu();
+	bool preempt;
 
 	/* Update statistics. */
 	ticks++;
 	if (current == idle_thread)
-		idle_ticks++;
+		percpu_counter_inc(&idle_ticks);
 #ifdef USERPROG
-	else if (current->pagedir != NULL)
-		user_ticks++;
+	else if (current->pagedir != NULL) {
+		percpu_counter_inc(&user_ticks);
+		if (user)
+			current->proc->rusage.user_ticks++;
+		else
+			current->proc->rusage.kernel_ticks++;
+	}
 #endif
 	else
-		kernel_ticks++;
+		percpu_counter_inc(&kernel_ticks);
+
+	/* Let the scheduling classes account the tick and preempt.  The
+	   class in use sees every tick, for its bookkeeping, but only the
+	   deadline class preempts a thread of its own. */
+	thread_ticks++;
+	preempt = sched_class->tick(c, current);
+	if (class_of(current) == &deadline_class)
+		preempt = false;
+	if (deadline_class.tick(c, current) || preempt)
+		intr_yield_on_return();
+}
 
-	/* Update statistics for MLFQS. */
-	if (thread_mlfqs) {
-		/* recent_cpu is incremented each tick. */
-		thread_mlfqs_increment_recent_cpu();
-		/* load_avg and recent_cpu is updated each second. */
-		if (ticks % TIMER_FREQ == 0)
-			thread_mlfqs_update_recent_cpu();
-		/* Priority is updated every 4th tick. */
-		else if (ticks % 4 == 0 && current != idle_thread)
-			thread_mlfqs_update_priority(current);
+/**
+ * thread_tick_idle - account ticks spent idle without timer interrupts
+ *
+ * @n: number of ticks
+ *
+ * Called in dynamic-tick mode for ticks whose timer interrupts were
+ * skipped since the CPU was idle, either by the timer interrupt handler
+ * or by the scheduler when switching away from the idle thread.
+ * Must be called with interrupts turned off.
+*/
+void thread_tick_idle(unsigned n)
+{
+	int64_t seconds;
+
+	ASSERT(intr_get_level() == INTR_OFF);
+
+	/* Under MLFQS, apply all but the last idle second at once. */
+	seconds = (ticks + n) / TIMER_FREQ - ticks / TIMER_FREQ;
+	if (thread_mlfqs && seconds > 1) {
+		unsigned skip = (ticks + n) / TIMER_FREQ * TIMER_FREQ - 1
+				- ticks;
+
+		thread_mlfqs_skip_idle(seconds - 1);
+		ticks += skip;
+		percpu_counter_add(&idle_ticks, skip);
+		n -= skip;
 	}
 
-	/* Enforce preemption. */
-	if (++thread_ticks >= TIME_SLICE)
-		intr_yield_on_return();
+	for (; n > 0; n--) {
+		ticks++;
+		percpu_counter_inc(&idle_ticks);
+		sched_class->tick(this_cpu(), idle_thread);
+	}
+}
+
+/**
+ * thread_sched_select - select the scheduling class
+ *
+ * @name: "priority", "mlfqs" or "fair"
+ *
+ * Select the scheduling class of the given name.  Must be called
+ * before any thread is ready, i.e. while parsing the command line.
+ * Return false if there is no such class.
+*/
+bool thread_sched_select(const char *name)
+{
+	static const struct sched_class *const classes[] = {
+		&priority_class, &mlfqs_class, &fair_class,
+	};
+	size_t i;
+
+	ASSERT(ready_threads_cnt() == 0);
+
+	for (i = 0; i < sizeof classes / sizeof *classes; i++)
+		if (!strcmp(name, classes[i]->name)) {
+			sched_class = classes[i];
+			thread_mlfqs = sched_class == &mlfqs_class;
+			return true;
+		}
+	return false;
+}
+
+/* Returns the name of the scheduling class in use. */
+const char *
+thread_sched_name (void)
+{
+  return sched_class->name;
+}
+
+/**
+ * thread_set_deadline - move the running thread into the deadline class
+ *
+ * @runtime: ticks of CPU time to reserve per period, or 0 to leave
+ * @period: ticks in a period
+ * @deadline: ticks into each period by which the runtime is due
+ *
+ * Reserve the given runtime in every period for the running thread,
+ * starting now, which puts it ahead of every thread outside the
+ * deadline class, or give up its reservation if runtime is 0.
+ * Requires 0 < runtime <= deadline <= period.  Return false, changing
+ * nothing, if the parameters are invalid or if admission control
+ * refuses them since the reservations would exceed DL_BW_MAX.
+*/
+bool thread_set_deadline(int64_t runtime, int64_t period, int64_t deadline)
+{
+	enum intr_level old_level;
+	bool success;
+
+	ASSERT(!intr_context());
+
+	if (runtime != 0 && (runtime < 0 || runtime > deadline ||
+			     deadline > period))
+		return false;
+
+	old_level = intr_disable();
+	success = dl_set(thread_current(), runtime, period, deadline);
+	intr_set_level(old_level);
+
+	/* Let EDF decide whether the thread still runs first. */
+	if (success)
+		thread_yield();
+	return success;
 }
 
 /* Prints thread statistics. */
 void
 thread_print_stats (void) 
 {
-  printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
-          idle_ticks, kernel_ticks, user_ticks);
+  enum intr_level old_level;
+
+  printf ("Thread: %llu idle ticks, %llu kernel ticks, %llu user ticks\n",
+          percpu_counter_sum (&idle_ticks), percpu_counter_sum (&kernel_ticks),
+          percpu_counter_sum (&user_ticks));
+  if (thread_sched_stats)
+    {
+      old_level = intr_disable ();
+      thread_foreach (sched_stats_print, NULL);
+      intr_set_level (old_level);
+    }
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -199,13 +601,13 @@ thread_create (const char *name, int priority,
   ASSERT (function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = thread_page_alloc ();
   if (t == NULL)
     return TID_ERROR;
 
   /* Initialize thread. */
   init_thread (t, name, priority);
-  tid = t->tid = allocate_tid ();
+  tid = register_thread (t);
 
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame (t, sizeof *kf);
@@ -255,48 +657,38 @@ thread_block (void)
    This function does not preempt the running thread.  This can
    be important: if the caller had disabled interrupts itself,
    it may expect that it can atomically unblock a thread and
-   update other data. */
+   update other data.  If T is more prioritized, the running
+   thread yields at its next preemption point instead; see
+   thread_cond_yield(). */
 void thread_unblock (struct thread *t)
 {
 	enum intr_level old_level;
-	bool aux;
+	bool preempt;
 
 	ASSERT(is_thread(t));
 
 	old_level = intr_disable();
 
 	ASSERT(t->status == THREAD_BLOCKED);
-	/* Insert to ready_list with priority descending. */
-	aux = true;
-	list_insert_ordered(&ready_list, &t->elem, thread_cmp_priority, &aux);
+	if (t->dl_runtime != 0)
+		dl_wakeup(t);
+	/* Catch up with the decays missed while blocked. */
+	if (thread_mlfqs && t != idle_thread) {
+		thread_mlfqs_sync(t);
+		thread_mlfqs_update_priority(t);
+	}
+	/* Append to the run queue of its priority. */
+	ready_queue_push(t);
 	t->status = THREAD_READY;
+	if (thread_sched_stats)
+		t->stats.stamp = timer_ticks();
+	preempt = runs_before(t, thread_current());
+	if (preempt)
+		need_resched = true;
+	TRACE(TRACE_WAKEUP, t->tid, preempt, 0);
 	intr_set_level(old_level);
 }
 
-/**
- * thread_cmp_ticks_sleep - compare two threads' ticks_sleep
- * 
- * @e1: pointer to sleepelem of one thread
- * @e2: pointer to sleepelem of another thread
- * @aux: pointer to direction of comparison in bool.
- *
- * Compare two threads' ticks_sleep.
-*/
-bool thread_cmp_ticks_sleep(const struct list_elem *e1,
-			    const struct list_elem *e2, void *aux)
-{
-	struct thread *t1;
-	struct thread *t2;
-
-	/* Convert sleepelems to threads. */
-	t1 = list_entry(e1, struct thread, sleepelem);
-	t2 = list_entry(e2, struct thread, sleepelem);
-
-	if (*(bool *)aux)
-		return t1->ticks_sleep > t2->ticks_sleep;
-	return t1->ticks_sleep < t2->ticks_sleep;
-}
-
 /**
  * thread_sleep - put the current thread to sleep
  *
@@ -308,7 +700,7 @@ bool thread_cmp_ticks_sleep(const struct list_elem *e1,
 void thread_sleep(int64_t ticks)
 {
 	struct thread *current;
-	bool aux;
+	uint64_t start;
 
 	ASSERT(!intr_context());
 	ASSERT(intr_get_level() == INTR_OFF);
@@ -316,10 +708,11 @@ void thread_sleep(int64_t ticks)
 	current = thread_current();
 	/* Set ticks_sleep. */
 	current->ticks_sleep = ticks;
-	/* Insert to sleep list with ticks_sleep ascending. */
-	aux = false;
-	list_insert_ordered(&sleep_list, &current->sleepelem,
-			    thread_cmp_ticks_sleep, &aux);
+	/* Insert to sleep heap in O(log n). */
+	start = rdtsc();
+	sleep_heap_push(current);
+	sleep_insert_cycles += rdtsc() - start;
+	sleep_insert_cnt++;
 	/* Block the current thread. */
 	thread_block();
 }
@@ -327,37 +720,99 @@ void thread_sleep(int64_t ticks)
 /**
  * thread_foreach_wake - wake threads if ticks_sleep reached the given ticks
  *
- * Wake threads in sleep_list if the given ticks has reached its ticks_sleep.
+ * Wake threads in the sleep heap if the given ticks has reached its
+ * ticks_sleep.  Costs a single comparison when no one is due.
  * Must be called with interrupts turned off.
 */
 void thread_foreach_wake(int64_t ticks)
 {
-	struct list_elem *e;
-	struct list_elem *e_next;
 	struct thread *t;
+	uint64_t start;
 
 	ASSERT(intr_get_level() == INTR_OFF);
 
-	e = list_begin(&sleep_list);
-	while (e && e != list_end(&sleep_list)) {
-		e_next = list_next(e);
+	/* Wake up any thread with ticks_sleep reached, earliest first. */
+	while (sleep_cnt > 0 && sleep_heap[0]->ticks_sleep <= ticks) {
+		start = rdtsc();
+		t = sleep_heap_pop();
+		/* Reset ticks_sleep and unblock this thread. */
+		t->stats.wake_deadline = t->ticks_sleep;
+		t->ticks_sleep = 0;
+		thread_unblock(t);
+		sleep_wake_cycles += rdtsc() - start;
+		sleep_wake_cnt++;
+	}
+	/* Rather than wait for the time slice to run out. */
+	if (need_resched && intr_context())
+		intr_yield_on_return();
+}
+
+/**
+ * thread_wake - wake a sleeping thread before its deadline
+ *
+ * @t: pointer to the thread
+ *
+ * Take the given thread out of the sleep heap and unblock it, if it
+ * sleeps in thread_sleep().  The search is linear, so this suits
+ * rare early wake-ups rather than routine ones.
+ * Must be called with interrupts turned off.
+ * Return true if the thread was sleeping.
+*/
+bool thread_wake(struct thread *t)
+{
+	size_t i;
+
+	ASSERT(intr_get_level() == INTR_OFF);
 
-		t = list_entry (e, struct thread, sleepelem);
-		/* Wake up any thread with ticks_sleep reached. */
-		if (t->ticks_sleep <= ticks) {
-			/* Remove from sleep_list and reset ticks_sleep. */
-			list_remove(e);
+	for (i = 0; i < sleep_cnt; i++)
+		if (sleep_heap[i] == t) {
+			sleep_heap_remove(i);
 			t->ticks_sleep = 0;
-			/* Unblock this thread. */
 			thread_unblock(t);
+			return true;
 		}
-		/* Stop since no one left since ticks_sleep is ascending. */
-		else {
-			break;
-		}
+	return false;
+}
 
-		e = e_next;
-	}
+/**
+ * thread_next_wakeup - get the earliest sleep deadline
+ *
+ * Return the ticks_sleep of the thread sleeping the least,
+ * or INT64_MAX if no thread sleeps.
+ * Must be called with interrupts turned off.
+*/
+int64_t thread_next_wakeup(void)
+{
+	ASSERT(intr_get_level() == INTR_OFF);
+
+	return sleep_cnt > 0 ? sleep_heap[0]->ticks_sleep : INT64_MAX;
+}
+
+/**
+ * thread_sleep_stats - report sleep heap costs
+ *
+ * @insert_cnt: set to the number of inserts, if not NULL
+ * @insert_cycles: set to the cycles spent inserting, if not NULL
+ * @wake_cnt: set to the number of wake-ups, if not NULL
+ * @wake_cycles: set to the cycles spent waking, if not NULL
+ *
+ * Report cumulative sleep heap statistics, for benchmarking.
+*/
+void thread_sleep_stats(uint64_t *insert_cnt, uint64_t *insert_cycles,
+			uint64_t *wake_cnt, uint64_t *wake_cycles)
+{
+	enum intr_level old_level;
+
+	old_level = intr_disable();
+	if (insert_cnt)
+		*insert_cnt = sleep_insert_cnt;
+	if (insert_cycles)
+		*insert_cycles = sleep_insert_cycles;
+	if (wake_cnt)
+		*wake_cnt = sleep_wake_cnt;
+	if (wake_cycles)
+		*wake_cycles = sleep_wake_cycles;
+	intr_set_level(old_level);
 }
 
 /* Returns the name of the running thread. */
@@ -392,30 +847,48 @@ thread_tid (void)
   return thread_current ()->tid;
 }
 
+#ifdef USERPROG
+/**
+ * thread_rusage - return the running process's resource usage
+ *
+ * Return the record that resources used by the running thread are
+ * charged to, which is its process's, or NULL for a kernel thread.
+ * The scheduler charges ticks and switches itself; page faults,
+ * disk traffic, and resident pages are charged where they happen.
+*/
+struct rusage *thread_rusage(void)
+{
+	struct thread *t = thread_current();
+
+	return t->pagedir != NULL ? &t->proc->rusage : NULL;
+}
+#endif
+
 /**
  * thread_from_tid - return the thread with the given tid
  *
  * @tid: the tid
  *
  * Return the thread with the given tid.
- * Must be called with interrupts turned off.
+ * Must be called in an RCU read-side section or with interrupts
+ * turned off, and the thread may be used only until it ends.
 */
 struct thread *thread_from_tid(tid_t tid)
 {
+	struct list *bucket = &tid_table[(unsigned)tid % TID_BUCKETS];
 	struct list_elem *e;
-	struct thread *t;
+	struct thread *t = NULL;
 
-	ASSERT(intr_get_level() == INTR_OFF);
+	ASSERT(rcu_read_active() || intr_get_level() == INTR_OFF);
 
-	for (e = list_begin(&all_list); e != list_end(&all_list);
-	     e = list_next(e)) {
-		t = list_entry(e, struct thread, allelem);
-		if (t->tid == tid)
-			return t;
-	}
+	for (e = list_begin(bucket); e != list_end(bucket); e = list_next(e))
+		if (list_entry(e, struct thread, tidelem)->tid == tid) {
+			t = list_entry(e, struct thread, tidelem);
+			break;
+		}
 
-	/* Return NULL if no corresponding thread exists. */
-	return NULL;
+	/* NULL if no corresponding thread exists. */
+	return t;
 }
 
 /* Deschedules the current thread and destroys it.  Never
@@ -428,12 +901,21 @@ thread_exit (void)
 #ifdef USERPROG
   process_exit ();
 #endif
+  arena_exit ();
+
+  if (thread_sched_stats)
+    sched_stats_print (thread_current (), NULL);
 
-  /* Remove thread from all threads list, set our status to dying,
-     and schedule another process.  That process will destroy us
-     when it calls thread_schedule_tail(). */
+  /* Give up any CPU reservation, remove thread from all threads
+     list, set our status to dying, and schedule another process.
+     That process will destroy us when it calls
+     thread_schedule_tail(). */
   intr_disable ();
-  list_remove (&thread_current()->allelem);
+  dl_set (thread_current (), 0, 0, 0);
+  spinlock_acquire (&all_lock);
+  list_remove (&thread_current ()->allelem);
+  list_remove (&thread_current ()->tidelem);
+  spinlock_release (&all_lock);
   thread_current ()->status = THREAD_DYING;
   schedule ();
   NOT_REACHED ();
@@ -449,38 +931,51 @@ void thread_yield(void)
 {
 	enum intr_level old_level;
 	struct thread *current;
-	bool aux;
   
 	ASSERT(!intr_context());
 
 	current = thread_current();
 	old_level = intr_disable ();
-	if (current != idle_thread) {
-		/* Insert to ready_list with priority descending. */
-		aux = true;
-		list_insert_ordered(&ready_list, &current->elem,
-				    thread_cmp_priority, &aux);
-	}
+	/* Append to the run queue of its priority. */
+	if (current != idle_thread)
+		ready_queue_push(current);
 	current->status = THREAD_READY;
 	schedule();
 	intr_set_level(old_level);
 }
 
+/**
+ * thread_cond_yield - preemption point for long kernel loops
+ *
+ * Yield the CPU if a more prioritized thread was made ready since the
+ * current thread was scheduled.  Kernel code is preempted by the
+ * timer interrupt only once its time slice runs out, so a loop that
+ * runs for many ticks calls this between iterations to let such a
+ * thread run sooner.  Does nothing with interrupts off, as while a
+ * spinlock is held, or in an RCU read-side section.
+*/
+void thread_cond_yield(void)
+{
+	ASSERT(!intr_context());
+
+	if (need_resched && intr_get_level() == INTR_ON && !rcu_read_active())
+		thread_yield();
+}
+
 /* Invoke function 'func' on all threads, passing along 'aux'.
-   This function must be called with interrupts off. */
+   The walk is an RCU read-side section, which leaves interrupts
+   on, so 'func' must not sleep.  Threads created meanwhile may be
+   missed, and threads that exit meanwhile may still be seen. */
 void
 thread_foreach (thread_action_func *func, void *aux)
 {
   struct list_elem *e;
 
-  ASSERT (intr_get_level () == INTR_OFF);
-
+  rcu_read_lock ();
   for (e = list_begin (&all_list); e != list_end (&all_list);
        e = list_next (e))
-    {
-      struct thread *t = list_entry (e, struct thread, allelem);
-      func (t, aux);
-    }
+    func (list_entry (e, struct thread, allelem), aux);
+  rcu_read_unlock ();
 }
 
 /**
@@ -521,7 +1016,7 @@ void thread_set_priority (int new_priority)
 	current->base_priority = new_priority;
 	/* Update priority of the thread if the new one is higher */
 	/* or holding no locks thus no donation to account. */
-	if (list_empty(&current->locks) || new_priority > current->priority) {
+	if (waitq_empty(&current->locks) || new_priority > current->priority) {
 		current->priority = new_priority;
 		/* Yield for more prioritized threads if any. */
 		thread_yield();
@@ -548,53 +1043,52 @@ void thread_update_priority(struct thread *t)
 {
 	enum intr_level old_level;
 	int lock_priority;
-	bool aux;
 
 	old_level = intr_disable();
 
 	/* Fallback to base_priority as default. */
 	t->priority = t->base_priority;
 	/* Check if its locks has higher priority. */
-	if (!list_empty(&t->locks)) {
-		/* Sort the list in case priorities of locks are updated. */
-		aux = true;
-		list_sort(&t->locks, lock_cmp_priority, &aux);
-		/* Get the max priority of its locks. */
-		lock_priority = list_entry(list_front(&t->locks), struct lock,
-					   elem)->priority;
+	if (!waitq_empty(&t->locks)) {
+		/* The front of the queue is the max priority of its locks. */
+		lock_priority = waitq_front(&t->locks)->priority;
 		/* Update if the lock has higher priority. */
 		if (lock_priority > t->priority)
 			t->priority = lock_priority;
 	}
+	/* Keep its place among the waiters it is queued with. */
+	synch_priority_changed(t);
 
 	intr_set_level(old_level);
 }
 
 /**
- * thread_donate_priority - let the current thread donate priority
+ * thread_donate_priority - donate priority through a held lock
  *
- * @t: pointer to the thread
+ * @lock: pointer to the lock held by another thread
+ * @priority: the priority to donate, higher than the lock's
  *
- * Let the current thread donate its priority to the given thread.
+ * Raise the priority of the given lock, and of its holder if lower.
+ * Donation only ever raises priorities, so the holder does not have
+ * to rescan its locks.
 */
-void thread_donate_priority(struct thread *t)
+void thread_donate_priority(struct lock *lock, int priority)
 {
 	enum intr_level old_level;
-	int old_priority;
-	bool aux;
+	struct thread *t;
+
+	ASSERT(lock->holder != NULL);
+	ASSERT(priority > lock->priority);
 
 	old_level = intr_disable();
 
-	/* Update priority of the thread. */
-	old_priority = t->priority;
-	thread_update_priority(t);
-	/* Re-insert to ready_list if priority changed. */
-	if (t->status == THREAD_READY && t->priority != old_priority) {
-		list_remove(&t->elem);
-		aux = true;
-		list_insert_ordered(&ready_list, &t->elem, thread_cmp_priority,
-				    &aux);
-	}
+	/* Update priority of the lock within its holder's locks. */
+	t = lock->holder;
+	lock->priority = priority;
+	waitq_update(&t->locks, &lock->elem, priority);
+	/* Update priority of the holder if lower. */
+	if (priority > t->priority)
+		thread_change_priority(t, priority);
 
 	intr_set_level(old_level);
 }
@@ -610,15 +1104,12 @@ void thread_hold_lock(struct lock *lock)
 {
 	enum intr_level old_level;
 	struct thread *current;
-	bool aux;
 
 	old_level = intr_disable();
 
 	current = thread_current();
-	/* Insert to locks list with priority descending. */
-	aux = true;
-	list_insert_ordered(&current->locks, &lock->elem,
-			    lock_cmp_priority, &aux);
+	/* Queue into its locks by priority. */
+	waitq_push(&current->locks, &lock->elem, lock->priority);
 	/* Get the donated priority for the current thread. */
 	if (lock->priority > current->priority) {
 		current->priority = lock->priority;
@@ -640,8 +1131,8 @@ void thread_release_lock(struct lock *lock)
 	enum intr_level old_level;
 
 	old_level = intr_disable();
-	/* Remove from locks list. */
-	list_remove(&lock->elem);
+	/* Remove from its locks. */
+	waitq_remove(&thread_current()->locks, &lock->elem);
 	/* Update priority of the current thread in case of donation. */
 	thread_update_priority(thread_current());
 	intr_set_level(old_level);
@@ -685,7 +1176,7 @@ int thread_get_nice(void)
 */
 int thread_get_load_avg(void)
 {
-	return FP_RND(FP_MULI(load_avg, 100));
+	return FP_WRND(FP_WMULI(load_avg, 100));
 }
 
 /**
@@ -695,7 +1186,7 @@ int thread_get_load_avg(void)
 */
 int thread_get_recent_cpu(void)
 {
-	return FP_RND(FP_MULI(thread_current()->recent_cpu, 100));
+	return FP_WRND(FP_WMULI(thread_current()->recent_cpu, 100));
 }
 
 /**
@@ -707,15 +1198,23 @@ int thread_get_recent_cpu(void)
 */
 void thread_mlfqs_update_priority(struct thread *t)
 {
+	enum intr_level old_level;
+	int priority;
+
 	ASSERT(thread_mlfqs);
 	ASSERT(t != idle_thread);
 
 	/* priority = PRI_MAX - (recent_cpu / 4) - (nice * 2). */
-	t->priority = FP_INT(FP_SUBI(FP_ISUB(PRI_MAX,
-					     FP_DIVI(t->recent_cpu, 4)),
-					     2 * t->nice));
+	priority = FP_INT(FP_SUBI(FP_ISUB(PRI_MAX, FP_DIVI(t->recent_cpu, 4)),
+				  2 * t->nice));
 	/* Boundary check. */
-	t->priority = MIN(MAX(t->priority, FP_FIX(PRI_MIN)), FP_FIX(PRI_MAX));
+	priority = MIN(MAX(priority, PRI_MIN), PRI_MAX);
+	if (priority == t->priority)
+		return;
+
+	old_level = intr_disable();
+	thread_change_priority(t, priority);
+	intr_set_level(old_level);
 }
 
 /**
@@ -747,47 +1246,168 @@ void thread_mlfqs_update_load_avg(void)
 	size_t ready_threads;
 
 	ASSERT(thread_mlfqs);
-	ASSERT(intr_context());
+	ASSERT(intr_get_level() == INTR_OFF);
 
 	/* Number of threads in running or ready state. */
-	ready_threads = list_size(&ready_list)
-		    + (thread_current() != idle_thread);
+	/* The idle thread may be switching out, so no thread_current(). */
+	ready_threads = ready_threads_cnt() +
+			(running_thread() != idle_thread);
 	/* load_avg = (59/60)*load_avg + (1/60)*ready_threads. */
-	load_avg = FP_ADD(FP_DIVI(FP_MULI(load_avg, 59), 60),
+	load_avg = FP_ADD(FP_DIVI(FP_WMULI(load_avg, 59), 60),
 			  FP_IDIVI(ready_threads, 60));
 }
 
+/* Returns the recent_cpu decay coefficient for LOAD, a load_avg:
+   (2*load)/(2*load + 1). */
+static fixed_t mlfqs_coefficient(fixed_t load)
+{
+	return FP_DIV(FP_MULI(load, 2), FP_ADDI(FP_MULI(load, 2), 1));
+}
+
+/**
+ * thread_mlfqs_skip_idle - apply idle seconds to MLFQS at once
+ *
+ * @seconds: number of whole seconds
+ *
+ * Bring load_avg and the decay epochs forward by the given number of
+ * seconds the CPU spent idle, with no thread ready.  load_avg then
+ * decays by 59/60 each second, so it takes a lookup in mlfqs_decay
+ * rather than a step per second.  Only the coefficients kept in the
+ * history are recorded.
+*/
+static void thread_mlfqs_skip_idle(int64_t seconds)
+{
+	int64_t i;
+
+	ASSERT(intr_get_level() == INTR_OFF);
+
+	i = seconds > MLFQS_HISTORY ? seconds - MLFQS_HISTORY + 1 : 1;
+	for (; i <= seconds; i++)
+		mlfqs_coef[(mlfqs_epoch + i) % MLFQS_HISTORY] =
+			mlfqs_coefficient(i < MLFQS_DECAY_CNT
+					  ? FP_MUL(load_avg, mlfqs_decay[i])
+					  : 0);
+	load_avg = seconds < MLFQS_DECAY_CNT
+		   ? FP_MUL(load_avg, mlfqs_decay[seconds]) : 0;
+	mlfqs_epoch += seconds;
+}
+
 /**
  * thread_mlfqs_update_recent_cpu - update recent_cpu
  *
- * Update recent_cpu of every non-idle thread for MLFQS.
+ * Update load_avg and start a new decay epoch, then bring recent_cpu
+ * and priority of the running and ready threads up to date for MLFQS.
+ * Blocked threads catch up lazily once unblocked, so the cost scales
+ * with the number of ready threads rather than all threads.  The ready
+ * threads are left to deferred work, which runs before the scheduler
+ * next picks a thread at the end of the timer interrupt.
 */
 void thread_mlfqs_update_recent_cpu(void)
 {
-	struct list_elem *e;
 	struct thread *t;
 
 	ASSERT(thread_mlfqs);
-	ASSERT(intr_context());
+	ASSERT(intr_get_level() == INTR_OFF);
 
 	/* Update load_avg. */
 	thread_mlfqs_update_load_avg();
 
-	/* Update recent_cpu time and priority for every non-idle thread.*/
-	/* recent_cpu = (2*load_avg)/(2*load_avg + 1) * recent_cpu + nice. */
-	for (e = list_begin(&all_list); e != list_end(&all_list);
-	     e = list_next(e)) {
-		t = list_entry(e, struct thread, allelem);
-		if (t != idle_thread) {
-			t->recent_cpu = FP_ADDI(FP_MUL(FP_DIV(
-						FP_MULI(load_avg, 2),
-						FP_ADDI(FP_MULI(load_avg, 2),
-						1)), t->recent_cpu), t->nice);
-			thread_mlfqs_update_priority(t);
+	/* Start a new epoch with coefficient (2*load_avg)/(2*load_avg + 1). */
+	mlfqs_epoch++;
+	mlfqs_coef[mlfqs_epoch % MLFQS_HISTORY] = mlfqs_coefficient(load_avg);
+
+	/* The running thread. */
+	t = running_thread();
+	if (t != idle_thread && t->status == THREAD_RUNNING) {
+		thread_mlfqs_sync(t);
+		thread_mlfqs_update_priority(t);
+	}
+	intr_defer(&mlfqs_work);
+}
+
+/**
+ * thread_mlfqs_update_ready - bring ready threads up to date for MLFQS
+ *
+ * @aux: unused
+ *
+ * Deferred second half of thread_mlfqs_update_recent_cpu().  Sync
+ * recent_cpu and priority of every ready thread, turning interrupts
+ * off for one run queue at a time rather than for the whole pass.
+*/
+static void thread_mlfqs_update_ready(void *aux UNUSED)
+{
+	enum intr_level old_level;
+	struct list_elem *e;
+	struct list_elem *e_next;
+	struct thread *t;
+	struct cpu *c;
+	int i;
+
+	/* Every ready thread, which may move to another run queue. */
+	/* The epoch check skips those moved to a queue not yet visited. */
+	for (c = cpus; c < cpus + CPU_CNT; c++) {
+		for (i = PRI_CNT - 1; i >= 0; i--) {
+			old_level = intr_disable();
+			for (e = list_begin(&c->ready_queues[i]);
+			     e != list_end(&c->ready_queues[i]); e = e_next) {
+				e_next = list_next(e);
+				t = list_entry(e, struct thread, elem);
+				if (t->recent_cpu_epoch == mlfqs_epoch)
+					continue;
+				thread_mlfqs_sync(t);
+				thread_mlfqs_update_priority(t);
+			}
+			intr_set_level(old_level);
 		}
 	}
 }
-
+
+/**
+ * thread_mlfqs_sync - apply missed recent_cpu decays to a thread
+ *
+ * @t: the thread
+ *
+ * Replay recent_cpu = coef * recent_cpu + nice for every epoch since
+ * the given thread was last brought up to date.  Epochs older than the
+ * coefficient history are approximated by the oldest coefficient kept,
+ * c, applied m times in closed form: c^m * recent_cpu plus nice times
+ * the geometric sum (1 - c^m) / (1 - c).
+ * Must be called with interrupts turned off.
+*/
+static void thread_mlfqs_sync(struct thread *t)
+{
+	int64_t epoch;
+	int64_t oldest;
+
+	ASSERT(intr_get_level() == INTR_OFF);
+
+	epoch = t->recent_cpu_epoch;
+	if (epoch == mlfqs_epoch)
+		return;
+
+	/* Too old for the history, approximate. */
+	oldest = mlfqs_epoch - MLFQS_HISTORY + 1;
+	if (epoch + 1 < oldest) {
+		fixed_t c = mlfqs_coef[oldest % MLFQS_HISTORY];
+		int64_t m = oldest - epoch - 1;
+		fixed_t cm = fp_pow(c, m > UINT32_MAX ? UINT32_MAX : m);
+		fixed_t sum = c < FP_FIX(1) ? FP_DIV(FP_ISUB(1, cm),
+						     FP_ISUB(1, c))
+					    : FP_FIX(MIN(m, MLFQS_HISTORY));
+
+		t->recent_cpu = FP_ADD(FP_MUL(cm, t->recent_cpu),
+				       FP_MULI(sum, t->nice));
+		epoch = oldest - 1;
+	}
+	/* Exact replay of the history. */
+	for (epoch++; epoch <= mlfqs_epoch; epoch++)
+		t->recent_cpu = FP_ADDI(FP_MUL(mlfqs_coef[epoch
+						% MLFQS_HISTORY],
+					       t->recent_cpu), t->nice);
+	t->recent_cpu_epoch = mlfqs_epoch;
+	t->io_class = BLOCK_CLASS_INHERIT;
+}
+
 /* Idle thread.  Executes when no other thread is ready to run.
 
    The idle thread is initially put on the ready list by
@@ -810,6 +1430,16 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+      /* Zero free pages for PAL_ZERO requests meanwhile.  With
+         interrupts on, a thread woken by one preempts the work,
+         and it resumes once nothing else is ready. */
+      intr_enable ();
+      while (palloc_zero_idle ())
+        continue;
+      intr_disable ();
+      if (ready_threads_cnt () > 0)
+        continue;
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -821,7 +1451,11 @@ idle (void *idle_started_ UNUSED)
          time.
 
          See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
-         7.11.1 "HLT Instruction". */
+         7.11.1 "HLT Instruction".
+
+         In dynamic-tick mode, first let the timer skip the ticks
+         until the next sleep deadline. */
+      timer_idle_enter ();
       asm volatile ("sti; hlt" : : : "memory");
     }
 }
@@ -871,7 +1505,6 @@ is_thread (struct thread *t)
 static void init_thread(struct thread *t, const char *name, int priority)
 {
 	enum intr_level old_level;
-	bool aux;
 
 	ASSERT(t != NULL);
 	ASSERT(PRI_MIN <= priority && priority <= PRI_MAX);
@@ -883,16 +1516,30 @@ static void init_thread(struct thread *t, const char *name, int priority)
 	t->stack = (uint8_t *)t + PGSIZE;
 	/* Initialize priority. */
 	t->priority = t->base_priority = priority;
-	/* Initialize locks list. */
-	list_init(&t->locks);
-
-	t->magic = THREAD_MAGIC;
-
+	/* Initialize locks queue. */
+	waitq_init(&t->locks);
+	/* Nothing to decay yet. */
+	t->recent_cpu_epoch = mlfqs_epoch;
+	/* Start level with the threads ready now. */
 	old_level = intr_disable();
-	/* Insert to all_list. */
-	aux = true;
-	list_insert_ordered(&all_list, &t->allelem, thread_cmp_priority, &aux);
+	t->vruntime = this_cpu()->min_vruntime;
 	intr_set_level(old_level);
+#ifdef USERPROG
+	/* No children yet. */
+	t->proc = t;
+	list_init(&t->children);
+	list_init(&t->exited_children);
+	sema_init(&t->child_exited, 0);
+	lock_init(&t->fds_lock);
+#endif
+#ifdef VM
+	t->swap_next = SWAP_NONE;
+	lock_init(&t->spt_lock);
+	list_init(&t->threads);
+	sema_init(&t->threads_exited, 0);
+#endif
+
+	t->magic = THREAD_MAGIC;
 }
 
 /* Allocates a SIZE-byte frame at the top of thread T's stack and
@@ -908,63 +1555,832 @@ alloc_frame (struct thread *t, size_t size)
   return t->stack;
 }
 
-/* Chooses and returns the next thread to be scheduled.  Should
-   return a thread from the run queue, unless the run queue is
-   empty.  (If the running thread can continue running, then it
-   will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
-static struct thread *
-next_thread_to_run (void) 
+/**
+ * next_thread_to_run - choose the next thread to be scheduled
+ *
+ * Return a thread from the run queues of this CPU if they are not
+ * empty, preferring a ready thread of the deadline class.  (If the
+ * running thread can continue running, then it is in the run
+ * queues.)  Otherwise steal the most prioritized ready thread of the
+ * busiest other CPU, or return idle_thread if there is none.
+*/
+static struct thread *next_thread_to_run(void)
 {
-  if (list_empty (&ready_list))
-    return idle_thread;
-  else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+	struct cpu *local;
+	struct cpu *victim;
+	struct cpu *c;
+
+	local = this_cpu();
+	if (local->ready_cnt > 0)
+		return ready_queue_pop(local);
+
+	/* Work stealing. */
+	victim = NULL;
+	for (c = cpus; c < cpus + CPU_CNT; c++)
+		if (c != local && c->ready_cnt > 0 &&
+		    (victim == NULL || c->ready_cnt > victim->ready_cnt))
+			victim = c;
+	if (victim == NULL)
+		return idle_thread;
+	return ready_queue_pop(victim);
 }
 
-/* Completes a thread switch by activating the new thread's page
-   tables, and, if the previous thread is dying, destroying it.
+/**
+ * thread_page_alloc - allocate a page for a new thread
+ *
+ * Reuse the page of a dead thread if any, or get a new one.  Only
+ * the struct thread at its bottom needs to be zeroed, which
+ * init_thread() does, so the page is not zeroed here.
+ * Return NULL if out of pages.
+*/
+static struct thread *thread_page_alloc(void)
+{
+	enum intr_level old_level;
+	struct thread *t;
 
-   At this function's invocation, we just switched from thread
-   PREV, the new thread is already running, and interrupts are
-   still disabled.  This function is normally invoked by
-   thread_schedule() as its final action before returning, but
-   the first time a thread is scheduled it is called by
-   switch_entry() (see switch.S).
+	old_level = intr_disable();
+	t = thread_cache_cnt > 0 ? thread_cache[--thread_cache_cnt] : NULL;
+	intr_set_level(old_level);
 
-   It's not safe to call printf() until the thread switch is
-   complete.  In practice that means that printf()s should be
-   added at the end of the function.
+	return t != NULL ? t : palloc_get_page(0);
+}
 
-   After this function and its caller returns, the thread switch
-   is complete. */
-void
-thread_schedule_tail (struct thread *prev)
+/**
+ * thread_page_free - free the page of a dead thread
+ *
+ * @t: pointer to the dead thread
+ *
+ * Keep the page of the given thread for reuse if the cache has room,
+ * freeing it otherwise.
+ * Must be called with interrupts turned off.
+*/
+static void thread_page_free(struct thread *t)
+{
+	ASSERT(intr_get_level() == INTR_OFF);
+
+	if (thread_cache_cnt < THREAD_CACHE_MAX)
+		thread_cache[thread_cache_cnt++] = t;
+	else
+		palloc_free_page(t);
+}
+
+/**
+ * thread_page_free_rcu - free the page of a dead thread after a grace period
+ *
+ * @head: pointer to the rcu member of the dead thread
+ *
+ * Callback for rcu_call(), run with interrupts turned off.
+*/
+static void thread_page_free_rcu(struct rcu_head *head)
+{
+	thread_page_free(rcu_entry(head, struct thread, rcu));
+}
+
+/* Returns the scheduler state of the running CPU. */
+static struct cpu *
+this_cpu (void)
+{
+  return &cpus[cpu_id ()];
+}
+
+/* Returns the number of ready threads on all CPUs. */
+static size_t
+ready_threads_cnt (void)
+{
+  struct cpu *c;
+  size_t cnt = 0;
+
+  for (c = cpus; c < cpus + CPU_CNT; c++)
+    cnt += c->ready_cnt;
+  return cnt;
+}
+
+/**
+ * ready_queue_push - make a thread ready on this CPU
+ *
+ * @t: pointer to the thread
+ *
+ * Hand the given thread to its scheduling class to queue on this CPU.
+ * Must be called with interrupts turned off.
+*/
+static void ready_queue_push(struct thread *t)
+{
+	struct cpu *c;
+
+	ASSERT(intr_get_level() == INTR_OFF);
+	ASSERT(PRI_MIN <= t->priority && t->priority <= PRI_MAX);
+
+	c = this_cpu();
+	spinlock_acquire(&c->lock);
+	class_of(t)->enqueue(c, t);
+	c->ready_cnt++;
+	t->cpu = c;
+	spinlock_release(&c->lock);
+}
+
+/**
+ * ready_queue_pop - pop the ready thread a CPU should run next
+ *
+ * @c: pointer to the CPU
+ *
+ * Pop the thread the deadline class picks from the given CPU, if it has
+ * any ready, or else the one the scheduling class in use picks.
+ * Must be called with interrupts turned off and some thread ready.
+*/
+static struct thread *ready_queue_pop(struct cpu *c)
+{
+	struct thread *t;
+
+	ASSERT(intr_get_level() == INTR_OFF);
+
+	spinlock_acquire(&c->lock);
+	ASSERT(c->ready_cnt > 0);
+	if (!rb_empty(&c->dl_tree))
+		t = deadline_class.pick_next(c);
+	else
+		t = sched_class->pick_next(c);
+	c->ready_cnt--;
+	spinlock_release(&c->lock);
+	return t;
+}
+
+/**
+ * thread_change_priority - set the effective priority of a thread
+ *
+ * @t: pointer to the thread
+ * @priority: the new priority
+ *
+ * Set the priority of the given thread, and keep its place in the
+ * run queues if ready, or among the waiters it is queued with.
+ * Must be called with interrupts turned off.
+*/
+static void thread_change_priority(struct thread *t, int priority)
+{
+	const struct sched_class *class;
+	struct cpu *c;
+	int old_priority;
+
+	ASSERT(intr_get_level() == INTR_OFF);
+	ASSERT(PRI_MIN <= priority && priority <= PRI_MAX);
+
+	if (t->status != THREAD_READY) {
+		t->priority = priority;
+		synch_priority_changed(t);
+		return;
+	}
+
+	c = t->cpu;
+	spinlock_acquire(&c->lock);
+	old_priority = t->priority;
+	class = class_of(t);
+	if (class->priority_changed != NULL) {
+		t->priority = priority;
+		class->priority_changed(c, t, old_priority);
+	} else {
+		class->dequeue(c, t);
+		t->priority = priority;
+		class->enqueue(c, t);
+	}
+	spinlock_release(&c->lock);
+}
+
+/* Priority class: appends T to the tail of the run queue of its
+   priority on C, keeping threads of equal priority in FIFO
+   order. */
+static void
+prio_enqueue (struct cpu *c, struct thread *t)
+{
+  list_push_back (&c->ready_queues[t->priority - PRI_MIN], &t->elem);
+  c->ready_bitmap |= (uint64_t) 1 << (t->priority - PRI_MIN);
+}
+
+/* Priority class: removes T from the run queue of its priority
+   on C. */
+static void
+prio_dequeue (struct cpu *c, struct thread *t)
+{
+  int i = t->priority - PRI_MIN;
+
+  list_remove (&t->elem);
+  if (list_empty (&c->ready_queues[i]))
+    c->ready_bitmap &= ~((uint64_t) 1 << i);
+}
+
+/**
+ * prio_pick_next - pop the most prioritized ready thread of a CPU
+ *
+ * @c: pointer to the CPU
+ *
+ * Pop the front of the highest non-empty run queue of the given CPU,
+ * found via the most significant set bit of its ready_bitmap.  The
+ * bitmap is split in halves since only 32-bit bit scans are inlined
+ * without libgcc.
+*/
+static struct thread *prio_pick_next(struct cpu *c)
+{
+	struct list_elem *e;
+	uint32_t high;
+	int i;
+
+	ASSERT(c->ready_bitmap != 0);
+	high = c->ready_bitmap >> 32;
+	if (high)
+		i = 63 - __builtin_clz(high);
+	else
+		i = 31 - __builtin_clz((uint32_t)c->ready_bitmap);
+	e = list_pop_front(&c->ready_queues[i]);
+	if (list_empty(&c->ready_queues[i]))
+		c->ready_bitmap &= ~((uint64_t)1 << i);
+	return list_entry(e, struct thread, elem);
+}
+
+/* Priority class: preempts CUR once its time slice is used up. */
+static bool
+prio_tick (struct cpu *c UNUSED, struct thread *cur UNUSED)
+{
+  return thread_ticks >= time_slice;
+}
+
+/**
+ * mlfqs_tick - account a timer tick for MLFQS
+ *
+ * @c: pointer to the CPU
+ * @cur: pointer to the running thread
+ *
+ * Update recent_cpu, load_avg and priorities as they fall due, then
+ * preempt by time slice as the priority class does.
+*/
+static bool mlfqs_tick(struct cpu *c, struct thread *cur)
+{
+	/* recent_cpu is incremented each tick. */
+	if (cur != idle_thread)
+		thread_mlfqs_increment_recent_cpu();
+	/* load_avg and recent_cpu is updated each second. */
+	if (ticks % TIMER_FREQ == 0)
+		thread_mlfqs_update_recent_cpu();
+	/* Priority is updated every 4th tick. */
+	else if (ticks % 4 == 0 && cur != idle_thread)
+		thread_mlfqs_update_priority(cur);
+	return prio_tick(c, cur);
+}
+
+/* Fair class: orders threads by vruntime. */
+static bool
+fair_less (const struct rb_node *a, const struct rb_node *b,
+           void *aux UNUSED)
+{
+  return (rb_entry (a, struct thread, runnode)->vruntime
+          < rb_entry (b, struct thread, runnode)->vruntime);
+}
+
+/* Fair class: raises the vruntime floor of C to VRUNTIME, if
+   higher.  The floor never goes back, so that threads waking up
+   are not placed behind time already handed out. */
+static void
+fair_update_min (struct cpu *c, uint64_t vruntime)
+{
+  if (vruntime > c->min_vruntime)
+    c->min_vruntime = vruntime;
+}
+
+/**
+ * fair_enqueue - insert a thread into the fair run queue of a CPU
+ *
+ * @c: pointer to the CPU
+ * @t: pointer to the thread
+ *
+ * Insert the given thread by vruntime in O(log n), after those of
+ * equal vruntime.  A thread that fell more than FAIR_SLEEPER_CREDIT
+ * behind the floor while blocked is moved up to it first.
+*/
+static void fair_enqueue(struct cpu *c, struct thread *t)
+{
+	if (t->vruntime + FAIR_SLEEPER_CREDIT < c->min_vruntime)
+		t->vruntime = c->min_vruntime - FAIR_SLEEPER_CREDIT;
+	rb_insert(&c->fair_tree, &t->runnode);
+}
+
+/* Fair class: removes T from the run queue of C. */
+static void
+fair_dequeue (struct cpu *c, struct thread *t)
+{
+  rb_remove (&c->fair_tree, &t->runnode);
+}
+
+/**
+ * fair_pick_next - pop the ready thread with the least vruntime
+ *
+ * @c: pointer to the CPU
+ *
+ * Pop the leftmost thread of the fair run queue of the given CPU,
+ * which the tree keeps at hand, in O(log n) for the removal.
+*/
+static struct thread *fair_pick_next(struct cpu *c)
+{
+	struct thread *t;
+
+	ASSERT(!rb_empty(&c->fair_tree));
+	t = rb_entry(rb_first(&c->fair_tree), struct thread, runnode);
+	rb_remove(&c->fair_tree, &t->runnode);
+	fair_update_min(c, t->vruntime);
+	return t;
+}
+
+/**
+ * fair_tick - account a timer tick for the fair class
+ *
+ * @c: pointer to the CPU
+ * @cur: pointer to the running thread
+ *
+ * Advance vruntime of the running thread by a tick scaled by the
+ * inverse of its weight, which follows its priority.  Preempt it
+ * once it is FAIR_GRANULARITY ahead of the least vruntime ready.
+*/
+static bool fair_tick(struct cpu *c, struct thread *cur)
+{
+	struct rb_node *first;
+	uint64_t vruntime;
+	bool preempt = false;
+	int nice;
+
+	if (cur == idle_thread)
+		return false;
+
+	/* Priorities above PRI_DEFAULT act like negative nice values. */
+	nice = MIN(MAX(PRI_DEFAULT - cur->priority, -20), 19);
+	cur->vruntime += FAIR_TICK * FAIR_WEIGHT_0 / fair_weights[nice + 20];
+
+	spinlock_acquire(&c->lock);
+	vruntime = cur->vruntime;
+	first = rb_first(&c->fair_tree);
+	if (first != NULL) {
+		struct thread *t = rb_entry(first, struct thread, runnode);
+
+		preempt = cur->vruntime > t->vruntime + FAIR_GRANULARITY;
+		vruntime = MIN(vruntime, t->vruntime);
+	}
+	fair_update_min(c, vruntime);
+	spinlock_release(&c->lock);
+	return preempt;
+}
+
+/* Fair class: nothing to do when the priority of ready thread T
+   changes, since the tree is ordered by vruntime and the weight
+   is looked up from the priority each tick. */
+static void
+fair_priority_changed (struct cpu *c UNUSED, struct thread *t UNUSED,
+                       int old_priority UNUSED)
+{
+}
+
+/* Returns the scheduling class that queues thread T when ready:
+   the deadline class if T has a reservation with budget left,
+   otherwise the class in use. */
+static const struct sched_class *
+class_of (const struct thread *t)
+{
+  return (t->dl_runtime != 0 && !t->dl_throttled
+          ? &deadline_class : sched_class);
+}
+
+/* Returns true if ready thread A should run before thread B, which
+   is running: by deadline within the deadline class, ahead of any
+   other thread, and by priority outside it. */
+static bool
+runs_before (const struct thread *a, const struct thread *b)
+{
+  if (class_of (a) == &deadline_class)
+    return (class_of (b) != &deadline_class
+            || a->dl_deadline < b->dl_deadline);
+  return class_of (b) != &deadline_class && a->priority > b->priority;
+}
+
+/* Deadline class: orders threads by absolute deadline. */
+static bool
+dl_less (const struct rb_node *a, const struct rb_node *b,
+         void *aux UNUSED)
+{
+  return (rb_entry (a, struct thread, runnode)->dl_deadline
+          < rb_entry (b, struct thread, runnode)->dl_deadline);
+}
+
+/* Deadline class: returns the fixed-point density of a
+   reservation of RUNTIME ticks within DEADLINE, rounded up. */
+static uint32_t
+dl_density (int64_t runtime, int64_t deadline)
+{
+  return DIV_ROUND_UP ((uint64_t) runtime << DL_BW_SHIFT, deadline);
+}
+
+/* Deadline class: returns the tick at which throttled thread T
+   gets its budget back, the start of its next period. */
+static int64_t
+dl_next_period (const struct thread *t)
+{
+  return t->dl_deadline - t->dl_rel_deadline + t->dl_period;
+}
+
+/* Deadline class: gives T a new budget and deadline for the
+   period starting at or, if T is late, before NOW. */
+static void
+dl_replenish (struct thread *t, int64_t now)
+{
+  t->dl_throttled = false;
+  t->dl_budget = t->dl_runtime;
+  t->dl_deadline += t->dl_period;
+  if (t->dl_deadline <= now)
+    t->dl_deadline = now + t->dl_rel_deadline;
+}
+
+/**
+ * dl_set - set the reservation of a thread
+ *
+ * @t: pointer to the thread, running or blocked
+ * @runtime: ticks per period, or 0 for none
+ * @period: ticks in a period
+ * @deadline: relative deadline in ticks
+ *
+ * Do the work of thread_set_deadline(), which checks the parameters,
+ * under admission control.  Must be called with interrupts turned off.
+*/
+static bool dl_set(struct thread *t, int64_t runtime, int64_t period,
+		   int64_t deadline)
+{
+	uint32_t old_bw = 0;
+	uint32_t bw = 0;
+	bool success = false;
+
+	ASSERT(intr_get_level() == INTR_OFF);
+	ASSERT(t->status != THREAD_READY);
+
+	if (runtime == 0 && t->dl_runtime == 0)
+		return true;
+	if (runtime != 0)
+		bw = dl_density(runtime, deadline);
+
+	spinlock_acquire(&dl_lock);
+	if (t->dl_runtime != 0)
+		old_bw = dl_density(t->dl_runtime, t->dl_rel_deadline);
+	if (dl_bandwidth - old_bw + bw <= (uint32_t)DL_BW_MAX * CPU_CNT) {
+		dl_bandwidth = dl_bandwidth - old_bw + bw;
+		if (t->dl_runtime == 0)
+			list_push_back(&dl_list, &t->dlelem);
+		else if (runtime == 0)
+			list_remove(&t->dlelem);
+		t->dl_runtime = runtime;
+		t->dl_period = period;
+		t->dl_rel_deadline = deadline;
+		t->dl_throttled = false;
+		t->dl_budget = runtime;
+		t->dl_deadline = timer_ticks() + deadline;
+		success = true;
+	}
+	spinlock_release(&dl_lock);
+	return success;
+}
+
+/**
+ * dl_wakeup - apply the wake-up rule of the constant bandwidth server
+ *
+ * @t: pointer to the thread, blocked
+ *
+ * Give the given thread a new period if its budget is due back, or if
+ * it could not use what is left of it by its deadline without running
+ * faster than its reservation allows, that is, if budget / (deadline -
+ * now) exceeds runtime / relative deadline.  Otherwise it goes on with
+ * its budget and deadline, which the time it spent blocked cannot have
+ * made too generous.  Must be called with interrupts turned off.
+*/
+static void dl_wakeup(struct thread *t)
+{
+	int64_t now = timer_ticks();
+
+	spinlock_acquire(&dl_lock);
+	if (t->dl_throttled) {
+		if (dl_next_period(t) <= now)
+			dl_replenish(t, now);
+	} else if (t->dl_deadline <= now ||
+		   t->dl_budget * t->dl_rel_deadline >
+		   (t->dl_deadline - now) * t->dl_runtime) {
+		t->dl_budget = t->dl_runtime;
+		t->dl_deadline = now + t->dl_rel_deadline;
+	}
+	spinlock_release(&dl_lock);
+}
+
+/**
+ * dl_replenish_due - give throttled threads their budget back
+ *
+ * @now: current timer ticks
+ *
+ * Replenish every throttled thread whose next period has started, and
+ * move each that is ready from the queues of the class in use to those
+ * of the deadline class.  Must be called with interrupts turned off.
+*/
+static void dl_replenish_due(int64_t now)
+{
+	struct list_elem *e;
+	int64_t next = INT64_MAX;
+
+	spinlock_acquire(&dl_lock);
+	for (e = list_begin(&dl_list); e != list_end(&dl_list);
+	     e = list_next(e)) {
+		struct thread *t = list_entry(e, struct thread, dlelem);
+		struct cpu *c = t->cpu;
+
+		if (!t->dl_throttled)
+			continue;
+		if (dl_next_period(t) > now) {
+			next = MIN(next, dl_next_period(t));
+			continue;
+		}
+		if (t->status != THREAD_READY) {
+			dl_replenish(t, now);
+			continue;
+		}
+		spinlock_acquire(&c->lock);
+		sched_class->dequeue(c, t);
+		dl_replenish(t, now);
+		deadline_class.enqueue(c, t);
+		spinlock_release(&c->lock);
+	}
+	dl_next_replenish = next;
+	spinlock_release(&dl_lock);
+}
+
+/* Deadline class: inserts T into the run queue of C by deadline,
+   after those of equal deadline, in O(log n). */
+static void
+dl_enqueue (struct cpu *c, struct thread *t)
+{
+  rb_insert (&c->dl_tree, &t->runnode);
+}
+
+/* Deadline class: removes T from the run queue of C. */
+static void
+dl_dequeue (struct cpu *c, struct thread *t)
+{
+  rb_remove (&c->dl_tree, &t->runnode);
+}
+
+/* Deadline class: pops the ready thread of C with the earliest
+   deadline. */
+static struct thread *
+dl_pick_next (struct cpu *c)
+{
+  struct thread *t;
+
+  ASSERT (!rb_empty (&c->dl_tree));
+  t = rb_entry (rb_first (&c->dl_tree), struct thread, runnode);
+  rb_remove (&c->dl_tree, &t->runnode);
+  return t;
+}
+
+/**
+ * dl_tick - account a timer tick for the deadline class
+ *
+ * @c: pointer to the CPU
+ * @cur: pointer to the running thread
+ *
+ * Replenish throttled threads that are due, and charge the tick to the
+ * budget of the running thread if it is in the deadline class,
+ * throttling it when the budget runs out.  Preempt it if it was
+ * throttled, or if a thread with an earlier deadline is ready, or any
+ * thread of the class if the running thread is outside it.
+*/
+static bool dl_tick(struct cpu *c, struct thread *cur)
+{
+	int64_t now = timer_ticks();
+	struct rb_node *first;
+	bool preempt;
+
+	if (now >= dl_next_replenish)
+		dl_replenish_due(now);
+
+	if (class_of(cur) == &deadline_class && --cur->dl_budget <= 0) {
+		spinlock_acquire(&dl_lock);
+		cur->dl_throttled = true;
+		dl_next_replenish = MIN(dl_next_replenish,
+					dl_next_period(cur));
+		spinlock_release(&dl_lock);
+		return true;
+	}
+
+	spinlock_acquire(&c->lock);
+	first = rb_first(&c->dl_tree);
+	preempt = first != NULL &&
+		  runs_before(rb_entry(first, struct thread, runnode), cur);
+	spinlock_release(&c->lock);
+	return preempt;
+}
+
+/* Deadline class: nothing to do when the priority of ready thread
+   T changes, since the tree is ordered by deadline. */
+static void
+dl_priority_changed (struct cpu *c UNUSED, struct thread *t UNUSED,
+                     int old_priority UNUSED)
+{
+}
+
+/**
+ * sched_stats_switch - account a context switch
+ *
+ * @cur: pointer to the thread switching out
+ * @next: pointer to the thread switching in, may be the same
+ *
+ * Charge the time since the last switch or unblock to the running
+ * time of the thread switching out, and to the waiting time in the
+ * run queues, and since a sleep deadline if just woken, of the one
+ * switching in.
+ * Must be called with interrupts turned off.
+*/
+static void sched_stats_switch(struct thread *cur, struct thread *next)
+{
+	int64_t now;
+
+	ASSERT(intr_get_level() == INTR_OFF);
+
+	now = timer_ticks();
+	cur->stats.run_ticks += now - cur->stats.stamp;
+	cur->stats.stamp = now;
+	if (cur->status == THREAD_READY)
+		cur->stats.involuntary++;
+	else
+		cur->stats.voluntary++;
+
+	/* The idle thread is never ready, but blocked while not idling. */
+	if (next == idle_thread)
+		return;
+	next->stats.ready_ticks += now - next->stats.stamp;
+	if (next->stats.wake_deadline) {
+		next->stats.wake_ticks += now - next->stats.wake_deadline;
+		next->stats.wake_cnt++;
+		next->stats.wake_deadline = 0;
+	}
+	next->stats.stamp = now;
+}
+
+/* Prints the scheduler statistics of thread T.  AUX is unused. */
+static void
+sched_stats_print (struct thread *t, void *aux UNUSED)
+{
+  const struct sched_stats *s = &t->stats;
+
+  printf ("Thread %s (tid %d): %u voluntary, %u involuntary switches, "
+          "%lld run, %lld ready, %lld lock wait ticks, "
+          "%u wakes, %lld wake latency ticks\n",
+          t->name, t->tid, s->voluntary, s->involuntary,
+          s->run_ticks, s->ready_ticks, s->lock_ticks,
+          s->wake_cnt, s->wake_ticks);
+}
+
+/**
+ * sleep_heap_push - insert a thread to the sleep heap
+ *
+ * @t: pointer to the thread with ticks_sleep set
+ *
+ * Sift the given thread up from the bottom of the sleep heap.
+ * Threads with equal ticks_sleep are not ordered among each other.
+ * Must be called with interrupts turned off.
+*/
+static void sleep_heap_push(struct thread *t)
+{
+	size_t i;
+	size_t parent;
+
+	ASSERT(intr_get_level() == INTR_OFF);
+	ASSERT(sleep_heap != NULL);
+	ASSERT(sleep_cnt < init_ram_pages);
+
+	for (i = sleep_cnt++; i > 0; i = parent) {
+		parent = (i - 1) / 2;
+		if (sleep_heap[parent]->ticks_sleep <= t->ticks_sleep)
+			break;
+		sleep_heap[i] = sleep_heap[parent];
+	}
+	sleep_heap[i] = t;
+}
+
+/**
+ * sleep_heap_pop - pop the thread sleeping the least
+ *
+ * Remove the root of the sleep heap and sift the last thread down
+ * into its place.
+ * Must be called with interrupts turned off and the heap non-empty.
+*/
+static struct thread *sleep_heap_pop(void)
+{
+	struct thread *min;
+	struct thread *last;
+	size_t i;
+	size_t child;
+
+	ASSERT(intr_get_level() == INTR_OFF);
+	ASSERT(sleep_cnt > 0);
+
+	min = sleep_heap[0];
+	last = sleep_heap[--sleep_cnt];
+	for (i = 0; (child = 2 * i + 1) < sleep_cnt; i = child) {
+		/* Pick the smaller child. */
+		if (child + 1 < sleep_cnt && sleep_heap[child + 1]->ticks_sleep
+					     < sleep_heap[child]->ticks_sleep)
+			child++;
+		if (last->ticks_sleep <= sleep_heap[child]->ticks_sleep)
+			break;
+		sleep_heap[i] = sleep_heap[child];
+	}
+	sleep_heap[i] = last;
+	return min;
+}
+
+/**
+ * sleep_heap_remove - remove a thread from the middle of the sleep heap
+ *
+ * @i: index of the thread in the heap
+ *
+ * Put the last thread in place of the removed one and sift it up or
+ * down, whichever restores the heap order.
+ * Must be called with interrupts turned off.
+*/
+static void sleep_heap_remove(size_t i)
+{
+	struct thread *last;
+	size_t parent;
+	size_t child;
+
+	ASSERT(intr_get_level() == INTR_OFF);
+	ASSERT(i < sleep_cnt);
+
+	last = sleep_heap[--sleep_cnt];
+	if (i == sleep_cnt)
+		return;
+	/* Up, if it sleeps less than the new parent. */
+	for (; i > 0; i = parent) {
+		parent = (i - 1) / 2;
+		if (sleep_heap[parent]->ticks_sleep <= last->ticks_sleep)
+			break;
+		sleep_heap[i] = sleep_heap[parent];
+	}
+	/* Otherwise down, if it sleeps more than a child. */
+	for (; (child = 2 * i + 1) < sleep_cnt; i = child) {
+		if (child + 1 < sleep_cnt && sleep_heap[child + 1]->ticks_sleep
+					     < sleep_heap[child]->ticks_sleep)
+			child++;
+		if (last->ticks_sleep <= sleep_heap[child]->ticks_sleep)
+			break;
+		sleep_heap[i] = sleep_heap[child];
+	}
+	sleep_heap[i] = last;
+}
+
+/* Completes a thread switch by activating the new thread's page
+   tables, and, if the previous thread is dying, destroying it.
+
+   At this function's invocation, we just switched from thread
+   PREV, the new thread is already running, and interrupts are
+   still disabled.  This function is normally invoked by
+   thread_schedule() as its final action before returning, but
+   the first time a thread is scheduled it is called by
+   switch_entry() (see switch.S).
+
+   It's not safe to call printf() until the thread switch is
+   complete.  In practice that means that printf()s should be
+   added at the end of the function.
+
+   After this function and its caller returns, the thread switch
+   is complete. */
+void
+thread_schedule_tail (struct thread *prev)
 {
   struct thread *cur = running_thread ();
   
   ASSERT (intr_get_level () == INTR_OFF);
 
-  /* Mark us as running. */
+  /* Mark us as running.  No RCU reader is in progress across a
+     switch, so callbacks queued before it may run. */
   cur->status = THREAD_RUNNING;
+  rcu_quiescent ();
 
   /* Start new time slice. */
   thread_ticks = 0;
+  need_resched = false;
 
 #ifdef USERPROG
   /* Activate the new address space. */
   process_activate ();
+  fpu_switch ();
 #endif
 
   /* If the thread we switched from is dying, destroy its struct
      thread.  This must happen late so that thread_exit() doesn't
-     pull out the rug under itself.  (We don't free
+     pull out the rug under itself, and after a grace period, for
+     readers of all_list that may be on it.  (We don't free
      initial_thread because its memory was not obtained via
      palloc().) */
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) 
     {
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      rcu_call (&prev->rcu, thread_page_free_rcu);
     }
 }
 
@@ -986,11 +2402,39 @@ schedule (void)
   ASSERT (cur->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
 
+  /* Bring back periodic ticks if idling ends. */
+  if (cur == idle_thread && next != idle_thread)
+    timer_idle_exit ();
+
+  if (thread_sched_stats)
+    sched_stats_switch (cur, next);
+
+  TRACE (TRACE_SCHEDULE, next->tid, cur->status, 0);
+#ifdef USERPROG
+  if (cur != next && cur->pagedir != NULL)
+    cur->proc->rusage.switches++;
+#endif
   if (cur != next)
     prev = switch_threads (cur, next);
   thread_schedule_tail (prev);
 }
 
+/* Gives thread T a tid and adds it to all_list and the tid
+   table.  Returns the tid. */
+static tid_t
+register_thread (struct thread *t)
+{
+  t->tid = allocate_tid ();
+  trace_thread (t);
+
+  spinlock_acquire (&all_lock);
+  list_push_back_rcu (&all_list, &t->allelem);
+  list_push_back_rcu (&tid_table[(unsigned) t->tid % TID_BUCKETS],
+                      &t->tidelem);
+  spinlock_release (&all_lock);
+  return t->tid;
+}
+
 /* Returns a tid to use for a new thread. */
 static tid_t
 allocate_tid (void) 
@@ -1008,3 +2452,11 @@ allocate_tid (void)
 /* Offset of `stack' member within `struct thread'.
    Used by switch.S, which can't figure it out on its own. */
 uint32_t thread_stack_ofs = offsetof (struct thread, stack);
+
+/* The layout that struct thread's comment describes. */
+STATIC_ASSERT (offsetof (struct thread, ticks_sleep)
+               + sizeof (int64_t) <= CACHE_LINE_SIZE);
+STATIC_ASSERT (offsetof (struct thread, stack) == CACHE_LINE_SIZE);
+STATIC_ASSERT (offsetof (struct thread, dl_throttled)
+               + sizeof (bool) <= 2 * CACHE_LINE_SIZE);
+STATIC_ASSERT (sizeof (struct thread) <= PGSIZE / 4);
@@ -3,8 +3,28 @@
 
 #include <debug.h>
 #include <fixed_point.h>
+#include <hash.h>
 #include <list.h>
+#include <rbtree.h>
 #include <stdint.h>
+#include "threads/arena.h"
+#include "threads/percpu.h"
+#include "threads/rcu.h"
+#include "threads/synch.h"
+#ifdef USERPROG
+#include <rusage.h>
+#include "userprog/fdtable.h"
+#endif
+#ifdef VM
+#include "vm/page.h"
+#endif
+
+struct cpu;
+struct file;
+struct child_status;
+struct spawn_status;
+struct dir;
+struct io_ring;
 
 /* Number of timer interrupts per second. */
 /* Defined here for thread_tick. */
@@ -79,52 +99,159 @@ typedef int tid_t;
    the `magic' member of the running thread's `struct thread' is
    set to THREAD_MAGIC.  Stack overflow will normally change this
    value, triggering the assertion. */
-/* The `elem' member has a dual purpose.  It can be an element in
-   the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+/* Scheduler statistics of a thread, kept if thread_sched_stats.
+   A switch out is voluntary if the thread blocks or exits, and
+   involuntary if it is still runnable, i.e. preempted. */
+struct sched_stats
+  {
+    unsigned voluntary;         /* # of voluntary switches out. */
+    unsigned involuntary;       /* # of involuntary switches out. */
+    int64_t run_ticks;          /* Ticks spent running. */
+    int64_t ready_ticks;        /* Ticks spent in the run queues. */
+    int64_t lock_ticks;         /* Ticks spent waiting for locks. */
+    int64_t wake_ticks;         /* Ticks from sleep deadlines to running. */
+    unsigned wake_cnt;          /* # of wake-ups from sleep. */
+    int64_t stamp;              /* Ticks at last switch or unblock. */
+    int64_t wake_deadline;      /* Deadline just woken from, or 0. */
+  };
+
+/* The `elem' member is an element in the run queue (thread.c),
+   or `runnode' under the fair scheduler or for a thread of the
+   deadline class, and the `waitelem'
+   member is an element in a semaphore wait queue (synch.c).
+   Only a thread in the ready state is on the run queue, whereas
+   only a thread in the blocked state is on a semaphore wait
+   queue.
+
+   The members are grouped by cache line.  The first line holds
+   what walks of the run queues, wait queues and sleep heap read
+   of every thread they pass, and what other threads write when
+   they wake this one or donate to it.  The second holds what
+   only the thread itself and its CPU's scheduler write, so that
+   on SMP it does not bounce between CPUs along with the first.
+   thread.c checks both at compile time. */
 struct thread
   {
-    /* Owned by thread.c. */
-    tid_t tid;                          /* Thread identifier. */
+    /* Shared between thread.c and synch.c.  First cache line. */
     enum thread_status status;          /* Thread state. */
-    char name[16];                      /* Name (for debugging purposes). */
-    uint8_t *stack;                     /* Saved stack pointer. */
-    int64_t ticks_sleep;		/* Timer ticks when the sleep ends. */
-    int base_priority;			/* Base priority before donation. */
     int priority;                       /* Priority. */
+    struct list_elem elem;              /* List element. */
+    struct waitq_elem waitelem;		/* Element in sema_/cond_waiting. */
+    struct cpu *cpu;			/* CPU whose run queue it is on. */
+    struct lock *lock_waiting;		/* The lock waiting for. */
+    int base_priority;			/* Base priority before donation. */
+    tid_t tid;                          /* Thread identifier. */
+    int64_t ticks_sleep;		/* Timer ticks when the sleep ends. */
+
+    /* Owned by thread.c.  Second cache line. */
+    uint8_t *stack                      /* Saved stack pointer. */
+      __attribute__ ((aligned (CACHE_LINE_SIZE)));
     int nice;				/* Niceness. */
     fixed_t recent_cpu;			/* Recent cpu time. */
-    struct lock *lock_waiting;		/* The lock waiting for. */
-    struct list locks;			/* All locks held by the thread. */
+    int64_t recent_cpu_epoch;		/* MLFQS epoch recent_cpu is of. */
+    uint64_t vruntime;			/* Weighted run time, fair class. */
+    struct rb_node runnode;             /* Element in fair or deadline
+                                           run queue. */
+    int64_t dl_deadline;		/* Absolute deadline, deadline class. */
+    int64_t dl_budget;			/* Ticks of runtime left. */
+    bool dl_throttled;			/* Out of budget until replenished. */
 
-    struct list_elem sleepelem;		/* List element for sleep_list. */
+    /* Owned by thread.c.  Cold. */
+    char name[16];                      /* Name (for debugging purposes). */
+    struct semaphore *sema_waiting;	/* The semaphore waiting on. */
+    struct condition *cond_waiting;	/* The condition waiting on. */
+    struct waitq locks;			/* All locks held by the thread. */
+    int64_t dl_runtime;			/* Deadline class: budget per period, */
+    int64_t dl_period;			/*   period, */
+    int64_t dl_rel_deadline;		/*   and relative deadline, in ticks, */
+    struct list_elem dlelem;		/*   and element in dl_list. */
+    struct sched_stats stats;		/* Scheduler statistics. */
     struct list_elem allelem;           /* List element for all threads list. */
-
-    /* Shared between thread.c and synch.c. */
-    struct list_elem elem;              /* List element. */
+    struct list_elem tidelem;           /* Element in the tid table. */
+    struct rcu_head rcu;                /* Frees the page once dead. */
 
 #ifdef USERPROG
-    /* Owned by userprog/process.c. */
+    /* Owned by userprog/process.c.  A thread started by
+       thread_spawn() shares the page directory of the process that
+       spawned it, and keeps the rest of the process state in PROC,
+       the process's first thread. */
     uint32_t *pagedir;                  /* Page directory. */
+    struct thread *proc;                /* Holds the process state. */
     int exit_code;			/* Exit code. */
+    bool dying;                         /* Exiting: its threads must end. */
+    struct child_status *wait_status;   /* Shared with the parent. */
+    struct list children;               /* Status of each child. */
+    struct list exited_children;        /* Children exited, unwaited. */
+    struct semaphore child_exited;      /* Upped as each child exits. */
+    struct file *exec_file;             /* Executable, kept open. */
+    struct fd_table fds;                /* Open files (userprog/syscall.c). */
+    struct lock fds_lock;               /* Serializes threads on FDS, CWD. */
+    struct dir *cwd;                    /* Working directory, NULL: root. */
+    struct io_ring *io_ring;            /* I/O ring, or NULL. */
+    void *net_ring;                     /* Mapped net rings, or NULL. */
+    struct fpu_state *fpu;              /* FPU state (userprog/fpu.c). */
+    unsigned tlb_batch;                 /* Depth of deferred invalidation. */
+    struct rusage rusage;               /* Used by the process itself. */
+    struct rusage child_rusage;         /* Used by children waited for. */
+#endif
+
+    /* Owned by devices/block.c. */
+    int io_class;                       /* See block_set_class(). */
+
+#ifdef FILESYS
+    /* Owned by filesys/journal.c. */
+    int journal_depth;                  /* Nesting of journal_begin(). */
 #endif
+#ifdef VM
+    /* Owned by vm/page.c. */
+    struct hash spt;                    /* Supplemental page table. */
+    struct list mmaps;                  /* Memory-mapped files. */
+    int next_mapid;                     /* Identifier of next mapping. */
+    void *user_esp;                     /* User ESP on kernel entry. */
+    struct fault_around exec_fa;        /* Executable's fault-around. */
+    size_t swap_next;                   /* Best swap slot for next page. */
+    uint32_t resident;                  /* Pages in frames (vm/frame.c), */
+    uint32_t ws_size;                   /*   working-set estimate, */
+    uint32_t ws_accessed;               /*   and pages seen accessed. */
+    struct lock spt_lock;               /* Serializes threads on SPT, MMAPS. */
+
+    /* Owned by userprog/process.c. */
+    struct list threads;                /* Threads spawned, unjoined. */
+    struct semaphore threads_exited;    /* Upped as each one exits. */
+    unsigned thread_cnt;                /* Spawned threads running. */
+    uint32_t stack_slots;               /* Their stacks, as a bitmap. */
+    struct spawn_status *spawn_status;  /* Own status, if spawned. */
+    uint8_t *heap_start;                /* First page of the heap. */
+    uint8_t *heap_brk;                  /* Break, under SPT_LOCK. */
+#endif
+
+    /* Owned by threads/arena.c. */
+    void *arena[ARENA_PAGES];           /* Scratch pages, or nulls. */
+    size_t arena_ofs;                   /* Top of scratch memory. */
 
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
   };
 
-/* If false (default), use round-robin scheduler.
-   If true, use multi-level feedback queue scheduler.
-   Controlled by kernel command-line option "-o mlfqs". */
+/* True if the multi-level feedback queue scheduler is selected,
+   false for the priority (default) or fair scheduler.
+   Controlled by kernel command-line option "-sched=mlfqs". */
 extern bool thread_mlfqs;
 
+/* If true, keep per-thread scheduler statistics, and print them
+   as threads exit and with thread_print_stats().
+   Controlled by kernel command-line option "-sched-stats". */
+extern bool thread_sched_stats;
+
+bool thread_sched_select (const char *name);
+const char *thread_sched_name (void);
+bool thread_set_deadline (int64_t runtime, int64_t period, int64_t deadline);
+
 void thread_init (void);
 void thread_start (void);
 
-void thread_tick (void);
+void thread_tick (bool user);
+void thread_tick_idle(unsigned);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
@@ -133,18 +260,23 @@ tid_t thread_create (const char *name, int priority, thread_func *, void *);
 void thread_block (void);
 void thread_unblock (struct thread *);
 
-bool thread_cmp_ticks_sleep(const struct list_elem *, const struct list_elem *,
-			    void *);
 void thread_sleep(int64_t);
 void thread_foreach_wake(int64_t);
+bool thread_wake(struct thread *);
+int64_t thread_next_wakeup(void);
+void thread_sleep_stats(uint64_t *, uint64_t *, uint64_t *, uint64_t *);
 
 struct thread *thread_current (void);
+#ifdef USERPROG
+struct rusage *thread_rusage (void);
+#endif
 struct thread *thread_from_tid(tid_t);
 tid_t thread_tid (void);
 const char *thread_name (void);
 
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
+void thread_cond_yield (void);
 
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func (struct thread *t, void *aux);
@@ -155,7 +287,7 @@ bool thread_cmp_priority(const struct list_elem *, const struct list_elem *,
 int thread_get_priority (void);
 void thread_set_priority (int);
 void thread_update_priority(struct thread *);
-void thread_donate_priority(struct thread *);
+void thread_donate_priority(struct lock *, int priority);
 
 void thread_hold_lock(struct lock *);
 void thread_release_lock(struct lock *);
@@ -0,0 +1,175 @@
+#include "threads/trace.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/cycle.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Kernel tracepoints.  Each TRACE() in the kernel writes a
+   fixed-size record, time-stamped with the TSC, into a ring that
+   overwrites its oldest records once it is full, so that it
+   always holds the latest history.  At shutdown the ring is
+   printed in hex, oldest record first, for utils/trace2json to
+   turn into a timeline.
+
+   There is one ring, because Pintos runs on one CPU.  Records are
+   claimed with interrupts off, which is all it takes there; each
+   CPU would need a ring of its own to keep recording lock-free
+   on more. */
+
+/* One record, as printed. */
+struct trace_rec {
+	uint64_t tsc;			/* Time stamp counter. */
+	int32_t tid;			/* Thread the event happened in. */
+	uint32_t event;			/* enum trace_event. */
+	uint32_t args[4];		/* Arguments. */
+};
+
+/* Names of events, printed with the ring so that the dump tool
+   need not know them. */
+static const char *trace_names[TRACE_EVENT_CNT] = {
+	"thread", "schedule", "wakeup", "lock_contend", "lock_acquire",
+	"lock_release", "sema_wait", "sema_wake", "page_fault",
+	"block_submit", "block_complete", "syscall", "syscall_exit",
+};
+
+bool trace_enabled;
+unsigned trace_pages = 16;
+
+static struct trace_rec *ring;
+static size_t ring_cnt;		/* Number of records RING holds. */
+static size_t ring_head;	/* Index of the next record to write. */
+static uint64_t rec_cnt;	/* Number of records written. */
+
+static struct trace_rec *claim(void);
+
+/**
+ * trace_init - start tracing
+ *
+ * If tracing was requested, allocate the ring and start recording.
+ * Name the current thread, which started before tracing could.
+*/
+void trace_init(void)
+{
+	if (!trace_enabled)
+		return;
+
+	trace_enabled = false;
+	ring = palloc_get_multiple(0, trace_pages);
+	if (ring == NULL)
+		PANIC("no memory for %u pages of trace ring", trace_pages);
+	ring_cnt = trace_pages * PGSIZE / sizeof *ring;
+	trace_enabled = true;
+	trace_thread(thread_current());
+}
+
+/**
+ * trace_record - record an event
+ *
+ * @event: what happened
+ * @a0: first argument
+ * @a1: second argument
+ * @a2: third argument
+ *
+ * Append a record of @event in the current thread to the ring.
+ * Use TRACE() instead, which skips the call unless tracing.
+*/
+void trace_record(enum trace_event event, uint32_t a0, uint32_t a1,
+		  uint32_t a2)
+{
+	enum intr_level old_level = intr_disable();
+	struct trace_rec *r = claim();
+
+	r->tid = thread_current()->tid;
+	r->event = event;
+	r->args[0] = a0;
+	r->args[1] = a1;
+	r->args[2] = a2;
+	r->args[3] = 0;
+	intr_set_level(old_level);
+}
+
+/**
+ * trace_thread - record the name of a thread
+ *
+ * @t: the thread, which need not be running
+ *
+ * Record a TRACE_THREAD event for @t, with its name, up to 16
+ * bytes of it, as the arguments.
+*/
+void trace_thread(struct thread *t)
+{
+	enum intr_level old_level;
+	struct trace_rec *r;
+
+	if (!trace_enabled)
+		return;
+
+	old_level = intr_disable();
+	r = claim();
+	r->tid = t->tid;
+	r->event = TRACE_THREAD;
+	memset(r->args, 0, sizeof r->args);
+	strlcpy((char *)r->args, t->name, sizeof r->args);
+	intr_set_level(old_level);
+}
+
+/* Returns the next record in the ring, stamped with the TSC.
+   Must be called with interrupts off. */
+static struct trace_rec *claim(void)
+{
+	struct trace_rec *r = &ring[ring_head];
+
+	ASSERT(intr_get_level() == INTR_OFF);
+	if (++ring_head == ring_cnt)
+		ring_head = 0;
+	rec_cnt++;
+	r->tsc = rdtsc();
+	return r;
+}
+
+/**
+ * trace_print_stats - print the trace ring
+ *
+ * Stop tracing and print the ring, led by the TSC frequency and
+ * the names of the events, as lines of the form
+ *
+ *	Trace: RECORDS records, LOST overwritten, HZ Hz
+ *	Trace event ID NAME
+ *	Trace record HEX
+ *
+ * where HEX is a record's bytes, as read by utils/trace2json.
+*/
+void trace_print_stats(void)
+{
+	bool wrapped;
+	size_t cnt, i;
+	int e;
+
+	if (ring == NULL)
+		return;
+	trace_enabled = false;
+
+	/* Once the ring wraps, the oldest record is the next one to
+	   be overwritten. */
+	wrapped = rec_cnt > ring_cnt;
+	cnt = wrapped ? ring_cnt : rec_cnt;
+	printf("Trace: %zu records, %llu overwritten, %llu Hz\n",
+	       cnt, rec_cnt - cnt, timer_tsc_hz());
+	for (e = 0; e < TRACE_EVENT_CNT; e++)
+		printf("Trace event %d %s\n", e, trace_names[e]);
+	for (i = 0; i < cnt; i++) {
+		size_t idx = wrapped ? (ring_head + i) % ring_cnt : i;
+		const uint8_t *p = (const uint8_t *)&ring[idx];
+		char hex[sizeof *ring * 2 + 1];
+		size_t j;
+
+		for (j = 0; j < sizeof *ring; j++)
+			snprintf(hex + j * 2, 3, "%02x", p[j]);
+		printf("Trace record %s\n", hex);
+	}
+}
@@ -0,0 +1,53 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct thread;
+
+/* Kernel events that can be traced.  Keep trace_names[] in
+   threads/trace.c in the same order. */
+enum trace_event {
+	TRACE_THREAD,		/* Thread named; args hold the name. */
+	TRACE_SCHEDULE,		/* Switch: next tid, old status. */
+	TRACE_WAKEUP,		/* Made ready: tid, preempts running? */
+	TRACE_LOCK_CONTEND,	/* Lock held: lock, holder tid. */
+	TRACE_LOCK_ACQUIRE,	/* Lock acquired: lock. */
+	TRACE_LOCK_RELEASE,	/* Lock released: lock. */
+	TRACE_SEMA_WAIT,	/* Sema down blocks: sema. */
+	TRACE_SEMA_WAKE,	/* Sema up wakes: sema, woken tid. */
+	TRACE_PAGE_FAULT,	/* Fault: address, eip, error code. */
+	TRACE_BLOCK_SUBMIT,	/* Request: req, sector, count|write. */
+	TRACE_BLOCK_COMPLETE,	/* Request done: req, sector, count|write. */
+	TRACE_SYSCALL,		/* System call: number, first argument. */
+	TRACE_SYSCALL_EXIT,	/* System call returns: number, result. */
+	TRACE_EVENT_CNT
+};
+
+/* Set in a block request count argument for a write. */
+#define TRACE_WRITE 0x80000000u
+
+/* True while events are being recorded.  Set by the kernel
+   command-line option "-trace". */
+extern bool trace_enabled;
+
+/* Records EVENT with arguments A0, A1, and A2 if tracing is on.
+   Otherwise this costs a test of trace_enabled, and the
+   arguments are not evaluated. */
+#define TRACE(EVENT, A0, A1, A2)					\
+	do {								\
+		if (__builtin_expect(trace_enabled, 0))			\
+			trace_record(EVENT, (uint32_t)(A0), (uint32_t)(A1), \
+				     (uint32_t)(A2));			\
+	} while (0)
+
+/* Pages in the trace ring.  Set by "-trace=PAGES". */
+extern unsigned trace_pages;
+
+void trace_init(void);
+void trace_record(enum trace_event, uint32_t, uint32_t, uint32_t);
+void trace_thread(struct thread *);
+void trace_print_stats(void);
+
+#endif /* threads/trace.h */
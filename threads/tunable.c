@@ -0,0 +1,148 @@
+#include "threads/tunable.h"
+#include <debug.h>
+#include <string.h>
+#include "threads/interrupt.h"
+
+/* Registered tunables, in order of registration.  Tunables
+   register at boot and stay registered, so the list only grows,
+   with interrupts off. */
+static struct list tunables = LIST_INITIALIZER (tunables);
+
+/* NAME=VALUE settings from the kernel command line not yet
+   applied, because their tunables have not registered. */
+#define BOOT_SETTING_MAX 16
+static char *boot_settings[BOOT_SETTING_MAX];
+static size_t boot_setting_cnt;
+
+static struct tunable *find (const char *name);
+
+/* Adds T to the registry, first setting it from the last of the
+   command line's settings for it, if there are any.  Panics if
+   such a setting is out of T's range. */
+void
+tunable_register (struct tunable *t)
+{
+  enum intr_level old_level;
+  size_t i;
+
+  ASSERT (strlen (t->name) <= SYSCTL_NAME_MAX);
+  ASSERT (t->min <= *t->value && *t->value <= t->max);
+
+  for (i = 0; i < boot_setting_cnt; i++)
+    {
+      char *setting = boot_settings[i];
+      size_t len = strcspn (setting, "=");
+      unsigned long long value = 0;
+      const char *p;
+
+      if (strlen (t->name) != len || memcmp (setting, t->name, len))
+        continue;
+      for (p = setting + len + 1; *p >= '0' && *p <= '9'; p++)
+        if (value <= t->max)
+          value = value * 10 + (*p - '0');
+      if (p == setting + len + 1 || *p != '\0'
+          || value < t->min || value > t->max)
+        PANIC ("tunable %s must be from %u to %u, not `%s'",
+               t->name, t->min, t->max, setting + len + 1);
+      *t->value = value;
+      boot_settings[i] = NULL;
+    }
+
+  old_level = intr_disable ();
+  list_push_back (&tunables, &t->elem);
+  intr_set_level (old_level);
+}
+
+/* Records SETTING, a NAME=VALUE argument of -set on the kernel
+   command line, to set NAME when it registers.  SETTING must
+   last until then. */
+void
+tunable_boot_set (char *setting)
+{
+  if (setting == NULL || strchr (setting, '=') == NULL)
+    PANIC ("-set needs NAME=VALUE, not `%s'",
+           setting != NULL ? setting : "");
+  if (boot_setting_cnt >= BOOT_SETTING_MAX)
+    PANIC ("more than %d -set options", BOOT_SETTING_MAX);
+  boot_settings[boot_setting_cnt++] = setting;
+}
+
+/* Panics if a command line setting named a tunable that did not
+   register, once all have had the chance. */
+void
+tunable_boot_check (void)
+{
+  size_t i;
+
+  for (i = 0; i < boot_setting_cnt; i++)
+    if (boot_settings[i] != NULL)
+      PANIC ("unknown tunable `%.*s' (use -h for help)",
+             (int) strcspn (boot_settings[i], "="), boot_settings[i]);
+}
+
+/* Sets the tunable called NAME to VALUE.  Returns false if there
+   is no such tunable, it may be set only at boot, or VALUE is out
+   of its range. */
+bool
+tunable_set (const char *name, unsigned value)
+{
+  struct tunable *t = find (name);
+
+  if (t == NULL || t->boot_only || value < t->min || value > t->max)
+    return false;
+  *t->value = value;
+  return true;
+}
+
+/* Stores a description of the IDX'th tunable registered, counting
+   from 0, in *SC.  Returns false if fewer than IDX + 1 have
+   registered. */
+bool
+tunable_get (size_t idx, struct sysctl *sc)
+{
+  enum intr_level old_level;
+  struct list_elem *e;
+
+  old_level = intr_disable ();
+  for (e = list_begin (&tunables); e != list_end (&tunables);
+       e = list_next (e))
+    if (idx-- == 0)
+      {
+        struct tunable *t = list_entry (e, struct tunable, elem);
+
+        memset (sc, 0, sizeof *sc);
+        strlcpy (sc->name, t->name, sizeof sc->name);
+        sc->value = *t->value;
+        sc->min = t->min;
+        sc->max = t->max;
+        sc->boot_only = t->boot_only;
+        break;
+      }
+  intr_set_level (old_level);
+  return e != list_end (&tunables);
+}
+
+/* Returns the tunable called NAME, or a null pointer if there is
+   none. */
+static struct tunable *
+find (const char *name)
+{
+  enum intr_level old_level;
+  struct tunable *found = NULL;
+  struct list_elem *e;
+
+  old_level = intr_disable ();
+  for (e = list_begin (&tunables); e != list_end (&tunables);
+       e = list_next (e))
+    {
+      struct tunable *t = list_entry (e, struct tunable, elem);
+
+      if (!strcmp (t->name, name))
+        {
+          found = t;
+          break;
+        }
+    }
+  intr_set_level (old_level);
+  return found;
+}
@@ -0,0 +1,42 @@
+#ifndef THREADS_TUNABLE_H
+#define THREADS_TUNABLE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sysctl.h>
+
+/* Tunables.
+
+   A kernel parameter worth changing without a rebuild, such as
+   the length of a time slice or how far to read ahead, is kept
+   in an unsigned variable that its module registers as a tunable
+   under a name like "sched.time_slice" before it first reads it.
+   The kernel command line sets tunables with -set=NAME=VALUE,
+   which takes effect as each one is registered, and the sysctl
+   system calls list and set them while the system runs (see
+   examples/sysctl.c).
+
+   Code that reads a tunable must cope with its changing between
+   one read and the next, to any value from MIN to MAX.  One that
+   is read only at boot, such as the number of sectors the buffer
+   cache allocates, is registered BOOT_ONLY and may be set only on
+   the command line. */
+struct tunable
+  {
+    const char *name;                   /* At most SYSCTL_NAME_MAX. */
+    unsigned *value;                    /* The variable. */
+    unsigned min, max;                  /* Values it may be set to. */
+    bool boot_only;                     /* Read only at boot? */
+
+    /* Owned by the tunable registry. */
+    struct list_elem elem;              /* Element in tunable list. */
+  };
+
+void tunable_register (struct tunable *);
+void tunable_boot_set (char *setting);
+void tunable_boot_check (void);
+bool tunable_set (const char *name, unsigned value);
+bool tunable_get (size_t idx, struct sysctl *);
+
+#endif /* threads/tunable.h */
@@ -0,0 +1,64 @@
+#include "threads/vmstat.h"
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+
+/* Memory statistics.  The memory subsystems count their events
+   in vmstat_events; vmstat_get() adds the state of the page and
+   block allocators, for shutdown and for the vmstat system
+   call. */
+
+struct percpu_counter vmstat_events[VMSTAT_EVENT_CNT];
+
+/**
+ * vmstat_get - take a snapshot of the memory statistics
+ *
+ * @st: where to store the snapshot
+*/
+void vmstat_get(struct vmstat *st)
+{
+	size_t i;
+
+	memset(st, 0, sizeof *st);
+	for (i = 0; i < VMSTAT_EVENT_CNT; i++)
+		st->events[i] = vmstat_read(i);
+	palloc_vmstat(st);
+	malloc_vmstat(st);
+}
+
+/**
+ * vmstat_print_stats - print the memory statistics
+ *
+ * Print the events that happened, the free pages of each pool, how
+ * many PAL_ZERO requests found a page zeroed ahead of time, and the
+ * usage of each malloc() size class that has blocks.
+*/
+void vmstat_print_stats(void)
+{
+	static const char *names[VMSTAT_EVENT_CNT] = VMSTAT_EVENT_NAMES;
+	struct vmstat st;
+	uint64_t zero_reqs;
+	size_t i;
+
+	vmstat_get(&st);
+	printf("Memory:");
+	for (i = 0; i < VMSTAT_EVENT_CNT; i++)
+		printf(" %llu %s%s", st.events[i], names[i],
+		       i + 1 < VMSTAT_EVENT_CNT ? "," : "\n");
+	printf("Memory: %u/%u kernel pages free, %u/%u user pages free\n",
+	       st.kernel_free, st.kernel_pages, st.user_free, st.user_pages);
+	zero_reqs = st.events[VMSTAT_PREZEROED] + st.events[VMSTAT_ZEROED];
+	if (zero_reqs > 0)
+		printf("Memory: %llu%% of %llu PAL_ZERO requests prezeroed\n",
+		       st.events[VMSTAT_PREZEROED] * 100 / zero_reqs,
+		       zero_reqs);
+	for (i = 0; i < st.class_cnt; i++) {
+		struct vmstat_class *c = &st.classes[i];
+
+		if (c->arenas > 0)
+			printf("Memory: malloc %u: %u arenas, %u used, "
+			       "%u free\n", c->block_size, c->arenas, c->used,
+			       c->free);
+	}
+}
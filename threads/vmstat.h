@@ -0,0 +1,33 @@
+#ifndef THREADS_VMSTAT_H
+#define THREADS_VMSTAT_H
+
+#include <vmstat.h>
+#include "threads/percpu.h"
+
+/* Counts of memory events, by enum vmstat_event. */
+extern struct percpu_counter vmstat_events[VMSTAT_EVENT_CNT];
+
+/**
+ * vmstat_count - count a memory event
+ *
+ * @event: the event
+*/
+static inline void vmstat_count(enum vmstat_event event)
+{
+	percpu_counter_inc(&vmstat_events[event]);
+}
+
+/**
+ * vmstat_read - get the count of a memory event
+ *
+ * @event: the event
+*/
+static inline uint64_t vmstat_read(enum vmstat_event event)
+{
+	return percpu_counter_sum(&vmstat_events[event]);
+}
+
+void vmstat_get(struct vmstat *);
+void vmstat_print_stats(void);
+
+#endif /* threads/vmstat.h */
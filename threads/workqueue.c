@@ -0,0 +1,422 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Workqueues.  A workqueue is a pool of worker threads that run
+   work submitted to it, highest priority first and in FIFO order
+   within a priority, so that a subsystem with occasional
+   background work need not keep a thread of its own, and the
+   number of workers bounds how much of it runs at once.
+
+   Idle workers park on a semaphore.  Delayed work waits in a
+   tree ordered by due tick, and one idle worker, the timekeeper,
+   sleeps in the timer's sleep heap until the first of it falls
+   due, rather than parking.  Submitting work that is due earlier
+   wakes the timekeeper early.
+
+   The state of a workqueue is protected by turning interrupts
+   off, so that interrupt handlers can submit work too. */
+
+/* Workers of system_wq. */
+#define SYSTEM_WORKERS 2
+
+/* Thread priority a worker runs work of each priority at. */
+static const int work_thread_pri[WORK_PRI_CNT] = {
+	PRI_DEFAULT + 10, PRI_DEFAULT, PRI_DEFAULT - 10,
+};
+
+struct workqueue {
+	char name[16];			/* Name, for statistics. */
+	struct list queues[WORK_PRI_CNT];	/* Work to run, by priority. */
+	struct rb_tree delayed;		/* Delayed work, by due tick. */
+	struct semaphore park;		/* Idle workers wait here. */
+	unsigned parked;		/* # of workers waiting on PARK. */
+	struct thread *timekeeper;	/* Worker asleep until WAKE_AT. */
+	int64_t wake_at;		/* Due tick the timekeeper waits for. */
+	unsigned workers;		/* # of worker threads. */
+	struct list_elem elem;		/* Element in wq_list. */
+
+	/* Statistics. */
+	uint64_t run_cnt;		/* # of work items run. */
+	uint64_t delayed_cnt;		/* # of them submitted delayed. */
+	int64_t wait_ticks;		/* Ticks from ready to running. */
+	int64_t wait_max;		/* Most ticks of one of them. */
+};
+
+struct workqueue *system_wq;
+
+/* All workqueues, for statistics. */
+static struct list wq_list;
+
+static thread_func worker NO_RETURN;
+static rb_less_func due_less;
+
+/**
+ * workqueue_init - initialize workqueues
+ *
+ * Set up workqueues and create system_wq.  Must be called after
+ * thread_start().
+*/
+void workqueue_init(void)
+{
+	list_init(&wq_list);
+	system_wq = workqueue_create("kworker", SYSTEM_WORKERS);
+	if (system_wq == NULL)
+		PANIC("could not create system workqueue");
+}
+
+/**
+ * workqueue_create - create a workqueue
+ *
+ * @name: name for statistics, and prefix of the workers' names
+ * @workers: number of worker threads
+ *
+ * Create a workqueue with up to the given number of worker threads,
+ * which is the most work of it that runs at once.
+ * Return NULL if not even one worker could be created.
+*/
+struct workqueue *workqueue_create(const char *name, unsigned workers)
+{
+	enum intr_level old_level;
+	struct workqueue *wq;
+	int i;
+
+	ASSERT(workers > 0);
+
+	wq = malloc(sizeof *wq);
+	if (wq == NULL)
+		return NULL;
+	memset(wq, 0, sizeof *wq);
+	strlcpy(wq->name, name, sizeof wq->name);
+	for (i = 0; i < WORK_PRI_CNT; i++)
+		list_init(&wq->queues[i]);
+	rb_init(&wq->delayed, due_less, NULL);
+	sema_init(&wq->park, 0);
+
+	while (wq->workers < workers) {
+		char thread_name[16];
+
+		snprintf(thread_name, sizeof thread_name, "%s/%u", name,
+			 wq->workers);
+		if (thread_create(thread_name, PRI_DEFAULT, worker, wq)
+		    == TID_ERROR)
+			break;
+		wq->workers++;
+	}
+	/* Nothing has a pointer to the workqueue until it is returned. */
+	if (wq->workers == 0) {
+		free(wq);
+		return NULL;
+	}
+
+	old_level = intr_disable();
+	list_push_back(&wq_list, &wq->elem);
+	intr_set_level(old_level);
+	return wq;
+}
+
+/**
+ * work_init - initialize a work item
+ *
+ * @w: the work item
+ * @func: function to run
+ * @aux: argument to pass to @func
+ * @priority: priority to run at
+*/
+void work_init(struct work *w, work_func *func, void *aux,
+	       enum work_priority priority)
+{
+	ASSERT(func != NULL);
+	ASSERT(priority < WORK_PRI_CNT);
+
+	w->func = func;
+	w->aux = aux;
+	w->priority = priority;
+	w->wq = NULL;
+	w->delayed = false;
+}
+
+/* Appends W to the queue of its priority on WQ, as ready to run
+   since tick NOW.  Interrupts must be off. */
+static void
+queue_ready (struct workqueue *wq, struct work *w, int64_t now)
+{
+  w->delayed = false;
+  w->queued_at = now;
+  list_push_back (&wq->queues[w->priority], &w->elem);
+}
+
+/* Wakes a parked worker of WQ, if any.  Returns true if
+   successful.  Interrupts must be off. */
+static bool
+unpark (struct workqueue *wq)
+{
+  if (wq->parked == 0)
+    return false;
+  wq->parked--;
+  sema_up (&wq->park);
+  return true;
+}
+
+/* Wakes the timekeeper of WQ, if any, to look for work before
+   its deadline.  Interrupts must be off. */
+static void
+wake_timekeeper (struct workqueue *wq)
+{
+  if (wq->timekeeper != NULL)
+    {
+      thread_wake (wq->timekeeper);
+      wq->timekeeper = NULL;
+    }
+}
+
+/**
+ * work_submit - queue work to run
+ *
+ * @wq: the workqueue
+ * @w: the work item, initialized by work_init()
+ *
+ * Queue the given work item to run in a worker of the given workqueue,
+ * and wake a worker if one is idle.  May be called from an interrupt
+ * handler.
+ * Return false, doing nothing, if the item is already queued.
+*/
+bool work_submit(struct workqueue *wq, struct work *w)
+{
+	enum intr_level old_level;
+
+	old_level = intr_disable();
+	if (w->wq != NULL) {
+		intr_set_level(old_level);
+		return false;
+	}
+	w->wq = wq;
+	queue_ready(wq, w, timer_ticks());
+	if (!unpark(wq))
+		wake_timekeeper(wq);
+	intr_set_level(old_level);
+	return true;
+}
+
+/**
+ * work_submit_delayed - queue work to run after a delay
+ *
+ * @wq: the workqueue
+ * @w: the work item, initialized by work_init()
+ * @ticks: timer ticks to wait first, or 0 not to
+ *
+ * Queue the given work item to run once the given number of ticks has
+ * passed, as work_submit() would then.  May be called from an
+ * interrupt handler.
+ * Return false, doing nothing, if the item is already queued.
+*/
+bool work_submit_delayed(struct workqueue *wq, struct work *w, int64_t ticks)
+{
+	enum intr_level old_level;
+
+	if (ticks <= 0)
+		return work_submit(wq, w);
+
+	old_level = intr_disable();
+	if (w->wq != NULL) {
+		intr_set_level(old_level);
+		return false;
+	}
+	w->wq = wq;
+	w->delayed = true;
+	w->due = timer_ticks() + ticks;
+	rb_insert(&wq->delayed, &w->node);
+	wq->delayed_cnt++;
+	/* Someone has to wait for it, by this deadline. */
+	if (wq->timekeeper != NULL) {
+		if (w->due < wq->wake_at)
+			wake_timekeeper(wq);
+	} else {
+		unpark(wq);
+	}
+	intr_set_level(old_level);
+	return true;
+}
+
+/**
+ * work_cancel - take queued work back
+ *
+ * @w: the work item
+ *
+ * Take the given work item off its workqueue if it has not started to
+ * run yet.  Once it has, it may be running still.
+ * Return true if it was queued, false if not.
+*/
+bool work_cancel(struct work *w)
+{
+	enum intr_level old_level;
+	struct workqueue *wq;
+
+	old_level = intr_disable();
+	wq = w->wq;
+	if (wq != NULL) {
+		if (w->delayed)
+			rb_remove(&wq->delayed, &w->node);
+		else
+			list_remove(&w->elem);
+		w->delayed = false;
+		w->wq = NULL;
+	}
+	intr_set_level(old_level);
+	return wq != NULL;
+}
+
+/**
+ * workqueue_print_stats - print workqueue statistics
+*/
+void workqueue_print_stats(void)
+{
+	struct list_elem *e;
+
+	/* Not initialized if the kernel stopped early. */
+	if (system_wq == NULL)
+		return;
+	for (e = list_begin(&wq_list); e != list_end(&wq_list);
+	     e = list_next(e)) {
+		struct workqueue *wq = list_entry(e, struct workqueue, elem);
+
+		printf("Workqueue %s: %u workers, %llu run, %llu delayed, "
+		       "wait %llu avg/%lld max ticks\n",
+		       wq->name, wq->workers, wq->run_cnt, wq->delayed_cnt,
+		       wq->run_cnt ? (unsigned long long)wq->wait_ticks
+				      / wq->run_cnt : 0,
+		       wq->wait_max);
+	}
+}
+
+/* Orders delayed work by due tick. */
+static bool
+due_less (const struct rb_node *a, const struct rb_node *b,
+          void *aux UNUSED)
+{
+  return (rb_entry (a, struct work, node)->due
+          < rb_entry (b, struct work, node)->due);
+}
+
+/**
+ * next_work - take the next work item to run
+ *
+ * @wq: the workqueue
+ *
+ * Move delayed work that has fallen due to its queue, then take the
+ * front of the highest non-empty queue.  Wake another worker if more
+ * is left to run.
+ * Must be called with interrupts turned off.
+ * Return NULL if there is nothing to run.
+*/
+static struct work *next_work(struct workqueue *wq)
+{
+	struct rb_node *node;
+	struct work *w;
+	int64_t now;
+	int i;
+
+	ASSERT(intr_get_level() == INTR_OFF);
+
+	now = timer_ticks();
+	while ((node = rb_first(&wq->delayed)) != NULL &&
+	       (w = rb_entry(node, struct work, node))->due <= now) {
+		rb_remove(&wq->delayed, node);
+		queue_ready(wq, w, w->due);
+	}
+
+	for (i = 0; i < WORK_PRI_CNT; i++)
+		if (!list_empty(&wq->queues[i])) {
+			w = list_entry(list_pop_front(&wq->queues[i]),
+				       struct work, elem);
+			break;
+		}
+	if (i == WORK_PRI_CNT)
+		return NULL;
+
+	for (i = 0; i < WORK_PRI_CNT; i++)
+		if (!list_empty(&wq->queues[i])) {
+			unpark(wq);
+			break;
+		}
+	return w;
+}
+
+/**
+ * wait_for_work - let a worker wait for work
+ *
+ * @wq: the workqueue of the current worker
+ *
+ * Become the timekeeper and sleep until the first delayed work is due,
+ * if there is delayed work and no timekeeper yet, or park otherwise.
+ * Must be called with interrupts turned off.
+*/
+static void wait_for_work(struct workqueue *wq)
+{
+	struct rb_node *first;
+
+	ASSERT(intr_get_level() == INTR_OFF);
+
+	first = rb_first(&wq->delayed);
+	if (first != NULL && wq->timekeeper == NULL) {
+		wq->timekeeper = thread_current();
+		wq->wake_at = rb_entry(first, struct work, node)->due;
+		thread_sleep(wq->wake_at);
+		/* Unless woken early, which resigned us already. */
+		if (wq->timekeeper == thread_current())
+			wq->timekeeper = NULL;
+	} else {
+		wq->parked++;
+		sema_down(&wq->park);
+	}
+}
+
+/* Worker thread of workqueue WQ_: runs its work, forever. */
+static void
+worker (void *wq_)
+{
+  struct workqueue *wq = wq_;
+  int priority = PRI_DEFAULT;
+
+  for (;;)
+    {
+      enum intr_level old_level = intr_disable ();
+      struct work *w = next_work (wq);
+      work_func *func;
+      void *aux;
+      int new_priority;
+      int64_t wait;
+
+      if (w == NULL)
+        {
+          wait_for_work (wq);
+          intr_set_level (old_level);
+          continue;
+        }
+
+      /* W is no longer ours once it may be submitted again. */
+      func = w->func;
+      aux = w->aux;
+      new_priority = work_thread_pri[w->priority];
+      w->wq = NULL;
+      wait = timer_ticks () - w->queued_at;
+      wq->run_cnt++;
+      wq->wait_ticks += wait;
+      if (wait > wq->wait_max)
+        wq->wait_max = wait;
+      intr_set_level (old_level);
+
+      if (priority != new_priority)
+        {
+          priority = new_priority;
+          thread_set_priority (priority);
+        }
+      func (aux);
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <rbtree.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct workqueue;
+
+/* Priorities of work.  Each has a queue of its own in a
+   workqueue, and a worker runs work of higher priority at a
+   higher thread priority. */
+enum work_priority {
+	WORK_HIGH,		/* Latency-sensitive, e.g. I/O completion. */
+	WORK_NORMAL,		/* Default. */
+	WORK_LOW,		/* Background, e.g. write-back. */
+	WORK_PRI_CNT
+};
+
+/* A function to run in a worker thread, given auxiliary data
+   AUX.  It may sleep, and may submit its own work again. */
+typedef void work_func(void *aux);
+
+/* An item of work.  Embedded in the structure it works on, and
+   owned by the workqueue while queued. */
+struct work {
+	struct list_elem elem;		/* Element in a priority queue. */
+	struct rb_node node;		/* Element in the delayed tree. */
+	work_func *func;		/* Function to run. */
+	void *aux;			/* Argument to FUNC. */
+	enum work_priority priority;	/* Queue to run from. */
+	int64_t due;			/* Timer tick due, if delayed. */
+	int64_t queued_at;		/* Timer tick queued to run. */
+	struct workqueue *wq;		/* Queued on, or NULL. */
+	bool delayed;			/* In the delayed tree? */
+};
+
+/* Shared workqueue, for subsystems that do not need one of their
+   own.  Created by workqueue_init(). */
+extern struct workqueue *system_wq;
+
+void workqueue_init(void);
+struct workqueue *workqueue_create(const char *name, unsigned workers);
+
+void work_init(struct work *, work_func *, void *aux, enum work_priority);
+bool work_submit(struct workqueue *, struct work *);
+bool work_submit_delayed(struct workqueue *, struct work *, int64_t ticks);
+bool work_cancel(struct work *);
+
+void workqueue_print_stats(void);
+
+#endif /* threads/workqueue.h */
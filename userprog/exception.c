@@ -1,14 +1,20 @@
 #include "userprog/exception.h"
 #include <inttypes.h>
 #include <stdio.h>
+#include "userprog/fpu.h"
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
-
-/* Number of page faults processed. */
-static long long page_fault_cnt;
+#include "threads/trace.h"
+#include "threads/vaddr.h"
+#include "threads/vmstat.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 static void kill (struct intr_frame *);
+static bool fixup_exception (struct intr_frame *);
+static void device_not_available (struct intr_frame *);
 static void page_fault (struct intr_frame *);
 
 /* Registers handlers for interrupts that can be caused by user
@@ -45,7 +51,7 @@ exception_init (void)
   intr_register_int (0, 0, INTR_ON, kill, "#DE Divide Error");
   intr_register_int (1, 0, INTR_ON, kill, "#DB Debug Exception");
   intr_register_int (6, 0, INTR_ON, kill, "#UD Invalid Opcode Exception");
-  intr_register_int (7, 0, INTR_ON, kill,
+  intr_register_int (7, 0, INTR_ON, device_not_available,
                      "#NM Device Not Available Exception");
   intr_register_int (11, 0, INTR_ON, kill, "#NP Segment Not Present");
   intr_register_int (12, 0, INTR_ON, kill, "#SS Stack Fault Exception");
@@ -64,7 +70,7 @@ exception_init (void)
 void
 exception_print_stats (void) 
 {
-  printf ("Exception: %lld page faults\n", page_fault_cnt);
+  printf ("Exception: %llu page faults\n", vmstat_read (VMSTAT_FAULT));
 }
 
 /* Handler for an exception (probably) caused by a user process. */
@@ -86,6 +92,7 @@ kill (struct intr_frame *f)
     case SEL_UCSEG:
       /* User's code segment, so it's a user exception, as we
          expected.  Kill the user process.  */
+      thread_current ()->exit_code = -1;
       printf ("%s: dying due to interrupt %#04x (%s).\n",
               thread_name (), f->vec_no, intr_name (f->vec_no));
       intr_dump_frame (f);
@@ -108,6 +115,16 @@ kill (struct intr_frame *f)
     }
 }
 
+/* Handler for #NM, raised by a thread's first use of the FPU
+   since it was switched in, unless it still owns it.  See
+   userprog/fpu.c.  The kernel itself never uses the FPU. */
+static void
+device_not_available (struct intr_frame *f)
+{
+  if (f->cs != SEL_UCSEG || !fpu_trap ())
+    kill (f);
+}
+
 /* Page fault handler.  This is a skeleton that must be filled in
    to implement virtual memory.  Some solutions to project 2 may
    also require modifying this code.
@@ -141,16 +158,34 @@ page_fault (struct intr_frame *f)
   intr_enable ();
 
   /* Count page faults. */
-  page_fault_cnt++;
+  vmstat_count (VMSTAT_FAULT);
 
   /* Determine cause. */
   not_present = (f->error_code & PF_P) == 0;
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
+  TRACE (TRACE_PAGE_FAULT, fault_addr, f->eip, f->error_code);
+
+#ifdef VM
+  /* Bring in the page from the supplemental page table, growing
+     the stack if needed, or copy a copy-on-write page being
+     written.  A fault in the kernel has the user's stack pointer
+     saved on entry. */
+  if (is_user_vaddr (fault_addr)
+      && (not_present
+          ? (page_load (fault_addr, write)
+             || page_grow_stack (fault_addr, user ? f->esp
+                                 : thread_current ()->user_esp))
+          : write && page_copy_on_write (fault_addr)))
+    return;
+#endif
+
+  /* A fault in the kernel on a user address is expected from the
+     user memory accessors in userprog/syscall.c, and reported to
+     them.  From anywhere else it is a kernel bug. */
+  if (!user && is_user_vaddr (fault_addr) && fixup_exception (f))
+    return;
 
-  /* To implement virtual memory, delete the rest of the function
-     body, and replace it with code that brings in the page to
-     which fault_addr refers. */
   printf ("Page fault at %p: %s error %s page in %s context.\n",
           fault_addr,
           not_present ? "not present" : "rights violation",
@@ -159,3 +194,21 @@ page_fault (struct intr_frame *f)
   kill (f);
 }
 
+/* If the kernel instruction at F's EIP is in the exception
+   table, resumes F at its fixup address with EAX set to -1, and
+   returns true.  Otherwise returns false. */
+static bool
+fixup_exception (struct intr_frame *f)
+{
+  extern const struct exception_entry _start_ex_table[], _end_ex_table[];
+  const struct exception_entry *e;
+
+  for (e = _start_ex_table; e < _end_ex_table; e++)
+    if (e->insn == (uintptr_t) f->eip)
+      {
+        f->eip = (void (*) (void)) e->fixup;
+        f->eax = 0xffffffff;
+        return true;
+      }
+  return false;
+}
@@ -1,11 +1,29 @@
 #ifndef USERPROG_EXCEPTION_H
 #define USERPROG_EXCEPTION_H
 
+#include <stdint.h>
+
 /* Page fault error code bits that describe the cause of the exception.  */
 #define PF_P 0x1    /* 0: not-present page. 1: access rights violation. */
 #define PF_W 0x2    /* 0: read, 1: write. */
 #define PF_U 0x4    /* 0: kernel, 1: user process. */
 
+/* An entry of the exception table: a kernel instruction that may
+   fault on a user address, and the address to resume at if it
+   does, with EAX set to -1.  A fault in the kernel anywhere else
+   is a kernel bug.  EX_TABLE adds an entry from inline assembly,
+   given local labels on the instruction and the resume address. */
+struct exception_entry
+  {
+    uintptr_t insn;             /* Address of the instruction. */
+    uintptr_t fixup;            /* Address to resume at. */
+  };
+
+#define EX_TABLE(INSN, FIXUP)                           \
+        ".pushsection __ex_table, \"a\"\n\t"             \
+        ".long " #INSN ", " #FIXUP "\n\t"                 \
+        ".popsection\n\t"
+
 void exception_init (void);
 void exception_print_stats (void);
 
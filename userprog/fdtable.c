@@ -0,0 +1,215 @@
+#include "userprog/fdtable.h"
+#include <debug.h>
+#include <limits.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+
+/* Bits per word of the bitmap. */
+#define FD_BITS 32
+
+/* Initial number of descriptors.  A multiple of FD_BITS. */
+#define FD_INIT_SIZE 32
+
+static bool grow(struct fd_table *t, int size);
+
+/**
+ * fd_alloc - install a file under the lowest free descriptor
+ *
+ * @t: file descriptor table
+ * @file: open file
+ *
+ * Descriptors 0 and 1 are the console, unless fd_install() puts a
+ * file there, and never allocated.  The search starts at the word
+ * of the free hint, so it usually takes a single step.  Return the
+ * new descriptor, or -1 if the table is full and cannot grow.
+*/
+int fd_alloc(struct fd_table *t, struct file *file)
+{
+	int w;
+
+	ASSERT(file != NULL);
+
+	if (t->size == 0 && !grow(t, FD_INIT_SIZE))
+		return -1;
+
+	for (w = t->free_hint / FD_BITS;; w++) {
+		int fd;
+
+		if (w == t->size / FD_BITS && !grow(t, t->size * 2))
+			return -1;
+		if (t->used[w] == UINT32_MAX)
+			continue;
+
+		fd = w * FD_BITS + __builtin_ctz(~t->used[w]);
+		t->used[w] |= 1u << (fd % FD_BITS);
+		t->files[fd] = file;
+		t->free_hint = fd + 1;
+		return fd;
+	}
+}
+
+/**
+ * fd_install - install a file under a given descriptor
+ *
+ * @t: file descriptor table
+ * @fd: free file descriptor, or 0 or 1 to redirect the console
+ * @file: open file
+ *
+ * Return false if the table cannot grow to hold the descriptor.
+*/
+bool fd_install(struct fd_table *t, int fd, struct file *file)
+{
+	ASSERT(fd >= 0 && file != NULL);
+	ASSERT(fd_get(t, fd) == NULL);
+
+	if (fd > INT_MAX - FD_BITS)
+		return false;
+	if (fd >= t->size && !grow(t, ROUND_UP(fd + 1, FD_BITS)))
+		return false;
+
+	t->used[fd / FD_BITS] |= 1u << (fd % FD_BITS);
+	t->files[fd] = file;
+	return true;
+}
+
+/**
+ * fd_get - look up a file descriptor
+ *
+ * @t: file descriptor table
+ * @fd: file descriptor
+ *
+ * Return the open file of the given descriptor, or a null pointer
+ * if it is not open.
+*/
+struct file *fd_get(const struct fd_table *t, int fd)
+{
+	if (fd < 0 || fd >= t->size)
+		return NULL;
+	return t->files[fd];
+}
+
+/**
+ * fd_free - release a file descriptor
+ *
+ * @t: file descriptor table
+ * @fd: file descriptor
+ *
+ * Return the file the descriptor referred to, which the caller
+ * should close, or a null pointer if it was not open.  Freeing a
+ * redirected descriptor 0 or 1 gives it back to the console.
+*/
+struct file *fd_free(struct fd_table *t, int fd)
+{
+	struct file *file = fd_get(t, fd);
+
+	if (file != NULL) {
+		t->files[fd] = NULL;
+		if (fd > STDOUT_FILENO) {
+			t->used[fd / FD_BITS] &= ~(1u << (fd % FD_BITS));
+			if (fd < t->free_hint)
+				t->free_hint = fd;
+		}
+	}
+	return file;
+}
+
+/**
+ * fd_table_copy - duplicate a file descriptor table
+ *
+ * @dst: empty table to fill in
+ * @src: table to copy
+ *
+ * Every open file of @src is reopened under the same descriptor in
+ * @dst, at the same position.  Return true if successful.  On
+ * failure @dst holds the files copied so far and should be
+ * destroyed.
+*/
+bool fd_table_copy(struct fd_table *dst, const struct fd_table *src)
+{
+	int w;
+
+	ASSERT(dst->size == 0);
+
+	if (src->size == 0)
+		return true;
+	if (!grow(dst, src->size))
+		return false;
+
+	for (w = 0; w < src->size / FD_BITS; w++) {
+		uint32_t bits = src->used[w];
+
+		while (bits != 0) {
+			int fd = w * FD_BITS + __builtin_ctz(bits);
+			struct file *file;
+
+			bits &= bits - 1;
+			if (src->files[fd] == NULL)
+				continue;
+
+			file = file_reopen(src->files[fd]);
+			if (file == NULL)
+				return false;
+			file_seek(file, file_tell(src->files[fd]));
+			dst->files[fd] = file;
+			dst->used[w] |= 1u << (fd % FD_BITS);
+		}
+	}
+	dst->free_hint = src->free_hint;
+	return true;
+}
+
+/**
+ * fd_table_destroy - close every file in a table and free it
+ *
+ * @t: file descriptor table, left empty
+*/
+void fd_table_destroy(struct fd_table *t)
+{
+	int fd;
+
+	for (fd = 0; fd < t->size; fd++)
+		if (t->files[fd] != NULL)
+			file_close(t->files[fd]);
+	free(t->files);
+	free(t->used);
+	memset(t, 0, sizeof *t);
+}
+
+/**
+ * grow - enlarge a file descriptor table
+ *
+ * @t: file descriptor table
+ * @size: new number of descriptors, a multiple of FD_BITS
+ *
+ * Zero the new slots.  A new table gets descriptors 0 and 1 marked
+ * in use.  Return false if out of memory, leaving @t's size
+ * unchanged.
+*/
+static bool grow(struct fd_table *t, int size)
+{
+	struct file **files;
+	uint32_t *used;
+
+	ASSERT(size > t->size && size % FD_BITS == 0);
+
+	files = realloc(t->files, size * sizeof *files);
+	if (files == NULL)
+		return false;
+	t->files = files;
+	memset(files + t->size, 0, (size - t->size) * sizeof *files);
+
+	used = realloc(t->used, size / FD_BITS * sizeof *used);
+	if (used == NULL)
+		return false;
+	t->used = used;
+	memset(used + t->size / FD_BITS, 0,
+	       (size - t->size) / FD_BITS * sizeof *used);
+
+	if (t->size == 0)
+		used[0] = 0x3;
+	t->size = size;
+	return true;
+}
@@ -0,0 +1,28 @@
+#ifndef USERPROG_FDTABLE_H
+#define USERPROG_FDTABLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct file;
+
+/* A process's file descriptor table: its open files, indexed by
+   file descriptor, with a bitmap of the descriptors in use.  Both
+   arrays grow on demand.  An all-zero table is a valid empty
+   table. */
+struct fd_table
+  {
+    struct file **files;        /* Open files, NULL where free. */
+    uint32_t *used;             /* Bitmap of descriptors in use. */
+    int size;                   /* Descriptors the arrays have room for. */
+    int free_hint;              /* No free descriptor below this one. */
+  };
+
+int fd_alloc (struct fd_table *, struct file *);
+bool fd_install (struct fd_table *, int fd, struct file *);
+struct file *fd_get (const struct fd_table *, int fd);
+struct file *fd_free (struct fd_table *, int fd);
+bool fd_table_copy (struct fd_table *dst, const struct fd_table *src);
+void fd_table_destroy (struct fd_table *);
+
+#endif /* userprog/fdtable.h */
@@ -0,0 +1,262 @@
+#include "userprog/fpu.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/slab.h"
+#include "threads/thread.h"
+
+/* Floating-point unit for user programs.
+
+   The kernel is built without floating point, so only user code
+   touches the FPU and its SSE registers.  Their state is saved
+   and restored lazily: the FPU holds the state of one thread, its
+   owner, and a context switch to any other thread merely sets
+   CR0.TS, so that the thread's first FPU instruction traps with
+   #NM.  Only then is the owner's state saved and the thread's
+   restored, and the thread becomes the owner.  A thread that never
+   uses the FPU never pays for it, and neither does one that is
+   the only user of it, however often it is switched out.
+
+   A thread's state is allocated on its first use of the FPU,
+   starting as a copy of the state the FPU had at boot.  It is an
+   FXSAVE area, or an FNSAVE one on a CPU without FXSR. */
+
+/* CR0 bits.  See [IA32-v3a] 2.5 "Control Registers". */
+#define CR0_MP 0x00000002       /* Monitor coprocessor: WAIT traps on TS. */
+#define CR0_EM 0x00000004       /* Emulation: FPU instructions trap. */
+#define CR0_TS 0x00000008       /* Task switched: FPU use traps. */
+#define CR0_NE 0x00000020       /* Numeric error: report with #MF. */
+
+/* CR4 bits. */
+#define CR4_OSFXSR 0x00000200   /* FXSAVE, FXRSTOR and SSE enabled. */
+#define CR4_OSXMMEXCPT 0x00000400 /* SSE errors reported with #XF. */
+
+/* CPUID function 1 EDX bits. */
+#define CPUID_FXSR (1u << 24)   /* FXSAVE and FXRSTOR. */
+#define CPUID_SSE (1u << 25)    /* SSE. */
+
+/* Size of an FXSAVE area, which must be 16-byte aligned, and of
+   the smaller FNSAVE area used without FXSR. */
+#define FPU_AREA_SIZE 512
+
+/* Saved FPU state of a thread.  Objects of a cache are only
+   word-aligned, so the area starts at the first 16-byte boundary
+   within. */
+struct fpu_state {
+	uint8_t buf[FPU_AREA_SIZE + 15];
+};
+
+static struct kmem_cache *fpu_cache;
+static struct fpu_state initial_state;
+static bool has_fxsr;
+
+/* Thread whose state the FPU holds, or NULL. */
+static struct thread *fpu_owner;
+
+static inline uint32_t read_cr0(void)
+{
+	uint32_t cr0;
+
+	asm volatile("movl %%cr0, %0" : "=r" (cr0));
+	return cr0;
+}
+
+static inline void write_cr0(uint32_t cr0)
+{
+	asm volatile("movl %0, %%cr0" : : "r" (cr0));
+}
+
+static inline void clts(void)
+{
+	asm volatile("clts");
+}
+
+static inline void stts(void)
+{
+	write_cr0(read_cr0() | CR0_TS);
+}
+
+/* Returns the aligned save area of S. */
+static void *area(struct fpu_state *s)
+{
+	return (void *)ROUND_UP((uintptr_t)s->buf, 16);
+}
+
+/* Saves the FPU's state in S.  TS must be clear. */
+static void save(struct fpu_state *s)
+{
+	if (has_fxsr)
+		asm volatile("fxsave (%0)" : : "r" (area(s)) : "memory");
+	else
+		asm volatile("fnsave (%0)" : : "r" (area(s)) : "memory");
+}
+
+/* Loads the FPU's state from S.  TS must be clear. */
+static void restore(struct fpu_state *s)
+{
+	if (has_fxsr)
+		asm volatile("fxrstor (%0)" : : "r" (area(s)) : "memory");
+	else
+		asm volatile("frstor (%0)" : : "r" (area(s)) : "memory");
+}
+
+/**
+ * fpu_init - enable the FPU for user programs
+ *
+ * Turn off the emulation that boot set up in CR0, enable SSE if the
+ * CPU has it, and record the FPU's initial state.  The FPU is left
+ * unowned and trapping.
+*/
+void fpu_init(void)
+{
+	uint32_t eax = 1, ebx, ecx, edx;
+
+	fpu_cache = kmem_cache_create("fpu", sizeof(struct fpu_state),
+				      NULL);
+	if (fpu_cache == NULL)
+		PANIC("fpu_init: out of memory");
+
+	asm("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+	has_fxsr = (edx & CPUID_FXSR) != 0;
+	if (has_fxsr) {
+		uint32_t cr4;
+
+		asm volatile("movl %%cr4, %0" : "=r" (cr4));
+		cr4 |= CR4_OSFXSR;
+		if (edx & CPUID_SSE)
+			cr4 |= CR4_OSXMMEXCPT;
+		asm volatile("movl %0, %%cr4" : : "r" (cr4));
+	}
+
+	write_cr0((read_cr0() & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE);
+	asm volatile("fninit");
+	save(&initial_state);
+	stts();
+}
+
+/**
+ * fpu_trap - give the FPU to the current thread
+ *
+ * Handle #NM, raised by the current thread's use of the FPU while
+ * another thread owns it: save the owner's state and load the
+ * current thread's, allocating it on first use.  Return false if
+ * memory is not available.
+*/
+bool fpu_trap(void)
+{
+	struct thread *t = thread_current();
+	enum intr_level old_level;
+
+	if (t->fpu == NULL) {
+		struct fpu_state *s = kmem_cache_alloc(fpu_cache);
+
+		if (s == NULL)
+			return false;
+		memcpy(area(s), area(&initial_state), FPU_AREA_SIZE);
+		t->fpu = s;
+	}
+
+	/* Switching threads sets TS again, so the ownership must not
+	   change until we are done. */
+	old_level = intr_disable();
+	clts();
+	if (fpu_owner != t) {
+		if (fpu_owner != NULL)
+			save(fpu_owner->fpu);
+		restore(t->fpu);
+		fpu_owner = t;
+	}
+	intr_set_level(old_level);
+	return true;
+}
+
+/**
+ * fpu_switch - prepare the FPU for the current thread
+ *
+ * Called on every context switch: let the current thread use the
+ * FPU freely if it owns it, or have its first use trap otherwise.
+*/
+void fpu_switch(void)
+{
+	if (fpu_owner == thread_current())
+		clts();
+	else
+		stts();
+}
+
+/**
+ * fpu_fork - inherit the FPU state of a forking thread
+ *
+ * @parent: thread that called fork(), blocked meanwhile
+ *
+ * Give the current thread, new, a copy of the FPU state of the
+ * given thread, if it has one.  Return false if memory is not
+ * available.
+*/
+bool fpu_fork(struct thread *parent)
+{
+	struct thread *t = thread_current();
+	enum intr_level old_level;
+
+	if (parent->fpu == NULL)
+		return true;
+	t->fpu = kmem_cache_alloc(fpu_cache);
+	if (t->fpu == NULL)
+		return false;
+
+	/* The parent's latest state may still be in the FPU.  Saving it
+	   leaves the FPU unowned, as FNSAVE also resets it. */
+	old_level = intr_disable();
+	if (fpu_owner == parent) {
+		clts();
+		save(parent->fpu);
+		fpu_owner = NULL;
+		stts();
+	}
+	intr_set_level(old_level);
+
+	memcpy(area(t->fpu), area(parent->fpu), FPU_AREA_SIZE);
+	return true;
+}
+
+/**
+ * fpu_exit - release the FPU state of the current thread
+*/
+void fpu_exit(void)
+{
+	struct thread *t = thread_current();
+	enum intr_level old_level;
+
+	old_level = intr_disable();
+	if (fpu_owner == t) {
+		fpu_owner = NULL;
+		stts();
+	}
+	intr_set_level(old_level);
+
+	if (t->fpu != NULL) {
+		kmem_cache_free(fpu_cache, t->fpu);
+		t->fpu = NULL;
+	}
+}
+
+/**
+ * fpu_release - save the FPU's state to its owner
+ *
+ * Save the owner's state, if any, and leave the FPU unowned and
+ * trapping, so that the registers hold nothing that memory does
+ * not.  Called with interrupts off before memory is snapshotted.
+*/
+void fpu_release(void)
+{
+	ASSERT(intr_get_level() == INTR_OFF);
+
+	if (fpu_owner != NULL) {
+		clts();
+		save(fpu_owner->fpu);
+		fpu_owner = NULL;
+	}
+	stts();
+}
@@ -0,0 +1,15 @@
+#ifndef USERPROG_FPU_H
+#define USERPROG_FPU_H
+
+#include <stdbool.h>
+
+struct thread;
+
+void fpu_init (void);
+bool fpu_trap (void);
+void fpu_switch (void);
+bool fpu_fork (struct thread *parent);
+void fpu_exit (void);
+void fpu_release (void);
+
+#endif /* userprog/fpu.h */
@@ -0,0 +1,174 @@
+#include "userprog/futex.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "userprog/process.h"
+
+/* Fast user-space mutexes.  User programs keep their lock state
+   in ordinary memory and update it with atomic instructions,
+   entering the kernel only to sleep when the state says a lock
+   is taken, or to wake sleepers when it says there are some.
+
+   Sleepers wait in a hash table of wait queues, keyed by the
+   physical address of the word they sleep on, so that every
+   mapping of the same memory finds the same queue.  The word's
+   page must stay put for the key to stay meaningful, so the
+   caller keeps it pinned, and private, for as long as the
+   thread sleeps.
+
+   A process that is exiting wakes all of its threads at once, with
+   futex_wake_process(), and its threads no longer go to sleep. */
+
+/* Number of hash buckets.  A power of 2. */
+#define FUTEX_BUCKETS 64
+
+/* A hash bucket: the threads sleeping on words that hash to it. */
+struct futex_bucket
+  {
+    struct lock lock;           /* Protects WAITERS. */
+    struct list waiters;        /* List of struct futex_waiter. */
+  };
+
+/* A thread sleeping in futex_wait(), on its own stack. */
+struct futex_waiter
+  {
+    struct list_elem elem;      /* Element in bucket's WAITERS list. */
+    uintptr_t key;              /* Physical address slept on. */
+    struct thread *proc;        /* Process of the sleeping thread. */
+    struct semaphore woken;     /* Upped by futex_wake(). */
+  };
+
+static struct futex_bucket buckets[FUTEX_BUCKETS];
+
+/* Initializes the futex wait queues. */
+void
+futex_init (void)
+{
+  struct futex_bucket *b;
+
+  for (b = buckets; b < buckets + FUTEX_BUCKETS; b++)
+    {
+      lock_init (&b->lock);
+      list_init (&b->waiters);
+    }
+}
+
+/* Returns the bucket of KEY. */
+static struct futex_bucket *
+bucket_of (uintptr_t key)
+{
+  return &buckets[hash_int (key) & (FUTEX_BUCKETS - 1)];
+}
+
+/**
+ * futex_wait - sleep on a word while it holds a value
+ *
+ * @addr: kernel address of an aligned word of user memory, pinned
+ * @val: value the word is expected to hold
+ *
+ * Check that the given word holds the given value and, if so, sleep
+ * until futex_wake() is called on it.  The check and going to sleep
+ * are atomic with respect to futex_wake(), so a wake-up that follows
+ * a change of the word is never missed.
+ * Return 0 once woken, or -1 at once if the word held another value
+ * or the process is exiting.
+*/
+int futex_wait(const uint32_t *addr, uint32_t val)
+{
+	struct futex_waiter w;
+	struct futex_bucket *b;
+
+	ASSERT((uintptr_t)addr % sizeof *addr == 0);
+
+	w.key = vtop(addr);
+	w.proc = process_current();
+	sema_init(&w.woken, 0);
+	b = bucket_of(w.key);
+
+	lock_acquire(&b->lock);
+	if (*(volatile const uint32_t *)addr != val || w.proc->dying) {
+		lock_release(&b->lock);
+		return -1;
+	}
+	list_push_back(&b->waiters, &w.elem);
+	lock_release(&b->lock);
+
+	sema_down(&w.woken);
+	return 0;
+}
+
+/**
+ * futex_wake - wake threads sleeping on a word
+ *
+ * @addr: kernel address of an aligned word of user memory
+ * @cnt: most threads to wake
+ *
+ * Wake up to the given number of threads sleeping on the given word,
+ * in the order they went to sleep.
+ * Return the number of threads woken.
+*/
+int futex_wake(const uint32_t *addr, int cnt)
+{
+	struct futex_bucket *b;
+	struct list_elem *e, *next;
+	uintptr_t key;
+	int woken = 0;
+
+	ASSERT((uintptr_t)addr % sizeof *addr == 0);
+
+	key = vtop(addr);
+	b = bucket_of(key);
+
+	lock_acquire(&b->lock);
+	for (e = list_begin(&b->waiters);
+	     e != list_end(&b->waiters) && woken < cnt; e = next) {
+		struct futex_waiter *w = list_entry(e, struct futex_waiter,
+						    elem);
+
+		next = list_next(e);
+		if (w->key != key)
+			continue;
+		list_remove(&w->elem);
+		sema_up(&w->woken);
+		woken++;
+	}
+	lock_release(&b->lock);
+	return woken;
+}
+
+/**
+ * futex_wake_process - wake every sleeping thread of a process
+ *
+ * @proc: first thread of a process, already marked as dying
+ *
+ * Wake every thread of the given process sleeping on any word.  Since
+ * futex_wait() checks the mark under the bucket lock, a thread about
+ * to sleep either is woken here or does not sleep at all.
+*/
+void futex_wake_process(const struct thread *proc)
+{
+	struct futex_bucket *b;
+
+	ASSERT(proc->dying);
+
+	for (b = buckets; b < buckets + FUTEX_BUCKETS; b++) {
+		struct list_elem *e, *next;
+
+		lock_acquire(&b->lock);
+		for (e = list_begin(&b->waiters); e != list_end(&b->waiters);
+		     e = next) {
+			struct futex_waiter *w = list_entry(e,
+							    struct futex_waiter,
+							    elem);
+
+			next = list_next(e);
+			if (w->proc != proc)
+				continue;
+			list_remove(&w->elem);
+			sema_up(&w->woken);
+		}
+		lock_release(&b->lock);
+	}
+}
@@ -0,0 +1,13 @@
+#ifndef USERPROG_FUTEX_H
+#define USERPROG_FUTEX_H
+
+#include <stdint.h>
+
+struct thread;
+
+void futex_init (void);
+int futex_wait (const uint32_t *, uint32_t val);
+int futex_wake (const uint32_t *, int cnt);
+void futex_wake_process (const struct thread *proc);
+
+#endif /* userprog/futex.h */
@@ -1,54 +1,189 @@
 #include "userprog/pagedir.h"
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
+#include <vdso.h>
+#include "devices/timer.h"
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/thread.h"
 
+/* TLB invalidation statistics. */
+static long long invlpg_cnt;    /* Single pages invalidated. */
+static long long flush_cnt;     /* Full flushes for batches. */
+static long long skip_cnt;      /* Changes to inactive directories. */
+static long long reload_cnt;    /* Page directory loads. */
+static long long lazy_cnt;      /* Loads skipped, directory active. */
+
+/* Large page statistics. */
+static long long large_cnt;     /* 4 MB user pages mapped. */
+static long long split_cnt;     /* Split into 4 kB pages. */
+
+/* A 4 MB page of user memory mapped by a single PDE, and the page
+   table set aside to map the same memory with 4 kB pages when it
+   has to be split. */
+struct large_slot
+  {
+    uint32_t pde_no;            /* Index of the PDE. */
+    uint32_t *pt;               /* Page table, or NULL if slot free. */
+  };
+
+/* The slots follow the PTE counts, in the second half of their
+   page. */
+#define LARGE_SLOTS (PGSIZE / 2 / sizeof (struct large_slot))
+
+/* True if invalidations deferred by a batch are still owed, to be
+   done by the next load of a page directory.  This belongs to the
+   CPU rather than to the thread that deferred them, since another
+   thread of its process may run in the same page directory before
+   the batch ends. */
+static bool tlb_stale;
+
+static uint16_t *pt_counts (uint32_t *pd);
+static struct large_slot *large_slots (uint32_t *pd);
+static uint32_t *large_pde (uint32_t *pd, const void *vaddr);
+static void split_large (uint32_t *pd, uint32_t *pde);
 static uint32_t *active_pd (void);
-static void invalidate_pagedir (uint32_t *);
+static void invalidate_page (uint32_t *, const void *vpage);
+static void invalidate_range (uint32_t *, const void *vpage,
+                              size_t page_cnt);
+
+/* Ranges of more pages than this are invalidated by one flush of
+   the whole TLB rather than page by page. */
+#define INVLPG_MAX 32
 
 /* Creates a new page directory that has mappings for kernel
-   virtual addresses, but none for user virtual addresses.
+   virtual addresses, and for user virtual addresses only the
+   timer's shared page, read-only at VDSO_ADDR.
    Returns the new page directory, or a null pointer if memory
-   allocation fails. */
+   allocation fails.
+
+   The page directory is followed by a page of counts of the
+   present PTEs in each of its page tables (see pt_counts()), so
+   that empty page tables can be freed as soon as their last page
+   is unmapped, and of the slots of its 4 MB pages (see
+   pagedir_set_large()). */
 uint32_t *
 pagedir_create (void) 
 {
-  uint32_t *pd = palloc_get_page (0);
+  uint32_t *pd = palloc_get_multiple (0, 2);
   if (pd != NULL)
-    memcpy (pd, init_page_dir, PGSIZE);
+    {
+      memcpy (pd, init_page_dir, PGSIZE);
+      memset (pt_counts (pd), 0, PGSIZE);
+      if (!pagedir_set_page (pd, VDSO_ADDR, timer_vdso_page (), false))
+        {
+          palloc_free_multiple (pd, 2);
+          return NULL;
+        }
+    }
   return pd;
 }
 
 /* Destroys page directory PD, freeing all the pages it
-   references. */
+   references.  Only present page tables are scanned, and each
+   only up to its last present PTE, so the cost follows the
+   number of mapped pages rather than the size of the address
+   space. */
 void
 pagedir_destroy (uint32_t *pd) 
 {
+  uint16_t *counts;
   uint32_t *pde;
+  size_t i;
 
   if (pd == NULL)
     return;
 
   ASSERT (pd != init_page_dir);
+  ASSERT (pd != active_pd ());
+  /* The shared page belongs to the timer. */
+  pagedir_clear_page (pd, VDSO_ADDR);
+  counts = pt_counts (pd);
   for (pde = pd; pde < pd + pd_no (PHYS_BASE); pde++)
-    if (*pde & PTE_P) 
+    if (*pde & PTE_PS)
+      palloc_free_multiple (pte_get_page (*pde), 1 << PTBITS);
+    else if (*pde & PTE_P) 
       {
         uint32_t *pt = pde_get_pt (*pde);
+        size_t cnt = counts[pde - pd];
         uint32_t *pte;
         
-        for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
+        for (pte = pt; cnt > 0; pte++)
           if (*pte & PTE_P) 
-            palloc_free_page (pte_get_page (*pte));
+            {
+              palloc_free_page (pte_get_page (*pte));
+              cnt--;
+            }
         palloc_free_page (pt);
+        thread_cond_yield ();
       }
-  palloc_free_page (pd);
+  for (i = 0; i < LARGE_SLOTS; i++)
+    palloc_free_page (large_slots (pd)[i].pt);
+  palloc_free_multiple (pd, 2);
+}
+
+/* Returns the array of counts of present PTEs, indexed by page
+   directory index, that follows PD. */
+static uint16_t *
+pt_counts (uint32_t *pd)
+{
+  return (uint16_t *) (pd + PGSIZE / sizeof *pd);
+}
+
+/* Returns the slots of PD's 4 MB pages, which follow its counts
+   of present PTEs. */
+static struct large_slot *
+large_slots (uint32_t *pd)
+{
+  return (struct large_slot *) (pt_counts (pd) + (1 << PDBITS));
+}
+
+/* Returns the PDE of PD that maps user virtual address VADDR as
+   part of a 4 MB page, or a null pointer if VADDR is not in
+   one. */
+static uint32_t *
+large_pde (uint32_t *pd, const void *vaddr)
+{
+  uint32_t *pde = pd + pd_no (vaddr);
+
+  ASSERT (is_user_vaddr (vaddr));
+  return (*pde & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS) ? pde : NULL;
+}
+
+/* Replaces PDE, which maps a 4 MB page of user memory in PD, by
+   the page table set aside for it, mapping the same memory with
+   the same permissions and accessed and dirty bits in 4 kB
+   pages, which may then be changed one at a time. */
+static void
+split_large (uint32_t *pd, uint32_t *pde)
+{
+  uint32_t flags = *pde & (PTE_P | PTE_W | PTE_U | PTE_A | PTE_D);
+  uint32_t addr = *pde & PTE_ADDR;
+  struct large_slot *s = large_slots (pd);
+  enum intr_level old_level;
+  size_t i;
+
+  while (s->pt == NULL || s->pde_no != (uint32_t) (pde - pd))
+    s++;
+  for (i = 0; i < 1 << PTBITS; i++)
+    s->pt[i] = (addr + i * PGSIZE) | flags;
+
+  old_level = intr_disable ();
+  pt_counts (pd)[pde - pd] = 1 << PTBITS;
+  *pde = pde_create (s->pt);
+  s->pt = NULL;
+  invalidate_page (pd, (void *) ((pde - pd) << PDSHIFT));
+  intr_set_level (old_level);
+  split_cnt++;
 }
 
 /* Returns the address of the page table entry for virtual
-   address VADDR in page directory PD.
+   address VADDR in page directory PD, first splitting the 4 MB
+   page VADDR lies in, if any.
    If PD does not have a page table for VADDR, behavior depends
    on CREATE.  If CREATE is true, then a new page table is
    created and a pointer into it is returned.  Otherwise, a null
@@ -66,6 +201,8 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
   /* Check for a page table for VADDR.
      If one is missing, create one if requested. */
   pde = pd + pd_no (vaddr);
+  if ((*pde & PTE_PS) && is_user_vaddr (vaddr))
+    split_large (pd, pde);
   if (*pde == 0) 
     {
       if (create)
@@ -98,6 +235,7 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
 bool
 pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool writable)
 {
+  enum intr_level old_level;
   uint32_t *pte;
 
   ASSERT (pg_ofs (upage) == 0);
@@ -106,16 +244,90 @@ pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool writable)
   ASSERT (vtop (kpage) >> PTSHIFT < init_ram_pages);
   ASSERT (pd != init_page_dir);
 
+  /* Keep an eviction in another thread from freeing the page
+     table between the lookup and the update. */
+  old_level = intr_disable ();
   pte = lookup_page (pd, upage, true);
-
   if (pte != NULL) 
     {
       ASSERT ((*pte & PTE_P) == 0);
       *pte = pte_create_user (kpage, writable);
-      return true;
+      pt_counts (pd)[pd_no (upage)]++;
     }
-  else
-    return false;
+  intr_set_level (old_level);
+
+  return pte != NULL;
+}
+
+/**
+ * pagedir_set_large - map 4 MB of user memory with a single PDE
+ *
+ * @pd: the page directory
+ * @upage: user virtual address, aligned to 4 MB, none of whose
+ *         4 MB is mapped
+ * @kpage: kernel virtual address of 1024 pages of the user pool,
+ *         aligned to 4 MB
+ * @writable: whether the user may write the pages
+ *
+ * Map the given memory as one large page, which takes one TLB entry
+ * and no page table.  A later change to the mapping of any of its
+ * pages, through any function here, first splits it back into 4 kB
+ * pages, with a page table set aside now, so that splitting never
+ * fails.  Return false if the CPU lacks large pages, part of the
+ * range is mapped, or memory is not available.
+*/
+bool pagedir_set_large(uint32_t *pd, void *upage, void *kpage, bool writable)
+{
+	struct large_slot *s = large_slots(pd);
+	enum intr_level old_level;
+	size_t i;
+
+	ASSERT((uintptr_t)upage % PTSPAN == 0);
+	ASSERT(is_user_vaddr(upage));
+	ASSERT(pd != init_page_dir);
+
+	if (!init_large_pages || pd[pd_no(upage)] != 0)
+		return false;
+	for (i = 0; i < LARGE_SLOTS && s[i].pt != NULL; i++)
+		continue;
+	if (i == LARGE_SLOTS)
+		return false;
+	s[i].pt = palloc_get_page(0);
+	if (s[i].pt == NULL)
+		return false;
+	s[i].pde_no = pd_no(upage);
+
+	/* The PDE was not present, so no TLB entry needs invalidating. */
+	old_level = intr_disable();
+	pd[pd_no(upage)] = pde_create_large(kpage, writable) | PTE_U;
+	intr_set_level(old_level);
+	large_cnt++;
+	return true;
+}
+
+/**
+ * pagedir_range_free - check that 4 MB of user memory is unmapped
+ *
+ * @pd: the page directory
+ * @upage: user virtual address, aligned to 4 MB
+*/
+bool pagedir_range_free(uint32_t *pd, const void *upage)
+{
+	ASSERT((uintptr_t)upage % PTSPAN == 0);
+	ASSERT(is_user_vaddr(upage));
+
+	return pd[pd_no(upage)] == 0;
+}
+
+/**
+ * pagedir_is_large - check whether a user page is part of a 4 MB page
+ *
+ * @pd: the page directory
+ * @upage: user virtual address
+*/
+bool pagedir_is_large(uint32_t *pd, const void *upage)
+{
+	return large_pde(pd, upage) != NULL;
 }
 
 /* Looks up the physical address that corresponds to user virtual
@@ -128,6 +340,10 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
   uint32_t *pte;
 
   ASSERT (is_user_vaddr (uaddr));
+
+  pte = large_pde (pd, uaddr);
+  if (pte != NULL)
+    return pte_get_page (*pte) + ((uintptr_t) uaddr & (PTSPAN - 1));
   
   pte = lookup_page (pd, uaddr, false);
   if (pte != NULL && (*pte & PTE_P) != 0)
@@ -136,24 +352,211 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
     return NULL;
 }
 
+/* Points the mapping of user virtual page UPAGE in page
+   directory PD, which must be present, at the physical frame
+   identified by kernel virtual address KPAGE instead, keeping
+   its permissions and marking it dirty.  Unlike clearing the
+   mapping and setting it again, this cannot free the page table
+   or need memory for a new one. */
+void
+pagedir_replace_page (uint32_t *pd, const void *upage, void *kpage)
+{
+  enum intr_level old_level;
+  uint32_t *pte;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (pg_ofs (kpage) == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (vtop (kpage) >> PTSHIFT < init_ram_pages);
+
+  old_level = intr_disable ();
+  pte = lookup_page (pd, upage, false);
+  ASSERT (pte != NULL && (*pte & PTE_P) != 0);
+  *pte = vtop (kpage) | (*pte & PTE_FLAGS) | PTE_D;
+  invalidate_page (pd, upage);
+  intr_set_level (old_level);
+}
+
 /* Marks user virtual page UPAGE "not present" in page
    directory PD.  Later accesses to the page will fault.  Other
-   bits in the page table entry are preserved.
+   bits in the page table entry are preserved, unless UPAGE was
+   the last present page of its page table, which is then
+   freed.
    UPAGE need not be mapped. */
 void
 pagedir_clear_page (uint32_t *pd, void *upage) 
 {
+  enum intr_level old_level;
   uint32_t *pte;
 
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (is_user_vaddr (upage));
 
+  old_level = intr_disable ();
   pte = lookup_page (pd, upage, false);
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
+      uint16_t *cnt = &pt_counts (pd)[pd_no (upage)];
+
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      if (--*cnt == 0)
+        {
+          /* Invalidating UPAGE also drops the CPU's cached copy
+             of its PDE.  See [IA32-v3a] 4.10.4.1 "Operations that
+             Invalidate TLBs and Paging-Structure Caches". */
+          palloc_free_page (pde_get_pt (pd[pd_no (upage)]));
+          pd[pd_no (upage)] = 0;
+        }
+      invalidate_page (pd, upage);
+    }
+  intr_set_level (old_level);
+}
+
+/* Returns the number of pages, up to PAGE_CNT, from VADDR to the
+   end of the page table that maps it. */
+static size_t
+pt_run (const void *vaddr, size_t page_cnt)
+{
+  size_t left = (1 << PTBITS) - pt_no (vaddr);
+
+  return page_cnt < left ? page_cnt : left;
+}
+
+/* Maps the PAGE_CNT user virtual pages starting at UPAGE in page
+   directory PD to the as many consecutive kernel pages starting
+   at KPAGE, writable if WRITABLE is true.  None of the pages may
+   already be mapped.  Fills in each page table's PTEs directly,
+   looking the table up only once.  Returns true if successful,
+   or false, with no page mapped, if memory allocation failed. */
+bool
+pagedir_map_range (uint32_t *pd, void *upage, void *kpage,
+                   size_t page_cnt, bool writable)
+{
+  uint8_t *uaddr = upage;
+  uint8_t *kaddr = kpage;
+  size_t done = 0;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (pg_ofs (kpage) == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (page_cnt <= ((uintptr_t) PHYS_BASE - (uintptr_t) upage) / PGSIZE);
+  ASSERT ((vtop (kpage) >> PTSHIFT) + page_cnt <= init_ram_pages);
+  ASSERT (pd != init_page_dir);
+
+  while (done < page_cnt)
+    {
+      size_t n = pt_run (uaddr, page_cnt - done);
+      enum intr_level old_level;
+      uint32_t *pte;
+      size_t i;
+
+      /* As in pagedir_set_page(). */
+      old_level = intr_disable ();
+      pte = lookup_page (pd, uaddr, true);
+      if (pte == NULL)
+        {
+          intr_set_level (old_level);
+          pagedir_unmap_range (pd, upage, done);
+          return false;
+        }
+      for (i = 0; i < n; i++)
+        {
+          ASSERT ((pte[i] & PTE_P) == 0);
+          pte[i] = pte_create_user (kaddr + i * PGSIZE, writable);
+        }
+      pt_counts (pd)[pd_no (uaddr)] += n;
+      intr_set_level (old_level);
+
+      done += n;
+      uaddr += n * PGSIZE;
+      kaddr += n * PGSIZE;
+    }
+  return true;
+}
+
+/* Marks the PAGE_CNT user virtual pages starting at UPAGE "not
+   present" in page directory PD, as pagedir_clear_page() does
+   for each, freeing page tables left empty, and then invalidates
+   their TLB entries all at once.  The pages need not be
+   mapped. */
+void
+pagedir_unmap_range (uint32_t *pd, void *upage, size_t page_cnt)
+{
+  enum intr_level old_level;
+  uint8_t *uaddr = upage;
+  size_t done;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (page_cnt <= ((uintptr_t) PHYS_BASE - (uintptr_t) upage) / PGSIZE);
+
+  /* The freed page tables may still be cached by the CPU until
+     the invalidation, so nothing may run in between. */
+  old_level = intr_disable ();
+  for (done = 0; done < page_cnt; )
+    {
+      size_t n = pt_run (uaddr, page_cnt - done);
+      uint32_t *pte = lookup_page (pd, uaddr, false);
+
+      if (pte != NULL)
+        {
+          uint16_t *cnt = &pt_counts (pd)[pd_no (uaddr)];
+          size_t i;
+
+          for (i = 0; i < n; i++)
+            if (pte[i] & PTE_P)
+              {
+                pte[i] &= ~PTE_P;
+                --*cnt;
+              }
+          if (*cnt == 0)
+            {
+              palloc_free_page (pde_get_pt (pd[pd_no (uaddr)]));
+              pd[pd_no (uaddr)] = 0;
+            }
+        }
+      done += n;
+      uaddr += n * PGSIZE;
+    }
+  invalidate_range (pd, upage, page_cnt);
+  intr_set_level (old_level);
+}
+
+/* Sets the writable bit to WRITABLE in the PTEs of those of the
+   PAGE_CNT user virtual pages starting at UPAGE in PD that have
+   one, and then invalidates their TLB entries all at once. */
+void
+pagedir_protect_range (uint32_t *pd, void *upage, size_t page_cnt,
+                       bool writable)
+{
+  enum intr_level old_level;
+  uint8_t *uaddr = upage;
+  size_t done;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (page_cnt <= ((uintptr_t) PHYS_BASE - (uintptr_t) upage) / PGSIZE);
+
+  old_level = intr_disable ();
+  for (done = 0; done < page_cnt; )
+    {
+      size_t n = pt_run (uaddr, page_cnt - done);
+      uint32_t *pte = lookup_page (pd, uaddr, false);
+      size_t i;
+
+      if (pte != NULL)
+        for (i = 0; i < n; i++)
+          {
+            if (writable)
+              pte[i] |= PTE_W;
+            else
+              pte[i] &= ~(uint32_t) PTE_W;
+          }
+      done += n;
+      uaddr += n * PGSIZE;
     }
+  invalidate_range (pd, upage, page_cnt);
+  intr_set_level (old_level);
 }
 
 /* Returns true if the PTE for virtual page VPAGE in PD is dirty,
@@ -163,7 +566,10 @@ pagedir_clear_page (uint32_t *pd, void *upage)
 bool
 pagedir_is_dirty (uint32_t *pd, const void *vpage) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
+  uint32_t *pte = large_pde (pd, vpage);
+
+  if (pte == NULL)
+    pte = lookup_page (pd, vpage, false);
   return pte != NULL && (*pte & PTE_D) != 0;
 }
 
@@ -180,11 +586,27 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else 
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
 
+/* Sets the writable bit to WRITABLE in the PTE for virtual page
+   VPAGE in PD. */
+void
+pagedir_set_writable (uint32_t *pd, const void *vpage, bool writable)
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  if (pte != NULL)
+    {
+      if (writable)
+        *pte |= PTE_W;
+      else
+        *pte &= ~(uint32_t) PTE_W;
+      invalidate_page (pd, vpage);
+    }
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PD has been
    accessed recently, that is, between the time the PTE was
    installed and the last time it was cleared.  Returns false if
@@ -192,7 +614,10 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
 bool
 pagedir_is_accessed (uint32_t *pd, const void *vpage) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
+  uint32_t *pte = large_pde (pd, vpage);
+
+  if (pte == NULL)
+    pte = lookup_page (pd, vpage, false);
   return pte != NULL && (*pte & PTE_A) != 0;
 }
 
@@ -209,18 +634,26 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
       else 
         {
           *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
 
 /* Loads page directory PD into the CPU's page directory base
-   register. */
+   register, unless it is there already.  Loading it flushes the
+   TLB, so that is skipped, unless a batch owes a flush. */
 void
 pagedir_activate (uint32_t *pd) 
 {
   if (pd == NULL)
     pd = init_page_dir;
+  if (pd == active_pd () && !tlb_stale)
+    {
+      lazy_cnt++;
+      return;
+    }
+  tlb_stale = false;
+  reload_cnt++;
 
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
@@ -243,21 +676,106 @@ active_pd (void)
   return ptov (pd);
 }
 
-/* Seom page table changes can cause the CPU's translation
-   lookaside buffer (TLB) to become out-of-sync with the page
-   table.  When this happens, we have to "invalidate" the TLB by
-   re-activating it.
+/* Defers the TLB invalidations made by the current thread until
+   the matching call to pagedir_end_batch(), which does a single
+   full flush instead of one invlpg per page.  Meant for tearing
+   down many mappings at once, as munmap and exit do.  Batches
+   nest.
+
+   Deferring is safe because only the current thread's page
+   directory is ever active while it runs, the kernel does not
+   touch user pages it is unmapping, and switching to another
+   thread of the process does the flush if it is still owed. */
+void
+pagedir_begin_batch (void)
+{
+  thread_current ()->tlb_batch++;
+}
+
+/* Ends a batch begun by pagedir_begin_batch(), flushing the TLB
+   if any invalidation was deferred. */
+void
+pagedir_end_batch (void)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->tlb_batch > 0);
+  if (--t->tlb_batch == 0 && tlb_stale)
+    {
+      pagedir_activate (active_pd ());
+      flush_cnt++;
+    }
+}
 
-   This function invalidates the TLB if PD is the active page
-   directory.  (If PD is not active then its entries are not in
-   the TLB, so there is no need to invalidate anything.) */
+/* Prints TLB invalidation statistics. */
+void
+pagedir_print_stats (void)
+{
+  printf ("TLB: %lld pages invalidated, %lld batch flushes, "
+          "%lld inactive skipped\n", invlpg_cnt, flush_cnt, skip_cnt);
+  printf ("TLB: %lld page directory loads, %lld skipped as active\n",
+          reload_cnt, lazy_cnt);
+  printf ("TLB: %lld large user pages mapped, %lld split\n",
+          large_cnt, split_cnt);
+}
+
+/* Invalidates the TLB entries of the PAGE_CNT pages starting at
+   VPAGE, as invalidate_page() does for one: page by page for up
+   to INVLPG_MAX pages, or else by a single full flush. */
 static void
-invalidate_pagedir (uint32_t *pd) 
+invalidate_range (uint32_t *pd, const void *vpage, size_t page_cnt)
 {
-  if (active_pd () == pd) 
+  size_t i;
+
+  if (page_cnt <= INVLPG_MAX)
+    {
+      for (i = 0; i < page_cnt; i++)
+        invalidate_page (pd, (const uint8_t *) vpage + i * PGSIZE);
+      return;
+    }
+  if (active_pd () != pd)
+    {
+      skip_cnt++;
+      return;
+    }
+
+  /* Inside a batch the flush is left to pagedir_end_batch(). */
+  tlb_stale = true;
+  if (thread_current ()->tlb_batch == 0)
     {
-      /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
-         "Translation Lookaside Buffers (TLBs)". */
       pagedir_activate (pd);
-    } 
+      flush_cnt++;
+    }
+}
+
+/* Some page table changes can cause the CPU's translation
+   lookaside buffer (TLB) to become out-of-sync with the page
+   table.  When this happens, we have to "invalidate" the TLB
+   entry for the page that changed.
+
+   This function invalidates VPAGE's TLB entry if PD is the
+   active page directory.  (If PD is not active then its entries
+   are not in the TLB, so there is no need to invalidate
+   anything.)  Inside a batch the invalidation is left to
+   pagedir_end_batch(). */
+static void
+invalidate_page (uint32_t *pd, const void *vpage) 
+{
+  struct thread *t;
+
+  if (active_pd () != pd)
+    {
+      skip_cnt++;
+      return;
+    }
+
+  t = thread_current ();
+  if (t->tlb_batch > 0)
+    tlb_stale = true;
+  else
+    {
+      /* See [IA32-v2a] "INVLPG--Invalidate TLB Entry". */
+      asm volatile ("invlpg (%0)" : : "r" (vpage) : "memory");
+      invlpg_cnt++;
+    }
 }
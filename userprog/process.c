@@ -5,142 +5,413 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <vdso.h>
+#include "devices/input.h"
+#include "userprog/fdtable.h"
+#include "userprog/fpu.h"
+#include "userprog/futex.h"
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
+#include "userprog/syscall.h"
 #include "userprog/tss.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "filesys/pipe.h"
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/tunable.h"
 #include "threads/vaddr.h"
+#include "threads/workqueue.h"
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
+
+/* Header of the initial stack page of a new process, at the
+   bottom of the page.  process_execute() fills in the page, and
+   start_process() maps it at the top of the user stack. */
+struct exec_args
+  {
+    char *file_name;            /* Program name, in the page. */
+    void *esp;                  /* Initial user stack pointer. */
+    struct child_status *status; /* Status of the new process. */
+    bool has_fds;               /* Given its descriptors by spawn()? */
+    struct fd_table fds;        /* If so, its descriptors. */
+#ifdef VM
+    struct frame *frame;        /* Frame holding the page. */
+#endif
+  };
+
+/* Status of a child process, shared by the child and its parent.
+   The parent keeps the status of each of its children on a list
+   of its own until it waits for the child, and frees it then.  A
+   child whose parent exited first frees its own status. */
+struct child_status
+  {
+    tid_t tid;                  /* Child's thread id. */
+    int exit_code;              /* Exit code, once exited. */
+    bool exited;                /* Has the child exited? */
+    bool loaded;                /* Did the child start successfully? */
+    struct rusage rusage;       /* Its and its children's, once exited. */
+    struct thread *parent;      /* Parent, or NULL if it exited. */
+    struct list_elem elem;      /* Element in parent's children. */
+    struct list_elem exit_elem; /* In parent's exited_children. */
+    struct semaphore started;   /* Up once the child starts or fails. */
+    struct semaphore dead;      /* Upped when the child exits. */
+  };
+
+/* Protects every child_status and spawn_status, the lists they
+   are on, and the spawned threads' counts and stack slots. */
+static struct lock children_lock;
+
+static struct child_status *child_create (void);
+static int child_reap (struct child_status *);
+static void rusage_add (struct rusage *, const struct rusage *);
+static void child_exit (void);
 
 static thread_func start_process NO_RETURN;
-static bool load (const char *cmdline, void (**eip) (void), void **esp);
+#ifdef VM
+static thread_func start_fork NO_RETURN;
+static thread_func start_thread NO_RETURN;
+static void spawn_exit (void);
+static void spawn_wait_all (void);
+#endif
+static struct exec_args *alloc_args (void);
+static tid_t run_args (struct exec_args *, bool wait);
+static bool build_args (struct exec_args *, const char *cmdline);
+static bool build_argv (struct exec_args *, const char *file,
+                        const char *words, size_t len);
+static bool lay_out_args (struct exec_args *, char *words, size_t len,
+                          bool split);
+static void free_args (struct exec_args *);
+static bool load (struct exec_args *, void (**eip) (void), void **esp);
+
+/* Executable image cache.
+
+   Parsing an executable means reading and checking its ELF header
+   and every program header, so a program that is run over and
+   over is parsed over and over.  The cache keeps the result, the
+   entry point and the loadable segments, for the executables
+   loaded most recently, keyed by inode.  A cached image holds its
+   inode open and denies writes to it, but gives both up as soon
+   as the file is written to or removed, by process_uncache(), so
+   that neither fails nor keeps the file's sectors allocated
+   because of the cache.  It is also only used while the inode's
+   version matches the one it was parsed at.
+
+   The segments' pages themselves need no caching here: with VM,
+   read-only pages are shared between processes by the frame
+   table and read in on demand. */
+
+/* Number of images cached. */
+#define EXEC_CACHE_SIZE 8
+
+/* Maximum number of segments of a cached image. */
+#define EXEC_SEGS_MAX 8
+
+/* A loadable segment, as passed to load_segment(). */
+struct exec_segment
+  {
+    uint32_t ofs;               /* Page-aligned offset in the file. */
+    uint32_t upage;             /* Page-aligned user virtual address. */
+    uint32_t read_bytes;        /* Bytes to read from the file. */
+    uint32_t zero_bytes;        /* Bytes to zero after those read. */
+    bool writable;              /* Writable by the user process? */
+  };
+
+/* A parsed executable. */
+struct exec_image
+  {
+    struct inode *inode;        /* Executable, or NULL if unused. */
+    unsigned version;           /* Version of INODE when parsed. */
+    unsigned last_use;          /* Time of last use, for eviction. */
+    void (*entry) (void);       /* Entry point. */
+    size_t seg_cnt;             /* Number of segments. */
+    struct exec_segment segs[EXEC_SEGS_MAX];
+  };
+
+static struct exec_image exec_cache[EXEC_CACHE_SIZE];
+static struct lock exec_cache_lock;
+static unsigned exec_cache_clock;
+static unsigned exec_hit_cnt, exec_miss_cnt;
+
+static bool exec_cache_lookup (struct file *, struct exec_image *);
+static void exec_cache_insert (struct file *, const struct exec_image *);
+static void exec_cache_drop (struct exec_image *);
+
+#ifdef VM
+/* Pages at the start of each segment of a file that load_segment()
+   has read into the buffer cache in the background, so that the
+   disk is busy with them while exec finishes and the program
+   starts, and its first faults on them find them cached. */
+static unsigned exec_prefetch_pages = 4;
+static struct tunable exec_prefetch_tunable =
+  {
+    .name = "exec.prefetch_pages",
+    .value = &exec_prefetch_pages,
+    .min = 0,
+    .max = 64,
+  };
+#endif
+
+/* The page directory of an exited process, left to be freed. */
+struct pd_reap
+  {
+    struct work work;           /* Runs reap_pagedir(). */
+    uint32_t *pd;               /* Page directory to free. */
+  };
+
+/* Page directories are freed by a low-priority worker after
+   their process has exited, so that its parent's wait() need not
+   wait for that too.  While either pool has fewer than
+   REAP_RESERVE free pages, exec and fork wait for the page
+   directories in flight to be freed first, so that memory left
+   to be reclaimed is not mistaken for memory in use. */
+#define REAP_RESERVE 64
+
+static struct lock reap_lock;
+static struct condition reaps_done; /* Signaled when REAP_CNT is 0. */
+static unsigned reap_cnt;           /* Page directories in flight. */
+
+static void defer_pagedir_destroy (uint32_t *pd);
+static work_func reap_pagedir;
+static void reap_wait_if_short (void);
 
 /**
- * process_Execute - start a process running a user program
+ * process_init - initialize process loading
+*/
+void process_init(void)
+{
+	lock_init_named(&exec_cache_lock, "exec cache");
+	lock_init_named(&children_lock, "children");
+	lock_init_named(&reap_lock, "reap");
+	cond_init(&reaps_done);
+#ifdef VM
+	tunable_register(&exec_prefetch_tunable);
+#endif
+}
+
+/**
+ * process_print_stats - print process loading statistics
+*/
+void process_print_stats(void)
+{
+	printf("Exec cache: %u hits, %u misses\n", exec_hit_cnt,
+	       exec_miss_cnt);
+}
+
+/**
+ * process_execute - start a process running a user program
  *
- * @proc_cmd: pointer to the arguments unparsed
+ * @cmdline: the program name and its arguments, separated by spaces
  *
- * Starts a new thread running a user program loaded from FILENAME.
- * The new thread may be scheduled (and may even exit) before 
- * process_execute() returns. Returns the new process's thread id,
- * or TID_ERROR if the thread cannot be created.
+ * Starts a new thread running a user program loaded from the file
+ * named by the first word of @cmdline.  The arguments are laid
+ * out here, once, in the page that becomes the new process's
+ * initial stack.  Waits for the new process to load.  Returns
+ * the new process's thread id, or TID_ERROR if the thread cannot
+ * be created or the program cannot be loaded.
 */
-tid_t process_execute(const char *proc_cmd_)
+tid_t process_execute(const char *cmdline)
 {
-	char *proc_name;
-	char *proc_cmd;
-	char *saveptr;
-	tid_t tid;
+	struct exec_args *args = alloc_args();
 
-	/* Make two copies of proc_cmd for process name and start_process. */
-	/* Otherwise there's a race between the caller and load(). */
-	proc_name = palloc_get_page(0);
-	if (!proc_name)
+	if (args == NULL)
 		return TID_ERROR;
-	proc_cmd = palloc_get_page(0);
-	if (!proc_cmd)
+	if (!build_args(args, cmdline)) {
+		free_args(args);
 		return TID_ERROR;
-	strlcpy(proc_name, proc_cmd_, PGSIZE);
-	strlcpy(proc_name, proc_cmd_, PGSIZE);
-
-	/* Split the process name from the other arguments. */
-	proc_name = strtok_r(proc_name, " ", &saveptr);
-
-	/* Create a thread with proc_name and unparsed proc_cmd. */
-	tid = thread_create(proc_name, PRI_DEFAULT, start_process, proc_cmd);
-	/* Free the extra page since process name was copied in init_thread. */
-	palloc_free_page(proc_name);
-	if (tid == TID_ERROR)
-		palloc_free_page(proc_cmd);
-	return tid;
+	}
+	return run_args(args, true);
+}
+
+/**
+ * process_execv - start a process with given arguments and descriptors
+ *
+ * @file: name of the program file
+ * @words: the arguments, each followed by a null character
+ * @len: total bytes in @words
+ * @fds: the new process's file descriptor table, which it takes
+ *       over, even on failure
+ * @wait: whether to wait for the program to load
+ *
+ * Starts a new thread running the program in @file, as
+ * process_execute() does, but with the arguments laid out as
+ * given, spaces and all, and with @fds as its descriptors instead
+ * of a copy of the current process's redirections.  If @wait is
+ * false, returns as soon as the thread is created, and
+ * process_load_status() tells how the load went.  Returns the new
+ * process's thread id, or TID_ERROR if the thread cannot be
+ * created, the arguments do not fit, or @wait is true and the
+ * program cannot be loaded.
+*/
+tid_t process_execv(const char *file, const char *words, size_t len,
+		    struct fd_table *fds, bool wait)
+{
+	struct exec_args *args = alloc_args();
+
+	if (args == NULL) {
+		fd_table_destroy(fds);
+		return TID_ERROR;
+	}
+	args->has_fds = true;
+	args->fds = *fds;
+	memset(fds, 0, sizeof *fds);
+	if (!build_argv(args, file, words, len)) {
+		free_args(args);
+		return TID_ERROR;
+	}
+	return run_args(args, wait);
+}
+
+/**
+ * process_load_status - wait for a child process to load
+ *
+ * @child_tid: thread id of a child of the current process
+ *
+ * Return 1 once the child has loaded its program, 0 if it failed
+ * to, or -1 if it is not a child of the current process that has
+ * yet to be waited for.
+*/
+int process_load_status(tid_t child_tid)
+{
+	struct thread *cur = process_current();
+	struct child_status *c = NULL;
+	struct list_elem *e;
+
+	lock_acquire(&children_lock);
+	for (e = list_begin(&cur->children); e != list_end(&cur->children);
+	     e = list_next(e))
+		if (list_entry(e, struct child_status, elem)->tid ==
+		    child_tid) {
+			c = list_entry(e, struct child_status, elem);
+			break;
+		}
+	lock_release(&children_lock);
+	if (c == NULL)
+		return -1;
+
+	/* Leave the semaphore up for the next caller. */
+	sema_down(&c->started);
+	sema_up(&c->started);
+	return c->loaded;
+}
+
+/* Returns a page for the initial stack of a new process, with its
+   header cleared, or a null pointer if none is available. */
+static struct exec_args *
+alloc_args (void)
+{
+  struct exec_args *args;
+#ifdef VM
+  struct frame *f;
+
+  reap_wait_if_short ();
+  f = frame_alloc (NULL);
+  if (f == NULL)
+    return NULL;
+  args = f->kpage;
+  memset (args, 0, sizeof *args);
+  args->frame = f;
+#else
+  reap_wait_if_short ();
+  args = palloc_get_page (PAL_USER);
+  if (args == NULL)
+    return NULL;
+  memset (args, 0, sizeof *args);
+#endif
+  return args;
+}
+
+/* Starts a child process with ARGS, an initial stack page filled
+   in, which it takes over.  If WAIT, waits for it to load.
+   Returns its thread id, or TID_ERROR if it cannot be created or,
+   if WAIT, loaded. */
+static tid_t
+run_args (struct exec_args *args, bool wait)
+{
+  struct child_status *c = child_create ();
+  tid_t tid = TID_ERROR;
+
+  if (c == NULL)
+    {
+      free_args (args);
+      return TID_ERROR;
+    }
+  args->status = c;
+
+  /* The child owns the page once it runs. */
+  tid = thread_create (args->file_name, PRI_DEFAULT, start_process, args);
+  if (tid == TID_ERROR)
+    {
+      free_args (args);
+      child_reap (c);
+      return TID_ERROR;
+    }
+
+  c->tid = tid;
+  if (!wait)
+    return tid;
+  sema_down (&c->started);
+  if (!c->loaded)
+    {
+      sema_down (&c->dead);
+      child_reap (c);
+      return TID_ERROR;
+    }
+  sema_up (&c->started);
+  return tid;
 }
 
 /**
  * start_process - load and start a user process
  *
- * @proc_cmd_: pointer to the commands.
+ * @args_: pointer to the initial stack page built by process_execute()
  *
  * A thread function that loads a user process
  * and starts it running.
 */
-static void start_process(void *proc_cmd_)
+static void start_process(void *args)
 {
+	struct thread *t = thread_current();
+	struct exec_args *exec_args = args;
+	struct fd_table fds = exec_args->fds;
+	bool has_fds = exec_args->has_fds;
 	struct intr_frame if_;
-	char *saveptr;
-	char proc_cmd;
-	char *proc_name;
-	char *token;
-	void *argv[ARG_MAX];
-	int argc;
-	int i;
-	size_t len;
-	size_t vptrlen;
 	bool success;
 
+	/* The page becomes the user's stack, so take the descriptors
+	   out of it first. */
+	memset(&exec_args->fds, 0, sizeof exec_args->fds);
+
 	/* Initialize interrupt frame and load executable. */
 	memset(&if_, 0, sizeof(if_));
 	if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
 	if_.cs = SEL_UCSEG;
 	if_.eflags = FLAG_IF | FLAG_MBS;
 
-	/* Parse process name for ELF loading. */
-	if (proc_name = palloc_get_page(0))
-		return;
-	strlcpy(proc_name, proc_cmd_, PGSIZE);
-	proc_name = strtok_r(proc_name, " ", &saveptr);
-	success = load(proc_name, &if_.eip, &if_.esp);
-	palloc_free_page(proc_name);
-
-	/* If load failed, quit. */
-	palloc_free_page(proc_cmd_);
-	if (!success)
+	/* Tell the parent how the load went.  If it failed, quit. */
+	t->wait_status = exec_args->status;
+	success = load(args, &if_.eip, &if_.esp) &&
+		  (has_fds ? syscall_spawn(t->wait_status->parent, &fds) :
+			     syscall_exec(t->wait_status->parent));
+	if (has_fds && !success)
+		fd_table_destroy(&fds);
+	t->wait_status->loaded = success;
+	sema_up(&t->wait_status->started);
+	if (!success) {
+		t->exit_code = -1;
 		thread_exit();
-
-	/* Arguments parsing. */
-	/* 1. Move the stack pointer ESP to the beginning */
-	/*    of the user virtual address space. */
-	if_.esp = PHYS_BASE;
-
-	/* 2. Parse proc_cmd and save address to each token atop the stack. */
-	argc = 0;
-	proc_cmd = proc_cmd_;
-	for (token = strtok_r(proc_cmd, " ", &saveptr); token;
-	     token = strtok_r(NULL, " ", &saveptr)) {
-		/* Move down ESP and store the token. */
-		/* len + 1 for the trailing '\0'. */
-		if_.esp -= (len = strlen(token) + 1);
-		memcpy(if_.esp, token, len);
-		argv[argc++] = if_.esp;
 	}
 
-	/* 3. Round the ESP down to the multiple of 4 bytes for performance. */
-	if_.esp = (void *)((uintptr_t)if_.esp - (uintptr_t)if_.esp % 4);
-
-	/* 4. Push a null pointer sentinel on the stack, and then */
-	/*    the address of each token, all in right-to-left order. */
-	vptrlen = sizeof(void *);
-	memset(if_.esp -= vptrlen, 0, vptrlen);
-	for (i = argc - 1; i >= 0; --i)
-		memset(if_.esp -= vptrlen, &argv[i], vptrlen);
-
-	/* 5. Push the address of argv, and then argc in right-to-left order. */
-	if_.esp -= vptrlen;
-	*(uintptr_t *)if_.esp = ((uintptr_t)if_.esp + vptrlen);
-	*(int *)if_.esp = argc;
-
-	/* 6. Push a fake "return address", a.k.a. 0. */
-	memset(if_.esp -= vptrlen, 0, vptrlen);
-
-	/* DEBUGGING INFORMATION FOR THE STACK. */
-	printf("(start_process) esp:%p, argc:%d, &argv:%p\n", if_.esp, argc, argv);
-	hex_dump((uintptr_t)if_.esp, if_.esp, ARG_MAX, true);
-
 	/* Start the user process by simulating a return from an
 	interrupt, implemented by intr_exit (in
 	threads/intr-stubs.S).  Because intr_exit takes all of its
@@ -151,20 +422,792 @@ static void start_process(void *proc_cmd_)
 	NOT_REACHED();
 }
 
+/* Returns the user virtual address at which the byte at KADDR in
+   the initial stack page ARGS appears. */
+static uint32_t
+user_addr (const struct exec_args *args, const void *kaddr)
+{
+  return ((uintptr_t) PHYS_BASE - PGSIZE
+          + ((const uint8_t *) kaddr - (const uint8_t *) args));
+}
+
+/* Lays out CMDLINE in ARGS, a page to become the top page of the
+   user stack, as the program expects to find its arguments, with
+   lay_out_args().  The program is named by the first word.
+   Returns false if CMDLINE has no words or does not fit. */
+static bool
+build_args (struct exec_args *args, const char *cmdline)
+{
+  size_t len = strnlen (cmdline, PGSIZE) + 1;
+  char *words;
+  size_t i;
+
+  if (len > PGSIZE - sizeof *args)
+    return false;
+
+  /* Copy the line to the top of the page and split it into words
+     in place. */
+  words = (char *) args + PGSIZE - len;
+  memcpy (words, cmdline, len);
+  for (i = 0; i + 1 < len; i++)
+    if (words[i] == ' ')
+      words[i] = '\0';
+  return lay_out_args (args, words, len, true);
+}
+
+/* Lays out the LEN bytes of WORDS, each argument followed by a
+   null character, in ARGS as build_args() does, but as they are,
+   with empty arguments and spaces kept, and with FILE, copied in
+   above them, as the program's name.  Returns false if there are
+   no arguments or they do not fit. */
+static bool
+build_argv (struct exec_args *args, const char *file, const char *words,
+            size_t len)
+{
+  size_t file_len = strnlen (file, PGSIZE) + 1;
+  char *top = (char *) args + PGSIZE;
+
+  if (len == 0 || words[len - 1] != '\0'
+      || file_len + len > PGSIZE - sizeof *args)
+    return false;
+  memcpy (top - file_len, file, file_len);
+  memcpy (top - file_len - len, words, len);
+  if (!lay_out_args (args, top - file_len - len, len, false))
+    return false;
+  args->file_name = top - file_len;
+  return true;
+}
+
+/* Returns true if an argument starts at WORDS[I], as
+   lay_out_args() takes them. */
+static bool
+arg_start (const char *words, size_t i, bool split)
+{
+  return (i == 0 || words[i - 1] == '\0') && (!split || words[i] != '\0');
+}
+
+/* Lays out the arguments in the LEN bytes of WORDS, already at
+   the top of ARGS, a page to become the top page of the user
+   stack, as the program expects to find them: below the words,
+   the argv array pointing to them, a null pointer sentinel, argv,
+   argc and a fake return address.  If SPLIT, an argument is each
+   run of characters other than null, as left by splitting a
+   command line; otherwise each null-terminated string is one.
+   Fills in the header at the bottom of the page, naming the
+   first argument as the program.  Returns false if there are no
+   arguments or they do not fit. */
+static bool
+lay_out_args (struct exec_args *args, char *words, size_t len, bool split)
+{
+  uint8_t *bottom = (uint8_t *) (args + 1);
+  uint32_t *sp, *argv;
+  int argc = 0;
+  size_t i;
+
+  for (i = 0; i < len; i++)
+    if (arg_start (words, i, split))
+      argc++;
+  if (argc == 0)
+    return false;
+
+  /* Room for argv, its sentinel, argv, argc and the return
+     address, below the words rounded down to a word boundary. */
+  argv = (uint32_t *) ((uintptr_t) words & ~(uintptr_t) 3) - (argc + 1);
+  if ((uint8_t *) argv < bottom + 3 * sizeof *argv)
+    return false;
+
+  argc = 0;
+  for (i = 0; i < len; i++)
+    if (arg_start (words, i, split))
+      {
+        if (argc == 0)
+          args->file_name = words + i;
+        argv[argc++] = user_addr (args, words + i);
+      }
+  argv[argc] = 0;
+  memset (argv + argc + 1, 0,
+          (uint8_t *) words - (uint8_t *) (argv + argc + 1));
+
+  sp = argv;
+  *--sp = user_addr (args, argv);
+  *--sp = argc;
+  *--sp = 0;
+  args->esp = (void *) user_addr (args, sp);
+
+  /* The page is not zeroed when allocated, as most of it is
+     filled in above.  Zero the rest. */
+  memset (bottom, 0, (uint8_t *) sp - bottom);
+  return true;
+}
+
+/* Frees ARGS, an initial stack page that was never mapped. */
+static void
+free_args (struct exec_args *args)
+{
+  if (args->has_fds)
+    fd_table_destroy (&args->fds);
+#ifdef VM
+  frame_release (args->frame);
+#else
+  palloc_free_page (args);
+#endif
+}
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
    child of the calling process, or if process_wait() has already
    been successfully called for the given TID, returns -1
-   immediately, without waiting.
-
-   This function will be implemented in problem 2-2.  For now, it
-   does nothing. */
+   immediately, without waiting. */
 int
-process_wait (tid_t child_tid UNUSED) 
+process_wait (tid_t child_tid) 
+{
+  struct thread *cur = process_current ();
+  struct child_status *c = NULL;
+  struct list_elem *e;
+
+  lock_acquire (&children_lock);
+  for (e = list_begin (&cur->children); e != list_end (&cur->children);
+       e = list_next (e))
+    if (list_entry (e, struct child_status, elem)->tid == child_tid)
+      {
+        c = list_entry (e, struct child_status, elem);
+        break;
+      }
+  lock_release (&children_lock);
+  if (c == NULL)
+    return -1;
+
+  sema_down (&c->dead);
+  return child_reap (c);
+}
+
+/**
+ * process_wait_any - wait for any child process to die
+ *
+ * @status: set to the exit status of the child
+ *
+ * Wait until a child of the current process that has not been
+ * waited for yet dies, or pick one that already has.  Return its
+ * thread id, or TID_ERROR at once if there is none.
+*/
+tid_t process_wait_any(int *status)
+{
+	struct thread *cur = process_current();
+	struct child_status *c;
+	tid_t tid;
+
+	lock_acquire(&children_lock);
+	while (list_empty(&cur->exited_children)) {
+		if (list_empty(&cur->children)) {
+			lock_release(&children_lock);
+			return TID_ERROR;
+		}
+		/* Children waited for by tid leave extra ups. */
+		lock_release(&children_lock);
+		sema_down(&cur->child_exited);
+		lock_acquire(&children_lock);
+	}
+	c = list_entry(list_front(&cur->exited_children),
+		       struct child_status, exit_elem);
+	lock_release(&children_lock);
+
+	tid = c->tid;
+	*status = child_reap(c);
+	return tid;
+}
+
+/* Returns a status record for a new child of the current
+   process, on its list of children, or a null pointer if out of
+   memory. */
+static struct child_status *
+child_create (void)
+{
+  struct child_status *c = malloc (sizeof *c);
+
+  if (c == NULL)
+    return NULL;
+  c->tid = TID_ERROR;
+  c->exit_code = -1;
+  c->exited = false;
+  c->loaded = false;
+  memset (&c->rusage, 0, sizeof c->rusage);
+  c->parent = process_current ();
+  sema_init (&c->started, 0);
+  sema_init (&c->dead, 0);
+
+  lock_acquire (&children_lock);
+  list_push_back (&c->parent->children, &c->elem);
+  lock_release (&children_lock);
+  return c;
+}
+
+/* Removes child status C from the current process's lists and
+   frees it, adding the resources it used to the process's
+   children's.  C must have exited, or never have run.  Returns
+   its exit code. */
+static int
+child_reap (struct child_status *c)
+{
+  int exit_code = c->exit_code;
+
+  rusage_add (&process_current ()->child_rusage, &c->rusage);
+  lock_acquire (&children_lock);
+  list_remove (&c->elem);
+  if (c->exited)
+    list_remove (&c->exit_elem);
+  lock_release (&children_lock);
+  free (c);
+  return exit_code;
+}
+
+/* Posts the current process's exit code to its parent, frees the
+   status of the children it never waited for, and lets those
+   still running free their own. */
+static void
+child_exit (void)
+{
+  struct thread *cur = thread_current ();
+  struct child_status *c = cur->wait_status;
+  struct list_elem *e;
+
+  lock_acquire (&children_lock);
+  while (!list_empty (&cur->children))
+    {
+      struct child_status *child;
+
+      e = list_pop_front (&cur->children);
+      child = list_entry (e, struct child_status, elem);
+      if (child->exited)
+        free (child);
+      else
+        child->parent = NULL;
+    }
+  list_init (&cur->exited_children);
+
+  if (c != NULL)
+    {
+      c->exit_code = cur->exit_code;
+      c->rusage = cur->rusage;
+      rusage_add (&c->rusage, &cur->child_rusage);
+      c->exited = true;
+      if (c->parent != NULL)
+        {
+          list_push_back (&c->parent->exited_children, &c->exit_elem);
+          sema_up (&c->parent->child_exited);
+          sema_up (&c->dead);
+        }
+      else
+        free (c);
+      cur->wait_status = NULL;
+    }
+  lock_release (&children_lock);
+}
+
+/* Adds the resources used according to B to A.  Of the peaks of
+   resident pages, keeps the larger. */
+static void
+rusage_add (struct rusage *a, const struct rusage *b)
+{
+  a->user_ticks += b->user_ticks;
+  a->kernel_ticks += b->kernel_ticks;
+  a->minor_faults += b->minor_faults;
+  a->major_faults += b->major_faults;
+  a->block_reads += b->block_reads;
+  a->block_writes += b->block_writes;
+  a->switches += b->switches;
+  if (b->max_resident > a->max_resident)
+    a->max_resident = b->max_resident;
+}
+
+#ifdef VM
+/* State handed from a forking process to its child. */
+struct fork_args
+  {
+    struct intr_frame if_;      /* Parent's user context. */
+    struct thread *parent;      /* Parent process. */
+    struct child_status *status; /* Status of the child. */
+  };
+
+/**
+ * process_fork - duplicate the current process
+ *
+ * @if_: pointer to the user context of the current process
+ *
+ * Start a child process running a copy of the current one, resuming
+ * from the given context, where it sees 0 returned in EAX.  Loaded
+ * pages are shared copy-on-write rather than copied.  Return the
+ * child's thread id, or TID_ERROR if it could not be set up.
+*/
+tid_t process_fork(const struct intr_frame *if_)
+{
+	struct fork_args args;
+	struct child_status *c;
+	tid_t tid;
+
+	reap_wait_if_short();
+	c = child_create();
+	if (c == NULL)
+		return TID_ERROR;
+	args.if_ = *if_;
+	args.parent = process_current();
+	args.status = c;
+
+	tid = thread_create(thread_name(), PRI_DEFAULT, start_fork, &args);
+	if (tid == TID_ERROR) {
+		child_reap(c);
+		return TID_ERROR;
+	}
+	c->tid = tid;
+
+	/* ARGS lives on our stack, so wait for the child to copy it. */
+	sema_down(&c->started);
+	if (!c->loaded) {
+		sema_down(&c->dead);
+		child_reap(c);
+		return TID_ERROR;
+	}
+	sema_up(&c->started);
+	return tid;
+}
+
+/**
+ * start_fork - set up and start a forked process
+ *
+ * @args_: pointer to the fork arguments
+ *
+ * A thread function that copies its parent's address space and
+ * returns to the parent's user context.
+*/
+static void start_fork(void *args_)
+{
+	struct fork_args *args = args_;
+	struct thread *t = thread_current();
+	struct thread *parent = args->parent;
+	struct intr_frame if_ = args->if_;
+	bool success = false;
+
+	t->wait_status = args->status;
+	t->pagedir = pagedir_create();
+	if (t->pagedir != NULL) {
+		if (page_table_init(&t->spt)) {
+			list_init(&t->mmaps);
+			t->next_mapid = 0;
+			t->exec_fa = parent->exec_fa;
+			t->heap_start = parent->heap_start;
+			t->heap_brk = parent->heap_brk;
+			process_activate();
+			t->exec_file = file_reopen(parent->exec_file);
+			success = t->exec_file != NULL &&
+				  page_table_copy(parent) &&
+				  syscall_fork(parent) &&
+				  fpu_fork(parent);
+		} else {
+			pagedir_destroy(t->pagedir);
+			t->pagedir = NULL;
+		}
+	}
+
+	t->wait_status->loaded = success;
+	sema_up(&t->wait_status->started);
+	if (!success) {
+		t->exit_code = -1;
+		thread_exit();
+	}
+
+	/* The child sees fork() return 0. */
+	if_.eax = 0;
+	asm volatile("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+	NOT_REACHED();
+}
+
+/* Spawned threads.
+
+   A thread started by thread_spawn() runs in the address space of
+   the process that spawned it, on a stack of its own in one of 32
+   slots, one per bit of stack_slots, of THREAD_STACK_PAGES pages
+   each, below the reach of the main stack.  The pages of its slot
+   are recorded as zero pages when it starts, so that they only
+   take frames once touched, and discarded when it exits.  The
+   lowest page of each slot is left out, as a guard against
+   overflowing into the next.
+
+   Everything else the process owns stays with the thread that
+   started it, the `proc' of each thread it spawns, which waits
+   for them all in process_exit() before it tears anything down.
+   Calling exit() in a spawned thread ends only that thread, and
+   the status passed is what thread_join() reports. */
+
+/* Pages per stack slot, including the guard page. */
+#define THREAD_STACK_PAGES 64
+
+/* Number of stack slots, one per bit of stack_slots. */
+#define STACK_SLOT_CNT 32
+
+/* Status of a spawned thread, kept on its process's list of
+   threads until joined, or until the process exits. */
+struct spawn_status
+  {
+    tid_t tid;                  /* Thread's id. */
+    int exit_code;              /* Exit code, once exited. */
+    unsigned slot;              /* Stack slot. */
+    bool joining;               /* Claimed by a thread_join()? */
+    struct list_elem elem;      /* Element in process's threads. */
+    struct semaphore dead;      /* Upped when the thread exits. */
+  };
+
+/* State handed from a spawning thread to the new one. */
+struct spawn_args
+  {
+    void (*entry) (void);       /* User entry point. */
+    uint32_t aux[2];            /* Arguments to ENTRY. */
+    struct thread *proc;        /* Process to join. */
+    struct spawn_status *status; /* Status of the new thread. */
+    struct semaphore started;   /* Upped once it starts or fails. */
+    bool success;               /* Did it start? */
+  };
+
+/* Returns the user address of the top of stack slot SLOT. */
+static uint8_t *
+stack_top (unsigned slot)
+{
+  return ((uint8_t *) PHYS_BASE
+          - (page_stack_max + slot * THREAD_STACK_PAGES) * PGSIZE);
+}
+
+/* Discards the pages of stack slot SLOT of the current process. */
+static void
+discard_stack (unsigned slot)
+{
+  uint8_t *top = stack_top (slot);
+  unsigned i;
+
+  pagedir_begin_batch ();
+  for (i = 1; i < THREAD_STACK_PAGES; i++)
+    page_discard (top - i * PGSIZE);
+  pagedir_end_batch ();
+}
+
+/* Records the pages of stack slot SLOT in the current process's
+   page table, with a frame for the top page holding a null
+   return address and the words of AUX, as if pushed by a call
+   with them as arguments.  Points *ESP at the return address.
+   Returns false if memory is not available or a page of the slot
+   is already in use, leaving the caller to discard_stack(). */
+static bool
+setup_thread_stack (unsigned slot, const uint32_t aux[2], void **esp)
+{
+  uint8_t *top = stack_top (slot);
+  struct frame *f = frame_alloc (NULL);
+  uint32_t *sp;
+  unsigned i;
+
+  if (f == NULL)
+    return false;
+  sp = (uint32_t *) ((uint8_t *) f->kpage + PGSIZE);
+  *--sp = aux[1];
+  *--sp = aux[0];
+  *--sp = 0;
+  memset (f->kpage, 0, (uint8_t *) sp - (uint8_t *) f->kpage);
+  if (!page_record_frame (top - PGSIZE, f))
+    return false;
+  *esp = top - 3 * sizeof *sp;
+
+  for (i = 2; i < THREAD_STACK_PAGES; i++)
+    if (!page_record_file (top - i * PGSIZE, NULL, 0, 0, true))
+      return false;
+  return true;
+}
+
+/**
+ * process_spawn - start another thread in the current process
+ *
+ * @entry: user address to start running at
+ * @aux1: first argument to @entry
+ * @aux2: second argument to @entry
+ *
+ * Start a thread sharing the address space, open files and working
+ * directory of the current process, running @entry on a stack of
+ * its own as if called with the given arguments, from a null
+ * return address.  Return the new thread's id, or TID_ERROR if the
+ * process has no stack slot left or memory is not available.
+*/
+tid_t process_spawn(void (*entry)(void), uint32_t aux1, uint32_t aux2)
+{
+	struct thread *proc = process_current();
+	struct spawn_args args;
+	struct spawn_status *s;
+	tid_t tid;
+
+	s = malloc(sizeof *s);
+	if (s == NULL)
+		return TID_ERROR;
+	s->exit_code = -1;
+	s->joining = false;
+	sema_init(&s->dead, 0);
+
+	lock_acquire(&children_lock);
+	if (proc->stack_slots == UINT32_MAX) {
+		lock_release(&children_lock);
+		free(s);
+		return TID_ERROR;
+	}
+	s->slot = __builtin_ctz(~proc->stack_slots);
+	proc->stack_slots |= 1u << s->slot;
+	lock_release(&children_lock);
+
+	args.entry = entry;
+	args.aux[0] = aux1;
+	args.aux[1] = aux2;
+	args.proc = proc;
+	args.status = s;
+	sema_init(&args.started, 0);
+	args.success = false;
+
+	/* ARGS lives on our stack, so wait for the thread to start. */
+	tid = thread_create(thread_name(), thread_get_priority(),
+			    start_thread, &args);
+	if (tid != TID_ERROR)
+		sema_down(&args.started);
+	if (!args.success) {
+		lock_acquire(&children_lock);
+		proc->stack_slots &= ~(1u << s->slot);
+		lock_release(&children_lock);
+		free(s);
+		return TID_ERROR;
+	}
+	return tid;
+}
+
+/**
+ * start_thread - set up and start a spawned thread
+ *
+ * @args_: pointer to the spawn arguments
+ *
+ * A thread function that moves into the address space of the
+ * spawning process and starts running its entry point.
+*/
+static void start_thread(void *args_)
+{
+	struct spawn_args *args = args_;
+	struct thread *t = thread_current();
+	struct thread *proc = args->proc;
+	struct spawn_status *s = args->status;
+	struct intr_frame if_;
+
+	memset(&if_, 0, sizeof(if_));
+	if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
+	if_.cs = SEL_UCSEG;
+	if_.eflags = FLAG_IF | FLAG_MBS;
+	if_.eip = args->entry;
+
+	t->proc = proc;
+	t->pagedir = proc->pagedir;
+	process_activate();
+
+	args->success = setup_thread_stack(s->slot, args->aux, &if_.esp);
+	if (args->success) {
+		lock_acquire(&children_lock);
+		s->tid = t->tid;
+		list_push_back(&proc->threads, &s->elem);
+		proc->thread_cnt++;
+		lock_release(&children_lock);
+		t->spawn_status = s;
+	} else {
+		discard_stack(s->slot);
+	}
+
+	sema_up(&args->started);
+	if (t->spawn_status == NULL) {
+		t->exit_code = -1;
+		thread_exit();
+	}
+
+	asm volatile("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+	NOT_REACHED();
+}
+
+/**
+ * process_join - wait for a spawned thread to exit
+ *
+ * @tid: thread id of a thread spawned in the current process
+ * @status: set to the exit status of the thread
+ *
+ * Wait until the given thread exits, then free its status.  Return
+ * false at once if @tid is not a thread spawned in the current
+ * process, is the thread calling, or was already joined.
+*/
+bool process_join(tid_t tid, int *status)
+{
+	struct thread *proc = process_current();
+	struct spawn_status *s = NULL;
+	struct list_elem *e;
+
+	if (tid == thread_tid())
+		return false;
+
+	lock_acquire(&children_lock);
+	for (e = list_begin(&proc->threads); e != list_end(&proc->threads);
+	     e = list_next(e)) {
+		struct spawn_status *ts = list_entry(e, struct spawn_status,
+						      elem);
+
+		if (ts->tid == tid && !ts->joining) {
+			s = ts;
+			s->joining = true;
+			break;
+		}
+	}
+	lock_release(&children_lock);
+	if (s == NULL)
+		return false;
+
+	sema_down(&s->dead);
+	lock_acquire(&children_lock);
+	list_remove(&s->elem);
+	lock_release(&children_lock);
+	*status = s->exit_code;
+	free(s);
+	return true;
+}
+
+/* Ends the current thread, a spawned one: frees its stack, leaves
+   the address space, and posts its exit code for thread_join(). */
+static void
+spawn_exit (void)
 {
-  return -1;
+  struct thread *cur = thread_current ();
+  struct thread *proc = cur->proc;
+  struct spawn_status *s = cur->spawn_status;
+
+  /* A thread that failed to start already freed its stack. */
+  if (s != NULL)
+    discard_stack (s->slot);
+  cur->pagedir = NULL;
+  pagedir_activate (NULL);
+  if (s == NULL)
+    return;
+
+  lock_acquire (&children_lock);
+  s->exit_code = cur->exit_code;
+  proc->stack_slots &= ~(1u << s->slot);
+  proc->thread_cnt--;
+  sema_up (&s->dead);
+  sema_up (&proc->threads_exited);
+  lock_release (&children_lock);
+  cur->spawn_status = NULL;
+}
+
+/**
+ * process_check_dying - end a thread whose process is exiting
+ *
+ * End the current thread if it was spawned into a process that has
+ * begun to exit.  Called on each return to user mode, so that
+ * threads spinning in user mode end as well as those that were
+ * asleep in the kernel.
+*/
+void process_check_dying(void)
+{
+	struct thread *cur = thread_current();
+
+	if (cur->proc == cur || !cur->proc->dying)
+		return;
+	intr_enable();
+	cur->exit_code = -1;
+	thread_exit();
+}
+
+/* Has every thread the current process spawned end, waits for them
+   to exit, and frees the status of those not joined.  Threads asleep
+   in futex_wait() or waiting on a pipe or the console are woken; the
+   rest, and those joining them, end as they next return to user mode
+   (see process_check_dying()). */
+static void
+spawn_wait_all (void)
+{
+  struct thread *cur = thread_current ();
+
+  cur->dying = true;
+  futex_wake_process (cur);
+  pipe_wake_all ();
+  input_kick ();
+
+  lock_acquire (&children_lock);
+  while (cur->thread_cnt > 0)
+    {
+      /* Joined threads leave extra ups. */
+      lock_release (&children_lock);
+      sema_down (&cur->threads_exited);
+      lock_acquire (&children_lock);
+    }
+  while (!list_empty (&cur->threads))
+    free (list_entry (list_pop_front (&cur->threads),
+                      struct spawn_status, elem));
+  lock_release (&children_lock);
+}
+
+/* User heap.
+
+   A process's heap runs from the first page past the highest
+   segment of its executable up to its break, which sbrk() moves.
+   Pages brought into it are recorded as zero pages, so that they
+   only take frames once touched, and pages it gives back are
+   discarded.  It may grow up to the bottom of the lowest stack
+   slot, around any pages already in use. */
+
+/**
+ * process_sbrk - move the current process's break
+ *
+ * @increment: bytes to add to the break, or to take off if negative
+ *
+ * Return the previous break, or a null pointer if the break would
+ * pass the start of the heap or its limit, a page it needs is
+ * already in use, or memory is not available.
+*/
+void *process_sbrk(intptr_t increment)
+{
+	struct thread *t = process_current();
+	uint8_t *limit = stack_top(STACK_SLOT_CNT);
+	uint8_t *old, *new, *upage;
+
+	lock_acquire(&t->spt_lock);
+	old = t->heap_brk;
+	new = old + increment;
+	if (old == NULL || new < t->heap_start || new > limit
+	    || (increment < 0) != (new < old)) {
+		lock_release(&t->spt_lock);
+		return NULL;
+	}
+	t->heap_brk = new;
+	lock_release(&t->spt_lock);
+
+	/* Pages wholly past the new break go away. */
+	if (new < old) {
+		pagedir_begin_batch();
+		for (upage = pg_round_up(new); upage < old; upage += PGSIZE)
+			page_discard(upage);
+		pagedir_end_batch();
+		return old;
+	}
+
+	for (upage = pg_round_up(old); upage < new; upage += PGSIZE)
+		if (page_in_use(upage)
+		    || !page_record_file(upage, NULL, 0, 0, true)) {
+			/* Put back the break, unless another thread of the
+			   process has moved it since. */
+			while (upage > (uint8_t *)pg_round_up(old)) {
+				upage -= PGSIZE;
+				page_discard(upage);
+			}
+			lock_acquire(&t->spt_lock);
+			if (t->heap_brk == new)
+				t->heap_brk = old;
+			lock_release(&t->spt_lock);
+			return NULL;
+		}
+	return old;
 }
+#endif
 
 /* Free the current process's resources. */
 void
@@ -173,12 +1216,40 @@ process_exit (void)
   struct thread *cur = thread_current ();
   uint32_t *pd;
 
+  fpu_exit ();
+
+#ifdef VM
+  /* A spawned thread leaves the process to its first thread,
+     which must outlive it. */
+  if (cur->proc != cur)
+    {
+      spawn_exit ();
+      return;
+    }
+  spawn_wait_all ();
+#endif
+
 	/* Print exit code. */
 	printf("%s: exit(%d)\n", cur->name, cur->exit_code);
 
-  /* Destroy the current process's page directory and switch back
-     to the kernel-only page directory. */
+  /* Close the open files and the executable. */
+  syscall_exit ();
+  file_close (cur->exec_file);
+  cur->exec_file = NULL;
+
+  /* Switch back to the kernel-only page directory and leave the
+     current process's page directory to be destroyed. */
   pd = cur->pagedir;
+#ifdef VM
+  /* Frees the frames of loaded pages, so must come first. */
+  if (pd != NULL)
+    {
+      pagedir_begin_batch ();
+      mmap_unmap_all ();
+      page_table_destroy (&cur->spt);
+      pagedir_end_batch ();
+    }
+#endif
   if (pd != NULL) 
     {
       /* Correct ordering here is crucial.  We must set
@@ -190,8 +1261,64 @@ process_exit (void)
          that's been freed (and cleared). */
       cur->pagedir = NULL;
       pagedir_activate (NULL);
+      defer_pagedir_destroy (pd);
+    }
+
+  /* Only now that its files are closed may its parent go on. */
+  child_exit ();
+}
+
+/* Has PD, the page directory of the exiting process, freed in
+   the background, or frees it at once if that cannot be
+   arranged. */
+static void
+defer_pagedir_destroy (uint32_t *pd)
+{
+  struct pd_reap *r = malloc (sizeof *r);
+
+  if (r == NULL)
+    {
       pagedir_destroy (pd);
+      return;
     }
+  r->pd = pd;
+  work_init (&r->work, reap_pagedir, r, WORK_LOW);
+
+  lock_acquire (&reap_lock);
+  reap_cnt++;
+  lock_release (&reap_lock);
+  if (!work_submit (system_wq, &r->work))
+    reap_pagedir (r);
+}
+
+/* Frees the page directory of PD_REAP, then PD_REAP itself. */
+static void
+reap_pagedir (void *pd_reap)
+{
+  struct pd_reap *r = pd_reap;
+
+  pagedir_destroy (r->pd);
+  free (r);
+
+  lock_acquire (&reap_lock);
+  if (--reap_cnt == 0)
+    cond_broadcast (&reaps_done, &reap_lock);
+  lock_release (&reap_lock);
+}
+
+/* Waits until no page directories are left to be freed, if
+   either pool is short of free pages. */
+static void
+reap_wait_if_short (void)
+{
+  if (palloc_free_cnt (0) >= REAP_RESERVE
+      && palloc_free_cnt (PAL_USER) >= REAP_RESERVE)
+    return;
+
+  lock_acquire (&reap_lock);
+  while (reap_cnt > 0)
+    cond_wait (&reaps_done, &reap_lock);
+  lock_release (&reap_lock);
 }
 
 /* Sets up the CPU for running user code in the current
@@ -202,7 +1329,17 @@ process_activate (void)
 {
   struct thread *t = thread_current ();
 
-  /* Activate thread's page tables. */
+  /* A kernel thread has no user address space, so it runs in
+     whichever one is active, as long as it lasts.  That spares
+     the TLB flush of switching to the kernel's page directory,
+     and then another one if the CPU goes back to the same process
+     next.  Nor does a kernel thread enter the kernel from user
+     mode, so the TSS may keep pointing to another thread's
+     stack. */
+  if (t->pagedir == NULL)
+    return;
+
+  /* Activate thread's page tables, if not already active. */
   pagedir_activate (t->pagedir);
 
   /* Set thread's kernel stack for use in processing
@@ -273,21 +1410,29 @@ struct Elf32_Phdr
 #define PF_W 2          /* Writable. */
 #define PF_R 4          /* Readable. */
 
-static bool setup_stack (void **esp);
+static bool setup_stack (struct exec_args *, void **esp);
 static bool validate_segment (const struct Elf32_Phdr *, struct file *);
 static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
                           uint32_t read_bytes, uint32_t zero_bytes,
                           bool writable);
+static bool load_image (struct file *, const struct exec_image *);
+static void add_segment (struct exec_image *, uint32_t ofs, uint32_t upage,
+                         uint32_t read_bytes, uint32_t zero_bytes,
+                         bool writable);
 
-/* Loads an ELF executable from FILE_NAME into the current thread.
+/* Loads an ELF executable from ARGS->file_name into the current
+   thread, with the arguments in ARGS as its initial stack page.
    Stores the executable's entry point into *EIP
    and its initial stack pointer into *ESP.
-   Returns true if successful, false otherwise. */
+   Returns true if successful, false otherwise.  Either way the
+   stack page is taken care of. */
 bool
-load (const char *file_name, void (**eip) (void), void **esp) 
+load (struct exec_args *args, void (**eip) (void), void **esp) 
 {
+  const char *file_name = args->file_name;
   struct thread *t = thread_current ();
   struct Elf32_Ehdr ehdr;
+  struct exec_image image;
   struct file *file = NULL;
   off_t file_ofs;
   bool success = false;
@@ -296,9 +1441,32 @@ load (const char *file_name, void (**eip) (void), void **esp)
   /* Allocate and activate page directory. */
   t->pagedir = pagedir_create ();
   if (t->pagedir == NULL) 
-    goto done;
+    {
+      free_args (args);
+      goto done;
+    }
+#ifdef VM
+  if (!page_table_init (&t->spt))
+    {
+      pagedir_destroy (t->pagedir);
+      t->pagedir = NULL;
+      free_args (args);
+      goto done;
+    }
+  list_init (&t->mmaps);
+  t->next_mapid = 0;
+  t->heap_start = t->heap_brk = NULL;
+  t->exec_fa.next = NULL;
+  t->exec_fa.window = 0;
+#endif
   process_activate ();
 
+  /* Set up stack.  This maps the arguments page, so that it goes
+     away with the rest of the address space, and must come
+     before anything else that can fail.  FILE_NAME is in it. */
+  if (!setup_stack (args, esp))
+    goto done;
+
   /* Open executable file. */
   file = filesys_open (file_name);
   if (file == NULL) 
@@ -306,6 +1474,17 @@ load (const char *file_name, void (**eip) (void), void **esp)
       printf ("load: %s: open failed\n", file_name);
       goto done; 
     }
+  t->exec_file = file;
+
+  /* Skip parsing if the executable's image is cached. */
+  if (exec_cache_lookup (file, &image))
+    {
+      if (!load_image (file, &image))
+        goto done;
+      *eip = image.entry;
+      success = true;
+      goto done;
+    }
 
   /* Read and verify executable header. */
   if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
@@ -319,6 +1498,8 @@ load (const char *file_name, void (**eip) (void), void **esp)
       printf ("load: %s: error loading executable\n", file_name);
       goto done; 
     }
+  image.entry = (void (*) (void)) ehdr.e_entry;
+  image.seg_cnt = 0;
 
   /* Read program headers. */
   file_ofs = ehdr.e_phoff;
@@ -372,31 +1553,33 @@ load (const char *file_name, void (**eip) (void), void **esp)
               if (!load_segment (file, file_page, (void *) mem_page,
                                  read_bytes, zero_bytes, writable))
                 goto done;
+              add_segment (&image, file_page, mem_page, read_bytes,
+                           zero_bytes, writable);
             }
           else
             goto done;
           break;
         }
     }
-
-  /* Set up stack. */
-  if (!setup_stack (esp))
-    goto done;
+  exec_cache_insert (file, &image);
 
   /* Start address. */
-  *eip = (void (*) (void)) ehdr.e_entry;
+  *eip = image.entry;
 
   success = true;
 
  done:
-  /* We arrive here whether the load is successful or not. */
-  file_close (file);
+  /* We arrive here whether the load is successful or not.
+     The executable stays open until process_exit(), since pages
+     may be loaded from it on demand. */
   return success;
 }
 
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page (void *upage, void *kpage, bool writable);
+#endif
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -439,6 +1622,11 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
   if (phdr->p_vaddr < PGSIZE)
     return false;
 
+  /* Keep clear of the timer's shared page (see lib/vdso.h). */
+  if (phdr->p_vaddr < (uintptr_t) VDSO_ADDR + PGSIZE
+      && phdr->p_vaddr + phdr->p_memsz > (uintptr_t) VDSO_ADDR)
+    return false;
+
   /* It's okay. */
   return true;
 }
@@ -455,6 +1643,10 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   With VM, the pages are only recorded in the supplemental page
+   table here and read in by page_load() on first access.  The
+   first exec_prefetch_pages of them are read ahead meanwhile.
+
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
 static bool
@@ -465,6 +1657,14 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
+#ifdef VM
+  if (read_bytes > 0 && exec_prefetch_pages > 0)
+    file_advise (file, ofs,
+                 (read_bytes < exec_prefetch_pages * PGSIZE
+                  ? read_bytes : exec_prefetch_pages * PGSIZE),
+                 ADV_WILLNEED);
+#endif
+
   file_seek (file, ofs);
   while (read_bytes > 0 || zero_bytes > 0) 
     {
@@ -474,6 +1674,12 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
+#ifdef VM
+      /* Record the page to be loaded on first access. */
+      if (!page_record_file (upage, file, ofs, page_read_bytes, writable))
+        return false;
+      ofs += page_read_bytes;
+#else
       /* Get a page of memory. */
       uint8_t *kpage = palloc_get_page (PAL_USER);
       if (kpage == NULL)
@@ -493,35 +1699,202 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
           palloc_free_page (kpage);
           return false; 
         }
+#endif
 
       /* Advance. */
       read_bytes -= page_read_bytes;
       zero_bytes -= page_zero_bytes;
       upage += PGSIZE;
+      thread_cond_yield ();
     }
+
+#ifdef VM
+  /* The heap starts past the highest segment. */
+  if (upage > thread_current ()->heap_start)
+    thread_current ()->heap_start = thread_current ()->heap_brk = upage;
+#endif
   return true;
 }
 
-/* Create a minimal stack by mapping a zeroed page at the top of
-   user virtual memory. */
+/* Loads the segments of IMAGE, parsed from FILE.  Returns true
+   if successful, false otherwise. */
 static bool
-setup_stack (void **esp) 
+load_image (struct file *file, const struct exec_image *image)
 {
-  uint8_t *kpage;
-  bool success = false;
+  size_t i;
+
+  for (i = 0; i < image->seg_cnt; i++)
+    {
+      const struct exec_segment *s = &image->segs[i];
+
+      if (!load_segment (file, s->ofs, (uint8_t *) s->upage,
+                         s->read_bytes, s->zero_bytes, s->writable))
+        return false;
+    }
+  return true;
+}
+
+/* Records a segment loaded by load_segment() in IMAGE.  An image
+   with more than EXEC_SEGS_MAX segments keeps counting them, but
+   cannot be cached. */
+static void
+add_segment (struct exec_image *image, uint32_t ofs, uint32_t upage,
+             uint32_t read_bytes, uint32_t zero_bytes, bool writable)
+{
+  if (image->seg_cnt < EXEC_SEGS_MAX)
+    {
+      struct exec_segment *s = &image->segs[image->seg_cnt];
+
+      s->ofs = ofs;
+      s->upage = upage;
+      s->read_bytes = read_bytes;
+      s->zero_bytes = zero_bytes;
+      s->writable = writable;
+    }
+  image->seg_cnt++;
+}
+
+/* Copies the cached image of FILE, if there is one that is still
+   current, into *IMAGE.  Returns true if found, false otherwise.
+   A stale image is dropped. */
+static bool
+exec_cache_lookup (struct file *file, struct exec_image *image)
+{
+  struct inode *inode = file_get_inode (file);
+  bool found = false;
+  size_t i;
 
-  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
-  if (kpage != NULL) 
+  lock_acquire (&exec_cache_lock);
+  for (i = 0; i < EXEC_CACHE_SIZE; i++)
     {
-      success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
-      if (success)
-        *esp = PHYS_BASE;
+      struct exec_image *e = &exec_cache[i];
+
+      if (e->inode != inode)
+        continue;
+      if (e->version == inode_get_version (inode))
+        {
+          e->last_use = ++exec_cache_clock;
+          *image = *e;
+          found = true;
+        }
       else
-        palloc_free_page (kpage);
+        exec_cache_drop (e);
+      break;
     }
-  return success;
+  if (found)
+    exec_hit_cnt++;
+  else
+    exec_miss_cnt++;
+  lock_release (&exec_cache_lock);
+  return found;
 }
 
+/* Caches IMAGE, just parsed from FILE, in place of any older
+   image of the same file or else of the least recently used
+   one. */
+static void
+exec_cache_insert (struct file *file, const struct exec_image *image)
+{
+  struct inode *inode = file_get_inode (file);
+  struct exec_image *victim = NULL;
+  size_t i;
+
+  if (image->seg_cnt > EXEC_SEGS_MAX)
+    return;
+
+  lock_acquire (&exec_cache_lock);
+  for (i = 0; i < EXEC_CACHE_SIZE; i++)
+    {
+      struct exec_image *e = &exec_cache[i];
+
+      if (e->inode == inode)
+        {
+          victim = e;
+          break;
+        }
+      if (victim == NULL
+          || (victim->inode != NULL
+              && (e->inode == NULL || e->last_use < victim->last_use)))
+        victim = e;
+    }
+  if (victim->inode != NULL)
+    exec_cache_drop (victim);
+
+  *victim = *image;
+  victim->inode = inode_reopen (inode);
+  victim->version = inode_get_version (inode);
+  inode_deny_write (victim->inode);
+  victim->last_use = ++exec_cache_clock;
+  lock_release (&exec_cache_lock);
+}
+
+/* Gives up cached image E's inode.  The caller must hold
+   exec_cache_lock. */
+static void
+exec_cache_drop (struct exec_image *e)
+{
+  ASSERT (lock_held_by_current_thread (&exec_cache_lock));
+
+  inode_allow_write (e->inode);
+  inode_close (e->inode);
+  e->inode = NULL;
+}
+
+/* Drops the cached image of INODE, if any, which is about to be
+   written to or has been removed.  The caller has INODE open, so
+   the cache's reference is not the last one, and is given up
+   without exec_cache_lock: writers may call this with other locks
+   held, such as frames_lock while evicting a mapped page. */
+void
+process_uncache (struct inode *inode)
+{
+  bool found = false;
+  size_t i;
+
+  lock_acquire (&exec_cache_lock);
+  for (i = 0; i < EXEC_CACHE_SIZE; i++)
+    if (exec_cache[i].inode == inode)
+      {
+        exec_cache[i].inode = NULL;
+        found = true;
+        break;
+      }
+  lock_release (&exec_cache_lock);
+
+  if (found)
+    {
+      inode_allow_write (inode);
+      inode_close (inode);
+    }
+}
+
+/* Create a minimal stack by mapping ARGS, the page built by
+   build_args(), at the top of user virtual memory.  Frees ARGS
+   if it cannot be mapped. */
+static bool
+setup_stack (struct exec_args *args, void **esp) 
+{
+  uint8_t *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
+  struct exec_args header = *args;
+
+  /* Keep the header out of the process's sight. */
+  memset (args, 0, sizeof *args);
+#ifdef VM
+  if (!page_record_frame (upage, header.frame))
+    return false;
+#else
+  if (!install_page (upage, args, true))
+    {
+      palloc_free_page (args);
+      return false;
+    }
+#endif
+  *esp = header.esp;
+  return true;
+}
+
+#ifndef VM
+
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -541,3 +1914,4 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
+#endif
@@ -1,13 +1,48 @@
 #ifndef USERPROG_PROCESS_H
 #define USERPROG_PROCESS_H
 
+#include <stddef.h>
 #include "threads/thread.h"
 
-#define ARG_MAX 127		/* Maximum argv count. */
+struct fd_table;
+struct inode;
 
+void process_init (void);
+void process_print_stats (void);
 tid_t process_execute (const char *file_name);
+tid_t process_execv (const char *file, const char *words, size_t len,
+                     struct fd_table *, bool wait);
+int process_load_status (tid_t);
 int process_wait (tid_t);
+tid_t process_wait_any (int *status);
 void process_exit (void);
 void process_activate (void);
+void process_uncache (struct inode *);
+#ifdef VM
+struct intr_frame;
+tid_t process_fork (const struct intr_frame *);
+tid_t process_spawn (void (*entry) (void), uint32_t aux1, uint32_t aux2);
+bool process_join (tid_t, int *status);
+void process_check_dying (void);
+void *process_sbrk (intptr_t increment);
+#endif
+
+/* Returns the thread that holds the state of the running
+   thread's process: the thread itself, unless thread_spawn()
+   started it. */
+static inline struct thread *
+process_current (void)
+{
+  return thread_current ()->proc;
+}
+
+/* Returns true if the running thread's process is exiting, in
+   which case the thread should stop waiting for I/O, so that it
+   can end. */
+static inline bool
+process_dying (void)
+{
+  return process_current ()->dying;
+}
 
 #endif /* userprog/process.h */
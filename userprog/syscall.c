@@ -1,20 +1,1860 @@
 #include "userprog/syscall.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <hist.h>
+#include <net.h>
+#include <spawn.h>
+#include <stat.h>
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
+#include <uio.h>
+#include "devices/e1000.h"
+#include "devices/input.h"
+#include "devices/shutdown.h"
+#include "filesys/directory.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "filesys/pipe.h"
+#include "threads/arena.h"
+#include "threads/cycle.h"
 #include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/tunable.h"
+#include "threads/vaddr.h"
+#include "threads/vmstat.h"
+#include "userprog/exception.h"
+#include "userprog/futex.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "userprog/tss.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#include "vm/shm.h"
+#endif
+
+/* A system call handler.  ARGS holds the call's arguments as
+   copied from the user stack.  The return value is passed back
+   to the user in EAX. */
+typedef uint32_t syscall_func (const uint32_t *args, struct intr_frame *);
+
+/* Maximum number of arguments taken by a system call. */
+#define SYSCALL_ARGS_MAX 4
+
+/* A system call. */
+struct syscall
+  {
+    syscall_func *func;         /* Handler. */
+    size_t arg_cnt;             /* Number of arguments. */
+  };
+
+static syscall_func sys_halt, sys_exit, sys_exec, sys_wait;
+static syscall_func sys_create, sys_remove, sys_open, sys_filesize;
+static syscall_func sys_read, sys_write, sys_seek, sys_tell, sys_close;
+static syscall_func sys_mmap, sys_munmap;
+static syscall_func sys_chdir, sys_mkdir, sys_readdir, sys_isdir;
+static syscall_func sys_inumber, sys_fork, sys_getpid;
+static syscall_func sys_readv, sys_writev;
+static syscall_func sys_io_ring_setup, sys_io_ring_enter;
+static syscall_func sys_waitany, sys_sendfile, sys_vmstat;
+static syscall_func sys_futex_wait, sys_futex_wake;
+static syscall_func sys_thread_spawn, sys_thread_join, sys_sbrk;
+static syscall_func sys_shm_create, sys_shm_map, sys_pipe, sys_dup2;
+static syscall_func sys_madvise, sys_fadvise, sys_getdents;
+static syscall_func sys_fsync, sys_fdatasync, sys_fcntl;
+static syscall_func sys_net_map, sys_net_send, sys_net_recv;
+static syscall_func sys_sched_deadline, sys_stat, sys_fstat;
+static syscall_func sys_clone_file, sys_getrusage;
+static syscall_func sys_spawn, sys_spawn_status;
+static syscall_func sys_sysctl_get, sys_sysctl_set;
+
+/* System calls, indexed by number. */
+static const struct syscall syscalls[] =
+  {
+    [SYS_HALT] = {sys_halt, 0},
+    [SYS_EXIT] = {sys_exit, 1},
+    [SYS_EXEC] = {sys_exec, 1},
+    [SYS_WAIT] = {sys_wait, 1},
+    [SYS_CREATE] = {sys_create, 2},
+    [SYS_REMOVE] = {sys_remove, 1},
+    [SYS_OPEN] = {sys_open, 1},
+    [SYS_FILESIZE] = {sys_filesize, 1},
+    [SYS_READ] = {sys_read, 3},
+    [SYS_WRITE] = {sys_write, 3},
+    [SYS_SEEK] = {sys_seek, 2},
+    [SYS_TELL] = {sys_tell, 1},
+    [SYS_CLOSE] = {sys_close, 1},
+    [SYS_MMAP] = {sys_mmap, 2},
+    [SYS_MUNMAP] = {sys_munmap, 1},
+    [SYS_CHDIR] = {sys_chdir, 1},
+    [SYS_MKDIR] = {sys_mkdir, 1},
+    [SYS_READDIR] = {sys_readdir, 2},
+    [SYS_ISDIR] = {sys_isdir, 1},
+    [SYS_INUMBER] = {sys_inumber, 1},
+    [SYS_FORK] = {sys_fork, 0},
+    [SYS_GETPID] = {sys_getpid, 0},
+    [SYS_READV] = {sys_readv, 3},
+    [SYS_WRITEV] = {sys_writev, 3},
+    [SYS_IO_RING_SETUP] = {sys_io_ring_setup, 1},
+    [SYS_IO_RING_ENTER] = {sys_io_ring_enter, 0},
+    [SYS_WAITANY] = {sys_waitany, 1},
+    [SYS_SENDFILE] = {sys_sendfile, 4},
+    [SYS_VMSTAT] = {sys_vmstat, 1},
+    [SYS_FUTEX_WAIT] = {sys_futex_wait, 2},
+    [SYS_FUTEX_WAKE] = {sys_futex_wake, 2},
+    [SYS_THREAD_SPAWN] = {sys_thread_spawn, 3},
+    [SYS_THREAD_JOIN] = {sys_thread_join, 2},
+    [SYS_SBRK] = {sys_sbrk, 1},
+    [SYS_SHM_CREATE] = {sys_shm_create, 1},
+    [SYS_SHM_MAP] = {sys_shm_map, 2},
+    [SYS_PIPE] = {sys_pipe, 1},
+    [SYS_DUP2] = {sys_dup2, 2},
+    [SYS_MADVISE] = {sys_madvise, 3},
+    [SYS_FADVISE] = {sys_fadvise, 4},
+    [SYS_GETDENTS] = {sys_getdents, 3},
+    [SYS_FSYNC] = {sys_fsync, 1},
+    [SYS_FDATASYNC] = {sys_fdatasync, 1},
+    [SYS_FCNTL] = {sys_fcntl, 3},
+    [SYS_NET_MAP] = {sys_net_map, 1},
+    [SYS_NET_SEND] = {sys_net_send, 0},
+    [SYS_NET_RECV] = {sys_net_recv, 1},
+    [SYS_SCHED_DEADLINE] = {sys_sched_deadline, 3},
+    [SYS_STAT] = {sys_stat, 2},
+    [SYS_FSTAT] = {sys_fstat, 2},
+    [SYS_CLONE_FILE] = {sys_clone_file, 2},
+    [SYS_GETRUSAGE] = {sys_getrusage, 2},
+    [SYS_SPAWN] = {sys_spawn, 4},
+    [SYS_SPAWN_STATUS] = {sys_spawn_status, 1},
+    [SYS_SYSCTL_GET] = {sys_sysctl_get, 2},
+    [SYS_SYSCTL_SET] = {sys_sysctl_set, 2},
+  };
+#define SYSCALL_CNT (sizeof syscalls / sizeof *syscalls)
+
+/* Cycles each system call took, indexed by number, counted while
+   the "syscall.cycle_hist" tunable is nonzero. */
+static histogram *syscall_hists;
+static unsigned cycle_hist;
+static struct tunable cycle_hist_tunable =
+  {
+    .name = "syscall.cycle_hist",
+    .value = &cycle_hist,
+    .min = 0,
+    .max = 1,
+  };
+
+/* Model-specific registers for SYSENTER.  See [IA32-v3a] 4.8.7
+   "Fast System Calls in 32-Bit Protected Mode". */
+#define MSR_SYSENTER_CS 0x174   /* Kernel code segment. */
+#define MSR_SYSENTER_ESP 0x175  /* Kernel stack pointer. */
+#define MSR_SYSENTER_EIP 0x176  /* Entry point. */
+
+/* Entry point in sysenter.S. */
+void sysenter_entry (void);
 
 static void syscall_handler (struct intr_frame *);
+static bool cpu_has_sysenter (void);
+static void wrmsr (uint32_t msr, uint32_t value);
+static void copy_in (void *dst, const void *usrc, size_t size);
+static char *copy_in_string (const char *us);
+static bool is_user_range (const void *uaddr, size_t size);
+static bool copy_user (void *dst, const void *src, size_t size);
+static bool copy_from_user (void *dst, const void *usrc, size_t size);
+static bool copy_to_user (void *udst, const void *src, size_t size);
+static int get_user (const uint8_t *uaddr);
+static bool put_user (uint8_t *udst, uint8_t byte);
+static void *pin_user (uint8_t *uaddr);
+static void unpin_user (uint8_t *uaddr);
+static int read_user (struct file *, uint8_t *ubuf, unsigned size,
+                      uint8_t *kbuf);
+static int write_user (struct file *, const uint8_t *ubuf, unsigned size,
+                       uint8_t *kbuf);
+static int send_file (struct file *out, struct file *in, off_t ofs,
+                      unsigned size, uint8_t *kbuf);
+static int io_ring_op (const struct io_ring_sqe *, uint8_t *kbuf);
+static struct file *find_fd (int fd);
+static struct file *lookup_fd (int fd);
+static struct file *lookup_std_fd (int fd, int std_fd);
+static bool inherit_cwd (struct thread *parent);
+static bool copy_in_argv (char *const *uargv, char *words, size_t *len);
+static bool spawn_fds (struct fd_table *,
+                       const struct spawn_action *uactions);
+static void terminate (int status) NO_RETURN;
 
 void
-syscall_init (void) 
+syscall_init (void)
 {
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
+  futex_init ();
+  syscall_hists = calloc (SYSCALL_CNT, sizeof *syscall_hists);
+  if (syscall_hists != NULL)
+    tunable_register (&cycle_hist_tunable);
+
+  /* Also accept system calls through SYSENTER, which enters at
+     sysenter_entry with ESP pointing to the TSS's esp0.  The CPU
+     takes SS from the selector after CS, and SYSEXIT takes the
+     user selectors from the two after that, which is how
+     loader.h and gdt.h lay them out. */
+  if (cpu_has_sysenter ())
+    {
+      wrmsr (MSR_SYSENTER_CS, SEL_KCSEG);
+      wrmsr (MSR_SYSENTER_ESP, (uint32_t) tss_esp0 ());
+      wrmsr (MSR_SYSENTER_EIP, (uint32_t) sysenter_entry);
+    }
+}
+
+/**
+ * syscall_print_stats - print system call statistics
+ *
+ * Print the histogram of cycles taken by each system call that was
+ * timed while the "syscall.cycle_hist" tunable was set.
+*/
+void syscall_print_stats(void)
+{
+	unsigned nr;
+
+	if (syscall_hists == NULL)
+		return;
+	for (nr = 0; nr < SYSCALL_CNT; nr++) {
+		if (hist_count(syscall_hists[nr]) == 0)
+			continue;
+		printf("Syscall %u:", nr);
+		hist_print("cycles", syscall_hists[nr]);
+	}
+}
+
+/**
+ * syscall_sysenter - handle a system call entered through SYSENTER
+ *
+ * @f: user context, laid out by sysenter_entry as for "int $0x30"
+*/
+void syscall_sysenter(struct intr_frame *f)
+{
+	syscall_handler(f);
+#ifdef VM
+	process_check_dying();
+#endif
+}
+
+/**
+ * syscall_exit - release the system call state of a process
+ *
+ * Close every file the current process still has open, and its
+ * working directory.  Called from process_exit().
+*/
+void syscall_exit(void)
+{
+	struct thread *t = thread_current();
+
+	fd_table_destroy(&t->fds);
+	dir_close(t->cwd);
+	t->cwd = NULL;
+	if (t->net_ring != NULL) {
+		pagedir_unmap_range(t->pagedir, t->net_ring,
+				    NET_MAP_SIZE / PGSIZE);
+		e1000_release();
+		t->net_ring = NULL;
+	}
+}
+
+/**
+ * syscall_exec - inherit the system call state that survives exec
+ *
+ * @parent: process that ran the current one
+ *
+ * Give the current process, a new child of @parent started by
+ * exec, @parent's working directory, and its own copy of the files
+ * @parent has redirected descriptors 0 and 1 to, if any.  Called
+ * from the child while @parent waits for it to load.  Return true
+ * if successful.
+*/
+bool syscall_exec(struct thread *parent)
+{
+	struct thread *t = thread_current();
+	bool success;
+	int fd;
+
+	lock_acquire(&parent->fds_lock);
+	success = inherit_cwd(parent);
+	for (fd = STDIN_FILENO; success && fd <= STDOUT_FILENO; fd++) {
+		struct file *file = fd_get(&parent->fds, fd);
+		struct file *copy;
+
+		if (file == NULL)
+			continue;
+		copy = file_reopen(file);
+		success = copy != NULL && fd_install(&t->fds, fd, copy);
+		if (success)
+			file_seek(copy, file_tell(file));
+		else
+			file_close(copy);
+	}
+	lock_release(&parent->fds_lock);
+	return success;
+}
+
+/**
+ * syscall_fork - inherit the system call state of a process
+ *
+ * @parent: process being forked
+ *
+ * Give the current process, a new child of @parent, its own copy
+ * of every file @parent has open.  Called from the child.  Return
+ * true if successful.
+*/
+bool syscall_fork(struct thread *parent)
+{
+	bool success;
+
+	lock_acquire(&parent->fds_lock);
+	success = inherit_cwd(parent) &&
+		  fd_table_copy(&thread_current()->fds, &parent->fds);
+	lock_release(&parent->fds_lock);
+	return success;
+}
+
+/**
+ * syscall_spawn - take the system call state a spawn() built
+ *
+ * @parent: process that spawned the current one
+ * @fds: file descriptor table built for the current process
+ *
+ * Give the current process, a new child of @parent started by
+ * spawn(), @parent's working directory, and make @fds its
+ * descriptor table, leaving @fds empty.  Return true if successful.
+ * On failure @fds is left to the caller.
+*/
+bool syscall_spawn(struct thread *parent, struct fd_table *fds)
+{
+	struct thread *t = thread_current();
+	bool success;
+
+	lock_acquire(&parent->fds_lock);
+	success = inherit_cwd(parent);
+	lock_release(&parent->fds_lock);
+	if (success) {
+		t->fds = *fds;
+		memset(fds, 0, sizeof *fds);
+	}
+	return success;
+}
+
+/* Gives the current process PARENT's working directory, if it
+   has one.  Caller must hold PARENT's fds_lock.  Returns false if
+   out of memory. */
+static bool
+inherit_cwd (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+
+  if (parent->cwd == NULL)
+    return true;
+  t->cwd = dir_reopen (parent->cwd);
+  return t->cwd != NULL;
+}
+
+/* Dispatches the system call whose number and arguments are on
+   the user stack through the syscalls table.  The arguments are
+   fetched with one copy, sized by the call's argument count.
+   Each call runs in a scope of scratch memory, so the buffers it
+   takes from arena_alloc() go away when it returns, or with the
+   thread if it terminates the process. */
+static void
+syscall_handler (struct intr_frame *f)
+{
+  uint32_t args[SYSCALL_ARGS_MAX];
+  const struct syscall *sc;
+  uint64_t start = 0;
+  unsigned nr;
+  size_t mark;
+
+#ifdef VM
+  /* For stack growth on faults in the kernel. */
+  thread_current ()->user_esp = f->esp;
+#endif
+
+  copy_in (&nr, f->esp, sizeof nr);
+  if (nr >= SYSCALL_CNT || syscalls[nr].func == NULL)
+    terminate (-1);
+  sc = &syscalls[nr];
+
+  copy_in (args, (uint32_t *) f->esp + 1, sizeof *args * sc->arg_cnt);
+  TRACE (TRACE_SYSCALL, nr, sc->arg_cnt > 0 ? args[0] : 0, 0);
+  mark = arena_begin ();
+  if (cycle_hist)
+    start = rdtsc ();
+  f->eax = sc->func (args, f);
+  if (start != 0)
+    hist_add (syscall_hists[nr], rdtsc () - start);
+  arena_end (mark);
+  TRACE (TRACE_SYSCALL_EXIT, nr, f->eax, 0);
+}
+
+/* Halts the machine. */
+static uint32_t
+sys_halt (const uint32_t *args UNUSED, struct intr_frame *f UNUSED)
+{
+  shutdown_power_off ();
+}
+
+/* Terminates the process with status ARGS[0]. */
+static uint32_t
+sys_exit (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  terminate (args[0]);
+}
+
+/* Runs the command line at ARGS[0] in a new process and returns
+   its pid, or -1 on failure. */
+static uint32_t
+sys_exec (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  char *cmd = copy_in_string ((const char *) args[0]);
+  tid_t tid;
+
+  tid = process_execute (cmd);
+  return tid;
+}
+
+/* Waits for child ARGS[0] and returns its exit status. */
+static uint32_t
+sys_wait (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  return process_wait (args[0]);
+}
+
+/* Waits for any child to die, stores its exit status in *ARGS[0],
+   and returns its pid, or -1 if there are no children to wait
+   for. */
+static uint32_t
+sys_waitany (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  int status;
+  tid_t tid = process_wait_any (&status);
+
+  if (tid != TID_ERROR
+      && !copy_to_user ((void *) args[0], &status, sizeof status))
+    terminate (-1);
+  return tid;
+}
+
+/* Creates file ARGS[0] with an initial size of ARGS[1] bytes. */
+static uint32_t
+sys_create (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  char *name = copy_in_string ((const char *) args[0]);
+  bool ok;
+
+  ok = filesys_create (name, args[1]);
+  return ok;
+}
+
+/* Deletes file ARGS[0]. */
+static uint32_t
+sys_remove (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  char *name = copy_in_string ((const char *) args[0]);
+  bool ok;
+
+  ok = filesys_remove (name);
+  return ok;
+}
+
+/* Opens file ARGS[0] and returns a new file descriptor for it,
+   or -1 on failure. */
+static uint32_t
+sys_open (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  char *name = copy_in_string ((const char *) args[0]);
+  struct file *file;
+  int handle = -1;
+
+  file = filesys_open (name);
+  if (file != NULL)
+    {
+      struct thread *t = process_current ();
+
+      lock_acquire (&t->fds_lock);
+      handle = fd_alloc (&t->fds, file);
+      lock_release (&t->fds_lock);
+      if (handle < 0)
+        file_close (file);
+    }
+  return handle;
+}
+
+/* Returns the size in bytes of open file ARGS[0]. */
+static uint32_t
+sys_filesize (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  return file_length (lookup_fd (args[0]));
+}
+
+/* Reads up to ARGS[2] bytes into ARGS[1] from file descriptor
+   ARGS[0], the keyboard if it is 0 and not redirected.  Returns
+   the number of bytes read, or -1 on failure. */
+static uint32_t
+sys_read (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  int handle = args[0];
+  struct file *file = lookup_std_fd (handle, STDIN_FILENO);
+  uint8_t *kbuf;
+  int read;
+
+  kbuf = arena_alloc (PGSIZE);
+  if (kbuf == NULL)
+    return -1;
+  read = read_user (file, (uint8_t *) args[1], args[2], kbuf);
+  if (read < 0)
+    terminate (-1);
+  return read;
+}
+
+/* Writes ARGS[2] bytes from ARGS[1] to file descriptor ARGS[0],
+   the console if it is 1 and not redirected.  Returns the number
+   of bytes written, or -1 on failure. */
+static uint32_t
+sys_write (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  int handle = args[0];
+  struct file *file = lookup_std_fd (handle, STDOUT_FILENO);
+  uint8_t *kbuf;
+  int written;
+
+  kbuf = arena_alloc (PGSIZE);
+  if (kbuf == NULL)
+    return -1;
+  written = write_user (file, (const uint8_t *) args[1], args[2], kbuf);
+  if (written < 0)
+    terminate (-1);
+  return written;
+}
+
+/* Reads from file descriptor ARGS[0] into the ARGS[2] buffers
+   described by the iovec array at ARGS[1], in order, or writes
+   from them if WRITE.  Stops at the first short transfer.
+   Returns the number of bytes transferred, or -1 on failure. */
+static uint32_t
+transfer_vector (const uint32_t *args, bool write)
+{
+  int handle = args[0];
+  int iovcnt = args[2];
+  struct iovec iov[IOV_MAX];
+  struct file *file;
+  uint8_t *kbuf;
+  int total = 0;
+  int i;
+
+  if (iovcnt < 0 || iovcnt > IOV_MAX)
+    return -1;
+  copy_in (iov, (const void *) args[1], sizeof *iov * iovcnt);
+  file = lookup_std_fd (handle, write ? STDOUT_FILENO : STDIN_FILENO);
+
+  kbuf = arena_alloc (PGSIZE);
+  if (kbuf == NULL)
+    return -1;
+  for (i = 0; i < iovcnt; i++)
+    {
+      int n = (write
+               ? write_user (file, iov[i].iov_base, iov[i].iov_len, kbuf)
+               : read_user (file, iov[i].iov_base, iov[i].iov_len, kbuf));
+      if (n < 0)
+        terminate (-1);
+      total += n;
+      if ((size_t) n < iov[i].iov_len)
+        break;
+    }
+  return total;
+}
+
+/* Reads from file descriptor ARGS[0] into ARGS[2] buffers. */
+static uint32_t
+sys_readv (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  return transfer_vector (args, false);
+}
+
+/* Writes to file descriptor ARGS[0] from ARGS[2] buffers. */
+static uint32_t
+sys_writev (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  return transfer_vector (args, true);
+}
+
+/* Reads up to SIZE bytes from FD, the keyboard if FD is null,
+   into user buffer UBUF.  A file is read straight into UBUF, one
+   pinned page at a time, so that the data is copied once, from
+   the buffer cache, and the file system never faults on the
+   user's buffer.  A pipe copies straight into UBUF itself.
+   Keyboard input goes through kernel page KBUF.  Returns the
+   number of bytes read, or -1 if UBUF is not valid user memory
+   or FILE is the write end of a pipe. */
+static int
+read_user (struct file *file, uint8_t *ubuf, unsigned size, uint8_t *kbuf)
+{
+  unsigned done = 0;
+
+  if (file != NULL && file_is_dir (file))
+    return -1;
+  if (file != NULL && file_get_pipe (file) != NULL)
+    return file_pipe_read (file, ubuf, size, copy_to_user);
+  while (done < size)
+    {
+      uint8_t *uaddr = ubuf + done;
+      off_t chunk = PGSIZE - pg_ofs (uaddr);
+      off_t read;
+
+      if (chunk > (off_t) (size - done))
+        chunk = size - done;
+      if (file == NULL)
+        {
+          for (read = 0; read < chunk; read++)
+            {
+              int key = input_getc_unless (process_dying);
+
+              if (key < 0)
+                break;
+              kbuf[read] = key;
+            }
+          if (!copy_to_user (uaddr, kbuf, read))
+            return -1;
+        }
+      else
+        {
+          uint8_t *kaddr = pin_user (uaddr);
+
+          if (kaddr == NULL)
+            return -1;
+          read = file_read (file, kaddr, chunk);
+          unpin_user (uaddr);
+        }
+
+      done += read;
+      if (read < chunk)
+        break;
+    }
+  return done;
+}
+
+/* Writes SIZE bytes from user buffer UBUF to FD, the console if
+   FD is null, through kernel page KBUF like read_user().  A pipe
+   copies straight from UBUF.  Returns the number of bytes
+   written, or -1 if UBUF is not valid user memory or FILE is a
+   pipe that cannot be written, for want of readers. */
+static int
+write_user (struct file *file, const uint8_t *ubuf, unsigned size,
+            uint8_t *kbuf)
+{
+  unsigned done = 0;
+
+  if (file != NULL && file_is_dir (file))
+    return -1;
+  if (file != NULL && file_get_pipe (file) != NULL)
+    return file_pipe_write (file, ubuf, size, copy_from_user);
+  while (done < size)
+    {
+      off_t chunk = size - done < PGSIZE ? size - done : PGSIZE;
+      off_t written;
+
+      /* Direct writes go to disk straight from the user's page. */
+      if (file != NULL && file_is_direct (file))
+        {
+          uint8_t *uaddr = (uint8_t *) ubuf + done;
+          uint8_t *kaddr;
+
+          if (chunk > PGSIZE - (off_t) pg_ofs (uaddr))
+            chunk = PGSIZE - pg_ofs (uaddr);
+          kaddr = pin_user (uaddr);
+          if (kaddr == NULL)
+            return -1;
+          written = file_write (file, kaddr, chunk);
+          unpin_user (uaddr);
+          done += written;
+          if (written < chunk)
+            break;
+          continue;
+        }
+
+      if (!copy_from_user (kbuf, ubuf + done, chunk))
+        return -1;
+
+      if (file == NULL)
+        {
+          putbuf ((const char *) kbuf, chunk);
+          written = chunk;
+        }
+      else
+        written = file_write (file, kbuf, chunk);
+      done += written;
+      if (written < chunk)
+        break;
+    }
+  return done;
+}
+
+/* Copies up to ARGS[3] bytes from file descriptor ARGS[1] to
+   file descriptor ARGS[0], the console if it is 1, without
+   passing them through user memory.  If ARGS[2] is not null, it
+   points to the offset in ARGS[1] to copy from, which is
+   advanced past the bytes copied, and ARGS[1]'s position is left
+   alone; otherwise the copy starts at, and advances, ARGS[1]'s
+   position.  Returns the number of bytes copied, or -1 on
+   failure. */
+static uint32_t
+sys_sendfile (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  int out_handle = args[0];
+  struct file *in = lookup_fd (args[1]);
+  struct file *out = lookup_std_fd (out_handle, STDOUT_FILENO);
+  off_t *uofs = (off_t *) args[2];
+  uint8_t *kbuf;
+  off_t ofs;
+  int copied;
+
+  if (uofs != NULL)
+    copy_in (&ofs, uofs, sizeof ofs);
+  else
+    ofs = file_tell (in);
+  if (ofs < 0)
+    return -1;
+
+  kbuf = arena_alloc (PGSIZE);
+  if (kbuf == NULL)
+    return -1;
+  copied = send_file (out, in, ofs, args[3], kbuf);
+  if (copied < 0)
+    return -1;
+
+  ofs += copied;
+  if (uofs == NULL)
+    file_seek (in, ofs);
+  else if (!copy_to_user (uofs, &ofs, sizeof ofs))
+    terminate (-1);
+  return copied;
+}
+
+/* Stores a snapshot of the memory statistics at ARGS[0]. */
+static uint32_t
+sys_vmstat (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  struct vmstat st;
+
+  vmstat_get (&st);
+  if (!copy_to_user ((void *) args[0], &st, sizeof st))
+    terminate (-1);
+  return 0;
+}
+
+/* Returns the kernel address of the futex word at user address
+   UADDR, pinned by pin_user().  Terminates the process if UADDR
+   is misaligned or not valid, writable user memory. */
+static uint32_t *
+pin_futex (uint8_t *uaddr)
+{
+  uint32_t *kaddr;
+
+  if ((uintptr_t) uaddr % sizeof *kaddr != 0)
+    terminate (-1);
+  kaddr = pin_user (uaddr);
+  if (kaddr == NULL)
+    terminate (-1);
+  return kaddr;
+}
+
+/* Sleeps on the word at ARGS[0] if it holds ARGS[1].  The page
+   stays pinned while the thread sleeps, so that the physical
+   address that identifies the word cannot change. */
+static uint32_t
+sys_futex_wait (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  uint8_t *uaddr = (uint8_t *) args[0];
+  int result;
+
+  result = futex_wait (pin_futex (uaddr), args[1]);
+  unpin_user (uaddr);
+  return result;
+}
+
+/* Wakes up to ARGS[1] threads sleeping on the word at ARGS[0]. */
+static uint32_t
+sys_futex_wake (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  uint8_t *uaddr = (uint8_t *) args[0];
+  int result;
+
+  result = futex_wake (pin_futex (uaddr), args[1]);
+  unpin_user (uaddr);
+  return result;
+}
+
+/* Copies up to SIZE bytes from IN, starting at offset OFS, to OUT,
+   the console if OUT is null, a page at a time through kernel
+   page KBUF.  IN is read at OFS without moving its position; OUT
+   is written at its position.  Returns the number of bytes
+   copied, which is short at the end of IN or if OUT cannot grow,
+   or -1 if either is a directory or IN is a pipe. */
+static int
+send_file (struct file *out, struct file *in, off_t ofs, unsigned size,
+           uint8_t *kbuf)
+{
+  unsigned done = 0;
+
+  if (file_is_dir (in) || file_get_pipe (in) != NULL
+      || (out != NULL && file_is_dir (out)))
+    return -1;
+  while (done < size)
+    {
+      off_t chunk = size - done < PGSIZE ? size - done : PGSIZE;
+      off_t read, written;
+
+      read = file_read_at (in, kbuf, chunk, ofs + done);
+      if (read == 0)
+        break;
+      if (out == NULL)
+        {
+          putbuf ((const char *) kbuf, read);
+          written = read;
+        }
+      else
+        written = file_write (out, kbuf, read);
+      done += written;
+      if (read < chunk || written < read)
+        break;
+    }
+  return done;
+}
+
+/* Moves the position of open file ARGS[0] to ARGS[1]. */
+static uint32_t
+sys_seek (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  file_seek (lookup_fd (args[0]), args[1]);
+  return 0;
+}
+
+/* Returns the position of open file ARGS[0]. */
+static uint32_t
+sys_tell (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  return file_tell (lookup_fd (args[0]));
+}
+
+/* Closes file descriptor ARGS[0]. */
+static uint32_t
+sys_close (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  struct thread *t = process_current ();
+  struct file *file;
+
+  lock_acquire (&t->fds_lock);
+  file = fd_free (&t->fds, args[0]);
+  lock_release (&t->fds_lock);
+  if (file == NULL)
+    terminate (-1);
+  file_close (file);
+  return 0;
+}
+
+/* Creates a pipe and stores file descriptors for its read and
+   write ends, in that order, in the two ints at ARGS[0].  Returns
+   0 if successful, -1 if out of memory or descriptors. */
+static uint32_t
+sys_pipe (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  struct thread *t = process_current ();
+  struct pipe *p = pipe_create ();
+  struct file *read_end, *write_end;
+  int fds[2] = {-1, -1};
+
+  if (p == NULL)
+    return -1;
+  read_end = file_open_pipe (p, false);
+  write_end = file_open_pipe (p, true);
+  if (read_end != NULL && write_end != NULL)
+    {
+      lock_acquire (&t->fds_lock);
+      fds[0] = fd_alloc (&t->fds, read_end);
+      if (fds[0] >= 0)
+        {
+          fds[1] = fd_alloc (&t->fds, write_end);
+          if (fds[1] < 0)
+            fd_free (&t->fds, fds[0]);
+        }
+      lock_release (&t->fds_lock);
+    }
+  if (fds[1] < 0)
+    {
+      file_close (read_end);
+      file_close (write_end);
+      return -1;
+    }
+
+  if (!copy_to_user ((void *) args[0], fds, sizeof fds))
+    terminate (-1);
+  return 0;
+}
+
+/* Makes file descriptor ARGS[1] refer to a new copy of open file
+   ARGS[0], closing the file it referred to first, if any.  Giving
+   0 or 1 redirects the console, for this process and those it
+   runs with exec().  The copy of a file has a position of its
+   own, starting at ARGS[0]'s.  Returns ARGS[1], or -1 on
+   failure. */
+static uint32_t
+sys_dup2 (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  struct thread *t = process_current ();
+  struct file *file = find_fd (args[0]);
+  int new_fd = args[1];
+  struct file *copy, *old;
+  bool ok;
+
+  if (file == NULL || new_fd < 0)
+    return -1;
+  if (new_fd == (int) args[0])
+    return new_fd;
+  copy = file_reopen (file);
+  if (copy == NULL)
+    return -1;
+  file_seek (copy, file_tell (file));
+
+  lock_acquire (&t->fds_lock);
+  old = fd_free (&t->fds, new_fd);
+  ok = fd_install (&t->fds, new_fd, copy);
+  lock_release (&t->fds_lock);
+  file_close (old);
+  if (!ok)
+    {
+      file_close (copy);
+      return -1;
+    }
+  return new_fd;
+}
+
+/* Maps open file ARGS[0] at ARGS[1] and returns the mapping's
+   identifier, or -1 on failure. */
+static uint32_t
+sys_mmap (const uint32_t *args UNUSED, struct intr_frame *f UNUSED)
+{
+#ifdef VM
+  return mmap_map (lookup_fd (args[0]), (void *) args[1]);
+#else
+  return -1;
+#endif
+}
+
+/* Removes mapping ARGS[0], of a file or a shared memory segment,
+   writing back its dirty pages. */
+static uint32_t
+sys_munmap (const uint32_t *args UNUSED, struct intr_frame *f UNUSED)
+{
+#ifdef VM
+  mmap_unmap (args[0]);
+#endif
+  return 0;
+}
+
+/* Applies advice ARGS[2] to the ARGS[1] bytes of memory at
+   ARGS[0].  Returns 0 if successful, -1 if ARGS[0] is not
+   page-aligned or the range is not all user memory. */
+static uint32_t
+sys_madvise (const uint32_t *args UNUSED, struct intr_frame *f UNUSED)
+{
+#ifdef VM
+  return page_advise ((void *) args[0], args[1], args[2]) ? 0 : -1;
+#else
+  return -1;
+#endif
+}
+
+/* Applies advice ARGS[3] to the ARGS[2] bytes of open file ARGS[0]
+   starting at offset ARGS[1].  Returns 0 if successful, -1 on
+   failure. */
+static uint32_t
+sys_fadvise (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  return file_advise (lookup_fd (args[0]), args[1], args[2], args[3])
+         ? 0 : -1;
+}
+
+/* Changes the working directory to ARGS[0]. */
+static uint32_t
+sys_chdir (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  char *name = copy_in_string ((const char *) args[0]);
+  bool ok;
+
+  ok = filesys_chdir (name);
+  return ok;
+}
+
+/* Creates directory ARGS[0]. */
+static uint32_t
+sys_mkdir (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  char *name = copy_in_string ((const char *) args[0]);
+  bool ok;
+
+  ok = filesys_mkdir (name);
+  return ok;
+}
+
+/* Reads the next entry of directory ARGS[0] into ARGS[1], which
+   has room for NAME_MAX + 1 bytes.  The file descriptor's
+   position says which entry is next.  Returns false if ARGS[0]
+   is not a directory or has no more entries. */
+static uint32_t
+sys_readdir (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  struct file *file = lookup_fd (args[0]);
+  char name[NAME_MAX + 1];
+  struct dir *dir;
+  bool ok = false;
+
+  if (file_is_dir (file))
+    {
+      dir = dir_open (inode_reopen (file_get_inode (file)));
+      if (dir != NULL)
+        {
+          dir_seek (dir, file_tell (file));
+          ok = dir_readdir (dir, name);
+          file_seek (file, dir_tell (dir));
+          dir_close (dir);
+        }
+    }
+
+  if (ok && !copy_to_user ((void *) args[1], name, strlen (name) + 1))
+    terminate (-1);
+  return ok;
+}
+
+/* Reads up to ARGS[2] of the next entries of directory ARGS[0]
+   into the array of struct dirent at ARGS[1], as many at a time
+   as fit in a page.  The file descriptor's position says which
+   entry is next.  Returns the number of entries read, 0 at the
+   end of the directory, or -1 if ARGS[0] is not a directory. */
+static uint32_t
+sys_getdents (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  struct file *file = lookup_fd (args[0]);
+  size_t cnt = args[2];
+  struct dirent *ents;
+  struct dir *dir;
+  size_t found;
+  bool ok;
+
+  if (!file_is_dir (file))
+    return -1;
+  if (cnt > PGSIZE / sizeof *ents)
+    cnt = PGSIZE / sizeof *ents;
+
+  ents = arena_alloc (PGSIZE);
+  if (ents == NULL)
+    return -1;
+  dir = dir_open (inode_reopen (file_get_inode (file)));
+  if (dir == NULL)
+    return -1;
+  dir_seek (dir, file_tell (file));
+  found = dir_getdents (dir, ents, cnt);
+  file_seek (file, dir_tell (dir));
+  dir_close (dir);
+
+  ok = copy_to_user ((void *) args[1], ents, found * sizeof *ents);
+  if (!ok)
+    terminate (-1);
+  return found;
+}
+
+/* Stores the attributes of the file named ARGS[0] in the struct
+   stat at ARGS[1], from its inode, without opening a file.
+   Returns 0 if successful, -1 if there is no such file. */
+static uint32_t
+sys_stat (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  char *name = copy_in_string ((const char *) args[0]);
+  struct stat st;
+
+  if (!filesys_stat (name, &st))
+    return -1;
+  if (!copy_to_user ((void *) args[1], &st, sizeof st))
+    terminate (-1);
+  return 0;
+}
+
+/* Stores the attributes of open file ARGS[0] in the struct stat
+   at ARGS[1].  Returns 0 if successful, -1 if ARGS[0] is a
+   pipe. */
+static uint32_t
+sys_fstat (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  struct file *file = lookup_fd (args[0]);
+  struct stat st;
+
+  if (file_get_pipe (file) != NULL)
+    return -1;
+  inode_stat (file_get_inode (file), &st);
+  if (!copy_to_user ((void *) args[1], &st, sizeof st))
+    terminate (-1);
+  return 0;
+}
+
+/* Creates file ARGS[1] as a copy of file ARGS[0] that shares its
+   data sectors until either is written.  Returns true if
+   successful, false otherwise. */
+static uint32_t
+sys_clone_file (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  char *src = copy_in_string ((const char *) args[0]);
+  char *dst = copy_in_string ((const char *) args[1]);
+
+  return filesys_clone (src, dst);
+}
+
+/* Stores the resources used by the running process, if ARGS[0]
+   is RUSAGE_SELF, or by its children that it waited for and
+   theirs, if RUSAGE_CHILDREN, at ARGS[1].  Returns 0 if
+   successful, -1 if ARGS[0] is neither. */
+static uint32_t
+sys_getrusage (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  struct thread *cur = process_current ();
+  struct rusage *ru;
+
+  if ((int) args[0] == RUSAGE_SELF)
+    ru = &cur->rusage;
+  else if ((int) args[0] == RUSAGE_CHILDREN)
+    ru = &cur->child_rusage;
+  else
+    return -1;
+  if (!copy_to_user ((void *) args[1], ru, sizeof *ru))
+    terminate (-1);
+  return 0;
+}
+
+/* Runs the program in file ARGS[0] in a new process, with the
+   arguments in the null-terminated array ARGS[1], and its file
+   descriptors set up by the actions at ARGS[2], ended by one of
+   SPAWN_END, if ARGS[2] is nonnull.  Unlike exec(), the command
+   line is not joined and split again, and the child needs no
+   system calls of its own to redirect its input and output.
+   Waits for the program to load unless ARGS[3] has SPAWN_NOWAIT.
+   Returns the new process's pid, or -1 on failure. */
+static uint32_t
+sys_spawn (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  char *file = copy_in_string ((const char *) args[0]);
+  char *words = arena_alloc (PGSIZE);
+  struct fd_table fds;
+  size_t len;
+
+  if (words == NULL)
+    return -1;
+  memset (&fds, 0, sizeof fds);
+  if (!copy_in_argv ((char *const *) args[1], words, &len)
+      || !spawn_fds (&fds, (const struct spawn_action *) args[2]))
+    {
+      fd_table_destroy (&fds);
+      return -1;
+    }
+  return process_execv (file, words, len, &fds,
+                        !(args[3] & SPAWN_NOWAIT));
+}
+
+/* Waits for child ARGS[0] to load its program.  Returns 1 if it
+   did, 0 if it failed to, or -1 if ARGS[0] is not a child that
+   has yet to be waited for. */
+static uint32_t
+sys_spawn_status (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  return process_load_status (args[0]);
+}
+
+/* Stores a description of the ARGS[0]'th kernel tunable at
+   ARGS[1].  Returns false if there are no more tunables. */
+static uint32_t
+sys_sysctl_get (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  struct sysctl sc;
+
+  if (!tunable_get (args[0], &sc))
+    return false;
+  if (!copy_to_user ((void *) args[1], &sc, sizeof sc))
+    terminate (-1);
+  return true;
+}
+
+/* Sets the kernel tunable named ARGS[0] to ARGS[1].  Returns
+   false if there is no such tunable, it may be set only at boot,
+   or ARGS[1] is out of its range. */
+static uint32_t
+sys_sysctl_set (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  return tunable_set (copy_in_string ((const char *) args[0]), args[1]);
+}
+
+/* Makes the data written to file descriptor ARGS[0] durable, with
+   its metadata.  Returns 0 if successful, -1 if ARGS[0] is a
+   pipe. */
+static uint32_t
+sys_fsync (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  return file_sync (lookup_fd (args[0])) ? 0 : -1;
+}
+
+/* Makes the data written to file descriptor ARGS[0] durable.  A
+   file's only metadata is its length and where its data is, which
+   finding the data needs, so this is the same as fsync. */
+static uint32_t
+sys_fdatasync (const uint32_t *args, struct intr_frame *f)
+{
+  return sys_fsync (args, f);
+}
+
+/* Carries out fcntl() command ARGS[1] on file descriptor ARGS[0]:
+   F_GETFL returns its flags, and F_SETFL sets them to ARGS[2].
+   O_DIRECT is the only flag, and only files have it.  Returns -1
+   on failure, otherwise 0 for F_SETFL. */
+static uint32_t
+sys_fcntl (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  struct file *file = lookup_fd (args[0]);
+
+  switch (args[1])
+    {
+    case F_GETFL:
+      return ((file_is_direct (file) ? O_DIRECT : 0)
+              | (file_is_append (file) ? O_APPEND : 0));
+    case F_SETFL:
+      if ((args[2] & ~(O_DIRECT | O_APPEND)) != 0
+          || !file_set_direct (file, (args[2] & O_DIRECT) != 0)
+          || !file_set_append (file, (args[2] & O_APPEND) != 0))
+        return -1;
+      return 0;
+    default:
+      return -1;
+    }
+}
+
+/* Maps the network card's packet rings, NET_MAP_SIZE bytes laid
+   out as lib/net.h describes, for the process at page-aligned
+   user address ARGS[0].  The pages belong to the card, so they
+   are unmapped rather than freed when the process exits, and are
+   not inherited by fork().  Returns true if successful, false if
+   there is no card, another process has it, or the address range
+   is unusable. */
+static uint32_t
+sys_net_map (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  struct thread *t = process_current ();
+  uint8_t *upage = (uint8_t *) args[0];
+  size_t i;
+
+  if (t->net_ring != NULL || upage == NULL || pg_ofs (upage) != 0
+      || !is_user_range (upage, NET_MAP_SIZE))
+    return false;
+  for (i = 0; i < NET_MAP_SIZE / PGSIZE; i++)
+#ifdef VM
+    if (page_in_use (upage + i * PGSIZE))
+      return false;
+#else
+    if (pagedir_get_page (t->pagedir, upage + i * PGSIZE) != NULL)
+      return false;
+#endif
+
+  if (!e1000_claim ())
+    return false;
+  if (!pagedir_map_range (t->pagedir, upage, e1000_map_page (0),
+                          NET_MAP_SIZE / PGSIZE, true))
+    {
+      e1000_release ();
+      return false;
+    }
+  t->net_ring = upage;
+  return true;
+}
+
+/* Has the network card send the packets queued in the process's
+   send ring.  Returns the number of packets, or -1 if the process
+   has not mapped the rings or queued too many. */
+static uint32_t
+sys_net_send (const uint32_t *args UNUSED, struct intr_frame *f UNUSED)
+{
+  if (process_current ()->net_ring == NULL)
+    return -1;
+  return e1000_send ();
+}
+
+/* Gives the network card back the receive buffers the process
+   has consumed and, if ARGS[0] is true, waits for a packet.
+   Returns the number of packets waiting, or -1 if the process
+   has not mapped the rings. */
+static uint32_t
+sys_net_recv (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  if (process_current ()->net_ring == NULL)
+    return -1;
+  return e1000_recv (args[0] != 0);
+}
+
+/* Reserves ARGS[0] timer ticks of CPU time in every ARGS[1] for
+   the calling thread, due ARGS[2] ticks into each period, or gives
+   up its reservation if ARGS[0] is 0.  Returns true if successful,
+   false if the parameters are invalid or the CPU time is already
+   reserved by others. */
+static uint32_t
+sys_sched_deadline (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  return thread_set_deadline ((int) args[0], (int) args[1], (int) args[2]);
+}
+
+/* Returns true if ARGS[0] refers to a directory. */
+static uint32_t
+sys_isdir (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  struct file *file = lookup_fd (args[0]);
+
+  return file_is_dir (file);
+}
+
+/* Returns the inode number of open file ARGS[0], or -1 if it is
+   a pipe. */
+static uint32_t
+sys_inumber (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  struct file *file = lookup_fd (args[0]);
+
+  if (file_get_pipe (file) != NULL)
+    return -1;
+  return inode_get_inumber (file_get_inode (file));
+}
+
+/* Duplicates the process.  Returns the child's pid in the parent
+   and 0 in the child, or -1 on failure. */
+static uint32_t
+sys_fork (const uint32_t *args UNUSED, struct intr_frame *f UNUSED)
+{
+#ifdef VM
+  return process_fork (f);
+#else
+  return -1;
+#endif
+}
+
+/* Starts a thread in the process running at ARGS[0], called with
+   ARGS[1] and ARGS[2].  Returns its thread id, or -1 on failure. */
+static uint32_t
+sys_thread_spawn (const uint32_t *args UNUSED, struct intr_frame *f UNUSED)
+{
+#ifdef VM
+  if (!is_user_vaddr ((void *) args[0]))
+    terminate (-1);
+  return process_spawn ((void (*) (void)) args[0], args[1], args[2]);
+#else
+  return -1;
+#endif
+}
+
+/* Waits for thread ARGS[0] of the process to exit and stores its
+   exit status at ARGS[1].  Returns 0 if successful, or -1 at once
+   if ARGS[0] was not spawned in the process or already joined. */
+static uint32_t
+sys_thread_join (const uint32_t *args UNUSED, struct intr_frame *f UNUSED)
+{
+#ifdef VM
+  int status;
+
+  if (!process_join (args[0], &status))
+    return -1;
+  if (!copy_to_user ((void *) args[1], &status, sizeof status))
+    terminate (-1);
+  return 0;
+#else
+  return -1;
+#endif
+}
+
+/* Moves the end of the process's heap by ARGS[0] bytes.  Returns
+   the previous end, or -1 if the heap cannot be moved that far. */
+static uint32_t
+sys_sbrk (const uint32_t *args UNUSED, struct intr_frame *f UNUSED)
+{
+#ifdef VM
+  void *old = process_sbrk ((intptr_t) args[0]);
+
+  return old != NULL ? (uint32_t) old : (uint32_t) -1;
+#else
+  return -1;
+#endif
+}
+
+/* Creates a shared memory segment of ARGS[0] bytes, rounded up to
+   whole pages, that lives until the process and every process
+   that maps it are done with it.  Returns its identifier, or -1
+   if memory is not available. */
+static uint32_t
+sys_shm_create (const uint32_t *args UNUSED, struct intr_frame *f UNUSED)
+{
+#ifdef VM
+  return shm_create (args[0]);
+#else
+  return -1;
+#endif
+}
+
+/* Maps shared memory segment ARGS[0] at page-aligned user address
+   ARGS[1].  Returns a mapping identifier for munmap(), or -1 if
+   there is no such segment or the address is unusable. */
+static uint32_t
+sys_shm_map (const uint32_t *args UNUSED, struct intr_frame *f UNUSED)
+{
+#ifdef VM
+  return shm_map (args[0], (void *) args[1]);
+#else
+  return -1;
+#endif
+}
+
+/* Maps a new I/O ring for the process at page-aligned user
+   address ARGS[0].  The ring's page stays mapped, and so is
+   never paged out, until the process exits.  It is not inherited
+   by fork().  Returns true if successful, false if the process
+   already has a ring or the address is unusable. */
+static uint32_t
+sys_io_ring_setup (const uint32_t *args, struct intr_frame *f UNUSED)
+{
+  struct thread *t = process_current ();
+  void *upage = (void *) args[0];
+  void *kpage;
+
+  ASSERT (sizeof *t->io_ring <= PGSIZE);
+  if (t->io_ring != NULL || upage == NULL || pg_ofs (upage) != 0
+      || !is_user_vaddr (upage))
+    return false;
+#ifdef VM
+  if (page_in_use (upage))
+    return false;
+#else
+  if (pagedir_get_page (t->pagedir, upage) != NULL)
+    return false;
+#endif
+
+  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+  if (kpage == NULL)
+    return false;
+  if (!pagedir_set_page (t->pagedir, upage, kpage, true))
+    {
+      palloc_free_page (kpage);
+      return false;
+    }
+  t->io_ring = kpage;
+  return true;
+}
+
+/* Carries out the operations queued in the process's I/O ring
+   and posts their completions, stopping early if the completion
+   queue fills up.  The ring is accessed through the kernel's
+   mapping of its page, so only the operations' buffers go
+   through the user memory accessors.  Returns the number of
+   operations done, or -1 if the process has no ring. */
+static uint32_t
+sys_io_ring_enter (const uint32_t *args UNUSED, struct intr_frame *f UNUSED)
+{
+  struct io_ring *r = process_current ()->io_ring;
+  uint32_t head, tail;
+  uint8_t *kbuf;
+  int done = 0;
+
+  if (r == NULL)
+    return -1;
+  kbuf = arena_alloc (PGSIZE);
+  if (kbuf == NULL)
+    return -1;
+
+  /* The process may not touch the ring until we return. */
+  head = r->sq_head;
+  tail = r->sq_tail;
+  while (head != tail && r->cq_tail - r->cq_head < IO_RING_ENTRIES)
+    {
+      struct io_ring_sqe sqe = r->sq[head++ % IO_RING_ENTRIES];
+      struct io_ring_cqe *cqe = &r->cq[r->cq_tail % IO_RING_ENTRIES];
+
+      cqe->user_data = sqe.user_data;
+      cqe->res = io_ring_op (&sqe, kbuf);
+      r->cq_tail++;
+      done++;
+    }
+  r->sq_head = head;
+
+  return done;
+}
+
+/* Carries out I/O ring operation SQE using kernel page KBUF and
+   returns its result.  Bad file descriptors and buffers fail the
+   operation with -1 instead of terminating the process. */
+static int
+io_ring_op (const struct io_ring_sqe *sqe, uint8_t *kbuf)
+{
+  struct file *file = find_fd (sqe->fd);
+
+  switch (sqe->op)
+    {
+    case IO_RING_READ:
+      if (file == NULL && sqe->fd != STDIN_FILENO)
+        return -1;
+      return read_user (file, sqe->buf, sqe->len, kbuf);
+
+    case IO_RING_WRITE:
+      if (file == NULL && sqe->fd != STDOUT_FILENO)
+        return -1;
+      return write_user (file, sqe->buf, sqe->len, kbuf);
+
+    case IO_RING_SEEK:
+      if (file == NULL)
+        return -1;
+      file_seek (file, sqe->len);
+      return 0;
+
+    default:
+      return -1;
+    }
+}
+
+/* Returns the pid of the process.  Does nothing else, which
+   makes it the null system call for measuring entry costs. */
+static uint32_t
+sys_getpid (const uint32_t *args UNUSED, struct intr_frame *f UNUSED)
+{
+  return process_current ()->tid;
+}
+
+/* Returns true if the CPU supports SYSENTER and SYSEXIT, as
+   reported by CPUID function 1 in EDX bit 11. */
+static bool
+cpu_has_sysenter (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+
+  asm ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  return (edx & (1u << 11)) != 0;
+}
+
+/* Writes VALUE to model-specific register MSR. */
+static void
+wrmsr (uint32_t msr, uint32_t value)
+{
+  asm volatile ("wrmsr" : : "c" (msr), "a" (value), "d" (0));
+}
+
+/* Copies SIZE bytes from user address USRC to kernel address
+   DST, terminating the process if any of them is not valid user
+   memory. */
+static void
+copy_in (void *dst, const void *usrc, size_t size)
+{
+  if (!copy_from_user (dst, usrc, size))
+    terminate (-1);
+}
+
+/* Returns a copy of the null-terminated string at user address
+   US in a page of scratch memory, which lasts until the system
+   call returns.  Terminates the process if the string is not
+   valid user memory or does not fit in a page. */
+static char *
+copy_in_string (const char *us)
+{
+  char *ks;
+  size_t len;
+
+  ks = arena_alloc (PGSIZE);
+  if (ks == NULL)
+    terminate (-1);
+
+  for (len = 0; len < PGSIZE && is_user_vaddr (us + len); len++)
+    {
+      int c = get_user ((const uint8_t *) us + len);
+
+      if (c < 0)
+        break;
+      ks[len] = c;
+      if (c == '\0')
+        return ks;
+    }
+  terminate (-1);
+}
+
+/* Copies the strings of the null-terminated array UARGV in user
+   memory into WORDS, a page, each followed by a null character,
+   and stores their total length in *LEN.  Returns false if they
+   do not fit.  Terminates the process if UARGV or a string is
+   not valid user memory. */
+static bool
+copy_in_argv (char *const *uargv, char *words, size_t *len)
+{
+  size_t ofs = 0;
+
+  for (;; uargv++)
+    {
+      const char *us;
+
+      copy_in (&us, uargv, sizeof us);
+      if (us == NULL)
+        break;
+      for (;; ofs++, us++)
+        {
+          int c = is_user_vaddr (us) ? get_user ((const uint8_t *) us) : -1;
+
+          if (c < 0)
+            terminate (-1);
+          if (ofs >= PGSIZE)
+            return false;
+          words[ofs] = c;
+          if (c == '\0')
+            break;
+        }
+      ofs++;
+    }
+  *len = ofs;
+  return true;
+}
+
+/* Builds in FDS, an empty table, the file descriptors of a
+   process about to be spawned by the current one: first its
+   redirected descriptors 0 and 1, as exec() would, then those the
+   actions at UACTIONS in user memory, if nonnull, call for.
+   Returns false if an action is invalid, there are more than
+   SPAWN_ACTIONS_MAX, or out of memory; FDS is then to be
+   destroyed.  Terminates the process if UACTIONS is not valid
+   user memory. */
+static bool
+spawn_fds (struct fd_table *fds, const struct spawn_action *uactions)
+{
+  struct thread *t = process_current ();
+  int fd, i;
+
+  for (fd = STDIN_FILENO; fd <= STDOUT_FILENO; fd++)
+    {
+      struct file *file = find_fd (fd);
+      struct file *copy;
+
+      if (file == NULL)
+        continue;
+      copy = file_reopen (file);
+      if (copy == NULL || !fd_install (fds, fd, copy))
+        {
+          file_close (copy);
+          return false;
+        }
+      file_seek (copy, file_tell (file));
+    }
+
+  for (i = 0; uactions != NULL; i++)
+    {
+      struct spawn_action a;
+      struct file *file, *copy;
+
+      copy_in (&a, uactions + i, sizeof a);
+      if (a.op == SPAWN_END)
+        break;
+      if (i == SPAWN_ACTIONS_MAX || a.child_fd < 0)
+        return false;
+      if (a.op == SPAWN_CLOSE)
+        {
+          file_close (fd_free (fds, a.child_fd));
+          continue;
+        }
+      if (a.op != SPAWN_DUP2)
+        return false;
+
+      lock_acquire (&t->fds_lock);
+      file = fd_get (&t->fds, a.fd);
+      copy = file != NULL ? file_reopen (file) : NULL;
+      if (copy != NULL)
+        file_seek (copy, file_tell (file));
+      lock_release (&t->fds_lock);
+      if (copy == NULL)
+        return false;
+      file_close (fd_free (fds, a.child_fd));
+      if (!fd_install (fds, a.child_fd, copy))
+        {
+          file_close (copy);
+          return false;
+        }
+    }
+  return true;
+}
+
+/* User memory access.
+
+   User addresses are not validated page by page before they are
+   accessed.  Instead, each access that may fault is done by one
+   of the instructions below, each listed in the exception table
+   with the address to resume at.  When such an instruction faults
+   on a user address that cannot be paged in, page_fault() resumes
+   there with EAX set to -1.  Only the range check against
+   PHYS_BASE is done up front. */
+
+/* Returns true if the SIZE bytes at UADDR lie below PHYS_BASE. */
+static bool
+is_user_range (const void *uaddr, size_t size)
+{
+  uintptr_t start = (uintptr_t) uaddr;
+
+  return start + size >= start && start + size <= (uintptr_t) PHYS_BASE;
+}
+
+/* Copies SIZE bytes from SRC to DST, of which one is a user
+   address already checked with is_user_range().  Returns false
+   if the user address faulted. */
+static bool
+copy_user (void *dst, const void *src, size_t size)
+{
+  int result;
+
+  asm volatile ("0: rep movsb\n\t"
+                "xorl %0, %0\n"
+                "1:\n\t"
+                EX_TABLE (0b, 1b)
+                : "=&a" (result), "+D" (dst), "+S" (src), "+c" (size)
+                : : "memory");
+  return result == 0;
+}
+
+/* Copies SIZE bytes from user address USRC to DST.  Returns
+   false if USRC is not valid user memory. */
+static bool
+copy_from_user (void *dst, const void *usrc, size_t size)
+{
+  return is_user_range (usrc, size) && copy_user (dst, usrc, size);
+}
+
+/* Copies SIZE bytes from SRC to user address UDST.  Returns
+   false if UDST is not valid, writable user memory. */
+static bool
+copy_to_user (void *udst, const void *src, size_t size)
+{
+  return is_user_range (udst, size) && copy_user (udst, src, size);
+}
+
+/* Reads a byte at user virtual address UADDR, which must be
+   below PHYS_BASE.  Returns the byte value if successful, -1 if
+   a segfault occurred. */
+static int
+get_user (const uint8_t *uaddr)
+{
+  int result;
+
+  asm ("0: movzbl %1, %0\n"
+       "1:\n\t"
+       EX_TABLE (0b, 1b)
+       : "=&a" (result) : "m" (*uaddr));
+  return result;
+}
+
+/* Writes BYTE to user address UDST, which must be below
+   PHYS_BASE.  Returns true if successful, false if a segfault
+   occurred. */
+static bool
+put_user (uint8_t *udst, uint8_t byte)
+{
+  int error_code;
+
+  asm ("xorl %0, %0\n"
+       "0: movb %b2, %1\n"
+       "1:\n\t"
+       EX_TABLE (0b, 1b)
+       : "=&a" (error_code), "=m" (*udst) : "q" (byte));
+  return error_code != -1;
+}
+
+/* Makes the page of user address UADDR resident, writable and
+   private to the current process, keeps it so until
+   unpin_user(), and returns the kernel address that UADDR maps
+   to.  Returns a null pointer if UADDR is not valid, writable
+   user memory.  Writing a byte back through UADDR does the work,
+   by faulting the page in, growing the stack or breaking
+   copy-on-write sharing as a user write would. */
+static void *
+pin_user (uint8_t *uaddr)
+{
+  for (;;)
+    {
+      int c;
+
+      if (!is_user_vaddr (uaddr) || (c = get_user (uaddr)) < 0
+          || !put_user (uaddr, c))
+        return NULL;
+#ifdef VM
+      /* The page may have been evicted or shared again since, and
+         then the write above brings it back.  Its frame may also be
+         busy being evicted, so let that finish first. */
+      if (!page_pin (pg_round_down (uaddr)))
+        {
+          thread_yield ();
+          continue;
+        }
+#endif
+      return pagedir_get_page (thread_current ()->pagedir, uaddr);
+    }
+}
+
+/* Lets the page of user address UADDR, pinned by pin_user(), be
+   evicted again. */
+static void
+unpin_user (uint8_t *uaddr UNUSED)
+{
+#ifdef VM
+  page_unpin (pg_round_down (uaddr));
+#endif
+}
+
+/* Returns the open file FD of the current process, or a null
+   pointer if there is none. */
+static struct file *
+find_fd (int fd)
+{
+  struct thread *t = process_current ();
+  struct file *file;
+
+  lock_acquire (&t->fds_lock);
+  file = fd_get (&t->fds, fd);
+  lock_release (&t->fds_lock);
+  return file;
+}
+
+/* Returns the open file FD of the current process.  Terminates
+   the process if there is none. */
+static struct file *
+lookup_fd (int fd)
+{
+  struct file *file = find_fd (fd);
+
+  if (file == NULL)
+    terminate (-1);
+  return file;
+}
+
+/* Returns the open file FD of the current process, or a null
+   pointer for the console if FD is STD_FD and not redirected.
+   Terminates the process if FD is neither. */
+static struct file *
+lookup_std_fd (int fd, int std_fd)
+{
+  struct file *file = find_fd (fd);
+
+  if (file == NULL && fd != std_fd)
+    terminate (-1);
+  return file;
 }
 
+/* Terminates the current process with exit code STATUS. */
 static void
-syscall_handler (struct intr_frame *f UNUSED) 
+terminate (int status)
 {
-  printf ("system call!\n");
+  thread_current ()->exit_code = status;
   thread_exit ();
 }
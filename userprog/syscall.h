@@ -1,6 +1,19 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include <stdbool.h>
+
+struct thread;
+struct fd_table;
+
 void syscall_init (void);
+void syscall_print_stats (void);
+void syscall_exit (void);
+bool syscall_exec (struct thread *parent);
+bool syscall_fork (struct thread *parent);
+bool syscall_spawn (struct thread *parent, struct fd_table *);
+
+struct intr_frame;
+void syscall_sysenter (struct intr_frame *);
 
 #endif /* userprog/syscall.h */
@@ -96,6 +96,16 @@ tss_get (void)
   return tss;
 }
 
+/* Returns the address of the ring 0 stack pointer in the TSS,
+   which tss_update() keeps pointing to the end of the running
+   thread's stack. */
+void **
+tss_esp0 (void) 
+{
+  ASSERT (tss != NULL);
+  return &tss->esp0;
+}
+
 /* Sets the ring 0 stack pointer in the TSS to point to the end
    of the thread stack. */
 void
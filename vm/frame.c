@@ -0,0 +1,1436 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "threads/cycle.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/shrinker.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tunable.h"
+#include "threads/vaddr.h"
+#include "threads/vmstat.h"
+#include "devices/timer.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+
+/* Frame table.
+
+   Every user page brought in by page_load() sits in a frame on
+   a single list shared by all processes.  When the user pool
+   runs out, a victim is picked by the clock algorithm: a hand
+   sweeps the list, giving each frame whose accessed bit is set a
+   second chance by clearing the bit, and stops at the first
+   frame that has not been accessed since the hand last passed.
+   Each step of the hand either finds the victim or clears a bit
+   that has to be set again by the process before the hand comes
+   back, so an eviction is O(1) amortized.
+
+   A clean page is simply dropped: page_load() reads it back from
+   its file, or zeroes it.  A dirty page of a mapped file is
+   written back to the file.  Any other dirty page is written to
+   swap first, so it can only be evicted while swap has room.
+   Frames are pinned while being filled so that they cannot be
+   evicted before they are mapped.
+
+   Frames of read-only executable pages are shared between the
+   processes running the same executable, through a share table
+   keyed by the file's inode sector and the offset of the page.
+   A shared frame is evicted from all of its pages at once, and
+   freed when its last page goes away.
+
+   A forked process shares the frames of its parent's loaded
+   pages, mapped read-only in both.  A write to a formerly
+   writable page then faults into frame_copy_on_write(), which
+   gives the writer a private copy, or the frame itself once it is
+   the frame's only page.  Frames shared this way are evicted like
+   read-only ones while clean, and left alone while dirty, until
+   their sharing is broken.
+
+   Processes often hold pages with the same contents, zero-filled
+   buffers most of all.  A merge scanner thread, at the lowest
+   priority, walks the frame table once a second and hashes each
+   private, anonymous page.  A page whose hash is the same as on
+   the previous pass is taken to be stable and goes into a merge
+   table keyed by the hash.  When it meets a page already there
+   whose contents turn out to be identical, the page is remapped
+   read-only to the other page's frame, both become copy-on-write
+   just as after a fork, and its own frame is freed.  Pages whose
+   hash changed are still being written, so merging them would
+   soon cost a copy-on-write fault.
+
+   Global replacement lets one process that touches much memory
+   push out the pages every other process is using.  So each
+   process counts its resident pages, and a sampler thread
+   estimates its working set once a second, as the number of its
+   pages whose accessed bits were set since the last sample,
+   averaged with the previous estimate.  The sampler remembers
+   the bits it clears in the frame, so the clock still sees them.
+   A private frame of a process with more pages resident than its
+   working set gets no second chance from the clock, so eviction
+   falls first on processes holding more than they use.  With the
+   -frame-quota option, a process at its quota takes the frames
+   for its new pages from its own pages instead, by a clock sweep
+   over those alone.
+
+   A page of a mapped file is held by a single frame, which every
+   mapping of the page maps writable, and which the file's inode
+   indexes by offset, so that read() and write() of the file use
+   the frame as well (see filesys/inode.c), rather than another
+   copy in the buffer cache.  The page is dirty if any of its pages
+   is, or was when it was unmapped, and only then written back to
+   the file, when the frame is evicted or freed with its last page.
+   Locking an inode's index while frames_lock is held, to find or
+   remove such a frame, orders frames_lock before the inode's
+   locks.
+
+   Frames of shared memory segments (see vm/shm.c) are wired: they
+   are mapped writable by a page of each process that maps the
+   segment, never evicted, and only freed along with the segment,
+   not when their last page goes away.
+
+   Eviction on demand makes the fault that finds the user pool
+   empty wait for a victim to be written out.  To keep that rare,
+   a reclaim thread is woken whenever the number of free frames
+   drops below a low watermark, and evicts pages with the same
+   clock hand until it is back up to a high watermark.  Slots are
+   handed out next-fit, so the dirty pages it evicts one after
+   another are written to adjacent slots of swap.  It is also
+   woken when the kernel pool runs low, and then has the kernel's
+   caches give pages back through their shrinkers (see
+   threads/shrinker.h). */
+
+/* Frame table and clock hand. */
+static struct list frames;
+static struct list_elem *hand;
+static size_t frame_cnt;
+static struct lock frames_lock;
+
+/* Shared frames, by inode sector and offset. */
+static struct hash share_table;
+
+/* Stable pages seen in the merge scanner's current pass, by
+   checksum, and the next frame it is to scan, or a null pointer
+   between passes. */
+static struct hash merge_table;
+static struct list_elem *merge_cursor;
+
+/* Next frame the working-set sampler is to sample, or a null
+   pointer between passes. */
+static struct list_elem *ws_cursor;
+
+/* Frames scanned per hold of frames_lock, and ticks between
+   passes of the merge scanner. */
+#define MERGE_BATCH 16
+#define MERGE_INTERVAL TIMER_FREQ
+
+/* Resident page quota, 0 for none. */
+size_t frame_quota;
+
+/* Ticks between working-set samples. */
+#define WS_INTERVAL TIMER_FREQ
+
+/* Cache of frame table entries. */
+static struct kmem_cache *frame_cache;
+
+/* Statistics. */
+static unsigned alloc_cnt;      /* Frames allocated. */
+static unsigned share_cnt;      /* Pages mapped to a shared frame. */
+static unsigned file_cnt;       /* Frames of mapped files filled. */
+static unsigned evict_cnt;      /* Frames evicted. */
+static uint64_t evict_cycles;   /* Cycles spent evicting. */
+static unsigned reclaim_cnt;    /* Frames freed by the reclaim thread. */
+static unsigned merge_cnt;      /* Pages merged into another's frame. */
+static unsigned ws_evict_cnt;   /* Evicted beyond a process's working set. */
+static unsigned quota_cnt;      /* Evicted for a process at its quota. */
+
+/* Free frame watermarks, as numbers of free pages in the user
+   pool, and the same for the kernel pool.  All are 0 until the
+   reclaim thread is started, when they are registered as
+   tunables up to the size of their pools. */
+static size_t low_watermark, high_watermark;
+static size_t kernel_low_watermark, kernel_high_watermark;
+static struct tunable watermark_tunables[] =
+  {
+    {.name = "vm.low_watermark", .value = &low_watermark, .min = 1},
+    {.name = "vm.high_watermark", .value = &high_watermark, .min = 1},
+    {.name = "vm.kernel_low_watermark", .value = &kernel_low_watermark,
+     .min = 1},
+    {.name = "vm.kernel_high_watermark", .value = &kernel_high_watermark,
+     .min = 1},
+  };
+static struct condition reclaim_wanted;
+
+static struct frame *frame_get (struct thread *owner);
+static struct frame *frame_evict (struct thread *owner);
+static void frame_insert (struct frame *, void *kpage);
+static void frame_link (struct frame *, struct page *);
+static void frame_unmap (struct frame *, struct page *);
+static void frame_destroy (struct frame *);
+static void merge_forget (struct frame *);
+static thread_func reclaim_thread NO_RETURN;
+static thread_func merge_thread NO_RETURN;
+static thread_func ws_thread NO_RETURN;
+static hash_hash_func share_hash;
+static hash_less_func share_less;
+static hash_hash_func merge_hash;
+static hash_less_func merge_less;
+
+/**
+ * frame_init - initialize the frame table
+*/
+void frame_init(void)
+{
+	list_init(&frames);
+	hand = list_end(&frames);
+	lock_init_named(&frames_lock, "frames");
+	cond_init(&reclaim_wanted);
+	frame_cache = kmem_cache_create("frame", sizeof(struct frame), NULL);
+	if (frame_cache == NULL ||
+	    !hash_init(&share_table, share_hash, share_less, NULL) ||
+	    !hash_init(&merge_table, merge_hash, merge_less, NULL))
+		PANIC("frame_init: out of memory");
+}
+
+/**
+ * frame_start_reclaim - start the reclaim and scanning threads
+ *
+ * Set the free frame watermarks from the size of the user pool,
+ * which is to be all free, and start the thread that keeps that
+ * many frames free, along with the merge scanner and working-set
+ * sampler.  Must be called
+ * once the scheduler is running.
+*/
+void frame_start_reclaim(void)
+{
+	size_t pages = palloc_free_cnt(PAL_USER);
+	size_t i;
+
+	low_watermark = pages / 64 > 4 ? pages / 64 : 4;
+	high_watermark = 2 * low_watermark;
+	watermark_tunables[0].max = watermark_tunables[1].max =
+		pages > high_watermark ? pages : high_watermark;
+	pages = palloc_free_cnt(0);
+	kernel_low_watermark = pages / 64 > 4 ? pages / 64 : 4;
+	kernel_high_watermark = 2 * kernel_low_watermark;
+	watermark_tunables[2].max = watermark_tunables[3].max =
+		pages > kernel_high_watermark ? pages : kernel_high_watermark;
+	for (i = 0; i < sizeof watermark_tunables / sizeof *watermark_tunables;
+	     i++)
+		tunable_register(&watermark_tunables[i]);
+	if (thread_create("reclaim", PRI_DEFAULT, reclaim_thread, NULL) ==
+	    TID_ERROR)
+		PANIC("reclaim thread creation failed");
+	if (thread_create("merge", PRI_MIN, merge_thread, NULL) == TID_ERROR)
+		PANIC("merge thread creation failed");
+	if (thread_create("ws-sample", PRI_DEFAULT, ws_thread, NULL) ==
+	    TID_ERROR)
+		PANIC("working-set sampler creation failed");
+}
+
+/**
+ * frame_alloc - allocate a frame for a page
+ *
+ * @p: pointer to the page of the current process to hold, or NULL
+ *
+ * Get a frame from the user pool for the given page, evicting
+ * another page if the pool is exhausted, and make it the page's
+ * frame.  The frame is returned pinned and must be unpinned once
+ * the page is mapped.  A frame allocated for no page is to be
+ * given one with frame_attach(), or freed with frame_release().
+ * Return NULL if no frame can be found.
+*/
+struct frame *frame_alloc(struct page *p)
+{
+	struct frame *f;
+
+	lock_acquire(&frames_lock);
+
+	f = frame_get(p != NULL ? p->owner : NULL);
+	if (f != NULL && p != NULL) {
+		frame_link(f, p);
+	}
+
+	lock_release(&frames_lock);
+	return f;
+}
+
+/**
+ * frame_alloc_large - allocate frames for 4 MB of pages at once
+ *
+ * @pages: list of FRAME_LARGE_CNT pages of the current process,
+ *         linked through their frame_elem, in order of address from
+ *         one aligned to 4 MB, none in a frame or mapped
+ *
+ * Take FRAME_LARGE_CNT zeroed frames, physically contiguous and
+ * aligned to 4 MB, for the given pages, and map them all writable
+ * with one large page.  The frames are then frames like any other,
+ * and the large page is split into 4 kB pages as soon as one of
+ * the pages is unmapped or has its accessed bit cleared by the
+ * clock.  Return false, leaving the pages as they were, if the
+ * user pool cannot spare such a block without falling below the
+ * high watermark, the block is not aligned, or the process would
+ * exceed its quota.
+*/
+bool frame_alloc_large(struct list *pages)
+{
+	struct page *first = list_entry(list_front(pages), struct page,
+					frame_elem);
+	struct thread *t = first->owner;
+	struct list new_frames;
+	uint8_t *kpage;
+	size_t i;
+
+	ASSERT(list_size(pages) == FRAME_LARGE_CNT);
+	ASSERT(t == process_current());
+
+	if (palloc_free_cnt(PAL_USER) < FRAME_LARGE_CNT + high_watermark ||
+	    (frame_quota != 0 && t->resident + FRAME_LARGE_CNT > frame_quota))
+		return false;
+	kpage = palloc_get_multiple(PAL_USER | PAL_ZERO, FRAME_LARGE_CNT);
+	if (kpage == NULL)
+		return false;
+
+	/* Only the buddy allocator aligns blocks to their size. */
+	list_init(&new_frames);
+	if (vtop(kpage) % (FRAME_LARGE_CNT * PGSIZE) != 0)
+		goto fail;
+	for (i = 0; i < FRAME_LARGE_CNT; i++) {
+		struct frame *f = kmem_cache_alloc(frame_cache);
+
+		if (f == NULL)
+			goto fail;
+		list_push_back(&new_frames, &f->elem);
+	}
+
+	lock_acquire(&frames_lock);
+	if (!pagedir_set_large(t->pagedir, first->upage, kpage, true)) {
+		lock_release(&frames_lock);
+		goto fail;
+	}
+	for (i = 0; i < FRAME_LARGE_CNT; i++) {
+		struct page *p = list_entry(list_pop_front(pages), struct page,
+					    frame_elem);
+		struct frame *f = list_entry(list_pop_front(&new_frames),
+					     struct frame, elem);
+
+		frame_insert(f, kpage + i * PGSIZE);
+		f->pinned = false;
+		f->referenced = false;
+		f->wired = false;
+		f->shared = false;
+		f->mapped = false;
+		f->checksum = 0;
+		frame_link(f, p);
+	}
+	alloc_cnt += FRAME_LARGE_CNT;
+	if (palloc_free_cnt(PAL_USER) < low_watermark)
+		cond_signal(&reclaim_wanted, &frames_lock);
+	lock_release(&frames_lock);
+	return true;
+
+fail:
+	while (!list_empty(&new_frames))
+		kmem_cache_free(frame_cache,
+				list_entry(list_pop_front(&new_frames),
+					   struct frame, elem));
+	palloc_free_multiple(kpage, FRAME_LARGE_CNT);
+	return false;
+}
+
+/**
+ * frame_attach - make a frame allocated for no page a page's frame
+ *
+ * @f: pointer to a pinned frame with no pages
+ * @p: pointer to a page of the current process, in no frame
+*/
+void frame_attach(struct frame *f, struct page *p)
+{
+	ASSERT(f->pinned && p->frame == NULL);
+
+	lock_acquire(&frames_lock);
+	ASSERT(list_empty(&f->pages));
+	frame_link(f, p);
+	lock_release(&frames_lock);
+}
+
+/**
+ * frame_release - free a frame allocated for no page
+ *
+ * @f: pointer to a pinned frame with no pages
+*/
+void frame_release(struct frame *f)
+{
+	ASSERT(f->pinned);
+
+	lock_acquire(&frames_lock);
+	ASSERT(list_empty(&f->pages));
+	frame_destroy(f);
+	lock_release(&frames_lock);
+}
+
+/**
+ * frame_map_shared - map a page to a shared frame
+ *
+ * @p: pointer to a read-only file page of the current process
+ *
+ * Map the given page to the shared frame holding the same page of
+ * the same file, read to the same length, if there is one that is
+ * already filled.  Return
+ * false if there is none or it could not be mapped.
+*/
+bool frame_map_shared(struct page *p)
+{
+	struct frame key, *f;
+	struct hash_elem *e;
+	bool success = false;
+
+	ASSERT(!p->writable && p->file != NULL);
+
+	key.sector = inode_get_inumber(file_get_inode(p->file));
+	key.ofs = p->ofs;
+	key.read_bytes = p->read_bytes;
+
+	lock_acquire(&frames_lock);
+
+	e = hash_find(&share_table, &key.share_elem);
+	if (e != NULL) {
+		f = hash_entry(e, struct frame, share_elem);
+		if (!f->pinned &&
+		    pagedir_set_page(p->owner->pagedir, p->upage, f->kpage,
+				     false)) {
+			frame_link(f, p);
+			share_cnt++;
+			success = true;
+		}
+	}
+
+	lock_release(&frames_lock);
+	return success;
+}
+
+/**
+ * frame_publish - make a frame available for sharing
+ *
+ * @f: pointer to a pinned frame, filled with a read-only file page
+ *
+ * Add the given frame to the share table, unless a frame for the
+ * same page of the same file, read to the same length, is already
+ * there.
+*/
+void frame_publish(struct frame *f)
+{
+	struct page *p;
+
+	ASSERT(f->pinned);
+	ASSERT(list_size(&f->pages) == 1);
+
+	p = list_entry(list_front(&f->pages), struct page, frame_elem);
+	ASSERT(!p->writable && p->file != NULL);
+
+	lock_acquire(&frames_lock);
+	f->sector = inode_get_inumber(file_get_inode(p->file));
+	f->ofs = p->ofs;
+	f->read_bytes = p->read_bytes;
+	f->shared = hash_insert(&share_table, &f->share_elem) == NULL;
+	lock_release(&frames_lock);
+}
+
+/* Returns the frame holding the page of a mapped file IPAGE. */
+static struct frame *
+ipage_frame (struct inode_page *ipage)
+{
+  return (struct frame *) ((uint8_t *) ipage
+                           - offsetof (struct frame, ipage));
+}
+
+/**
+ * frame_map_file - map a page of a mapped file to its frame
+ *
+ * @p: pointer to a page of a file mapping of the current process
+ *
+ * Map the given page, writable, to the frame that already holds the
+ * same page of the same file for some mapping, if there is one.
+ * Return false if there is none, it holds a different number of
+ * bytes of the file, or it could not be mapped.
+*/
+bool frame_map_file(struct page *p)
+{
+	struct inode *inode = file_get_inode(p->file);
+	struct inode_page *ipage;
+	bool success = false;
+
+	ASSERT(p->writeback && p->file != NULL);
+
+	lock_acquire(&frames_lock);
+
+	ipage = inode_find_page(inode, p->ofs);
+	if (ipage != NULL && ipage->size == (off_t)p->read_bytes) {
+		struct frame *f = ipage_frame(ipage);
+
+		if (pagedir_set_page(p->owner->pagedir, p->upage, f->kpage,
+				     true)) {
+			frame_link(f, p);
+			share_cnt++;
+			success = true;
+		}
+	}
+
+	lock_release(&frames_lock);
+	return success;
+}
+
+/**
+ * frame_add_file - fill a frame with a page of a mapped file
+ *
+ * @f: pointer to a pinned frame allocated for a page of a file mapping
+ *
+ * Read the page into the given frame and have the file's inode index
+ * it, so that the frame is the file's copy of the page, shared by
+ * every mapping of it.  Return false, leaving the frame empty, if the
+ * inode already holds the page in another frame or memory is not
+ * available.
+*/
+bool frame_add_file(struct frame *f)
+{
+	struct page *p;
+
+	ASSERT(f->pinned);
+	ASSERT(list_size(&f->pages) == 1);
+
+	p = list_entry(list_front(&f->pages), struct page, frame_elem);
+	ASSERT(p->writeback && p->file != NULL);
+
+	/* F is pinned and has no other page, so no one looks at these
+	   members until the inode indexes it. */
+	f->inode = file_get_inode(p->file);
+	f->ipage.ofs = p->ofs;
+	f->ipage.size = p->read_bytes;
+	f->ipage.data = f->kpage;
+	f->dirty = false;
+	f->mapped = true;
+	memset((uint8_t *)f->kpage + p->read_bytes, 0,
+	       PGSIZE - p->read_bytes);
+	if (!inode_add_page(f->inode, &f->ipage)) {
+		f->mapped = false;
+		return false;
+	}
+	file_cnt++;
+	return true;
+}
+
+/**
+ * frame_wire - hand a frame over to a shared memory segment
+ *
+ * @f: pointer to a pinned frame allocated for no page, filled in
+ *
+ * Unpin the given frame, which is never to be evicted nor freed
+ * until frame_unwire().
+*/
+void frame_wire(struct frame *f)
+{
+	ASSERT(f->pinned);
+
+	lock_acquire(&frames_lock);
+	ASSERT(list_empty(&f->pages));
+	f->wired = true;
+	f->pinned = false;
+	lock_release(&frames_lock);
+}
+
+/**
+ * frame_map_wired - map a page to a wired frame
+ *
+ * @f: pointer to a wired frame
+ * @p: pointer to a writable page of the current process, in no frame
+ *
+ * Return false if the page cannot be mapped.
+*/
+bool frame_map_wired(struct frame *f, struct page *p)
+{
+	bool success;
+
+	ASSERT(f->wired && p->frame == NULL && p->writable);
+
+	lock_acquire(&frames_lock);
+	success = pagedir_set_page(p->owner->pagedir, p->upage, f->kpage,
+				   true);
+	if (success) {
+		frame_link(f, p);
+	}
+	lock_release(&frames_lock);
+	return success;
+}
+
+/**
+ * frame_unwire - free a wired frame
+ *
+ * @f: pointer to a wired frame with no pages
+*/
+void frame_unwire(struct frame *f)
+{
+	ASSERT(f->wired);
+
+	lock_acquire(&frames_lock);
+	ASSERT(list_empty(&f->pages));
+	frame_destroy(f);
+	lock_release(&frames_lock);
+}
+
+/**
+ * frame_share_cow - share a page's frame with a forked page
+ *
+ * @p: pointer to a page of the parent process, whose page table
+ *     lock is held
+ * @c: pointer to the same page of the current, forked, process
+ * @slot: set to the swap slot that holds the parent page's data,
+ *        or SWAP_NONE
+ *
+ * If the given parent page is in a frame, map the child page to the
+ * frame too, read-only.  A writable page becomes copy-on-write in
+ * both processes.  Otherwise, set @slot to the parent page's swap
+ * slot, for the caller to read a copy from.  Eviction moves a page
+ * from its frame to its slot under frames_lock, and with its page
+ * table lock held the parent cannot fault it back in, so the page
+ * is found in one place or the other, and the slot stays written
+ * until the caller has read it.  Return false if the child page
+ * cannot be mapped.
+*/
+bool frame_share_cow(struct page *p, struct page *c, size_t *slot)
+{
+	uint32_t *ppd = p->owner->pagedir, *cpd = c->owner->pagedir;
+	struct frame *f;
+	bool success = true;
+
+	ASSERT(lock_held_by_current_thread(&p->owner->spt_lock));
+
+	lock_acquire(&frames_lock);
+
+	f = p->frame;
+	*slot = f == NULL ? p->swap_slot : SWAP_NONE;
+	if (f != NULL) {
+		success = pagedir_set_page(cpd, c->upage, f->kpage, false);
+		if (success) {
+			/* The frame may differ from the page's file. */
+			pagedir_set_dirty(cpd, c->upage,
+					  pagedir_is_dirty(ppd, p->upage));
+			frame_link(f, c);
+			if (p->writable) {
+				pagedir_set_writable(ppd, p->upage, false);
+				p->cow = c->cow = true;
+			}
+		}
+	}
+
+	lock_release(&frames_lock);
+	return success;
+}
+
+/**
+ * frame_copy_on_write - break the sharing of a copy-on-write page
+ *
+ * @p: pointer to a copy-on-write page of the current process
+ *
+ * Make the given page writable, in a private copy of its frame if
+ * other pages still share it.  Return false if memory is not
+ * available for the copy.
+*/
+bool frame_copy_on_write(struct page *p)
+{
+	uint32_t *pd = p->owner->pagedir;
+	struct frame *f, *copy;
+
+	lock_acquire(&frames_lock);
+
+	/* Evicted meanwhile: the page faults back in writable. */
+	f = p->frame;
+	if (f == NULL) {
+		lock_release(&frames_lock);
+		return true;
+	}
+	ASSERT(p->cow);
+
+	if (list_size(&f->pages) == 1) {
+		pagedir_set_writable(pd, p->upage, true);
+		p->cow = false;
+		lock_release(&frames_lock);
+		return true;
+	}
+
+	/* Keep F from being picked while getting the copy. */
+	f->pinned = true;
+	copy = frame_get(NULL);
+	f->pinned = false;
+	if (copy == NULL) {
+		lock_release(&frames_lock);
+		return false;
+	}
+	memcpy(copy->kpage, f->kpage, PGSIZE);
+	frame_unmap(f, p);
+	if (!pagedir_set_page(pd, p->upage, copy->kpage, true)) {
+		/* Cannot happen: the page table is already there. */
+		PANIC("frame_copy_on_write: cannot map copy");
+	}
+	pagedir_set_dirty(pd, p->upage, true);
+	frame_link(copy, p);
+	copy->pinned = false;
+
+	lock_release(&frames_lock);
+	return true;
+}
+
+/**
+ * frame_exchange - give a page's frame a different kernel page
+ *
+ * @p: pointer to a writable, private page of the current process
+ * @kpage: kernel page holding the page's new contents
+ *
+ * If the given page is in an unpinned frame of its own, remap it to
+ * the given kernel page, marked dirty, and make that the frame's
+ * page.  Return the kernel page the frame held before, which the
+ * caller now owns, or a null pointer if the page cannot be
+ * exchanged.
+*/
+void *frame_exchange(struct page *p, void *kpage)
+{
+	uint32_t *pd = p->owner->pagedir;
+	struct frame *f;
+	void *old = NULL;
+
+	ASSERT(pg_ofs(kpage) == 0);
+
+	lock_acquire(&frames_lock);
+
+	f = p->frame;
+	if (f != NULL && !f->pinned && !f->wired && !f->shared &&
+	    !f->mapped && list_size(&f->pages) == 1 && p->writable && !p->cow) {
+		old = f->kpage;
+		pagedir_replace_page(pd, p->upage, kpage);
+		f->kpage = kpage;
+	}
+
+	lock_release(&frames_lock);
+	return old;
+}
+
+/**
+ * frame_pin - keep the frame holding a page from being evicted
+ *
+ * @p: pointer to a page of the current process
+ *
+ * Pin the frame that holds the given page, if it is in one, no one
+ * else has it pinned, and the page is not copy-on-write, which it
+ * may have become since the caller looked, by merging.  Return
+ * false otherwise.
+*/
+bool frame_pin(struct page *p)
+{
+	struct frame *f;
+	bool success = false;
+
+	lock_acquire(&frames_lock);
+	f = p->frame;
+	if (f != NULL && !f->pinned && !p->cow) {
+		f->pinned = true;
+		success = true;
+	}
+	lock_release(&frames_lock);
+	return success;
+}
+
+/**
+ * frame_unpin - allow a frame to be evicted
+ *
+ * @f: pointer to the frame, holding a mapped page
+*/
+void frame_unpin(struct frame *f)
+{
+	ASSERT(f->pinned);
+	f->pinned = false;
+}
+
+/**
+ * frame_free - free the frame holding a page
+ *
+ * @p: pointer to the page of the current process
+ *
+ * Unmap the given page, if it is in a frame, and give the frame back
+ * to the user pool unless other pages still share it or it is
+ * wired.  A dirty page of a mapped file is written back to the file
+ * first.
+*/
+void frame_free(struct page *p)
+{
+	struct frame *f;
+
+	lock_acquire(&frames_lock);
+
+	f = p->frame;
+	if (f != NULL && f->mapped) {
+		ASSERT(p->owner == process_current());
+
+		/* The page's dirty bit goes away with the mapping. */
+		if (pagedir_is_dirty(p->owner->pagedir, p->upage))
+			f->dirty = true;
+		frame_unmap(f, p);
+
+		if (list_empty(&f->pages)) {
+			inode_remove_page(f->inode, &f->ipage, f->dirty);
+			frame_destroy(f);
+		}
+	} else if (f != NULL) {
+		ASSERT(p->owner == process_current());
+		if (p->writeback && pagedir_is_dirty(p->owner->pagedir,
+						     p->upage))
+			file_write_at(p->file, f->kpage, p->read_bytes, p->ofs);
+		frame_unmap(f, p);
+
+		if (list_empty(&f->pages) && !f->wired)
+			frame_destroy(f);
+	}
+
+	lock_release(&frames_lock);
+}
+
+/* Prints frame table statistics. */
+void
+frame_print_stats (void)
+{
+  printf ("Frames: %u allocated, %u shared, %u evicted (%u reclaimed), "
+          "%llu swapped, %llu cycles/eviction\n", alloc_cnt, share_cnt,
+          evict_cnt, reclaim_cnt, vmstat_read (VMSTAT_SWAP_OUT),
+          evict_cnt ? evict_cycles / evict_cnt : 0);
+  printf ("Frames: %u pages of mapped files read in, %u pages merged\n",
+          file_cnt, merge_cnt);
+  printf ("Frames: %u evicted beyond working sets, %u within quotas\n",
+          ws_evict_cnt, quota_cnt);
+}
+
+/* Gets a frame from the user pool, evicting a page if the pool
+   is exhausted, and returns it pinned and with no pages.  If
+   OWNER, the process the frame is for, if any, is at its quota,
+   evicts one of its own pages instead.  Wakes the reclaim thread
+   if the pool is running low.  Returns a null pointer if no frame
+   can be found.  Caller must hold frames_lock. */
+static struct frame *
+frame_get (struct thread *owner)
+{
+  struct frame *f = NULL;
+  void *kpage = NULL;
+
+  if (owner != NULL && frame_quota != 0 && owner->resident >= frame_quota)
+    {
+      f = frame_evict (owner);
+      if (f != NULL)
+        quota_cnt++;
+    }
+  if (f == NULL)
+    kpage = palloc_get_page (PAL_USER);
+  if (palloc_free_cnt (PAL_USER) < low_watermark
+      || palloc_free_cnt (0) < kernel_low_watermark)
+    cond_signal (&reclaim_wanted, &frames_lock);
+  if (f != NULL)
+    merge_forget (f);
+  else if (kpage != NULL)
+    {
+      f = kmem_cache_alloc (frame_cache);
+      if (f == NULL)
+        {
+          palloc_free_page (kpage);
+          return NULL;
+        }
+      frame_insert (f, kpage);
+    }
+  else
+    {
+      f = frame_evict (NULL);
+      if (f == NULL)
+        return NULL;
+      merge_forget (f);
+    }
+  f->pinned = true;
+  f->referenced = false;
+  f->wired = false;
+  f->shared = false;
+  f->mapped = false;
+  f->checksum = 0;
+  alloc_cnt++;
+  return f;
+}
+
+/* Makes F, newly allocated, the frame of KPAGE, with no pages,
+   and adds it to the frame table.  Caller must hold
+   frames_lock. */
+static void
+frame_insert (struct frame *f, void *kpage)
+{
+  f->kpage = kpage;
+  list_init (&f->pages);
+  f->merge_listed = false;
+  /* Insert just behind the hand, last to be considered. */
+  list_insert (hand, &f->elem);
+  frame_cnt++;
+}
+
+/* Adds page P to frame F, and counts it among the pages its
+   process has resident. */
+static void
+frame_link (struct frame *f, struct page *p)
+{
+  struct thread *t = p->owner;
+
+  list_push_back (&f->pages, &p->frame_elem);
+  p->frame = f;
+  if (++t->resident > t->rusage.max_resident)
+    t->rusage.max_resident = t->resident;
+}
+
+/* Removes page P from frame F and unmaps it. */
+static void
+frame_unmap (struct frame *f, struct page *p)
+{
+  ASSERT (p->frame == f);
+
+  p->owner->resident--;
+  pagedir_clear_page (p->owner->pagedir, p->upage);
+  list_remove (&p->frame_elem);
+  p->frame = NULL;
+  p->cow = false;
+}
+
+/* Removes F, which has no pages left, from the frame table and
+   gives its page back to the user pool.  Caller must hold
+   frames_lock. */
+static void
+frame_destroy (struct frame *f)
+{
+  if (f->shared)
+    hash_delete (&share_table, &f->share_elem);
+  merge_forget (f);
+  if (hand == &f->elem)
+    hand = list_next (hand);
+  if (merge_cursor == &f->elem)
+    merge_cursor = list_next (merge_cursor);
+  if (ws_cursor == &f->elem)
+    ws_cursor = list_next (ws_cursor);
+  list_remove (&f->elem);
+  frame_cnt--;
+  palloc_free_page (f->kpage);
+  kmem_cache_free (frame_cache, f);
+}
+
+/* Returns true if any page of frame F is dirty. */
+static bool
+frame_dirty (struct frame *f)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+
+      if (pagedir_is_dirty (p->owner->pagedir, p->upage))
+        return true;
+    }
+  return false;
+}
+
+/* Returns true if any page of frame F was accessed since the
+   last call, clearing the accessed bits, including those cleared
+   meanwhile by the working-set sampler. */
+static bool
+frame_accessed (struct frame *f)
+{
+  struct list_elem *e;
+  bool accessed = f->referenced;
+
+  f->referenced = false;
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+
+      if (pagedir_is_accessed (p->owner->pagedir, p->upage))
+        {
+          pagedir_set_accessed (p->owner->pagedir, p->upage, false);
+          accessed = true;
+        }
+    }
+  return accessed;
+}
+
+/* Returns the process whose private page frame F holds, or a
+   null pointer if F is shared, wired, or holds no page or a
+   page of a mapped file. */
+static struct thread *
+frame_owner (struct frame *f)
+{
+  if (f->shared || f->wired || f->mapped || list_size (&f->pages) != 1)
+    return NULL;
+  return list_entry (list_front (&f->pages), struct page,
+                     frame_elem)->owner;
+}
+
+/* Returns true if frame F, just found accessed, is to be evicted
+   all the same, since its process has more pages resident than
+   its working set. */
+static bool
+frame_beyond_ws (struct frame *f)
+{
+  struct thread *t = frame_owner (f);
+
+  if (t == NULL || t->ws_size == 0 || t->resident <= t->ws_size)
+    return false;
+  ws_evict_cnt++;
+  return true;
+}
+
+/* Picks a victim with the clock algorithm, unmaps its pages, and
+   returns it, in the share table no more, for reuse.  If OWNER is
+   nonnull, considers only frames of OWNER's private pages.
+   Returns a null pointer if every frame is pinned, or dirty with
+   swap full.  Caller must hold frames_lock. */
+static struct frame *
+frame_evict (struct thread *owner)
+{
+  uint64_t start = rdtsc ();
+  size_t steps;
+
+  /* Two sweeps clear every accessed bit, so a longer search
+     cannot succeed. */
+  for (steps = 0; steps <= 2 * frame_cnt; steps++)
+    {
+      struct frame *f;
+      struct page *p;
+      uint32_t *pd;
+      size_t slot = SWAP_NONE;
+      bool writeback = false;
+      enum intr_level old_level;
+
+      if (hand == list_end (&frames))
+        hand = list_begin (&frames);
+      if (hand == list_end (&frames))
+        break;
+      f = list_entry (hand, struct frame, elem);
+      hand = list_next (hand);
+      if (f->pinned || f->wired
+          || (owner != NULL && frame_owner (f) != owner))
+        continue;
+      if (frame_accessed (f) && (owner != NULL || !frame_beyond_ws (f)))
+        continue;
+
+      if (f->mapped)
+        {
+          /* Unmap every page, keeping their owners from dirtying
+             them meanwhile, then write the data back if any of
+             them did.  Faults on the pages wait for frames_lock,
+             and find the page no longer in the inode's index. */
+          bool dirty;
+
+          old_level = intr_disable ();
+          dirty = f->dirty || frame_dirty (f);
+          while (!list_empty (&f->pages))
+            frame_unmap (f, list_entry (list_front (&f->pages),
+                                        struct page, frame_elem));
+          intr_set_level (old_level);
+          inode_remove_page (f->inode, &f->ipage, dirty);
+          f->mapped = false;
+          vmstat_count (dirty ? VMSTAT_EVICT_DIRTY : VMSTAT_EVICT_CLEAN);
+          evict_cnt++;
+          evict_cycles += rdtsc () - start;
+          return f;
+        }
+
+      if (f->shared || list_size (&f->pages) > 1)
+        {
+          /* Shared read-only frames are clean.  Copy-on-write
+             frames are skipped unless clean too.  The pages
+             are read-only, so this cannot change under us. */
+          if (!f->shared && frame_dirty (f))
+            continue;
+          while (!list_empty (&f->pages))
+            frame_unmap (f, list_entry (list_front (&f->pages),
+                                        struct page, frame_elem));
+          if (f->shared)
+            hash_delete (&share_table, &f->share_elem);
+          f->shared = false;
+          vmstat_count (VMSTAT_EVICT_CLEAN);
+          evict_cnt++;
+          evict_cycles += rdtsc () - start;
+          return f;
+        }
+
+      p = list_entry (list_front (&f->pages), struct page, frame_elem);
+      pd = p->owner->pagedir;
+
+      /* Keep the owner from dirtying the page while it is
+         being unmapped. */
+      old_level = intr_disable ();
+      if (pagedir_is_dirty (pd, p->upage) && p->writeback)
+        writeback = true;
+      else if (pagedir_is_dirty (pd, p->upage))
+        {
+          slot = swap_alloc (&p->owner->swap_next);
+          if (slot == SWAP_NONE)
+            {
+              intr_set_level (old_level);
+              continue;
+            }
+        }
+      frame_unmap (f, p);
+      p->swap_slot = slot;
+      intr_set_level (old_level);
+
+      /* The owner may fault the page back in while it is being
+         written, but its frame_alloc() waits for frames_lock. */
+      if (writeback)
+        file_write_at (p->file, f->kpage, p->read_bytes, p->ofs);
+      else if (slot != SWAP_NONE)
+        swap_write (slot, f->kpage);
+      vmstat_count (writeback || slot != SWAP_NONE
+                    ? VMSTAT_EVICT_DIRTY : VMSTAT_EVICT_CLEAN);
+      evict_cnt++;
+      evict_cycles += rdtsc () - start;
+      return f;
+    }
+  return NULL;
+}
+
+/* Reclaim thread.  Each time it is woken, evicts pages and
+   gives their frames back to the user pool until the pool has
+   high_watermark free pages, or nothing more can be evicted.
+   frames_lock is let go between evictions, so that faulting
+   processes are not held up for the whole batch.  Then, if the
+   kernel pool is below kernel_low_watermark, shrinks the kernel's
+   caches toward kernel_high_watermark free pages. */
+static void
+reclaim_thread (void *aux UNUSED)
+{
+  size_t free_cnt;
+
+  lock_acquire (&frames_lock);
+  for (;;)
+    {
+      cond_wait (&reclaim_wanted, &frames_lock);
+      while (palloc_free_cnt (PAL_USER) < high_watermark)
+        {
+          struct frame *f = frame_evict (NULL);
+          if (f == NULL)
+            break;
+          frame_destroy (f);
+          reclaim_cnt++;
+
+          lock_release (&frames_lock);
+          thread_yield ();
+          lock_acquire (&frames_lock);
+        }
+
+      free_cnt = palloc_free_cnt (0);
+      if (free_cnt < kernel_low_watermark)
+        {
+          lock_release (&frames_lock);
+          shrink_memory (kernel_high_watermark - free_cnt);
+          lock_acquire (&frames_lock);
+        }
+    }
+}
+
+/* Removes F from the merge table, if it is there.  Caller must
+   hold frames_lock. */
+static void
+merge_forget (struct frame *f)
+{
+  if (f->merge_listed)
+    {
+      hash_delete (&merge_table, &f->merge_elem);
+      f->merge_listed = false;
+    }
+}
+
+/* Returns true if frame F may take part in merging: it is in no
+   table but the frame table, and holds either a single private,
+   writable, anonymous page, or pages already mapped read-only, as
+   after a fork or an earlier merge.  Caller must hold
+   frames_lock. */
+static bool
+mergeable (struct frame *f)
+{
+  struct page *p;
+
+  if (f->pinned || f->wired || f->shared || f->mapped
+      || list_empty (&f->pages))
+    return false;
+  if (list_size (&f->pages) > 1)
+    return true;
+  p = list_entry (list_front (&f->pages), struct page, frame_elem);
+  return (p->writable && !p->cow && !p->writeback
+          && !pagedir_is_large (p->owner->pagedir, p->upage));
+}
+
+/* Merges the single page of frame F into frame TARGET, if their
+   contents are the same, making every page of TARGET
+   copy-on-write, and frees F.  Returns true if successful.
+   Caller must hold frames_lock. */
+static bool
+merge_frames (struct frame *target, struct frame *f)
+{
+  struct page *p = list_entry (list_front (&f->pages), struct page,
+                               frame_elem);
+  uint32_t *pd = p->owner->pagedir;
+  enum intr_level old_level;
+  bool dirty;
+
+  ASSERT (list_size (&f->pages) == 1);
+
+  /* Keep both owners from writing the pages until they are
+     read-only. */
+  old_level = intr_disable ();
+  if (memcmp (target->kpage, f->kpage, PGSIZE))
+    {
+      intr_set_level (old_level);
+      return false;
+    }
+  if (list_size (&target->pages) == 1)
+    {
+      struct page *q = list_entry (list_front (&target->pages),
+                                   struct page, frame_elem);
+
+      pagedir_set_writable (q->owner->pagedir, q->upage, false);
+      q->cow = true;
+    }
+  dirty = pagedir_is_dirty (pd, p->upage);
+  frame_unmap (f, p);
+  if (!pagedir_set_page (pd, p->upage, target->kpage, false))
+    {
+      /* Cannot happen: the page table is already there. */
+      PANIC ("merge_frames: cannot map page");
+    }
+  pagedir_set_dirty (pd, p->upage, dirty);
+  frame_link (target, p);
+  p->cow = true;
+  intr_set_level (old_level);
+
+  frame_destroy (f);
+  vmstat_count (VMSTAT_MERGED);
+  merge_cnt++;
+  return true;
+}
+
+/* Scans frame F for the merge scanner: merges it with the frame
+   in the merge table with the same checksum, if their contents
+   are the same, or otherwise puts it in the table if its
+   checksum has not changed since the last pass.  Caller must hold
+   frames_lock. */
+static void
+merge_scan (struct frame *f)
+{
+  struct hash_elem *e;
+  struct frame *g;
+  unsigned checksum;
+
+  if (f->merge_listed || !mergeable (f))
+    return;
+  checksum = hash_bytes (f->kpage, PGSIZE);
+  if (checksum != f->checksum)
+    {
+      f->checksum = checksum;
+      return;
+    }
+
+  e = hash_insert (&merge_table, &f->merge_elem);
+  if (e == NULL)
+    {
+      f->merge_listed = true;
+      return;
+    }
+  g = hash_entry (e, struct frame, merge_elem);
+  if (mergeable (g))
+    {
+      if (list_size (&f->pages) == 1 && merge_frames (g, f))
+        return;
+      if (list_size (&g->pages) == 1 && merge_frames (f, g))
+        {
+          /* G left the table as it was freed. */
+          hash_insert (&merge_table, &f->merge_elem);
+          f->merge_listed = true;
+          return;
+        }
+    }
+  else
+    {
+      /* G has changed hands since it was listed.  F takes its
+         place. */
+      hash_replace (&merge_table, &f->merge_elem);
+      g->merge_listed = false;
+      f->merge_listed = true;
+    }
+}
+
+/* Takes frame F_ out of the merge table. */
+static void
+merge_unlist (struct hash_elem *f_, void *aux UNUSED)
+{
+  struct frame *f = hash_entry (f_, struct frame, merge_elem);
+  f->merge_listed = false;
+}
+
+/* Merge scanner thread.  Every MERGE_INTERVAL ticks, scans the
+   whole frame table with merge_scan(), MERGE_BATCH frames at a
+   time, letting go of frames_lock between batches so that it
+   holds up faults and eviction no longer than that.  Frames freed
+   meanwhile move merge_cursor on.  Then empties the merge table,
+   whose checksums would be stale by the next pass. */
+static void
+merge_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (MERGE_INTERVAL);
+
+      lock_acquire (&frames_lock);
+      merge_cursor = list_begin (&frames);
+      while (merge_cursor != list_end (&frames))
+        {
+          size_t i;
+
+          for (i = 0; i < MERGE_BATCH && merge_cursor != list_end (&frames);
+               i++)
+            {
+              struct frame *f = list_entry (merge_cursor, struct frame,
+                                            elem);
+              merge_cursor = list_next (merge_cursor);
+              merge_scan (f);
+            }
+
+          lock_release (&frames_lock);
+          thread_yield ();
+          lock_acquire (&frames_lock);
+        }
+      hash_clear (&merge_table, merge_unlist);
+      merge_cursor = NULL;
+      lock_release (&frames_lock);
+    }
+}
+
+/* Counts each page of frame F accessed since the last sample
+   toward its process's working set, clearing its accessed bit
+   but leaving it set in F for the clock.  The bit of a page in a
+   large page is shared by the whole large page, and left set,
+   since clearing it would split the large page.  Caller must hold
+   frames_lock. */
+static void
+ws_sample (struct frame *f)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+
+      if (pagedir_is_accessed (p->owner->pagedir, p->upage))
+        {
+          if (!pagedir_is_large (p->owner->pagedir, p->upage))
+            {
+              pagedir_set_accessed (p->owner->pagedir, p->upage, false);
+              f->referenced = true;
+            }
+          p->owner->ws_accessed++;
+        }
+    }
+}
+
+/* Folds the pages of process T seen accessed in the last pass
+   into its working-set estimate. */
+static void
+ws_update (struct thread *t, void *aux UNUSED)
+{
+  if (t->pagedir == NULL || t->proc != t)
+    return;
+  if (t->ws_size == 0)
+    t->ws_size = t->ws_accessed;
+  else
+    t->ws_size = (t->ws_size + t->ws_accessed + 1) / 2;
+  t->ws_accessed = 0;
+}
+
+/* Working-set sampler thread.  Every WS_INTERVAL ticks, samples
+   the accessed bits of every frame with ws_sample(), MERGE_BATCH
+   frames at a time, as the merge scanner does, then updates each
+   process's estimate. */
+static void
+ws_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (WS_INTERVAL);
+
+      lock_acquire (&frames_lock);
+      ws_cursor = list_begin (&frames);
+      while (ws_cursor != list_end (&frames))
+        {
+          size_t i;
+
+          for (i = 0; i < MERGE_BATCH && ws_cursor != list_end (&frames);
+               i++)
+            {
+              struct frame *f = list_entry (ws_cursor, struct frame, elem);
+              ws_cursor = list_next (ws_cursor);
+              ws_sample (f);
+            }
+
+          lock_release (&frames_lock);
+          thread_yield ();
+          lock_acquire (&frames_lock);
+        }
+      ws_cursor = NULL;
+      thread_foreach (ws_update, NULL);
+      lock_release (&frames_lock);
+    }
+}
+
+/* Returns a hash value for frame F in the merge table. */
+static unsigned
+merge_hash (const struct hash_elem *f_, void *aux UNUSED)
+{
+  return hash_entry (f_, struct frame, merge_elem)->checksum;
+}
+
+/* Returns true if frame A precedes frame B in the merge table. */
+static bool
+merge_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  return (hash_entry (a_, struct frame, merge_elem)->checksum
+          < hash_entry (b_, struct frame, merge_elem)->checksum);
+}
+
+/* Returns a hash value for shared frame F. */
+static unsigned
+share_hash (const struct hash_elem *f_, void *aux UNUSED)
+{
+  const struct frame *f = hash_entry (f_, struct frame, share_elem);
+  return hash_int (f->sector) ^ hash_int (f->ofs) ^ hash_int (f->read_bytes);
+}
+
+/* Returns true if shared frame A precedes shared frame B. */
+static bool
+share_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct frame *a = hash_entry (a_, struct frame, share_elem);
+  const struct frame *b = hash_entry (b_, struct frame, share_elem);
+
+  if (a->sector != b->sector)
+    return a->sector < b->sector;
+  if (a->ofs != b->ofs)
+    return a->ofs < b->ofs;
+  return a->read_bytes < b->read_bytes;
+}
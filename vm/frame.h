@@ -0,0 +1,78 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+#include "filesys/inode.h"
+#include "filesys/off_t.h"
+
+struct page;
+
+/* A frame of the user pool, holding one user page.  A frame of
+   read-only executable text may be shared: it is then mapped by
+   a page of each process running the executable.  So may a frame
+   of a shared memory segment, which is wired, and a frame holding
+   a page of a mapped file, which is mapped by each mapping of that
+   page and is the file's copy of it.  Finally, a frame may hold
+   identical anonymous pages of several processes, merged by the
+   merge scanner and mapped copy-on-write. */
+struct frame
+  {
+    void *kpage;                /* Kernel virtual address. */
+    struct list pages;          /* Pages mapping the frame. */
+    bool pinned;                /* Not to be evicted? */
+    bool wired;                 /* Held by a shared memory segment? */
+    bool mapped;                /* Holds a page of a mapped file? */
+    bool referenced;            /* Accessed bit sampled, unseen by clock? */
+    struct list_elem elem;      /* Element in the frame table. */
+
+    /* Shared frames only. */
+    bool shared;                /* In the share table? */
+    struct hash_elem share_elem; /* Element in the share table. */
+    block_sector_t sector;      /* Inode sector of the file. */
+    off_t ofs;                  /* Offset in the file. */
+    size_t read_bytes;          /* Bytes read, the rest zeroed. */
+
+    /* Merge scanner's view (see frame.c). */
+    unsigned checksum;          /* Hash of contents when last scanned. */
+    bool merge_listed;          /* In the merge table? */
+    struct hash_elem merge_elem; /* Element in the merge table. */
+
+    /* Frames of mapped files only. */
+    struct inode *inode;        /* The file. */
+    struct inode_page ipage;    /* The page, in INODE's pages. */
+    bool dirty;                 /* Dirtied by a page since unmapped? */
+  };
+
+/* Pages in a large page, all brought in by frame_alloc_large(). */
+#define FRAME_LARGE_CNT 1024
+
+/* Most pages a process may have resident, or 0 for no limit. */
+extern size_t frame_quota;
+
+void frame_init (void);
+void frame_start_reclaim (void);
+struct frame *frame_alloc (struct page *);
+bool frame_alloc_large (struct list *pages);
+void frame_attach (struct frame *, struct page *);
+void frame_release (struct frame *);
+bool frame_map_shared (struct page *);
+bool frame_share_cow (struct page *parent, struct page *child,
+                      size_t *slot);
+bool frame_copy_on_write (struct page *);
+void *frame_exchange (struct page *, void *kpage);
+void frame_publish (struct frame *);
+bool frame_map_file (struct page *);
+bool frame_add_file (struct frame *);
+void frame_wire (struct frame *);
+bool frame_map_wired (struct frame *, struct page *);
+void frame_unwire (struct frame *);
+bool frame_pin (struct page *);
+void frame_unpin (struct frame *);
+void frame_free (struct page *);
+void frame_print_stats (void);
+
+#endif /* vm/frame.h */
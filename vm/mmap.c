@@ -0,0 +1,241 @@
+#include "vm/mmap.h"
+#include <debug.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "vm/page.h"
+#include "vm/shm.h"
+
+/* Memory-mapped files.
+
+   Mapping a file only records its pages in the supplemental page
+   table, so that each page is read from the file on its first
+   access like a page of an executable.  Mapped pages are written
+   back to the file rather than to swap, and only if they are
+   dirty, whether on eviction or when the mapping goes away.  All
+   mappings of a page of a file share a single frame, which reads
+   and writes of the file use too (see vm/frame.c), so that they
+   all see the same data.
+
+   A mapping of a shared memory segment instead maps each page to
+   the segment's frame right away, and holds a reference to the
+   segment until it goes away.  A mapping of no pages, with no
+   identifier, holds the reference of the process that created a
+   segment until it exits. */
+
+static void unmap (struct mmap *);
+
+/**
+ * mmap_map - map a file into memory
+ *
+ * @file: file to map
+ * @addr: page-aligned user virtual address to map it at
+ *
+ * Map the whole of the given file at consecutive pages starting at
+ * the given address, the tail of the last page zeroed.  The mapping
+ * stays valid after @file is closed.  Return the mapping's
+ * identifier, or MAP_FAILED if the file is empty, the address is
+ * unaligned or null, or any of the pages is already in use.
+*/
+mapid_t mmap_map(struct file *file, void *addr)
+{
+	struct thread *t = process_current();
+	struct mmap *m;
+	off_t length;
+	size_t i;
+
+	if (file == NULL || addr == NULL || pg_ofs(addr) != 0)
+		return MAP_FAILED;
+	length = file_length(file);
+	if (length == 0)
+		return MAP_FAILED;
+
+	m = malloc(sizeof *m);
+	if (m == NULL)
+		return MAP_FAILED;
+	m->addr = addr;
+	m->shm = NULL;
+	m->fa.next = NULL;
+	m->fa.window = 0;
+	m->page_cnt = (length + PGSIZE - 1) / PGSIZE;
+	m->file = file_reopen(file);
+	if (m->file == NULL) {
+		free(m);
+		return MAP_FAILED;
+	}
+
+	/* Check the whole range first, so a failure unmaps nothing
+	   that was there before. */
+	for (i = 0; i < m->page_cnt; i++) {
+		void *upage = (uint8_t *)addr + i * PGSIZE;
+
+		if (!is_user_vaddr(upage) || page_in_use(upage)) {
+			file_close(m->file);
+			free(m);
+			return MAP_FAILED;
+		}
+	}
+	for (i = 0; i < m->page_cnt; i++) {
+		off_t ofs = i * PGSIZE;
+		size_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+
+		if (!page_record_mmap((uint8_t *)addr + ofs, m->file, ofs,
+				      read_bytes, &m->fa)) {
+			m->page_cnt = i;
+			unmap(m);
+			return MAP_FAILED;
+		}
+	}
+
+	lock_acquire(&t->spt_lock);
+	m->id = t->next_mapid++;
+	list_push_back(&t->mmaps, &m->elem);
+	lock_release(&t->spt_lock);
+	return m->id;
+}
+
+/**
+ * mmap_map_shm - map a shared memory segment into memory
+ *
+ * @s: pointer to the segment, whose reference the mapping takes over
+ * @addr: page-aligned user virtual address to map it at
+ * @page_cnt: number of pages in the segment
+ *
+ * Map the pages of the given segment at consecutive pages starting
+ * at the given address.  Return the mapping's identifier, or
+ * MAP_FAILED, dropping the reference, if the address is unaligned
+ * or null, any of the pages is already in use, or memory is not
+ * available.
+*/
+mapid_t mmap_map_shm(struct shm *s, void *addr, size_t page_cnt)
+{
+	struct thread *t = process_current();
+	struct mmap *m;
+	size_t i;
+
+	if (addr == NULL || pg_ofs(addr) != 0) {
+		shm_put(s);
+		return MAP_FAILED;
+	}
+	for (i = 0; i < page_cnt; i++) {
+		void *upage = (uint8_t *)addr + i * PGSIZE;
+
+		if (!is_user_vaddr(upage) || page_in_use(upage)) {
+			shm_put(s);
+			return MAP_FAILED;
+		}
+	}
+
+	m = malloc(sizeof *m);
+	if (m == NULL) {
+		shm_put(s);
+		return MAP_FAILED;
+	}
+	m->file = NULL;
+	m->shm = s;
+	m->addr = addr;
+	m->page_cnt = page_cnt;
+	for (i = 0; i < page_cnt; i++)
+		if (!page_record_wired((uint8_t *)addr + i * PGSIZE,
+				       shm_frame(s, i))) {
+			m->page_cnt = i;
+			unmap(m);
+			return MAP_FAILED;
+		}
+
+	lock_acquire(&t->spt_lock);
+	m->id = t->next_mapid++;
+	list_push_back(&t->mmaps, &m->elem);
+	lock_release(&t->spt_lock);
+	return m->id;
+}
+
+/**
+ * mmap_hold_shm - hold a shared memory segment until exit
+ *
+ * @s: pointer to the segment, whose reference the process takes over
+ *
+ * Return false, keeping the reference, if memory is not available.
+*/
+bool mmap_hold_shm(struct shm *s)
+{
+	struct thread *t = process_current();
+	struct mmap *m = malloc(sizeof *m);
+
+	if (m == NULL)
+		return false;
+	m->id = MAP_FAILED;
+	m->file = NULL;
+	m->shm = s;
+	m->addr = NULL;
+	m->page_cnt = 0;
+
+	lock_acquire(&t->spt_lock);
+	list_push_back(&t->mmaps, &m->elem);
+	lock_release(&t->spt_lock);
+	return true;
+}
+
+/**
+ * mmap_unmap - remove a memory mapping
+ *
+ * @id: identifier of a mapping of the current process
+ *
+ * Write back the dirty pages of the given mapping and unmap them.
+ * Unknown identifiers, and MAP_FAILED, are ignored.
+*/
+void mmap_unmap(mapid_t id)
+{
+	struct thread *t = process_current();
+	struct mmap *m = NULL;
+	struct list_elem *e;
+
+	if (id == MAP_FAILED)
+		return;
+	lock_acquire(&t->spt_lock);
+	for (e = list_begin(&t->mmaps); e != list_end(&t->mmaps);
+	     e = list_next(e))
+		if (list_entry(e, struct mmap, elem)->id == id) {
+			m = list_entry(e, struct mmap, elem);
+			list_remove(&m->elem);
+			break;
+		}
+	lock_release(&t->spt_lock);
+
+	/* Discarding the pages takes the lock again. */
+	if (m != NULL)
+		unmap(m);
+}
+
+/**
+ * mmap_unmap_all - remove every memory mapping of the current process
+*/
+void mmap_unmap_all(void)
+{
+	struct thread *t = process_current();
+
+	while (!list_empty(&t->mmaps))
+		unmap(list_entry(list_pop_front(&t->mmaps), struct mmap,
+				 elem));
+}
+
+/* Discards the pages of mapping M, writing back the dirty ones,
+   drops its reference to its file or segment, and frees M. */
+static void
+unmap (struct mmap *m)
+{
+  size_t i;
+
+  pagedir_begin_batch ();
+  for (i = 0; i < m->page_cnt; i++)
+    page_discard ((uint8_t *) m->addr + i * PGSIZE);
+  pagedir_end_batch ();
+  if (m->shm != NULL)
+    shm_put (m->shm);
+  else
+    file_close (m->file);
+  free (m);
+}
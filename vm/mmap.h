@@ -0,0 +1,35 @@
+#ifndef VM_MMAP_H
+#define VM_MMAP_H
+
+#include <list.h>
+#include <stddef.h>
+#include "vm/page.h"
+
+struct file;
+struct shm;
+
+/* Memory mapping identifier, as returned by the mmap system
+   call. */
+typedef int mapid_t;
+#define MAP_FAILED ((mapid_t) -1)
+
+/* A file or shared memory segment mapped into a process's
+   address space. */
+struct mmap
+  {
+    mapid_t id;                 /* Mapping identifier. */
+    struct file *file;          /* Mapped file, reopened, or NULL. */
+    struct shm *shm;            /* Mapped segment, or NULL. */
+    void *addr;                 /* First mapped page. */
+    size_t page_cnt;            /* Number of mapped pages. */
+    struct fault_around fa;     /* Fault-around window. */
+    struct list_elem elem;      /* Element in the process's mappings. */
+  };
+
+mapid_t mmap_map (struct file *, void *addr);
+mapid_t mmap_map_shm (struct shm *, void *addr, size_t page_cnt);
+bool mmap_hold_shm (struct shm *);
+void mmap_unmap (mapid_t);
+void mmap_unmap_all (void);
+
+#endif /* vm/mmap.h */
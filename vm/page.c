@@ -0,0 +1,1198 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <hist.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "threads/cycle.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/thread.h"
+#include "threads/tunable.h"
+#include "threads/vaddr.h"
+#include "threads/vmstat.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "vm/frame.h"
+#include "vm/shm.h"
+#include "vm/swap.h"
+
+/* Supplemental page table.
+
+   Each process keeps a hash table of the user pages that it may
+   access, keyed by user virtual address.  load() only records
+   where each page of the executable comes from, and page_load()
+   brings it in from page_fault() the first time it is touched,
+   so that starting a process costs in proportion to the pages it
+   actually uses rather than to the size of its executable.  A
+   page that was evicted dirty comes back from its swap slot
+   instead, and is marked dirty again so that it goes back to
+   swap, not to its stale file contents, when next evicted.
+   Read-only pages of a file are loaded once into a frame shared
+   by every process that maps them.  A page of all zeros is mapped
+   read-only to a single zero page shared by everyone until it is
+   first written, and only then gets a frame of its own.
+
+   The stack starts out as a single page and grows on demand by
+   page_grow_stack(), down to page_stack_max pages.
+
+   A fault on a file page also maps the next few pages of the
+   file, so that streaming through an executable or a mapped file
+   does not take a fault per page.  How many is decided by the
+   fault-around window of the executable or mapping, which grows
+   while faults are sequential and shrinks when they are not.
+
+   The threads of a process share its page table, so each public
+   function takes the process's spt_lock while it uses it. */
+
+/* Cache of page table entries. */
+static struct kmem_cache *page_cache;
+
+/* Page of zeros, mapped read-only by zero pages until written. */
+static void *zero_page;
+
+/* -stack-max: Maximum number of pages in a user stack. */
+size_t page_stack_max = 2048;
+
+/* Stack pages mapped ahead of a fault that extends the stack by
+   one page, as it is likely to keep growing. */
+#define STACK_PREFAULT 4
+
+/* How far below the stack pointer an access may extend the
+   stack.  PUSHA pushes 32 bytes before updating it. */
+#define STACK_SLACK 32
+
+/* Maximum fault-around window, in pages, and the window of pages
+   advised to be accessed sequentially. */
+#define FAULT_AROUND_MAX 16
+#define FAULT_AROUND_SEQ (2 * FAULT_AROUND_MAX)
+
+/* How far behind a fault on pages advised to be accessed
+   sequentially to drop the pages already passed, in pages. */
+#define DROP_BEHIND 8
+
+/* Kinds of faults, and the phases of serving one, for the
+   histograms of cycles that faults take, kept while the
+   "vm.fault_cycle_hist" tunable is nonzero. */
+enum fault_type
+  {
+    FAULT_ZERO_FILL,            /* Served by zeros. */
+    FAULT_MINOR,                /* Mapped a frame already in memory. */
+    FAULT_FILE,                 /* Read a page of a file. */
+    FAULT_SWAP,                 /* Read a page back from swap. */
+    FAULT_COW,                  /* Copied a copy-on-write page. */
+    FAULT_STACK,                /* Grew the stack. */
+    FAULT_TYPE_CNT
+  };
+
+enum fault_phase
+  {
+    PHASE_LOOKUP,               /* Locking and searching the page table. */
+    PHASE_ALLOC,                /* Getting a frame, and copying into it. */
+    PHASE_IO,                   /* Reading the page in. */
+    PHASE_MAP,                  /* Mapping it. */
+    PHASE_TOTAL,                /* The whole fault. */
+    PHASE_CNT
+  };
+
+/* A fault being timed, phase by phase. */
+struct fault_clock
+  {
+    uint64_t start;             /* TSC at the start, or 0 if not timed. */
+    uint64_t stamp;             /* TSC at the end of the last phase. */
+    uint64_t cycles[PHASE_TOTAL]; /* Cycles in each phase. */
+    int type;                   /* The fault's kind, or -1 if not served. */
+  };
+
+/* Histograms, by fault type and phase. */
+static histogram (*fault_hists)[PHASE_CNT];
+static unsigned fault_cycle_hist;
+static struct tunable fault_cycle_hist_tunable =
+  {
+    .name = "vm.fault_cycle_hist",
+    .value = &fault_cycle_hist,
+    .min = 0,
+    .max = 1,
+  };
+
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static hash_action_func page_destructor;
+static struct page *page_lookup (struct hash *, const void *upage);
+static struct page *page_record (void *upage, struct file *, off_t ofs,
+                                 size_t read_bytes, bool writable);
+static bool page_in (struct page *, bool write, struct fault_clock *);
+static bool page_in_large (struct thread *, struct page *);
+static void page_fault_around (struct page *);
+static void page_swap_in (struct thread *, struct page *, void *kpage);
+static void page_drop_behind (struct thread *, struct page *);
+static bool page_drop (struct page *);
+static struct thread *page_table_lock (void);
+static bool load_page (struct thread *, void *fault_addr, bool write,
+                       struct fault_clock *);
+static bool page_used (struct thread *, const void *upage);
+static void clock_start (struct fault_clock *);
+static void clock_phase (struct fault_clock *, enum fault_phase);
+static void clock_stop (struct fault_clock *);
+
+/**
+ * page_init - initialize the supplemental page table
+ *
+ * Create the cache that page table entries are allocated from.
+*/
+void page_init(void)
+{
+	page_cache = kmem_cache_create("page", sizeof(struct page), NULL);
+	zero_page = palloc_get_page(PAL_ZERO);
+	if (page_cache == NULL || zero_page == NULL)
+		PANIC("page_init: out of memory");
+	fault_hists = calloc(FAULT_TYPE_CNT, sizeof *fault_hists);
+	if (fault_hists != NULL)
+		tunable_register(&fault_cycle_hist_tunable);
+	frame_init();
+	shm_init();
+}
+
+/**
+ * page_table_init - initialize a process's page table
+ *
+ * @spt: pointer to the page table
+ *
+ * Return false if memory is not available.
+*/
+bool page_table_init(struct hash *spt)
+{
+	return hash_init(spt, page_hash, page_less, NULL);
+}
+
+/**
+ * page_table_destroy - destroy a process's page table
+ *
+ * @spt: pointer to the page table
+ *
+ * Free every entry of the given page table, along with the frames
+ * of loaded pages.  Must be called before the page directory is
+ * destroyed.
+*/
+void page_table_destroy(struct hash *spt)
+{
+	hash_destroy(spt, page_destructor);
+}
+
+/**
+ * page_record_file - record a page to be loaded from a file
+ *
+ * @upage: user virtual page
+ * @file: file to read the page from
+ * @ofs: offset of the page in the file
+ * @read_bytes: bytes to read from the file, the rest are zeroed
+ * @writable: whether the user process may modify the page
+ *
+ * Add the given page to the current process's page table, to be
+ * loaded on its first access.  Once modified, the page goes to swap
+ * when evicted.  File pages recorded this way are taken to be of
+ * the executable, and share its fault-around window.  Return false
+ * if the page is already recorded or memory is not available.
+*/
+bool page_record_file(void *upage, struct file *file, off_t ofs,
+		      size_t read_bytes, bool writable)
+{
+	struct thread *t = page_table_lock();
+	struct page *p;
+
+	p = page_record(upage, file, ofs, read_bytes, writable);
+	if (p != NULL && p->file != NULL)
+		p->fa = &t->exec_fa;
+	lock_release(&t->spt_lock);
+	return p != NULL;
+}
+
+/**
+ * page_record_frame - record a page that is already in a frame
+ *
+ * @upage: user virtual page
+ * @f: pointer to a pinned frame allocated for no page, filled in
+ *
+ * Add the given writable page to the current process's page table
+ * and map it to the given frame right away.  The page goes to swap
+ * when evicted.  Return false, freeing the frame, if the page is
+ * already recorded or cannot be mapped.
+*/
+bool page_record_frame(void *upage, struct frame *f)
+{
+	struct thread *t = page_table_lock();
+	struct page *p;
+	bool success = false;
+
+	p = page_record(upage, NULL, 0, 0, true);
+	if (p == NULL) {
+		frame_release(f);
+	} else {
+		frame_attach(f, p);
+		success = pagedir_set_page(t->pagedir, upage, f->kpage, true);
+		if (!success) {
+			frame_free(p);
+		} else {
+			/* The contents cannot be read back from anywhere
+			   but swap. */
+			pagedir_set_dirty(t->pagedir, upage, true);
+			frame_unpin(f);
+		}
+	}
+	lock_release(&t->spt_lock);
+	return success;
+}
+
+/**
+ * page_record_wired - record a page of a shared memory segment
+ *
+ * @upage: user virtual page
+ * @f: pointer to a wired frame of the segment
+ *
+ * Add the given writable page to the current process's page table
+ * and map it to the given frame, which it shares with the other
+ * processes that map the segment, right away.  The page is never
+ * evicted, nor inherited by fork().  Return false if the page is
+ * already recorded or cannot be mapped.
+*/
+bool page_record_wired(void *upage, struct frame *f)
+{
+	struct thread *t = page_table_lock();
+	struct page *p;
+	bool success = false;
+
+	p = page_record(upage, NULL, 0, 0, true);
+	if (p != NULL) {
+		p->wired = true;
+		success = frame_map_wired(f, p);
+		if (!success) {
+			hash_delete(&t->spt, &p->elem);
+			page_destructor(&p->elem, NULL);
+		}
+	}
+	lock_release(&t->spt_lock);
+	return success;
+}
+
+/**
+ * page_record_mmap - record a page of a memory-mapped file
+ *
+ * @upage: user virtual page
+ * @file: mapped file
+ * @ofs: offset of the page in the file
+ * @read_bytes: bytes of the file in the page, the rest are zeroed
+ * @fa: fault-around window of the mapping
+ *
+ * Like page_record_file(), for a writable page whose modifications
+ * are written back to the file instead of swap.
+*/
+bool page_record_mmap(void *upage, struct file *file, off_t ofs,
+		      size_t read_bytes, struct fault_around *fa)
+{
+	struct thread *t = page_table_lock();
+	struct page *p;
+
+	p = page_record(upage, file, ofs, read_bytes, true);
+	if (p != NULL) {
+		p->writeback = true;
+		p->fa = fa;
+	}
+	lock_release(&t->spt_lock);
+	return p != NULL;
+}
+
+/**
+ * page_in_use - check whether a user page is in use
+ *
+ * @upage: user virtual page
+ *
+ * Return true if the given page of the current process is recorded
+ * in its page table or mapped outside of it.
+*/
+bool page_in_use(const void *upage)
+{
+	struct thread *t = page_table_lock();
+	bool in_use = page_used(t, upage);
+
+	lock_release(&t->spt_lock);
+	return in_use;
+}
+
+/**
+ * page_pin - keep a writable page in its frame
+ *
+ * @upage: user virtual page of the current process, just written
+ *
+ * Pin the frame of the given page, so that the kernel can write to
+ * it through its kernel address.  The page must have just been
+ * written through its user address, so that it is loaded, its own
+ * and marked dirty.  Threads of a process may pin the same page at
+ * once; it stays pinned until each has called page_unpin().  A
+ * page mapped outside of the page table or in a wired frame is
+ * never evicted, and needs no pin.
+ * Return false if the page is no longer in a frame of its own, in
+ * which case the caller should write to it and try again.
+*/
+bool page_pin(const void *upage)
+{
+	struct thread *t = page_table_lock();
+	struct page *p = page_lookup(&t->spt, upage);
+	bool success;
+
+	if (p == NULL || p->wired) {
+		lock_release(&t->spt_lock);
+		return true;
+	}
+	success = p->pin_cnt > 0 ||
+		  (!p->cow && !p->zero_mapped && frame_pin(p));
+	if (success)
+		p->pin_cnt++;
+	lock_release(&t->spt_lock);
+	return success;
+}
+
+/**
+ * page_unpin - allow a page pinned by page_pin() to be evicted
+ *
+ * @upage: user virtual page of the current process
+*/
+void page_unpin(const void *upage)
+{
+	struct thread *t = page_table_lock();
+	struct page *p = page_lookup(&t->spt, upage);
+
+	if (p != NULL && !p->wired) {
+		ASSERT(p->frame != NULL && p->pin_cnt > 0);
+		if (--p->pin_cnt == 0)
+			frame_unpin(p->frame);
+	}
+	lock_release(&t->spt_lock);
+}
+
+/**
+ * page_exchange - swap the contents of a page for a kernel page
+ *
+ * @upage: user virtual page of the current process
+ * @kpage: kernel page holding the page's new contents
+ *
+ * Move the given kernel page into the frame holding the given
+ * page, in place of copying its contents there.  Only a resident,
+ * writable page that no other page shares and no one has pinned
+ * can be exchanged.  Return the page's old kernel page, which the
+ * caller now owns, or a null pointer if it cannot be exchanged.
+*/
+void *page_exchange(void *upage, void *kpage)
+{
+	struct thread *t = page_table_lock();
+	struct page *p = page_lookup(&t->spt, upage);
+	void *old = NULL;
+
+	if (p != NULL && p->pin_cnt == 0 && !p->zero_mapped)
+		old = frame_exchange(p, kpage);
+	lock_release(&t->spt_lock);
+	return old;
+}
+
+/**
+ * page_discard - remove a page from the page table
+ *
+ * @upage: user virtual page of the current process
+ *
+ * Write back the given page if it is a dirty page of a mapped file,
+ * then unmap it and free it.  Pages not in the page table are
+ * ignored.
+*/
+void page_discard(void *upage)
+{
+	struct thread *t = page_table_lock();
+	struct page *p;
+
+	p = page_lookup(&t->spt, upage);
+	if (p != NULL) {
+		hash_delete(&t->spt, &p->elem);
+		page_destructor(&p->elem, NULL);
+	}
+	lock_release(&t->spt_lock);
+}
+
+/**
+ * page_load - load a faulting page
+ *
+ * @fault_addr: user virtual address that faulted
+ * @write: whether the fault was a write
+ *
+ * Bring in the page containing the given address from the current
+ * process's page table and map it.  A page of zeros that is only
+ * read maps the shared zero page instead.  Return false if the
+ * address is not in the page table or the page cannot be loaded.
+*/
+bool page_load(void *fault_addr, bool write)
+{
+	struct fault_clock fc;
+	struct thread *t;
+	bool success;
+
+	/* Kernel threads have no page table. */
+	if (thread_current()->pagedir == NULL)
+		return false;
+
+	clock_start(&fc);
+	t = page_table_lock();
+	success = load_page(t, fault_addr, write, &fc);
+	lock_release(&t->spt_lock);
+	clock_stop(&fc);
+	return success;
+}
+
+/**
+ * page_copy_on_write - handle a write to a copy-on-write page
+ *
+ * @fault_addr: user virtual address that faulted
+ *
+ * Give the current process its own copy of the page containing the
+ * given address, if it is copy-on-write or mapped to the zero page.
+ * Return false if it is not, or memory is not available.
+*/
+bool page_copy_on_write(void *fault_addr)
+{
+	struct fault_clock fc;
+	struct thread *t;
+	struct page *p;
+	bool success = false;
+
+	if (thread_current()->pagedir == NULL)
+		return false;
+
+	clock_start(&fc);
+	t = page_table_lock();
+	p = page_lookup(&t->spt, pg_round_down(fault_addr));
+	clock_phase(&fc, PHASE_LOOKUP);
+	if (p == NULL) {
+		/* Nothing to do. */
+	} else if (p->zero_mapped && p->writable) {
+		pagedir_clear_page(t->pagedir, p->upage);
+		p->zero_mapped = false;
+		success = load_page(t, fault_addr, true, &fc);
+	} else if (p->cow && frame_copy_on_write(p)) {
+		clock_phase(&fc, PHASE_ALLOC);
+		fc.type = FAULT_COW;
+		vmstat_count(VMSTAT_COW);
+		vmstat_count(VMSTAT_MINOR);
+		t->rusage.minor_faults++;
+		success = true;
+	} else if (p->writable && p->frame != NULL && !p->cow) {
+		/* Another thread of the process got here first. */
+		success = true;
+	}
+	lock_release(&t->spt_lock);
+	clock_stop(&fc);
+	return success;
+}
+
+/**
+ * page_grow_stack - extend the stack to a faulting address
+ *
+ * @fault_addr: user virtual address that faulted
+ * @esp: user stack pointer at the time of the fault
+ *
+ * Add the page containing the given address to the current
+ * process's stack, if the address is within the stack limit and no
+ * more than STACK_SLACK bytes below the stack pointer.  When the
+ * page is just below an existing page, the next STACK_PREFAULT pages
+ * further down are added too.  Return false if the address does not
+ * belong to the stack or memory is not available.
+*/
+bool page_grow_stack(void *fault_addr, void *esp)
+{
+	uint8_t *upage = pg_round_down(fault_addr);
+	uint8_t *bottom = (uint8_t *)PHYS_BASE - page_stack_max * PGSIZE;
+	struct fault_clock fc;
+	struct thread *t;
+	struct page *p;
+	bool success;
+	int i;
+
+	if (thread_current()->pagedir == NULL || esp == NULL ||
+	    (uint8_t *)fault_addr < (uint8_t *)esp - STACK_SLACK ||
+	    upage < bottom)
+		return false;
+
+	clock_start(&fc);
+	t = page_table_lock();
+	if (page_lookup(&t->spt, upage) != NULL) {
+		/* Another thread of the process grew it meanwhile. */
+		success = load_page(t, upage, true, &fc);
+		lock_release(&t->spt_lock);
+		clock_stop(&fc);
+		return success;
+	}
+	if (page_record(upage, NULL, 0, 0, true) == NULL ||
+	    !load_page(t, upage, true, &fc)) {
+		lock_release(&t->spt_lock);
+		return false;
+	}
+	vmstat_count(VMSTAT_STACK);
+	fc.type = FAULT_STACK;
+
+	/* Growing one page at a time: map a batch ahead.  Failure is
+	   harmless, the pages just fault in later. */
+	if (page_lookup(&t->spt, upage + PGSIZE) != NULL) {
+		for (i = 0; i < STACK_PREFAULT; i++) {
+			upage -= PGSIZE;
+			if (upage < bottom || page_used(t, upage) ||
+			    (p = page_record(upage, NULL, 0, 0, true)) == NULL ||
+			    !page_in(p, true, NULL))
+				break;
+		}
+	}
+	lock_release(&t->spt_lock);
+	clock_stop(&fc);
+	return true;
+}
+
+/**
+ * page_table_copy - copy a page table into a forked process
+ *
+ * @parent: pointer to the parent process, blocked meanwhile
+ *
+ * Copy every page of the given process other than those of mapped
+ * files into the current process's page table.  Loaded pages share
+ * the parent's frames copy-on-write, swapped pages are read back
+ * into a frame of their own, and other pages are left to be loaded
+ * on demand.  Return false if memory is not available.
+*/
+bool page_table_copy(struct thread *parent)
+{
+	struct thread *t = thread_current();
+	struct hash_iterator i;
+	bool success = false;
+
+	/* Other threads of the parent may still be running. */
+	lock_acquire(&parent->spt_lock);
+	hash_first(&i, &parent->spt);
+	while (hash_next(&i)) {
+		struct page *p = hash_entry(hash_cur(&i), struct page, elem);
+		struct file *file = p->file;
+		struct page *c;
+		size_t slot;
+
+		/* Mappings are not inherited. */
+		if (p->writeback || p->wired)
+			continue;
+
+		if (file != NULL && file == parent->exec_file)
+			file = t->exec_file;
+		c = page_record(p->upage, file, p->ofs, p->read_bytes,
+				p->writable);
+		if (c == NULL)
+			goto done;
+		if (c->file != NULL)
+			c->fa = &t->exec_fa;
+		c->advice = p->advice;
+
+		if (!frame_share_cow(p, c, &slot))
+			goto done;
+		if (slot != SWAP_NONE) {
+			struct frame *f = frame_alloc(c);
+
+			if (f == NULL)
+				goto done;
+			swap_read(slot, f->kpage);
+			if (!pagedir_set_page(t->pagedir, c->upage, f->kpage,
+					      c->writable)) {
+				frame_free(c);
+				goto done;
+			}
+			pagedir_set_dirty(t->pagedir, c->upage, true);
+			frame_unpin(f);
+		}
+	}
+	success = true;
+
+done:
+	lock_release(&parent->spt_lock);
+	return success;
+}
+
+/* Counts a fault of kind TYPE, which is FAULT_ZERO_FILL,
+   FAULT_MINOR, FAULT_FILE, or FAULT_SWAP, and records it as the
+   type of the fault that FC is timing, if FC is nonnull. */
+static void
+count_fault (struct fault_clock *fc, enum fault_type type)
+{
+  struct rusage *ru = thread_rusage ();
+  bool major = type == FAULT_FILE || type == FAULT_SWAP;
+
+  if (fc == NULL)
+    return;
+  fc->type = type;
+  vmstat_count (major ? VMSTAT_MAJOR : VMSTAT_MINOR);
+  if (type == FAULT_ZERO_FILL)
+    vmstat_count (VMSTAT_ZERO_FILL);
+  if (ru != NULL && major)
+    ru->major_faults++;
+  else if (ru != NULL)
+    ru->minor_faults++;
+}
+
+/* Brings in page P of the current process and maps it, or maps
+   the zero page if P is a zero page and WRITE is false.  Counts
+   the kind of fault it was and times it with FC, if FC is
+   nonnull, rather than a page mapped ahead of a fault.  Returns
+   false if P cannot be loaded. */
+static bool
+page_in (struct page *p, bool write, struct fault_clock *fc)
+{
+  struct thread *t = process_current ();
+  struct frame *f;
+  uint8_t *kpage;
+  bool share, swapped;
+
+  /* Zero pages need no frame until written. */
+  if (!write && p->file == NULL && p->swap_slot == SWAP_NONE)
+    {
+      if (!pagedir_set_page (t->pagedir, p->upage, zero_page, false))
+        return false;
+      p->zero_mapped = true;
+      clock_phase (fc, PHASE_MAP);
+      count_fault (fc, FAULT_ZERO_FILL);
+      return true;
+    }
+
+  /* Read-only file pages, i.e. executable text, are shared. */
+  share = !p->writable && p->file != NULL;
+  if (share && frame_map_shared (p))
+    {
+      clock_phase (fc, PHASE_MAP);
+      count_fault (fc, FAULT_MINOR);
+      return true;
+    }
+
+  /* So are pages of mapped files, read and written. */
+  if (p->writeback && p->file != NULL && frame_map_file (p))
+    {
+      clock_phase (fc, PHASE_MAP);
+      count_fault (fc, FAULT_MINOR);
+      return true;
+    }
+
+  /* The frame stays pinned until the page is mapped. */
+  f = frame_alloc (p);
+  if (f == NULL)
+    return false;
+  kpage = f->kpage;
+  clock_phase (fc, PHASE_ALLOC);
+
+  swapped = p->swap_slot != SWAP_NONE;
+  if (swapped)
+    page_swap_in (t, p, kpage);
+  else if (p->writeback && p->file != NULL && frame_add_file (f))
+    {
+      /* Read in, and now the file's copy of the page. */
+    }
+  else
+    {
+      if (p->file != NULL
+          && file_read_at (p->file, kpage, p->read_bytes, p->ofs)
+             != (off_t) p->read_bytes)
+        {
+          frame_free (p);
+          return false;
+        }
+      memset (kpage + p->read_bytes, 0, PGSIZE - p->read_bytes);
+    }
+  clock_phase (fc, PHASE_IO);
+
+  if (!pagedir_set_page (t->pagedir, p->upage, kpage, p->writable))
+    {
+      frame_free (p);
+      return false;
+    }
+  if (p->swap_slot != SWAP_NONE)
+    {
+      pagedir_set_dirty (t->pagedir, p->upage, true);
+      swap_free (p->swap_slot);
+      p->swap_slot = SWAP_NONE;
+    }
+  if (share)
+    frame_publish (f);
+  frame_unpin (f);
+  clock_phase (fc, PHASE_MAP);
+  count_fault (fc, (swapped ? FAULT_SWAP
+                    : p->file != NULL ? FAULT_FILE : FAULT_ZERO_FILL));
+  return true;
+}
+
+/* Returns true if page Q may be brought in as part of a large
+   page: it is an untouched, private page of zeros, written to
+   swap never and back to a file never. */
+static bool
+large_candidate (const struct page *q)
+{
+  return (q->frame == NULL && !q->zero_mapped && q->writable
+          && !q->writeback && !q->wired && !q->cow
+          && (q->file == NULL || q->read_bytes == 0)
+          && q->swap_slot == SWAP_NONE && q->pin_cnt == 0);
+}
+
+/* Brings in the FRAME_LARGE_CNT pages of process T around page P
+   at once, all zeros, and maps them with a single 4 MB page, if P
+   lies in a 4 MB range of T's address space that is unmapped and
+   made up entirely of pages like it, and memory allows.  Such
+   ranges are large heaps and buffers, which then take one TLB
+   entry instead of 1024.  Returns false, with nothing done,
+   otherwise. */
+static bool
+page_in_large (struct thread *t, struct page *p)
+{
+  uint8_t *base = (uint8_t *) ((uintptr_t) p->upage
+                               & ~(FRAME_LARGE_CNT * PGSIZE - 1));
+  struct list pages;
+  size_t i;
+
+  if (!large_candidate (p) || !pagedir_range_free (t->pagedir, base))
+    return false;
+
+  list_init (&pages);
+  for (i = 0; i < FRAME_LARGE_CNT; i++)
+    {
+      struct page *q = page_lookup (&t->spt, base + i * PGSIZE);
+
+      if (q == NULL || !large_candidate (q))
+        break;
+      list_push_back (&pages, &q->frame_elem);
+    }
+  if (i < FRAME_LARGE_CNT || !frame_alloc_large (&pages))
+    return false;
+  vmstat_count (VMSTAT_LARGE);
+  return true;
+}
+
+/* Returns the page DELTA pages away from page P of process T,
+   if it is out in the swap slot DELTA slots away from P's, or a
+   null pointer. */
+static struct page *
+swap_neighbor (struct thread *t, struct page *p, int delta)
+{
+  struct page *q = page_lookup (&t->spt,
+                                (uint8_t *) p->upage + delta * PGSIZE);
+
+  if (q == NULL || q->frame != NULL || q->swap_slot == SWAP_NONE
+      || q->swap_slot != p->swap_slot + delta)
+    return NULL;
+  return q;
+}
+
+/* Reads page P of process T, which is in swap, into KPAGE, along
+   with the pages around it that went to the slots around its
+   own, up to SWAP_CLUSTER pages in all, and maps those others.
+   Their slots are adjacent, so the reads are merged into one.
+   T's page table must be locked. */
+static void
+page_swap_in (struct thread *t, struct page *p, void *kpage)
+{
+  struct page *pages[SWAP_CLUSTER];
+  size_t slots[SWAP_CLUSTER];
+  void *kpages[SWAP_CLUSTER];
+  size_t cnt = 0, i;
+  int first, last, delta;
+
+  for (first = 0; -first + 1 < SWAP_CLUSTER; first--)
+    if (swap_neighbor (t, p, first - 1) == NULL)
+      break;
+  for (last = 0; last - first + 1 < SWAP_CLUSTER; last++)
+    if (swap_neighbor (t, p, last + 1) == NULL)
+      break;
+
+  for (delta = first; delta <= last; delta++)
+    {
+      struct page *q = delta != 0 ? swap_neighbor (t, p, delta) : p;
+      struct frame *f;
+
+      if (q == p)
+        kpages[cnt] = kpage;
+      else if (q != NULL && (f = frame_alloc (q)) != NULL)
+        kpages[cnt] = f->kpage;
+      else
+        continue;
+      pages[cnt] = q;
+      slots[cnt++] = q->swap_slot;
+    }
+  swap_read_cluster (slots, kpages, cnt);
+
+  /* P itself is mapped by the caller. */
+  for (i = 0; i < cnt; i++)
+    {
+      struct page *q = pages[i];
+
+      if (q == p)
+        continue;
+      if (!pagedir_set_page (t->pagedir, q->upage, kpages[i], q->writable))
+        {
+          /* Still in swap, so nothing is lost. */
+          frame_free (q);
+          continue;
+        }
+      pagedir_set_dirty (t->pagedir, q->upage, true);
+      swap_free (q->swap_slot);
+      q->swap_slot = SWAP_NONE;
+      frame_unpin (q->frame);
+      vmstat_count (VMSTAT_FAULT_AROUND);
+    }
+}
+
+/* Maps pages of the same file following page P, which just
+   faulted in, as many as P's fault-around window says.  The
+   window doubles, up to FAULT_AROUND_MAX, each time a fault
+   lands just past the pages mapped ahead by the last one, and
+   halves each time one lands elsewhere.  A page advised to be
+   accessed sequentially gets a window of FAULT_AROUND_SEQ. */
+static void
+page_fault_around (struct page *p)
+{
+  struct thread *t = process_current ();
+  struct fault_around *fa = p->fa;
+  uint8_t *next = (uint8_t *) p->upage + PGSIZE;
+  unsigned i;
+
+  if (p->advice == ADV_SEQUENTIAL)
+    fa->window = FAULT_AROUND_SEQ;
+  else if (p->upage == fa->next)
+    fa->window = fa->window == 0 ? 1 : MIN (fa->window * 2,
+                                            FAULT_AROUND_MAX);
+  else
+    fa->window /= 2;
+
+  for (i = 0; i < fa->window; i++, next += PGSIZE)
+    {
+      struct page *q = page_lookup (&t->spt, next);
+
+      if (q == NULL || q->file != p->file || q->frame != NULL
+          || q->zero_mapped || q->swap_slot != SWAP_NONE
+          || !page_in (q, false, NULL))
+        break;
+      vmstat_count (VMSTAT_FAULT_AROUND);
+    }
+  fa->next = next;
+}
+
+/* Drops the file pages that a sequential access has left behind,
+   from DROP_BEHIND pages before page P, which just faulted in,
+   back to the first one that is not in memory.  Only pages of
+   P's file, also advised to be accessed sequentially, that can be
+   read back from the file as they are, are dropped.  T is the
+   current process, whose page table the caller has locked. */
+static void
+page_drop_behind (struct thread *t, struct page *p)
+{
+  uint8_t *upage = (uint8_t *) p->upage - DROP_BEHIND * PGSIZE;
+  unsigned i;
+
+  if (p->file == NULL || (uint8_t *) p->upage < upage)
+    return;
+  for (i = 0; i < FAULT_AROUND_SEQ; i++, upage -= PGSIZE)
+    {
+      struct page *q = page_lookup (&t->spt, upage);
+
+      if (q == NULL || q->file != p->file || q->frame == NULL
+          || q->advice != ADV_SEQUENTIAL
+          || (!q->writeback && pagedir_is_dirty (t->pagedir, q->upage))
+          || !page_drop (q))
+        break;
+      vmstat_count (VMSTAT_DROP_BEHIND);
+    }
+}
+
+/* Takes page P of the current process, whose page table the
+   caller has locked, out of memory, so that its next access loads
+   it afresh: from its file, after writing back a dirty page of a
+   mapped file, or as zeros.  Returns false, leaving P alone, if P
+   is pinned or in a shared memory segment. */
+static bool
+page_drop (struct page *p)
+{
+  if (p->pin_cnt > 0 || p->wired)
+    return false;
+  if (p->zero_mapped)
+    {
+      pagedir_clear_page (p->owner->pagedir, p->upage);
+      p->zero_mapped = false;
+    }
+  frame_free (p);
+  swap_free (p->swap_slot);
+  p->swap_slot = SWAP_NONE;
+  return true;
+}
+
+/**
+ * page_advise - act on advice about how pages will be accessed
+ *
+ * @addr: page-aligned user virtual address of the first page
+ * @size: number of bytes advised about
+ * @advice: how the pages will be accessed
+ *
+ * Record the given advice for each page of the current process in
+ * the given range, or act on it: ADV_SEQUENTIAL gives faults on the
+ * pages a wider fault-around window and drops the pages of a file
+ * that they leave behind, ADV_RANDOM turns fault-around off,
+ * ADV_WILLNEED has the file data of pages not in memory read into
+ * the buffer cache in the background, and ADV_DONTNEED takes the
+ * pages out of memory at once, discarding changes to any but those
+ * of mapped files.  Pages that are not in the page table are
+ * skipped.  Return false if the address is not page-aligned or the
+ * range is not all user memory.
+*/
+bool page_advise(void *addr, size_t size, enum advice advice)
+{
+	uint8_t *upage = addr, *end = upage + size;
+	struct thread *t;
+
+	if (pg_ofs(addr) != 0 || end < upage || !is_user_vaddr(end - 1) ||
+	    advice > ADV_DONTNEED)
+		return false;
+
+	t = page_table_lock();
+	pagedir_begin_batch();
+	for (; upage < end; upage += PGSIZE) {
+		struct page *p = page_lookup(&t->spt, upage);
+
+		if (p == NULL)
+			continue;
+		switch (advice) {
+		case ADV_NORMAL:
+		case ADV_SEQUENTIAL:
+		case ADV_RANDOM:
+			p->advice = advice;
+			break;
+		case ADV_WILLNEED:
+			if (p->frame == NULL && p->file != NULL &&
+			    p->swap_slot == SWAP_NONE)
+				inode_read_ahead(file_get_inode(p->file),
+						 p->read_bytes, p->ofs);
+			break;
+		case ADV_DONTNEED:
+			page_drop(p);
+			break;
+		}
+	}
+	pagedir_end_batch();
+	lock_release(&t->spt_lock);
+	return true;
+}
+
+/**
+ * page_print_stats - print page table statistics
+ *
+ * Print the pages mapped ahead of faults, and the histograms of
+ * cycles that each kind of fault took in each phase while the
+ * "vm.fault_cycle_hist" tunable was set.
+*/
+void page_print_stats(void)
+{
+	static const char *type_names[FAULT_TYPE_CNT] = {
+		"zero-fill", "minor", "file", "swap", "cow", "stack"
+	};
+	static const char *phase_names[PHASE_CNT] = {
+		"lookup cycles", "alloc cycles", "io cycles", "map cycles",
+		"total cycles"
+	};
+	int type, phase;
+
+	printf("Pages: %llu mapped by fault-around\n",
+	       vmstat_read(VMSTAT_FAULT_AROUND));
+	if (fault_hists == NULL)
+		return;
+	for (type = 0; type < FAULT_TYPE_CNT; type++)
+		for (phase = 0; phase < PHASE_CNT; phase++) {
+			if (hist_count(fault_hists[type][phase]) == 0)
+				continue;
+			printf("Pages: %s faults:", type_names[type]);
+			hist_print(phase_names[phase], fault_hists[type][phase]);
+		}
+}
+
+/* Adds UPAGE to the current process's page table, to be loaded
+   from READ_BYTES of FILE at OFS.  Returns the new entry, or a
+   null pointer if UPAGE is already recorded or memory is not
+   available. */
+static struct page *
+page_record (void *upage, struct file *file, off_t ofs,
+             size_t read_bytes, bool writable)
+{
+  struct thread *t = process_current ();
+  struct page *p;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (read_bytes <= PGSIZE);
+
+  p = kmem_cache_alloc (page_cache);
+  if (p == NULL)
+    return NULL;
+
+  p->upage = upage;
+  p->owner = t;
+  p->frame = NULL;
+  p->writable = writable;
+  p->writeback = false;
+  p->cow = false;
+  p->zero_mapped = false;
+  p->wired = false;
+  p->advice = ADV_NORMAL;
+  p->file = read_bytes > 0 ? file : NULL;
+  p->ofs = ofs;
+  p->read_bytes = read_bytes;
+  p->swap_slot = SWAP_NONE;
+  p->fa = NULL;
+  p->pin_cnt = 0;
+
+  if (hash_insert (&t->spt, &p->elem) != NULL)
+    {
+      kmem_cache_free (page_cache, p);
+      return NULL;
+    }
+  return p;
+}
+
+/* Locks the page table of the current process against the
+   process's other threads.  Returns the thread that holds it. */
+static struct thread *
+page_table_lock (void)
+{
+  struct thread *t = process_current ();
+
+  lock_acquire (&t->spt_lock);
+  return t;
+}
+
+/* Brings in the page containing FAULT_ADDR from the page table of
+   process T, which the caller has locked, for page_load(), timing
+   it with FC.  A page that another thread of T brought in
+   meanwhile is done. */
+static bool
+load_page (struct thread *t, void *fault_addr, bool write,
+           struct fault_clock *fc)
+{
+  struct page *p = page_lookup (&t->spt, pg_round_down (fault_addr));
+
+  clock_phase (fc, PHASE_LOOKUP);
+  if (p == NULL)
+    return false;
+  if (p->frame != NULL || p->zero_mapped)
+    return pagedir_get_page (t->pagedir, p->upage) != NULL;
+  if (write && page_in_large (t, p))
+    {
+      clock_phase (fc, PHASE_ALLOC);
+      count_fault (fc, FAULT_ZERO_FILL);
+      return true;
+    }
+  if (!page_in (p, write, fc))
+    return false;
+  if (p->fa != NULL && p->advice != ADV_RANDOM)
+    page_fault_around (p);
+  if (p->advice == ADV_SEQUENTIAL)
+    page_drop_behind (t, p);
+  return true;
+}
+
+/* Returns true if UPAGE of process T, whose page table the caller
+   has locked, is recorded in the table or mapped outside it. */
+static bool
+page_used (struct thread *t, const void *upage)
+{
+  return (page_lookup (&t->spt, upage) != NULL
+          || pagedir_get_page (t->pagedir, upage) != NULL);
+}
+
+/* Starts timing a fault with FC, if the fault histograms are
+   on. */
+static void
+clock_start (struct fault_clock *fc)
+{
+  int i;
+
+  fc->start = fc->stamp = fault_cycle_hist ? rdtsc () : 0;
+  for (i = 0; i < PHASE_TOTAL; i++)
+    fc->cycles[i] = 0;
+  fc->type = -1;
+}
+
+/* Charges the cycles since the end of the last phase of the
+   fault that FC is timing, if any, to PHASE. */
+static void
+clock_phase (struct fault_clock *fc, enum fault_phase phase)
+{
+  uint64_t now;
+
+  if (fc == NULL || fc->start == 0)
+    return;
+  now = rdtsc ();
+  fc->cycles[phase] += now - fc->stamp;
+  fc->stamp = now;
+}
+
+/* Adds the fault that FC timed to the histograms of its type, if
+   it was timed and served.  Phases it did not go through are
+   left out. */
+static void
+clock_stop (struct fault_clock *fc)
+{
+  histogram *h;
+  int i;
+
+  if (fc->start == 0 || fc->type < 0)
+    return;
+  h = fault_hists[fc->type];
+  for (i = 0; i < PHASE_TOTAL; i++)
+    if (fc->cycles[i] > 0)
+      hist_add (h[i], fc->cycles[i]);
+  hist_add (h[PHASE_TOTAL], rdtsc () - fc->start);
+}
+
+/* Returns the page table entry for UPAGE in SPT, or a null
+   pointer if there is none. */
+static struct page *
+page_lookup (struct hash *spt, const void *upage)
+{
+  struct page p;
+  struct hash_elem *e;
+
+  p.upage = (void *) upage;
+  e = hash_find (spt, &p.elem);
+  return e != NULL ? hash_entry (e, struct page, elem) : NULL;
+}
+
+/* Returns a hash value for page P. */
+static unsigned
+page_hash (const struct hash_elem *p_, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (p_, struct page, elem);
+  return hash_int ((uintptr_t) p->upage >> PGBITS);
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct page *a = hash_entry (a_, struct page, elem);
+  const struct page *b = hash_entry (b_, struct page, elem);
+
+  return a->upage < b->upage;
+}
+
+/* Frees page table entry P, its frame and its swap slot. */
+static void
+page_destructor (struct hash_elem *p_, void *aux UNUSED)
+{
+  struct page *p = hash_entry (p_, struct page, elem);
+
+  /* Keep pagedir_destroy() from freeing the zero page. */
+  if (p->zero_mapped)
+    pagedir_clear_page (p->owner->pagedir, p->upage);
+
+  frame_free (p);
+  swap_free (p->swap_slot);
+  kmem_cache_free (page_cache, p);
+}
@@ -0,0 +1,74 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <advice.h>
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+
+struct file;
+struct frame;
+struct thread;
+
+/* Fault-around state of an executable or a file mapping. */
+struct fault_around
+  {
+    void *next;                 /* First page past those mapped ahead. */
+    unsigned window;            /* Pages to map ahead of a fault. */
+  };
+
+/* Supplemental page table entry.  Describes where the contents
+   of a user virtual page come from, so that it can be loaded on
+   its first access instead of when the process starts. */
+struct page
+  {
+    void *upage;                /* User virtual address. */
+    struct hash_elem elem;      /* Element in the page table. */
+    struct thread *owner;       /* Owning process. */
+    struct frame *frame;        /* Frame holding the page, or NULL. */
+    struct list_elem frame_elem; /* Element in the frame's pages. */
+    bool writable;              /* Writable by the user process? */
+    bool writeback;             /* Written back to FILE, not swap? */
+    bool cow;                   /* Copy-on-write, mapped read-only? */
+    bool zero_mapped;           /* Mapped to the shared zero page? */
+    bool wired;                 /* In a shared memory segment's frame? */
+    uint8_t advice;             /* enum advice, from madvise(). */
+
+    /* Backing file: READ_BYTES at OFS, the rest zeroed. */
+    struct file *file;          /* File, or NULL if all zeros. */
+    off_t ofs;                  /* Offset in FILE. */
+    size_t read_bytes;          /* Bytes to read from FILE. */
+
+    size_t swap_slot;           /* Swap slot, or SWAP_NONE. */
+    struct fault_around *fa;    /* Fault-around window, or NULL. */
+    unsigned pin_cnt;           /* Holders of page_pin() on it. */
+  };
+
+/* Maximum number of pages in a user stack. */
+extern size_t page_stack_max;
+
+void page_init (void);
+bool page_table_init (struct hash *spt);
+void page_table_destroy (struct hash *spt);
+bool page_record_file (void *upage, struct file *, off_t ofs,
+                       size_t read_bytes, bool writable);
+bool page_record_frame (void *upage, struct frame *);
+bool page_record_mmap (void *upage, struct file *, off_t ofs,
+                       size_t read_bytes, struct fault_around *);
+bool page_record_wired (void *upage, struct frame *);
+bool page_in_use (const void *upage);
+bool page_pin (const void *upage);
+void page_unpin (const void *upage);
+void *page_exchange (void *upage, void *kpage);
+bool page_advise (void *addr, size_t size, enum advice);
+void page_discard (void *upage);
+bool page_load (void *fault_addr, bool write);
+bool page_copy_on_write (void *fault_addr);
+bool page_grow_stack (void *fault_addr, void *esp);
+bool page_table_copy (struct thread *parent);
+void page_print_stats (void);
+
+#endif /* vm/page.h */
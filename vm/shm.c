@@ -0,0 +1,191 @@
+#include "vm/shm.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "vm/frame.h"
+
+/* Shared memory segments.
+
+   A segment is a set of zeroed frames of the user pool, wired
+   so that they are never evicted, which any process may map by
+   the segment's identifier.  Each mapping is one of the process's
+   memory mappings (see vm/mmap.c), whose pages are mapped to the
+   segment's frames writable and at once, so that processes
+   exchange data through them without copying and without
+   faulting.
+
+   A segment is reference counted: each mapping holds a
+   reference, and so does the process that created it, until it
+   exits.  The segment's frames go back to the user pool with its
+   last reference. */
+
+/* Most pages in a segment. */
+#define SHM_PAGES_MAX 1024
+
+/* A shared memory segment. */
+struct shm
+  {
+    int id;                     /* Identifier. */
+    unsigned ref_cnt;           /* Mappings and creator, if alive. */
+    struct list_elem elem;      /* Element in segments. */
+    size_t page_cnt;            /* Number of frames. */
+    struct frame *frames[];     /* Frames, one per page. */
+  };
+
+/* Every segment, its lock, and the next identifier. */
+static struct list segments;
+static struct lock segments_lock;
+static int next_id;
+
+static struct shm *shm_get (int id);
+static void shm_destroy (struct shm *);
+
+/**
+ * shm_init - initialize shared memory segments
+*/
+void shm_init(void)
+{
+	list_init(&segments);
+	lock_init_named(&segments_lock, "shm");
+}
+
+/**
+ * shm_create - create a shared memory segment
+ *
+ * @size: bytes in the segment, rounded up to whole pages
+ *
+ * Create a zeroed segment, held by the current process until it
+ * exits.  Return the segment's identifier, or -1 if the size is 0
+ * or too large, or memory is not available.
+*/
+int shm_create(size_t size)
+{
+	size_t page_cnt;
+	struct shm *s;
+	size_t i;
+
+	if (size == 0 || size > SHM_PAGES_MAX * PGSIZE)
+		return -1;
+	page_cnt = DIV_ROUND_UP(size, PGSIZE);
+	s = malloc(sizeof *s + page_cnt * sizeof *s->frames);
+	if (s == NULL)
+		return -1;
+	s->ref_cnt = 1;
+	s->page_cnt = 0;
+	for (i = 0; i < page_cnt; i++) {
+		struct frame *f = frame_alloc(NULL);
+
+		if (f == NULL) {
+			shm_destroy(s);
+			return -1;
+		}
+		memset(f->kpage, 0, PGSIZE);
+		frame_wire(f);
+		s->frames[s->page_cnt++] = f;
+	}
+	if (!mmap_hold_shm(s)) {
+		shm_destroy(s);
+		return -1;
+	}
+
+	lock_acquire(&segments_lock);
+	s->id = next_id++;
+	list_push_back(&segments, &s->elem);
+	lock_release(&segments_lock);
+	return s->id;
+}
+
+/**
+ * shm_map - map a shared memory segment into memory
+ *
+ * @id: identifier of the segment
+ * @addr: page-aligned user virtual address to map it at
+ *
+ * Return the mapping's identifier, to be passed to munmap(), or
+ * MAP_FAILED if there is no such segment or the pages cannot be
+ * mapped there.
+*/
+mapid_t shm_map(int id, void *addr)
+{
+	struct shm *s = shm_get(id);
+
+	if (s == NULL)
+		return MAP_FAILED;
+	return mmap_map_shm(s, addr, s->page_cnt);
+}
+
+/**
+ * shm_frame - get a frame of a shared memory segment
+ *
+ * @s: pointer to the segment
+ * @page: index of a page of the segment
+ *
+ * Return the frame holding the given page.
+*/
+struct frame *shm_frame(struct shm *s, size_t page)
+{
+	ASSERT(page < s->page_cnt);
+	return s->frames[page];
+}
+
+/**
+ * shm_put - drop a reference to a shared memory segment
+ *
+ * @s: pointer to the segment
+ *
+ * Free the segment and its frames when its last reference goes away.
+ * Its pages must all be unmapped by then.
+*/
+void shm_put(struct shm *s)
+{
+	bool last;
+
+	lock_acquire(&segments_lock);
+	ASSERT(s->ref_cnt > 0);
+	last = --s->ref_cnt == 0;
+	if (last)
+		list_remove(&s->elem);
+	lock_release(&segments_lock);
+
+	if (last)
+		shm_destroy(s);
+}
+
+/* Returns segment ID with a new reference to it, or a null pointer
+   if there is none. */
+static struct shm *
+shm_get (int id)
+{
+  struct list_elem *e;
+
+  lock_acquire (&segments_lock);
+  for (e = list_begin (&segments); e != list_end (&segments);
+       e = list_next (e))
+    {
+      struct shm *s = list_entry (e, struct shm, elem);
+
+      if (s->id == id)
+        {
+          s->ref_cnt++;
+          lock_release (&segments_lock);
+          return s;
+        }
+    }
+  lock_release (&segments_lock);
+  return NULL;
+}
+
+/* Frees segment S, no longer in segments, and its frames. */
+static void
+shm_destroy (struct shm *s)
+{
+  size_t i;
+
+  for (i = 0; i < s->page_cnt; i++)
+    frame_unwire (s->frames[i]);
+  free (s);
+}
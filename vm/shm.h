@@ -0,0 +1,16 @@
+#ifndef VM_SHM_H
+#define VM_SHM_H
+
+#include <stddef.h>
+#include "vm/mmap.h"
+
+struct shm;
+struct frame;
+
+void shm_init (void);
+int shm_create (size_t size);
+mapid_t shm_map (int id, void *addr);
+struct frame *shm_frame (struct shm *, size_t page);
+void shm_put (struct shm *);
+
+#endif /* vm/shm.h */
@@ -0,0 +1,495 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <lz4.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/shrinker.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "threads/vmstat.h"
+
+/* Swap.
+
+   The swap device is divided into page-sized slots, tracked by a
+   bitmap with one bit per slot.  Slots are handed out next-fit,
+   so that pages evicted one after another land next to each
+   other on disk.  The bitmap is guarded by a spinlock, since the
+   frame table allocates slots with interrupts off.
+
+   Each process has a slot of its own where its next page would
+   best go, just past the last one it was given.  When that slot
+   is taken, the process is given the first slot of the next run
+   of SWAP_CLUSTER free ones, and next fit then skips the rest of
+   the run for other processes.  Pages evicted together from one
+   process so end up in adjacent slots, and a fault on one of
+   them can read its neighbors in with it in one transfer.
+
+   Writing a page to the device over PIO takes far longer than
+   compressing it, so a page written to a slot is first
+   compressed into a block from the kernel pool instead, if it
+   shrinks to at most ZSWAP_MAX_SIZE bytes and the compressed
+   pages stay within zswap_limit bytes in all.  Only pages that
+   do not fit are written to the device.  Reading the slot back
+   then decompresses the page without any I/O, and freeing the
+   slot frees the block.
+
+   When the kernel pool runs short, the zswap shrinker writes
+   compressed pages back to their slots on the device, decompressed,
+   and frees their blocks.  A block being written back stays in place
+   until the write is done, so that the page can still be read from
+   it; if the slot is freed meanwhile, the shrinker frees the slot
+   once its write is done, so that the slot cannot be written again
+   under it.
+
+   Swap may span several devices, or areas, each with a priority.
+   Their slots are numbered one area after another, in order of
+   decreasing priority, and each area has a bitmap of its own.  A
+   new run of slots is taken from the areas of the highest
+   priority that has one free, round-robin among areas of the same
+   priority, so that with one area per disk or IDE channel,
+   successive runs of pages, typically those of different
+   processes, are written to different disks, whose transfers then
+   overlap.  Lower priorities are only used once the higher ones
+   are full, so the fastest device is best given the highest. */
+
+/* Sectors per slot. */
+#define SLOT_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Largest compressed page worth keeping in memory. */
+#define ZSWAP_MAX_SIZE (PGSIZE * 3 / 4)
+
+/* A compressed page. */
+struct zpage
+  {
+    uint16_t size;              /* Bytes of data. */
+    bool writeback;             /* Being written to the device? */
+    bool freed;                 /* Slot freed during writeback? */
+    uint8_t data[];             /* Compressed data. */
+  };
+
+/* Most swap areas. */
+#define SWAP_AREAS_MAX 8
+
+/* A swap area: a device, holding some of the slots. */
+struct swap_area
+  {
+    struct block *device;       /* Block device. */
+    int priority;               /* Higher is used first. */
+    size_t first;               /* Number of its first slot. */
+    struct bitmap *slots;       /* Allocated slots, from 0. */
+  };
+
+/* Swap areas, in order of decreasing priority. */
+static struct swap_area areas[SWAP_AREAS_MAX];
+static size_t area_cnt;
+static size_t slot_cnt;         /* Slots in all areas. */
+static unsigned stripe_cnt;     /* Runs taken, for round-robin. */
+static struct spinlock swap_lock;
+
+/* Compressed pages, by slot, or null for slots on the device.
+   The pointers, zswap_bytes and zswap_cnt are guarded by
+   swap_lock. */
+static struct zpage **zpages;
+static size_t zswap_bytes, zswap_limit;
+static size_t zswap_cnt;        /* Compressed pages. */
+static size_t zswap_hand;       /* Next slot the shrinker looks at. */
+
+/* Compression buffers, used under compress_lock, which also keeps
+   the shrinker from freeing a block that is being decompressed. */
+static struct lock compress_lock;
+static uint16_t *compress_table;
+static uint8_t *compress_buf;
+static void *writeback_page;    /* A page decompressed for writeback. */
+
+static struct swap_area *slot_area (size_t slot);
+static size_t alloc_run (struct swap_area *, size_t cnt);
+static bool zswap_store (size_t slot, const void *kpage);
+static bool zswap_load (size_t slot, void *kpage);
+static size_t zswap_shrink_count (void);
+static size_t zswap_shrink_scan (size_t nr);
+
+static struct shrinker zswap_shrinker =
+  {
+    .name = "zswap",
+    .count = zswap_shrink_count,
+    .scan = zswap_shrink_scan,
+  };
+
+/**
+ * swap_add_area - add a device to swap
+ *
+ * @device: block device
+ * @priority: areas of higher priority are used first, those of
+ *            the same priority in turn
+ *
+ * To be called before swap_init(), once per device.  Return false
+ * if there are too many areas already.
+*/
+bool swap_add_area(struct block *device, int priority)
+{
+	size_t i;
+
+	if (area_cnt == SWAP_AREAS_MAX)
+		return false;
+
+	/* Keep the areas sorted, the first added first among equals. */
+	for (i = area_cnt; i > 0 && areas[i - 1].priority < priority; i--)
+		areas[i] = areas[i - 1];
+	areas[i].device = device;
+	areas[i].priority = priority;
+	area_cnt++;
+	return true;
+}
+
+/**
+ * swap_init - initialize swap
+ *
+ * Use the areas added with swap_add_area().  Without any,
+ * swap_alloc() always fails.
+*/
+void swap_init(void)
+{
+	size_t i;
+
+	spinlock_init(&swap_lock);
+	if (area_cnt == 0)
+		return;
+
+	for (i = 0; i < area_cnt; i++) {
+		struct swap_area *a = &areas[i];
+
+		a->first = slot_cnt;
+		a->slots = bitmap_create(block_size(a->device) / SLOT_SECTORS);
+		if (a->slots == NULL)
+			PANIC("swap_init: out of memory");
+		slot_cnt += bitmap_size(a->slots);
+	}
+	zpages = calloc(slot_cnt, sizeof *zpages);
+	compress_table = malloc(LZ4_HASH_SIZE * sizeof *compress_table);
+	compress_buf = malloc(ZSWAP_MAX_SIZE);
+	writeback_page = palloc_get_page(0);
+	if (zpages == NULL || compress_table == NULL || compress_buf == NULL
+	    || writeback_page == NULL)
+		PANIC("swap_init: out of memory");
+	lock_init_named(&compress_lock, "compress");
+	shrinker_register(&zswap_shrinker);
+
+	/* Let compressed pages take up to a quarter of the kernel pool. */
+	zswap_limit = palloc_free_cnt(0) / 4 * PGSIZE;
+}
+
+/**
+ * swap_alloc - allocate a swap slot
+ *
+ * @next: pointer to the slot the owner of the page would best be
+ *        given next, or to SWAP_NONE, updated to follow the slot
+ *        allocated
+ *
+ * Return the index of a free slot, or SWAP_NONE if swap is full or
+ * there is no swap device.  May be called with interrupts off.
+*/
+size_t swap_alloc(size_t *next)
+{
+	struct swap_area *a = slot_area(*next);
+	size_t slot = BITMAP_ERROR;
+	size_t i, j;
+
+	if (area_cnt == 0)
+		return SWAP_NONE;
+
+	spinlock_acquire(&swap_lock);
+	if (a != NULL && !bitmap_test(a->slots, *next - a->first)) {
+		slot = *next;
+		bitmap_mark(a->slots, slot - a->first);
+	}
+
+	/* Each priority in turn, from the highest: areas [I, J). */
+	for (i = 0; slot == BITMAP_ERROR && i < area_cnt; i = j) {
+		size_t start;
+		size_t k;
+
+		for (j = i + 1; j < area_cnt; j++)
+			if (areas[j].priority != areas[i].priority)
+				break;
+		start = stripe_cnt++ % (j - i);
+		for (k = 0; slot == BITMAP_ERROR && k < j - i; k++)
+			slot = alloc_run(&areas[i + (start + k) % (j - i)],
+					 SWAP_CLUSTER);
+		for (k = 0; slot == BITMAP_ERROR && k < j - i; k++)
+			slot = alloc_run(&areas[i + (start + k) % (j - i)], 1);
+	}
+	spinlock_release(&swap_lock);
+
+	if (slot == BITMAP_ERROR)
+		return SWAP_NONE;
+	*next = slot + 1;
+	return slot;
+}
+
+/**
+ * swap_free - free a swap slot
+ *
+ * @slot: index of the slot, or SWAP_NONE
+ *
+ * Free the slot, and the compressed page it holds, if any.
+*/
+void swap_free(size_t slot)
+{
+	struct swap_area *a;
+	struct zpage *z;
+
+	if (slot == SWAP_NONE)
+		return;
+
+	a = slot_area(slot);
+	spinlock_acquire(&swap_lock);
+	ASSERT(bitmap_test(a->slots, slot - a->first));
+	z = zpages[slot];
+	if (z != NULL && z->writeback) {
+		/* The shrinker frees the slot and the block when done. */
+		ASSERT(!z->freed);
+		z->freed = true;
+		z = NULL;
+	} else {
+		bitmap_reset(a->slots, slot - a->first);
+		zpages[slot] = NULL;
+		if (z != NULL) {
+			zswap_bytes -= sizeof *z + z->size;
+			zswap_cnt--;
+		}
+	}
+	spinlock_release(&swap_lock);
+	free(z);
+}
+
+/**
+ * swap_write - write a page to a swap slot
+ *
+ * @slot: index of an allocated slot
+ * @kpage: kernel virtual address of the page
+ *
+ * Keep the page compressed in memory if it compresses well and
+ * there is room, otherwise write it to the swap device.
+*/
+void swap_write(size_t slot, const void *kpage)
+{
+	struct swap_area *a = slot_area(slot);
+
+	ASSERT(bitmap_test(a->slots, slot - a->first));
+
+	if (zswap_store(slot, kpage)) {
+		vmstat_count(VMSTAT_ZSWAP_OUT);
+		return;
+	}
+	block_write_multiple(a->device, (slot - a->first) * SLOT_SECTORS,
+			     SLOT_SECTORS, kpage);
+	vmstat_count(VMSTAT_SWAP_OUT);
+}
+
+/**
+ * swap_read - read a page from a swap slot
+ *
+ * @slot: index of an allocated slot
+ * @kpage: kernel virtual address of the page
+*/
+void swap_read(size_t slot, void *kpage)
+{
+	swap_read_cluster(&slot, &kpage, 1);
+}
+
+/**
+ * swap_read_cluster - read pages from several swap slots
+ *
+ * @slots: indexes of allocated slots
+ * @kpages: kernel virtual addresses of the pages to read them into
+ * @cnt: number of slots, at most SWAP_CLUSTER
+ *
+ * Like swap_read() on each slot, but submit all the reads from the
+ * swap devices before waiting for any, so that the block layer
+ * merges those of adjacent slots into one transfer, and reads from
+ * different devices overlap.
+*/
+void swap_read_cluster(const size_t slots[], void *kpages[], size_t cnt)
+{
+	struct block_request reqs[SWAP_CLUSTER];
+	size_t req_cnt = 0;
+	size_t i;
+
+	ASSERT(cnt <= SWAP_CLUSTER);
+
+	for (i = 0; i < cnt; i++) {
+		struct swap_area *a = slot_area(slots[i]);
+
+		ASSERT(bitmap_test(a->slots, slots[i] - a->first));
+		if (zswap_load(slots[i], kpages[i]))
+			continue;
+		block_request_init(&reqs[req_cnt], false,
+				   (slots[i] - a->first) * SLOT_SECTORS,
+				   SLOT_SECTORS, kpages[i], NULL, NULL);
+		block_submit(a->device, &reqs[req_cnt++]);
+	}
+	for (i = 0; i < req_cnt; i++) {
+		block_wait(&reqs[i]);
+		vmstat_count(VMSTAT_SWAP_IN);
+	}
+}
+
+/* Returns the area that holds SLOT, or a null pointer if SLOT is
+   out of range, as SWAP_NONE is. */
+static struct swap_area *
+slot_area (size_t slot)
+{
+  size_t i;
+
+  if (slot >= slot_cnt)
+    return NULL;
+  for (i = area_cnt - 1; areas[i].first > slot; i--)
+    continue;
+  return &areas[i];
+}
+
+/* Takes a run of CNT free slots in area A, next fit, marking the
+   first allocated and leaving the rest free, for the process that
+   is given the first to take next.  Returns the number of the
+   first slot, or BITMAP_ERROR if A has no such run.  Caller must
+   hold swap_lock. */
+static size_t
+alloc_run (struct swap_area *a, size_t cnt)
+{
+  size_t idx = bitmap_scan_and_flip_next (a->slots, cnt, false);
+
+  if (idx == BITMAP_ERROR)
+    return BITMAP_ERROR;
+  bitmap_set_multiple (a->slots, idx + 1, cnt - 1, false);
+  return a->first + idx;
+}
+
+/* Decompresses the page in SLOT into KPAGE, if it is kept in
+   memory.  Returns false if it is on the swap device. */
+static bool
+zswap_load (size_t slot, void *kpage)
+{
+  struct zpage *z;
+
+  /* Only the slot's owner frees the slot, and the shrinker frees
+     the block only while holding compress_lock, so Z stays valid. */
+  lock_acquire (&compress_lock);
+  spinlock_acquire (&swap_lock);
+  z = zpages[slot];
+  spinlock_release (&swap_lock);
+  if (z != NULL && !lz4_decompress (z->data, z->size, kpage, PGSIZE))
+    PANIC ("swap_read: corrupt compressed page");
+  lock_release (&compress_lock);
+  if (z == NULL)
+    return false;
+
+  vmstat_count (VMSTAT_ZSWAP_IN);
+  return true;
+}
+
+/* Compresses KPAGE into a block of its own for SLOT.  Returns
+   false if it does not compress well enough, or there is no room
+   for it in memory. */
+static bool
+zswap_store (size_t slot, const void *kpage)
+{
+  struct zpage *z = NULL;
+  size_t size;
+  bool fits = false;
+
+  lock_acquire (&compress_lock);
+  size = lz4_compress (kpage, PGSIZE, compress_buf, ZSWAP_MAX_SIZE,
+                       compress_table);
+  if (size > 0)
+    {
+      spinlock_acquire (&swap_lock);
+      fits = zswap_bytes + sizeof *z + size <= zswap_limit;
+      if (fits)
+        zswap_bytes += sizeof *z + size;
+      spinlock_release (&swap_lock);
+
+      if (fits)
+        {
+          z = malloc (sizeof *z + size);
+          if (z != NULL)
+            {
+              z->size = size;
+              z->writeback = z->freed = false;
+              memcpy (z->data, compress_buf, size);
+            }
+        }
+    }
+  lock_release (&compress_lock);
+  if (size == 0 || !fits)
+    return false;
+
+  spinlock_acquire (&swap_lock);
+  if (z != NULL)
+    {
+      zpages[slot] = z;
+      zswap_cnt++;
+    }
+  else
+    zswap_bytes -= sizeof *z + size;
+  spinlock_release (&swap_lock);
+  return z != NULL;
+}
+
+/* Returns the number of compressed pages, all of which the
+   shrinker could write back. */
+static size_t
+zswap_shrink_count (void)
+{
+  return zswap_cnt;
+}
+
+/* Writes up to NR compressed pages back to their slots on the swap
+   device and frees their blocks, taking the slots round-robin.
+   Returns the number written back. */
+static size_t
+zswap_shrink_scan (size_t nr)
+{
+  size_t done = 0, steps;
+
+  /* The running thread may be compressing a page for zswap_store(),
+     which is what ran the kernel pool short. */
+  if (lock_held_by_current_thread (&compress_lock)
+      || !lock_try_acquire (&compress_lock))
+    return 0;
+  for (steps = 0; steps < slot_cnt && done < nr; steps++)
+    {
+      size_t slot = zswap_hand;
+      struct swap_area *a = slot_area (slot);
+      struct zpage *z;
+
+      zswap_hand = (zswap_hand + 1) % slot_cnt;
+      spinlock_acquire (&swap_lock);
+      z = zpages[slot];
+      if (z != NULL)
+        z->writeback = true;
+      spinlock_release (&swap_lock);
+      if (z == NULL)
+        continue;
+
+      if (!lz4_decompress (z->data, z->size, writeback_page, PGSIZE))
+        PANIC ("swap: corrupt compressed page");
+      block_write_multiple (a->device, (slot - a->first) * SLOT_SECTORS,
+                            SLOT_SECTORS, writeback_page);
+      vmstat_count (VMSTAT_SWAP_OUT);
+
+      spinlock_acquire (&swap_lock);
+      zpages[slot] = NULL;
+      zswap_bytes -= sizeof *z + z->size;
+      zswap_cnt--;
+      if (z->freed)
+        bitmap_reset (a->slots, slot - a->first);
+      spinlock_release (&swap_lock);
+      free (z);
+      done++;
+    }
+  lock_release (&compress_lock);
+  return done;
+}
@@ -0,0 +1,25 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* No swap slot. */
+#define SWAP_NONE SIZE_MAX
+
+/* Slots set aside at a time for the pages of one process, and
+   most slots read in together. */
+#define SWAP_CLUSTER 8
+
+struct block;
+
+bool swap_add_area (struct block *, int priority);
+void swap_init (void);
+size_t swap_alloc (size_t *next);
+void swap_free (size_t slot);
+void swap_write (size_t slot, const void *kpage);
+void swap_read (size_t slot, void *kpage);
+void swap_read_cluster (const size_t slots[], void *kpages[], size_t cnt);
+
+#endif /* vm/swap.h */